@@ -31,10 +31,12 @@ struct _51d_property_names {
 };
 
 #ifdef FIFTYONEDEGREES_H_PATTERN_INCLUDED
-static struct lru64_head *_51d_lru_tree = NULL;
+/* Each thread owns its own LRU tree so that lookups and insertions never
+ * need any locking. The seed is common to all threads so that the trees
+ * remain comparable in efficiency for a given traffic pattern.
+ */
+static THREAD_LOCAL struct lru64_head *_51d_lru_tree = NULL;
 static unsigned long long _51d_lru_seed;
-
-__decl_spinlock(_51d_lru_lock);
 #endif
 
 #ifdef FIFTYONE_DEGREES_HASH_INCLUDED
@@ -244,9 +246,7 @@ static void _51d_insert_cache_entry(struct sample *smp, struct lru64 *lru, void*
 	memcpy(cache_entry->area, smp->data.u.str.area, smp->data.u.str.data);
 	cache_entry->area[smp->data.u.str.data] = 0;
 	cache_entry->data = smp->data.u.str.data;
-	HA_SPIN_LOCK(OTHER_LOCK, &_51d_lru_lock);
 	lru64_commit(lru, cache_entry, domain, 0, _51d_lru_free);
-	HA_SPIN_UNLOCK(OTHER_LOCK, &_51d_lru_lock);
 }
 
 /* Retrieves the data from the cache and sets the sample data to this string.
@@ -691,20 +691,16 @@ static int _51d_fetch(const struct arg *args, struct sample *smp, const char *kw
 
 	/* Check the cache to see if there's results for these headers already. */
 	if (_51d_lru_tree) {
-		HA_SPIN_LOCK(OTHER_LOCK, &_51d_lru_lock);
-
 		lru = lru64_get(_51d_req_hash(args, ws),
 		                _51d_lru_tree, (void*)args, 0);
 
 		if (lru && lru->domain) {
 			fiftyoneDegreesWorksetPoolRelease(global_51degrees.pool, ws);
 			_51d_retrieve_cache_entry(smp, lru);
-			HA_SPIN_UNLOCK(OTHER_LOCK, &_51d_lru_lock);
 
 			_51d_set_smp(smp);
 			return 1;
 		}
-		HA_SPIN_UNLOCK(OTHER_LOCK, &_51d_lru_lock);
 	}
 
 	fiftyoneDegreesMatchForHttpHeaders(ws);
@@ -777,15 +773,12 @@ static int _51d_conv(const struct arg *args, struct sample *smp, void *private)
 	if (_51d_lru_tree) {
 		unsigned long long seed = _51d_lru_seed ^ (long)args;
 
-		HA_SPIN_LOCK(OTHER_LOCK, &_51d_lru_lock);
 		lru = lru64_get(XXH3(smp->data.u.str.area, smp->data.u.str.data, seed),
 		                _51d_lru_tree, (void*)args, 0);
 		if (lru && lru->domain) {
 			_51d_retrieve_cache_entry(smp, lru);
-			HA_SPIN_UNLOCK(OTHER_LOCK, &_51d_lru_lock);
 			return 1;
 		}
-		HA_SPIN_UNLOCK(OTHER_LOCK, &_51d_lru_lock);
 	}
 
 	/* Create workset. This will later contain detection results. */
@@ -983,9 +976,6 @@ static int init_51degrees(void)
 
 #ifdef FIFTYONEDEGREES_H_PATTERN_INCLUDED
 	_51d_lru_seed = ha_random();
-	if (global_51degrees.cache_size) {
-		_51d_lru_tree = lru64_new(global_51degrees.cache_size);
-	}
 #endif
 
 #elif defined(FIFTYONE_DEGREES_HASH_INCLUDED)
@@ -1072,11 +1062,25 @@ static void deinit_51degrees(void)
 		LIST_DELETE(&_51d_prop_name->list);
 		free(_51d_prop_name);
 	}
+}
 
 #ifdef FIFTYONEDEGREES_H_PATTERN_INCLUDED
+static int alloc_51degrees_per_thread()
+{
+	if (global_51degrees.cache_size) {
+		_51d_lru_tree = lru64_new(global_51degrees.cache_size);
+		if (!_51d_lru_tree)
+			return 0;
+	}
+	return 1;
+}
+
+static void free_51degrees_per_thread()
+{
 	while (lru64_destroy(_51d_lru_tree));
-#endif
+	_51d_lru_tree = NULL;
 }
+#endif
 
 #ifdef FIFTYONE_DEGREES_HASH_INCLUDED
 static int init_51degrees_per_thread()
@@ -1157,6 +1161,8 @@ REGISTER_POST_CHECK(init_51degrees);
 REGISTER_POST_DEINIT(deinit_51degrees);
 
 #if defined(FIFTYONEDEGREES_H_PATTERN_INCLUDED)
+	REGISTER_PER_THREAD_ALLOC(alloc_51degrees_per_thread);
+	REGISTER_PER_THREAD_FREE(free_51degrees_per_thread);
 #ifndef FIFTYONEDEGREES_DUMMY_LIB
 	REGISTER_BUILD_OPTS("Built with 51Degrees Pattern support.");
 #else
@@ -3,6 +3,7 @@
 #include <sys/mman.h>
 #include <errno.h>
 
+#include <import/lru.h>
 #include <haproxy/api.h>
 #include <haproxy/arg.h>
 #include <haproxy/cfgparse.h>
@@ -14,7 +15,9 @@
 #include <haproxy/http_htx.h>
 #include <haproxy/htx.h>
 #include <haproxy/sample.h>
+#include <haproxy/thread.h>
 #include <haproxy/tools.h>
+#include <haproxy/xxhash.h>
 #include <dac.h>
 
 #define ATLASTOKSZ PATH_MAX
@@ -32,6 +35,7 @@ static struct {
 	da_severity_t loglevel;
 	char separator;
 	unsigned char daset:1;
+	int cache_size;
 } global_deviceatlas = {
 	.loglevel = 0,
 	.jsonpath = 0,
@@ -42,10 +46,20 @@ static struct {
 	.useragentid = 0,
 	.daset = 0,
 	.separator = '|',
+	.cache_size = 0,
 };
 
 __decl_thread(HA_SPINLOCK_T dadwsch_lock);
 
+/* Each thread owns its own LRU tree of resolved property sets so that
+ * lookups and insertions never need any locking. The instance generation
+ * is bumped each time a new data file instance is installed, which
+ * atomically invalidates all entries resolved with the previous one.
+ */
+static THREAD_LOCAL struct lru64_head *da_lru_tree = NULL;
+static unsigned long long da_lru_seed;
+static unsigned long long da_instance_gen = 1;
+
 static int da_json_file(char **args, int section_type, struct proxy *curpx,
                         const struct proxy *defpx, const char *file, int line,
                         char **err)
@@ -104,6 +118,22 @@ static int da_properties_cookie(char **args, int section_type, struct proxy *cur
 	return 0;
 }
 
+static int da_cache_size(char **args, int section_type, struct proxy *curpx,
+                         const struct proxy *defpx, const char *file, int line,
+                         char **err)
+{
+	if (*(args[1]) == 0) {
+		memprintf(err, "deviceatlas cache size : expects an integer argument.\n");
+		return -1;
+	}
+	global_deviceatlas.cache_size = atoi(args[1]);
+	if (global_deviceatlas.cache_size < 0) {
+		memprintf(err, "deviceatlas cache size : expects a positive number of entries, %s given.\n", args[1]);
+		return -1;
+	}
+	return 0;
+}
+
 static size_t da_haproxy_read(void *ctx, size_t len, char *buf)
 {
 	return fread(buf, 1, len, ctx);
@@ -186,6 +216,7 @@ static int init_deviceatlas(void)
 			}
 		}
 		global_deviceatlas.daset = 1;
+		da_lru_seed = ha_random();
 
 		fprintf(stdout, "Deviceatlas module loaded.\n");
 	}
@@ -215,6 +246,22 @@ static void deinit_deviceatlas(void)
 	da_fini();
 }
 
+static int alloc_deviceatlas_per_thread()
+{
+	if (global_deviceatlas.daset == 1 && global_deviceatlas.cache_size) {
+		da_lru_tree = lru64_new(global_deviceatlas.cache_size);
+		if (!da_lru_tree)
+			return 0;
+	}
+	return 1;
+}
+
+static void free_deviceatlas_per_thread()
+{
+	while (lru64_destroy(da_lru_tree));
+	da_lru_tree = NULL;
+}
+
 static void da_haproxy_checkinst(void)
 {
 	if (global_deviceatlas.atlasmap != 0) {
@@ -244,6 +291,9 @@ static void da_haproxy_checkinst(void)
 					jsond = da_getdatacreation(&global_deviceatlas.atlas);
 					ctime_r(&jsond, jsonbuf);
 					jsonbuf[24] = 0;
+					/* invalidate all the detection results cached
+					 * with the previous instance */
+					HA_ATOMIC_INC(&da_instance_gen);
 					printf("deviceatlas: new instance, data file date `%s`.\n", jsonbuf);
 				} else {
 					ha_warning("deviceatlas: instance update failed.\n");
@@ -258,6 +308,53 @@ static void da_haproxy_checkinst(void)
 	}
 }
 
+static void da_lru_free(void *cache_entry)
+{
+	struct buffer *ptr = cache_entry;
+
+	if (!ptr)
+		return;
+
+	free(ptr->area);
+	free(ptr);
+}
+
+/* Insert the resolved property set into the cache. A NULL entry is committed
+ * on detection failure so that the locked node is always released.
+ */
+static void da_insert_cache_entry(struct sample *smp, struct lru64 *lru, void *domain)
+{
+	struct buffer *cache_entry = malloc(sizeof(*cache_entry));
+
+	if (!cache_entry)
+		goto fail;
+
+	cache_entry->area = malloc(smp->data.u.str.data + 1);
+	if (!cache_entry->area) {
+		free(cache_entry);
+		goto fail;
+	}
+
+	memcpy(cache_entry->area, smp->data.u.str.area, smp->data.u.str.data);
+	cache_entry->area[smp->data.u.str.data] = 0;
+	cache_entry->data = smp->data.u.str.data;
+	lru64_commit(lru, cache_entry, domain, HA_ATOMIC_LOAD(&da_instance_gen), da_lru_free);
+	return;
+fail:
+	lru64_commit(lru, NULL, domain, HA_ATOMIC_LOAD(&da_instance_gen), da_lru_free);
+}
+
+/* Sets the sample to the cached property set without copying it. */
+static void da_retrieve_cache_entry(struct sample *smp, struct lru64 *lru)
+{
+	struct buffer *cache_entry = lru->data;
+
+	smp->data.u.str.area = cache_entry->area;
+	smp->data.u.str.data = cache_entry->data;
+	smp->data.type = SMP_T_STR;
+	smp->flags |= SMP_F_CONST;
+}
+
 static int da_haproxy(const struct arg *args, struct sample *smp, da_deviceinfo_t *devinfo)
 {
 	struct buffer *tmp;
@@ -335,6 +432,7 @@ static int da_haproxy_conv(const struct arg *args, struct sample *smp, void *pri
 {
 	da_deviceinfo_t devinfo;
 	da_status_t status;
+	struct lru64 *lru = NULL;
 	const char *useragent;
 	char useragentbuf[1024] = { 0 };
 	int i;
@@ -351,10 +449,31 @@ static int da_haproxy_conv(const struct arg *args, struct sample *smp, void *pri
 
 	useragent = (const char *)useragentbuf;
 
+	/* Check the cache for a previous detection of this User-Agent. */
+	if (da_lru_tree) {
+		unsigned long long seed = da_lru_seed ^ (long)args;
+
+		lru = lru64_get(XXH3(useragent, strlen(useragent), seed),
+		                da_lru_tree, (void *)args, HA_ATOMIC_LOAD(&da_instance_gen));
+		if (lru && lru->domain) {
+			if (!lru->data)
+				return 0;
+			da_retrieve_cache_entry(smp, lru);
+			return 1;
+		}
+	}
+
 	status = da_search(&global_deviceatlas.atlas, &devinfo,
 		global_deviceatlas.useragentid, useragent, 0);
+	if (status != DA_OK || !da_haproxy(args, smp, &devinfo)) {
+		if (lru)
+			lru64_commit(lru, NULL, (void *)args, HA_ATOMIC_LOAD(&da_instance_gen), da_lru_free);
+		return 0;
+	}
 
-	return status != DA_OK ? 0 : da_haproxy(args, smp, &devinfo);
+	if (lru)
+		da_insert_cache_entry(smp, lru, (void *)args);
+	return 1;
 }
 
 #define DA_MAX_HEADERS       24
@@ -364,6 +483,7 @@ static int da_haproxy_fetch(const struct arg *args, struct sample *smp, const ch
 	da_evidence_t ev[DA_MAX_HEADERS];
 	da_deviceinfo_t devinfo;
 	da_status_t status;
+	struct lru64 *lru = NULL;
 	struct channel *chn;
 	struct htx *htx;
 	struct htx_blk *blk;
@@ -452,10 +572,38 @@ static int da_haproxy_fetch(const struct arg *args, struct sample *smp, const ch
 		++ nbh;
 	}
 
+	/* Hash the collected evidence and check the cache for a previous
+	 * detection of the same set.
+	 */
+	if (da_lru_tree) {
+		unsigned long long seed = da_lru_seed ^ (long)args;
+		unsigned long long hash = 0;
+
+		for (i = 0; i < nbh; i++) {
+			hash ^= ev[i].key;
+			hash ^= XXH3(ev[i].value, strlen(ev[i].value), seed);
+		}
+
+		lru = lru64_get(hash, da_lru_tree, (void *)args, HA_ATOMIC_LOAD(&da_instance_gen));
+		if (lru && lru->domain) {
+			if (!lru->data)
+				return 0;
+			da_retrieve_cache_entry(smp, lru);
+			return 1;
+		}
+	}
+
 	status = da_searchv(&global_deviceatlas.atlas, &devinfo,
 			ev, nbh);
+	if (status != DA_OK || !da_haproxy(args, smp, &devinfo)) {
+		if (lru)
+			lru64_commit(lru, NULL, (void *)args, HA_ATOMIC_LOAD(&da_instance_gen), da_lru_free);
+		return 0;
+	}
 
-	return status != DA_OK ? 0 : da_haproxy(args, smp, &devinfo);
+	if (lru)
+		da_insert_cache_entry(smp, lru, (void *)args);
+	return 1;
 }
 
 static struct cfg_kw_list dacfg_kws = {{ }, {
@@ -463,6 +611,7 @@ static struct cfg_kw_list dacfg_kws = {{ }, {
 		{ CFG_GLOBAL, "deviceatlas-log-level",	  da_log_level },
 		{ CFG_GLOBAL, "deviceatlas-property-separator", da_property_separator },
 		{ CFG_GLOBAL, "deviceatlas-properties-cookie", da_properties_cookie },
+		{ CFG_GLOBAL, "deviceatlas-cache-size", da_cache_size },
 		{ 0, NULL, NULL },
 }};
 
@@ -498,4 +647,6 @@ INITCALL1(STG_REGISTER, sample_register_convs, &conv_kws);
 
 REGISTER_POST_CHECK(init_deviceatlas);
 REGISTER_POST_DEINIT(deinit_deviceatlas);
+REGISTER_PER_THREAD_ALLOC(alloc_deviceatlas_per_thread);
+REGISTER_PER_THREAD_FREE(free_deviceatlas_per_thread);
 INITCALL0(STG_REGISTER, da_haproxy_register_build_options);
@@ -159,6 +159,7 @@ struct flt_ot_conf_tracer {
 	char              *plugin;        /* The OpenTracing plugin library file name. */
 	struct otc_tracer *tracer;        /* The OpenTracing tracer handle. */
 	uint32_t           rate_limit;    /* [0 2^32-1] <-> [0.0 100.0] */
+	char              *rate_limit_key; /* Request header used for the deterministic sampling decision. */
 	bool               flag_harderr;  /* [0 1] */
 	bool               flag_disabled; /* [0 1] */
 	uint8_t            logging;       /* [0 1 3] */
@@ -37,6 +37,7 @@
 #include <haproxy/tcp_rules.h>
 #include <haproxy/tools.h>
 #include <haproxy/vars.h>
+#include <haproxy/xxhash.h>
 
 #include "config.h"
 #include "debug.h"
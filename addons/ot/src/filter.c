@@ -500,6 +500,39 @@ static void flt_ot_deinit_per_thread(struct proxy *p, struct flt_conf *fconf)
 #endif /* DEBUG_OT */
 
 
+/***
+ * NAME
+ *   flt_ot_sampling_value -
+ *
+ * ARGUMENTS
+ *   s    -
+ *   conf -
+ *
+ * DESCRIPTION
+ *   Returns the value compared against the tracer rate limit to decide
+ *   whether the stream is traced.  When the 'rate-limit-key' header is
+ *   configured and present in the request, an unseeded hash of its value
+ *   is used so that the decision is deterministic: all the requests of a
+ *   trace, and all the proxies in a chain seeing the same trace ID, take
+ *   the same decision.  Otherwise a random value is returned.
+ *
+ * RETURN VALUE
+ *   A value in the range [0 2^32-1] compared against the rate limit.
+ */
+static uint32_t flt_ot_sampling_value(const struct stream *s, const struct flt_ot_conf *conf)
+{
+	if ((conf->tracer->rate_limit_key != NULL) && IS_HTX_STRM(s)) {
+		struct htx          *htx = htxbuf(&(s->req.buf));
+		struct http_hdr_ctx  ctx = { .blk = NULL };
+
+		if (!htx_is_empty(htx) && http_find_header(htx, ist(conf->tracer->rate_limit_key), &ctx, 0))
+			return XXH32(istptr(ctx.value), istlen(ctx.value), 0);
+	}
+
+	return ha_random32();
+}
+
+
 /***
  * NAME
  *   flt_ot_attach - Called when a filter instance is created and attach to a stream.
@@ -532,7 +565,7 @@ static int flt_ot_attach(struct stream *s, struct filter *f)
 		FLT_OT_RETURN_INT(FLT_OT_RET_IGNORE);
 	}
 	else if (conf->tracer->rate_limit < FLT_OT_FLOAT_U32(FLT_OT_RATE_LIMIT_MAX, FLT_OT_RATE_LIMIT_MAX)) {
-		uint32_t rnd = ha_random32();
+		uint32_t rnd = flt_ot_sampling_value(s, conf);
 
 		if (conf->tracer->rate_limit <= rnd) {
 			FLT_OT_DBG(2, "filter '%s', type: %s (ignored: %u <= %u)", conf->id, flt_ot_type(f), conf->tracer->rate_limit, rnd);
@@ -523,6 +523,9 @@ static int flt_ot_parse_cfg_tracer(const char *file, int linenum, char **args, i
 	else if (pdata->keyword == FLT_OT_PARSE_TRACER_RATE_LIMIT) {
 		flt_ot_current_tracer->rate_limit = FLT_OT_FLOAT_U32(flt_ot_strtod(args[1], 0.0, FLT_OT_RATE_LIMIT_MAX, &err), FLT_OT_RATE_LIMIT_MAX);
 	}
+	else if (pdata->keyword == FLT_OT_PARSE_TRACER_RATE_LIMIT_KEY) {
+		retval = flt_ot_parse_strdup(&(flt_ot_current_tracer->rate_limit_key), args[1], &err, args[0]);
+	}
 	else if (pdata->keyword == FLT_OT_PARSE_TRACER_OPTION) {
 		if (strcmp(args[1], FLT_OT_PARSE_OPTION_DISABLED) == 0) {
 			flt_ot_current_tracer->flag_disabled = (kw_mod == KWM_NO) ? 0 : 1;
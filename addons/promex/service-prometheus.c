@@ -13,14 +13,18 @@
  *
  */
 
+#include <import/ebmbtree.h>
+
 #include <haproxy/action-t.h>
 #include <haproxy/api.h>
 #include <haproxy/applet.h>
 #include <haproxy/backend.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/check.h>
+#include <haproxy/clock.h>
 #include <haproxy/frontend.h>
 #include <haproxy/global.h>
+#include <haproxy/host_stats.h>
 #include <haproxy/http.h>
 #include <haproxy/http_ana.h>
 #include <haproxy/http_htx.h>
@@ -36,6 +40,8 @@
 #include <haproxy/stconn.h>
 #include <haproxy/stream.h>
 #include <haproxy/task.h>
+#include <haproxy/thread.h>
+#include <haproxy/ticks.h>
 #include <haproxy/tools.h>
 #include <haproxy/version.h>
 
@@ -57,6 +63,7 @@ enum {
 	PROMEX_DUMPER_LI,         /* dump metrics of listeners */
 	PROMEX_DUMPER_SRV,        /* dump metrics of servers */
 	PROMEX_DUMPER_STICKTABLE, /* dump metrics of stick tables */
+	PROMEX_DUMPER_HOSTSTATS,  /* dump per-host metrics */
 	PROMEX_DUMPER_DONE,       /* finished */
 };
 
@@ -75,10 +82,15 @@ enum {
 #define PROMEX_FL_SCOPE_LI          0x00000800
 #define PROMEX_FL_SCOPE_STICKTABLE  0x00001000
 #define PROMEX_FL_NO_MAINT_SRV      0x00002000
+#define PROMEX_FL_CACHE_READ        0x00004000
+#define PROMEX_FL_CACHE_FILL        0x00008000
+#define PROMEX_FL_HOSTSTATS_METRIC  0x00010000
+#define PROMEX_FL_SCOPE_HOSTSTATS   0x00020000
 
 #define PROMEX_FL_SCOPE_ALL (PROMEX_FL_SCOPE_GLOBAL | PROMEX_FL_SCOPE_FRONT | \
 			     PROMEX_FL_SCOPE_LI | PROMEX_FL_SCOPE_BACK | \
-			     PROMEX_FL_SCOPE_SERVER | PROMEX_FL_SCOPE_STICKTABLE)
+			     PROMEX_FL_SCOPE_SERVER | PROMEX_FL_SCOPE_STICKTABLE | \
+			     PROMEX_FL_SCOPE_HOSTSTATS)
 
 /* the context of the applet */
 struct promex_ctx {
@@ -88,9 +100,41 @@ struct promex_ctx {
 	struct server *sv;         /* current server */
 	unsigned int flags;	   /* PROMEX_FL_* */
 	unsigned field_num;        /* current field number (ST_F_* etc) */
+	unsigned int hs_shard;     /* current per-host stats shard */
+	struct host_stats_entry *hs_entry; /* referenced per-host entry to resume from, or NULL */
 	int obj_state;             /* current state among PROMEX_{FRONT|BACK|SRV|LI}_STATE_* */
+	size_t cache_ofs;          /* amount of the cached snapshot already sent (PROMEX_FL_CACHE_READ) */
+	int cache_idx;             /* index of the snapshot buffer this applet reads or fills */
 };
 
+/* One buffer of the snapshot cache below. <users> counts the applets currently
+ * streaming it and the buffer cannot be recycled as long as it is non-null.
+ */
+struct promex_cache_buf {
+	char *area;                /* the rendered exposition */
+	size_t data;               /* number of bytes used in <area> */
+	size_t size;               /* allocated size of <area> */
+	unsigned int users;        /* number of readers currently attached */
+	unsigned int scopes;       /* scope and no-maint flags the snapshot was built with */
+};
+
+/* Double-buffered cache of the rendered exposition. While readers stream the
+ * <live> buffer, the next scrape renders into the other one and flips <live>
+ * once complete, so that any scrape arriving before <expire> boils down to
+ * copying already formatted text. It is only enabled when a validity period
+ * is set with "tune.promex.snapshot-expire" in the global section.
+ */
+static struct {
+	struct promex_cache_buf b[2];
+	int live;                  /* index of the buffer served to readers, -1 if none yet */
+	unsigned int expire;       /* tick at which the live buffer becomes stale */
+	unsigned int filling;      /* non-null while an applet renders into the back buffer */
+	__decl_thread(HA_RWLOCK_T lock);
+} promex_cache = { .live = -1 };
+
+/* validity period of a snapshot, in ms ("tune.promex.snapshot-expire", 0 = disabled) */
+static unsigned int promex_snapshot_expire = 0;
+
 /* Promtheus metric type (gauge or counter) */
 enum promex_mt_type {
 	PROMEX_MT_GAUGE   = 1,
@@ -287,6 +331,8 @@ const struct promex_metric promex_st_metrics[ST_F_TOTAL_FIELDS] = {
 	[ST_F_WREW]                 = { .n = IST("failed_header_rewriting_total"),    .type = PROMEX_MT_COUNTER,  .flags = (PROMEX_FL_FRONT_METRIC | PROMEX_FL_LI_METRIC | PROMEX_FL_BACK_METRIC | PROMEX_FL_SRV_METRIC) },
 	[ST_F_CONNECT]              = { .n = IST("connection_attempts_total"),        .type = PROMEX_MT_COUNTER,  .flags = (                                               PROMEX_FL_BACK_METRIC | PROMEX_FL_SRV_METRIC) },
 	[ST_F_REUSE]                = { .n = IST("connection_reuses_total"),          .type = PROMEX_MT_COUNTER,  .flags = (                                               PROMEX_FL_BACK_METRIC | PROMEX_FL_SRV_METRIC) },
+	[ST_F_CONNECT_TFO]          = { .n = IST("connection_fastopen_total"),        .type = PROMEX_MT_COUNTER,  .flags = (                                               PROMEX_FL_BACK_METRIC | PROMEX_FL_SRV_METRIC) },
+	[ST_F_CONNECT_TFO_FALL]     = { .n = IST("connection_fastopen_fallbacks_total"), .type = PROMEX_MT_COUNTER,  .flags = (                                            PROMEX_FL_BACK_METRIC | PROMEX_FL_SRV_METRIC) },
 	[ST_F_CACHE_LOOKUPS]        = { .n = IST("http_cache_lookups_total"),         .type = PROMEX_MT_COUNTER,  .flags = (PROMEX_FL_FRONT_METRIC |                       PROMEX_FL_BACK_METRIC                       ) },
 	[ST_F_CACHE_HITS]           = { .n = IST("http_cache_hits_total"),            .type = PROMEX_MT_COUNTER,  .flags = (PROMEX_FL_FRONT_METRIC |                       PROMEX_FL_BACK_METRIC                       ) },
 	[ST_F_SRV_ICUR]             = { .n = IST("idle_connections_current"),         .type = PROMEX_MT_GAUGE,    .flags = (                                                                       PROMEX_FL_SRV_METRIC) },
@@ -341,6 +387,39 @@ const struct ist promex_sticktable_metric_desc[STICKTABLE_TOTAL_FIELDS] = {
 	[STICKTABLE_USED] = IST("Number of entries used in this stick table."),
 };
 
+/* Per-host metrics */
+enum {
+	HOSTSTATS_REQ_TOT = 0,
+	HOSTSTATS_HRSP_1XX,
+	HOSTSTATS_HRSP_2XX,
+	HOSTSTATS_HRSP_3XX,
+	HOSTSTATS_HRSP_4XX,
+	HOSTSTATS_HRSP_5XX,
+	HOSTSTATS_HRSP_OTHER,
+
+	HOSTSTATS_TOTAL_FIELDS
+};
+
+const struct promex_metric promex_hoststats_metrics[HOSTSTATS_TOTAL_FIELDS] = {
+	[HOSTSTATS_REQ_TOT]    = { .n = IST("http_requests_total"),  .type = PROMEX_MT_COUNTER, .flags = PROMEX_FL_HOSTSTATS_METRIC },
+	[HOSTSTATS_HRSP_1XX]   = { .n = IST("http_responses_total"), .type = PROMEX_MT_COUNTER, .flags = PROMEX_FL_HOSTSTATS_METRIC },
+	[HOSTSTATS_HRSP_2XX]   = { .n = IST("http_responses_total"), .type = PROMEX_MT_COUNTER, .flags = PROMEX_FL_HOSTSTATS_METRIC },
+	[HOSTSTATS_HRSP_3XX]   = { .n = IST("http_responses_total"), .type = PROMEX_MT_COUNTER, .flags = PROMEX_FL_HOSTSTATS_METRIC },
+	[HOSTSTATS_HRSP_4XX]   = { .n = IST("http_responses_total"), .type = PROMEX_MT_COUNTER, .flags = PROMEX_FL_HOSTSTATS_METRIC },
+	[HOSTSTATS_HRSP_5XX]   = { .n = IST("http_responses_total"), .type = PROMEX_MT_COUNTER, .flags = PROMEX_FL_HOSTSTATS_METRIC },
+	[HOSTSTATS_HRSP_OTHER] = { .n = IST("http_responses_total"), .type = PROMEX_MT_COUNTER, .flags = PROMEX_FL_HOSTSTATS_METRIC },
+};
+
+const struct ist promex_hoststats_metric_desc[HOSTSTATS_TOTAL_FIELDS] = {
+	[HOSTSTATS_REQ_TOT]    = IST("Total number of HTTP requests received for this host."),
+	[HOSTSTATS_HRSP_1XX]   = IST("Total number of HTTP responses per host."),
+	[HOSTSTATS_HRSP_2XX]   = IST("Total number of HTTP responses per host."),
+	[HOSTSTATS_HRSP_3XX]   = IST("Total number of HTTP responses per host."),
+	[HOSTSTATS_HRSP_4XX]   = IST("Total number of HTTP responses per host."),
+	[HOSTSTATS_HRSP_5XX]   = IST("Total number of HTTP responses per host."),
+	[HOSTSTATS_HRSP_OTHER] = IST("Total number of HTTP responses per host."),
+};
+
 /* Specific labels for all ST_F_HRSP_* fields */
 const struct ist promex_hrsp_code[1 + ST_F_HRSP_OTHER - ST_F_HRSP_1XX] = {
 	[ST_F_HRSP_1XX - ST_F_HRSP_1XX]   = IST("1xx"),
@@ -437,6 +516,142 @@ static int promex_metric_to_str(struct buffer *out, struct field *f, size_t max)
 	return 1;
 }
 
+/* Attach the applet to the snapshot cache, if enabled. If a fresh snapshot
+ * matching the requested scopes exists, the applet becomes a reader and will
+ * only copy it. Otherwise, if no applet is already doing so and the back
+ * buffer is idle, this one will feed it while performing its regular dump. In
+ * any other case the dump proceeds without the cache. The reference taken
+ * here is always released by promex_appctx_release().
+ */
+static void promex_cache_join(struct appctx *appctx)
+{
+	struct promex_ctx *ctx = appctx->svcctx;
+	unsigned int scopes = (ctx->flags & (PROMEX_FL_SCOPE_ALL|PROMEX_FL_NO_MAINT_SRV));
+	int back;
+
+	if (!promex_snapshot_expire)
+		return;
+
+	HA_RWLOCK_WRLOCK(OTHER_LOCK, &promex_cache.lock);
+	if (promex_cache.live >= 0 && promex_cache.b[promex_cache.live].scopes == scopes &&
+	    !tick_is_expired(promex_cache.expire, now_ms)) {
+		ctx->cache_idx = promex_cache.live;
+		promex_cache.b[ctx->cache_idx].users++;
+		ctx->flags |= PROMEX_FL_CACHE_READ;
+	}
+	else if (!promex_cache.filling) {
+		back = (promex_cache.live == 0) ? 1 : 0;
+		if (!promex_cache.b[back].users) {
+			promex_cache.b[back].data = 0;
+			promex_cache.b[back].scopes = scopes;
+			promex_cache.filling = 1;
+			ctx->cache_idx = back;
+			ctx->flags |= PROMEX_FL_CACHE_FILL;
+		}
+	}
+	HA_RWLOCK_WRUNLOCK(OTHER_LOCK, &promex_cache.lock);
+}
+
+/* Append <data> to the back buffer of the snapshot cache, growing it as
+ * needed. Returns 1 on success and 0 on allocation failure. Only the filling
+ * applet touches this buffer so no lock is needed.
+ */
+static int promex_cache_append(struct promex_ctx *ctx, const struct ist data)
+{
+	struct promex_cache_buf *cb = &promex_cache.b[ctx->cache_idx];
+
+	if (cb->data + data.len > cb->size) {
+		size_t newsize = (cb->size ? cb->size : global.tune.bufsize);
+		char *area;
+
+		while (cb->data + data.len > newsize)
+			newsize *= 2;
+		area = my_realloc2(cb->area, newsize);
+		if (!area)
+			return 0;
+		cb->area = area;
+		cb->size = newsize;
+	}
+	memcpy(cb->area + cb->data, istptr(data), istlen(data));
+	cb->data += istlen(data);
+	return 1;
+}
+
+/* Flip the freshly filled back buffer to the live position once the dump
+ * completed, making it available to the next scrapes until it expires.
+ */
+static void promex_cache_publish(struct appctx *appctx)
+{
+	struct promex_ctx *ctx = appctx->svcctx;
+
+	if (!(ctx->flags & PROMEX_FL_CACHE_FILL))
+		return;
+
+	HA_RWLOCK_WRLOCK(OTHER_LOCK, &promex_cache.lock);
+	promex_cache.live = ctx->cache_idx;
+	promex_cache.expire = tick_add(now_ms, promex_snapshot_expire);
+	promex_cache.filling = 0;
+	HA_RWLOCK_WRUNLOCK(OTHER_LOCK, &promex_cache.lock);
+	ctx->flags &= ~PROMEX_FL_CACHE_FILL;
+}
+
+/* Add the chunk rendered in <out> to the response channel, and mirror it at
+ * the end of the snapshot being built when this applet feeds the cache. An
+ * allocation failure while mirroring only detaches the applet from the cache,
+ * the dump itself goes on. Returns 1 on success and -1 on unrecoverable
+ * error.
+ */
+static int promex_flush_data(struct appctx *appctx, struct htx *htx, struct channel *chn, struct ist *out)
+{
+	struct promex_ctx *ctx = appctx->svcctx;
+
+	if (!out->len)
+		return 1;
+	if (!htx_add_data_atonce(htx, *out))
+		return -1; /* Unexpected and unrecoverable error */
+	channel_add_input(chn, out->len);
+
+	if ((ctx->flags & PROMEX_FL_CACHE_FILL) && !promex_cache_append(ctx, *out)) {
+		HA_RWLOCK_WRLOCK(OTHER_LOCK, &promex_cache.lock);
+		promex_cache.filling = 0;
+		HA_RWLOCK_WRUNLOCK(OTHER_LOCK, &promex_cache.lock);
+		ctx->flags &= ~PROMEX_FL_CACHE_FILL;
+	}
+	return 1;
+}
+
+/* Copy the cached snapshot into the response channel, possibly accross
+ * several calls. It returns 1 once the whole snapshot was copied and 0 if
+ * <htx> is full.
+ */
+static int promex_dump_cache(struct appctx *appctx, struct stconn *sc, struct htx *htx)
+{
+	struct promex_ctx *ctx = appctx->svcctx;
+	struct promex_cache_buf *cb = &promex_cache.b[ctx->cache_idx];
+	struct channel *chn = sc_ic(sc);
+	size_t max = htx_get_max_blksz(htx, channel_htx_recv_max(chn, htx));
+	size_t len, sent;
+
+	while (ctx->cache_ofs < cb->data) {
+		len = cb->data - ctx->cache_ofs;
+		if (len > max)
+			len = max;
+		if (!len)
+			goto full;
+		sent = htx_add_data(htx, ist2(cb->area + ctx->cache_ofs, len));
+		if (!sent)
+			goto full;
+		channel_add_input(chn, sent);
+		ctx->cache_ofs += sent;
+		max -= sent;
+	}
+	return 1;
+
+  full:
+	sc_need_room(sc);
+	return 0;
+}
+
 /* Dump the header lines for <metric>. It is its #HELP and #TYPE strings. It
  * returns 1 on success. Otherwise, if <out> length exceeds <max>, it returns 0.
  */
@@ -465,6 +680,8 @@ static int promex_dump_metric_header(struct appctx *appctx, struct htx *htx,
 		desc = ist(info_fields[ctx->field_num].desc);
 	else if (metric->flags & PROMEX_FL_STICKTABLE_METRIC)
 		desc = promex_sticktable_metric_desc[ctx->field_num];
+	else if (metric->flags & PROMEX_FL_HOSTSTATS_METRIC)
+		desc = promex_hoststats_metric_desc[ctx->field_num];
 	else if (!isttest(promex_st_metric_desc[ctx->field_num]))
 		desc = ist(stat_fields[ctx->field_num].desc);
 	else
@@ -593,11 +810,8 @@ static int promex_dump_global_metrics(struct appctx *appctx, struct htx *htx)
 	}
 
   end:
-	if (out.len) {
-		if (!htx_add_data_atonce(htx, out))
-			return -1; /* Unexpected and unrecoverable error */
-		channel_add_input(chn, out.len);
-	}
+	if (promex_flush_data(appctx, htx, chn, &out) == -1)
+		return -1; /* Unexpected and unrecoverable error */
 	return ret;
   full:
 	ret = 0;
@@ -694,11 +908,8 @@ static int promex_dump_front_metrics(struct appctx *appctx, struct htx *htx)
 	}
 
   end:
-	if (out.len) {
-		if (!htx_add_data_atonce(htx, out))
-			return -1; /* Unexpected and unrecoverable error */
-		channel_add_input(chn, out.len);
-	}
+	if (promex_flush_data(appctx, htx, chn, &out) == -1)
+		return -1; /* Unexpected and unrecoverable error */
 	return ret;
   full:
 	ret = 0;
@@ -784,11 +995,8 @@ static int promex_dump_listener_metrics(struct appctx *appctx, struct htx *htx)
 	}
 
   end:
-	if (out.len) {
-		if (!htx_add_data_atonce(htx, out))
-			return -1; /* Unexpected and unrecoverable error */
-		channel_add_input(chn, out.len);
-	}
+	if (promex_flush_data(appctx, htx, chn, &out) == -1)
+		return -1; /* Unexpected and unrecoverable error */
 	return ret;
   full:
 	ctx->li = li;
@@ -965,11 +1173,8 @@ static int promex_dump_back_metrics(struct appctx *appctx, struct htx *htx)
 	}
 
   end:
-	if (out.len) {
-		if (!htx_add_data_atonce(htx, out))
-			return -1; /* Unexpected and unrecoverable error */
-		channel_add_input(chn, out.len);
-	}
+	if (promex_flush_data(appctx, htx, chn, &out) == -1)
+		return -1; /* Unexpected and unrecoverable error */
 	return ret;
   full:
 	ret = 0;
@@ -1137,11 +1342,8 @@ static int promex_dump_srv_metrics(struct appctx *appctx, struct htx *htx)
 
 
   end:
-	if (out.len) {
-		if (!htx_add_data_atonce(htx, out))
-			return -1; /* Unexpected and unrecoverable error */
-		channel_add_input(chn, out.len);
-	}
+	if (promex_flush_data(appctx, htx, chn, &out) == -1)
+		return -1; /* Unexpected and unrecoverable error */
 	return ret;
   full:
 	ret = 0;
@@ -1200,11 +1402,89 @@ static int promex_dump_sticktable_metrics(struct appctx *appctx, struct htx *htx
 	}
 
   end:
-	if (out.len) {
-		if (!htx_add_data_atonce(htx, out))
-			return -1; /* Unexpected and unrecoverable error */
-		channel_add_input(chn, out.len);
+	if (promex_flush_data(appctx, htx, chn, &out) == -1)
+		return -1; /* Unexpected and unrecoverable error */
+	return ret;
+  full:
+	ret = 0;
+	goto end;
+}
+
+/* Dump per-host metrics (prefixed by "haproxy_host_"). Entries are visited
+ * under their shard's lock, and when the output buffer fills up, a reference
+ * is kept on the current entry so that it cannot be evicted before the dump
+ * resumes. It returns 1 on success, 0 if <htx> is full and -1 in case of any
+ * error. */
+static int promex_dump_hoststats_metrics(struct appctx *appctx, struct htx *htx)
+{
+	static struct ist prefix = IST("haproxy_host_");
+	struct promex_ctx *ctx = appctx->svcctx;
+	struct field val;
+	struct channel *chn = sc_ic(appctx_sc(appctx));
+	struct ist out = ist2(trash.area, 0);
+	size_t max = htx_get_max_blksz(htx, channel_htx_recv_max(chn, htx));
+	struct host_stats_entry *ent;
+	int ret = 1;
+
+	for (; ctx->field_num < HOSTSTATS_TOTAL_FIELDS; ctx->field_num++) {
+		while (ctx->hs_shard < HOST_STATS_SHARDS) {
+			struct host_stats_shard *shard = &host_stats_shards[ctx->hs_shard];
+			struct ebmb_node *node;
+
+			HA_SPIN_LOCK(HOST_STATS_LOCK, &shard->lock);
+			if (ctx->hs_entry) {
+				ent = ctx->hs_entry;
+				ctx->hs_entry = NULL;
+				host_stats_put(ent);
+				node = &ent->node;
+			}
+			else
+				node = ebmb_first(&shard->keys);
+
+			while (node) {
+				struct promex_label labels[PROMEX_MAX_LABELS - 1] = {};
+
+				ent = ebmb_entry(node, struct host_stats_entry, node);
+				labels[0].name  = ist("host");
+				labels[0].value = ist2((char *)ent->node.key, strlen((char *)ent->node.key));
+
+				if (ctx->field_num == HOSTSTATS_REQ_TOT)
+					val = mkf_u64(FN_COUNTER, HA_ATOMIC_LOAD(&ent->req_tot));
+				else {
+					int cls = ctx->field_num - HOSTSTATS_HRSP_1XX; /* 0=1xx ... 5=other */
+
+					if (ctx->field_num != HOSTSTATS_HRSP_1XX)
+						ctx->flags &= ~PROMEX_FL_METRIC_HDR;
+					labels[1].name  = ist("code");
+					labels[1].value = promex_hrsp_code[cls];
+					val = mkf_u64(FN_COUNTER,
+						      HA_ATOMIC_LOAD(&ent->rsp[(cls == 5) ? 0 : cls + 1]));
+				}
+
+				if (!promex_dump_metric(appctx, htx, prefix,
+							&promex_hoststats_metrics[ctx->field_num],
+							&val, labels, &out, max)) {
+					/* stay on this entry and protect it
+					 * from eviction while the lock is
+					 * released.
+					 */
+					HA_ATOMIC_INC(&ent->refcnt);
+					ctx->hs_entry = ent;
+					HA_SPIN_UNLOCK(HOST_STATS_LOCK, &shard->lock);
+					goto full;
+				}
+				node = ebmb_next(node);
+			}
+			HA_SPIN_UNLOCK(HOST_STATS_LOCK, &shard->lock);
+			ctx->hs_shard++;
+		}
+		ctx->flags |= PROMEX_FL_METRIC_HDR;
+		ctx->hs_shard = 0;
 	}
+
+  end:
+	if (promex_flush_data(appctx, htx, chn, &out) == -1)
+		return -1; /* Unexpected and unrecoverable error */
 	return ret;
   full:
 	ret = 0;
@@ -1348,12 +1628,30 @@ static int promex_dump_metrics(struct appctx *appctx, struct stconn *sc, struct
 				}
 			}
 
+			ctx->flags &= ~(PROMEX_FL_METRIC_HDR|PROMEX_FL_STICKTABLE_METRIC);
+			ctx->flags |= (PROMEX_FL_METRIC_HDR|PROMEX_FL_HOSTSTATS_METRIC);
+			ctx->field_num = HOSTSTATS_REQ_TOT;
+			ctx->hs_shard = 0;
+			appctx->st1 = PROMEX_DUMPER_HOSTSTATS;
+			__fallthrough;
+
+		case PROMEX_DUMPER_HOSTSTATS:
+			if (ctx->flags & PROMEX_FL_SCOPE_HOSTSTATS) {
+				ret = promex_dump_hoststats_metrics(appctx, htx);
+				if (ret <= 0) {
+					if (ret == -1)
+						goto error;
+					goto full;
+				}
+			}
+
 			ctx->px = NULL;
 			ctx->st = NULL;
 			ctx->li = NULL;
 			ctx->sv = NULL;
-			ctx->flags &= ~(PROMEX_FL_METRIC_HDR|PROMEX_FL_STICKTABLE_METRIC);
+			ctx->flags &= ~(PROMEX_FL_METRIC_HDR|PROMEX_FL_HOSTSTATS_METRIC);
 			ctx->field_num = 0;
+			ctx->hs_shard = 0;
 			appctx->st1 = PROMEX_DUMPER_DONE;
 			__fallthrough;
 
@@ -1468,6 +1766,8 @@ static int promex_parse_uri(struct appctx *appctx, struct stconn *sc)
 				ctx->flags |= PROMEX_FL_SCOPE_LI;
 			else if (strcmp(value, "sticktable") == 0)
 				ctx->flags |= PROMEX_FL_SCOPE_STICKTABLE;
+			else if (strcmp(value, "host") == 0)
+				ctx->flags |= PROMEX_FL_SCOPE_HOSTSTATS;
 			else
 				goto error;
 		}
@@ -1528,6 +1828,35 @@ static int promex_appctx_init(struct appctx *appctx)
 	return 0;
 }
 
+/* Release the resources attached to the promex applet. A reference taken on
+ * one of the snapshot cache buffers is dropped here, this way it also covers
+ * the client aborting in the middle of a transfer.
+ */
+static void promex_appctx_release(struct appctx *appctx)
+{
+	struct promex_ctx *ctx = appctx->svcctx;
+
+	if (!ctx)
+		return;
+
+	if (ctx->hs_entry) {
+		host_stats_put(ctx->hs_entry);
+		ctx->hs_entry = NULL;
+	}
+
+	if (ctx->flags & PROMEX_FL_CACHE_READ) {
+		HA_RWLOCK_WRLOCK(OTHER_LOCK, &promex_cache.lock);
+		promex_cache.b[ctx->cache_idx].users--;
+		HA_RWLOCK_WRUNLOCK(OTHER_LOCK, &promex_cache.lock);
+	}
+	else if (ctx->flags & PROMEX_FL_CACHE_FILL) {
+		/* interrupted before completion: drop the partial snapshot */
+		HA_RWLOCK_WRLOCK(OTHER_LOCK, &promex_cache.lock);
+		promex_cache.filling = 0;
+		HA_RWLOCK_WRUNLOCK(OTHER_LOCK, &promex_cache.lock);
+	}
+}
+
 /* The main I/O handler for the promex applet. */
 static void promex_appctx_handle_io(struct appctx *appctx)
 {
@@ -1556,6 +1885,7 @@ static void promex_appctx_handle_io(struct appctx *appctx)
 					goto error;
 				goto out;
 			}
+			promex_cache_join(appctx);
 			appctx->st0 = PROMEX_ST_HEAD;
 			appctx->st1 = PROMEX_DUMPER_INIT;
 			__fallthrough;
@@ -1567,12 +1897,16 @@ static void promex_appctx_handle_io(struct appctx *appctx)
 			__fallthrough;
 
 		case PROMEX_ST_DUMP:
-			ret = promex_dump_metrics(appctx, sc, res_htx);
+			if (((struct promex_ctx *)appctx->svcctx)->flags & PROMEX_FL_CACHE_READ)
+				ret = promex_dump_cache(appctx, sc, res_htx);
+			else
+				ret = promex_dump_metrics(appctx, sc, res_htx);
 			if (ret <= 0) {
 				if (ret == -1)
 					goto error;
 				goto out;
 			}
+			promex_cache_publish(appctx);
 			appctx->st0 = PROMEX_ST_DONE;
 			__fallthrough;
 
@@ -1624,6 +1958,7 @@ struct applet promex_applet = {
 	.obj_type = OBJ_TYPE_APPLET,
 	.name = "<PROMEX>", /* used for logging */
 	.init = promex_appctx_init,
+	.release = promex_appctx_release,
 	.fct = promex_appctx_handle_io,
 };
 
@@ -1641,6 +1976,41 @@ static enum act_parse_ret service_parse_prometheus_exporter(const char **args, i
 
 	return ACT_RET_PRS_OK;
 }
+/* config parser for global "tune.promex.snapshot-expire" */
+static int promex_parse_snapshot_expire(char **args, int section_type, struct proxy *curpx,
+					const struct proxy *defpx, const char *file, int line,
+					char **err)
+{
+	unsigned int time;
+	const char *res;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	res = parse_time_err(args[1], &time, TIME_UNIT_MS);
+	if (res == PARSE_TIME_OVER) {
+		memprintf(err, "timer overflow in argument '%s' to '%s' "
+			  "(maximum value is 2147483647 ms or ~24.8 days)", args[1], args[0]);
+		return -1;
+	}
+	else if (res == PARSE_TIME_UNDER) {
+		memprintf(err, "timer underflow in argument '%s' to '%s' "
+			  "(minimum non-null value is 1 ms)", args[1], args[0]);
+		return -1;
+	}
+	else if (res) {
+		memprintf(err, "unexpected character '%c' in argument to '%s'", *res, args[0]);
+		return -1;
+	}
+	promex_snapshot_expire = time;
+	return 0;
+}
+
+static void promex_init_cache(void)
+{
+	HA_RWLOCK_INIT(&promex_cache.lock);
+}
+
 static void promex_register_build_options(void)
 {
         char *ptr = NULL;
@@ -1655,5 +2025,12 @@ static struct action_kw_list service_actions = { ILH, {
 	{ /* END */ }
 }};
 
+static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.promex.snapshot-expire", promex_parse_snapshot_expire },
+	{ 0, NULL, NULL },
+}};
+
+INITCALL0(STG_PREPARE, promex_init_cache);
+INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
 INITCALL1(STG_REGISTER, service_keywords_register, &service_actions);
 INITCALL0(STG_REGISTER, promex_register_build_options);
@@ -19,9 +19,10 @@
  *
  * This function manages its own buffer and returns a pointer to that buffer
  * in order to avoid expensive memory copies. It also checks for line breaks
- * 32 or 64 bits at a time. It could be improved a lot using mmap() but we
- * would not be allowed to replace trailing \n with zeroes and we would be
- * limited to small log files on 32-bit machines.
+ * 32 or 64 bits at a time. When the input is a regular file, it is mapped
+ * by large windows using MAP_PRIVATE so that trailing \n may be replaced
+ * with zeroes without copying the data around; pipes and other non-seekable
+ * inputs keep using the read() path below.
  *
  */
 
@@ -29,11 +30,25 @@
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 
 #ifndef FGETS2_BUFSIZE
 #define FGETS2_BUFSIZE		(256*1024)
 #endif
 
+/* size of the file windows mapped at once; must be a multiple of the page
+ * size. It bounds both the memory usage and the longest supported line.
+ */
+#ifndef FGETS2_MAPSIZE
+#define FGETS2_MAPSIZE		(256*1024*1024)
+#endif
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
 /* memchr() is faster in glibc with SSE since commit 093ecf92998de2 */
 #if defined(__x86_64__) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 15))
 #define USE_MEMCHR
@@ -202,6 +217,111 @@ static char *find_lf(char *next, char *end)
 	return next;
 }
 
+#ifdef MAP_ANONYMOUS
+/* state of the mmap-based input, only used when the input is a regular file.
+ * <map_state> is 0 before the first call, 1 once the file is mapped, and -1
+ * when the input is not mappable (pipe, terminal, empty file, mmap failure).
+ */
+static char *map_base;      /* base of the currently mapped window */
+static size_t map_len;      /* bytes of file data present in the window */
+static off_t map_off;       /* file offset of the window (page-aligned) */
+static off_t map_size;      /* total file size */
+static char *map_line;      /* start of the next line within the window */
+static long map_pgsz;       /* page size, cached */
+static int map_state;
+
+/* map the window of up to FGETS2_MAPSIZE bytes starting at page-aligned file
+ * offset <off> of file <fd>. The file data is first overlaid on a private
+ * anonymous mapping one page larger, so that one writable zero-filled page
+ * always follows the data : this way the multi-byte scans above as well as
+ * the terminating zero may safely touch a few bytes past the last line.
+ * Returns 0 on success, -1 on error.
+ */
+static int map_window(int fd, off_t off)
+{
+	size_t len, rounded;
+	char *base;
+
+	len = map_size - off;
+	if (len > FGETS2_MAPSIZE)
+		len = FGETS2_MAPSIZE;
+
+	rounded = (len + map_pgsz - 1) & -(size_t)map_pgsz;
+	base = mmap(NULL, rounded + map_pgsz, PROT_READ | PROT_WRITE,
+	            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		return -1;
+
+	if (mmap(base, len, PROT_READ | PROT_WRITE,
+	         MAP_PRIVATE | MAP_FIXED, fd, off) == MAP_FAILED) {
+		munmap(base, rounded + map_pgsz);
+		return -1;
+	}
+
+#ifdef MADV_SEQUENTIAL
+	madvise(base, len, MADV_SEQUENTIAL);
+#endif
+	map_base = base;
+	map_len = len;
+	map_off = off;
+	return 0;
+}
+
+static void unmap_window(void)
+{
+	munmap(map_base, ((map_len + map_pgsz - 1) & -(size_t)map_pgsz) + map_pgsz);
+	map_base = NULL;
+}
+
+/* fgets2() over a mapped regular file. Lines are terminated in place thanks
+ * to MAP_PRIVATE which turns the writes into copy-on-write. Returns NULL at
+ * the end of the file, on error, or if a line is larger than the window.
+ */
+static const char *fgets2_map(FILE *stream)
+{
+	while (1) {
+		char *nl, *start;
+		off_t line_off;
+
+		if (map_line < map_base + map_len) {
+			nl = find_lf(map_line, map_base + map_len);
+			if (nl < map_base + map_len) {
+				start = map_line;
+				*nl = '\0';
+				map_line = nl + 1;
+				return start;
+			}
+
+			if (map_off + (off_t)map_len >= map_size) {
+				/* last line of the file without a trailing LF.
+				 * The bytes following the data are zeroes from
+				 * the trailing page, so the line is already
+				 * terminated.
+				 */
+				start = map_line;
+				map_line = map_base + map_len;
+				return start;
+			}
+		}
+		else if (map_off + (off_t)map_len >= map_size)
+			return NULL;
+
+		/* either the window was fully consumed, or the current line
+		 * continues into the next one. Remap starting at the page
+		 * holding the beginning of the current line.
+		 */
+		line_off = map_off + (map_line - map_base); /* absolute offset of the line */
+		if ((line_off & -(off_t)map_pgsz) == map_off) /* line larger than the window */
+			return NULL;
+
+		unmap_window();
+		if (map_window(fileno(stream), line_off & -(off_t)map_pgsz) < 0)
+			return NULL;
+		map_line = map_base + (line_off - map_off);
+	}
+}
+#endif /* MAP_ANONYMOUS */
+
 const char *fgets2(FILE *stream)
 {
 	static char buffer[FGETS2_BUFSIZE + 68]; /* Note: +32 is enough on 32-bit systems */
@@ -210,6 +330,27 @@ const char *fgets2(FILE *stream)
 	char *next;
 	int ret;
 
+#ifdef MAP_ANONYMOUS
+	if (map_state >= 0) {
+		if (!map_state) {
+			struct stat st;
+
+			map_state = -1;
+			if (fstat(fileno(stream), &st) == 0 &&
+			    S_ISREG(st.st_mode) && st.st_size > 0) {
+				map_size = st.st_size;
+				map_pgsz = sysconf(_SC_PAGESIZE);
+				if (map_window(fileno(stream), 0) == 0) {
+					map_line = map_base;
+					map_state = 1;
+				}
+			}
+		}
+		if (map_state > 0)
+			return fgets2_map(stream);
+	}
+#endif
+
 	next = line;
 
 	while (1) {
@@ -22,6 +22,10 @@
 
 #include <haproxy/compiler.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <import/eb32tree.h>
 #include <import/eb64tree.h>
 #include <import/ebistree.h>
@@ -244,6 +248,23 @@ static inline const char *field_stop(const char *p)
 	    );
 	return p;
 }
+#elif defined(__SSE2__)
+const char *field_stop(const char *p)
+{
+	/* check 16 bytes at once for a space or the trailing zero. Lines
+	 * produced by fgets2() may safely be read a few bytes past their end.
+	 */
+	while (1) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+		                         _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+		unsigned int mask = _mm_movemask_epi8(m);
+
+		if (mask)
+			return p + __builtin_ctz(mask);
+		p += 16;
+	}
+}
 #else
 const char *field_stop(const char *p)
 {
@@ -297,6 +318,26 @@ const char *field_start(const char *p, int field)
 
 		/* skip this field */
 		while (1) {
+#if defined(__SSE2__)
+			/* check 16 bytes at once for a space or the trailing
+			 * zero; fgets2() guarantees a few readable bytes past
+			 * the end of the line.
+			 */
+			__m128i v = _mm_loadu_si128((const __m128i *)p);
+			__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+			                         _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+			unsigned int mask = _mm_movemask_epi8(m);
+
+			if (!mask) {
+				p += 16;
+				continue;
+			}
+			p += __builtin_ctz(mask);
+			if (!*p)
+				return p;
+			p++;
+			break;
+#else
 #if defined(HA_UNALIGNED_LE64)
 			unsigned long long l = *(unsigned long long *)p;
 			if (!has_zero64(l)) {
@@ -322,6 +363,7 @@ const char *field_start(const char *p, int field)
 				return p - 1;
 			if (c == ' ')
 				break;
+#endif
 		}
 	}
 #else
@@ -0,0 +1,287 @@
+/*
+ * Microbenchmarks for some of haproxy's hot primitives.
+ *
+ * Build from the top directory with "make bench" (or "make dev/bench/bench"),
+ * it reuses the objects built for haproxy so it must be run after a regular
+ * build. Each benchmark is run several times and the best run is reported,
+ * which filters out scheduling noise. Typical use:
+ *
+ *    ./dev/bench/bench > baseline.txt         # on the reference version
+ *    ./dev/bench/bench -b baseline.txt        # on the candidate version
+ *
+ * The -b output appends the baseline value and the relative difference to
+ * each line, so regressions are immediately visible without an external
+ * tool. Only the primitives which can run outside the full runtime are
+ * covered here (trees, h1 parsing, huffman decoding, freq counters);
+ * pools and rings need the scheduler and thread setup and are better
+ * measured with task profiling on a live process.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <import/eb32tree.h>
+
+#include <haproxy/freq_ctr.h>
+#include <haproxy/h1.h>
+#include <haproxy/hpack-huff.h>
+#include <haproxy/http-hdr.h>
+
+/* normally provided by clock.o, fed manually here */
+volatile unsigned int global_now_ms;
+THREAD_LOCAL unsigned int now_ms;
+
+/* normally provided by tools.o, which would drag the whole runtime in.
+ * These are only referenced by h1.o/http.o code paths (websocket keys,
+ * status ranges) that the benchmarks never execute.
+ */
+uint64_t ha_random64(void)
+{
+	abort();
+}
+
+unsigned int strl2ui(const char *s, int len)
+{
+	abort();
+}
+
+#define BENCH_REPS  5
+#define TREE_NODES  16384
+
+/* global sink preventing the compiler from dropping the measured work */
+static volatile uint64_t bench_sink;
+
+/* simple LCG so that all runs use the same "random" sequence */
+static inline uint32_t bench_rnd(uint32_t *state)
+{
+	*state = *state * 1103515245 + 12345;
+	return *state >> 8;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* runs <fn> BENCH_REPS times over <iters> iterations and returns the best
+ * observed cost per operation in nanoseconds.
+ */
+static double bench_run(uint64_t (*fn)(uint64_t iters), uint64_t iters)
+{
+	double best = 0;
+	uint64_t t;
+	int rep;
+
+	for (rep = 0; rep < BENCH_REPS; rep++) {
+		t = now_ns();
+		bench_sink += fn(iters);
+		t = now_ns() - t;
+		if (!rep || (double)t / iters < best)
+			best = (double)t / iters;
+	}
+	return best;
+}
+
+/*************** eb32 tree lookups and insertions ***************/
+
+static struct eb_root bench_tree = EB_ROOT;
+static struct eb32_node bench_nodes[TREE_NODES];
+
+static void bench_tree_setup(void)
+{
+	uint32_t rnd = 1;
+	int i;
+
+	for (i = 0; i < TREE_NODES; i++) {
+		bench_nodes[i].key = bench_rnd(&rnd);
+		eb32_insert(&bench_tree, &bench_nodes[i]);
+	}
+}
+
+static uint64_t bench_eb32_lookup(uint64_t iters)
+{
+	uint64_t found = 0;
+	uint32_t rnd = 1;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++)
+		found += !!eb32_lookup(&bench_tree, bench_rnd(&rnd));
+	return found;
+}
+
+static uint64_t bench_eb32_insdel(uint64_t iters)
+{
+	struct eb32_node node;
+	uint32_t rnd = 0x55555555;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		node.key = bench_rnd(&rnd);
+		eb32_insert(&bench_tree, &node);
+		eb32_delete(&node);
+	}
+	return iters;
+}
+
+/*************** h1 request header parsing ***************/
+
+static const char bench_req[] =
+	"GET /index.html?q=microbench HTTP/1.1\r\n"
+	"host: www.example.com\r\n"
+	"user-agent: Mozilla/5.0 (X11; Linux x86_64) Gecko/20100101\r\n"
+	"accept: text/html,application/xhtml+xml,application/xml;q=0.9\r\n"
+	"accept-language: en-US,en;q=0.5\r\n"
+	"accept-encoding: gzip, deflate, br\r\n"
+	"cookie: session=0123456789abcdef0123456789abcdef\r\n"
+	"referer: https://www.example.com/\r\n"
+	"connection: keep-alive\r\n"
+	"\r\n";
+
+static uint64_t bench_h1_parse(uint64_t iters)
+{
+	struct http_hdr hdr[32];
+	union h1_sl sl;
+	struct h1m h1m;
+	uint64_t total = 0;
+	uint64_t i;
+	int ret;
+
+	for (i = 0; i < iters; i++) {
+		h1m_init_req(&h1m);
+		h1m.flags |= H1_MF_NO_PHDR;
+		ret = h1_headers_to_hdr_list((char *)bench_req, bench_req + sizeof(bench_req) - 1,
+		                             hdr, sizeof(hdr) / sizeof(hdr[0]), &h1m, &sl);
+		if (ret <= 0) {
+			fprintf(stderr, "h1 parsing error at iteration %llu\n", (unsigned long long)i);
+			exit(1);
+		}
+		total += ret;
+	}
+	return total;
+}
+
+/*************** hpack huffman decoding ***************/
+
+/* "www.example.com" huffman-encoded (RFC7541 C.4.1) */
+static const uint8_t bench_huff[] = {
+	0xf1, 0xe3, 0xc2, 0xe5, 0xf2, 0x3a, 0x6b, 0xa0, 0xab, 0x90, 0xf4, 0xff
+};
+
+static uint64_t bench_huff_dec(uint64_t iters)
+{
+	char out[64];
+	uint64_t total = 0;
+	uint64_t i;
+	int ret;
+
+	for (i = 0; i < iters; i++) {
+		ret = huff_dec(bench_huff, sizeof(bench_huff), out, sizeof(out));
+		if (ret <= 0) {
+			fprintf(stderr, "huffman decoding error\n");
+			exit(1);
+		}
+		total += ret;
+	}
+	return total;
+}
+
+/*************** freq_ctr updates ***************/
+
+static uint64_t bench_freq_ctr(uint64_t iters)
+{
+	struct freq_ctr ctr = { };
+	uint64_t total = 0;
+	uint64_t i;
+
+	for (i = 0; i < iters; i++) {
+		/* tick the fake clock so that period rollovers are exercised
+		 * at a realistic rate (about one per thousand updates).
+		 */
+		if (!(i & 1023)) {
+			global_now_ms += 1000;
+			now_ms = global_now_ms;
+		}
+		total += update_freq_ctr_period(&ctr, 1000, 1);
+	}
+	return total;
+}
+
+/*************** harness ***************/
+
+struct bench {
+	const char *name;
+	uint64_t (*fn)(uint64_t iters);
+	uint64_t iters;
+};
+
+static const struct bench benches[] = {
+	{ "eb32_lookup",  bench_eb32_lookup, 2000000  },
+	{ "eb32_insdel",  bench_eb32_insdel, 2000000  },
+	{ "h1_parse_req", bench_h1_parse,    200000   },
+	{ "huff_dec",     bench_huff_dec,    2000000  },
+	{ "freq_ctr_upd", bench_freq_ctr,    10000000 },
+	{ NULL, NULL, 0 }
+};
+
+/* looks up <name> in baseline file <path>, returns its ns/op or < 0 */
+static double baseline_lookup(const char *path, const char *name)
+{
+	char line[256], key[64];
+	double val;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+
+	val = -1;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%63s %lf", key, &val) == 2 && strcmp(key, name) == 0)
+			break;
+		val = -1;
+	}
+	fclose(f);
+	return val;
+}
+
+int main(int argc, char **argv)
+{
+	const char *baseline = NULL;
+	const struct bench *b;
+	double ns, base;
+
+	if (argc == 3 && strcmp(argv[1], "-b") == 0)
+		baseline = argv[2];
+	else if (argc != 1) {
+		fprintf(stderr, "Usage: %s [-b <baseline_file>]\n", argv[0]);
+		return 1;
+	}
+
+	bench_tree_setup();
+
+	printf("# %-14s %10s %10s%s\n", "name", "ns/op", "Mops/s",
+	       baseline ? "   baseline      delta" : "");
+
+	for (b = benches; b->name; b++) {
+		ns = bench_run(b->fn, b->iters);
+		printf("%-16s %10.2f %10.2f", b->name, ns, 1000.0 / ns);
+		if (baseline) {
+			base = baseline_lookup(baseline, b->name);
+			if (base > 0)
+				printf(" %10.2f %+9.1f%%", base, (ns - base) * 100.0 / base);
+			else
+				printf(" %10s %10s", "-", "-");
+		}
+		putchar('\n');
+	}
+
+	/* prevent the whole measurement from being optimized out */
+	if (bench_sink == ~0ULL)
+		fprintf(stderr, "unexpected sink value\n");
+	return 0;
+}
@@ -38,6 +38,9 @@
 int force = 0; // force access to a different layout
 int lfremap = 0; // remap LF in traces
 int repair = 0; // repair file
+int wait_mode = 0; // wait for new events ("follow" mode)
+int seek_new = 0; // seek to the end before dumping
+unsigned long tail = 0; // dump only the last <tail> messages
 
 
 /* display the message and exit with the code */
@@ -63,6 +66,9 @@ __attribute__((noreturn)) void usage(int code, const char *arg0)
 	    "  -f           : force accessing a non-matching layout for 'ring struct'\n"
 	    "  -l           : replace LF in contents with CR VT\n"
 	    "  -r           : \"repair\" corrupted file (actively search for message boundaries)\n"
+	    "  -w           : wait for new events after the dump (follow mode)\n"
+	    "  -e           : seek to the end before dumping (useful with -w)\n"
+	    "  -t <num>     : dump only the last <num> messages\n"
 	    "\n"
 	    "", arg0);
 }
@@ -130,6 +136,37 @@ int dump_ring(struct ring *ring, size_t ofs, int flags)
 		ofs += ring->ofs;
 	}
 
+	/* in tail mode, hop over the messages a first time to count them, then
+	 * a second time to skip all but the last <tail> ones. Messages being
+	 * length-prefixed, only the varint lengths are read, so even huge rings
+	 * are traversed quickly without touching the payloads.
+	 */
+	if (tail) {
+		size_t o = ofs - ring->ofs;
+		unsigned long tot = 0;
+
+		while (o + 1 < b_data(&buf)) {
+			cnt = 1;
+			len = b_peek_varint(&buf, o + cnt, &msg_len);
+			if (!len)
+				break;
+			cnt += len;
+			if (msg_len + o + cnt + 1 > buf.data)
+				break;
+			o += cnt + msg_len;
+			tot++;
+		}
+
+		o = ofs - ring->ofs;
+		while (tot > tail) {
+			cnt = 1;
+			cnt += b_peek_varint(&buf, o + cnt, &msg_len);
+			o += cnt + msg_len;
+			tot--;
+		}
+		ofs = o + ring->ofs;
+	}
+
 	while (1) {
 		//HA_RWLOCK_RDLOCK(LOGSRV_LOCK, &ring->lock);
 
@@ -209,8 +246,18 @@ int dump_ring(struct ring *ring, size_t ofs, int flags)
 		if (!(flags & RING_WF_WAIT_MODE))
 			break;
 
-		/* pause 10ms before checking for new stuff */
+		fflush(stdout);
+
+		/* pause 10ms before checking for new stuff. The writer process
+		 * updates the mapping in place, which does not produce any
+		 * event to wait for, so polling is the only option.
+		 */
 		usleep(10000);
+
+		/* refresh our view of the buffer's head and count, the writer
+		 * may have appended or rotated data meanwhile.
+		 */
+		buf = b_make(buf.area, ring->buf.size, ring->buf.head, ring->buf.data);
 	}
 	return 0;
 }
@@ -231,6 +278,16 @@ int main(int argc, char **argv)
 			lfremap = 1;
 		else if (strcmp(argv[0], "-r") == 0)
 			repair = 1;
+		else if (strcmp(argv[0], "-w") == 0)
+			wait_mode = 1;
+		else if (strcmp(argv[0], "-e") == 0)
+			seek_new = 1;
+		else if (strcmp(argv[0], "-t") == 0) {
+			if (argc < 3)
+				usage(1, arg0);
+			argc--; argv++;
+			tail = atol(argv[0]);
+		}
 		else if (strcmp(argv[0], "--") == 0)
 			break;
 		else
@@ -259,7 +316,9 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
-	return dump_ring(ring, ~0, 0);
+	return dump_ring(ring, ~0,
+	                 (wait_mode ? RING_WF_WAIT_MODE : 0) |
+	                 (seek_new ? RING_WF_SEEK_NEW : 0));
 }
 
 
@@ -118,7 +118,6 @@ struct acl {
 	struct list list;           /* chaining */
 	char *name;		    /* acl name */
 	struct list expr;	    /* list of acl_exprs */
-	int cache_idx;              /* ACL index in cache */
 	unsigned int use;           /* or'ed bit mask of all acl_expr's SMP_USE_* */
 	unsigned int val;           /* or'ed bit mask of all acl_expr's SMP_VAL_* */
 };
@@ -135,9 +134,20 @@ struct acl_term_suite {
 	struct list terms;          /* list of acl_terms */
 };
 
+/* flattened form of a term, used by the array representation of a condition.
+ * <first> marks the beginning of a new suite (a new "or" group).
+ */
+struct acl_flat_term {
+	struct acl *acl;            /* acl pointed to by this term */
+	short neg;                  /* 1 if the ACL result must be negated */
+	short first;                /* 1 if this term starts a new suite */
+};
+
 struct acl_cond {
 	struct list list;           /* Some specific tests may use multiple conditions */
 	struct list suites;         /* list of acl_term_suites */
+	struct acl_flat_term *fterms; /* flattened terms walked by acl_exec_cond() */
+	int nb_fterms;              /* number of entries in <fterms> */
 	enum acl_cond_pol pol;      /* polarity: ACL_COND_IF / ACL_COND_UNLESS */
 	unsigned int use;           /* or'ed bit mask of all suites's SMP_USE_* */
 	unsigned int val;           /* or'ed bit mask of all suites's SMP_VAL_* */
@@ -113,6 +113,7 @@ enum act_normalize_uri {
 	ACT_NORMALIZE_URI_PERCENT_DECODE_UNRESERVED_STRICT,
 	ACT_NORMALIZE_URI_FRAGMENT_STRIP,
 	ACT_NORMALIZE_URI_FRAGMENT_ENCODE,
+	ACT_NORMALIZE_URI_CHAIN,
 };
 
 /* NOTE: if <.action_ptr> is defined, the referenced function will always be
@@ -142,6 +143,7 @@ struct act_rule {
 			struct ist str;        /* string param (reason, header name, ...) */
 			struct list fmt;       /* log-format compatible expression */
 			struct my_regex *re;   /* used by replace-header/value/uri/path */
+			struct ist static_val; /* <fmt> precomputed at parsing time when purely static (early-hint) */
 		} http;                        /* args used by some HTTP rules */
 		struct http_reply *http_reply; /* HTTP response to be used by return/deny/tarpit rules */
 		struct redirect_rule *redir;   /* redirect rule or "http-request redirect" */
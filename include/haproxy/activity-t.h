@@ -105,6 +105,8 @@ struct activity {
 	unsigned int accq_full;    // accept queue connection not pushed because full
 	unsigned int pool_fail;    // failed a pool allocation
 	unsigned int buf_wait;     // waited on a buffer allocation
+	unsigned int shed_conns;   // connections rejected or left pending due to overload
+	unsigned int shed_reqs;    // requests answered a fast 503 due to overload
 #if defined(DEBUG_DEV)
 	/* keep these ones at the end */
 	unsigned int ctr0;         // general purposee debug counter
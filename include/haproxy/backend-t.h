@@ -28,6 +28,7 @@
 #include <haproxy/lb_fwlc-t.h>
 #include <haproxy/lb_fwrr-t.h>
 #include <haproxy/lb_map-t.h>
+#include <haproxy/lb_p2c-t.h>
 #include <haproxy/server-t.h>
 #include <haproxy/thread-t.h>
 
@@ -58,6 +59,7 @@
 /* BE_LB_CB_* is used with BE_LB_KIND_CB */
 #define BE_LB_CB_LC     0x00000  /* least-connections */
 #define BE_LB_CB_FAS    0x00001  /* first available server (opposite of leastconn) */
+#define BE_LB_CB_P2C    0x00002  /* power of two choices */
 
 #define BE_LB_PARM      0x000FF  /* mask to get/clear the LB param */
 
@@ -84,6 +86,7 @@
 #define BE_LB_ALGO_RND  (BE_LB_KIND_RR | BE_LB_NEED_NONE | BE_LB_RR_RANDOM) /* random value */
 #define BE_LB_ALGO_LC   (BE_LB_KIND_CB | BE_LB_NEED_NONE | BE_LB_CB_LC)    /* least connections */
 #define BE_LB_ALGO_FAS  (BE_LB_KIND_CB | BE_LB_NEED_NONE | BE_LB_CB_FAS)   /* first available server */
+#define BE_LB_ALGO_P2C  (BE_LB_KIND_CB | BE_LB_NEED_NONE | BE_LB_CB_P2C)   /* power of two choices */
 #define BE_LB_ALGO_SRR  (BE_LB_KIND_RR | BE_LB_NEED_NONE | BE_LB_RR_STATIC) /* static round robin */
 #define BE_LB_ALGO_SH	(BE_LB_KIND_HI | BE_LB_NEED_ADDR | BE_LB_HASH_SRC) /* hash: source IP */
 #define BE_LB_ALGO_UH	(BE_LB_KIND_HI | BE_LB_NEED_HTTP | BE_LB_HASH_URI) /* hash: HTTP URI  */
@@ -103,6 +106,7 @@
 #define BE_LB_LKUP_LCTREE 0x30000  /* FWLC tree lookup */
 #define BE_LB_LKUP_CHTREE 0x40000  /* consistent hash  */
 #define BE_LB_LKUP_FSTREE 0x50000  /* FAS tree lookup */
+#define BE_LB_LKUP_P2CMAP 0x60000  /* P2C flat map lookup */
 #define BE_LB_LKUP        0x70000  /* mask to get just the LKUP value */
 
 /* additional properties */
@@ -118,11 +122,12 @@
 #define BE_LB_HASH_MOD    0x200000  /* get/clear hash modifier */
 
 /* BE_LB_HFCN_* is the hash function, to be used with BE_LB_HASH_FUNC */
-#define BE_LB_HFCN_SDBM   0x000000 /* sdbm hash */
-#define BE_LB_HFCN_DJB2   0x400000 /* djb2 hash */
-#define BE_LB_HFCN_WT6    0x800000 /* wt6 hash */
-#define BE_LB_HFCN_CRC32  0xC00000 /* crc32 hash */
-#define BE_LB_HASH_FUNC   0xC00000 /* get/clear hash function */
+#define BE_LB_HFCN_SDBM   0x0000000 /* sdbm hash */
+#define BE_LB_HFCN_DJB2   0x0400000 /* djb2 hash */
+#define BE_LB_HFCN_WT6    0x0800000 /* wt6 hash */
+#define BE_LB_HFCN_CRC32  0x0C00000 /* crc32 hash */
+#define BE_LB_HFCN_XXH3   0x1000000 /* xxh3 hash */
+#define BE_LB_HASH_FUNC   0x1C00000 /* get/clear hash function */
 
 
 /* various constants */
@@ -145,6 +150,7 @@ struct lbprm {
 		struct lb_fwlc fwlc;
 		struct lb_chash chash;
 		struct lb_fas fas;
+		struct lb_p2c p2c;
 	};
 	int algo;			/* load balancing algorithm and variants: BE_LB_* */
 	int tot_wact, tot_wbck;		/* total effective weights of active and backup servers */
@@ -47,6 +47,7 @@ int be_downtime(struct proxy *px);
 void recount_servers(struct proxy *px);
 void update_backend_weight(struct proxy *px);
 int be_lastsession(const struct proxy *be);
+int be_retry_within_budget(struct proxy *be);
 
 /* Returns number of usable servers in backend */
 static inline int be_usable_srv(struct proxy *be)
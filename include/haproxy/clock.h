@@ -23,6 +23,7 @@
 #define _HAPROXY_CLOCK_H
 
 #include <sys/time.h>
+#include <time.h>
 #include <haproxy/api.h>
 
 extern struct timeval              start_date;    /* the process's start date in wall-clock time */
@@ -42,6 +43,12 @@ void clock_init_process_date(void);
 void clock_init_thread_date(void);
 int clock_setup_signal_timer(void *timer, int sig, int val);
 char *timeofday_as_iso_us(int pad);
+struct tm *get_localtime_cached(time_t t);
+struct tm *get_gmtime_cached(time_t t);
+char *date2str_log_cached(char *dst, const struct timeval *date, size_t size);
+char *gmt2str_log_cached(char *dst, time_t t, size_t size);
+char *localdate2str_log_cached(char *dst, time_t t, size_t size);
+const char *gmtdate2str_rfc7231_cached(time_t t);
 uint clock_report_idle(void);
 void clock_leaving_poll(int timeout, int interrupted);
 void clock_entering_poll(void);
@@ -32,6 +32,10 @@
 #include <zlib.h>
 #endif
 
+#if defined(USE_ZSTD)
+#include <zstd.h>
+#endif
+
 #include <haproxy/buf-t.h>
 
 struct comp {
@@ -53,6 +57,10 @@ struct comp_ctx {
 	void *zlib_prev;
 	void *zlib_pending_buf;
 	void *zlib_head;
+	int zlib_wbits;  /* window bits passed to deflateInit2(), used to match spare contexts */
+#endif
+#if defined(USE_ZSTD)
+	ZSTD_CCtx *zstd_cctx; /* zstd compression context, only used by the zstd algo */
 #endif
 	int cur_lvl;
 };
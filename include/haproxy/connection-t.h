@@ -85,7 +85,9 @@ enum {
 	CO_FL_IDLE_LIST     = 0x00000002,  /* 2 = in idle_list, 3 = invalid */
 	CO_FL_LIST_MASK     = 0x00000003,  /* Is the connection in any server-managed list ? */
 
-	/* unused : 0x00000004, 0x00000008 */
+	CO_FL_FASTOPEN      = 0x00000004,  /* connected with TCP Fast Open, SYN may carry data */
+
+	/* unused : 0x00000008 */
 
 	/* unused : 0x00000010 */
 	/* unused : 0x00000020 */
@@ -170,13 +172,13 @@ static forceinline char *conn_show_flags(char *buf, size_t len, const char *deli
 	/* prologue */
 	_(0);
 	/* flags */
-	_(CO_FL_SAFE_LIST, _(CO_FL_IDLE_LIST, _(CO_FL_CTRL_READY, _(CO_FL_XPRT_READY,
+	_(CO_FL_SAFE_LIST, _(CO_FL_IDLE_LIST, _(CO_FL_FASTOPEN, _(CO_FL_CTRL_READY, _(CO_FL_XPRT_READY,
 	_(CO_FL_WANT_DRAIN, _(CO_FL_WAIT_ROOM, _(CO_FL_EARLY_SSL_HS, _(CO_FL_EARLY_DATA,
 	_(CO_FL_SOCKS4_SEND, _(CO_FL_SOCKS4_RECV, _(CO_FL_SOCK_RD_SH, _(CO_FL_SOCK_WR_SH,
 	_(CO_FL_ERROR, _(CO_FL_FDLESS, _(CO_FL_WAIT_L4_CONN, _(CO_FL_WAIT_L6_CONN,
 	_(CO_FL_SEND_PROXY, _(CO_FL_ACCEPT_PROXY, _(CO_FL_ACCEPT_CIP, _(CO_FL_SSL_WAIT_HS,
 	_(CO_FL_PRIVATE, _(CO_FL_RCVD_PROXY, _(CO_FL_SESS_IDLE, _(CO_FL_XPRT_TRACKED
-	))))))))))))))))))))))));
+	)))))))))))))))))))))))));
 	/* epilogue */
 	_(~0U);
 	return buf;
@@ -29,6 +29,7 @@
 #include <haproxy/connection-t.h>
 #include <haproxy/stconn-t.h>
 #include <haproxy/fd.h>
+#include <haproxy/global.h>
 #include <haproxy/list.h>
 #include <haproxy/listener-t.h>
 #include <haproxy/obj_type.h>
@@ -684,6 +685,20 @@ static inline int conn_is_ssl(struct connection *conn)
 	return !!conn_get_ssl_sock_ctx(conn);
 }
 
+/* Pre-assign mux I/O tasklet <tl> of connection <conn> to the bulk class when
+ * "tune.sched.bulk-ssl-io" is set and the connection runs over SSL. This makes
+ * all TLS record processing of a thread run as consecutive batches, separately
+ * from the stream processing, instead of interleaving crypto and application
+ * code on each wakeup, which measurably improves instruction cache efficiency
+ * on the two sides. To be called by muxes once their I/O tasklet is allocated.
+ */
+static inline void conn_set_tasklet_class(const struct connection *conn, struct tasklet *tl)
+{
+	if (unlikely(global.tune.options & GTUNE_SCHED_BULK_SSL) &&
+	    conn_is_ssl((struct connection *)conn))
+		tl->state |= TASK_SELF_WAKING;
+}
+
 #endif /* _HAPROXY_CONNECTION_H */
 
 /*
@@ -23,6 +23,20 @@
 #ifndef _HAPROXY_COUNTERS_T_H
 #define _HAPROXY_COUNTERS_T_H
 
+#include <haproxy/compiler.h>
+#include <haproxy/defaults.h>
+
+/* Per thread-group shard for the counters updated on the traffic path. Each
+ * shard lives on its own cache line so that, with thread groups mapped on
+ * NUMA nodes, these updates only ever touch a node-local line instead of
+ * bouncing a single one across all sockets. The shards are summed when the
+ * stats are consulted (see counters.h).
+ */
+struct cnt_shard {
+	long long bytes_in;                     /* number of bytes transferred from the client to the server */
+	long long bytes_out;                    /* number of bytes transferred from the server to the client */
+} THREAD_ALIGNED(64);
+
 /* counters used by listeners and frontends */
 struct fe_counters {
 	unsigned int conn_max;                  /* max # of active sessions */
@@ -33,9 +47,6 @@ struct fe_counters {
 	unsigned int cps_max;                   /* maximum of new connections received per second */
 	unsigned int sps_max;                   /* maximum of new connections accepted per second (sessions) */
 
-	long long bytes_in;                     /* number of bytes transferred from the client to the server */
-	long long bytes_out;                    /* number of bytes transferred from the server to the client */
-
 	long long comp_in;                      /* input bytes fed to the compressor */
 	long long comp_out;                     /* output bytes emitted by the compressor */
 	long long comp_byp;                     /* input bytes that bypassed the compressor (cpu/ram/bw limitation) */
@@ -62,8 +73,17 @@ struct fe_counters {
 			long long cache_hits;   /* cache hits */
 		} http;
 	} p;                                    /* protocol-specific stats */
+
+	struct cnt_shard shards[MAX_TGROUPS];   /* per thread-group bytes_in/bytes_out */
 };
 
+/* number of buckets in the log-linear time histograms below: times of 0-7 ms
+ * use one bucket per millisecond, then each power of two is split in four
+ * buckets, and the last bucket also collects everything above ~2 minutes
+ * (see tm_hist_idx() in counters.h).
+ */
+#define TIME_HIST_BUCKETS 64
+
 /* counters used by servers and backends */
 struct be_counters {
 	unsigned int conn_max;                  /* max # of active sessions */
@@ -77,9 +97,6 @@ struct be_counters {
 	unsigned int nbpend_max;                /* max number of pending connections with no server assigned yet */
 	unsigned int cur_sess_max;		/* max number of currently active sessions */
 
-	long long bytes_in;                     /* number of bytes transferred from the client to the server */
-	long long bytes_out;                    /* number of bytes transferred from the server to the client */
-
 	long long comp_in;                      /* input bytes fed to the compressor */
 	long long comp_out;                     /* output bytes emitted by the compressor */
 	long long comp_byp;                     /* input bytes that bypassed the compressor (cpu/ram/bw limitation) */
@@ -89,12 +106,15 @@ struct be_counters {
 
 	long long connect;                      /* number of connection establishment attempts */
 	long long reuse;                        /* number of connection reuses */
+	long long connect_tfo;                  /* connect() attempts with data in the SYN (TFO, BE only) */
+	long long connect_tfo_fall;             /* TFO attempts downgraded to a regular handshake (BE only) */
 	long long failed_conns;                 /* failed connect() attempts (BE only) */
 	long long failed_resp;                  /* failed responses (BE only) */
 	long long cli_aborts;                   /* aborted responses during DATA phase caused by the client */
 	long long srv_aborts;                   /* aborted responses during DATA phase caused by the server */
 	long long retries;                      /* retried and redispatched connections (BE only) */
 	long long redispatches;                 /* retried and redispatched connections (BE only) */
+	long long denied_retries;               /* retries denied by the retry budget (BE only) */
 	long long failed_rewrites;              /* failed rewrites (warning) */
 	long long internal_errors;              /* internal processing errors */
 
@@ -104,6 +124,10 @@ struct be_counters {
 	unsigned int q_time, c_time, d_time, t_time; /* sums of conn_time, queue_time, data_time, total_time */
 	unsigned int qtime_max, ctime_max, dtime_max, ttime_max; /* maximum of conn_time, queue_time, data_time, total_time observed */
 
+	unsigned int ttime_hist[TIME_HIST_BUCKETS]; /* distribution of total_time */
+	unsigned int ctime_hist[TIME_HIST_BUCKETS]; /* distribution of conn_time */
+	unsigned int dtime_hist[TIME_HIST_BUCKETS]; /* distribution of data_time */
+
 	union {
 		struct {
 			long long cum_req;      /* cumulated number of processed HTTP requests */
@@ -114,6 +138,8 @@ struct be_counters {
 			long long cache_hits;   /* cache hits */
 		} http;
 	} p;                                    /* protocol-specific stats */
+
+	struct cnt_shard shards[MAX_TGROUPS];   /* per thread-group bytes_in/bytes_out */
 };
 
 #endif /* _HAPROXY_COUNTERS_T_H */
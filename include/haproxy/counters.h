@@ -0,0 +1,116 @@
+/*
+ * include/haproxy/counters.h
+ * Functions to manipulate the sharded statistics counters.
+ *
+ * Copyright 2008-2009 Krzysztof Piotr Oledzki <ole@ans.pl>
+ * Copyright 2011-2014 Willy Tarreau <w@1wt.eu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_COUNTERS_H
+#define _HAPROXY_COUNTERS_H
+
+#include <haproxy/api.h>
+#include <haproxy/counters-t.h>
+#include <haproxy/intops.h>
+#include <haproxy/thread.h>
+
+/* Add <v> bytes received from the client to counters <c>, which may be any of
+ * the fe/be/srv/listener counters. Only the current thread group's shard is
+ * touched, so the atomic op never competes with other groups (i.e. other NUMA
+ * nodes when groups are bound to nodes).
+ */
+#define cnt_add_bytes_in(c, v)  _HA_ATOMIC_ADD(&(c)->shards[tgid - 1].bytes_in,  (v))
+
+/* Same as cnt_add_bytes_in() for the bytes sent to the client */
+#define cnt_add_bytes_out(c, v) _HA_ATOMIC_ADD(&(c)->shards[tgid - 1].bytes_out, (v))
+
+/* returns the sum of the bytes_in shards of <shards>, for use by the stats
+ * consumers. The shards of unused groups always remain zero.
+ */
+static inline long long cnt_bytes_in(const struct cnt_shard *shards)
+{
+	long long total = 0;
+	int i;
+
+	for (i = 0; i < MAX_TGROUPS; i++)
+		total += HA_ATOMIC_LOAD(&shards[i].bytes_in);
+	return total;
+}
+
+/* same as cnt_bytes_in() for the bytes_out shards */
+static inline long long cnt_bytes_out(const struct cnt_shard *shards)
+{
+	long long total = 0;
+	int i;
+
+	for (i = 0; i < MAX_TGROUPS; i++)
+		total += HA_ATOMIC_LOAD(&shards[i].bytes_out);
+	return total;
+}
+
+/* Returns the histogram bucket for a time of <ms> milliseconds. Buckets 0-7
+ * are one millisecond wide, then each power of two is split in four buckets
+ * so that the relative resolution always remains better than 25%. Bucket 63
+ * nominally covers up to 131071 ms and also collects everything above.
+ * Negative times (unset timers) are accounted in bucket zero.
+ */
+static inline unsigned int tm_hist_idx(int ms)
+{
+	unsigned int e;
+
+	if (ms < 8)
+		return (ms < 0) ? 0 : ms;
+
+	e = my_flsl(ms) - 1;
+	if (e >= 17)
+		return TIME_HIST_BUCKETS - 1;
+	return ((e - 3) << 2) + 8 + (((unsigned int)ms >> (e - 2)) & 3);
+}
+
+/* Returns the upper bound in milliseconds of histogram bucket <idx>, the
+ * reciprocal of tm_hist_idx(). The last bucket also collects all larger
+ * values.
+ */
+static inline unsigned int tm_hist_bound(unsigned int idx)
+{
+	unsigned int e, sub;
+
+	if (idx < 8)
+		return idx;
+
+	e   = ((idx - 8) >> 2) + 3;
+	sub = (idx - 8) & 3;
+	return ((sub + 5) << (e - 2)) - 1;
+}
+
+/* Adds one sample of <ms> milliseconds to histogram <hist>, one of the
+ * *time_hist[] arrays of a be_counters struct. The update is atomic so the
+ * histograms may be fed and consulted concurrently without locking.
+ */
+static inline void tm_hist_add(unsigned int *hist, int ms)
+{
+	_HA_ATOMIC_INC(&hist[tm_hist_idx(ms)]);
+}
+
+#endif /* _HAPROXY_COUNTERS_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -30,6 +30,9 @@ void ha_thread_dump(struct buffer *buf, int thr, int calling_tid);
 void ha_dump_backtrace(struct buffer *buf, const char *prefix, int dump);
 void ha_backtrace_to_stderr(void);
 void ha_thread_dump_all_to_trash(void);
+#ifdef USE_THREAD
+void ha_dump_lock_contention(struct buffer *buf);
+#endif
 void ha_panic(void);
 
 #endif /* _HAPROXY_DEBUG_H */
@@ -192,6 +192,16 @@
 #define MAX_POLL_EVENTS 200
 #endif
 
+// the max number of dead connections that the per-thread cleanup task may
+// destroy in one wakeup. Mass removals (server maintenance, "shutdown
+// sessions", idle-conn purges) can queue thousands of connections at once,
+// and closing them all inline would stall the thread for several ms. The
+// task re-wakes itself as long as some remain so the scheduler can
+// interleave other work between batches.
+#ifndef CONN_CLEANUP_BATCH
+#define CONN_CLEANUP_BATCH 64
+#endif
+
 /* eternity when exprimed in timeval */
 #ifndef TV_ETERNITY
 #define TV_ETERNITY     (~0UL)
@@ -438,6 +448,15 @@
 #define CONFIG_HAP_POOL_CLUSTER_SIZE 8
 #endif
 
+/* Number of buckets a stick-table is divided into. Each bucket gets its own
+ * trees, lock and expiration task, so that concurrent accesses to entries
+ * hashed into different buckets never compete for the same lock. Must be a
+ * power of two.
+ */
+#ifndef CONFIG_HAP_TBL_BUCKETS
+#define CONFIG_HAP_TBL_BUCKETS 16
+#endif
+
 /* Number of samples used to compute the times reported in stats. A power of
  * two is highly recommended, and this value multiplied by the largest response
  * time must not overflow and unsigned int. See freq_ctr.h for more information.
@@ -95,10 +95,18 @@ struct dns_stream_server {
 	__decl_thread(HA_SPINLOCK_T lock); // lock to protect current struct
 };
 
+/* maximum number of datagrams read at once by recvmmsg() */
+#define DNS_RX_BATCH 4
+
 struct dns_dgram_server {
 	struct dgram_conn conn;  /* transport layer */
 	struct ring *ring_req;
 	size_t ofs_req;           // ring buffer reader offset
+	char *rx_buf;             /* stash for a batch of received datagrams */
+	size_t rx_slot;           /* size of a datagram slot in <rx_buf> */
+	unsigned int rx_len[DNS_RX_BATCH]; /* length of each stashed datagram */
+	unsigned char rx_count;   /* number of datagrams in the stash */
+	unsigned char rx_next;    /* next datagram to deliver */
 };
 
 struct dns_query {
@@ -37,6 +37,7 @@
 extern struct pool_head *pool_head_buffer;
 
 int init_buffer(void);
+int buffer_arena_init(void);
 void buffer_dump(FILE *o, struct buffer *b, int from, int to);
 
 /*****************************************************************/
@@ -333,6 +333,14 @@ struct event_hdl_sub *event_hdl_lookup_take(event_hdl_sub_list *sub_list,
 int event_hdl_publish(event_hdl_sub_list *sub_list,
                       struct event_hdl_sub_type e_type, const struct event_hdl_cb_data *data);
 
+/* returns 1 if <sub_list> (or the global subscription list if NULL) currently
+ * has no subscription, 0 otherwise.
+ * This is racy by nature (a subscriber may register right after the check),
+ * but it is fine for publishers that only want to skip the event data
+ * preparation when nobody listens.
+ */
+int event_hdl_sub_list_empty(event_hdl_sub_list *sub_list);
+
 /* ------ MISC/HELPER FUNCTIONS ------ */
 
 /* returns a statically allocated string that is
@@ -180,16 +180,21 @@ struct fdlist {
  * containing a thread group ID. The tgid may only be changed when refc is zero
  * and running may only be checked/changed when refc is held and shows the
  * reader is alone. An FD with tgid zero belongs to nobody.
+ * The fields are laid out with the atomically updated words first (these are
+ * the ones hammered by fd_update_events() and by cross-thread takeovers), and
+ * the rarely written ones (update list entry, iocb, owner) at the end, so
+ * that the write-hot part of each entry stays packed at the head of its
+ * cache line.
  */
 struct fdtab {
+	unsigned int state;                  /* FD state for read and write directions (FD_EV_*) + FD_POLL_* */
+	unsigned int refc_tgid;              /* refcounted tgid, updated atomically */
 	unsigned long running_mask;          /* mask of thread IDs currently using the fd */
-	unsigned long thread_mask;           /* mask of thread IDs authorized to process the fd */
 	unsigned long update_mask;           /* mask of thread IDs having an update for fd */
+	unsigned long thread_mask;           /* mask of thread IDs authorized to process the fd */
 	struct fdlist_entry update;          /* Entry in the global update list */
 	void (*iocb)(int fd);                /* I/O handler */
 	void *owner;                         /* the connection or listener associated with this fd, NULL if closed */
-	unsigned int state;                  /* FD state for read and write directions (FD_EV_*) + FD_POLL_* */
-	unsigned int refc_tgid;              /* refcounted tgid, updated atomically */
 #ifdef DEBUG_FD
 	unsigned int event_count;            /* number of events reported */
 #endif
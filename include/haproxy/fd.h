@@ -82,6 +82,7 @@ struct rlimit;
 int raise_rlim_nofile(struct rlimit *old_limit, struct rlimit *new_limit);
 
 int compute_poll_timeout(int next);
+uint64_t compute_poll_spin_until(int wait_time);
 void fd_leaving_poll(int wait_time, int status);
 
 /* disable the specified poller */
@@ -35,6 +35,18 @@ struct freq_ctr {
 	unsigned int prev_ctr; /* value for last period */
 };
 
+/* Small single-entry cache for read_freq_ctr_period_cached(). It remembers
+ * the last counter read and the rate that was computed for it during the
+ * current millisecond. It must be thread-local (or otherwise private) since
+ * it is accessed without any locking.
+ */
+struct freq_ctr_cache {
+	const struct freq_ctr *ctr; /* counter the cached rate belongs to */
+	unsigned int tick;      /* now_ms at the time of the computation */
+	unsigned int period;    /* period the rate was computed for */
+	unsigned int rate;      /* cached result of read_freq_ctr_period() */
+};
+
 #endif /* _HAPROXY_FREQ_CTR_T_H */
 
 /*
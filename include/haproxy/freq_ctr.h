@@ -84,6 +84,26 @@ static inline uint read_freq_ctr_period(struct freq_ctr *ctr, uint period)
 	return div64_32(total, period);
 }
 
+/* Same as read_freq_ctr_period() but uses the single-entry thread-local cache
+ * <cache> to avoid recomputing the interpolated rate when the same counter is
+ * read several times during the same millisecond, which is typically the case
+ * for a series of ACLs checking the rates of the same stick counter. The
+ * cached value is at most one millisecond old, which remains well below the
+ * precision of the measure itself, but it means that events added to the
+ * counter during the current millisecond may not be reflected immediately.
+ */
+static inline uint read_freq_ctr_period_cached(struct freq_ctr *ctr, uint period, struct freq_ctr_cache *cache)
+{
+	if (cache->ctr == ctr && cache->tick == now_ms && cache->period == period)
+		return cache->rate;
+
+	cache->ctr    = ctr;
+	cache->tick   = now_ms;
+	cache->period = period;
+	cache->rate   = read_freq_ctr_period(ctr, period);
+	return cache->rate;
+}
+
 /* same as read_freq_ctr_period() above except that floats are used for the
  * output so that low rates can be more precise.
  */
@@ -102,6 +122,12 @@ static inline unsigned int read_freq_ctr(struct freq_ctr *ctr)
 	return read_freq_ctr_period(ctr, MS_TO_TICKS(1000));
 }
 
+/* Cached variant of read_freq_ctr(), see read_freq_ctr_period_cached() */
+static inline uint read_freq_ctr_cached(struct freq_ctr *ctr, struct freq_ctr_cache *cache)
+{
+	return read_freq_ctr_period_cached(ctr, MS_TO_TICKS(1000), cache);
+}
+
 /* same as read_freq_ctr() above except that floats are used for the
  * output so that low rates can be more precise.
  */
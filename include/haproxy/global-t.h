@@ -80,6 +80,16 @@
 #define GTUNE_QUICK_EXIT         (1<<23)
 #define GTUNE_QUIC_SOCK_PER_CONN (1<<24)
 #define GTUNE_NO_QUIC            (1<<25)
+#define GTUNE_USE_URING          (1<<26)
+#define GTUNE_LISTENER_MQ_LOAD   (1<<27)
+#define GTUNE_BUFS_HUGEPAGES     (1<<28)
+#define GTUNE_QUIC_PACING        (1<<29)
+#define GTUNE_SCHED_BULK_SSL     (1<<30)
+
+/* overload shedding actions for tune.overload.action */
+#define OVERLOAD_ACT_REJECT      0    /* close incoming connections immediately */
+#define OVERLOAD_ACT_FAST503     1    /* respond 503 to new requests without processing them */
+#define OVERLOAD_ACT_DRAIN       2    /* stop accepting, leave connections in the kernel queue */
 
 /* SSL server verify mode */
 enum {
@@ -87,6 +97,12 @@ enum {
 	SSL_SERVER_VERIFY_REQUIRED = 1,
 };
 
+/* NUMA placement policy of large shared arrays (global.numa_policy) */
+enum {
+	NUMA_POLICY_DEFAULT = 0,   /* leave placement to the kernel (first touch) */
+	NUMA_POLICY_INTERLEAVE,    /* interleave pages across all NUMA nodes */
+};
+
 /* bit values to go with "warned" above */
 #define WARN_ANY                    0x00000001 /* any warning was emitted */
 #define WARN_FORCECLOSE_DEPRECATED  0x00000002
@@ -141,6 +157,12 @@ struct global {
 		int maxaccept;     /* max number of consecutive accept() */
 		int options;       /* various tuning options */
 		int runqueue_depth;/* max number of tasks to run at once */
+		int sched_steal_batch; /* max non-affine tasks stolen from a sibling at once (0=off) */
+		int sched_inline_depth; /* max I/O stream wakeups skipping the run queue per scheduler pass (0=off) */
+		unsigned int host_stats_max; /* max number of hosts tracked by per-host stats (0=off) */
+		int sched_heavy_per_loop; /* max heavy tasklets processed per polling loop (default 1) */
+		uint sched_timer_gran; /* rounding granularity of distant timers, in ms (0=off) */
+		uint poll_spin_us; /* max time to busy-wait before sleeping in the poller, in us (0=off) */
 		int recv_enough;   /* how many input bytes at once are "enough" */
 		int bufsize;       /* buffer size in bytes, defaults to BUFSIZE */
 		int maxrewrite;    /* buffer max rewrite size in bytes, defaults to MAXREWRITE */
@@ -151,6 +173,7 @@ struct global {
 		int server_sndbuf; /* set server sndbuf to this value if not null */
 		int server_rcvbuf; /* set server rcvbuf to this value if not null */
 		int pipesize;      /* pipe size in bytes, system defaults if zero */
+		int pipes_prewarm; /* number of pipes to pre-allocate per thread at boot */
 		int max_http_hdr;  /* max number of HTTP headers, use MAX_HTTP_HDR if zero */
 		int requri_len;    /* max len of request URI, use REQURI_LEN if zero */
 		int cookie_len;    /* max length of cookie captures */
@@ -163,7 +186,11 @@ struct global {
 		int pool_high_count;  /* max number of opened fd before we start killing idle connections when creating new connections */
 		size_t pool_cache_size;    /* per-thread cache size per pool (defaults to CONFIG_HAP_POOL_CACHE_SIZE) */
 		unsigned short idle_timer; /* how long before an empty buffer is considered idle (ms) */
+		uint idle_shrink;  /* how long before an idle mux releases its expendable memory (ms, 0=never) */
 		int nb_stk_ctr;       /* number of stick counters, defaults to MAX_SESS_STKCTR */
+		uint overload_loop_time; /* avg loop time in us above which a thread sheds load (0=never) */
+		uint overload_rq_depth;  /* per-thread run queue depth above which a thread sheds load (0=never) */
+		int overload_action;     /* what to do when overloaded, OVERLOAD_ACT_* */
 #ifdef USE_QUIC
 		unsigned int quic_backend_max_idle_timeout;
 		unsigned int quic_frontend_max_idle_timeout;
@@ -183,6 +210,8 @@ struct global {
 	} unix_bind;
 	struct proxy *cli_fe;           /* the frontend holding the stats settings */
 	int numa_cpu_mapping;
+	int l3_cpu_mapping;             /* 0 to disable the L3 cache based thread group placement */
+	int numa_policy;                /* allocation policy for large shared arrays (NUMA_POLICY_*) */
 	int cfg_curr_line;              /* line number currently being parsed */
 	const char *cfg_curr_file;      /* config file currently being parsed or NULL */
 	char *cfg_curr_section;         /* config section name currently being parsed or NULL */
@@ -65,6 +65,7 @@ int compare_current_version(const char *version);
 
 void mworker_accept_wrapper(int fd);
 void mworker_reload(void);
+int mworker_config_unchanged(void);
 
 /* to be used with warned and WARN_* */
 static inline int already_warned(unsigned int warning)
@@ -0,0 +1,70 @@
+/*
+ * include/haproxy/host_stats-t.h
+ * This file contains types for per-host statistics.
+ *
+ * Copyright 2023 HAProxy Technologies
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef _HAPROXY_HOST_STATS_T_H
+#define _HAPROXY_HOST_STATS_T_H
+
+#include <import/ebtree-t.h>
+
+#include <haproxy/api-t.h>
+#include <haproxy/thread-t.h>
+
+/* number of independent shards the store is split into. Each shard has its
+ * own lock, tree and LRU list so that updates performed by all threads only
+ * collide when hitting the same subset of hosts. Must be a power of two.
+ */
+#define HOST_STATS_SHARDS 64
+
+/* maximum length of a tracked host name, longer ones are truncated */
+#define HOST_STATS_KEYLEN 255
+
+/* one tracked host. Everything is covered by the owner shard's lock except
+ * <refcnt> and the counters which are updated atomically by their holders.
+ */
+struct host_stats_entry {
+	struct list lru;          /* position in the shard's LRU list */
+	unsigned int refcnt;      /* streams and dumpers holding this entry */
+	unsigned int shard;       /* owner shard number */
+	long long req_tot;        /* total number of requests seen */
+	long long rsp[6];         /* responses per status class, [0] = other */
+	struct ebmb_node node;    /* indexing node, its key is the host name */
+	/* WARNING: the host name is stored right after <node>, don't add
+	 * any field after it.
+	 */
+};
+
+/* one shard of the store */
+struct host_stats_shard {
+	struct eb_root keys;      /* entries sorted by host name */
+	struct list lru;          /* entries by last use, oldest at the tail */
+	unsigned int count;       /* number of entries in this shard */
+	long long evicted;        /* total number of entries evicted so far */
+	__decl_thread(HA_SPINLOCK_T lock);
+};
+
+#endif /* _HAPROXY_HOST_STATS_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
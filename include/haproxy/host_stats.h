@@ -0,0 +1,47 @@
+/*
+ * include/haproxy/host_stats.h
+ * This file contains functions for per-host statistics.
+ *
+ * Copyright 2023 HAProxy Technologies
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef _HAPROXY_HOST_STATS_H
+#define _HAPROXY_HOST_STATS_H
+
+#include <haproxy/api.h>
+#include <haproxy/host_stats-t.h>
+
+extern struct host_stats_shard host_stats_shards[HOST_STATS_SHARDS];
+
+struct host_stats_entry *host_stats_get(const char *host, size_t len);
+
+/* releases the reference held on entry <ent>. Once unreferenced, the entry
+ * is eligible for LRU eviction again.
+ */
+static inline void host_stats_put(struct host_stats_entry *ent)
+{
+	HA_ATOMIC_DEC(&ent->refcnt);
+}
+
+#endif /* _HAPROXY_HOST_STATS_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
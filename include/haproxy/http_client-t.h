@@ -37,6 +37,21 @@ struct httpclient {
 #ifdef USE_OPENSSL
 	struct server *srv_ssl;               /* server for SSL connections */
 #endif
+	struct httpclient_batch *batch;       /* batch this client belongs to, or NULL */
+	struct list batch_el;                 /* membership in the batch's client list */
+};
+
+/* Groups several httpclients behind a single completion callback: the
+ * requests run concurrently, sharing the proxy's idle server connections,
+ * and <done> is called once, when the last of them ends. All the clients of
+ * a batch must be started from the same thread, which is also the one the
+ * callback runs on, so no locking is involved.
+ */
+struct httpclient_batch {
+	struct list clients;                  /* attached httpclients */
+	int remaining;                        /* clients not ended yet */
+	void (*done)(struct httpclient_batch *batch); /* completion callback */
+	void *caller;                         /* opaque pointer for the caller */
 };
 
 /* Action (FA) to do */
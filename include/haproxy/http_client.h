@@ -12,6 +12,10 @@ struct httpclient *httpclient_new_from_proxy(struct proxy *px, void *caller, enu
 int httpclient_set_proxy(struct httpclient *hc, struct proxy *px);
 
 struct appctx *httpclient_start(struct httpclient *hc);
+struct httpclient_batch *httpclient_batch_new(void *caller, void (*done)(struct httpclient_batch *batch));
+int httpclient_batch_add(struct httpclient_batch *batch, struct httpclient *hc);
+int httpclient_batch_start(struct httpclient_batch *batch);
+void httpclient_batch_destroy(struct httpclient_batch *batch);
 int httpclient_set_dst(struct httpclient *hc, const char *dst);
 void httpclient_set_timeout(struct httpclient *hc, int timeout);
 int httpclient_res_xfer(struct httpclient *hc, struct buffer *dst);
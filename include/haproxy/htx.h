@@ -316,6 +316,19 @@ static inline struct htx_blk *htx_get_next_blk(const struct htx *htx,
 	return ((pos == -1) ? NULL : htx_get_blk(htx, pos));
 }
 
+/* Returns the HTX block after <blk>, <tail> being the tail block as
+ * precomputed by the caller with htx_get_tail_blk(). The blocks form a dense
+ * array growing downwards from the end of the storage area, so the next
+ * position simply is the previous descriptor in memory. This skips the
+ * position arithmetic of htx_get_next_blk() and is meant for tight read-only
+ * walks during which the message cannot change (e.g. header lookups).
+ */
+static inline struct htx_blk *htx_get_next_blk_fast(const struct htx_blk *blk,
+						    const struct htx_blk *tail)
+{
+	return ((blk == tail) ? NULL : (struct htx_blk *)blk - 1);
+}
+
 /* Returns 1 if <blk> is the block is the only one inside the HTX message <htx>,
  * excluding all unused blocks. Otherwise, it returns 0. If 1 is returned, this
  * means that there is only <blk> and eventually some unused ones in <htx>.
@@ -766,7 +779,21 @@ static inline int htx_copy_msg(struct htx *htx, const struct buffer *msg)
 {
 	/* The destination HTX message is allocated and empty, we can do a raw copy */
 	if (htx_is_empty(htx) && htx_free_space(htx)) {
-		memcpy(htx, msg->area, msg->size);
+		const struct htx *src = (const struct htx *)msg->area;
+		uint32_t blks = src->tail + 1;
+
+		/* Only copy the live regions instead of the whole storage
+		 * area: the header plus the payloads at the front, then the
+		 * block table at the end. Error and return messages are
+		 * stored in full-sized but mostly empty buffers, for which
+		 * the full copy used to dominate the cost of emitting a
+		 * response.
+		 */
+		memcpy(htx, src, sizeof(*src) + src->tail_addr);
+		if (blks)
+			memcpy(htx->blocks + htx_pos_to_addr(src, src->tail),
+			       src->blocks + htx_pos_to_addr(src, src->tail),
+			       blks * sizeof(struct htx_blk));
 		return 1;
 	}
 
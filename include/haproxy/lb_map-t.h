@@ -22,11 +22,20 @@
 #ifndef _HAPROXY_LB_MAP_T_H
 #define _HAPROXY_LB_MAP_T_H
 
+#include <import/ebtree-t.h>
 #include <haproxy/api-t.h>
 #include <haproxy/server-t.h>
 
+/* one entry per server in the scratch pick queue used to rebuild the map */
+struct lb_map_pick {
+	struct eb64_node node;	/* key: next virtual pick time + declaration index */
+	struct server *srv;	/* the server this entry designates */
+	unsigned int picks;	/* number of map slots already assigned */
+};
+
 struct lb_map {
 	struct server **srv;	/* the server map used to apply weights */
+	struct lb_map_pick *pick; /* scratch pick queue for recalc_server_map() */
 	int rr_idx;		/* next server to be elected in round robin mode */
 };
 
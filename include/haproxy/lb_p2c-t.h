@@ -0,0 +1,56 @@
+/*
+ * include/haproxy/lb_p2c-t.h
+ * Types for the power-of-two-choices load balancing algorithm.
+ *
+ * Copyright (C) 2023 Willy Tarreau - w@1wt.eu
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_LB_P2C_T_H
+#define _HAPROXY_LB_P2C_T_H
+
+#include <haproxy/compiler.h>
+
+/* A flat map of usable servers. Maps are only modified under the lbprm lock
+ * with the revision counter below marked odd, so that pickers can read them
+ * without any lock and detect a concurrent rebuild. When a map needs to grow,
+ * the old one is kept chained via <prev> instead of being freed, because a
+ * lockless reader may still be dereferencing it; the memory is only released
+ * when the proxy is deinitialized. Growth only happens when servers are added
+ * to the backend, so the waste is bounded by the number of doublings.
+ */
+struct lb_p2c_map {
+	struct lb_p2c_map *prev;	/* older generation, kept for lockless readers */
+	unsigned int size;		/* number of allocated entries */
+	struct server *srv[VAR_ARRAY];	/* usable servers, first <nbsrv> entries are valid */
+};
+
+struct lb_p2c {
+	struct lb_p2c_map *act;		/* map of usable active servers */
+	struct lb_p2c_map *bck;		/* map of usable backup servers */
+	unsigned int nbsrv_act;		/* number of valid entries in <act> */
+	unsigned int nbsrv_bck;		/* number of valid entries in <bck> */
+	unsigned int revision;		/* odd while a rebuild is in progress */
+};
+
+#endif /* _HAPROXY_LB_P2C_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,41 @@
+/*
+ * include/haproxy/lb_p2c.h
+ * Power-of-two-choices load balancing algorithm.
+ *
+ * Copyright (C) 2023 Willy Tarreau - w@1wt.eu
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_LB_P2C_H
+#define _HAPROXY_LB_P2C_H
+
+#include <haproxy/api.h>
+#include <haproxy/lb_p2c-t.h>
+#include <haproxy/proxy-t.h>
+#include <haproxy/server-t.h>
+
+void p2c_init_server_map(struct proxy *p);
+void p2c_deinit_server_map(struct proxy *p);
+struct server *p2c_get_next_server(struct proxy *p, struct server *srvtoavoid);
+
+#endif /* _HAPROXY_LB_P2C_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -46,6 +46,7 @@
 #define LOG_OPT_HTTP            0x00000020
 #define LOG_OPT_ESC             0x00000040
 #define LOG_OPT_MERGE_SPACES    0x00000080
+#define LOG_OPT_BIN             0x00000100
 
 
 /* Fields that need to be extracted from the incoming connection or request for
@@ -198,6 +199,7 @@ struct logformat_node {
 	int type;      // LOG_FMT_*
 	int options;   // LOG_OPT_*
 	char *arg;     // text for LOG_FMT_TEXT, arg for others
+	int arg_len;   // length of <arg> for LOG_FMT_TEXT, to avoid a strlen() per log line
 	void *expr;    // for use with LOG_FMT_EXPR
 };
 
@@ -241,7 +243,6 @@ struct logsrv {
                 char *file;                     /* file where the logsrv appears */
                 int line;                       /* line where the logsrv appears */
         } conf;
-	__decl_thread(HA_SPINLOCK_T lock);
 };
 
 #endif /* _HAPROXY_LOG_T_H */
@@ -78,7 +78,7 @@ void app_log(struct list *logsrvs, struct buffer *tag, int level, const char *fo
 /*
  * add to the logformat linked list
  */
-int add_to_logformat_list(char *start, char *end, int type, struct list *list_format, char **err);
+int add_to_logformat_list(char *start, char *end, int type, int options, struct list *list_format, char **err);
 
 /*
  * Parse the log_format string and fill a linked list.
@@ -61,6 +61,7 @@
 #define H2_CF_WINDOW_OPENED     0x00010000  // demux increased window already advertised
 #define H2_CF_RCVD_SHUT         0x00020000  // a recv() attempt already failed on a shutdown
 #define H2_CF_END_REACHED       0x00040000  // pending data too short with RCVD_SHUT present
+#define H2_CF_IDLE_SHRUNK       0x00080000  // idle resources were released, rearmed on demux activity
 
 #define H2_CF_RCVD_RFC8441      0x00100000  // settings from RFC8441 has been received indicating support for Extended CONNECT
 #define H2_CF_SHTS_UPDATED      0x00200000  // SETTINGS_HEADER_TABLE_SIZE updated
@@ -85,8 +86,9 @@ static forceinline char *h2c_show_flags(char *buf, size_t len, const char *delim
 	_(H2_CF_DEM_SHORT_READ, _(H2_CF_DEM_IN_PROGRESS, _(H2_CF_GOAWAY_SENT,
 	_(H2_CF_GOAWAY_FAILED, _(H2_CF_WAIT_FOR_HS, _(H2_CF_IS_BACK,
 	_(H2_CF_WINDOW_OPENED, _(H2_CF_RCVD_SHUT, _(H2_CF_END_REACHED,
+	_(H2_CF_IDLE_SHRUNK,
 	_(H2_CF_RCVD_RFC8441, _(H2_CF_SHTS_UPDATED, _(H2_CF_DTSU_EMITTED,
-	_(H2_CF_ERR_PENDING, _(H2_CF_ERROR))))))))))))))))))))));
+	_(H2_CF_ERR_PENDING, _(H2_CF_ERROR)))))))))))))))))))))));
 	/* epilogue */
 	_(~0U);
 	return buf;
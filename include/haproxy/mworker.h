@@ -18,6 +18,7 @@
 #include <haproxy/signal-t.h>
 
 extern struct mworker_proc *proc_self;
+extern int mworker_skip_unchanged_reloads;
 
 void mworker_proc_list_to_env(void);
 int mworker_env_to_proc_list(void);
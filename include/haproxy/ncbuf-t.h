@@ -85,6 +85,7 @@ struct ncbuf {
 	char *area;
 	ncb_sz_t size;
 	ncb_sz_t head;
+	ncb_sz_t hint; /* offset of a gap block to resume lookups from, 0 if unset */
 };
 
 enum ncb_ret {
@@ -123,10 +123,10 @@ struct pat_ref_elt {
 	struct list back_refs; /* list of users tracking this pat ref */
 	void *list_head; /* all &pattern_list->from_ref derived from this reference, ends with NULL */
 	void *tree_head; /* all &pattern_tree->from_ref derived from this reference, ends with NULL */
-	char *pattern;
 	char *sample;
 	unsigned int gen_id; /* generation of pat_ref this was made for */
 	int line;
+	char pattern[VAR_ARRAY]; /* the pattern string, allocated with the element */
 };
 
 /* This contain each tree indexed entry. This struct permit to associate
@@ -183,6 +183,11 @@ struct pattern_list {
 	struct pattern pat;
 };
 
+/* Compiled multi-pattern automaton used by substring matching. Fully private
+ * to pattern.c, see the description above pat_ac_build() there.
+ */
+struct pat_ac;
+
 /* Description of a pattern expression.
  * It contains pointers to the parse and match functions, and a list or tree of
  * patterns to test against. The structure is organized so that the hot parts
@@ -199,6 +204,7 @@ struct pattern_expr {
 	struct list patterns;         /* list of acl_patterns */
 	struct eb_root pattern_tree;  /* may be used for lookup in large datasets */
 	struct eb_root pattern_tree_2;  /* may be used for different types */
+	struct pat_ac *ac;              /* optional substring matching automaton, or NULL */
 	int mflags;                     /* flags relative to the parsing or matching method. */
 	__decl_thread(HA_RWLOCK_T lock);               /* lock used to protect patterns */
 };
@@ -47,11 +47,16 @@ struct shared_table {
 	unsigned int last_get;
 	unsigned int teaching_origin;
 	unsigned int update;
+	char *last_pushed_key;        /* last key sent over the wire, used to delta-encode the next one */
+	int last_pushed_key_len;      /* length of <last_pushed_key>, -1 when unusable */
+	char *last_get_key;           /* last key received, used to rebuild delta-encoded keys */
+	int last_get_key_len;         /* length of <last_get_key>, -1 when unusable */
 	struct shared_table *next;    /* next shared table in list */
 };
 
 struct peer {
 	int local;                    /* proxy state */
+	int stripe;                   /* stripe index handled by this session, 0 for the base peer */
 	__decl_thread(HA_SPINLOCK_T lock); /* lock used to handle this peer section */
 	char *id;
 	struct {
@@ -65,6 +70,7 @@ struct peer {
 	void *sock_init_arg;          /* socket operations's opaque init argument if needed */
 	unsigned int flags;           /* peer session flags */
 	unsigned int statuscode;      /* current/last session status code */
+	unsigned int proto_minor;     /* peers protocol minor version in use on the current session */
 	unsigned int reconnect;       /* next connect timer */
 	unsigned int heartbeat;       /* next heartbeat timer */
 	unsigned int confirm;         /* confirm message counter */
@@ -103,6 +109,7 @@ struct peers {
 	unsigned int resync_timeout;    /* resync timeout timer */
 	int count;                      /* total of peers */
 	int nb_shards;                  /* Number of peer shards */
+	int nb_stripes;                 /* Number of parallel sessions per remote peer */
 	int disabled;                   /* peers proxy disabled if >0 */
 	int applet_count[MAX_THREADS];  /* applet count per thread */
 };
@@ -34,6 +34,7 @@
 extern struct peers *cfg_peers;
 
 int peers_init_sync(struct peers *peers);
+int peers_alloc_stripes(struct peers *peers);
 int peers_alloc_dcache(struct peers *peers);
 int peers_register_table(struct peers *, struct stktable *table);
 void peers_setup_frontend(struct proxy *fe);
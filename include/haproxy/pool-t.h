@@ -114,13 +114,17 @@ struct pool_head {
 	unsigned int flags;	/* MEM_F_* */
 	unsigned int users;	/* number of pools sharing this zone */
 	unsigned int alloc_sz;	/* allocated size (includes hidden fields) */
+	unsigned int mem_flags;	/* allocator flags for mallocx() when bound to a dedicated arena (0 = plain malloc) */
 	struct list list;	/* list of all known pools */
 	void *base_addr;        /* allocation address, for free() */
+	void *arena_addr;       /* base of the optional preallocated arena */
+	size_t arena_size;      /* size of the arena in bytes (0 = none) */
 	char name[12];		/* name of the pool */
 
 	/* heavily read-write part */
 	THREAD_ALIGN(64);
-	struct pool_item *free_list; /* list of free shared objects */
+	struct pool_item *free_list[MAX_TGROUPS]; /* lists of free shared objects, one shard per thread group */
+	struct pool_item *arena_free; /* recycled arena chunks awaiting reuse */
 	unsigned int used;	/* how many chunks are currently in use */
 	unsigned int needed_avg;/* floating indicator between used and allocated */
 	unsigned int allocated;	/* how many chunks have been allocated */
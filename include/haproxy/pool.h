@@ -105,6 +105,7 @@ void *pool_get_from_os(struct pool_head *pool);
 void pool_put_to_os(struct pool_head *pool, void *ptr);
 void *pool_alloc_nocache(struct pool_head *pool);
 void pool_free_nocache(struct pool_head *pool, void *ptr);
+int pool_reserve_arena(struct pool_head *pool, uint count);
 void dump_pools(void);
 int pool_parse_debugging(const char *str, char **err);
 int pool_total_failures(void);
@@ -132,6 +133,7 @@ void pool_fill_pattern(struct pool_cache_head *pch, struct pool_cache_item *item
 void pool_check_pattern(struct pool_cache_head *pch, struct pool_cache_item *item, uint size);
 void pool_refill_local_from_shared(struct pool_head *pool, struct pool_cache_head *pch);
 void pool_put_to_shared_cache(struct pool_head *pool, struct pool_item *item, uint count);
+void pool_prewarm(struct pool_head *pool, uint count);
 
 /* Returns the max number of entries that may be brought back to the pool
  * before it's considered as full. Note that it is only usable for releasing
@@ -220,6 +222,23 @@ static inline void *pool_get_from_cache(struct pool_head *pool, const void *call
 }
 
 
+/* Prefetches the object which would most likely be returned by the next
+ * allocation from <pool>'s local cache. This may be used at the beginning of
+ * a sequence of dependent allocations so that the first-touch misses of the
+ * later objects overlap with the work done in between instead of
+ * serializing. It's only a hint and does nothing when the cache is disabled
+ * or empty.
+ */
+static inline void pool_prefetch(const struct pool_head *pool)
+{
+	if (likely(!(pool_debugging & POOL_DBG_NO_CACHE))) {
+		const struct pool_cache_head *ph = &pool->cache[tid];
+
+		if (likely(!LIST_ISEMPTY(&ph->list)))
+			__builtin_prefetch(LIST_NEXT(&ph->list, struct pool_cache_item *, by_pool), 1);
+	}
+}
+
 /****************** Common high-level code ******************/
 
 #if !defined(DEBUG_MEM_STATS)
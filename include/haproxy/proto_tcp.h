@@ -33,6 +33,7 @@ extern struct protocol proto_tcp6;
 
 int tcp_bind_socket(int fd, int flags, struct sockaddr_storage *local, struct sockaddr_storage *remote);
 int tcp_connect_server(struct connection *conn, int flags);
+void tcp_fastopen_report(struct connection *conn);
 int tcp_is_foreign(int fd, sa_family_t family);
 
 #endif /* _HAPROXY_PROTO_TCP_H */
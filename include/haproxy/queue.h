@@ -87,7 +87,7 @@ static inline int server_has_room(const struct server *s) {
  * for and if/else usage.
  */
 static inline int may_dequeue_tasks(const struct server *s, const struct proxy *p) {
-	return (s && (s->queue.length || (p->queue.length && srv_currently_usable(s))) &&
+	return (s && (s->queue_length || (p->queue.length && srv_currently_usable(s))) &&
 		(!s->maxconn || s->cur_sess < srv_dynamic_maxconn(s)));
 }
 
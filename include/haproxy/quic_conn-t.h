@@ -432,6 +432,14 @@ struct quic_rx_packet {
 };
 
 /* QUIC datagram handler */
+/* Per-thread datagram handler. There is one instance per thread, and a
+ * datagram is always queued to the instance of the thread owning the
+ * connection, which is encoded in the lowest 12 bits of every CID we emit
+ * (see quic_pin_cid_to_tid()). Since only the owning thread ever inserts,
+ * looks up or removes entries, the CID trees below are deliberately
+ * lock-free: packet-to-connection demux never touches shared state besides
+ * the dispatch mt_list.
+ */
 struct quic_dghdlr {
 	struct mt_list dgrams;
 	struct tasklet *task;
@@ -582,6 +590,11 @@ struct quic_path {
 	uint64_t in_flight;
 	/* Number of in flight ack-eliciting packets. */
 	uint64_t ifae_pkts;
+
+	/* Pacing emission credit (in bytes). */
+	uint64_t pace_credit;
+	/* Date of the last pacing credit refill. */
+	unsigned int pace_ts;
 };
 
 /* QUIC ring buffer */
@@ -618,6 +631,7 @@ enum qc_mux_state {
 /* gap here */
 #define QUIC_FL_CONN_HALF_OPEN_CNT_DECREMENTED   (1U << 11) /* The half-open connection counter was decremented */
 #define QUIC_FL_CONN_HANDSHAKE_SPEED_UP          (1U << 12) /* Handshake speeding up was done */
+#define QUIC_FL_CONN_PACED_OUT                   (1U << 13) /* Emission interrupted by the pacer, must be resumed ASAP */
 #define QUIC_FL_CONN_TO_KILL                     (1U << 24) /* Unusable connection, to be killed */
 #define QUIC_FL_CONN_TX_TP_RECEIVED              (1U << 25) /* Peer transport parameters have been received (used for the transmitting part) */
 #define QUIC_FL_CONN_FINALIZED                   (1U << 26) /* QUIC connection finalized (functional, ready to send/receive) */
@@ -578,9 +578,38 @@ static inline void quic_path_init(struct quic_path *path, int ipv4,
 	path->prep_in_flight = 0;
 	path->in_flight = 0;
 	path->ifae_pkts = 0;
+	path->pace_credit = path->cwnd;
+	path->pace_ts = now_ms;
 	quic_cc_init(&path->cc, algo, qc);
 }
 
+/* Refill the pacing credit of <path> depending on the time elapsed since the
+ * last refill. The credit grows at the current delivery rate, i.e. one
+ * congestion window per smoothed RTT, and is capped to a small burst so that
+ * a long quiet period may not be converted into a line rate blast.
+ */
+static inline void quic_path_pace_refill(struct quic_path *path)
+{
+	unsigned int elapsed = now_ms - path->pace_ts;
+	uint64_t rate, burst;
+
+	/* Emission budget per millisecond. <srtt> is stored premultiplied
+	 * by 8 (see quic_loss-t.h).
+	 */
+	rate = path->cwnd / QUIC_MAX(path->loss.srtt >> 3, 1U);
+	if (rate < path->mtu)
+		rate = path->mtu;
+
+	burst = QUIC_MAX(10 * (uint64_t)path->mtu, 2 * rate);
+	if (elapsed) {
+		path->pace_credit += rate * elapsed;
+		path->pace_ts = now_ms;
+	}
+
+	if (path->pace_credit > burst)
+		path->pace_credit = burst;
+}
+
 /* Return the remaining <room> available on <path> QUIC path. In fact this this
  *the remaining number of bytes available in the congestion controller window.
  */
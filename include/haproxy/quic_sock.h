@@ -35,6 +35,11 @@
 #include <haproxy/quic_conn-t.h>
 #include <haproxy/quic_sock-t.h>
 
+/* Maximum number of datagrams a single UDP GSO send may carry, matching the
+ * kernel's UDP_MAX_SEGMENTS limit.
+ */
+#define QUIC_MAX_GSO_DGRAMS 64
+
 int quic_session_accept(struct connection *cli_conn);
 int quic_sock_get_src(struct connection *conn, struct sockaddr *addr, socklen_t len);
 int quic_sock_get_dst(struct connection *conn, struct sockaddr *addr, socklen_t len);
@@ -45,6 +50,9 @@ struct task *quic_lstnr_dghdlr(struct task *t, void *ctx, unsigned int state);
 void quic_lstnr_sock_fd_iocb(int fd);
 int qc_snd_buf(struct quic_conn *qc, const struct buffer *buf, size_t count,
                int flags);
+int quic_sock_gso_supported(void);
+int qc_snd_buf_gso(struct quic_conn *qc, struct iovec *iov, int ndgram,
+                   uint16_t gso_sz);
 int qc_rcv_buf(struct quic_conn *qc);
 
 /* Set default value for <qc> socket as uninitialized. */
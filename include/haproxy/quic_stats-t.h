@@ -21,6 +21,7 @@ enum {
 	QUIC_ST_RETRY_SENT,
 	QUIC_ST_RETRY_VALIDATED,
 	QUIC_ST_RETRY_ERRORS,
+	QUIC_ST_RETRY_TOKEN_EARLY_DROP,
 	QUIC_ST_HALF_OPEN_CONN,
 	QUIC_ST_HDSHK_FAIL,
 	QUIC_ST_STATELESS_RESET_SENT,
@@ -67,6 +68,7 @@ struct quic_counters {
 	long long retry_sent;        /* total number of Retry sent */
 	long long retry_validated;   /* total number of validated Retry tokens */
 	long long retry_error;       /* total number of Retry token errors */
+	long long retry_token_early_dropped; /* total number of Retry tokens dropped before any crypto validation */
 	long long half_open_conn;    /* total number of half open connections */
 	long long hdshk_fail;        /* total number of handshake failures */
 	long long stateless_reset_sent; /* total number of handshake failures */
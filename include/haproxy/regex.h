@@ -30,6 +30,14 @@
 
 extern THREAD_LOCAL regmatch_t pmatch[MAX_MATCH];
 
+#ifdef USE_PCRE2
+/* Per-thread preallocated match data and context, NULL before the threads
+ * are started. See regex.c for the details.
+ */
+extern THREAD_LOCAL pcre2_match_data *pcre2_matchdata;
+extern THREAD_LOCAL pcre2_match_context *pcre2_matchctx;
+#endif
+
 /* "str" is the string that contain the regex to compile.
  * "regex" is preallocated memory. After the execution of this function, this
  *         struct contain the compiled regex.
@@ -61,10 +69,16 @@ static inline int regex_exec(const struct my_regex *preg, char *subject)
 	pcre2_match_data *pm;
 	int ret;
 
-	pm = pcre2_match_data_create_from_pattern(preg->reg, NULL);
+	pm = pcre2_matchdata;
+	if (unlikely(!pm)) {
+		pm = pcre2_match_data_create_from_pattern(preg->reg, NULL);
+		if (!pm)
+			return 0;
+	}
 	ret = preg->mfn(preg->reg, (PCRE2_SPTR)subject, (PCRE2_SIZE)strlen(subject),
-		0, 0, pm, NULL);
-	pcre2_match_data_free(pm);
+		0, 0, pm, pcre2_matchctx);
+	if (pm != pcre2_matchdata)
+		pcre2_match_data_free(pm);
 	if (ret < 0)
 		return 0;
 	return 1;
@@ -93,10 +107,16 @@ static inline int regex_exec2(const struct my_regex *preg, char *subject, int le
 	pcre2_match_data *pm;
 	int ret;
 
-	pm = pcre2_match_data_create_from_pattern(preg->reg, NULL);
+	pm = pcre2_matchdata;
+	if (unlikely(!pm)) {
+		pm = pcre2_match_data_create_from_pattern(preg->reg, NULL);
+		if (!pm)
+			return 0;
+	}
 	ret = preg->mfn(preg->reg, (PCRE2_SPTR)subject, (PCRE2_SIZE)length,
-		0, 0, pm, NULL);
-	pcre2_match_data_free(pm);
+		0, 0, pm, pcre2_matchctx);
+	if (pm != pcre2_matchdata)
+		pcre2_match_data_free(pm);
 	if (ret < 0)
 		return 0;
 	return 1;
@@ -98,6 +98,7 @@
 
 struct ring {
 	struct buffer buf;   // storage area
+	size_t pending;      // length reserved by writers, >= buf.data, both equal when no write is in progress
 	size_t ofs;          // absolute offset in history of the buffer's head
 	struct list waiters; // list of waiters, for now, CLI "show event"
 	__decl_thread(HA_RWLOCK_T lock);
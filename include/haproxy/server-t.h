@@ -215,6 +215,7 @@ struct srv_per_thread {
 
 /* Each server will have one occurrence of this structure per thread group */
 struct srv_per_tgroup {
+	struct queue queue;                     /* pending connections from threads of this group */
 	unsigned int next_takeover;             /* thread ID to try to steal connections from next time */
 };
 
@@ -251,6 +252,8 @@ struct server {
 	unsigned int pool_purge_delay;          /* Delay before starting to purge the idle conns pool */
 	unsigned int low_idle_conns;            /* min idle connection count to start picking from other threads */
 	unsigned int max_idle_conns;            /* Max number of connection allowed in the orphan connections list */
+	unsigned int min_idle_conns;            /* Min number of idle connections to maintain by pre-warming the pool */
+	struct list prewarm_list;               /* member of the list of servers with idle conns pre-warming enabled */
 	int max_reuse;                          /* Max number of requests on a same connection */
 	struct task *warmup;                    /* the task dedicated to the warmup when slowstart is set */
 
@@ -263,11 +266,11 @@ struct server {
 	short onmarkeddown;			/* what to do when marked down: one of HANA_ONMARKEDDOWN_* */
 	short onmarkedup;			/* what to do when marked up: one of HANA_ONMARKEDUP_* */
 	int slowstart;				/* slowstart time in seconds (ms in the conf) */
+	int dual_stack_delay;			/* head start in ms given to the preferred family before trying the other one (0 = off) */
 
 	char *id;				/* just for identification */
 	uint32_t rid;				/* revision: if id has been reused for a new server, rid won't match */
 	unsigned iweight,uweight, cur_eweight;	/* initial weight, user-specified weight, and effective weight */
-	unsigned wscore;			/* weight score, used during srv map computation */
 	unsigned next_eweight;			/* next pending eweight to commit */
 	unsigned rweight;			/* remainder of weight in the current LB tree */
 	unsigned cumulative_weight;		/* weight of servers prior to this one in the same group, for chash balancing */
@@ -291,7 +294,7 @@ struct server {
 	unsigned int max_used_conns;            /* Max number of used connections (the counter is reset at each connection purges */
 	unsigned int est_need_conns;            /* Estimate on the number of needed connections (max of curr and previous max_used) */
 
-	struct queue queue;			/* pending connections */
+	unsigned int queue_length;		/* number of pending connections, all thread groups included */
 
 	/* Element below are usd by LB algorithms and must be doable in
 	 * parallel to other threads reusing connections above.
@@ -409,6 +412,7 @@ struct server {
 	/* warning, these structs are huge, keep them at the bottom */
 	struct conn_src conn_src;               /* connection source settings */
 	struct sockaddr_storage addr;           /* the address to connect to, doesn't include the port */
+	struct sockaddr_storage addr_alt;       /* alternate-family address from resolvers for dual-stack fallback, or unset */
 	struct sockaddr_storage socks4_addr;	/* the address of the SOCKS4 Proxy, including the port */
 
 	EXTRA_COUNTERS(extra_counters);
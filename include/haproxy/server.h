@@ -41,6 +41,8 @@ extern struct task *idle_conn_task;
 extern struct list servers_list;
 extern struct dict server_key_dict;
 
+struct stconn;
+
 int srv_downtime(const struct server *s);
 int srv_lastsession(const struct server *s);
 int srv_getinter(const struct check *check);
@@ -81,6 +83,7 @@ struct connection *srv_lookup_conn(struct eb_root *tree, uint64_t hash);
 struct connection *srv_lookup_conn_next(struct connection *conn);
 
 int srv_add_to_idle_list(struct server *srv, struct connection *conn, int is_safe);
+int wake_srv_prewarm(struct stconn *sc);
 struct task *srv_cleanup_toremove_conns(struct task *task, void *context, unsigned int state);
 
 int srv_apply_track(struct server *srv, struct proxy *curproxy);
@@ -49,7 +49,11 @@ struct shared_context {
 	__decl_thread(HA_SPINLOCK_T lock);
 	struct list avail;  /* list for active and free blocks */
 	struct list hot;     /* list for locked blocks */
+	struct list reclaim; /* runs of blocks whose pages were given back to the OS */
 	unsigned int nbav;  /* number of available blocks */
+	unsigned int nbrcl; /* number of blocks detached for page reclaim */
+	unsigned int maxblocks; /* total number of blocks in the area */
+	unsigned int extra; /* size of the application area before the blocks */
 	unsigned int max_obj_size;   /* maximum object size (in bytes). */
 	void (*free_block)(struct shared_block *first, struct shared_block *block);
 	short int block_size;
@@ -31,6 +31,8 @@ int shctx_row_data_append(struct shared_context *shctx,
                           unsigned char *data, int len);
 int shctx_row_data_get(struct shared_context *shctx, struct shared_block *first,
                        unsigned char *dst, int offset, int len);
+int shctx_release_avail(struct shared_context *shctx, int rows);
+size_t shctx_reclaim(struct shared_context *shctx);
 
 
 /* Lock functions */
@@ -110,6 +110,8 @@ struct ckch_inst {
 	SSL_CTX *ctx; /* pointer to the SSL context used by this instance */
 	unsigned int is_default:1;      /* This instance is used as the default ctx for this bind_conf */
 	unsigned int is_server_instance:1; /* This instance is used by a backend server */
+	unsigned int is_prepared:1;     /* The ctx was fully prepared by ssl_sock_prep_ctx_and_inst() */
+	unsigned int prep_failed:1;     /* The deferred ctx preparation failed, do not retry nor use it */
 	/* space for more flag there */
 	struct list sni_ctx; /* list of sni_ctx using this ckch_inst */
 	struct list by_ckchs; /* chained in ckch_store's list of ckch_inst */
@@ -42,9 +42,13 @@ struct certificate_ocsp {
 	struct ebmb_node key;
 	unsigned char key_data[OCSP_MAX_CERTID_ASN1_LENGTH];
 	unsigned int key_length;
-	struct buffer response;
+	struct buffer response[2];	/* DER responses, the active one is designated by <response_idx>.
+					 * Updates fill the standby slot and flip the index last so that
+					 * the stapling callback can read the active slot locklessly.
+					 */
+	long expire[2];			/* per-slot expiration date of the response */
+	unsigned int response_idx;	/* index of the active response slot */
 	int refcount;
-	long expire;
 	X509 *issuer;
 	STACK_OF(X509) *chain;
 	struct eb64_node next_update;	/* Key of items inserted in ocsp_update_tree (sorted by absolute date) */
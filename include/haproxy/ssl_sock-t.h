@@ -175,7 +175,10 @@ struct tls_keys_ref {
 	union tls_sess_key *tlskeys;
 	int tls_ticket_enc_index;
 	int key_size_bits;
-	__decl_thread(HA_RWLOCK_T lock); /* lock used to protect the ref */
+	/* No lock: the keys and the encryption index are only modified under
+	 * full thread isolation, so the per-resumption read paths access them
+	 * without any synchronization.
+	 */
 };
 
 /* shared ssl session */
@@ -223,6 +226,40 @@ struct ssl_capture {
 	char data[VAR_ARRAY];
 };
 
+/* Lazily filled cache of the client certificate derived fields, attached to
+ * the SSL with ssl_c_cache_index. Configurations commonly reference the same
+ * ssl_c_* fetches many times per request (ACLs, headers, logs), so each field
+ * is extracted and formatted only once per connection and further calls
+ * become plain struct reads. A field whose flag is set with a zero length
+ * could not be cached (extraction error or value too large for the fixed
+ * storage) and keeps using the regular path.
+ */
+#define SSL_CCACHE_SHA1       0x01
+#define SSL_CCACHE_SERIAL     0x02
+#define SSL_CCACHE_NOTBEFORE  0x04
+#define SSL_CCACHE_NOTAFTER   0x08
+#define SSL_CCACHE_S_DN       0x10
+#define SSL_CCACHE_I_DN       0x20
+
+#define SSL_CCACHE_TIME_LEN   16  /* ASN1 UTCTIME/GENERALIZEDTIME strings */
+#define SSL_CCACHE_SERIAL_LEN 20  /* max serial length per RFC 5280 */
+#define SSL_CCACHE_DN_LEN     256 /* larger DNs are simply not cached */
+
+struct ssl_c_cache {
+	uchar flags;                           /* SSL_CCACHE_* fields already extracted */
+	uchar serial_len;
+	uchar notbefore_len;
+	uchar notafter_len;
+	ushort s_dn_len;
+	ushort i_dn_len;
+	uchar sha1[20];
+	uchar serial[SSL_CCACHE_SERIAL_LEN];
+	char notbefore[SSL_CCACHE_TIME_LEN];
+	char notafter[SSL_CCACHE_TIME_LEN];
+	char s_dn[SSL_CCACHE_DN_LEN];
+	char i_dn[SSL_CCACHE_DN_LEN];
+};
+
 #ifdef HAVE_SSL_KEYLOG
 #define SSL_KEYLOG_MAX_SECRET_SIZE 129
 
@@ -289,12 +326,18 @@ struct global_ssl {
 	unsigned int hard_max_record; /* SSL max record size hard limit */
 	unsigned int default_dh_param; /* SSL maximum DH parameter size */
 	int ctx_cache; /* max number of entries in the ssl_ctx cache. */
+	int verify_cache; /* max number of entries per thread in the client cert verification cache. */
 	int capture_buffer_size; /* Size of the capture buffer. */
 	int keylog; /* activate keylog  */
+	int lazy_ctx_prepare; /* prepare the certificates' SSL_CTX on first use instead of at boot */
 	int extra_files; /* which files not defined in the configuration file are we looking for */
 	int extra_files_noext; /* whether we remove the extension when looking up a extra file */
+	int sess_cache_shards; /* number of independent SSL session cache shards */
 };
 
+/* limit to the number of session cache shards ("tune.ssl.cache-shards") */
+#define SH_SSL_SESS_MAX_SHARDS 64
+
 /* The order here matters for picking a default context,
  * keep the most common keytype at the bottom of the list
  */
@@ -37,6 +37,7 @@ extern struct eb_root crtlists_tree;
 extern struct eb_root cafile_tree;
 extern int sctl_ex_index;
 extern struct global_ssl global_ssl;
+extern unsigned long long ssl_verify_cache_gen;
 extern struct ssl_bind_kw ssl_bind_kws[];
 extern struct methodVersions methodVersions[];
 __decl_thread(extern HA_SPINLOCK_T ckch_lock);
@@ -49,6 +50,8 @@ extern unsigned int openssl_engines_initialized;
 extern int nb_engines;
 extern struct xprt_ops ssl_sock;
 extern int ssl_capture_ptr_index;
+extern int ssl_c_cache_index;
+extern struct pool_head *pool_head_ssl_c_cache;
 extern int ssl_keylog_index;
 extern int ssl_client_sni_index;
 extern struct pool_head *pool_head_ssl_keylog;
@@ -142,10 +145,10 @@ int ssl_ocsp_response_print(struct buffer *ocsp_response, struct buffer *out);
 
 #define sh_ssl_sess_tree_delete(s)     ebmb_delete(&(s)->key);
 
-#define sh_ssl_sess_tree_insert(s)     (struct sh_ssl_sess_hdr *)ebmb_insert(sh_ssl_sess_tree, \
+#define sh_ssl_sess_tree_insert(t, s)  (struct sh_ssl_sess_hdr *)ebmb_insert((t), \
                                                                     &(s)->key, SSL_MAX_SSL_SESSION_ID_LENGTH);
 
-#define sh_ssl_sess_tree_lookup(k)     (struct sh_ssl_sess_hdr *)ebmb_lookup(sh_ssl_sess_tree, \
+#define sh_ssl_sess_tree_lookup(t, k)  (struct sh_ssl_sess_hdr *)ebmb_lookup((t), \
                                                                     (k), SSL_MAX_SSL_SESSION_ID_LENGTH);
 
 /* Registers the function <func> in order to be called on SSL/TLS protocol
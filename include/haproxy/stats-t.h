@@ -43,6 +43,7 @@
 #define STAT_HIDE_MAINT 0x00004000	/* hide maint/disabled servers */
 #define STAT_CONVDONE   0x00008000	/* conf: rules conversion done */
 #define STAT_USE_FLOAT  0x00010000      /* use floats where possible in the outputs */
+#define STAT_PROJ_FIELDS 0x00020000     /* restrict the output to the fields selected in col_mask */
 
 #define STAT_BOUND      0x00800000	/* bound statistics to selected proxies/types/services */
 #define STAT_STARTED    0x01000000	/* some output has occurred */
@@ -467,6 +468,9 @@ enum stat_field {
 	ST_F_H1REQ,
 	ST_F_H2REQ,
 	ST_F_H3REQ,
+	ST_F_CONNECT_TFO,
+	ST_F_CONNECT_TFO_FALL,
+	ST_F_RETR_DENIED,
 
 	/* must always be the last one */
 	ST_F_TOTAL_FIELDS
@@ -553,6 +557,7 @@ struct show_stat_ctx {
 	unsigned int flags;	/* STAT_* from stats-t.h */
 	int iid, type, sid;	/* proxy id, type and service id if bounding of stats is enabled */
 	int st_code;		/* the status code returned by an action */
+	uint64_t col_mask[2];	/* bitmap of the selected fields if STAT_PROJ_FIELDS is set */
 	enum stat_state state;  /* phase of output production */
 };
 
@@ -32,15 +32,19 @@ struct session;
 struct appctx;
 struct stream;
 struct check;
+struct server;
 
 #define IS_HTX_SC(sc)     (sc_conn(sc) && IS_HTX_CONN(__sc_conn(sc)))
 
+extern struct pool_head *pool_head_connstream;
+
 struct sedesc *sedesc_new();
 void sedesc_free(struct sedesc *sedesc);
 
 struct stconn *sc_new_from_endp(struct sedesc *sedesc, struct session *sess, struct buffer *input);
 struct stconn *sc_new_from_strm(struct stream *strm, unsigned int flags);
 struct stconn *sc_new_from_check(struct check *check, unsigned int flags);
+struct stconn *sc_new_from_prewarm(struct server *srv, unsigned int flags);
 void sc_free(struct stconn *sc);
 
 int sc_attach_mux(struct stconn *sc, void *target, void *ctx);
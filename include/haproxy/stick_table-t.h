@@ -146,6 +146,7 @@ struct stksess {
 	unsigned int ref_cnt;     /* reference count, can only purge when zero */
 	__decl_thread(HA_RWLOCK_T lock); /* lock related to the table entry */
 	int shard;                /* shard */
+	unsigned int bucket;      /* the table bucket this session is stored into */
 	struct eb32_node exp;     /* ebtree node used to hold the session in expiration tree */
 	struct eb32_node upd;     /* ebtree node used to hold the update sequence tree */
 	struct ebmb_node key;     /* ebtree node used to hold the session in table */
@@ -153,6 +154,21 @@ struct stksess {
 };
 
 
+/* One bucket of a stick-table. Each table is split into
+ * CONFIG_HAP_TBL_BUCKETS of these, selected by a hash of the key, so that
+ * operations on entries hashed into different buckets never compete for the
+ * same lock nor the same expiration task. The padding keeps the locks of
+ * adjacent buckets on distinct cache lines.
+ */
+struct stktable_bucket {
+	struct eb_root keys;      /* head of sticky session tree for this bucket */
+	struct eb_root exps;      /* head of sticky session expiration tree */
+	struct task *exp_task;    /* expiration task for this bucket */
+	struct stktable *table;   /* the table this bucket belongs to */
+	__decl_thread(HA_RWLOCK_T lock); /* lock protecting this bucket's trees */
+	THREAD_PAD(63);
+};
+
 /* stick table */
 struct stktable {
 	char *id;		  /* local table id name. */
@@ -162,11 +178,9 @@ struct stktable {
 	                           * the same configuration section.
 	                           */
 	struct ebpt_node name;    /* Stick-table are lookup by name here. */
-	struct eb_root keys;      /* head of sticky session tree */
-	struct eb_root exps;      /* head of sticky session expiration tree */
+	struct stktable_bucket buckets[CONFIG_HAP_TBL_BUCKETS]; /* the key and expiration trees, split by key hash */
 	struct eb_root updates;   /* head of sticky updates sequence tree */
 	struct pool_head *pool;   /* pool used to allocate sticky sessions */
-	struct task *exp_task;    /* expiration task */
 	struct task *sync_task;   /* sync task */
 	unsigned int update;
 	unsigned int localupdate;
@@ -201,7 +215,7 @@ struct stktable {
 		const char *file;     /* The file where the stick-table is declared. */
 		int line;             /* The line in this <file> the stick-table is declared. */
 	} conf;
-	__decl_thread(HA_RWLOCK_T lock); /* lock related to the table */
+	__decl_thread(HA_RWLOCK_T lock); /* lock protecting the updates tree and counters */
 };
 
 extern struct stktable_data_type stktable_data_types[STKTABLE_DATA_TYPES];
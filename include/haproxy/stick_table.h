@@ -70,6 +70,13 @@ int stktable_register_data_store(int idx, const char *name, int std_type, int ar
 int stktable_get_data_type(char *name);
 int stktable_trash_oldest(struct stktable *t, int to_batch);
 int __stksess_kill(struct stktable *t, struct stksess *ts);
+uint stktable_calc_bucket_num(const struct stktable *t, const void *key, size_t len);
+
+/* returns a pointer to the bucket of table <t> that entry <ts> is stored into */
+static inline struct stktable_bucket *stktable_bucket(struct stktable *t, const struct stksess *ts)
+{
+	return &t->buckets[ts->bucket];
+}
 
 /************************* Composite address manipulation *********************
  * Composite addresses are simply unsigned long data in which the higher bits
@@ -201,20 +208,21 @@ static inline int __stksess_kill_if_expired(struct stktable *t, struct stksess *
 
 static inline void stksess_kill_if_expired(struct stktable *t, struct stksess *ts, int decrefcnt)
 {
+	struct stktable_bucket *bkt = stktable_bucket(t, ts);
 
 	if (t->expire != TICK_ETERNITY && tick_is_expired(ts->expire, now_ms)) {
-		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->lock);
+		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &bkt->lock);
 		if (decrefcnt)
-			ts->ref_cnt--;
+			HA_ATOMIC_DEC(&ts->ref_cnt);
 
 		__stksess_kill_if_expired(t, ts);
-		HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->lock);
+		HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
 	}
 	else {
 		if (decrefcnt) {
-			HA_RWLOCK_RDLOCK(STK_TABLE_LOCK, &t->lock);
+			HA_RWLOCK_RDLOCK(STK_TABLE_LOCK, &bkt->lock);
 			HA_ATOMIC_DEC(&ts->ref_cnt);
-			HA_RWLOCK_RDUNLOCK(STK_TABLE_LOCK, &t->lock);
+			HA_RWLOCK_RDUNLOCK(STK_TABLE_LOCK, &bkt->lock);
 		}
 	}
 }
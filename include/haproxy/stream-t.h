@@ -22,6 +22,7 @@
 #ifndef _HAPROXY_STREAM_T_H
 #define _HAPROXY_STREAM_T_H
 
+#include <netinet/in.h>
 #include <sys/time.h>
 
 #include <haproxy/api-t.h>
@@ -29,7 +30,9 @@
 #include <haproxy/stconn-t.h>
 #include <haproxy/dynbuf-t.h>
 #include <haproxy/filters-t.h>
+#include <haproxy/host_stats-t.h>
 #include <haproxy/obj_type-t.h>
+#include <haproxy/sample_data-t.h>
 #include <haproxy/show_flags-t.h>
 #include <haproxy/stick_table-t.h>
 #include <haproxy/vars-t.h>
@@ -247,6 +250,25 @@ struct stream {
 
 	struct stkctr *stkctr;                  /* content-aware stick counters */
 
+	struct {
+		const struct sample_expr *expr; /* expression the sample below was fetched from, NULL = none */
+		unsigned int opt;               /* SMP_OPT_DIR_* the fetch was performed with */
+		unsigned int flags;             /* SMP_F_* flags of the memoized sample */
+		struct sample_data data;        /* self-contained sample result, reused by later rules */
+	} stkey_memo;                           /* memoized stick-table key sample (see stktable_fetch_key) */
+
+	struct {
+		union {
+			struct in_addr v4;      /* raw address the text below was built from */
+			struct in6_addr v6;
+		} addr;
+		char str[INET6_ADDRSTRLEN];     /* canonical text form of the source address */
+		unsigned char len;              /* length of <str>, 0 = not yet formatted */
+		unsigned char family;           /* address family the text was built from */
+	} src_txt;                              /* memoized source address text (see stream_src_txt) */
+
+	struct host_stats_entry *host_stats;    /* referenced per-host stats entry for this request, or NULL */
+
 	struct strm_flt strm_flt;               /* current state of filters active on this stream */
 
 	char **req_cap;                         /* array of captures from the request (may be NULL) */
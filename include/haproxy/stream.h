@@ -70,6 +70,7 @@ void stream_dump(struct buffer *buf, const struct stream *s, const char *pfx, ch
 void stream_dump_and_crash(enum obj_type *obj, int rate);
 
 struct ist stream_generate_unique_id(struct stream *strm, struct list *format);
+struct ist stream_src_txt(struct stream *s);
 
 void stream_process_counters(struct stream *s);
 void sess_change_server(struct stream *strm, struct server *newsrv);
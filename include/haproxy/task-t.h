@@ -27,6 +27,7 @@
 #include <import/ebtree-t.h>
 
 #include <haproxy/api-t.h>
+#include <haproxy/list-t.h>
 #include <haproxy/show_flags-t.h>
 #include <haproxy/thread-t.h>
 
@@ -163,6 +164,23 @@ struct tasklet {
 	 */
 };
 
+/* A coarse timer, to be embedded into any structure needing large amounts of
+ * cheap, imprecise timeouts (mux connections, checks, resolvers). Instead of
+ * an individual node in the timer ebtree, the entry is chained into one of the
+ * buckets of the owner thread's timer wheel, making both (re-)arming and
+ * disarming O(1) regardless of the number of timers. The associated task is
+ * woken up with TASK_WOKEN_TIMER once the expiration date is passed, with an
+ * accuracy of the bucket width (a few hundred milliseconds). The list part
+ * uses an mt_list so that an entry may be removed from another thread during
+ * a connection takeover, but queuing and expiry always happen on the owner
+ * thread.
+ */
+struct ctimer {
+	struct mt_list list; /* attachment into the thread's timer wheel, detached when unset */
+	struct task *task;   /* the task to wake up upon expiration */
+	int expire;          /* expiration date of this timer, in ticks (TICK_ETERNITY = unset) */
+};
+
 /*
  * The task callback (->process) is responsible for updating ->expire. It must
  * return a pointer to the task itself, except if the task has been deleted, in
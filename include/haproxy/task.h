@@ -123,6 +123,36 @@ void wake_expired_tasks(void);
  */
 int next_timer_expiry(void);
 
+/* Arms coarse timer <ct> to expire at <expire>, which must be a valid tick.
+ * The timer is queued (or re-queued if it was already set) into the current
+ * thread's timer wheel in constant time, and its task will be woken up with
+ * TASK_WOKEN_TIMER once the date is passed, with an accuracy of the wheel's
+ * bucket width. Must only be called from the thread that services the timer.
+ */
+void ctimer_queue(struct ctimer *ct, int expire);
+
+/* Initializes coarse timer <ct> in the unset state, to wake up task <t> upon
+ * expiration. Must be called before any other ctimer_* function.
+ */
+static inline void ctimer_init(struct ctimer *ct, struct task *t)
+{
+	MT_LIST_INIT(&ct->list);
+	ct->task = t;
+	ct->expire = TICK_ETERNITY;
+}
+
+/* Disarms coarse timer <ct>, which may or may not have been queued. Contrary
+ * to ctimer_queue(), this may be called from any thread (e.g. when taking
+ * over a connection from another thread), removal from the wheel being
+ * multi-thread safe.
+ */
+static inline void ctimer_dequeue(struct ctimer *ct)
+{
+	if (MT_LIST_INLIST(&ct->list))
+		MT_LIST_DELETE(&ct->list);
+	ct->expire = TICK_ETERNITY;
+}
+
 /*
  * Delete every tasks before running the master polling loop
  */
@@ -94,6 +94,75 @@
 #define __HA_SPINLOCK_T     unsigned long
 #define __HA_RWLOCK_T       unsigned long
 
+/* WARNING!!! if you update this enum, please also keep lock_label() up to
+ * date in src/thread.c.
+ */
+enum lock_label {
+	TASK_RQ_LOCK,
+	TASK_WQ_LOCK,
+	LISTENER_LOCK,
+	PROXY_LOCK,
+	SERVER_LOCK,
+	LBPRM_LOCK,
+	SIGNALS_LOCK,
+	STK_TABLE_LOCK,
+	STK_SESS_LOCK,
+	APPLETS_LOCK,
+	PEER_LOCK,
+	SHCTX_LOCK,
+	SSL_LOCK,
+	SSL_GEN_CERTS_LOCK,
+	PATREF_LOCK,
+	PATEXP_LOCK,
+	VARS_LOCK,
+	COMP_POOL_LOCK,
+	LUA_LOCK,
+	NOTIF_LOCK,
+	SPOE_APPLET_LOCK,
+	DNS_LOCK,
+	PID_LIST_LOCK,
+	EMAIL_ALERTS_LOCK,
+	PIPES_LOCK,
+	AUTH_LOCK,
+	LOGSRV_LOCK,
+	DICT_LOCK,
+	PROTO_LOCK,
+	QUEUE_LOCK,
+	CKCH_LOCK,
+	SNI_LOCK,
+	SSL_SERVER_LOCK,
+	SFT_LOCK, /* sink forward target */
+	IDLE_CONNS_LOCK,
+	QUIC_LOCK,
+	OCSP_LOCK,
+	CACHE_LOCK,
+	HOST_STATS_LOCK,
+	OTHER_LOCK,
+	/* WT: make sure never to use these ones outside of development,
+	 * we need them for lock profiling!
+	 */
+	DEBUG1_LOCK,
+	DEBUG2_LOCK,
+	DEBUG3_LOCK,
+	DEBUG4_LOCK,
+	DEBUG5_LOCK,
+	LOCK_LABELS
+};
+
+/* Operations recorded in the per-thread lock history. Each entry of the
+ * history is a byte made of the label plus one in the 6 upper bits and one
+ * of these operations in the 2 lower ones, so that zero means no entry.
+ * The same encoding is used to expose the lock a thread is waiting for.
+ */
+enum lock_hist_op {
+	LH_WR = 0,   /* write lock taken (also used for spinlocks) */
+	LH_SK = 1,   /* seek lock taken */
+	LH_RD = 2,   /* read lock taken */
+	LH_UN = 3,   /* lock released */
+};
+
+#define LOCK_HIST_ENC(lbl, op) (((((uint)(lbl)) + 1) << 2) + (op))
+
 
 /* When thread debugging is enabled, we remap HA_SPINLOCK_T and HA_RWLOCK_T to
  * complex structures which embed debugging info.
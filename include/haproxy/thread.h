@@ -296,34 +296,189 @@ static inline unsigned long thread_isolated()
  */
 int thread_cpu_mask_forced(void);
 
+/* Lightweight lock tracking, always enabled because its cost is barely
+ * measurable (a thread-local store per operation and an atomic increment
+ * on contention): each thread keeps a rolling history of its last locking
+ * operations in th_ctx->lock_history and exposes the lock it's currently
+ * waiting for in th_ctx->lock_waiting, so that the watchdog and the thread
+ * dumps can name what a stalled thread holds or waits for. In addition, a
+ * global per-label counter of contended acquisitions helps spotting which
+ * locks hurt without rebuilding with DEBUG_THREAD.
+ */
+extern unsigned int lock_contention[LOCK_LABELS];
+
+const char *lock_label(enum lock_label label);
+
+/* registers the lock the current thread is about to sleep on */
+static inline void lock_wait_begin(enum lock_label lbl, enum lock_hist_op op)
+{
+	th_ctx->lock_waiting = LOCK_HIST_ENC(lbl, op);
+}
+
+/* releases the waiting status once the lock was obtained (or abandoned) */
+static inline void lock_wait_end(void)
+{
+	th_ctx->lock_waiting = 0;
+}
+
+/* appends the operation <op> on lock <lbl> to the thread's lock history */
+static inline void lock_hist_append(enum lock_label lbl, enum lock_hist_op op)
+{
+	th_ctx->lock_history = (th_ctx->lock_history << 8) + LOCK_HIST_ENC(lbl, op);
+}
+
 #if !defined(DEBUG_THREAD) && !defined(DEBUG_FULL)
 
-/* Thread debugging is DISABLED, these are the regular locking functions */
+/* Thread debugging is DISABLED, these are the regular locking functions.
+ * They first attempt the uncontended fast path, and only account and track
+ * the lock when this fails, so that the cost of the tracking is only paid
+ * when there is contention.
+ */
 
 #define HA_SPIN_INIT(l)            ({ (*l) = 0; })
 #define HA_SPIN_DESTROY(l)         ({ (*l) = 0; })
-#define HA_SPIN_LOCK(lbl, l)       pl_take_s(l)
-#define HA_SPIN_TRYLOCK(lbl, l)    (!pl_try_s(l))
-#define HA_SPIN_UNLOCK(lbl, l)     pl_drop_s(l)
+
+#define HA_SPIN_LOCK(lbl, l)						\
+	({								\
+		if (unlikely(!pl_try_s(l))) {				\
+			lock_wait_begin(lbl, LH_SK);			\
+			HA_ATOMIC_INC(&lock_contention[lbl]);		\
+			pl_take_s(l);					\
+			lock_wait_end();				\
+		}							\
+		lock_hist_append(lbl, LH_SK);				\
+	})
+
+#define HA_SPIN_TRYLOCK(lbl, l)						\
+	({								\
+		int __r = !pl_try_s(l);					\
+		if (!__r)						\
+			lock_hist_append(lbl, LH_SK);			\
+		__r;							\
+	})
+
+#define HA_SPIN_UNLOCK(lbl, l)						\
+	({								\
+		pl_drop_s(l);						\
+		lock_hist_append(lbl, LH_UN);				\
+	})
 
 #define HA_RWLOCK_INIT(l)          ({ (*l) = 0; })
 #define HA_RWLOCK_DESTROY(l)       ({ (*l) = 0; })
-#define HA_RWLOCK_WRLOCK(lbl,l)    pl_take_w(l)
-#define HA_RWLOCK_TRYWRLOCK(lbl,l) (!pl_try_w(l))
-#define HA_RWLOCK_WRUNLOCK(lbl,l)  pl_drop_w(l)
-#define HA_RWLOCK_RDLOCK(lbl,l)    pl_take_r(l)
-#define HA_RWLOCK_TRYRDLOCK(lbl,l) (!pl_try_r(l))
-#define HA_RWLOCK_RDUNLOCK(lbl,l)  pl_drop_r(l)
 
-/* rwlock upgrades via seek locks */
-#define HA_RWLOCK_SKLOCK(lbl,l)         pl_take_s(l)      /* N --> S */
-#define HA_RWLOCK_SKTOWR(lbl,l)         pl_stow(l)        /* S --> W */
-#define HA_RWLOCK_WRTOSK(lbl,l)         pl_wtos(l)        /* W --> S */
-#define HA_RWLOCK_SKTORD(lbl,l)         pl_stor(l)        /* S --> R */
-#define HA_RWLOCK_WRTORD(lbl,l)         pl_wtor(l)        /* W --> R */
-#define HA_RWLOCK_SKUNLOCK(lbl,l)       pl_drop_s(l)      /* S --> N */
-#define HA_RWLOCK_TRYSKLOCK(lbl,l)      (!pl_try_s(l))    /* N -?> S */
-#define HA_RWLOCK_TRYRDTOSK(lbl,l)      (!pl_try_rtos(l)) /* R -?> S */
+#define HA_RWLOCK_WRLOCK(lbl,l)						\
+	({								\
+		if (unlikely(!pl_try_w(l))) {				\
+			lock_wait_begin(lbl, LH_WR);			\
+			HA_ATOMIC_INC(&lock_contention[lbl]);		\
+			pl_take_w(l);					\
+			lock_wait_end();				\
+		}							\
+		lock_hist_append(lbl, LH_WR);				\
+	})
+
+#define HA_RWLOCK_TRYWRLOCK(lbl,l)					\
+	({								\
+		int __r = !pl_try_w(l);					\
+		if (!__r)						\
+			lock_hist_append(lbl, LH_WR);			\
+		__r;							\
+	})
+
+#define HA_RWLOCK_WRUNLOCK(lbl,l)					\
+	({								\
+		pl_drop_w(l);						\
+		lock_hist_append(lbl, LH_UN);				\
+	})
+
+#define HA_RWLOCK_RDLOCK(lbl,l)						\
+	({								\
+		if (unlikely(!pl_try_r(l))) {				\
+			lock_wait_begin(lbl, LH_RD);			\
+			HA_ATOMIC_INC(&lock_contention[lbl]);		\
+			pl_take_r(l);					\
+			lock_wait_end();				\
+		}							\
+		lock_hist_append(lbl, LH_RD);				\
+	})
+
+#define HA_RWLOCK_TRYRDLOCK(lbl,l)					\
+	({								\
+		int __r = !pl_try_r(l);					\
+		if (!__r)						\
+			lock_hist_append(lbl, LH_RD);			\
+		__r;							\
+	})
+
+#define HA_RWLOCK_RDUNLOCK(lbl,l)					\
+	({								\
+		pl_drop_r(l);						\
+		lock_hist_append(lbl, LH_UN);				\
+	})
+
+/* rwlock upgrades via seek locks. The upgrades to a stronger lock may have
+ * to wait for other owners to leave, so the awaited lock is exposed across
+ * them, but they are not accounted as contention since they always have to
+ * observe the other owners' departure.
+ */
+#define HA_RWLOCK_SKLOCK(lbl,l)						\
+	({								\
+		if (unlikely(!pl_try_s(l))) {				\
+			lock_wait_begin(lbl, LH_SK);			\
+			HA_ATOMIC_INC(&lock_contention[lbl]);		\
+			pl_take_s(l);					\
+			lock_wait_end();				\
+		}							\
+		lock_hist_append(lbl, LH_SK);				\
+	})
+
+#define HA_RWLOCK_SKTOWR(lbl,l)						\
+	({								\
+		lock_wait_begin(lbl, LH_WR);				\
+		pl_stow(l);						\
+		lock_wait_end();					\
+		lock_hist_append(lbl, LH_WR);				\
+	})
+
+#define HA_RWLOCK_WRTOSK(lbl,l)						\
+	({								\
+		pl_wtos(l);						\
+		lock_hist_append(lbl, LH_SK);				\
+	})
+
+#define HA_RWLOCK_SKTORD(lbl,l)						\
+	({								\
+		pl_stor(l);						\
+		lock_hist_append(lbl, LH_RD);				\
+	})
+
+#define HA_RWLOCK_WRTORD(lbl,l)						\
+	({								\
+		pl_wtor(l);						\
+		lock_hist_append(lbl, LH_RD);				\
+	})
+
+#define HA_RWLOCK_SKUNLOCK(lbl,l)					\
+	({								\
+		pl_drop_s(l);						\
+		lock_hist_append(lbl, LH_UN);				\
+	})
+
+#define HA_RWLOCK_TRYSKLOCK(lbl,l)					\
+	({								\
+		int __r = !pl_try_s(l);					\
+		if (!__r)						\
+			lock_hist_append(lbl, LH_SK);			\
+		__r;							\
+	})
+
+#define HA_RWLOCK_TRYRDTOSK(lbl,l)					\
+	({								\
+		int __r = !pl_try_rtos(l);				\
+		if (!__r)						\
+			lock_hist_append(lbl, LH_SK);			\
+		__r;							\
+	})
 
 #else /* !defined(DEBUG_THREAD) && !defined(DEBUG_FULL) */
 
@@ -357,82 +512,136 @@ int thread_cpu_mask_forced(void);
 #define HA_SPIN_INIT(l)            __spin_init(l)
 #define HA_SPIN_DESTROY(l)         __spin_destroy(l)
 
-#define HA_SPIN_LOCK(lbl, l)       __spin_lock(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_SPIN_TRYLOCK(lbl, l)    __spin_trylock(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_SPIN_UNLOCK(lbl, l)     __spin_unlock(lbl, l, __func__, __FILE__, __LINE__)
+/* The lock history and awaited lock are maintained here as well so that
+ * the watchdog output doesn't depend on the build options. The detailed
+ * wait time stats are already collected by the functions themselves, so
+ * the contention counters are not updated here.
+ */
+
+#define HA_SPIN_LOCK(lbl, l)						\
+	({								\
+		lock_wait_begin(lbl, LH_SK);				\
+		__spin_lock(lbl, l, __func__, __FILE__, __LINE__);	\
+		lock_wait_end();					\
+		lock_hist_append(lbl, LH_SK);				\
+	})
+
+#define HA_SPIN_TRYLOCK(lbl, l)						\
+	({								\
+		int __r = __spin_trylock(lbl, l, __func__, __FILE__, __LINE__); \
+		if (!__r)						\
+			lock_hist_append(lbl, LH_SK);			\
+		__r;							\
+	})
+
+#define HA_SPIN_UNLOCK(lbl, l)						\
+	({								\
+		__spin_unlock(lbl, l, __func__, __FILE__, __LINE__);	\
+		lock_hist_append(lbl, LH_UN);				\
+	})
 
 #define HA_RWLOCK_INIT(l)          __ha_rwlock_init((l))
 #define HA_RWLOCK_DESTROY(l)       __ha_rwlock_destroy((l))
-#define HA_RWLOCK_WRLOCK(lbl,l)    __ha_rwlock_wrlock(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_TRYWRLOCK(lbl,l) __ha_rwlock_trywrlock(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_WRUNLOCK(lbl,l)  __ha_rwlock_wrunlock(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_RDLOCK(lbl,l)    __ha_rwlock_rdlock(lbl, l)
-#define HA_RWLOCK_TRYRDLOCK(lbl,l) __ha_rwlock_tryrdlock(lbl, l)
-#define HA_RWLOCK_RDUNLOCK(lbl,l)  __ha_rwlock_rdunlock(lbl, l)
-
-#define HA_RWLOCK_SKLOCK(lbl,l)    __ha_rwlock_sklock(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_SKTOWR(lbl,l)    __ha_rwlock_sktowr(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_WRTOSK(lbl,l)    __ha_rwlock_wrtosk(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_SKTORD(lbl,l)    __ha_rwlock_sktord(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_WRTORD(lbl,l)    __ha_rwlock_wrtord(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_SKUNLOCK(lbl,l)  __ha_rwlock_skunlock(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_TRYSKLOCK(lbl,l) __ha_rwlock_trysklock(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_TRYRDTOSK(lbl,l) __ha_rwlock_tryrdtosk(lbl, l, __func__, __FILE__, __LINE__)
-
-/* WARNING!!! if you update this enum, please also keep lock_label() up to date
- * below.
- */
-enum lock_label {
-	TASK_RQ_LOCK,
-	TASK_WQ_LOCK,
-	LISTENER_LOCK,
-	PROXY_LOCK,
-	SERVER_LOCK,
-	LBPRM_LOCK,
-	SIGNALS_LOCK,
-	STK_TABLE_LOCK,
-	STK_SESS_LOCK,
-	APPLETS_LOCK,
-	PEER_LOCK,
-	SHCTX_LOCK,
-	SSL_LOCK,
-	SSL_GEN_CERTS_LOCK,
-	PATREF_LOCK,
-	PATEXP_LOCK,
-	VARS_LOCK,
-	COMP_POOL_LOCK,
-	LUA_LOCK,
-	NOTIF_LOCK,
-	SPOE_APPLET_LOCK,
-	DNS_LOCK,
-	PID_LIST_LOCK,
-	EMAIL_ALERTS_LOCK,
-	PIPES_LOCK,
-	TLSKEYS_REF_LOCK,
-	AUTH_LOCK,
-	LOGSRV_LOCK,
-	DICT_LOCK,
-	PROTO_LOCK,
-	QUEUE_LOCK,
-	CKCH_LOCK,
-	SNI_LOCK,
-	SSL_SERVER_LOCK,
-	SFT_LOCK, /* sink forward target */
-	IDLE_CONNS_LOCK,
-	QUIC_LOCK,
-	OCSP_LOCK,
-	OTHER_LOCK,
-	/* WT: make sure never to use these ones outside of development,
-	 * we need them for lock profiling!
-	 */
-	DEBUG1_LOCK,
-	DEBUG2_LOCK,
-	DEBUG3_LOCK,
-	DEBUG4_LOCK,
-	DEBUG5_LOCK,
-	LOCK_LABELS
-};
 
+#define HA_RWLOCK_WRLOCK(lbl,l)						\
+	({								\
+		lock_wait_begin(lbl, LH_WR);				\
+		__ha_rwlock_wrlock(lbl, l, __func__, __FILE__, __LINE__); \
+		lock_wait_end();					\
+		lock_hist_append(lbl, LH_WR);				\
+	})
+
+#define HA_RWLOCK_TRYWRLOCK(lbl,l)					\
+	({								\
+		int __r = __ha_rwlock_trywrlock(lbl, l, __func__, __FILE__, __LINE__); \
+		if (!__r)						\
+			lock_hist_append(lbl, LH_WR);			\
+		__r;							\
+	})
+
+#define HA_RWLOCK_WRUNLOCK(lbl,l)					\
+	({								\
+		__ha_rwlock_wrunlock(lbl, l, __func__, __FILE__, __LINE__); \
+		lock_hist_append(lbl, LH_UN);				\
+	})
+
+#define HA_RWLOCK_RDLOCK(lbl,l)						\
+	({								\
+		lock_wait_begin(lbl, LH_RD);				\
+		__ha_rwlock_rdlock(lbl, l);				\
+		lock_wait_end();					\
+		lock_hist_append(lbl, LH_RD);				\
+	})
+
+#define HA_RWLOCK_TRYRDLOCK(lbl,l)					\
+	({								\
+		int __r = __ha_rwlock_tryrdlock(lbl, l);		\
+		if (!__r)						\
+			lock_hist_append(lbl, LH_RD);			\
+		__r;							\
+	})
+
+#define HA_RWLOCK_RDUNLOCK(lbl,l)					\
+	({								\
+		__ha_rwlock_rdunlock(lbl, l);				\
+		lock_hist_append(lbl, LH_UN);				\
+	})
+
+#define HA_RWLOCK_SKLOCK(lbl,l)						\
+	({								\
+		lock_wait_begin(lbl, LH_SK);				\
+		__ha_rwlock_sklock(lbl, l, __func__, __FILE__, __LINE__); \
+		lock_wait_end();					\
+		lock_hist_append(lbl, LH_SK);				\
+	})
+
+#define HA_RWLOCK_SKTOWR(lbl,l)						\
+	({								\
+		lock_wait_begin(lbl, LH_WR);				\
+		__ha_rwlock_sktowr(lbl, l, __func__, __FILE__, __LINE__); \
+		lock_wait_end();					\
+		lock_hist_append(lbl, LH_WR);				\
+	})
+
+#define HA_RWLOCK_WRTOSK(lbl,l)						\
+	({								\
+		__ha_rwlock_wrtosk(lbl, l, __func__, __FILE__, __LINE__); \
+		lock_hist_append(lbl, LH_SK);				\
+	})
+
+#define HA_RWLOCK_SKTORD(lbl,l)						\
+	({								\
+		__ha_rwlock_sktord(lbl, l, __func__, __FILE__, __LINE__); \
+		lock_hist_append(lbl, LH_RD);				\
+	})
+
+#define HA_RWLOCK_WRTORD(lbl,l)						\
+	({								\
+		__ha_rwlock_wrtord(lbl, l, __func__, __FILE__, __LINE__); \
+		lock_hist_append(lbl, LH_RD);				\
+	})
+
+#define HA_RWLOCK_SKUNLOCK(lbl,l)					\
+	({								\
+		__ha_rwlock_skunlock(lbl, l, __func__, __FILE__, __LINE__); \
+		lock_hist_append(lbl, LH_UN);				\
+	})
+
+#define HA_RWLOCK_TRYSKLOCK(lbl,l)					\
+	({								\
+		int __r = __ha_rwlock_trysklock(lbl, l, __func__, __FILE__, __LINE__); \
+		if (!__r)						\
+			lock_hist_append(lbl, LH_SK);			\
+		__r;							\
+	})
+
+#define HA_RWLOCK_TRYRDTOSK(lbl,l)					\
+	({								\
+		int __r = __ha_rwlock_tryrdtosk(lbl, l, __func__, __FILE__, __LINE__); \
+		if (!__r)						\
+			lock_hist_append(lbl, LH_SK);			\
+		__r;							\
+	})
 
 /* Following functions are used to collect some stats about locks. We wrap
  * pthread functions to known how much time we wait in a lock. */
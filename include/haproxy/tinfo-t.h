@@ -60,6 +60,7 @@ enum {
 #define TH_FL_TASK_PROFILING    0x00000002
 #define TH_FL_NOTIFIED          0x00000004  /* task was notified about the need to wake up */
 #define TH_FL_SLEEPING          0x00000008  /* thread won't check its task list before next wakeup */
+#define TH_FL_OVERLOADED        0x00000010  /* thread crossed the overload thresholds, new work is shed */
 
 
 /* Thread group information. This defines a base and a count of global thread
@@ -125,8 +126,10 @@ struct thread_ctx {
 	int current_queue;                  /* points to current tasklet list being run, -1 if none */
 	unsigned int nb_tasks;              /* number of tasks allocated on this thread */
 	uint8_t tl_class_mask;              /* bit mask of non-empty tasklets classes */
+	uint8_t lock_waiting;               /* lock currently awaited, LOCK_HIST_ENC() or 0 */
+	int sched_inline_credit;            /* remaining instant wakeups for this scheduler pass */
 
-	// 7 bytes hole here
+	// 2 bytes hole here
 	struct list pool_lru_head;          /* oldest objects in thread-local pool caches */
 	struct list buffer_wq;              /* buffer waiters */
 	struct list streams;                /* list of streams attached to this thread */
@@ -150,6 +153,7 @@ struct thread_ctx {
 
 	uint64_t prev_cpu_time;             /* previous per thread CPU time */
 	uint64_t prev_mono_time;            /* previous system wide monotonic time  */
+	unsigned long lock_history;         /* history of taken locks, 8 entries of 8 bits */
 
 	struct eb_root rqueue_shared;       /* run queue fed by other threads */
 	__decl_thread(HA_SPINLOCK_T rqsh_lock); /* lock protecting the shared runqueue */
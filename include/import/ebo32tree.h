@@ -0,0 +1,171 @@
+/*
+ * Elastic Binary Trees - macros and structures for operations on compact
+ * offset-based 32bit nodes.
+ * Version 6.0.6
+ * (C) 2002-2011 - Willy Tarreau <w@1wt.eu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef _EBO32TREE_H
+#define _EBO32TREE_H
+
+#include "ebtree.h"
+
+/* This is a compact variant of the 32-bit elastic binary trees where all the
+ * links are 32-bit offsets relative to an arena base instead of native
+ * pointers. On 64-bit machines this shrinks a node from 48 to 24 bytes, which
+ * about doubles the number of entries which fit in a given amount of memory,
+ * the reason why dense data sets such as large tracking tables prefer it.
+ * The counterpart is that every operation needs the arena base, and that a
+ * few constraints must be respected:
+ *   - all the nodes AND the struct ebo32_root must live in the same arena,
+ *     which may not exceed 4 GB;
+ *   - offset zero plays the role of the NULL pointer, so neither the root
+ *     nor any node may be placed at the very beginning of the arena (keeping
+ *     an arena header there is the natural way to enforce this);
+ *   - nodes must be at least 4-byte aligned so that the lowest bit of an
+ *     offset may carry the leaf/node and side tags, exactly like the tag in
+ *     the low bits of the pointer-based trees;
+ *   - keys are always unique: inserting an already existing key returns the
+ *     existing node instead of growing a duplicate sub-tree.
+ */
+
+/* An offset-based tree root. Only b[EB_LEFT] is used, b[EB_RGHT] must remain
+ * zero so that the root can be distinguished from a node during deletion.
+ */
+struct ebo32_root {
+	u32 b[EB_NODE_BRANCHES]; /* tagged offsets of left and right branches */
+};
+
+#define EBO32_ROOT						\
+	(struct ebo32_root) {					\
+		.b = { [0] = 0, [1] = 0 },			\
+	}
+
+/* A compact node: same layout as eb32_node with every pointer replaced by a
+ * 32-bit offset. The branches must remain the first member so that a parent
+ * link may indifferently designate a node or the tree root.
+ */
+struct ebo32_node {
+	u32 b[EB_NODE_BRANCHES]; /* tagged offsets of left and right branches */
+	u32 node_p;              /* tagged offset of the node part's parent */
+	u32 leaf_p;              /* tagged offset of the leaf part's parent */
+	short int bit;           /* link's bit position */
+	short unsigned int pad;  /* explicit padding, unused */
+	u32 key;
+} ALIGNED(4);
+
+/* Converts an untagged offset to a node pointer within arena <base> */
+static inline struct ebo32_node *ebo32_node_at(const void *base, u32 ofs)
+{
+	return (struct ebo32_node *)((char *)base + ofs);
+}
+
+/* Returns the untagged offset of object <ptr> within arena <base> */
+static inline u32 ebo32_ofs(const void *base, const void *ptr)
+{
+	return (u32)((const char *)ptr - (const char *)base);
+}
+
+/* Tagging operations, equivalent to eb_dotag/eb_untag/eb_gettag/eb_clrtag */
+static inline u32 ebo32_dotag(u32 ofs, u32 tag)
+{
+	return ofs + tag;
+}
+
+static inline u32 ebo32_untag(u32 ofs, u32 tag)
+{
+	return ofs - tag;
+}
+
+static inline u32 ebo32_gettag(u32 ofs)
+{
+	return ofs & 1;
+}
+
+static inline u32 ebo32_clrtag(u32 ofs)
+{
+	return ofs & ~1U;
+}
+
+/* Walks down starting at link <start>, always walking on side <side>. The
+ * arena base is <base>. NULL is returned if the (sub)tree is empty.
+ */
+static inline struct ebo32_node *ebo32_walk_down(const void *base, u32 start, unsigned int side)
+{
+	if (!start)
+		return NULL;
+	while (ebo32_gettag(start) == EB_NODE)
+		start = ebo32_node_at(base, ebo32_untag(start, EB_NODE))->b[side];
+	return ebo32_node_at(base, ebo32_untag(start, EB_LEAF));
+}
+
+/* Return leftmost node in the tree, or NULL if none */
+static inline struct ebo32_node *ebo32_first(const void *base, const struct ebo32_root *root)
+{
+	return ebo32_walk_down(base, root->b[0], EB_LEFT);
+}
+
+/* Return rightmost node in the tree, or NULL if none */
+static inline struct ebo32_node *ebo32_last(const void *base, const struct ebo32_root *root)
+{
+	return ebo32_walk_down(base, root->b[0], EB_RGHT);
+}
+
+/* Return next node in the tree, or NULL if none */
+static inline struct ebo32_node *ebo32_next(const void *base, const struct ebo32_node *node)
+{
+	u32 t = node->leaf_p;
+
+	while (ebo32_gettag(t) != EB_LEFT)
+		/* Walking up from right branch, so we cannot be below root */
+		t = ebo32_node_at(base, ebo32_untag(t, EB_RGHT))->node_p;
+
+	/* Note that <t> cannot be NULL at this stage */
+	t = ebo32_node_at(base, ebo32_untag(t, EB_LEFT))->b[EB_RGHT];
+	if (ebo32_clrtag(t) == 0)
+		return NULL;
+	return ebo32_walk_down(base, t, EB_LEFT);
+}
+
+/* Return previous node in the tree, or NULL if none */
+static inline struct ebo32_node *ebo32_prev(const void *base, const struct ebo32_node *node)
+{
+	u32 t = node->leaf_p;
+
+	while (ebo32_gettag(t) == EB_LEFT) {
+		/* Walking up from left branch. We must ensure that we never
+		 * walk beyond root.
+		 */
+		if (unlikely(ebo32_clrtag(ebo32_node_at(base, ebo32_untag(t, EB_LEFT))->b[EB_RGHT]) == 0))
+			return NULL;
+		t = ebo32_node_at(base, ebo32_untag(t, EB_LEFT))->node_p;
+	}
+	/* Note that <t> cannot be NULL at this stage */
+	t = ebo32_node_at(base, ebo32_untag(t, EB_RGHT))->b[EB_LEFT];
+	return ebo32_walk_down(base, t, EB_RGHT);
+}
+
+/*
+ * The following functions are not inlined because their code is large enough.
+ * They are implemented in ebo32tree.c.
+ */
+struct ebo32_node *ebo32_lookup(const void *base, const struct ebo32_root *root, u32 x);
+struct ebo32_node *ebo32_lookup_ge(const void *base, const struct ebo32_root *root, u32 x);
+struct ebo32_node *ebo32_insert(void *base, struct ebo32_root *root, struct ebo32_node *new);
+void ebo32_delete(void *base, struct ebo32_node *node);
+
+#endif /* _EBO32TREE_H */
@@ -96,6 +96,7 @@ enum mjson_tok mjson_find(const char *s, int len, const char *jp,
 int mjson_get_number(const char *s, int len, const char *path, double *v);
 int mjson_get_bool(const char *s, int len, const char *path, int *v);
 int mjson_get_string(const char *s, int len, const char *path, char *to, int n);
+int mjson_unescape(const char *s, int len, char *to, int n);
 int mjson_get_hex(const char *s, int len, const char *path, char *to, int n);
 
 #if MJSON_ENABLE_NEXT
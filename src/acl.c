@@ -855,9 +855,55 @@ struct acl_cond *prune_acl_cond(struct acl_cond *cond)
 			free(term);
 		free(suite);
 	}
+	ha_free(&cond->fterms);
 	return cond;
 }
 
+/* Build the flattened array form of condition <cond> from its suites, which
+ * acl_exec_cond() walks instead of the lists for better locality. Duplicate
+ * terms within a suite (same ACL with the same negation) are only kept once
+ * since ANDing a term with itself yields the same result. Returns 1 on
+ * success and 0 on allocation failure.
+ */
+static int acl_cond_flatten(struct acl_cond *cond)
+{
+	struct acl_term_suite *suite;
+	struct acl_term *term;
+	struct acl_flat_term *ft;
+	int count = 0;
+
+	list_for_each_entry(suite, &cond->suites, list)
+		list_for_each_entry(term, &suite->terms, list)
+			count++;
+
+	cond->fterms = calloc(count ? count : 1, sizeof(*cond->fterms));
+	if (!cond->fterms)
+		return 0;
+
+	ft = cond->fterms;
+	list_for_each_entry(suite, &cond->suites, list) {
+		struct acl_flat_term *start = ft;
+		int first = 1;
+
+		list_for_each_entry(term, &suite->terms, list) {
+			struct acl_flat_term *prev;
+
+			for (prev = start; prev < ft; prev++)
+				if (prev->acl == term->acl && prev->neg == term->neg)
+					break;
+			if (prev < ft)
+				continue;
+			ft->acl = term->acl;
+			ft->neg = term->neg;
+			ft->first = first;
+			first = 0;
+			ft++;
+		}
+	}
+	cond->nb_fterms = ft - cond->fterms;
+	return 1;
+}
+
 /* Parse an ACL condition starting at <args>[0], relying on a list of already
  * known ACLs passed in <known_acl>. The new condition is returned (or NULL in
  * case of low memory). Supports multiple conditions separated by "or". If
@@ -1002,6 +1048,11 @@ struct acl_cond *parse_acl_cond(const char **args, struct list *known_acl,
 	}
 
 	cond->val |= suite_val;
+
+	if (!acl_cond_flatten(cond)) {
+		memprintf(err, "out of memory when parsing condition");
+		goto out_free_suite;
+	}
 	return cond;
 
  out_free_term:
@@ -1072,8 +1123,7 @@ struct acl_cond *build_acl_cond(const char *file, int line, struct list *known_a
 enum acl_test_res acl_exec_cond(struct acl_cond *cond, struct proxy *px, struct session *sess, struct stream *strm, unsigned int opt)
 {
 	__label__ fetch_next;
-	struct acl_term_suite *suite;
-	struct acl_term *term;
+	struct acl_flat_term *ft, *end;
 	struct acl_expr *expr;
 	struct acl *acl;
 	struct sample smp;
@@ -1085,28 +1135,35 @@ enum acl_test_res acl_exec_cond(struct acl_cond *cond, struct proxy *px, struct
 	opt |= SMP_OPT_ITERATE;
 
 	/* We're doing a logical OR between conditions so we initialize to FAIL.
-	 * The MISS status is propagated down from the suites.
+	 * The MISS status is propagated down from the suites. The walk uses the
+	 * flattened term array built at parsing time instead of the suite and
+	 * term lists, each suite being delimited by the <first> flag of its
+	 * leading term.
 	 */
 	cond_res = ACL_TEST_FAIL;
-	list_for_each_entry(suite, &cond->suites, list) {
-		/* Evaluate condition suite <suite>. We stop at the first term
-		 * which returns ACL_TEST_FAIL. The MISS status is still propagated
-		 * in case of uncertainty in the result.
+	ft = cond->fterms;
+	end = ft + cond->nb_fterms;
+	while (ft < end) {
+		/* Evaluate one suite. We stop at the first term which returns
+		 * ACL_TEST_FAIL. The MISS status is still propagated in case
+		 * of uncertainty in the result.
 		 */
 
 		/* we're doing a logical AND between terms, so we must set the
 		 * initial value to PASS.
 		 */
 		suite_res = ACL_TEST_PASS;
-		list_for_each_entry(term, &suite->terms, list) {
-			acl = term->acl;
-
-			/* FIXME: use cache !
-			 * check acl->cache_idx for this.
-			 */
-
-			/* ACL result not cached. Let's scan all the expressions
-			 * and use the first one to match.
+		do {
+			acl = ft->acl;
+
+			/* Note that ACL results are deliberately never cached
+			 * across evaluations: almost all relevant fetches
+			 * report some SMP_F_VOL_* volatility, and actions
+			 * executed between two evaluations (set-header,
+			 * set-src, set-path, ...) may change what a fetch
+			 * observes, so a memoized result would silently become
+			 * stale. Let's scan all the expressions and use the
+			 * first one to match.
 			 */
 			acl_res = ACL_TEST_FAIL;
 			list_for_each_entry(expr, &acl->expr, list) {
@@ -1124,12 +1181,6 @@ enum acl_test_res acl_exec_cond(struct acl_cond *cond, struct proxy *px, struct
 				/*
 				 * OK now acl_res holds the result of this expression
 				 * as one of ACL_TEST_FAIL, ACL_TEST_MISS or ACL_TEST_PASS.
-				 *
-				 * Then if (!MISS) we can cache the result, and put
-				 * (smp.flags & SMP_F_VOLATILE) in the cache flags.
-				 *
-				 * FIXME: implement cache.
-				 *
 				 */
 
 				/* we're ORing these terms, so a single PASS is enough */
@@ -1151,18 +1202,24 @@ enum acl_test_res acl_exec_cond(struct acl_cond *cond, struct proxy *px, struct
 			 * ACLs are combined, negated or not, to form conditions.
 			 */
 
-			if (term->neg)
+			if (ft->neg)
 				acl_res = acl_neg(acl_res);
 
 			suite_res &= acl_res;
+			ft++;
 
 			/* we're ANDing these terms, so a single FAIL or MISS is enough */
-			if (suite_res != ACL_TEST_PASS)
+			if (suite_res != ACL_TEST_PASS) {
+				/* skip the remaining terms of this suite */
+				while (ft < end && !ft->first)
+					ft++;
 				break;
-		}
+			}
+		} while (ft < end && !ft->first);
+
 		cond_res |= suite_res;
 
-		/* we're ORing these terms, so a single PASS is enough */
+		/* we're ORing these suites, so a single PASS is enough */
 		if (cond_res == ACL_TEST_PASS)
 			break;
 	}
@@ -1354,6 +1411,7 @@ void free_acl_cond(struct acl_cond *cond)
 		free(suite);
 	}
 
+	free(cond->fterms);
 	free(cond);
 }
 
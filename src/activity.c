@@ -30,6 +30,7 @@ struct show_prof_ctx {
 	int maxcnt;     /* max line count per step (0=not set)  */
 	int by_what;    /* 0=sort by usage, 1=sort by address, 2=sort by time */
 	int aggr;       /* 0=dump raw, 1=aggregate on callee    */
+	int fold;       /* 1=dump tasks as folded stacks for flamegraphs */
 };
 
 /* CLI context for the "show activity" command */
@@ -355,6 +356,27 @@ void activity_count_runtime(uint32_t run_time)
 		             swrate_avg(run_time, TIME_STATS_SAMPLES) <= down)))
 			_HA_ATOMIC_AND(&th_ctx->flags, ~TH_FL_TASK_PROFILING);
 	}
+
+	/* The overload detection works the same way: crossing any of the
+	 * configured thresholds (average loop time or run queue depth) turns
+	 * the flag on, and it's only turned off once both metrics are back
+	 * below half of their respective thresholds, so that the thread
+	 * doesn't flap around the limit.
+	 */
+	if (global.tune.overload_loop_time || global.tune.overload_rq_depth) {
+		uint avg = swrate_avg(run_time, TIME_STATS_SAMPLES);
+		uint rq  = _HA_ATOMIC_LOAD(&th_ctx->rq_total);
+
+		if (!(_HA_ATOMIC_LOAD(&th_ctx->flags) & TH_FL_OVERLOADED)) {
+			if (unlikely((global.tune.overload_loop_time && avg >= global.tune.overload_loop_time) ||
+			             (global.tune.overload_rq_depth && rq >= global.tune.overload_rq_depth)))
+				_HA_ATOMIC_OR(&th_ctx->flags, TH_FL_OVERLOADED);
+		} else {
+			if (unlikely((!global.tune.overload_loop_time || avg <= global.tune.overload_loop_time / 2) &&
+			             (!global.tune.overload_rq_depth || rq <= global.tune.overload_rq_depth / 2)))
+				_HA_ATOMIC_AND(&th_ctx->flags, ~TH_FL_OVERLOADED);
+		}
+	}
 }
 
 #ifdef USE_MEMORY_PROFILING
@@ -659,10 +681,10 @@ static int cli_io_handler_show_profiling(struct appctx *appctx)
 
 	memcpy(tmp_activity, sched_activity, sizeof(tmp_activity));
 	/* for addr sort and for callee aggregation we have to first sort by address */
-	if (ctx->aggr || ctx->by_what == 1) // sort by addr
-		qsort(tmp_activity, SCHED_ACT_HASH_BUCKETS, sizeof(tmp_activity[0]), cmp_sched_activity_addr);	
+	if (!ctx->fold && (ctx->aggr || ctx->by_what == 1)) // sort by addr
+		qsort(tmp_activity, SCHED_ACT_HASH_BUCKETS, sizeof(tmp_activity[0]), cmp_sched_activity_addr);
 
-	if (ctx->aggr) {
+	if (ctx->aggr && !ctx->fold) {
 		/* merge entries for the same callee and reset their count */
 		for (i = j = 0; i < SCHED_ACT_HASH_BUCKETS; i = j) {
 			for (j = i + 1; j < SCHED_ACT_HASH_BUCKETS && tmp_activity[j].func == tmp_activity[i].func; j++) {
@@ -674,12 +696,14 @@ static int cli_io_handler_show_profiling(struct appctx *appctx)
 		}
 	}
 
-	if (!ctx->by_what) // sort by usage
-		qsort(tmp_activity, SCHED_ACT_HASH_BUCKETS, sizeof(tmp_activity[0]), cmp_sched_activity_calls);
-	else if (ctx->by_what == 2) // by cpu_tot
-		qsort(tmp_activity, SCHED_ACT_HASH_BUCKETS, sizeof(tmp_activity[0]), cmp_sched_activity_cpu);
+	if (!ctx->fold) {
+		if (!ctx->by_what) // sort by usage
+			qsort(tmp_activity, SCHED_ACT_HASH_BUCKETS, sizeof(tmp_activity[0]), cmp_sched_activity_calls);
+		else if (ctx->by_what == 2) // by cpu_tot
+			qsort(tmp_activity, SCHED_ACT_HASH_BUCKETS, sizeof(tmp_activity[0]), cmp_sched_activity_cpu);
+	}
 
-	if (!ctx->linenum)
+	if (!ctx->linenum && !ctx->fold)
 		chunk_appendf(&trash, "Tasks activity:\n"
 		                      "  function                      calls   cpu_tot   cpu_avg   lat_tot   lat_avg\n");
 
@@ -700,6 +724,23 @@ static int cli_io_handler_show_profiling(struct appctx *appctx)
 		else
 			resolve_sym_name(name_buffer, "", tmp_activity[i].func);
 
+		if (ctx->fold) {
+			/* folded stacks for flamegraph tools: "<frames> <value>"
+			 * with the waker as the parent frame, a synthetic root
+			 * distinguishing run time from wait (latency) time, and
+			 * values in microseconds.
+			 */
+			const char *waker = (caller && caller->what <= WAKEUP_TYPE_APPCTX_WAKEUP) ?
+			                    caller->func : "other";
+
+			chunk_appendf(&trash, "run;%s;%s %llu\n", waker, name_buffer->area,
+			              (unsigned long long)(tmp_activity[i].cpu_time / 1000ULL));
+			if (tmp_activity[i].lat_time)
+				chunk_appendf(&trash, "wait;%s;%s %llu\n", waker, name_buffer->area,
+				              (unsigned long long)(tmp_activity[i].lat_time / 1000ULL));
+			goto flush_line;
+		}
+
 		/* reserve 35 chars for name+' '+#calls, knowing that longer names
 		 * are often used for less often called functions.
 		 */
@@ -720,6 +761,8 @@ static int cli_io_handler_show_profiling(struct appctx *appctx)
 
 		b_putchr(&trash, '\n');
 
+ flush_line:
+
 		if (applet_putchk(appctx, &trash) == -1) {
 			/* failed, try again */
 			return 0;
@@ -860,11 +903,14 @@ static int cli_parse_show_profiling(char **args, char *payload, struct appctx *a
 		else if (strcmp(args[arg], "aggr") == 0) {
 			ctx->aggr = 1;    // aggregate output by callee
 		}
+		else if (strcmp(args[arg], "folded") == 0) {
+			ctx->fold = 1;    // dump tasks as folded stacks for flamegraphs
+		}
 		else if (isdigit((unsigned char)*args[arg])) {
 			ctx->maxcnt = atoi(args[arg]); // number of entries to dump
 		}
 		else
-			return cli_err(appctx, "Expects either 'all', 'status', 'tasks', 'memory', 'byaddr', 'bytime', 'aggr' or a max number of output lines.\n");
+			return cli_err(appctx, "Expects either 'all', 'status', 'tasks', 'memory', 'byaddr', 'bytime', 'aggr', 'folded' or a max number of output lines.\n");
 	}
 	return 0;
 }
@@ -1110,6 +1156,8 @@ static int cli_io_handler_show_activity(struct appctx *appctx)
 	chunk_appendf(&trash, "accepted:");     SHOW_TOT(thr, activity[thr].accepted);
 	chunk_appendf(&trash, "accq_pushed:");  SHOW_TOT(thr, activity[thr].accq_pushed);
 	chunk_appendf(&trash, "accq_full:");    SHOW_TOT(thr, activity[thr].accq_full);
+	chunk_appendf(&trash, "shed_conns:");   SHOW_TOT(thr, activity[thr].shed_conns);
+	chunk_appendf(&trash, "shed_reqs:");    SHOW_TOT(thr, activity[thr].shed_reqs);
 #ifdef USE_THREAD
 	chunk_appendf(&trash, "accq_ring:");    SHOW_TOT(thr, (accept_queue_rings[thr].tail - accept_queue_rings[thr].head + ACCEPT_QUEUE_SIZE) % ACCEPT_QUEUE_SIZE);
 	chunk_appendf(&trash, "fd_takeover:");  SHOW_TOT(thr, activity[thr].fd_takeover);
@@ -238,8 +238,21 @@ struct task *task_run_applet(struct task *t, void *context, unsigned int state)
 	 * some other processing if needed. The applet doesn't have anything to
 	 * do if it needs the buffer, it will be called again upon readiness.
 	 */
-	if (!sc_alloc_ibuf(sc, &app->buffer_wait))
+	if (!sc_alloc_ibuf(sc, &app->buffer_wait)) {
+		/* If in addition there is nothing to consume from the output
+		 * channel and no shutdown is in progress, the applet has
+		 * strictly nothing it can work on, and calling it would only
+		 * make it spin waiting for this buffer. Leave it asleep
+		 * instead, appctx_buf_available() will wake it up once an
+		 * allocation may succeed again, and the stream will do it for
+		 * any other event happening in between.
+		 */
+		if (!co_data(sc_oc(sc)) &&
+		    !(sc_oc(sc)->flags & (CF_SHUTW|CF_SHUTW_NOW)) &&
+		    !se_fl_test(app->sedesc, SE_FL_SHR | SE_FL_SHW))
+			return t;
 		applet_have_more_data(app);
+	}
 
 	count = co_data(sc_oc(sc));
 	app->applet->fct(app);
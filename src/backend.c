@@ -39,6 +39,7 @@
 #include <haproxy/lb_fwlc.h>
 #include <haproxy/lb_fwrr.h>
 #include <haproxy/lb_map.h>
+#include <haproxy/lb_p2c.h>
 #include <haproxy/log.h>
 #include <haproxy/namespace.h>
 #include <haproxy/obj_type.h>
@@ -58,6 +59,7 @@
 #include <haproxy/ticks.h>
 #include <haproxy/time.h>
 #include <haproxy/trace.h>
+#include <haproxy/xxhash.h>
 
 #define TRACE_SOURCE &trace_strm
 
@@ -69,6 +71,22 @@ int be_lastsession(const struct proxy *be)
 	return -1;
 }
 
+/* Checks whether backend <be>'s retry budget allows one more retry, and
+ * returns non-zero in this case. It is always granted when no "retry-budget"
+ * is configured. Otherwise the backend's current retry rate must remain below
+ * the configured percentage of its session rate. The comparison is not strict
+ * so that a backend seeing no traffic may still perform an occasional retry.
+ * Both rates come from atomically maintained freq counters, no lock is needed.
+ */
+int be_retry_within_budget(struct proxy *be)
+{
+	if (!be->retry_budget)
+		return 1;
+
+	return read_freq_ctr(&be->retry_per_sec) <=
+	       be->retry_budget * read_freq_ctr(&be->be_sess_per_sec) / 100;
+}
+
 /* helper function to invoke the correct hash method */
 static unsigned int gen_hash(const struct proxy* px, const char* key, unsigned long len)
 {
@@ -84,6 +102,9 @@ static unsigned int gen_hash(const struct proxy* px, const char* key, unsigned l
 	case BE_LB_HFCN_CRC32:
 		hash = hash_crc32(key, len);
 		break;
+	case BE_LB_HFCN_XXH3:
+		hash = XXH3(key, len, 0);
+		break;
 	case BE_LB_HFCN_SDBM:
 		/* this is the default hash function */
 	default:
@@ -557,6 +578,35 @@ static struct server *get_server_expr(struct stream *s, const struct server *avo
 		return map_get_server_hash(px, hash);
 }
 
+/* Measures server <srv>'s "temperature" for the random algorithm, as a value
+ * between 16 and 256 inclusive to be compared against an 8-bit random. A warm
+ * server (past its slowstart window, responding at least as fast as the farm's
+ * average) scores 256 and is always admitted. The score first shrinks with the
+ * remaining part of the slowstart window, in addition to the regular eweight
+ * ramp-up which is too coarse on its own for farms seeing constant server
+ * churn, then with the ratio of the farm's average total time to the server's,
+ * both read from the existing swrate counters without any lock. The 16 floor
+ * guarantees a trickle of traffic so that a server's measurements can converge
+ * again once it recovers.
+ */
+static unsigned int srv_rnd_temperature(const struct server *srv)
+{
+	unsigned int temp = 256;
+	unsigned int t_srv, t_be;
+
+	if (srv->slowstart &&
+	    now.tv_sec >= srv->last_change &&
+	    now.tv_sec < srv->last_change + srv->slowstart)
+		temp = temp * (now.tv_sec - srv->last_change + 1) / srv->slowstart;
+
+	t_srv = swrate_avg(srv->counters.t_time, TIME_STATS_SAMPLES);
+	t_be  = swrate_avg(srv->proxy->be_counters.t_time, TIME_STATS_SAMPLES);
+	if (t_be && t_srv > t_be)
+		temp = temp * t_be / t_srv;
+
+	return MAX(temp, 16);
+}
+
 /* random value  */
 static struct server *get_server_rnd(struct stream *s, const struct server *avoid)
 {
@@ -564,6 +614,7 @@ static struct server *get_server_rnd(struct stream *s, const struct server *avoi
 	struct proxy  *px = s->be;
 	struct server *prev, *curr;
 	int draws = px->lbprm.arg_opt1; // number of draws
+	int rejects = 2;                // max draws rejected by the temperature check
 
 	/* tot_weight appears to mean srv_count */
 	if (px->lbprm.tot_weight == 0)
@@ -577,19 +628,48 @@ static struct server *get_server_rnd(struct stream *s, const struct server *avoi
 		if (!curr)
 			break;
 
-		/* compare the new server to the previous best choice and pick
-		 * the one with the least currently served requests.
+		/* In temperature mode, each draw is only admitted with a
+		 * probability following the server's warmth, so that freshly
+		 * started or degraded servers receive proportionally less
+		 * traffic. A rejected draw is simply redrawn, within the
+		 * limit set above so that the loop always converges.
 		 */
-		if (prev && prev != curr &&
-		    curr->served * prev->cur_eweight > prev->served * curr->cur_eweight)
+		if (px->lbprm.arg_opt2 && rejects > 0 &&
+		    (statistical_prng() & 255) >= srv_rnd_temperature(curr)) {
+			rejects--;
 			curr = prev;
+			draws++;
+			continue;
+		}
+
+		/* compare the new server to the previous best choice and pick
+		 * the one with the least currently served requests. When idle
+		 * connection locality is enabled, a candidate with an idle
+		 * connection on the current thread is preferred over one
+		 * without, so that the connection can be reused without
+		 * stealing one from another thread.
+		 */
+		if (prev && prev != curr) {
+			if (px->options & PR_O_REUSE_LOCAL) {
+				int p_loc = HA_ATOMIC_LOAD(&prev->curr_idle_thr[tid]) > 0;
+				int c_loc = HA_ATOMIC_LOAD(&curr->curr_idle_thr[tid]) > 0;
+
+				if (p_loc != c_loc) {
+					if (p_loc)
+						curr = prev;
+					continue;
+				}
+			}
+			if (curr->served * prev->cur_eweight > prev->served * curr->cur_eweight)
+				curr = prev;
+		}
 	} while (--draws > 0);
 
 	/* if the selected server is full, pretend we have none so that we reach
 	 * the backend's queue instead.
 	 */
 	if (curr &&
-	    (curr->queue.length || (curr->maxconn && curr->served >= srv_dynamic_maxconn(curr))))
+	    (curr->queue_length || (curr->maxconn && curr->served >= srv_dynamic_maxconn(curr))))
 		curr = NULL;
 
 	return curr;
@@ -661,7 +741,7 @@ int assign_server(struct stream *s)
 			    ((s->sess->flags & SESS_FL_PREFER_LAST) ||
 			     (!s->be->max_ka_queue ||
 			      server_has_room(tmpsrv) || (
-			      tmpsrv->queue.length + 1 < s->be->max_ka_queue))) &&
+			      tmpsrv->queue_length + 1 < s->be->max_ka_queue))) &&
 			    srv_currently_usable(tmpsrv)) {
 				list_for_each_entry(conn, &srv_list->conn_list, session_list) {
 					if (!(conn->flags & CO_FL_WAIT_XPRT)) {
@@ -713,6 +793,10 @@ int assign_server(struct stream *s)
 			srv = fwlc_get_next_server(s->be, prev_srv);
 			break;
 
+		case BE_LB_LKUP_P2CMAP:
+			srv = p2c_get_next_server(s->be, prev_srv);
+			break;
+
 		case BE_LB_LKUP_CHTREE:
 		case BE_LB_LKUP_MAP:
 			if ((s->be->lbprm.algo & BE_LB_KIND) == BE_LB_KIND_RR) {
@@ -1028,9 +1112,9 @@ int assign_server_and_queue(struct stream *s)
 		 * not full, in which case we have to return FULL.
 		 */
 		if (srv->maxconn &&
-		    (srv->queue.length || srv->served >= srv_dynamic_maxconn(srv))) {
+		    (srv->queue_length || srv->served >= srv_dynamic_maxconn(srv))) {
 
-			if (srv->maxqueue > 0 && srv->queue.length >= srv->maxqueue)
+			if (srv->maxqueue > 0 && srv->queue_length >= srv->maxqueue)
 				return SRV_STATUS_FULL;
 
 			p = pendconn_add(s);
@@ -1279,9 +1363,16 @@ static int do_connect_server(struct stream *s, struct connection *conn)
 	if (unlikely(!conn || !conn->ctrl || !conn->ctrl->connect))
 		return SF_ERR_INTERNAL;
 
-	if (!channel_is_empty(&s->res))
+	/* data bound for the server sits as output data of the backend
+	 * stconn's channel, i.e. the request channel.
+	 */
+	if (!channel_is_empty(sc_oc(s->scb)))
 		conn_flags |= CONNECT_HAS_DATA;
-	if (s->conn_retries == s->be->conn_retries)
+	/* only the first connection attempt may use TFO: data queued in the
+	 * SYN may be lost if the server drops it, so retries must perform a
+	 * full handshake to disambiguate.
+	 */
+	if (!s->conn_retries)
 		conn_flags |= CONNECT_CAN_USE_TFO;
 	if (!conn_ctrl_ready(conn) || !conn_xprt_ready(conn)) {
 		ret = conn->ctrl->connect(conn, conn_flags);
@@ -1309,6 +1400,21 @@ static int do_connect_server(struct stream *s, struct connection *conn)
 	return ret;
 }
 
+/* Returns non-zero if the next connection attempt for stream <s> towards
+ * server <srv> should switch to the server's alternate-family address. This
+ * is only the case when "dual-stack-delay" is set on the server, the resolvers
+ * provided an address of the other family, and the stream's current
+ * destination still uses the server's preferred family (i.e. we have not
+ * switched yet).
+ */
+static int srv_will_switch_family(struct stream *s, struct server *srv)
+{
+	return srv && srv->dual_stack_delay &&
+	       is_addr(&srv->addr_alt) &&
+	       srv->addr_alt.ss_family != srv->addr.ss_family &&
+	       s->scb->dst && s->scb->dst->ss_family == srv->addr.ss_family;
+}
+
 /*
  * This function initiates a connection to the server assigned to this stream
  * (s->target, (s->scb)->addr.to). It will assign a server if none
@@ -1348,6 +1454,17 @@ static int connect_server(struct stream *s)
 	if (err != SRV_STATUS_OK)
 		return SF_ERR_INTERNAL;
 
+	/* dual-stack fallback: when retrying after the preferred family failed
+	 * (or got no answer within its head start), move to the alternate
+	 * family while keeping the port.
+	 */
+	if (s->conn_retries && srv_will_switch_family(s, srv)) {
+		int port = get_host_port(s->scb->dst);
+
+		*s->scb->dst = srv->addr_alt;
+		set_host_port(s->scb->dst, port);
+	}
+
 	err = alloc_bind_address(&bind_addr, srv, s);
 	if (err != SRV_STATUS_OK)
 		return SF_ERR_INTERNAL;
@@ -1807,6 +1924,13 @@ skip_reuse:
 	/* set connect timeout */
 	s->conn_exp = tick_add_ifset(now_ms, s->be->timeout.connect);
 
+	/* dual-stack fallback: only give the preferred family its configured
+	 * head start; the retry will switch to the alternate family.
+	 */
+	if (!s->conn_retries && srv_will_switch_family(s, srv))
+		s->conn_exp = tick_first(s->conn_exp,
+		                         tick_add(now_ms, MS_TO_TICKS(srv->dual_stack_delay)));
+
 	if (srv) {
 		int count;
 
@@ -2288,6 +2412,7 @@ void back_handle_st_cer(struct stream *s)
 {
 	struct stconn *sc = s->scb;
 	int must_tar = sc_ep_test(sc, SE_FL_ERROR);
+	int budget_ok;
 
 	DBG_TRACE_ENTER(STRM_EV_STRM_PROC|STRM_EV_CS_ST, s);
 
@@ -2328,8 +2453,20 @@ void back_handle_st_cer(struct stream *s)
 		}
 	}
 
+	/* check whether the retry budget still allows one more retry; an
+	 * exceeded budget is accounted for and makes us give up just like
+	 * exhausted retries, so that brownouts don't see their load multiplied
+	 * by retries.
+	 */
+	budget_ok = 1;
+	if (s->conn_retries < s->be->conn_retries && (s->be->retry_type & PR_RE_CONN_FAILED) &&
+	    !be_retry_within_budget(s->be)) {
+		budget_ok = 0;
+		_HA_ATOMIC_INC(&s->be->be_counters.denied_retries);
+	}
+
 	/* ensure that we have enough retries left */
-	if (s->conn_retries >= s->be->conn_retries || !(s->be->retry_type & PR_RE_CONN_FAILED)) {
+	if (s->conn_retries >= s->be->conn_retries || !(s->be->retry_type & PR_RE_CONN_FAILED) || !budget_ok) {
 		if (!s->conn_err_type) {
 			s->conn_err_type = STRM_ET_CONN_ERR;
 		}
@@ -2389,6 +2526,7 @@ void back_handle_st_cer(struct stream *s)
 	}
 
 	s->conn_retries++;
+	update_freq_ctr(&s->be->retry_per_sec, 1);
 	stream_choose_redispatch(s);
 
 	if (must_tar) {
@@ -2410,6 +2548,13 @@ void back_handle_st_cer(struct stream *s)
 		if (!s->conn_err_type)
 			s->conn_err_type = STRM_ET_CONN_ERR;
 
+		/* no wait when the retry will switch to the server's
+		 * alternate-family address: the failure may be specific to the
+		 * family that was just tried.
+		 */
+		if (srv_will_switch_family(s, objt_server(s->target)))
+			delay = 0;
+
 		/* only wait when we're retrying on the same server */
 		if ((sc->state == SC_ST_ASS ||
 		     (s->be->srv_act <= 1)) && !reused) {
@@ -2603,6 +2748,8 @@ const char *backend_lb_algo_str(int algo) {
 		return "first";
 	else if (algo == BE_LB_ALGO_LC)
 		return "leastconn";
+	else if (algo == BE_LB_ALGO_P2C)
+		return "p2c";
 	else if (algo == BE_LB_ALGO_SH)
 		return "source";
 	else if (algo == BE_LB_ALGO_UH)
@@ -2653,10 +2800,15 @@ int backend_parse_balance(const char **args, char **err, struct proxy *curproxy)
 		curproxy->lbprm.algo &= ~BE_LB_ALGO;
 		curproxy->lbprm.algo |= BE_LB_ALGO_LC;
 	}
+	else if (strcmp(args[0], "p2c") == 0) {
+		curproxy->lbprm.algo &= ~BE_LB_ALGO;
+		curproxy->lbprm.algo |= BE_LB_ALGO_P2C;
+	}
 	else if (!strncmp(args[0], "random", 6)) {
 		curproxy->lbprm.algo &= ~BE_LB_ALGO;
 		curproxy->lbprm.algo |= BE_LB_ALGO_RND;
 		curproxy->lbprm.arg_opt1 = 2;
+		curproxy->lbprm.arg_opt2 = 0; // "temperature"
 
 		if (*(args[0] + 6) == '(' && *(args[0] + 7) != ')') { /* number of draws */
 			const char *beg;
@@ -2678,6 +2830,15 @@ int backend_parse_balance(const char **args, char **err, struct proxy *curproxy)
 				return -1;
 			}
 		}
+
+		if (*args[1]) {
+			if (strcmp(args[1], "temperature") == 0)
+				curproxy->lbprm.arg_opt2 = 1;
+			else {
+				memprintf(err, "random : only 'temperature' is supported as an option (got '%s').", args[1]);
+				return -1;
+			}
+		}
 	}
 	else if (strcmp(args[0], "source") == 0) {
 		curproxy->lbprm.algo &= ~BE_LB_ALGO;
@@ -2901,7 +3062,7 @@ smp_fetch_connslots(const struct arg *args, struct sample *smp, const char *kw,
 		}
 
 		smp->data.u.sint += (iterator->maxconn - iterator->cur_sess)
-		                       +  (iterator->maxqueue - iterator->queue.length);
+		                       +  (iterator->maxqueue - iterator->queue_length);
 	}
 
 	return 1;
@@ -3178,7 +3339,7 @@ smp_fetch_srv_queue(const struct arg *args, struct sample *smp, const char *kw,
 {
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
-	smp->data.u.sint = args->data.srv->queue.length;
+	smp->data.u.sint = args->data.srv->queue_length;
 	return 1;
 }
 
@@ -3320,7 +3481,7 @@ sample_conv_srv_queue(const struct arg *args, struct sample *smp, void *private)
 		return 0;
 
 	smp->data.type = SMP_T_SINT;
-	smp->data.u.sint = srv->queue.length;
+	smp->data.u.sint = srv->queue_length;
 	return 1;
 }
 
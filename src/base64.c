@@ -124,6 +124,7 @@ int base64dec(const char *in, size_t ilen, char *out, size_t olen) {
 	unsigned char t[4];
 	signed char b;
 	int convlen = 0, i = 0, pad = 0;
+	uint32_t v, err;
 
 	if (ilen % 4)
 		return -1;
@@ -133,6 +134,41 @@ int base64dec(const char *in, size_t ilen, char *out, size_t olen) {
 	            - (in[ilen-2] == '=' ? 1 : 0)))
 		return -2;
 
+	/* bulk phase: pad-free groups are decoded 4 chars at a time into a
+	 * 24-bit word with a single validity test per group. The length check
+	 * above guarantees that these groups fully fit into <out>. As soon as
+	 * a group contains padding, the byte loop below takes over, since it
+	 * implements the historical semantics where padded groups are allowed
+	 * anywhere in the stream and decoding simply continues with the next
+	 * group.
+	 */
+	while (ilen > 4) {
+		v = err = 0;
+		for (i = 0; i < 4; i++) {
+			b = (signed char)in[i] - B64CMIN;
+			if ((unsigned char)b > (B64CMAX-B64CMIN))
+				return -1;
+			b = base64rev[b] - B64BASE - 1;
+			/* invalid (-1) sets 0xff, padding (64) sets 0x40 */
+			err |= (unsigned char)b;
+			v = (v << 6) | ((unsigned char)b & 0x3F);
+		}
+
+		if (err & 0x80)
+			return -1;
+
+		if (err & 0x40)
+			break;
+
+		out[convlen]   = v >> 16;
+		out[convlen+1] = v >> 8;
+		out[convlen+2] = v;
+		convlen += 3;
+		in += 4;
+		ilen -= 4;
+	}
+
+	i = 0;
 	while (ilen) {
 
 		/* if (*p < B64CMIN || *p > B64CMAX) */
@@ -193,6 +229,7 @@ int base64urldec(const char *in, size_t ilen, char *out, size_t olen)
 	unsigned char t[4];
 	signed char b;
 	int convlen = 0, i = 0, pad = 0, padlen = 0;
+	uint32_t v, err;
 
 	switch (ilen % 4) {
 		case 0:
@@ -210,6 +247,36 @@ int base64urldec(const char *in, size_t ilen, char *out, size_t olen)
 	if (olen < (((ilen + pad) / 4 * 3) - pad))
 		return -2;
 
+	/* bulk phase: the input never contains padding chars (missing chars
+	 * are accounted for by <pad>), so all complete groups are decoded
+	 * 4 chars at a time into a 24-bit word with a single validity test
+	 * per group. The length check above guarantees that these groups
+	 * fully fit into <out>.
+	 */
+	while (ilen >= 4) {
+		v = err = 0;
+		for (i = 0; i < 4; i++) {
+			b = (signed char)in[i] - UB64CMIN;
+			if ((unsigned char)b > (B64CMAX - UB64CMIN))
+				return -1;
+			b = ubase64rev[b] - B64BASE - 1;
+			/* invalid (-1) sets 0xff */
+			err |= (unsigned char)b;
+			v = (v << 6) | ((unsigned char)b & 0x3F);
+		}
+
+		if (err & 0xC0)
+			return -1;
+
+		out[convlen]   = v >> 16;
+		out[convlen+1] = v >> 8;
+		out[convlen+2] = v;
+		convlen += 3;
+		in += 4;
+		ilen -= 4;
+	}
+
+	i = 0;
 	while (ilen + pad) {
 		if (ilen) {
 			/* if (*p < UB64CMIN || *p > B64CMAX) */
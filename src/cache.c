@@ -10,12 +10,19 @@
  * 2 of the License, or (at your option) any later version.
  */
 
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 #include <import/eb32tree.h>
 #include <import/sha1.h>
 
 #include <haproxy/action-t.h>
 #include <haproxy/api.h>
 #include <haproxy/applet.h>
+#include <haproxy/backend.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/channel.h>
 #include <haproxy/cli.h>
@@ -24,6 +31,7 @@
 #include <haproxy/hash.h>
 #include <haproxy/http.h>
 #include <haproxy/http_ana.h>
+#include <haproxy/http_client.h>
 #include <haproxy/http_htx.h>
 #include <haproxy/http_rules.h>
 #include <haproxy/htx.h>
@@ -31,10 +39,12 @@
 #include <haproxy/proxy.h>
 #include <haproxy/sample.h>
 #include <haproxy/sc_strm.h>
+#include <haproxy/server.h>
 #include <haproxy/shctx.h>
 #include <haproxy/stconn.h>
 #include <haproxy/stream.h>
 #include <haproxy/tools.h>
+#include <haproxy/xxhash.h>
 
 #define CACHE_FLT_F_IMPLICIT_DECL  0x00000001 /* The cache filtre was implicitly declared (ie without
 					       * the filter keyword) */
@@ -43,22 +53,28 @@
 const char *cache_store_flt_id = "cache store filter";
 
 extern struct applet http_cache_applet;
+extern struct applet http_cache_disk_applet;
 
 struct flt_ops cache_ops;
 
 struct cache {
 	struct list list;        /* cache linked list */
 	struct eb_root entries;  /* head of cache entries based on keys */
+	__decl_thread(HA_RWLOCK_T lock); /* rwlock covering the entries tree */
 	unsigned int maxage;     /* max-age */
 	unsigned int maxblocks;
 	unsigned int maxobjsz;   /* max-object-size (in bytes) */
 	unsigned int max_secondary_entries;  /* maximum number of secondary entries with the same primary hash */
 	uint8_t vary_processing_enabled;     /* boolean : manage Vary header (disabled by default) */
 	char id[33];             /* cache name */
+	char *disk_path;         /* directory of the second-tier disk cache (NULL = disabled) */
+	unsigned int disk_min_hits; /* number of memory hits before an object is admitted on disk */
 };
 
 /* the appctx context of a cache applet, stored in appctx->svcctx */
 struct cache_appctx {
+	struct appctx *appctx;           /* Back pointer, used to wake the applet up from another stream. */
+	struct mt_list wait_entry;       /* Attachment to the entry's waiters list during a fill. */
 	struct cache_entry *entry;       /* Entry to be sent from cache. */
 	unsigned int sent;               /* The number of bytes already sent for this cache entry. */
 	unsigned int offset;             /* start offset of remaining data relative to beginning of the next block */
@@ -83,6 +99,17 @@ struct show_cache_ctx {
 	uint next_key;
 };
 
+/* CLI context used during "cache shrink" */
+struct shrink_cache_ctx {
+	struct cache *cache;
+	uint blocks;          /* blocks released so far */
+	size_t released;      /* bytes given back to the OS */
+	int done;             /* the shrink itself was performed */
+};
+
+/* number of rows evicted per lock round during "cache shrink" */
+#define CACHE_SHRINK_BATCH 1024
+
 
 /*
  * Vary-related structures and functions
@@ -154,6 +181,13 @@ struct cache_st {
 
 struct cache_entry {
 	unsigned int complete;    /* An entry won't be valid until complete is not null. */
+	unsigned int stale_swr;   /* stale-while-revalidate window (in seconds) past <expire> (RFC 5861) */
+	unsigned int stale_sie;   /* stale-if-error window (in seconds) past <expire> (RFC 5861) */
+	unsigned int refreshing;  /* A background revalidation of this entry is in progress. */
+	unsigned int committed;   /* Number of bytes of the stored message (headers included)
+				   * safely readable by concurrent streams while the entry
+				   * is being filled. Updated after each complete append. */
+	struct mt_list waiters;   /* Appctx streaming this entry while it is being filled. */
 	unsigned int latest_validation;     /* latest validation date */
 	unsigned int expire;      /* expiration date (wall clock time) */
 	unsigned int age;         /* Origin server "Age" header value */
@@ -170,6 +204,9 @@ struct cache_entry {
 	unsigned int etag_length; /* Length of the ETag value (if one was found in the response). */
 	unsigned int etag_offset; /* Offset of the ETag value in the data buffer. */
 
+	unsigned int hits;        /* Number of times this entry was served from memory, used
+				   * for the disk tier admission. */
+
 	time_t last_modified; /* Origin server "Last-Modified" header value converted in
 			       * seconds since epoch. If no "Last-Modified"
 			       * header is found, use "Date" header value,
@@ -191,8 +228,45 @@ DECLARE_STATIC_POOL(pool_head_cache_st, "cache_st", sizeof(struct cache_st));
 
 static struct eb32_node *insert_entry(struct cache *cache, struct cache_entry *new_entry);
 static void delete_entry(struct cache_entry *del_entry);
+static void cache_wakeup_waiters(struct cache_entry *object);
+static void cache_disk_store(struct cache *cache, struct cache_entry *object);
+static void cache_disk_invalidate(struct cache *cache, const char *hash);
+
+/* The cache's entries tree is protected by a dedicated rwlock so that
+ * concurrent cache hits only contend on the shctx lock for the short hot-list
+ * updates. Writers (store, invalidation, eviction) must hold the write lock.
+ * The lock order is always cache lock first, shctx lock second, because row
+ * reservation may evict entries from the tree via the shctx free_block
+ * callback.
+ */
+static inline void cache_rdlock(struct cache *cache)
+{
+	HA_RWLOCK_RDLOCK(CACHE_LOCK, &cache->lock);
+}
+
+static inline void cache_rdunlock(struct cache *cache)
+{
+	HA_RWLOCK_RDUNLOCK(CACHE_LOCK, &cache->lock);
+}
+
+static inline void cache_wrlock(struct cache *cache)
+{
+	HA_RWLOCK_WRLOCK(CACHE_LOCK, &cache->lock);
+}
+
+static inline void cache_wrunlock(struct cache *cache)
+{
+	HA_RWLOCK_WRUNLOCK(CACHE_LOCK, &cache->lock);
+}
 
-struct cache_entry *entry_exist(struct cache *cache, char *hash)
+/*
+ * Look for the cache entry matching primary hash <hash> in <cache>'s tree.
+ * Expired entries are only removed when <delete_expired> is set, which
+ * requires the caller to hold the cache's write lock; lookups performed under
+ * the read lock must pass 0 and leave the expired entry for a later writer.
+ * Returns the entry on success, NULL otherwise.
+ */
+struct cache_entry *entry_exist(struct cache *cache, char *hash, int delete_expired)
 {
 	struct eb32_node *node;
 	struct cache_entry *entry;
@@ -209,7 +283,13 @@ struct cache_entry *entry_exist(struct cache *cache, char *hash)
 
 	if (entry->expire > date.tv_sec) {
 		return entry;
-	} else {
+	} else if (!delete_expired &&
+		   entry->expire + MAX(entry->stale_swr, entry->stale_sie) > date.tv_sec) {
+		/* The entry is stale but still within one of its RFC 5861
+		 * windows: return it and let the caller decide whether it may
+		 * be served. */
+		return entry;
+	} else if (delete_expired) {
 		delete_entry(entry);
 		entry->eb.key = 0;
 	}
@@ -251,10 +331,12 @@ static int secondary_key_cmp(const char *ref_key, const char *new_key)
  * order to get the proper one out of the list, we use a secondary_key.
  * This function simply iterates over all the entries with the same primary_key
  * until it finds the right one.
+ * Expired entries crossed on the way are only cleared when <delete_expired>
+ * is set, which requires the cache's write lock; pass 0 under the read lock.
  * Returns the cache_entry in case of success, NULL otherwise.
  */
 struct cache_entry *secondary_entry_exist(struct cache *cache, struct cache_entry *entry,
-					  const char *secondary_key)
+					  const char *secondary_key, int delete_expired)
 {
 	struct eb32_node *node = &entry->eb;
 
@@ -268,7 +350,7 @@ struct cache_entry *secondary_entry_exist(struct cache *cache, struct cache_entr
 		 * when we find them. Calling delete_entry would be too costly
 		 * so we simply call eb32_delete. The secondary_entry count will
 		 * be updated when we try to insert a new entry to this list. */
-		if (entry->expire <= date.tv_sec) {
+		if (entry->expire <= date.tv_sec && delete_expired) {
 			eb32_delete(&entry->eb);
 			entry->eb.key = 0;
 		}
@@ -278,8 +360,10 @@ struct cache_entry *secondary_entry_exist(struct cache *cache, struct cache_entr
 
 	/* Expired entry */
 	if (entry && entry->expire <= date.tv_sec) {
-		eb32_delete(&entry->eb);
-		entry->eb.key = 0;
+		if (delete_expired) {
+			eb32_delete(&entry->eb);
+			entry->eb.key = 0;
+		}
 		entry = NULL;
 	}
 
@@ -536,9 +620,22 @@ cache_store_strm_deinit(struct stream *s, struct filter *filter)
 	/* Everything should be released in the http_end filter, but we need to do it
 	 * there too, in case of errors */
 	if (st && st->first_block) {
+		struct cache_entry *object = (struct cache_entry *)st->first_block->data;
+
+		/* The fill was interrupted before completion: remove the entry
+		 * from the tree so that readers attached to it give up instead
+		 * of waiting for data that will never come. */
+		if (!HA_ATOMIC_LOAD(&object->complete)) {
+			cache_wrlock(cache);
+			if (object->eb.key)
+				delete_entry(object);
+			object->eb.key = 0;
+			cache_wrunlock(cache);
+		}
 		shctx_lock(shctx);
 		shctx_row_dec_hot(shctx, st->first_block);
 		shctx_unlock(shctx);
+		cache_wakeup_waiters(object);
 	}
 	if (st) {
 		pool_free(pool_head_cache_st, st);
@@ -585,18 +682,36 @@ cache_store_http_headers(struct stream *s, struct filter *filter, struct http_ms
 	return 1;
 }
 
+/* Wake up all the streams attached to <object>, waiting for more data to be
+ * committed by the stream filling the entry. Woken applets re-subscribe by
+ * themselves if they still miss data, so the list can simply be flushed.
+ */
+static void cache_wakeup_waiters(struct cache_entry *object)
+{
+	struct cache_appctx *ctx;
+
+	while ((ctx = MT_LIST_POP(&object->waiters, struct cache_appctx *, wait_entry)))
+		appctx_wakeup(ctx->appctx);
+}
+
 static inline void disable_cache_entry(struct cache_st *st,
                                        struct filter *filter, struct shared_context *shctx)
 {
+	struct cache_flt_conf *cconf = FLT_CONF(filter);
+	struct cache *cache = cconf->c.cache;
 	struct cache_entry *object;
 
 	object = (struct cache_entry *)st->first_block->data;
 	filter->ctx = NULL; /* disable cache  */
-	shctx_lock(shctx);
-	shctx_row_dec_hot(shctx, st->first_block);
+	cache_wrlock(cache);
 	eb32_delete(&object->eb);
 	object->eb.key = 0;
+	cache_wrunlock(cache);
+	shctx_lock(shctx);
+	shctx_row_dec_hot(shctx, st->first_block);
 	shctx_unlock(shctx);
+	/* let the attached readers notice the aborted fill */
+	cache_wakeup_waiters(object);
 	pool_free(pool_head_cache_st, st);
 }
 
@@ -669,19 +784,30 @@ cache_store_http_payload(struct stream *s, struct filter *filter, struct http_ms
 	}
 
   end:
+	/* The write lock must be taken before the shctx one because the row
+	 * reservation might evict other entries from the tree. */
+	cache_wrlock(cconf->c.cache);
 	shctx_lock(shctx);
 	fb = shctx_row_reserve_hot(shctx, st->first_block, trash.data);
 	if (!fb) {
 		shctx_unlock(shctx);
+		cache_wrunlock(cconf->c.cache);
 		goto no_cache;
 	}
 	shctx_unlock(shctx);
+	cache_wrunlock(cconf->c.cache);
 
 	ret = shctx_row_data_append(shctx, st->first_block, st->first_block->last_append,
 				    (unsigned char *)b_head(&trash), b_data(&trash));
 	if (ret < 0)
 		goto no_cache;
 
+	/* Publish the bytes committed so far so that the streams attached to
+	 * this entry can forward them while the fill goes on. */
+	HA_ATOMIC_STORE(&((struct cache_entry *)st->first_block->data)->committed,
+			st->first_block->len - sizeof(struct cache_entry));
+	cache_wakeup_waiters((struct cache_entry *)st->first_block->data);
+
 	return to_forward;
 
   no_cache:
@@ -707,12 +833,16 @@ cache_store_http_end(struct stream *s, struct filter *filter,
 
 		object = (struct cache_entry *)st->first_block->data;
 
-		shctx_lock(shctx);
-		/* The whole payload was cached, the entry can now be used. */
-		object->complete = 1;
+		/* The whole payload was cached, the entry can now be used.
+		 * Lookups check this flag under the cache's read lock only so
+		 * an atomic store is required here. */
+		HA_ATOMIC_STORE(&object->committed, st->first_block->len - sizeof(*object));
+		HA_ATOMIC_STORE(&object->complete, 1);
 		/* remove from the hotlist */
+		shctx_lock(shctx);
 		shctx_row_dec_hot(shctx, st->first_block);
 		shctx_unlock(shctx);
+		cache_wakeup_waiters(object);
 
 	}
 	if (st) {
@@ -761,6 +891,33 @@ char *directive_value(const char *sample, int slen, const char *word, int wlen)
 	return NULL;
 }
 
+/*
+ * Look for the numerical argument of cache-control directive <word> (of
+ * length <wlen>) at the beginning of value element <value>. A quoted argument
+ * is accepted. Returns the parsed value, or -1 when the directive is absent
+ * or its argument unparsable.
+ */
+static long parse_cc_numeric(struct ist value, const char *word, int wlen)
+{
+	struct buffer *chk;
+	char *p, *endptr;
+	long ret;
+	int offset;
+
+	p = directive_value(istptr(value), istlen(value), word, wlen);
+	if (!p)
+		return -1;
+
+	chk = get_trash_chunk();
+	chunk_memcat(chk, p, istend(value) - p);
+	chunk_memcat(chk, "", 1);
+	offset = (*chk->area == '"') ? 1 : 0;
+	ret = strtol(chk->area + offset, &endptr, 10);
+	if (ret < 0 || endptr == chk->area + offset)
+		return -1;
+	return ret;
+}
+
 /*
  * Return the maxage in seconds of an HTTP response.
  * The returned value will always take the cache's configuration into account
@@ -866,6 +1023,11 @@ int http_calc_maxage(struct stream *s, struct cache *cache, int *true_maxage)
 }
 
 
+/* Release callback invoked by the shctx when a row is evicted. It removes the
+ * corresponding entry from the tree, so the caller triggering the eviction
+ * (shctx_row_reserve_hot or shctx_release_avail) must hold the cache's write
+ * lock on top of the shctx one.
+ */
 static void cache_free_blocks(struct shared_block *first, struct shared_block *block)
 {
 	struct cache_entry *object = (struct cache_entry *)block->data;
@@ -1014,7 +1176,8 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 
 	/* Don't cache if the response came from a cache */
 	if ((obj_type(s->target) == OBJ_TYPE_APPLET) &&
-	    s->target == &http_cache_applet.obj_type) {
+	    (s->target == &http_cache_applet.obj_type ||
+	     s->target == &http_cache_disk_applet.obj_type)) {
 		goto out;
 	}
 
@@ -1039,14 +1202,16 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 			default: /* Any unsafe method */
 				/* Discard any corresponding entry in case of successful
 				 * unsafe request (such as PUT, POST or DELETE). */
-				shctx_lock(shctx);
+				cache_wrlock(cache);
 
-				old = entry_exist(cconf->c.cache, txn->cache_hash);
+				old = entry_exist(cconf->c.cache, txn->cache_hash, 1);
 				if (old) {
 					eb32_delete(&old->eb);
 					old->eb.key = 0;
 				}
-				shctx_unlock(shctx);
+				cache_wrunlock(cache);
+				if (cache->disk_path)
+					cache_disk_invalidate(cache, txn->cache_hash);
 			}
 		}
 		goto out;
@@ -1104,36 +1269,49 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	if (!(txn->flags & TX_CACHEABLE) || !(txn->flags & TX_CACHE_COOK) || (txn->flags & TX_CACHE_IGNORE))
 		goto out;
 
-	shctx_lock(shctx);
-	old = entry_exist(cache, txn->cache_hash);
+	cache_wrlock(cache);
+	old = entry_exist(cache, txn->cache_hash, 1);
 	if (old) {
 		if (vary_signature)
 			old = secondary_entry_exist(cconf->c.cache, old,
-						    txn->cache_secondary_hash);
+						    txn->cache_secondary_hash, 1);
 		if (old) {
-			if (!old->complete) {
+			if (!HA_ATOMIC_LOAD(&old->complete)) {
 				/* An entry with the same primary key is already being
 				 * created, we should not try to store the current
 				 * response because it will waste space in the cache. */
-				shctx_unlock(shctx);
+				cache_wrunlock(cache);
 				goto out;
 			}
 			delete_entry(old);
 			old->eb.key = 0;
 		}
 	}
+	shctx_lock(shctx);
 	first = shctx_row_reserve_hot(shctx, NULL, sizeof(struct cache_entry));
 	if (!first) {
 		shctx_unlock(shctx);
+		cache_wrunlock(cache);
 		goto out;
 	}
+	shctx_unlock(shctx);
 	/* the received memory is not initialized, we need at least to mark
 	 * the object as not indexed yet.
 	 */
 	object = (struct cache_entry *)first->data;
 	memset(object, 0, sizeof(*object));
+	MT_LIST_INIT(&object->waiters);
 	object->eb.key = key;
 	object->secondary_key_signature = vary_signature;
+
+	/* a new version of the object is going to be stored: the disk tier
+	 * must not keep serving the previous one */
+	if (cache->disk_path)
+		cache_disk_invalidate(cache, txn->cache_hash);
+	/* Set a temporary validation date so that streams attached to this
+	 * entry during the fill compute a sane Age header. The actual one is
+	 * set at the end of this function. */
+	object->latest_validation = date.tv_sec;
 	/* We need to temporarily set a valid expiring time until the actual one
 	 * is set by the end of this function (in case of concurrent accesses to
 	 * the same resource). This way the second access will find an existing
@@ -1147,10 +1325,10 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	/* Insert the entry in the tree even if the payload is not cached yet. */
 	if (insert_entry(cache, object) != &object->eb) {
 		object->eb.key = 0;
-		shctx_unlock(shctx);
+		cache_wrunlock(cache);
 		goto out;
 	}
-	shctx_unlock(shctx);
+	cache_wrunlock(cache);
 
 	/* reserve space for the cache_entry structure */
 	first->len = sizeof(struct cache_entry);
@@ -1161,6 +1339,21 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	 * from cache-control directives or the expires header). */
 	effective_maxage = http_calc_maxage(s, cconf->c.cache, &true_maxage);
 
+	/* Keep the stale serving windows granted by the origin (RFC 5861) so
+	 * that the entry may be served stale while being revalidated in the
+	 * background, or when no server is usable. */
+	ctx.blk = NULL;
+	while (http_find_header(htx, ist("cache-control"), &ctx, 0)) {
+		long stale;
+
+		stale = parse_cc_numeric(ctx.value, "stale-while-revalidate", 22);
+		if (stale >= 0)
+			object->stale_swr = stale;
+		stale = parse_cc_numeric(ctx.value, "stale-if-error", 14);
+		if (stale >= 0)
+			object->stale_sie = stale;
+	}
+
 	ctx.blk = NULL;
 	if (http_find_header(htx, ist("Age"), &ctx, 0)) {
 		long long hdr_age;
@@ -1221,12 +1414,17 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 		if (set_secondary_key_encoding(htx, object->secondary_key))
 		    goto out;
 
+	/* The write lock must be taken before the shctx one because the row
+	 * reservation might evict other entries from the tree. */
+	cache_wrlock(cache);
 	shctx_lock(shctx);
 	if (!shctx_row_reserve_hot(shctx, first, trash.data)) {
 		shctx_unlock(shctx);
+		cache_wrunlock(cache);
 		goto out;
 	}
 	shctx_unlock(shctx);
+	cache_wrunlock(cache);
 
 	/* cache the headers in a http action because it allows to chose what
 	 * to cache, for example you might want to cache a response before
@@ -1238,6 +1436,11 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	if (shctx_row_data_append(shctx, first, NULL, (unsigned char *)trash.area, trash.data) < 0)
 		goto out;
 
+	/* The headers are committed, readers attached to this entry can start
+	 * forwarding them. */
+	HA_ATOMIC_STORE(&object->committed, first->len - sizeof(*object));
+	cache_wakeup_waiters(object);
+
 	/* register the buffer in the filter ctx for filling it with data*/
 	if (cache_ctx) {
 		cache_ctx->first_block = first;
@@ -1250,13 +1453,16 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 out:
 	/* if does not cache */
 	if (first) {
-		shctx_lock(shctx);
+		cache_wrlock(cache);
 		first->len = 0;
 		if (object->eb.key)
 			delete_entry(object);
 		object->eb.key = 0;
+		cache_wrunlock(cache);
+		shctx_lock(shctx);
 		shctx_row_dec_hot(shctx, first);
 		shctx_unlock(shctx);
+		cache_wakeup_waiters(object);
 	}
 
 	return ACT_RET_CONT;
@@ -1276,11 +1482,36 @@ static void http_cache_applet_release(struct appctx *appctx)
 	struct cache *cache = cconf->c.cache;
 	struct shared_block *first = block_ptr(cache_ptr);
 
+	MT_LIST_DELETE(&ctx->wait_entry);
+
 	shctx_lock(shctx_ptr(cache));
 	shctx_row_dec_hot(shctx_ptr(cache), first);
 	shctx_unlock(shctx_ptr(cache));
 }
 
+/* Subscribe the applet to <object>'s waiters list, so that the stream filling
+ * the entry wakes it up once more data is committed. The entry's state is
+ * re-checked after the subscription to close the race with a writer that
+ * would have progressed (or aborted) before the subscription was visible.
+ * Returns 1 if the applet may safely wait, 0 if the state changed in between
+ * and the caller must process the entry again.
+ */
+static int cache_applet_wait_data(struct appctx *appctx, struct cache_entry *object)
+{
+	struct cache_appctx *ctx = appctx->svcctx;
+
+	if (!MT_LIST_INLIST(&ctx->wait_entry))
+		MT_LIST_APPEND(&object->waiters, &ctx->wait_entry);
+
+	if (HA_ATOMIC_LOAD(&object->committed) != ctx->sent ||
+	    HA_ATOMIC_LOAD(&object->complete) || !HA_ATOMIC_LOAD(&object->eb.key)) {
+		MT_LIST_DELETE(&ctx->wait_entry);
+		return 0;
+	}
+	applet_have_no_more_data(appctx);
+	return 1;
+}
+
 
 static unsigned int htx_cache_dump_blk(struct appctx *appctx, struct htx *htx, enum htx_blk_type type,
 				       uint32_t info, struct shared_block *shblk, unsigned int offset)
@@ -1454,7 +1685,6 @@ static void http_cache_io_handler(struct appctx *appctx)
 {
 	struct cache_appctx *ctx = appctx->svcctx;
 	struct cache_entry *cache_ptr = ctx->entry;
-	struct shared_block *first = block_ptr(cache_ptr);
 	struct stconn *sc = appctx_sc(appctx);
 	struct channel *req = sc_oc(sc);
 	struct channel *res = sc_ic(sc);
@@ -1487,8 +1717,22 @@ static void http_cache_io_handler(struct appctx *appctx)
 	}
 
 	if (appctx->st0 == HTX_CACHE_HEADER) {
+		len = HA_ATOMIC_LOAD(&cache_ptr->committed) - ctx->sent;
+		if (!len) {
+			/* The entry is still being filled and its headers were
+			 * not committed yet: wait for the storing stream to
+			 * wake us up, unless the fill was aborted in between.
+			 */
+			if (HA_ATOMIC_LOAD(&cache_ptr->complete) ||
+			    !HA_ATOMIC_LOAD(&cache_ptr->eb.key))
+				goto error;
+			if (cache_applet_wait_data(appctx, cache_ptr))
+				goto out;
+			len = HA_ATOMIC_LOAD(&cache_ptr->committed) - ctx->sent;
+			if (!len)
+				goto error;
+		}
 		/* Headers must be dump at once. Otherwise it is an error */
-		len = first->len - sizeof(*cache_ptr) - ctx->sent;
 		ret = htx_cache_dump_msg(appctx, res_htx, len, HTX_BLK_EOH);
 		if (!ret || (htx_get_tail_type(res_htx) != HTX_BLK_EOH) ||
 		    !htx_cache_add_age_hdr(appctx, res_htx))
@@ -1512,13 +1756,32 @@ static void http_cache_io_handler(struct appctx *appctx)
 	}
 
 	if (appctx->st0 == HTX_CACHE_DATA) {
-		len = first->len - sizeof(*cache_ptr) - ctx->sent;
-		if (len) {
-			ret = htx_cache_dump_msg(appctx, res_htx, len, HTX_BLK_UNUSED);
-			if (ret < len) {
-				sc_need_room(sc);
-				goto out;
+		while (1) {
+			int complete = HA_ATOMIC_LOAD(&cache_ptr->complete);
+
+			/* <complete> is loaded before <committed> so that a
+			 * complete entry is never left before its last bytes
+			 * were forwarded. */
+			len = HA_ATOMIC_LOAD(&cache_ptr->committed) - ctx->sent;
+			if (len) {
+				ret = htx_cache_dump_msg(appctx, res_htx, len, HTX_BLK_UNUSED);
+				if (ret < len) {
+					sc_need_room(sc);
+					goto out;
+				}
+			}
+			if (complete)
+				break;
+			if (!HA_ATOMIC_LOAD(&cache_ptr->eb.key)) {
+				/* The fill was aborted: truncate the response
+				 * so that the client does not mistake the
+				 * partial object for a whole one. */
+				se_fl_set(appctx->sedesc, SE_FL_ERROR);
+				appctx->st0 = HTX_CACHE_END;
+				goto end;
 			}
+			if (cache_applet_wait_data(appctx, cache_ptr))
+				goto out;
 		}
 		appctx->st0 = HTX_CACHE_EOM;
 	}
@@ -1565,169 +1828,548 @@ static void http_cache_io_handler(struct appctx *appctx)
 }
 
 
-static int parse_cache_rule(struct proxy *proxy, const char *name, struct act_rule *rule, char **err)
-{
-	struct flt_conf *fconf;
-	struct cache_flt_conf *cconf = NULL;
+/*
+ * Second-tier disk cache.
+ *
+ * Frequently hit objects of the memory cache may be copied to a directory so
+ * that they survive their eviction from the shared memory. An object becomes
+ * eligible once it was served <disk_min_hits> times from memory; it is then
+ * dumped into one flat file named after its primary hash, holding a small
+ * fixed header followed by the very same serialized HTX stream as the shared
+ * memory rows, so that both tiers are replayed by the same logic. Objects
+ * with a Vary signature are never admitted as their secondary key depends on
+ * the stored response. Reads and writes use plain blocking syscalls like the
+ * file serving applet does: the accesses are page-cache friendly and bounded
+ * by max-object-size.
+ */
 
-	if (!*name || strcmp(name, "if") == 0 || strcmp(name, "unless") == 0) {
-		memprintf(err, "expects a cache name");
-		goto err;
-	}
+#define CACHE_DISK_MAGIC 0x48434431  /* "HCD1", bumped on layout changes */
 
-	/* check if a cache filter was already registered with this cache
-	 * name, if that's the case, must use it. */
-	list_for_each_entry(fconf, &proxy->filter_configs, list) {
-		if (fconf->id == cache_store_flt_id) {
-			cconf = fconf->conf;
-			if (cconf && strcmp((char *)cconf->c.name, name) == 0) {
-				rule->arg.act.p[0] = cconf;
-				return 1;
-			}
-		}
-	}
+/* on-disk header preceding the serialized message */
+struct cache_disk_hdr {
+	unsigned int magic;             /* CACHE_DISK_MAGIC */
+	unsigned int expire;            /* expiration date (wall clock time) */
+	unsigned int latest_validation; /* latest validation date */
+	unsigned int age;               /* Origin server "Age" header value */
+	unsigned int data_len;          /* length of the serialized message */
+};
 
-	/* Create the filter cache config  */
-	cconf = calloc(1, sizeof(*cconf));
-	if (!cconf) {
-		memprintf(err, "out of memory\n");
-		goto err;
-	}
-	cconf->flags = CACHE_FLT_F_IMPLICIT_DECL;
-	cconf->c.name = strdup(name);
-	if (!cconf->c.name) {
-		memprintf(err, "out of memory\n");
-		goto err;
-	}
+/* the appctx context of a disk cache applet, stored in appctx->svcctx */
+struct cache_disk_appctx {
+	int fd;                  /* read-only descriptor on the cached file */
+	unsigned int offset;     /* current read offset in the file */
+	unsigned int end;        /* file offset of the end of the message */
+	unsigned int rem_data;   /* remaining bytes for the current DATA block */
+	unsigned int age;        /* value of the Age header to be sent */
+};
 
-	/* register a filter to fill the cache buffer */
-	fconf = calloc(1, sizeof(*fconf));
-	if (!fconf) {
-		memprintf(err, "out of memory\n");
-		goto err;
-	}
-	fconf->id = cache_store_flt_id;
-	fconf->conf = cconf;
-	fconf->ops  = &cache_ops;
-	LIST_APPEND(&proxy->filter_configs, &fconf->list);
+/* Builds in <path> (of size <size>) the name of the file storing hash <hash>
+ * in <cache>'s disk tier. Returns 0 if the path does not fit.
+ */
+static int cache_disk_path(struct cache *cache, const char *hash, char *path, size_t size)
+{
+	int i, ret;
 
-	rule->arg.act.p[0] = cconf;
+	ret = snprintf(path, size, "%s/", cache->disk_path);
+	if (ret < 0 || ret + 41 > size)
+		return 0;
+	for (i = 0; i < 20; i++)
+		ret += snprintf(path + ret, size - ret, "%02x", (unsigned char)hash[i]);
 	return 1;
-
-  err:
-	free(cconf);
-	return 0;
 }
 
-enum act_parse_ret parse_cache_store(const char **args, int *orig_arg, struct proxy *proxy,
-                                          struct act_rule *rule, char **err)
+/* Removes the disk copy of the object of hash <hash>, if any. Used when a new
+ * version of the object is stored in memory, so that the disk tier never
+ * serves an outdated version.
+ */
+static void cache_disk_invalidate(struct cache *cache, const char *hash)
 {
-	rule->action       = ACT_CUSTOM;
-	rule->action_ptr   = http_action_store_cache;
+	char path[PATH_MAX];
 
-	if (!parse_cache_rule(proxy, args[*orig_arg], rule, err))
-		return ACT_RET_PRS_ERR;
-
-	(*orig_arg)++;
-	return ACT_RET_PRS_OK;
+	if (cache_disk_path(cache, hash, path, sizeof(path)))
+		unlink(path);
 }
 
-/* This produces a sha1 hash of the concatenation of the HTTP method,
- * the first occurrence of the Host header followed by the path component
- * if it begins with a slash ('/'). */
-int sha1_hosturi(struct stream *s)
+/* Dumps the complete entry <object> of <cache> into the disk tier. The entry
+ * must be hot so that its rows cannot be evicted while they are read. The
+ * file is built under a temporary name and renamed once complete so that
+ * concurrent lookups never see a partial object. Errors are silently ignored:
+ * the disk tier is only an opportunistic copy.
+ */
+static void cache_disk_store(struct cache *cache, struct cache_entry *object)
 {
-	struct http_txn *txn = s->txn;
-	struct htx *htx = htxbuf(&s->req.buf);
-	struct htx_sl *sl;
-	struct http_hdr_ctx ctx;
-	struct ist uri;
-	blk_SHA_CTX sha1_ctx;
-	struct buffer *trash;
-
-	trash = get_trash_chunk();
-	ctx.blk = NULL;
+	struct shared_context *shctx = shctx_ptr(cache);
+	struct shared_block *shblk = block_ptr(object);
+	struct cache_disk_hdr hdr;
+	char path[PATH_MAX], tmppath[PATH_MAX];
+	unsigned int offset = sizeof(*object);
+	unsigned int len = HA_ATOMIC_LOAD(&object->committed);
+	int fd;
+
+	if (!cache_disk_path(cache, object->hash, path, sizeof(path)))
+		return;
+	if (snprintf(tmppath, sizeof(tmppath), "%s.%u.tmp", path, tid) >= sizeof(tmppath))
+		return;
+
+	fd = open(tmppath, O_WRONLY|O_CREAT|O_EXCL, 0600);
+	if (fd < 0)
+		return;
+
+	hdr.magic = CACHE_DISK_MAGIC;
+	hdr.expire = object->expire;
+	hdr.latest_validation = object->latest_validation;
+	hdr.age = object->age;
+	hdr.data_len = len;
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr))
+		goto err;
 
-	sl = http_get_stline(htx);
-	uri = htx_sl_req_uri(sl); // whole uri
-	if (!uri.len)
-		return 0;
+	while (len) {
+		unsigned int max = MIN(len, shctx->block_size - offset);
 
-	/* In HTTP/1, most URIs are seen in origin form ('/path/to/resource'),
-	 * unless haproxy is deployed in front of an outbound cache. In HTTP/2,
-	 * URIs are almost always sent in absolute form with their scheme. In
-	 * this case, the scheme is almost always "https". In order to support
-	 * sharing of cache objects between H1 and H2, we'll hash the absolute
-	 * URI whenever known, or prepend "https://" + the Host header for
-	 * relative URIs. The difference will only appear on absolute HTTP/1
-	 * requests sent to an origin server, which practically is never met in
-	 * the real world so we don't care about the ability to share the same
-	 * key here.URIs are normalized from the absolute URI to an origin form as
-	 * well.
-	 */
-	if (!(sl->flags & HTX_SL_F_HAS_AUTHORITY)) {
-		chunk_istcat(trash, ist("https://"));
-		if (!http_find_header(htx, ist("Host"), &ctx, 0))
-			return 0;
-		chunk_istcat(trash, ctx.value);
+		if (write(fd, (const char *)shblk->data + offset, max) != max)
+			goto err;
+		offset += max;
+		len    -= max;
+		if (len || offset == shctx->block_size) {
+			shblk = LIST_NEXT(&shblk->list, typeof(shblk), list);
+			offset = 0;
+		}
 	}
 
-	chunk_istcat(trash, uri);
-
-	/* hash everything */
-	blk_SHA1_Init(&sha1_ctx);
-	blk_SHA1_Update(&sha1_ctx, trash->area, trash->data);
-	blk_SHA1_Final((unsigned char *)txn->cache_hash, &sha1_ctx);
+	if (rename(tmppath, path) < 0)
+		goto err;
+	close(fd);
+	return;
 
-	return 1;
+  err:
+	close(fd);
+	unlink(tmppath);
 }
 
-/* Looks for "If-None-Match" headers in the request and compares their value
- * with the one that might have been stored in the cache_entry. If any of them
- * matches, a "304 Not Modified" response should be sent instead of the cached
- * data.
- * Although unlikely in a GET/HEAD request, the "If-None-Match: *" syntax is
- * valid and should receive a "304 Not Modified" response (RFC 7234#4.3.2).
- *
- * If no "If-None-Match" header was found, look for an "If-Modified-Since"
- * header and compare its value (date) to the one stored in the cache_entry.
- * If the request's date is later than the cached one, we also send a
- * "304 Not Modified" response (see RFCs 7232#3.3 and 7234#4.3.2).
- *
- * Returns 1 if "304 Not Modified" should be sent, 0 otherwise.
+/* Appends to <htx> the HTX blocks read from the file of the disk cache applet
+ * <appctx>, until the response buffer is full, the message ends or a block of
+ * type <mark> was processed. Works exactly like htx_cache_dump_msg() except
+ * that the serialized stream comes from a file instead of shared memory
+ * rows. Returns the number of bytes of the stored message processed, or -1 on
+ * unexpected end of file.
  */
-static int should_send_notmodified_response(struct cache *cache, struct htx *htx,
-                                            struct cache_entry *entry)
+static ssize_t htx_cache_disk_dump_msg(struct appctx *appctx, struct htx *htx,
+				       enum htx_blk_type mark)
 {
-	int retval = 0;
+	struct cache_disk_appctx *ctx = appctx->svcctx;
+	size_t total = 0;
 
-	struct http_hdr_ctx ctx = { .blk = NULL };
-	struct ist cache_entry_etag = IST_NULL;
-	struct buffer *etag_buffer = NULL;
-	int if_none_match_found = 0;
+	while (ctx->offset < ctx->end) {
+		enum htx_blk_type type;
+		struct htx_blk *blk;
+		uint32_t info, blksz;
+		unsigned int max, sz;
 
-	struct tm tm = {};
-	time_t if_modified_since = 0;
+		max = htx_get_max_blksz(htx,
+					channel_htx_recv_max(sc_ic(appctx_sc(appctx)), htx));
+		if (!max)
+			break;
 
-	/* If we find a "If-None-Match" header in the request, rebuild the
-	 * cache_entry's ETag in order to perform comparisons.
-	 * There could be multiple "if-none-match" header lines. */
-	while (http_find_header(htx, ist("if-none-match"), &ctx, 0)) {
-		if_none_match_found = 1;
+		if (ctx->rem_data) {
+			ssize_t ret;
 
-		/* A '*' matches everything. */
-		if (isteq(ctx.value, ist("*")) != 0) {
-			retval = 1;
-			break;
+			sz = MIN(ctx->rem_data, max);
+			if (sz > b_size(&trash))
+				sz = b_size(&trash);
+			ret = pread(ctx->fd, b_orig(&trash), sz, ctx->offset);
+			if (ret <= 0)
+				return -1;
+			sz = htx_add_data(htx, ist2(b_orig(&trash), ret));
+			if (!sz)
+				break;
+			ctx->offset   += sz;
+			ctx->rem_data -= sz;
+			total         += sz;
+			continue;
 		}
 
-		/* No need to rebuild an etag if none was stored in the cache. */
-		if (entry->etag_length == 0)
-			break;
+		/* Get info of the next HTX block */
+		if (pread(ctx->fd, (char *)&info, 4, ctx->offset) != 4)
+			return -1;
+		type = (info >> 28);
+		blksz = ((type == HTX_BLK_HDR || type == HTX_BLK_TLR)
+			 ? (info & 0xff) + ((info >> 8) & 0xfffff)
+			 : info & 0xfffffff);
+
+		if (type == HTX_BLK_DATA) {
+			/* DATA blocks may be split over several buffers */
+			ctx->offset   += 4;
+			ctx->rem_data  = blksz;
+			total         += 4;
+			continue;
+		}
 
-		/* Rebuild the stored ETag. */
-		if (etag_buffer == NULL) {
-			etag_buffer = get_trash_chunk();
+		if (blksz > max)
+			break;
+		blk = htx_add_blk(htx, type, blksz);
+		if (!blk)
+			break;
+		blk->info = info;
+		if (blksz &&
+		    pread(ctx->fd, htx_get_blk_ptr(htx, blk), blksz, ctx->offset + 4) != blksz)
+			return -1;
+		ctx->offset += 4 + blksz;
+		total       += 4 + blksz;
+		if (type == mark)
+			break;
+	}
+
+	return total;
+}
+
+/* Adds the Age header to the response streamed from the disk tier */
+static int htx_cache_disk_add_age_hdr(struct appctx *appctx, struct htx *htx)
+{
+	struct cache_disk_appctx *ctx = appctx->svcctx;
+	char *end;
+
+	chunk_reset(&trash);
+	end = ultoa_o(ctx->age, b_head(&trash), b_size(&trash));
+	b_set_data(&trash, end - b_head(&trash));
+	if (!http_add_header(htx, ist("Age"), ist2(b_head(&trash), b_data(&trash))))
+		return 0;
+	return 1;
+}
+
+/* Streams a complete object from the disk tier. This is a stripped down
+ * version of http_cache_io_handler(): the file only holds complete objects,
+ * so there is no waiters machinery, and conditional requests are always
+ * answered with the full response.
+ */
+static void http_cache_disk_io_handler(struct appctx *appctx)
+{
+	struct cache_disk_appctx *ctx = appctx->svcctx;
+	struct stconn *sc = appctx_sc(appctx);
+	struct channel *req = sc_oc(sc);
+	struct channel *res = sc_ic(sc);
+	struct htx *req_htx, *res_htx;
+	struct buffer *errmsg;
+	ssize_t ret;
+	size_t total = 0;
+
+	res_htx = htx_from_buf(&res->buf);
+	total = res_htx->data;
+
+	if (unlikely(sc->state == SC_ST_DIS || sc->state == SC_ST_CLO))
+		goto out;
+
+	/* Check if the input buffer is available. */
+	if (!b_size(&res->buf)) {
+		sc_need_room(sc);
+		goto out;
+	}
+
+	if (res->flags & (CF_SHUTW|CF_SHUTR|CF_SHUTW_NOW))
+		appctx->st0 = HTX_CACHE_END;
+
+	if (appctx->st0 == HTX_CACHE_HEADER) {
+		/* Headers must be dumped at once. Otherwise it is an error */
+		ret = htx_cache_disk_dump_msg(appctx, res_htx, HTX_BLK_EOH);
+		if (ret <= 0 || (htx_get_tail_type(res_htx) != HTX_BLK_EOH) ||
+		    !htx_cache_disk_add_age_hdr(appctx, res_htx))
+			goto error;
+
+		/* Skip response body for HEAD requests */
+		if (__sc_strm(sc)->txn->meth == HTTP_METH_HEAD)
+			appctx->st0 = HTX_CACHE_EOM;
+		else
+			appctx->st0 = HTX_CACHE_DATA;
+	}
+
+	if (appctx->st0 == HTX_CACHE_DATA) {
+		ret = htx_cache_disk_dump_msg(appctx, res_htx, HTX_BLK_UNUSED);
+		if (ret < 0) {
+			/* truncated file: never let the client mistake the
+			 * partial object for a whole one */
+			se_fl_set(appctx->sedesc, SE_FL_ERROR);
+			appctx->st0 = HTX_CACHE_END;
+			goto end;
+		}
+		if (ctx->offset != ctx->end) {
+			sc_need_room(sc);
+			goto out;
+		}
+		appctx->st0 = HTX_CACHE_EOM;
+	}
+
+	if (appctx->st0 == HTX_CACHE_EOM) {
+		 /* no more data are expected. */
+		res_htx->flags |= HTX_FL_EOM;
+		res->flags |= CF_EOI;
+		se_fl_set(appctx->sedesc, SE_FL_EOI);
+		appctx->st0 = HTX_CACHE_END;
+	}
+
+  end:
+	if (!(res->flags & CF_SHUTR) && appctx->st0 == HTX_CACHE_END) {
+		res->flags |= CF_READ_EVENT;
+		sc_shutr(sc);
+	}
+
+  out:
+	total = res_htx->data - total;
+	if (total)
+		channel_add_input(res, total);
+	htx_to_buf(res_htx, &res->buf);
+
+	/* eat the whole request */
+	if (co_data(req)) {
+		req_htx = htx_from_buf(&req->buf);
+		co_htx_skip(req, req_htx, co_data(req));
+		htx_to_buf(req_htx, &req->buf);
+	}
+	return;
+
+  error:
+	/* Sent and HTTP error 500 */
+	b_reset(&res->buf);
+	errmsg = &http_err_chunks[HTTP_ERR_500];
+	res->buf.data = b_data(errmsg);
+	memcpy(res->buf.area, b_head(errmsg), b_data(errmsg));
+	res_htx = htx_from_buf(&res->buf);
+
+	total = 0;
+	appctx->st0 = HTX_CACHE_END;
+	goto end;
+}
+
+static void http_cache_disk_applet_release(struct appctx *appctx)
+{
+	struct cache_disk_appctx *ctx = appctx->svcctx;
+
+	if (ctx->fd >= 0)
+		close(ctx->fd);
+}
+
+struct applet http_cache_disk_applet = {
+	.obj_type = OBJ_TYPE_APPLET,
+	.name = "<CACHE-DISK>", /* used for logging */
+	.fct = http_cache_disk_io_handler,
+	.release = http_cache_disk_applet_release,
+};
+
+/* Looks up the request's hash in <cache>'s disk tier and attaches the disk
+ * cache applet to the stream on a hit. Expired or corrupted files are removed
+ * on the way. Returns 1 when the response will be served from disk, 0 to let
+ * the request go to the server.
+ */
+static int cache_disk_use(struct cache *cache, struct act_rule *rule,
+			  struct stream *s, struct proxy *px)
+{
+	struct cache_disk_appctx *ctx;
+	struct cache_disk_hdr hdr;
+	struct appctx *appctx;
+	char path[PATH_MAX];
+	unsigned int age;
+	int fd;
+
+	if (!cache_disk_path(cache, s->txn->cache_hash, path, sizeof(path)))
+		return 0;
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+
+	if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	    hdr.magic != CACHE_DISK_MAGIC || hdr.expire <= date.tv_sec) {
+		close(fd);
+		unlink(path);
+		return 0;
+	}
+
+	s->target = &http_cache_disk_applet.obj_type;
+	if (!(appctx = sc_applet_create(s->scb, objt_applet(s->target)))) {
+		s->target = NULL;
+		close(fd);
+		return 0;
+	}
+
+	ctx = applet_reserve_svcctx(appctx, sizeof(*ctx));
+	appctx->st0 = HTX_CACHE_HEADER;
+	appctx->rule = rule;
+	ctx->fd = fd;
+	ctx->offset = sizeof(hdr);
+	ctx->end = sizeof(hdr) + hdr.data_len;
+	ctx->rem_data = 0;
+	age = MAX(0, (int)(date.tv_sec - hdr.latest_validation)) + hdr.age;
+	if (unlikely(age > CACHE_ENTRY_MAX_AGE))
+		age = CACHE_ENTRY_MAX_AGE;
+	ctx->age = age;
+
+	if (px == strm_fe(s))
+		_HA_ATOMIC_INC(&px->fe_counters.p.http.cache_hits);
+	else
+		_HA_ATOMIC_INC(&px->be_counters.p.http.cache_hits);
+	return 1;
+}
+
+static int parse_cache_rule(struct proxy *proxy, const char *name, struct act_rule *rule, char **err)
+{
+	struct flt_conf *fconf;
+	struct cache_flt_conf *cconf = NULL;
+
+	if (!*name || strcmp(name, "if") == 0 || strcmp(name, "unless") == 0) {
+		memprintf(err, "expects a cache name");
+		goto err;
+	}
+
+	/* check if a cache filter was already registered with this cache
+	 * name, if that's the case, must use it. */
+	list_for_each_entry(fconf, &proxy->filter_configs, list) {
+		if (fconf->id == cache_store_flt_id) {
+			cconf = fconf->conf;
+			if (cconf && strcmp((char *)cconf->c.name, name) == 0) {
+				rule->arg.act.p[0] = cconf;
+				return 1;
+			}
+		}
+	}
+
+	/* Create the filter cache config  */
+	cconf = calloc(1, sizeof(*cconf));
+	if (!cconf) {
+		memprintf(err, "out of memory\n");
+		goto err;
+	}
+	cconf->flags = CACHE_FLT_F_IMPLICIT_DECL;
+	cconf->c.name = strdup(name);
+	if (!cconf->c.name) {
+		memprintf(err, "out of memory\n");
+		goto err;
+	}
+
+	/* register a filter to fill the cache buffer */
+	fconf = calloc(1, sizeof(*fconf));
+	if (!fconf) {
+		memprintf(err, "out of memory\n");
+		goto err;
+	}
+	fconf->id = cache_store_flt_id;
+	fconf->conf = cconf;
+	fconf->ops  = &cache_ops;
+	LIST_APPEND(&proxy->filter_configs, &fconf->list);
+
+	rule->arg.act.p[0] = cconf;
+	return 1;
+
+  err:
+	free(cconf);
+	return 0;
+}
+
+enum act_parse_ret parse_cache_store(const char **args, int *orig_arg, struct proxy *proxy,
+                                          struct act_rule *rule, char **err)
+{
+	rule->action       = ACT_CUSTOM;
+	rule->action_ptr   = http_action_store_cache;
+
+	if (!parse_cache_rule(proxy, args[*orig_arg], rule, err))
+		return ACT_RET_PRS_ERR;
+
+	(*orig_arg)++;
+	return ACT_RET_PRS_OK;
+}
+
+/* This produces a sha1 hash of the concatenation of the HTTP method,
+ * the first occurrence of the Host header followed by the path component
+ * if it begins with a slash ('/'). */
+int sha1_hosturi(struct stream *s)
+{
+	struct http_txn *txn = s->txn;
+	struct htx *htx = htxbuf(&s->req.buf);
+	struct htx_sl *sl;
+	struct http_hdr_ctx ctx;
+	struct ist uri;
+	blk_SHA_CTX sha1_ctx;
+	struct buffer *trash;
+
+	trash = get_trash_chunk();
+	ctx.blk = NULL;
+
+	sl = http_get_stline(htx);
+	uri = htx_sl_req_uri(sl); // whole uri
+	if (!uri.len)
+		return 0;
+
+	/* In HTTP/1, most URIs are seen in origin form ('/path/to/resource'),
+	 * unless haproxy is deployed in front of an outbound cache. In HTTP/2,
+	 * URIs are almost always sent in absolute form with their scheme. In
+	 * this case, the scheme is almost always "https". In order to support
+	 * sharing of cache objects between H1 and H2, we'll hash the absolute
+	 * URI whenever known, or prepend "https://" + the Host header for
+	 * relative URIs. The difference will only appear on absolute HTTP/1
+	 * requests sent to an origin server, which practically is never met in
+	 * the real world so we don't care about the ability to share the same
+	 * key here.URIs are normalized from the absolute URI to an origin form as
+	 * well.
+	 */
+	if (!(sl->flags & HTX_SL_F_HAS_AUTHORITY)) {
+		chunk_istcat(trash, ist("https://"));
+		if (!http_find_header(htx, ist("Host"), &ctx, 0))
+			return 0;
+		chunk_istcat(trash, ctx.value);
+	}
+
+	chunk_istcat(trash, uri);
+
+	/* hash everything */
+	blk_SHA1_Init(&sha1_ctx);
+	blk_SHA1_Update(&sha1_ctx, trash->area, trash->data);
+	blk_SHA1_Final((unsigned char *)txn->cache_hash, &sha1_ctx);
+
+	return 1;
+}
+
+/* Looks for "If-None-Match" headers in the request and compares their value
+ * with the one that might have been stored in the cache_entry. If any of them
+ * matches, a "304 Not Modified" response should be sent instead of the cached
+ * data.
+ * Although unlikely in a GET/HEAD request, the "If-None-Match: *" syntax is
+ * valid and should receive a "304 Not Modified" response (RFC 7234#4.3.2).
+ *
+ * If no "If-None-Match" header was found, look for an "If-Modified-Since"
+ * header and compare its value (date) to the one stored in the cache_entry.
+ * If the request's date is later than the cached one, we also send a
+ * "304 Not Modified" response (see RFCs 7232#3.3 and 7234#4.3.2).
+ *
+ * Returns 1 if "304 Not Modified" should be sent, 0 otherwise.
+ */
+static int should_send_notmodified_response(struct cache *cache, struct htx *htx,
+                                            struct cache_entry *entry)
+{
+	int retval = 0;
+
+	struct http_hdr_ctx ctx = { .blk = NULL };
+	struct ist cache_entry_etag = IST_NULL;
+	struct buffer *etag_buffer = NULL;
+	int if_none_match_found = 0;
+
+	struct tm tm = {};
+	time_t if_modified_since = 0;
+
+	/* If we find a "If-None-Match" header in the request, rebuild the
+	 * cache_entry's ETag in order to perform comparisons.
+	 * There could be multiple "if-none-match" header lines. */
+	while (http_find_header(htx, ist("if-none-match"), &ctx, 0)) {
+		if_none_match_found = 1;
+
+		/* A '*' matches everything. */
+		if (isteq(ctx.value, ist("*")) != 0) {
+			retval = 1;
+			break;
+		}
+
+		/* No need to rebuild an etag if none was stored in the cache. */
+		if (entry->etag_length == 0)
+			break;
+
+		/* Rebuild the stored ETag. */
+		if (etag_buffer == NULL) {
+			etag_buffer = get_trash_chunk();
 
 			if (shctx_row_data_get(shctx_ptr(cache), block_ptr(entry),
 					       (unsigned char*)b_orig(etag_buffer),
@@ -1766,6 +2408,497 @@ static int should_send_notmodified_response(struct cache *cache, struct htx *htx
 	return retval;
 }
 
+
+/*
+ * Background revalidation of stale entries (RFC 5861 stale-while-revalidate).
+ * When a stale entry is served within its stale-while-revalidate window, an
+ * httpclient request is issued towards one of the backend's servers, with an
+ * "If-None-Match" header when an ETag was stored. A "304 Not Modified"
+ * response refreshes the existing entry in place, a "200 OK" one is stored
+ * in a new row which atomically replaces the stale entry once complete.
+ */
+struct cache_reval {
+	struct cache *cache;             /* cache owning the entry being refreshed */
+	char hash[20];                   /* primary hash of the stale entry */
+	struct shared_block *first;      /* row receiving the fresh response, NULL until the headers are stored */
+	unsigned long long expected;     /* announced content-length of the fresh response */
+	unsigned long long received;     /* body bytes stored so far */
+	unsigned int maxage;             /* effective max-age of the fresh response */
+	unsigned int swr;                /* new stale-while-revalidate window */
+	unsigned int sie;                /* new stale-if-error window */
+	int aborted;                     /* the refresh must be abandoned */
+	int done;                        /* the entry was already refreshed in place (304) */
+};
+
+/* Get the value of header <name> from the httpclient's response headers array,
+ * or IST_NULL when absent.
+ */
+static struct ist cache_reval_hdr(struct http_hdr *hdrs, const char *name)
+{
+	struct http_hdr *hdr;
+
+	for (hdr = hdrs; hdr && isttest(hdr->n); hdr++) {
+		if (isteqi(hdr->n, ist(name)))
+			return hdr->v;
+	}
+	return IST_NULL;
+}
+
+/* Look for the numerical cache-control directive <word> in the full
+ * (comma-separated) header value <value>. Returns its argument or -1.
+ */
+static long cache_reval_cc_value(struct ist value, const char *word, int wlen)
+{
+	struct ist v = value, elt;
+	long ret;
+
+	while (istlen(v)) {
+		elt = istsplit(&v, ',');
+		while (istlen(elt) && HTTP_IS_SPHT(*istptr(elt)))
+			elt = istnext(elt);
+		ret = parse_cc_numeric(elt, word, wlen);
+		if (ret >= 0)
+			return ret;
+	}
+	return -1;
+}
+
+/* Return non-zero if boolean cache-control directive <word> is present in the
+ * full (comma-separated) header value <value>.
+ */
+static int cache_reval_cc_present(struct ist value, const char *word)
+{
+	struct ist v = value, elt;
+
+	while (istlen(v)) {
+		elt = istsplit(&v, ',');
+		while (istlen(elt) && HTTP_IS_SPHT(*istptr(elt)))
+			elt = istnext(elt);
+		while (istlen(elt) && HTTP_IS_SPHT(istptr(elt)[istlen(elt) - 1]))
+			elt.len--;
+		if (isteqi(elt, ist(word)))
+			return 1;
+	}
+	return 0;
+}
+
+/* Release the row being filled by a failed revalidation, if any. */
+static void cache_reval_release_row(struct cache_reval *rv)
+{
+	struct shared_context *shctx = shctx_ptr(rv->cache);
+
+	if (!rv->first)
+		return;
+	rv->first->len = 0;
+	shctx_lock(shctx);
+	shctx_row_dec_hot(shctx, rv->first);
+	shctx_unlock(shctx);
+	rv->first = NULL;
+}
+
+/* httpclient callback: response start line and headers were received. */
+static void cache_reval_res_headers(struct httpclient *hc)
+{
+	struct cache_reval *rv = hc->caller;
+	struct cache *cache;
+	struct shared_context *shctx;
+	struct buffer htx_buf = BUF_NULL, ser = BUF_NULL;
+	struct htx *htx;
+	struct htx_sl *sl;
+	struct http_hdr *hdr;
+	struct cache_entry *object;
+	struct shared_block *first;
+	struct ist value;
+	long long cl = 0;
+	long age = 0, maxage, stale;
+	int32_t pos;
+
+	if (!rv || rv->aborted || rv->done)
+		return;
+
+	cache = rv->cache;
+	shctx = shctx_ptr(cache);
+
+	/* freshness information of the revalidated response */
+	value = cache_reval_hdr(hc->res.hdrs, "cache-control");
+	if (isttest(value) &&
+	    (cache_reval_cc_present(value, "no-store") ||
+	     cache_reval_cc_present(value, "no-cache") ||
+	     cache_reval_cc_present(value, "private")))
+		goto abort;
+
+	maxage = isttest(value) ? cache_reval_cc_value(value, "s-maxage", 8) : -1;
+	if (maxage < 0 && isttest(value))
+		maxage = cache_reval_cc_value(value, "max-age", 7);
+	if (maxage < 0 || maxage > cache->maxage)
+		maxage = cache->maxage;
+	rv->maxage = maxage;
+
+	rv->swr = rv->sie = 0;
+	if (isttest(value)) {
+		stale = cache_reval_cc_value(value, "stale-while-revalidate", 22);
+		if (stale >= 0)
+			rv->swr = stale;
+		stale = cache_reval_cc_value(value, "stale-if-error", 14);
+		if (stale >= 0)
+			rv->sie = stale;
+	}
+
+	if (hc->res.status == 304) {
+		struct cache_entry *old;
+
+		/* The stored copy is still valid: refresh its dates in place */
+		cache_wrlock(cache);
+		old = entry_exist(cache, rv->hash, 0);
+		if (old && HA_ATOMIC_LOAD(&old->complete)) {
+			old->stale_swr = rv->swr;
+			old->stale_sie = rv->sie;
+			old->age = 0;
+			HA_ATOMIC_STORE(&old->latest_validation, (uint)date.tv_sec);
+			HA_ATOMIC_STORE(&old->expire, (uint)(date.tv_sec + rv->maxage));
+		}
+		cache_wrunlock(cache);
+		rv->done = 1;
+		return;
+	}
+
+	if (hc->res.status != 200)
+		goto abort;
+
+	/* The httpclient does not report truncated transfers, so only
+	 * responses with a content-length can safely be stored. */
+	value = cache_reval_hdr(hc->res.hdrs, "content-length");
+	if (!isttest(value) || strl2llrc(istptr(value), istlen(value), &cl) || cl < 0)
+		goto abort;
+	if (shctx->max_obj_size > 0 && (unsigned long long)cl > shctx->max_obj_size)
+		goto abort;
+	rv->expected = cl;
+
+	/* Vary responses cannot be rebuilt without the request's secondary key */
+	if (isttest(cache_reval_hdr(hc->res.hdrs, "vary")))
+		goto abort;
+
+	value = cache_reval_hdr(hc->res.hdrs, "age");
+	if (isttest(value)) {
+		long long hdr_age;
+
+		if (!strl2llrc(istptr(value), istlen(value), &hdr_age) && hdr_age > 0)
+			age = MIN(hdr_age, CACHE_ENTRY_MAX_AGE);
+		if (age > rv->maxage)
+			goto abort;
+	}
+
+	/* Rebuild the HTX message the regular store path would have seen, and
+	 * serialize it the same way ([blk info][blk payload] sequence). */
+	if (!b_alloc(&htx_buf) || !b_alloc(&ser))
+		goto abort;
+
+	htx = htx_from_buf(&htx_buf);
+	sl = htx_add_stline(htx, HTX_BLK_RES_SL,
+			    HTX_SL_F_IS_RESP | HTX_SL_F_VER_11 | HTX_SL_F_XFER_LEN | HTX_SL_F_CLEN,
+			    ist("HTTP/1.1"), ist("200"), hc->res.reason);
+	if (!sl)
+		goto abort;
+	sl->info.res.status = 200;
+
+	for (hdr = hc->res.hdrs; hdr && isttest(hdr->n); hdr++) {
+		/* hop-by-hop headers are not stored, neither is the Age header
+		 * which is regenerated from <latest_validation> when serving */
+		if (isteqi(hdr->n, ist("connection")) ||
+		    isteqi(hdr->n, ist("proxy-connection")) ||
+		    isteqi(hdr->n, ist("keep-alive")) ||
+		    isteqi(hdr->n, ist("transfer-encoding")) ||
+		    isteqi(hdr->n, ist("age")))
+			continue;
+		if (!htx_add_header(htx, hdr->n, hdr->v))
+			goto abort;
+	}
+	if (!htx_add_endof(htx, HTX_BLK_EOH))
+		goto abort;
+
+	/* reserve the row for the entry and its serialized headers */
+	cache_wrlock(cache);
+	shctx_lock(shctx);
+	first = shctx_row_reserve_hot(shctx, NULL, sizeof(struct cache_entry));
+	shctx_unlock(shctx);
+	cache_wrunlock(cache);
+	if (!first)
+		goto abort;
+	first->len = sizeof(struct cache_entry);
+	first->last_append = NULL;
+
+	object = (struct cache_entry *)first->data;
+	memset(object, 0, sizeof(*object));
+	MT_LIST_INIT(&object->waiters);
+	memcpy(object->hash, rv->hash, sizeof(object->hash));
+	object->age = age;
+	object->latest_validation = date.tv_sec;
+	object->last_modified = get_last_modified_time(htx);
+
+	for (pos = htx_get_first(htx); pos != -1; pos = htx_get_next(htx, pos)) {
+		struct htx_blk *blk = htx_get_blk(htx, pos);
+		enum htx_blk_type type = htx_get_blk_type(blk);
+		uint32_t sz = htx_get_blksz(blk);
+
+		chunk_memcat(&ser, (char *)&blk->info, sizeof(blk->info));
+		chunk_memcat(&ser, htx_get_blk_ptr(htx, blk), sz);
+
+		if (type == HTX_BLK_HDR) {
+			struct ist header_name = htx_get_blk_name(htx, blk);
+
+			if (isteq(header_name, ist("etag"))) {
+				object->etag_length = sz - istlen(header_name);
+				object->etag_offset = sizeof(struct cache_entry) + b_data(&ser) - sz + istlen(header_name);
+			}
+		}
+		if (type == HTX_BLK_EOH)
+			break;
+	}
+
+	rv->first = first;
+
+	cache_wrlock(cache);
+	shctx_lock(shctx);
+	first = shctx_row_reserve_hot(shctx, rv->first, b_data(&ser));
+	shctx_unlock(shctx);
+	cache_wrunlock(cache);
+	if (!first)
+		goto abort;
+
+	if (shctx_row_data_append(shctx, rv->first, NULL,
+				  (unsigned char *)b_head(&ser), b_data(&ser)) < 0)
+		goto abort;
+
+	b_free(&htx_buf);
+	b_free(&ser);
+	return;
+
+  abort:
+	b_free(&htx_buf);
+	b_free(&ser);
+	cache_reval_release_row(rv);
+	rv->aborted = 1;
+	hc->flags |= HTTPCLIENT_FA_STOP;
+}
+
+/* httpclient callback: a chunk of response body is available. */
+static void cache_reval_res_payload(struct httpclient *hc)
+{
+	struct cache_reval *rv = hc->caller;
+	struct cache *cache;
+	struct shared_context *shctx;
+	struct buffer *buf;
+	size_t len;
+
+	if (!rv)
+		return;
+	if (rv->aborted || rv->done || !rv->first) {
+		b_del(&hc->res.buf, b_data(&hc->res.buf));
+		return;
+	}
+
+	cache = rv->cache;
+	shctx = shctx_ptr(cache);
+	buf = get_trash_chunk();
+
+	while ((len = b_data(&hc->res.buf))) {
+		struct shared_block *fb;
+		uint32_t info;
+		size_t block = MIN(len, b_size(buf) - sizeof(info));
+
+		chunk_reset(buf);
+		info = (HTX_BLK_DATA << 28) + block;
+		chunk_memcat(buf, (char *)&info, sizeof(info));
+		b_getblk(&hc->res.buf, b_tail(buf), block, 0);
+		buf->data += block;
+
+		cache_wrlock(cache);
+		shctx_lock(shctx);
+		fb = shctx_row_reserve_hot(shctx, rv->first, b_data(buf));
+		shctx_unlock(shctx);
+		cache_wrunlock(cache);
+		if (!fb)
+			goto abort;
+
+		if (shctx_row_data_append(shctx, rv->first, rv->first->last_append,
+					  (unsigned char *)b_head(buf), b_data(buf)) < 0)
+			goto abort;
+
+		rv->received += block;
+		b_del(&hc->res.buf, block);
+	}
+	return;
+
+  abort:
+	b_del(&hc->res.buf, b_data(&hc->res.buf));
+	cache_reval_release_row(rv);
+	rv->aborted = 1;
+	hc->flags |= HTTPCLIENT_FA_STOP;
+}
+
+/* httpclient callback: end of the transfer (called on errors too). The fresh
+ * entry replaces the stale one if the whole announced body was received.
+ */
+static void cache_reval_res_end(struct httpclient *hc)
+{
+	struct cache_reval *rv = hc->caller;
+	struct cache *cache;
+	struct shared_context *shctx;
+	struct cache_entry *object, *old;
+
+	if (!rv)
+		return;
+
+	cache = rv->cache;
+	shctx = shctx_ptr(cache);
+
+	if (!rv->aborted && !rv->done && rv->first && rv->received == rv->expected) {
+		object = (struct cache_entry *)rv->first->data;
+		object->committed = rv->first->len - sizeof(*object);
+		object->complete = 1;
+		object->stale_swr = rv->swr;
+		object->stale_sie = rv->sie;
+		object->expire = date.tv_sec + rv->maxage;
+		object->eb.key = read_u32(rv->hash);
+
+		cache_wrlock(cache);
+		old = entry_exist(cache, rv->hash, 0);
+		if (old && !HA_ATOMIC_LOAD(&old->complete)) {
+			/* a regular fill of the same object is in progress,
+			 * possibly with readers attached: keep it */
+			object->eb.key = 0;
+			cache_wrunlock(cache);
+			cache_reval_release_row(rv);
+		}
+		else {
+			if (old) {
+				delete_entry(old);
+				old->eb.key = 0;
+			}
+			if (insert_entry(cache, object) != &object->eb) {
+				object->eb.key = 0;
+				cache_wrunlock(cache);
+				cache_reval_release_row(rv);
+			}
+			else {
+				cache_wrunlock(cache);
+				shctx_lock(shctx);
+				shctx_row_dec_hot(shctx, rv->first);
+				shctx_unlock(shctx);
+				rv->first = NULL;
+			}
+		}
+	}
+	else
+		cache_reval_release_row(rv);
+
+	/* allow a later request to trigger a new revalidation if the stale
+	 * entry is still in place */
+	cache_wrlock(cache);
+	old = entry_exist(cache, rv->hash, 0);
+	if (old)
+		HA_ATOMIC_STORE(&old->refreshing, 0);
+	cache_wrunlock(cache);
+
+	free(rv);
+	hc->caller = NULL;
+}
+
+/* Trigger an asynchronous revalidation of stale entry <res> of <cache>, using
+ * the request channel of stream <s> to rebuild the original URL. Must be
+ * called under the cache's read lock, with <res>'s refreshing flag owned.
+ * Returns 1 on success, 0 on failure (the flag must then be released by the
+ * caller).
+ */
+static int cache_revalidation_start(struct cache *cache, struct cache_entry *res, struct stream *s)
+{
+	struct htx *htx = htxbuf(&s->req.buf);
+	struct http_hdr_ctx h = { .blk = NULL };
+	struct http_hdr hdrs[2] = { };
+	struct buffer *chk = get_trash_chunk();
+	struct buffer *etag = NULL;
+	struct cache_reval *rv = NULL;
+	struct httpclient *hc = NULL;
+	struct htx_sl *sl;
+	struct server *srv;
+	struct ist host = IST_NULL, uri;
+	char addr[INET6_ADDRSTRLEN];
+	char dst[INET6_ADDRSTRLEN + sizeof("[]:65535")];
+	int ret;
+
+	sl = http_get_stline(htx);
+	if (!sl)
+		return 0;
+	uri = htx_sl_req_uri(sl);
+	if (http_find_header(htx, ist("host"), &h, 1))
+		host = h.value;
+	if (!istlen(host) || !istlen(uri) || *istptr(uri) != '/')
+		return 0;
+
+	/* join the origin through one of the backend's usable servers */
+	for (srv = s->be->srv; srv; srv = srv->next) {
+		if (srv_currently_usable(srv) && srv->addr.ss_family)
+			break;
+	}
+	if (!srv)
+		return 0;
+
+	ret = addr_to_str(&srv->addr, addr, sizeof(addr));
+	if (ret <= 0)
+		return 0;
+	snprintf(dst, sizeof(dst), (ret == AF_INET6) ? "[%s]:%hu" : "%s:%hu",
+		 addr, srv->svc_port);
+
+	chunk_printf(chk, "%s://%.*s%.*s", srv->use_ssl ? "https" : "http",
+		     (int)istlen(host), istptr(host), (int)istlen(uri), istptr(uri));
+
+	rv = calloc(1, sizeof(*rv));
+	if (!rv)
+		return 0;
+	rv->cache = cache;
+	memcpy(rv->hash, res->hash, sizeof(rv->hash));
+
+	hc = httpclient_new(rv, HTTP_METH_GET, ist2(b_head(chk), b_data(chk)));
+	if (!hc)
+		goto err;
+
+	if (httpclient_set_dst(hc, dst) < 0)
+		goto err;
+	if (s->be->timeout.server)
+		httpclient_set_timeout(hc, s->be->timeout.server);
+
+	/* revalidate conditionally when an ETag was stored */
+	if (res->etag_length && res->etag_length <= b_size(&trash)) {
+		etag = get_trash_chunk();
+		if (shctx_row_data_get(shctx_ptr(cache), block_ptr(res),
+				       (unsigned char *)b_orig(etag),
+				       res->etag_offset, res->etag_length) == 0) {
+			hdrs[0].n = ist("if-none-match");
+			hdrs[0].v = ist2(b_orig(etag), res->etag_length);
+		}
+	}
+
+	hc->ops.res_headers = cache_reval_res_headers;
+	hc->ops.res_payload = cache_reval_res_payload;
+	hc->ops.res_end = cache_reval_res_end;
+	hc->flags |= HTTPCLIENT_FA_AUTOKILL;
+
+	if (httpclient_req_gen(hc, hc->req.url, HTTP_METH_GET,
+			       isttest(hdrs[0].n) ? hdrs : NULL, IST_NULL) != ERR_NONE)
+		goto err;
+
+	if (!httpclient_start(hc))
+		goto err;
+
+	return 1;
+
+  err:
+	if (hc)
+		httpclient_destroy(hc);
+	free(rv);
+	return 0;
+}
+
 enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *px,
                                          struct session *sess, struct stream *s, int flags)
 {
@@ -1800,12 +2933,45 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 	else
 		_HA_ATOMIC_INC(&px->be_counters.p.http.cache_lookups);
 
-	shctx_lock(shctx_ptr(cache));
-	res = entry_exist(cache, s->txn->cache_hash);
-	/* We must not use an entry that is not complete. */
-	if (res && res->complete) {
+	/* The lookup only needs the cache's read lock: the entries found
+	 * cannot be deleted nor evicted while we hold it, and the hot-list
+	 * updates are performed under the nested shctx lock. This way
+	 * concurrent cache hits can progress in parallel. */
+	cache_rdlock(cache);
+	res = entry_exist(cache, s->txn->cache_hash, 0);
+	/* An incomplete entry is still being filled by another stream: attach
+	 * to it anyway and stream it while it fills (request collapsing),
+	 * except for Vary entries whose actual secondary key is only known
+	 * once the origin's response headers came back. */
+	if (res && !HA_ATOMIC_LOAD(&res->complete) && res->secondary_key_signature)
+		res = NULL;
+	/* A stale entry may only be served within one of its RFC 5861 windows:
+	 * during stale-while-revalidate a background refresh is triggered, and
+	 * during stale-if-error it is only served when no server is usable. */
+	if (res && res->expire <= date.tv_sec) {
+		int stale_ok = 0;
+
+		if (!res->secondary_key_signature && HA_ATOMIC_LOAD(&res->complete)) {
+			if (res->expire + res->stale_swr > date.tv_sec) {
+				if (!HA_ATOMIC_XCHG(&res->refreshing, 1)) {
+					if (!cache_revalidation_start(cache, res, s))
+						HA_ATOMIC_STORE(&res->refreshing, 0);
+				}
+				stale_ok = 1;
+			}
+			else if (res->expire + res->stale_sie > date.tv_sec &&
+				 !s->be->lbprm.tot_weight) {
+				/* no usable server: better stale than an error */
+				stale_ok = 1;
+			}
+		}
+		if (!stale_ok)
+			res = NULL;
+	}
+	if (res) {
 		struct appctx *appctx;
 		entry_block = block_ptr(res);
+		shctx_lock(shctx_ptr(cache));
 		shctx_row_inc_hot(shctx_ptr(cache), entry_block);
 		shctx_unlock(shctx_ptr(cache));
 
@@ -1814,21 +2980,22 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 		 * to find the actual entry we want (if it exists). */
 		if (res->secondary_key_signature) {
 			if (!http_request_build_secondary_key(s, res->secondary_key_signature)) {
-				shctx_lock(shctx_ptr(cache));
 				sec_entry = secondary_entry_exist(cache, res,
-								 s->txn->cache_secondary_hash);
+								 s->txn->cache_secondary_hash, 0);
 				if (sec_entry && sec_entry != res) {
 					/* The wrong row was added to the hot list. */
+					shctx_lock(shctx_ptr(cache));
 					shctx_row_dec_hot(shctx_ptr(cache), entry_block);
 					entry_block = block_ptr(sec_entry);
 					shctx_row_inc_hot(shctx_ptr(cache), entry_block);
+					shctx_unlock(shctx_ptr(cache));
 				}
 				res = sec_entry;
-				shctx_unlock(shctx_ptr(cache));
 			}
 			else
 				res = NULL;
 		}
+		cache_rdunlock(cache);
 
 		/* We looked for a valid secondary entry and could not find one,
 		 * the request must be forwarded to the server. */
@@ -1845,16 +3012,30 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 
 			appctx->st0 = HTX_CACHE_INIT;
 			appctx->rule = rule;
+			ctx->appctx = appctx;
+			MT_LIST_INIT(&ctx->wait_entry);
 			ctx->entry = res;
 			ctx->next = NULL;
 			ctx->sent = 0;
-			ctx->send_notmodified =
+			/* The conditional request handling needs fields (ETag,
+			 * last-modified date) that are only valid once the
+			 * entry is complete. */
+			ctx->send_notmodified = HA_ATOMIC_LOAD(&res->complete) &&
                                 should_send_notmodified_response(cache, htxbuf(&s->req.buf), res);
 
 			if (px == strm_fe(s))
 				_HA_ATOMIC_INC(&px->fe_counters.p.http.cache_hits);
 			else
 				_HA_ATOMIC_INC(&px->be_counters.p.http.cache_hits);
+
+			/* admission to the disk tier: copy the object once it
+			 * proved hot enough. The entry is hot here so its rows
+			 * cannot be evicted while they are dumped.
+			 */
+			if (cache->disk_path && !res->secondary_key_signature &&
+			    HA_ATOMIC_LOAD(&res->complete) && res->expire > date.tv_sec &&
+			    HA_ATOMIC_ADD_FETCH(&res->hits, 1) == cache->disk_min_hits)
+				cache_disk_store(cache, res);
 			return ACT_RET_CONT;
 		} else {
 			s->target = NULL;
@@ -1864,9 +3045,15 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 			return ACT_RET_CONT;
 		}
 	}
-	shctx_unlock(shctx_ptr(cache));
+	else
+		cache_rdunlock(cache);
+
+	/* Memory miss: the object may still live in the disk tier, which only
+	 * holds complete non-Vary objects. */
+	if (cache->disk_path && cache_disk_use(cache, rule, s, px))
+		return ACT_RET_CONT;
 
-	/* Shared context does not need to be locked while we calculate the
+	/* The cache does not need to be locked while we calculate the
 	 * secondary hash. */
 	if (!res && cache->vary_processing_enabled) {
 		/* Build a complete secondary hash until the server response
@@ -1938,6 +3125,7 @@ int cfg_parse_cache(const char *file, int linenum, char **args, int kwm)
 			tmp_cache_config->maxblocks = 0;
 			tmp_cache_config->maxobjsz = 0;
 			tmp_cache_config->max_secondary_entries = DEFAULT_MAX_SECONDARY_ENTRY;
+			tmp_cache_config->disk_min_hits = 2;
 		}
 	} else if (strcmp(args[0], "total-max-size") == 0) {
 		unsigned long int maxsize;
@@ -2045,6 +3233,60 @@ int cfg_parse_cache(const char *file, int linenum, char **args, int kwm)
 			goto out;
 		}
 		tmp_cache_config->max_secondary_entries = max_sec_entries;
+	} else if (strcmp(args[0], "disk-path") == 0) {
+		struct stat st;
+
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		if (!*args[1]) {
+			ha_alert("parsing [%s:%d]: '%s' expects a directory as argument.\n",
+				 file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		if (stat(args[1], &st) < 0 || !S_ISDIR(st.st_mode)) {
+			ha_alert("parsing [%s:%d]: '%s': '%s' is not an accessible directory.\n",
+				 file, linenum, args[0], args[1]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		/* keep room for '/', the hex hash and a temporary suffix */
+		if (strlen(args[1]) > PATH_MAX - 64) {
+			ha_alert("parsing [%s:%d]: '%s': path too long.\n",
+				 file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		free(tmp_cache_config->disk_path);
+		tmp_cache_config->disk_path = strdup(args[1]);
+		if (!tmp_cache_config->disk_path) {
+			ha_alert("parsing [%s:%d]: out of memory.\n", file, linenum);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+	} else if (strcmp(args[0], "disk-min-hits") == 0) {
+		unsigned int min_hits;
+		char *err;
+
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		min_hits = strtoul(args[1], &err, 10);
+		if (err == args[1] || *err != '\0' || min_hits == 0) {
+			ha_warning("parsing [%s:%d]: disk-min-hits wrong value '%s'\n",
+				   file, linenum, args[1]);
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+		tmp_cache_config->disk_min_hits = min_hits;
 	}
 	else if (*args[0] != 0) {
 		ha_alert("parsing [%s:%d] : unknown keyword '%s' in 'cache' section\n", file, linenum, args[0]);
@@ -2122,6 +3364,7 @@ int post_check_cache()
 		memcpy(shctx->data, cache_config, sizeof(struct cache));
 		cache = (struct cache *)shctx->data;
 		cache->entries = EB_ROOT;
+		HA_RWLOCK_INIT(&cache->lock);
 		LIST_APPEND(&caches, &cache->list);
 		LIST_DELETE(&cache_config->list);
 		free(cache_config);
@@ -2281,6 +3524,26 @@ static int parse_encoding_value(struct ist encoding, unsigned int *encoding_valu
 }
 
 #define ACCEPT_ENCODING_MAX_ENTRIES 16
+
+/* Number of slots of the per-thread accept-encoding normalization cache.
+ * Must be a power of two. */
+#define ACCEPT_ENCODING_CACHE_SIZE 64
+
+/* Per-thread memoization of the accept-encoding normalization. User agents
+ * keep sending the same handful of accept-encoding values so the bitmap
+ * computed for a given raw value can be reused instead of re-tokenizing the
+ * header on every lookup. The table is direct-mapped and indexed by a hash
+ * of the raw (pre-normalization) header values, a zero hash marking a free
+ * slot. Being per-thread it needs no locking and collisions only cost a
+ * recomputation.
+ */
+struct accept_encoding_memo {
+	uint64_t hash;            /* XXH64 of the raw accept-encoding values */
+	uint32_t encoding_bitmap; /* corresponding normalized bitmap */
+};
+
+static THREAD_LOCAL struct accept_encoding_memo accept_encoding_cache[ACCEPT_ENCODING_CACHE_SIZE];
+
 /*
  * Build a bitmap of the accept-encoding header.
  *
@@ -2302,6 +3565,26 @@ static int accept_encoding_normalizer(struct htx *htx, struct ist hdr_name,
 	struct http_hdr_ctx ctx = { .blk = NULL };
 	unsigned int encoding_value;
 	unsigned int rejected_encoding;
+	struct accept_encoding_memo *memo;
+	uint64_t hash = 0;
+
+	/* Hash the raw values (before any in-place normalization) of all the
+	 * accept-encoding headers and look the result up in the per-thread
+	 * memoization table. Most requests carry one of a few common values so
+	 * this avoids re-parsing the header for every lookup. The hash chains
+	 * the successive header occurrences so that their order is covered.
+	 */
+	while (http_find_header(htx, hdr_name, &ctx, 0))
+		hash = XXH64(istptr(ctx.value), istlen(ctx.value), hash);
+
+	memo = &accept_encoding_cache[hash & (ACCEPT_ENCODING_CACHE_SIZE - 1)];
+	if (hash && memo->hash == hash) {
+		write_u32(buf, memo->encoding_bitmap);
+		*buf_len = sizeof(memo->encoding_bitmap);
+		return 0;
+	}
+
+	ctx.blk = NULL;
 
 	/* A user agent always accepts an unencoded value unless it explicitly
 	 * refuses it through an "identity;q=0" accept-encoding value. */
@@ -2358,6 +3641,12 @@ static int accept_encoding_normalizer(struct htx *htx, struct ist hdr_name,
 	if (count == ACCEPT_ENCODING_MAX_ENTRIES)
 		return -1;
 
+	/* Only memoize successfully parsed values. */
+	if (hash) {
+		memo->hash = hash;
+		memo->encoding_bitmap = encoding_bitmap;
+	}
+
 	write_u32(buf, encoding_bitmap);
 	*buf_len = sizeof(encoding_bitmap);
 
@@ -2366,6 +3655,7 @@ static int accept_encoding_normalizer(struct htx *htx, struct ist hdr_name,
 	return 0;
 }
 #undef ACCEPT_ENCODING_MAX_ENTRIES
+#undef ACCEPT_ENCODING_CACHE_SIZE
 
 /*
  * Normalizer used by default for the Referer header. It only
@@ -2618,10 +3908,10 @@ static int cli_io_handler_show_cache(struct appctx *appctx)
 
 		while (1) {
 
-			shctx_lock(shctx_ptr(cache));
+			cache_wrlock(cache);
 			node = eb32_lookup_ge(&cache->entries, next_key);
 			if (!node) {
-				shctx_unlock(shctx_ptr(cache));
+				cache_wrunlock(cache);
 				ctx->next_key = 0;
 				break;
 			}
@@ -2644,7 +3934,7 @@ static int cli_io_handler_show_cache(struct appctx *appctx)
 
 			ctx->next_key = next_key;
 
-			shctx_unlock(shctx_ptr(cache));
+			cache_wrunlock(cache);
 
 			if (applet_putchk(appctx, &trash) == -1)
 				return 0;
@@ -2657,6 +3947,67 @@ static int cli_io_handler_show_cache(struct appctx *appctx)
 }
 
 
+/* It reserves a struct shrink_cache_ctx for the local variables */
+static int cli_parse_cache_shrink(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	struct shrink_cache_ctx *ctx = applet_reserve_svcctx(appctx, sizeof(*ctx));
+	struct cache *cache;
+
+	if (!cli_has_level(appctx, ACCESS_LVL_ADMIN))
+		return 1;
+
+	if (!*args[2])
+		return cli_err(appctx, "'cache shrink' expects a cache name.\n");
+
+	list_for_each_entry(cache, &caches, list) {
+		if (strcmp(cache->id, args[2]) == 0) {
+			ctx->cache = cache;
+			return 0;
+		}
+	}
+
+	return cli_err(appctx, "No such cache.\n");
+}
+
+/* It uses a struct shrink_cache_ctx for the local variables */
+static int cli_io_handler_cache_shrink(struct appctx *appctx)
+{
+	struct shrink_cache_ctx *ctx = appctx->svcctx;
+	struct shared_context *shctx = shctx_ptr(ctx->cache);
+	int ret;
+
+	if (!ctx->done) {
+		/* evict and detach the objects which are not in use, by small
+		 * batches so that the cache remains usable in between. The
+		 * cache's write lock must be held before the shctx one since
+		 * the release callback removes entries from the tree.
+		 */
+		do {
+			cache_wrlock(ctx->cache);
+			shctx_lock(shctx);
+			ret = shctx_release_avail(shctx, CACHE_SHRINK_BATCH);
+			shctx_unlock(shctx);
+			cache_wrunlock(ctx->cache);
+			ctx->blocks += ret;
+		} while (ret);
+
+		/* coalesce the detached blocks and give their pages back to
+		 * the OS
+		 */
+		shctx_lock(shctx);
+		ctx->released = shctx_reclaim(shctx);
+		shctx_unlock(shctx);
+		ctx->done = 1;
+	}
+
+	chunk_printf(&trash, "%s: %u blocks dropped, %lu kB given back to the OS.\n",
+		     ctx->cache->id, ctx->blocks, (unsigned long)(ctx->released / 1024));
+	if (applet_putchk(appctx, &trash) == -1)
+		return 0;
+
+	return 1;
+}
+
 /*
  * boolean, returns true if response was built out of a cache entry.
  */
@@ -2713,6 +4064,7 @@ static struct flt_kw_list filter_kws = { "CACHE", { }, {
 INITCALL1(STG_REGISTER, flt_register_keywords, &filter_kws);
 
 static struct cli_kw_list cli_kws = {{},{
+	{ { "cache", "shrink", NULL }, "cache shrink <name>                      : evict unused objects and release their memory", cli_parse_cache_shrink, cli_io_handler_cache_shrink, NULL, NULL },
 	{ { "show", "cache", NULL }, "show cache                              : show cache status", cli_parse_show_cache, cli_io_handler_show_cache, NULL, NULL },
 	{{},}
 }};
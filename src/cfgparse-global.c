@@ -26,15 +26,19 @@
  * registered anywhere. They are used as suggestions for mistyped words.
  */
 static const char *common_kw_list[] = {
-	"global", "daemon", "master-worker", "noepoll", "nokqueue",
+	"global", "daemon", "master-worker", "noepoll", "nouring", "nokqueue",
 	"noevports", "nopoll", "busy-polling", "set-dumpable",
 	"insecure-fork-wanted", "insecure-setuid-wanted", "nosplice",
 	"nogetaddrinfo", "noreuseport", "quiet", "zero-warning",
 	"tune.runqueue-depth", "tune.maxpollevents", "tune.maxaccept",
-	"tune.recv_enough", "tune.buffers.limit",
+	"tune.overload.loop-time", "tune.overload.runqueue-depth",
+	"tune.overload.action",
+	"tune.recv_enough", "tune.buffers.huge-pages", "tune.buffers.limit",
 	"tune.buffers.reserve", "tune.bufsize", "tune.maxrewrite",
-	"tune.idletimer", "tune.rcvbuf.client", "tune.rcvbuf.server",
+	"tune.idletimer", "tune.idle-shrink",
+	"tune.rcvbuf.client", "tune.rcvbuf.server",
 	"tune.sndbuf.client", "tune.sndbuf.server", "tune.pipesize",
+	"tune.pipes.prewarm",
 	"tune.http.cookielen", "tune.http.logurilen", "tune.http.maxhdr",
 	"tune.comp.maxlevel", "tune.pattern.cache-size", "uid", "gid",
 	"external-check", "user", "group", "nbproc", "maxconn",
@@ -44,7 +48,7 @@ static const char *common_kw_list[] = {
 	"log-send-hostname", "server-state-base", "server-state-file",
 	"log-tag", "spread-checks", "max-spread-checks", "cpu-map", "setenv",
 	"presetenv", "unsetenv", "resetenv", "strict-limits", "localpeer",
-	"numa-cpu-mapping", "defaults", "listen", "frontend", "backend",
+	"numa-cpu-mapping", "l3-cpu-mapping", "numa-policy", "defaults", "listen", "frontend", "backend",
 	"peers", "resolvers", "cluster-secret", "no-quic",
 	NULL /* must be last */
 };
@@ -96,6 +100,11 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 			goto out;
 		global.tune.options &= ~GTUNE_USE_EPOLL;
 	}
+	else if (strcmp(args[0], "nouring") == 0) {
+		if (alertif_too_many_args(0, file, linenum, args, &err_code))
+			goto out;
+		global.tune.options &= ~GTUNE_USE_URING;
+	}
 	else if (strcmp(args[0], "nokqueue") == 0) {
 		if (alertif_too_many_args(0, file, linenum, args, &err_code))
 			goto out;
@@ -198,6 +207,51 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 		global.tune.runqueue_depth = atol(args[1]);
 
 	}
+	else if (strcmp(args[0], "tune.overload.loop-time") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (global.tune.overload_loop_time != 0) {
+			ha_alert("parsing [%s:%d] : '%s' already specified. Continuing.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT;
+			goto out;
+		}
+		if (*(args[1]) == 0) {
+			ha_alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.overload_loop_time = atol(args[1]);
+	}
+	else if (strcmp(args[0], "tune.overload.runqueue-depth") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (global.tune.overload_rq_depth != 0) {
+			ha_alert("parsing [%s:%d] : '%s' already specified. Continuing.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT;
+			goto out;
+		}
+		if (*(args[1]) == 0) {
+			ha_alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.overload_rq_depth = atol(args[1]);
+	}
+	else if (strcmp(args[0], "tune.overload.action") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (strcmp(args[1], "reject") == 0)
+			global.tune.overload_action = OVERLOAD_ACT_REJECT;
+		else if (strcmp(args[1], "fast-503") == 0)
+			global.tune.overload_action = OVERLOAD_ACT_FAST503;
+		else if (strcmp(args[1], "drain") == 0)
+			global.tune.overload_action = OVERLOAD_ACT_DRAIN;
+		else {
+			ha_alert("parsing [%s:%d] : '%s' expects 'reject', 'fast-503' or 'drain' but got '%s'.\n", file, linenum, args[0], args[1]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
 	else if (strcmp(args[0], "tune.maxpollevents") == 0) {
 		if (alertif_too_many_args(1, file, linenum, args, &err_code))
 			goto out;
@@ -267,6 +321,11 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 				global.tune.buf_limit = global.tune.reserved_bufs + 1;
 		}
 	}
+	else if (strcmp(args[0], "tune.buffers.huge-pages") == 0) {
+		if (alertif_too_many_args(0, file, linenum, args, &err_code))
+			goto out;
+		global.tune.options |= GTUNE_BUFS_HUGEPAGES;
+	}
 	else if (strcmp(args[0], "tune.buffers.reserve") == 0) {
 		if (alertif_too_many_args(1, file, linenum, args, &err_code))
 			goto out;
@@ -352,6 +411,39 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 		}
 		global.tune.idle_timer = idle;
 	}
+	else if (strcmp(args[0], "tune.idle-shrink") == 0) {
+		unsigned int shrink;
+		const char *res;
+
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (*(args[1]) == 0) {
+			ha_alert("parsing [%s:%d] : '%s' expects a timer value.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		res = parse_time_err(args[1], &shrink, TIME_UNIT_MS);
+		if (res == PARSE_TIME_OVER) {
+			ha_alert("parsing [%s:%d]: timer overflow in argument <%s> to <%s>.\n",
+			         file, linenum, args[1], args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		else if (res == PARSE_TIME_UNDER) {
+			ha_alert("parsing [%s:%d]: timer underflow in argument <%s> to <%s>, minimum non-null value is 1 ms.\n",
+			         file, linenum, args[1], args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		else if (res) {
+			ha_alert("parsing [%s:%d]: unexpected character '%c' in argument to <%s>.\n",
+			         file, linenum, *res, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.idle_shrink = shrink;
+	}
 	else if (strcmp(args[0], "tune.rcvbuf.client") == 0) {
 		if (alertif_too_many_args(1, file, linenum, args, &err_code))
 			goto out;
@@ -422,6 +514,21 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 		}
 		global.tune.pipesize = atol(args[1]);
 	}
+	else if (strcmp(args[0], "tune.pipes.prewarm") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (*(args[1]) == 0) {
+			ha_alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.pipes_prewarm = atol(args[1]);
+		if (global.tune.pipes_prewarm < 0) {
+			ha_alert("parsing [%s:%d] : '%s' expects a positive integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
 	else if (strcmp(args[0], "tune.http.cookielen") == 0) {
 		if (alertif_too_many_args(1, file, linenum, args, &err_code))
 			goto out;
@@ -1275,6 +1382,22 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 	else if (strcmp(args[0], "numa-cpu-mapping") == 0) {
 		global.numa_cpu_mapping = (kwm == KWM_NO) ? 0 : 1;
 	}
+	else if (strcmp(args[0], "l3-cpu-mapping") == 0) {
+		global.l3_cpu_mapping = (kwm == KWM_NO) ? 0 : 1;
+	}
+	else if (strcmp(args[0], "numa-policy") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (strcmp(args[1], "default") == 0)
+			global.numa_policy = NUMA_POLICY_DEFAULT;
+		else if (strcmp(args[1], "interleave") == 0)
+			global.numa_policy = NUMA_POLICY_INTERLEAVE;
+		else {
+			ha_alert("parsing [%s:%d] : '%s' expects either 'default' or 'interleave' but got '%s'.\n", file, linenum, args[0], args[1]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
 	else if (strcmp(args[0], "anonkey") == 0) {
 		long long tmp = 0;
 
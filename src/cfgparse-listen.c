@@ -2556,8 +2556,11 @@ stats_error_parsing:
 			else if (strcmp(args[2], "crc32") == 0) {
 				curproxy->lbprm.algo |= BE_LB_HFCN_CRC32;
 			}
+			else if (strcmp(args[2], "xxh3") == 0) {
+				curproxy->lbprm.algo |= BE_LB_HFCN_XXH3;
+			}
 			else {
-				ha_alert("parsing [%s:%d] : '%s' only supports 'sdbm', 'djb2', 'crc32', or 'wt6' hash functions.\n", file, linenum, args[0]);
+				ha_alert("parsing [%s:%d] : '%s' only supports 'sdbm', 'djb2', 'crc32', 'xxh3', or 'wt6' hash functions.\n", file, linenum, args[0]);
 				err_code |= ERR_ALERT | ERR_FATAL;
 				goto out;
 			}
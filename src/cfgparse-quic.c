@@ -70,6 +70,29 @@ static int cfg_parse_quic_tune_socket_owner(char **args, int section_type,
 	return 0;
 }
 
+/* parse "tune.quic.pacing", accepts "on" or "off" */
+static int cfg_parse_quic_tune_pacing(char **args, int section_type,
+                                      struct proxy *curpx,
+                                      const struct proxy *defpx,
+                                      const char *file, int line, char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0) {
+		global.tune.options |= GTUNE_QUIC_PACING;
+	}
+	else if (strcmp(args[1], "off") == 0) {
+		global.tune.options &= ~GTUNE_QUIC_PACING;
+	}
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+
+	return 0;
+}
+
 /* Must be used to parse tune.quic.* setting which requires a time
  * as value.
  * Return -1 on alert, or 0 if succeeded.
@@ -163,6 +186,7 @@ static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_GLOBAL, "tune.quic.frontend.max-streams-bidi", cfg_parse_quic_tune_setting },
 	{ CFG_GLOBAL, "tune.quic.frontend.max-idle-timeout", cfg_parse_quic_time },
 	{ CFG_GLOBAL, "tune.quic.max-frame-loss", cfg_parse_quic_tune_setting },
+	{ CFG_GLOBAL, "tune.quic.pacing", cfg_parse_quic_tune_pacing },
 	{ CFG_GLOBAL, "tune.quic.retry-threshold", cfg_parse_quic_tune_setting },
 	{ 0, NULL, NULL }
 }};
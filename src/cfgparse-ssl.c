@@ -316,6 +316,35 @@ static int ssl_parse_global_curves(char **args, int section_type, struct proxy *
 	return 0;
 }
 #endif
+/* parse "tune.ssl.cache-shards", accepts a power of two between 1 and
+ * SH_SSL_SESS_MAX_SHARDS.
+ * Returns <0 on alert, >0 on warning, 0 on success.
+ */
+static int ssl_parse_global_cache_shards(char **args, int section_type, struct proxy *curpx,
+                                         const struct proxy *defpx, const char *file, int line,
+                                         char **err)
+{
+	int shards;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (*(args[1]) == 0) {
+		memprintf(err, "'%s' expects an integer argument.", args[0]);
+		return -1;
+	}
+
+	shards = atoi(args[1]);
+	if (shards < 1 || shards > SH_SSL_SESS_MAX_SHARDS || (shards & (shards - 1))) {
+		memprintf(err, "'%s' expects a power of two between 1 and %d but got '%s'.",
+		          args[0], SH_SSL_SESS_MAX_SHARDS, args[1]);
+		return -1;
+	}
+
+	global_ssl.sess_cache_shards = shards;
+	return 0;
+}
+
 /* parse various global tune.ssl settings consisting in positive integers.
  * Returns <0 on alert, >0 on warning, 0 on success.
  */
@@ -333,6 +362,8 @@ static int ssl_parse_global_int(char **args, int section_type, struct proxy *cur
 		target = (int *)&global_ssl.hard_max_record;
 	else if (strcmp(args[0], "tune.ssl.ssl-ctx-cache-size") == 0)
 		target = &global_ssl.ctx_cache;
+	else if (strcmp(args[0], "tune.ssl.ssl-verify-cache-size") == 0)
+		target = &global_ssl.verify_cache;
 	else if (strcmp(args[0], "maxsslconn") == 0)
 		target = &global.maxsslconn;
 	else if (strcmp(args[0], "tune.ssl.capture-buffer-size") == 0)
@@ -432,6 +463,28 @@ static int ssl_parse_global_keylog(char **args, int section_type, struct proxy *
 }
 #endif
 
+/* parse "tune.ssl.lazy-ctx-prepare".
+ * Returns <0 on alert, 0 on success.
+ */
+static int ssl_parse_global_lazy_ctx_prepare(char **args, int section_type, struct proxy *curpx,
+                                             const struct proxy *defpx, const char *file, int line,
+                                             char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		global_ssl.lazy_ctx_prepare = 1;
+	else if (strcmp(args[1], "off") == 0)
+		global_ssl.lazy_ctx_prepare = 0;
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+
+	return 0;
+}
+
 /* parse "ssl.force-private-cache".
  * Returns <0 on alert, >0 on warning, 0 on success.
  */
@@ -1281,7 +1334,6 @@ static int bind_parse_tls_ticket_keys(char **args, int cur_arg, struct proxy *px
 	keys_ref->tls_ticket_enc_index = i < 0 ? 0 : i % TLS_TICKETS_NO;
 	keys_ref->unique_id = -1;
 	keys_ref->refcount = 1;
-	HA_RWLOCK_INIT(&keys_ref->lock);
 	conf->keys_ref = keys_ref;
 
 	LIST_INSERT(&tlskeys_reference, &keys_ref->list);
@@ -2058,6 +2110,7 @@ static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_GLOBAL, "ssl-provider-path",  ssl_parse_global_ssl_provider_path },
 #endif
 	{ CFG_GLOBAL, "ssl-skip-self-issued-ca", ssl_parse_skip_self_issued_ca },
+	{ CFG_GLOBAL, "tune.ssl.cache-shards", ssl_parse_global_cache_shards },
 	{ CFG_GLOBAL, "tune.ssl.cachesize", ssl_parse_global_int },
 #ifndef OPENSSL_NO_DH
 	{ CFG_GLOBAL, "tune.ssl.default-dh-param", ssl_parse_global_default_dh },
@@ -2067,9 +2120,11 @@ static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_GLOBAL, "tune.ssl.maxrecord", ssl_parse_global_int },
 	{ CFG_GLOBAL, "tune.ssl.hard-maxrecord", ssl_parse_global_int },
 	{ CFG_GLOBAL, "tune.ssl.ssl-ctx-cache-size", ssl_parse_global_int },
+	{ CFG_GLOBAL, "tune.ssl.ssl-verify-cache-size", ssl_parse_global_int },
 	{ CFG_GLOBAL, "tune.ssl.capture-cipherlist-size", ssl_parse_global_capture_buffer },
 	{ CFG_GLOBAL, "tune.ssl.capture-buffer-size", ssl_parse_global_capture_buffer },
 	{ CFG_GLOBAL, "tune.ssl.keylog", ssl_parse_global_keylog },
+	{ CFG_GLOBAL, "tune.ssl.lazy-ctx-prepare", ssl_parse_global_lazy_ctx_prepare },
 	{ CFG_GLOBAL, "ssl-default-bind-ciphers", ssl_parse_global_ciphers },
 	{ CFG_GLOBAL, "ssl-default-server-ciphers", ssl_parse_global_ciphers },
 #if defined(SSL_CTX_set1_curves_list)
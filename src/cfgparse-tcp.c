@@ -78,6 +78,15 @@ static int bind_parse_tfo(char **args, int cur_arg, struct proxy *px, struct bin
 }
 #endif
 
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+/* parse the "steer-by-cpu" bind keyword */
+static int bind_parse_steer_by_cpu(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
+{
+	conf->options |= BC_O_STEER_CPU;
+	return 0;
+}
+#endif
+
 #ifdef TCP_MAXSEG
 /* parse the "mss" bind keyword */
 static int bind_parse_mss(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
@@ -232,6 +241,9 @@ static struct bind_kw_list bind_kws = { "TCP", { }, {
 #ifdef TCP_USER_TIMEOUT
 	{ "tcp-ut",        bind_parse_tcp_ut,       1 }, /* set User Timeout on listening socket */
 #endif
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+	{ "steer-by-cpu",  bind_parse_steer_by_cpu, 0 }, /* steer reuseport shards by RX cpu */
+#endif
 #ifdef TCP_FASTOPEN
 	{ "tfo",           bind_parse_tfo,          0 }, /* enable TCP_FASTOPEN of listening socket */
 #endif
@@ -64,6 +64,7 @@
 #include <haproxy/lb_fwlc.h>
 #include <haproxy/lb_fwrr.h>
 #include <haproxy/lb_map.h>
+#include <haproxy/lb_p2c.h>
 #include <haproxy/listener.h>
 #include <haproxy/log.h>
 #include <haproxy/sink.h>
@@ -997,6 +998,30 @@ int cfg_parse_peers(const char *file, int linenum, char **args, int kwm)
 
 		nb_shards = curpeers->nb_shards;
 	}
+	else if (strcmp(args[0], "stripes") == 0) {
+		char *endptr;
+
+		if (!*args[1]) {
+			ha_alert("parsing [%s:%d] : '%s' : missing value\n", file, linenum, args[0]);
+			err_code |= ERR_FATAL;
+			goto out;
+		}
+
+		curpeers->nb_stripes = strtol(args[1], &endptr, 10);
+		if (*endptr != '\0') {
+			ha_alert("parsing [%s:%d] : '%s' : expects an integer argument, found '%s'\n",
+			         file, linenum, args[0], args[1]);
+			err_code |= ERR_FATAL;
+			goto out;
+		}
+
+		if (curpeers->nb_stripes < 1 || curpeers->nb_stripes > 64) {
+			ha_alert("parsing [%s:%d] : '%s' : expects an integer argument between 1 and 64\n",
+			         file, linenum, args[0]);
+			err_code |= ERR_FATAL;
+			goto out;
+		}
+	}
 	else if (strcmp(args[0], "table") == 0) {
 		struct stktable *t, *other;
 		char *id;
@@ -2436,11 +2461,12 @@ next_line:
 		    strcmp(args[0], "log") != 0 && strcmp(args[0], "busy-polling") != 0 &&
 		    strcmp(args[0], "set-dumpable") != 0 && strcmp(args[0], "strict-limits") != 0 &&
 		    strcmp(args[0], "insecure-fork-wanted") != 0 &&
-		    strcmp(args[0], "numa-cpu-mapping") != 0) {
+		    strcmp(args[0], "numa-cpu-mapping") != 0 &&
+		    strcmp(args[0], "l3-cpu-mapping") != 0) {
 			ha_alert("parsing [%s:%d]: negation/default currently "
 				 "supported only for options, log, busy-polling, "
-				 "set-dumpable, strict-limits, insecure-fork-wanted "
-				 "and numa-cpu-mapping.\n", file, linenum);
+				 "set-dumpable, strict-limits, insecure-fork-wanted, "
+				 "numa-cpu-mapping and l3-cpu-mapping.\n", file, linenum);
 			err_code |= ERR_ALERT | ERR_FATAL;
 			fatal++;
 		}
@@ -2685,6 +2711,159 @@ static int numa_detect_topology()
 	return ha_cpuset_count(&node_cpu_set);
 }
 
+/* Returns non-zero if the configuration contains any explicit cpu or thread
+ * placement (a "cpu-map" directive or a "thread-group" assignment), in which
+ * case automatic topology-based placement must not be attempted.
+ */
+static int cpu_placement_forced()
+{
+	int g, i;
+
+	for (g = 0; g < MAX_TGROUPS; g++) {
+		if (ha_tgroup_info[g].count)
+			return 1;
+		if (ha_cpuset_count(&cpu_map[g].proc) ||
+		    ha_cpuset_count(&cpu_map[g].proc_t1))
+			return 1;
+		for (i = 0; i < MAX_THREADS_PER_GROUP; i++)
+			if (ha_cpuset_count(&cpu_map[g].thread[i]))
+				return 1;
+	}
+	return 0;
+}
+
+/* Inspect the cpu cache topology of the machine on startup and try to arrange
+ * threads and thread groups so that each group exactly covers one L3 cache
+ * domain (e.g. one core complex on modern AMD processors, where a single
+ * socket exposes many small L3 domains that NUMA detection alone cannot see).
+ * Each thread of a group is bound to the whole set of cpus of its domain so
+ * that threads never migrate across L3 boundaries. The number of threads is
+ * set to the number of usable cpus when left automatic. Nothing is done when
+ * a single domain is found, when the topology cannot be read, or when it does
+ * not fit the thread group limits, so that the regular defaults apply.
+ *
+ * This function must not be called if one of these conditions is met :
+ * - "no l3-cpu-mapping" is specified in the configuration
+ * - a "thread-groups", "thread-group" or "cpu-map" directive is active
+ * - a restrictive affinity is already applied, for example via taskset
+ *
+ * Returns the number of thread groups set up, or 0 if nothing was done.
+ */
+static int cpu_detect_l3_topology()
+{
+	struct hap_cpuset domains[MAX_TGROUPS];
+	struct hap_cpuset base_cpus, active_cpus, remain, l3_set;
+	const char *parse_cpu_set_args[2];
+	char sysfs_path[PATH_MAX];
+	char *err = NULL;
+	int ndomains = 0;
+	int cpu, idx, ltid, d, t;
+
+	/* 1. only consider online cpus the process may run on */
+	if (read_file_to_trash(NUMA_DETECT_SYSTEM_SYSFS_PATH"/cpu/online"))
+		return 0;
+
+	parse_cpu_set_args[0] = trash.area;
+	parse_cpu_set_args[1] = "\0";
+	if (parse_cpu_set(parse_cpu_set_args, &active_cpus, 1, &err)) {
+		free(err);
+		return 0;
+	}
+
+	if (sched_getaffinity(getpid(), sizeof(base_cpus.cpuset), &base_cpus.cpuset) == -1)
+		return 0;
+
+	ha_cpuset_and(&base_cpus, &active_cpus);
+
+	/* 2. group the usable cpus by L3 domain, each cpu reporting the set
+	 * of cpus sharing its L3 cache in its cache/index<N>/shared_cpu_map
+	 * sysfs entry.
+	 */
+	ha_cpuset_assign(&remain, &base_cpus);
+	while ((cpu = ha_cpuset_ffs(&remain))) {
+		cpu--;
+		ha_cpuset_clr(&remain, cpu);
+
+		/* look up the cache index describing the L3 for this cpu */
+		for (idx = 0; ; idx++) {
+			snprintf(sysfs_path, PATH_MAX, "%s/cpu/cpu%d/cache/index%d/level",
+			         NUMA_DETECT_SYSTEM_SYSFS_PATH, cpu, idx);
+
+			/* no L3 described for this cpu (e.g. some VMs) */
+			if (idx >= 16 || read_file_to_trash(sysfs_path))
+				return 0;
+
+			if (atoi(trash.area) == 3)
+				break;
+		}
+
+		snprintf(sysfs_path, PATH_MAX, "%s/cpu/cpu%d/cache/index%d/shared_cpu_map",
+		         NUMA_DETECT_SYSTEM_SYSFS_PATH, cpu, idx);
+
+		if (read_file_to_trash(sysfs_path))
+			return 0;
+
+		parse_cpumap(trash.area, &l3_set);
+		ha_cpuset_and(&l3_set, &base_cpus);
+		if (!ha_cpuset_count(&l3_set))
+			return 0;
+
+		if (ndomains == MAX_TGROUPS ||
+		    ha_cpuset_count(&l3_set) > MAX_THREADS_PER_GROUP) {
+			ha_diag_warning("Too many L3 cache domains or too many CPUs per domain for the thread group limits, not realigning thread groups on the cache topology.\n");
+			return 0;
+		}
+
+		ha_cpuset_assign(&domains[ndomains], &l3_set);
+		ndomains++;
+
+		/* strip the whole domain from the cpus left to visit */
+		while ((t = ha_cpuset_ffs(&l3_set))) {
+			ha_cpuset_clr(&remain, t - 1);
+			ha_cpuset_clr(&l3_set, t - 1);
+		}
+	}
+
+	/* 3. a single domain needs no realignment, the defaults are fine */
+	if (ndomains <= 1)
+		return 0;
+
+	for (d = t = 0; d < ndomains; d++)
+		t += ha_cpuset_count(&domains[d]);
+
+	if (t > MAX_THREADS)
+		return 0;
+
+	if (global.nbthread && global.nbthread != t) {
+		ha_diag_warning("Found %d CPUs over %d L3 cache domains but nbthread is set to %d, not realigning thread groups on the cache topology. Use 'no l3-cpu-mapping' to silence this warning.\n",
+		                t, ndomains, global.nbthread);
+		return 0;
+	}
+
+	/* 4. assign one thread group per domain, and bind each thread to all
+	 * the cpus of its domain, exactly like an explicit "thread-group" plus
+	 * "cpu-map" would have done.
+	 */
+	global.nbthread = t;
+	global.nbtgroups = ndomains;
+
+	for (d = t = 0; d < ndomains; d++) {
+		ha_tgroup_info[d].base  = t;
+		ha_tgroup_info[d].count = ha_cpuset_count(&domains[d]);
+
+		for (ltid = 0; ltid < ha_tgroup_info[d].count; ltid++, t++) {
+			ha_thread_info[t].tgid = d + 1;
+			ha_thread_info[t].tg = &ha_tgroup_info[d];
+			ha_thread_info[t].tg_ctx = &ha_tgroup_ctx[d];
+			ha_cpuset_assign(&cpu_map[d].thread[ltid], &domains[d]);
+		}
+	}
+
+	ha_diag_warning("Detected %d L3 cache domains, automatically setting nbthread to %d with one thread group bound to each domain. Use 'no l3-cpu-mapping' to disable this.\n",
+	                ndomains, global.nbthread);
+	return ndomains;
+}
+
 #elif defined(__FreeBSD__)
 static int numa_detect_topology()
 {
@@ -2738,6 +2917,31 @@ static int numa_detect_topology()
 #endif
 #endif /* USE_THREAD && USE_CPU_AFFINITY */
 
+/* Returns non-zero if proxy <px> is a plain TCP relay: no tcp rule at any
+ * layer, no content switching, sticking nor filter, and no logging. Streams
+ * passing through such a proxy never use stream-level stick counters, which
+ * allows their setup to be lightened (see PR_FL_LIGHT_STREAM).
+ */
+static int proxy_is_plain_tcp(const struct proxy *px)
+{
+	return (px->mode == PR_MODE_TCP &&
+		LIST_ISEMPTY(&px->tcp_req.l4_rules) &&
+		LIST_ISEMPTY(&px->tcp_req.l5_rules) &&
+		LIST_ISEMPTY(&px->tcp_req.inspect_rules) &&
+		LIST_ISEMPTY(&px->tcp_rep.inspect_rules) &&
+		LIST_ISEMPTY(&px->switching_rules) &&
+		LIST_ISEMPTY(&px->server_rules) &&
+		LIST_ISEMPTY(&px->sticking_rules) &&
+		LIST_ISEMPTY(&px->storersp_rules) &&
+		LIST_ISEMPTY(&px->filter_configs) &&
+		LIST_ISEMPTY(&px->logsrvs) &&
+		(!px->defpx ||
+		 (LIST_ISEMPTY(&px->defpx->tcp_req.l4_rules) &&
+		  LIST_ISEMPTY(&px->defpx->tcp_req.l5_rules) &&
+		  LIST_ISEMPTY(&px->defpx->tcp_req.inspect_rules) &&
+		  LIST_ISEMPTY(&px->defpx->tcp_rep.inspect_rules))));
+}
+
 /*
  * Returns the error code, 0 if OK, or any combination of :
  *  - ERR_ABORT: must abort ASAP
@@ -2780,6 +2984,18 @@ int check_config_validity()
 	if (!global.tune.requri_len)
 		global.tune.requri_len = REQURI_LEN;
 
+#if defined(USE_THREAD) && defined(USE_CPU_AFFINITY) && defined(__linux__)
+	/* Before electing the default number of threads, try to arrange the
+	 * thread groups along the L3 cache topology (e.g. one group per core
+	 * complex on AMD EPYC) so that no group spans multiple L3 domains nor
+	 * shares one with another group. Only done when no explicit placement
+	 * was configured.
+	 */
+	if (global.l3_cpu_mapping && !global.nbtgroups &&
+	    !thread_cpu_mask_forced() && !cpu_placement_forced())
+		cpu_detect_l3_topology();
+#endif
+
 	if (!global.nbthread) {
 		/* nbthread not set, thus automatic. In this case, and only if
 		 * running on a single process, we enable the same number of
@@ -2976,6 +3192,11 @@ init_proxies_list_stage1:
 				if (shards > todo)
 					shards = todo;
 
+				/* make the effective count visible to the proto
+				 * layer (e.g. cpu steering needs it at bind time)
+				 */
+				bind_conf->settings.shards = shards;
+
 				shard = done = grp = bit = mask = 0;
 				new_li = li;
 
@@ -3561,7 +3782,8 @@ out_uri_auth_compat:
 			curproxy->conf.args.line = curproxy->conf.lfs_line;
 			err = NULL;
 			if (!parse_logformat_string(curproxy->conf.logformat_string, curproxy, &curproxy->logformat,
-			                            LOG_OPT_MANDATORY|LOG_OPT_MERGE_SPACES,
+			                            LOG_OPT_MANDATORY|LOG_OPT_MERGE_SPACES |
+			                            ((curproxy->options2 & PR_O2_BINLOG) ? LOG_OPT_BIN : 0),
 			                            SMP_VAL_FE_LOG_END, &err)) {
 				ha_alert("Parsing [%s:%d]: failed to parse log-format : %s.\n",
 					 curproxy->conf.lfs_file, curproxy->conf.lfs_line, err);
@@ -3584,7 +3806,7 @@ out_uri_auth_compat:
 					 curproxy->conf.lfs_file, curproxy->conf.lfs_line, err);
 				free(err);
 				cfgerr++;
-			} else if (!add_to_logformat_list(NULL, NULL, LF_SEPARATOR, &curproxy->logformat_sd, &err)) {
+			} else if (!add_to_logformat_list(NULL, NULL, LF_SEPARATOR, LOG_OPT_ESC, &curproxy->logformat_sd, &err)) {
 				ha_alert("Parsing [%s:%d]: failed to parse log-format-sd : %s.\n",
 					 curproxy->conf.lfs_file, curproxy->conf.lfs_line, err);
 				free(err);
@@ -3622,7 +3844,8 @@ out_uri_auth_compat:
 			curproxy->conf.args.line = curproxy->conf.elfs_line;
 			err = NULL;
 			if (!parse_logformat_string(curproxy->conf.error_logformat_string, curproxy, &curproxy->logformat_error,
-			                            LOG_OPT_MANDATORY|LOG_OPT_MERGE_SPACES,
+			                            LOG_OPT_MANDATORY|LOG_OPT_MERGE_SPACES |
+			                            ((curproxy->options2 & PR_O2_BINLOG) ? LOG_OPT_BIN : 0),
 			                            SMP_VAL_FE_LOG_END, &err)) {
 				ha_alert("Parsing [%s:%d]: failed to parse error-log-format : %s.\n",
 					 curproxy->conf.elfs_file, curproxy->conf.elfs_line, err);
@@ -3762,36 +3985,41 @@ out_uri_auth_compat:
 			curproxy->srv = next;
 		}
 
-		/* Check that no server name conflicts. This causes trouble in the stats.
-		 * We only emit a warning for the first conflict affecting each server,
-		 * in order to avoid combinatory explosion if all servers have the same
-		 * name. We do that only for servers which do not have an explicit ID,
-		 * because these IDs were made also for distinguishing them and we don't
-		 * want to annoy people who correctly manage them.
-		 */
-		for (newsrv = curproxy->srv; newsrv; newsrv = newsrv->next) {
-			struct server *other_srv;
-
-			if (newsrv->puid)
-				continue;
-
-			for (other_srv = curproxy->srv; other_srv && other_srv != newsrv; other_srv = other_srv->next) {
-				if (!other_srv->puid && strcmp(other_srv->id, newsrv->id) == 0) {
-					ha_alert("parsing [%s:%d] : %s '%s', another server named '%s' was already defined at line %d, please use distinct names.\n",
-						   newsrv->conf.file, newsrv->conf.line,
-						   proxy_type_str(curproxy), curproxy->id,
-						   newsrv->id, other_srv->conf.line);
-					cfgerr++;
-					break;
-				}
-			}
-		}
-
 		/* assign automatic UIDs to servers which don't have one yet */
 		next_id = 1;
 		newsrv = curproxy->srv;
 		while (newsrv != NULL) {
 			if (!newsrv->puid) {
+				struct ebpt_node *node;
+
+				/* Check that no server name conflicts. This causes
+				 * trouble in the stats. We only emit an alert for the
+				 * first conflict affecting each server, in order to
+				 * avoid combinatory explosion if all servers have the
+				 * same name. We do that only for servers which do not
+				 * have an explicit ID, because these IDs were made
+				 * also for distinguishing them and we don't want to
+				 * annoy people who correctly manage them. The name
+				 * tree only contains the servers seen before this
+				 * one, so only previous occurrences are reported.
+				 */
+				node = ebis_lookup(&curproxy->conf.used_server_name, newsrv->id);
+				while (node) {
+					struct server *other_srv = container_of(node, struct server, conf.name);
+
+					if (strcmp(other_srv->id, newsrv->id) != 0)
+						break;
+					if (!(other_srv->flags & SRV_F_FORCED_ID)) {
+						ha_alert("parsing [%s:%d] : %s '%s', another server named '%s' was already defined at line %d, please use distinct names.\n",
+							   newsrv->conf.file, newsrv->conf.line,
+							   proxy_type_str(curproxy), curproxy->id,
+							   newsrv->id, other_srv->conf.line);
+						cfgerr++;
+						break;
+					}
+					node = ebpt_next(node);
+				}
+
 				/* server ID not set, use automatic numbering with first
 				 * spare entry starting with next_svid.
 				 */
@@ -3888,6 +4116,9 @@ out_uri_auth_compat:
 			if ((curproxy->lbprm.algo & BE_LB_PARM) == BE_LB_CB_LC) {
 				curproxy->lbprm.algo |= BE_LB_LKUP_LCTREE | BE_LB_PROP_DYN;
 				fwlc_init_server_tree(curproxy);
+			} else if ((curproxy->lbprm.algo & BE_LB_PARM) == BE_LB_CB_P2C) {
+				curproxy->lbprm.algo |= BE_LB_LKUP_P2CMAP | BE_LB_PROP_DYN;
+				p2c_init_server_map(curproxy);
 			} else {
 				curproxy->lbprm.algo |= BE_LB_LKUP_FSTREE | BE_LB_PROP_DYN;
 				fas_init_server_tree(curproxy);
@@ -4058,6 +4289,17 @@ out_uri_auth_compat:
 				curproxy->fe_req_ana |= AN_REQ_FLT_START_FE | AN_REQ_FLT_XFER_DATA | AN_REQ_FLT_END;
 				curproxy->fe_rsp_ana |= AN_RES_FLT_START_FE | AN_RES_FLT_XFER_DATA | AN_RES_FLT_END;
 			}
+
+			/* A plain TCP frontend which can only reach plain TCP
+			 * backends will never use stream-level stick counters:
+			 * flag it so that stream setup can skip their
+			 * allocation. Without switching rules the only
+			 * reachable backend is the default one (or the proxy
+			 * itself for "listen" instances).
+			 */
+			if (proxy_is_plain_tcp(curproxy) &&
+			    (!curproxy->defbe.be || proxy_is_plain_tcp(curproxy->defbe.be)))
+				curproxy->flags |= PR_FL_LIGHT_STREAM;
 		}
 
 		if (curproxy->cap & PR_CAP_BE) {
@@ -4466,7 +4708,8 @@ init_proxies_list_stage2:
 						bind_conf->xprt->prepare_bind_conf(bind_conf) < 0)
 						cfgerr++;
 				}
-				if (!peers_init_sync(curpeers) || !peers_alloc_dcache(curpeers)) {
+				if (!peers_alloc_stripes(curpeers) ||
+				    !peers_init_sync(curpeers) || !peers_alloc_dcache(curpeers)) {
 					ha_alert("Peers section '%s': out of memory, giving up on peers.\n",
 						 curpeers->id);
 					cfgerr++;
@@ -64,6 +64,7 @@
 #include <haproxy/time.h>
 #include <haproxy/tools.h>
 #include <haproxy/trace.h>
+#include <haproxy/xxhash.h>
 #include <haproxy/vars.h>
 
 /* trace source and events */
@@ -992,7 +993,7 @@ int httpchk_build_status_header(struct server *s, struct buffer *buf)
 		      (s->cur_eweight * s->proxy->lbprm.wmult + s->proxy->lbprm.wdiv - 1) / s->proxy->lbprm.wdiv,
 		      (s->proxy->lbprm.tot_weight * s->proxy->lbprm.wmult + s->proxy->lbprm.wdiv - 1) / s->proxy->lbprm.wdiv,
 		      s->cur_sess, s->proxy->beconn - s->proxy->queue.length,
-		      s->queue.length);
+		      s->queue_length);
 
 	if ((s->cur_state == SRV_ST_STARTING) &&
 	    now.tv_sec < s->last_change + s->slowstart &&
@@ -1285,7 +1286,15 @@ struct task *process_chk_conn(struct task *t, void *context, unsigned int state)
 		rv = 0;
 		if (global.spread_checks > 0) {
 			rv = srv_getinter(check) * global.spread_checks / 100;
-			rv -= (int) (2 * rv * (statistical_prng() / 4294967295.0));
+			if (rv) {
+				/* Stable per-check offset in [-rv:+rv]. A hash of
+				 * the check pointer is used so that each check
+				 * keeps the same phase from one round to the
+				 * other: checks stay evenly spread over time
+				 * instead of randomly walking and clustering.
+				 */
+				rv = (int)(XXH32(&check, sizeof(check), 0) % (2 * rv + 1)) - rv;
+			}
 		}
 		t->expire = tick_add(now_ms, MS_TO_TICKS(srv_getinter(check) + rv));
 		/* reset fastinter flag (if set) so that srv_getinter()
@@ -16,19 +16,24 @@
 #include <string.h>
 
 #include <haproxy/api.h>
+#include <haproxy/cfgparse.h>
 #include <haproxy/chunk.h>
 #include <haproxy/global.h>
 #include <haproxy/tools.h>
 
-/* trash chunks used for various conversions */
-static THREAD_LOCAL struct buffer *trash_chunk;
-static THREAD_LOCAL struct buffer trash_chunk1;
-static THREAD_LOCAL struct buffer trash_chunk2;
+/* trash chunks used for various conversions, returned in round-robin order.
+ * At least 2 are needed so that it is always possible to iterate data
+ * transformations without losing the data being transformed; a deeper ring
+ * ("tune.trash-chunks") protects longer call chains against silent reuse.
+ */
+static int trash_ring_size __read_mostly = 2;
+static THREAD_LOCAL struct buffer *trash_ring;
+static THREAD_LOCAL char **trash_ring_area; /* base area of each ring entry */
+static THREAD_LOCAL int trash_ring_cur; /* #allocated ring entries */
+static THREAD_LOCAL int trash_ring_idx;
 
 /* trash buffers used for various conversions */
 static int trash_size __read_mostly;
-static THREAD_LOCAL char *trash_buf1;
-static THREAD_LOCAL char *trash_buf2;
 
 /* the trash pool for reentrant allocations */
 struct pool_head *pool_head_trash __read_mostly = NULL;
@@ -47,19 +52,17 @@ THREAD_LOCAL struct buffer trash = { };
 */
 struct buffer *get_trash_chunk(void)
 {
-	char *trash_buf;
-
-	if (trash_chunk == &trash_chunk1) {
-		trash_chunk = &trash_chunk2;
-		trash_buf = trash_buf2;
-	}
-	else {
-		trash_chunk = &trash_chunk1;
-		trash_buf = trash_buf1;
-	}
-	*trash_buf = 0;
-	chunk_init(trash_chunk, trash_buf, trash_size);
-	return trash_chunk;
+	struct buffer *chk;
+
+	if (++trash_ring_idx >= trash_ring_cur)
+		trash_ring_idx = 0;
+	chk = &trash_ring[trash_ring_idx];
+	/* re-arm the chunk from its base area: callers such as casts may have
+	 * advanced ->area / shrunk ->size on the chunk they were handed.
+	 */
+	chunk_init(chk, trash_ring_area[trash_ring_idx], trash_size);
+	*chk->area = 0;
+	return chk;
 }
 
 /* (re)allocates the trash buffers. Returns 0 in case of failure. It is
@@ -67,11 +70,41 @@ struct buffer *get_trash_chunk(void)
  */
 static int alloc_trash_buffers(int bufsize)
 {
+	int i;
+
 	chunk_init(&trash, my_realloc2(trash.area, bufsize), bufsize);
 	trash_size = bufsize;
-	trash_buf1 = (char *)my_realloc2(trash_buf1, bufsize);
-	trash_buf2 = (char *)my_realloc2(trash_buf2, bufsize);
-	return trash.area && trash_buf1 && trash_buf2;
+
+	if (trash_ring_cur != trash_ring_size) {
+		struct buffer *ring;
+		char **areas;
+
+		ring = my_realloc2(trash_ring, trash_ring_size * sizeof(*ring));
+		if (!ring)
+			return 0;
+		trash_ring = ring;
+
+		areas = my_realloc2(trash_ring_area, trash_ring_size * sizeof(*areas));
+		if (!areas)
+			return 0;
+		trash_ring_area = areas;
+
+		for (i = trash_ring_cur; i < trash_ring_size; i++) {
+			chunk_init(&trash_ring[i], NULL, 0);
+			trash_ring_area[i] = NULL;
+		}
+		trash_ring_cur = trash_ring_size;
+	}
+
+	for (i = 0; i < trash_ring_cur; i++) {
+		char *area = (char *)my_realloc2(trash_ring_area[i], bufsize);
+
+		if (!area)
+			return 0;
+		trash_ring_area[i] = area;
+		chunk_init(&trash_ring[i], area, bufsize);
+	}
+	return trash.area != NULL;
 }
 
 static int alloc_trash_buffers_per_thread()
@@ -81,9 +114,16 @@ static int alloc_trash_buffers_per_thread()
 
 static void free_trash_buffers_per_thread()
 {
+	int i;
+
 	chunk_destroy(&trash);
-	ha_free(&trash_buf2);
-	ha_free(&trash_buf1);
+	for (i = 0; i < trash_ring_cur; i++) {
+		free(trash_ring_area[i]);
+		chunk_init(&trash_ring[i], NULL, 0);
+	}
+	ha_free(&trash_ring);
+	ha_free(&trash_ring_area);
+	trash_ring_cur = 0;
 }
 
 /* Initialize the trash buffers. It returns 0 if an error occurred. */
@@ -287,6 +327,32 @@ int chunk_strcasecmp(const struct buffer *chk, const char *str)
 
 REGISTER_PER_THREAD_ALLOC(alloc_trash_buffers_per_thread);
 REGISTER_PER_THREAD_FREE(free_trash_buffers_per_thread);
+
+/* config parser for global "tune.trash-chunks" */
+static int cfg_parse_tune_trash_chunks(char **args, int section_type, struct proxy *curpx,
+                                       const struct proxy *defpx, const char *file, int line,
+                                       char **err)
+{
+	int size;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	size = atoi(args[1]);
+	if (size < 2 || size > 256) {
+		memprintf(err, "'%s' expects a number between 2 and 256.", args[0]);
+		return -1;
+	}
+	trash_ring_size = size;
+	return 0;
+}
+
+static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.trash-chunks", cfg_parse_tune_trash_chunks },
+	{ 0, NULL, NULL }
+}};
+
+INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
 REGISTER_POST_DEINIT(free_trash_buffers_per_thread);
 
 /*
@@ -434,3 +434,138 @@ char *timeofday_as_iso_us(int pad)
 	}
 	return iso_time_str;
 }
+
+/* Per-thread caches of broken-down and preformatted wall-clock dates. Log and
+ * header generation keep requesting the same second over and over, and libc's
+ * localtime_r()/gmtime_r() are expensive due to timezone handling, so both the
+ * conversion and the fixed text forms are only recomputed when the requested
+ * second differs from the cached one, and the sub-second part is patched into
+ * the cached text, following the same principle as timeofday_as_iso_us()
+ * above.
+ */
+static THREAD_LOCAL struct {
+	time_t sec;        /* the cached second, 0 if not set yet */
+	struct tm tm;      /* broken-down local time for <sec> */
+	char clf[28];      /* "dd/mmm/yyyy:HH:MM:SS.000" as in date2str_log() */
+	char tz[28];       /* "dd/mmm/yyyy:HH:MM:SS +0200" as in localdate2str_log() */
+} local_date_cache;
+
+static THREAD_LOCAL struct {
+	time_t sec;        /* the cached second, 0 if not set yet */
+	struct tm tm;      /* broken-down GMT time for <sec> */
+	char clf[28];      /* "dd/mmm/yyyy:HH:MM:SS +0000" as in gmt2str_log() */
+	char rfc7231[32];  /* "Day, dd Mon yyyy HH:MM:SS GMT" (RFC7231#7.1.1.1) */
+} gmt_date_cache;
+
+/* refreshes the thread-local local time cache for second <sec> */
+static void clock_refresh_local_cache(time_t sec)
+{
+	const struct timeval tv = { .tv_sec = sec, .tv_usec = 0 };
+
+	get_localtime(sec, &local_date_cache.tm);
+	date2str_log(local_date_cache.clf, &local_date_cache.tm, &tv, sizeof(local_date_cache.clf));
+	localdate2str_log(local_date_cache.tz, sec, &local_date_cache.tm, sizeof(local_date_cache.tz));
+	local_date_cache.sec = sec;
+}
+
+/* refreshes the thread-local GMT time cache for second <sec> */
+static void clock_refresh_gmt_cache(time_t sec)
+{
+	static const char dayname[7][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+	struct tm *tm = &gmt_date_cache.tm;
+
+	get_gmtime(sec, tm);
+	gmt2str_log(gmt_date_cache.clf, tm, sizeof(gmt_date_cache.clf));
+	snprintf(gmt_date_cache.rfc7231, sizeof(gmt_date_cache.rfc7231),
+	         "%s, %02d %s %04d %02d:%02d:%02d GMT",
+	         dayname[tm->tm_wday], tm->tm_mday, monthname[tm->tm_mon],
+	         tm->tm_year + 1900, tm->tm_hour, tm->tm_min, tm->tm_sec);
+	gmt_date_cache.sec = sec;
+}
+
+/* cached equivalent of get_localtime(): returns a pointer to the thread-local
+ * broken-down local time for second <t>, which is only recomputed when <t>
+ * differs from the previous call on this thread. The result must not be
+ * modified by the caller and remains valid until the next call.
+ */
+struct tm *get_localtime_cached(time_t t)
+{
+	if (unlikely(t != local_date_cache.sec || !t))
+		clock_refresh_local_cache(t);
+	return &local_date_cache.tm;
+}
+
+/* cached equivalent of get_gmtime(), see get_localtime_cached() above */
+struct tm *get_gmtime_cached(time_t t)
+{
+	if (unlikely(t != gmt_date_cache.sec || !t))
+		clock_refresh_gmt_cache(t);
+	return &gmt_date_cache.tm;
+}
+
+/* cached equivalent of date2str_log(): writes at <dst> the local date for
+ * <date> in the "dd/mmm/yyyy:HH:MM:SS.sss" format, reusing the text form
+ * cached for this second and only patching the milliseconds in. Returns a
+ * pointer to the last char written (\0) or NULL if there isn't enough space.
+ */
+char *date2str_log_cached(char *dst, const struct timeval *date, size_t size)
+{
+	if (size < 25) /* the size is fixed: 24 chars + \0 */
+		return NULL;
+
+	if (unlikely(date->tv_sec != local_date_cache.sec || !date->tv_sec))
+		clock_refresh_local_cache(date->tv_sec);
+
+	/* patch the milliseconds into the cached text form (utoa_pad puts the
+	 * trailing \0 back at position 24)
+	 */
+	utoa_pad((unsigned int)(date->tv_usec / 1000U) % 1000, local_date_cache.clf + 21, 4);
+	memcpy(dst, local_date_cache.clf, 25);
+	return dst + 24;
+}
+
+/* cached equivalent of gmt2str_log(): writes at <dst> the GMT date for second
+ * <t> in the "dd/mmm/yyyy:HH:MM:SS +0000" format from the thread-local cache.
+ * Returns a pointer to the last char written (\0) or NULL if there isn't
+ * enough space.
+ */
+char *gmt2str_log_cached(char *dst, time_t t, size_t size)
+{
+	if (size < 27) /* the size is fixed: 26 chars + \0 */
+		return NULL;
+
+	if (unlikely(t != gmt_date_cache.sec || !t))
+		clock_refresh_gmt_cache(t);
+
+	memcpy(dst, gmt_date_cache.clf, 27);
+	return dst + 26;
+}
+
+/* cached equivalent of localdate2str_log(): writes at <dst> the local date for
+ * second <t> in the "dd/mmm/yyyy:HH:MM:SS +0200" format (with the local
+ * timezone offset) from the thread-local cache. Returns a pointer to the last
+ * char written (\0) or NULL if there isn't enough space.
+ */
+char *localdate2str_log_cached(char *dst, time_t t, size_t size)
+{
+	if (size < 27) /* the size is fixed: 26 chars + \0 */
+		return NULL;
+
+	if (unlikely(t != local_date_cache.sec || !t))
+		clock_refresh_local_cache(t);
+
+	memcpy(dst, local_date_cache.tz, 27);
+	return dst + 26;
+}
+
+/* returns the RFC7231 date string ("Day, dd Mon yyyy HH:MM:SS GMT", always 29
+ * chars and zero-terminated) for second <t> from the thread-local cache. The
+ * result must not be modified and remains valid until the next call on this
+ * thread.
+ */
+const char *gmtdate2str_rfc7231_cached(time_t t)
+{
+	if (unlikely(t != gmt_date_cache.sec || !t))
+		clock_refresh_gmt_cache(t);
+	return gmt_date_cache.rfc7231;
+}
@@ -90,6 +90,16 @@ static int deflate_end(struct comp_ctx **comp_ctx);
 
 #endif /* USE_ZLIB */
 
+#if defined(USE_ZSTD)
+
+static int zstd_init(struct comp_ctx **comp_ctx, int level);
+static int zstd_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out);
+static int zstd_flush(struct comp_ctx *comp_ctx, struct buffer *out);
+static int zstd_finish(struct comp_ctx *comp_ctx, struct buffer *out);
+static int zstd_end(struct comp_ctx **comp_ctx);
+
+#endif /* USE_ZSTD */
+
 
 const struct comp_algo comp_algos[] =
 {
@@ -103,6 +113,9 @@ const struct comp_algo comp_algos[] =
 	{ "raw-deflate", 11, "deflate",  7, raw_def_init,  deflate_add_data,  deflate_flush,  deflate_finish,  deflate_end },
 	{ "gzip",         4, "gzip",     4, gzip_init,     deflate_add_data,  deflate_flush,  deflate_finish,  deflate_end },
 #endif /* USE_ZLIB */
+#if defined(USE_ZSTD)
+	{ "zstd",         4, "zstd",     4, zstd_init,     zstd_add_data,     zstd_flush,     zstd_finish,     zstd_end },
+#endif
 	{ NULL,       0, NULL,          0, NULL ,         NULL,              NULL,           NULL,           NULL }
 };
 
@@ -148,8 +161,11 @@ int comp_append_algo(struct comp *comp, const char *algo)
 	return -1;
 }
 
-#if defined(USE_ZLIB) || defined(USE_SLZ)
+#if defined(USE_ZLIB) || defined(USE_SLZ) || defined(USE_ZSTD)
 DECLARE_STATIC_POOL(pool_comp_ctx, "comp_ctx", sizeof(struct comp_ctx));
+#endif
+
+#if defined(USE_ZLIB) || defined(USE_SLZ)
 
 /*
  * Alloc the comp_ctx
@@ -504,45 +520,70 @@ static void free_zlib(void *opaque, void *ptr)
 	__ha_barrier_atomic_store();
 }
 
-/**************************
-****  gzip algorithm   ****
-***************************/
-static int gzip_init(struct comp_ctx **comp_ctx, int level)
+/* Per-thread cache of spare zlib contexts. deflateInit2() allocates and
+ * initializes 5 memory areas, which is a significant part of the total cost
+ * of compressing small responses, while deflateReset() reuses them without
+ * any allocation. A finished context is kept aside instead of being freed and
+ * the next stream needing the same window bits (i.e. the same stream format,
+ * since the window size and memory level are fixed at config parsing time)
+ * simply resets it. The memory held by spare contexts remains accounted for
+ * in zlib_used_memory and is bounded by a few contexts per thread.
+ */
+#define ZLIB_SPARE_CTX_SLOTS 3
+static THREAD_LOCAL struct comp_ctx *zlib_spare_ctx[ZLIB_SPARE_CTX_SLOTS];
+
+/* Take a spare context previously initialized with window bits <wbits> and
+ * reset it, or initialize a fresh one at compression level <level>.
+ * Returns 0 on success, -1 on error.
+ */
+static int deflate_init_or_reuse(struct comp_ctx **comp_ctx, int level, int wbits)
 {
-	z_stream *strm;
+	int i;
+
+	for (i = 0; i < ZLIB_SPARE_CTX_SLOTS; i++) {
+		struct comp_ctx *ctx = zlib_spare_ctx[i];
+
+		if (!ctx || ctx->zlib_wbits != wbits)
+			continue;
+
+		zlib_spare_ctx[i] = NULL;
+		if (deflateReset(&ctx->strm) == Z_OK &&
+		    deflateParams(&ctx->strm, level, Z_DEFAULT_STRATEGY) == Z_OK) {
+			ctx->cur_lvl = level;
+			*comp_ctx = ctx;
+			return 0;
+		}
+		/* unusable context, release it for real and start from scratch */
+		deflateEnd(&ctx->strm);
+		deinit_comp_ctx(&ctx);
+		break;
+	}
 
 	if (init_comp_ctx(comp_ctx) < 0)
 		return -1;
 
-	strm = &(*comp_ctx)->strm;
-
-	if (deflateInit2(strm, level, Z_DEFLATED, global_tune_zlibwindowsize + 16, global_tune_zlibmemlevel, Z_DEFAULT_STRATEGY) != Z_OK) {
+	if (deflateInit2(&(*comp_ctx)->strm, level, Z_DEFLATED, wbits, global_tune_zlibmemlevel, Z_DEFAULT_STRATEGY) != Z_OK) {
 		deinit_comp_ctx(comp_ctx);
 		return -1;
 	}
 
+	(*comp_ctx)->zlib_wbits = wbits;
 	(*comp_ctx)->cur_lvl = level;
-
 	return 0;
 }
 
+/**************************
+****  gzip algorithm   ****
+***************************/
+static int gzip_init(struct comp_ctx **comp_ctx, int level)
+{
+	return deflate_init_or_reuse(comp_ctx, level, global_tune_zlibwindowsize + 16);
+}
+
 /* Raw deflate algorithm */
 static int raw_def_init(struct comp_ctx **comp_ctx, int level)
 {
-	z_stream *strm;
-
-	if (init_comp_ctx(comp_ctx) < 0)
-		return -1;
-
-	strm = &(*comp_ctx)->strm;
-
-	if (deflateInit2(strm, level, Z_DEFLATED, -global_tune_zlibwindowsize, global_tune_zlibmemlevel, Z_DEFAULT_STRATEGY) != Z_OK) {
-		deinit_comp_ctx(comp_ctx);
-		return -1;
-	}
-
-	(*comp_ctx)->cur_lvl = level;
-	return 0;
+	return deflate_init_or_reuse(comp_ctx, level, -global_tune_zlibwindowsize);
 }
 
 /**************************
@@ -551,21 +592,7 @@ static int raw_def_init(struct comp_ctx **comp_ctx, int level)
 
 static int deflate_init(struct comp_ctx **comp_ctx, int level)
 {
-	z_stream *strm;
-
-	if (init_comp_ctx(comp_ctx) < 0)
-		return -1;
-
-	strm = &(*comp_ctx)->strm;
-
-	if (deflateInit2(strm, level, Z_DEFLATED, global_tune_zlibwindowsize, global_tune_zlibmemlevel, Z_DEFAULT_STRATEGY) != Z_OK) {
-		deinit_comp_ctx(comp_ctx);
-		return -1;
-	}
-
-	(*comp_ctx)->cur_lvl = level;
-
-	return 0;
+	return deflate_init_or_reuse(comp_ctx, level, global_tune_zlibwindowsize);
 }
 
 /* Return the size of consumed data or -1 */
@@ -648,6 +675,19 @@ static int deflate_end(struct comp_ctx **comp_ctx)
 {
 	z_stream *strm = &(*comp_ctx)->strm;
 	int ret;
+	int i;
+
+	/* Keep the context aside for reuse by this thread if a slot is free,
+	 * the next stream of the same format will simply reset it instead of
+	 * reallocating everything.
+	 */
+	for (i = 0; i < ZLIB_SPARE_CTX_SLOTS; i++) {
+		if (!zlib_spare_ctx[i]) {
+			zlib_spare_ctx[i] = *comp_ctx;
+			*comp_ctx = NULL;
+			return 0;
+		}
+	}
 
 	ret = deflateEnd(strm);
 
@@ -701,6 +741,122 @@ static int zlib_parse_global_windowsize(char **args, int section_type, struct pr
 
 #endif /* USE_ZLIB */
 
+#if defined(USE_ZSTD)
+
+/**************************
+****   Zstd algorithm  ****
+***************************/
+
+/* Per-thread spare zstd context kept across streams: resetting an existing
+ * context is much cheaper than creating one, which allocates its workspace
+ * and internal buffers.
+ */
+static THREAD_LOCAL ZSTD_CCtx *zstd_spare_cctx;
+
+static int zstd_init(struct comp_ctx **comp_ctx, int level)
+{
+	ZSTD_CCtx *cctx;
+
+	/* The level follows tune.comp.maxlevel like the other algorithms,
+	 * simply bounded to zstd's own scale.
+	 */
+	if (level < 1)
+		level = 1;
+	else if (level > ZSTD_maxCLevel())
+		level = ZSTD_maxCLevel();
+
+	cctx = zstd_spare_cctx;
+	zstd_spare_cctx = NULL;
+	if (!cctx)
+		cctx = ZSTD_createCCtx();
+	if (!cctx)
+		return -1;
+
+	*comp_ctx = pool_alloc(pool_comp_ctx);
+	if (*comp_ctx == NULL) {
+		ZSTD_freeCCtx(cctx);
+		return -1;
+	}
+
+	ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+	ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+
+	(*comp_ctx)->zstd_cctx = cctx;
+	(*comp_ctx)->cur_lvl = level;
+	return 0;
+}
+
+/* Return the size of consumed data or -1. The data not consumed yet remain
+ * buffered in the context and will be emitted by a later call or a flush.
+ */
+static int zstd_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out)
+{
+	ZSTD_outBuffer outb = { .dst = b_tail(out), .size = b_room(out), .pos = 0 };
+	ZSTD_inBuffer  inb  = { .src = in_data, .size = in_len, .pos = 0 };
+
+	if (in_len <= 0)
+		return 0;
+
+	if (!outb.size)
+		return -1;
+
+	if (ZSTD_isError(ZSTD_compressStream2(comp_ctx->zstd_cctx, &outb, &inb, ZSTD_e_continue)))
+		return -1;
+
+	b_add(out, outb.pos);
+	return inb.pos;
+}
+
+static int zstd_flush_or_finish(struct comp_ctx *comp_ctx, struct buffer *out, ZSTD_EndDirective mode)
+{
+	ZSTD_outBuffer outb = { .dst = b_tail(out), .size = b_room(out), .pos = 0 };
+	ZSTD_inBuffer  inb  = { .src = NULL, .size = 0, .pos = 0 };
+	size_t remaining;
+
+	do {
+		size_t prev = outb.pos;
+
+		remaining = ZSTD_compressStream2(comp_ctx->zstd_cctx, &outb, &inb, mode);
+		if (ZSTD_isError(remaining))
+			return -1;
+		if (remaining && outb.pos == prev)
+			return -1; /* output buffer full */
+	} while (remaining);
+
+	b_add(out, outb.pos);
+	return outb.pos;
+}
+
+static int zstd_flush(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return zstd_flush_or_finish(comp_ctx, out, ZSTD_e_flush);
+}
+
+static int zstd_finish(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return zstd_flush_or_finish(comp_ctx, out, ZSTD_e_end);
+}
+
+static int zstd_end(struct comp_ctx **comp_ctx)
+{
+	/* the algo may have been selected from the request without the stream
+	 * ever being initialized if the response was not compressible */
+	if (!*comp_ctx)
+		return 0;
+
+	/* keep the context aside for reuse by this thread when possible */
+	if (!zstd_spare_cctx)
+		zstd_spare_cctx = (*comp_ctx)->zstd_cctx;
+	else
+		ZSTD_freeCCtx((*comp_ctx)->zstd_cctx);
+
+	pool_free(pool_comp_ctx, *comp_ctx);
+	*comp_ctx = NULL;
+	return 0;
+}
+
+#endif /* USE_ZSTD */
+
 
 /* config keyword parsers */
 static struct cfg_kw_list cfg_kws = {ILH, {
@@ -725,6 +881,9 @@ static void comp_register_build_opts(void)
 	memprintf(&ptr, "Built with libslz for stateless compression.");
 #else
 	memprintf(&ptr, "Built without compression support (neither USE_ZLIB nor USE_SLZ are set).");
+#endif
+#ifdef USE_ZSTD
+	memprintf(&ptr, "%s\nBuilt with libzstd version : %s", ptr, ZSTD_versionString());
 #endif
 	memprintf(&ptr, "%s\nCompression algorithms supported :", ptr);
 
@@ -208,6 +208,37 @@ void ha_thread_dump(struct buffer *buf, int thr, int calling_tid)
 	chunk_appendf(buf, "\n");
 	chunk_appendf(buf, "             cpu_ns: poll=%llu now=%llu diff=%llu\n", p, n, n-p);
 
+#ifdef USE_THREAD
+	/* decodes the awaited lock and the lock operation history, both
+	 * encoded with LOCK_HIST_ENC(). This is approximate for threads
+	 * other than the current one but remains exact for a stuck one,
+	 * which is the case of interest for the watchdog.
+	 */
+	{
+		static const char ops[4] = { 'W', 'S', 'R', 'U' };
+		unsigned long hist = HA_ATOMIC_LOAD(&ha_thread_ctx[thr].lock_history);
+		uint8_t wait = HA_ATOMIC_LOAD(&ha_thread_ctx[thr].lock_waiting);
+		uint8_t entry;
+		uint i;
+
+		if (wait || hist) {
+			chunk_appendf(buf, "             locks:");
+			if (wait)
+				chunk_appendf(buf, " wait=%s:%c",
+				              lock_label((wait >> 2) - 1), ops[wait & 3]);
+			chunk_appendf(buf, " hist=");
+			for (i = 0; i < sizeof(hist); i++) {
+				entry = hist >> (8 * i);
+				if (!entry)
+					break;
+				chunk_appendf(buf, "%s%s:%c", i ? "," : "",
+				              lock_label((entry >> 2) - 1), ops[entry & 3]);
+			}
+			chunk_appendf(buf, "\n");
+		}
+	}
+#endif
+
 	/* this is the end of what we can dump from outside the current thread */
 
 	if (thr != tid)
@@ -323,6 +354,9 @@ static int cli_io_handler_show_threads(struct appctx *appctx)
 
 	chunk_reset(&trash);
 	ha_thread_dump_all_to_trash();
+#ifdef USE_THREAD
+	ha_dump_lock_contention(&trash);
+#endif
 
 	if (applet_putchk(appctx, &trash) == -1) {
 		/* failed, try again */
@@ -361,6 +395,9 @@ void ha_panic()
 	chunk_reset(&trash);
 	chunk_appendf(&trash, "Thread %u is about to kill the process.\n", tid + 1);
 	ha_thread_dump_all_to_trash();
+#ifdef USE_THREAD
+	ha_dump_lock_contention(&trash);
+#endif
 	DISGUISE(write(2, trash.area, trash.data));
 	for (;;)
 		abort();
@@ -1440,6 +1477,30 @@ static void debug_release_memstats(struct appctx *appctx)
 }
 #endif
 
+#ifdef USE_THREAD
+/* appends to buffer <buf> a summary of the per-label counts of contended
+ * lock acquisitions observed since start. Only non-zero labels are reported.
+ */
+void ha_dump_lock_contention(struct buffer *buf)
+{
+	uint count;
+	int empty = 1;
+	int lbl;
+
+	chunk_appendf(buf, "Contended locks:");
+	for (lbl = 0; lbl < LOCK_LABELS; lbl++) {
+		count = HA_ATOMIC_LOAD(&lock_contention[lbl]);
+		if (!count)
+			continue;
+		chunk_appendf(buf, " %s=%u", lock_label(lbl), count);
+		empty = 0;
+	}
+	if (empty)
+		chunk_appendf(buf, " none");
+	chunk_appendf(buf, "\n");
+}
+#endif
+
 #ifndef USE_THREAD_DUMP
 
 /* This function dumps all threads' state to the trash. This version is the
@@ -3,8 +3,30 @@
 #include <import/eb32tree.h>
 #include <import/ebistree.h>
 #include <haproxy/dict.h>
+#include <haproxy/init.h>
 #include <haproxy/thread.h>
 
+/* Per-thread cache of the last interned entry. Peers resyncs and log
+ * sampling tend to intern the same string many times in a row, so this turns
+ * such repeated dict_insert() calls into a simple string comparison without
+ * ever touching the tree lock. The cache owns one reference on the entry it
+ * pins, which is released when another entry replaces it or when the thread
+ * exits.
+ */
+static THREAD_LOCAL struct {
+	struct dict *d;
+	struct dict_entry *de;
+} dict_cache;
+
+static void free_dict_cache_per_thread(void)
+{
+	if (dict_cache.de) {
+		dict_entry_unref(dict_cache.d, dict_cache.de);
+		dict_cache.de = NULL;
+	}
+}
+REGISTER_PER_THREAD_FREE(free_dict_cache_per_thread);
+
 struct dict *new_dict(const char *name)
 {
 	struct dict *dict;
@@ -82,26 +104,52 @@ struct dict_entry *dict_insert(struct dict *d, char *s)
 	struct dict_entry *de;
 	struct ebpt_node *n;
 
-	HA_RWLOCK_RDLOCK(DICT_LOCK, &d->rwlock);
-	de = __dict_lookup(d, s);
-	HA_RWLOCK_RDUNLOCK(DICT_LOCK, &d->rwlock);
-	if (de) {
+	/* fast path: same string as the last one interned on this thread.
+	 * The cache holds its own reference so the entry cannot vanish.
+	 */
+	de = dict_cache.de;
+	if (de && dict_cache.d == d && strcmp(de->value.key, s) == 0) {
 		HA_ATOMIC_INC(&de->refcount);
 		return de;
 	}
 
+	/* the refcount must be taken under the read lock: holders of the
+	 * write lock may only release an entry once its refcount is null.
+	 */
+	HA_RWLOCK_RDLOCK(DICT_LOCK, &d->rwlock);
+	de = __dict_lookup(d, s);
+	if (de)
+		HA_ATOMIC_INC(&de->refcount);
+	HA_RWLOCK_RDUNLOCK(DICT_LOCK, &d->rwlock);
+	if (de)
+		goto done;
+
 	de = new_dict_entry(s);
 	if (!de)
 		return NULL;
 
 	HA_RWLOCK_WRLOCK(DICT_LOCK, &d->rwlock);
 	n = ebis_insert(&d->values, &de->value);
+	if (n != &de->value) {
+		/* another thread won the insertion race, take a reference on
+		 * its entry while still under the lock
+		 */
+		HA_ATOMIC_INC(&container_of(n, struct dict_entry, value)->refcount);
+	}
 	HA_RWLOCK_WRUNLOCK(DICT_LOCK, &d->rwlock);
 	if (n != &de->value) {
 		free_dict_entry(de);
 		de = container_of(n, struct dict_entry, value);
 	}
 
+  done:
+	/* refresh the cache with its own reference */
+	HA_ATOMIC_INC(&de->refcount);
+	if (dict_cache.de)
+		dict_entry_unref(dict_cache.d, dict_cache.de);
+	dict_cache.d = d;
+	dict_cache.de = de;
+
 	return de;
 }
 
@@ -120,6 +168,13 @@ void dict_entry_unref(struct dict *d, struct dict_entry *de)
 		return;
 
 	HA_RWLOCK_WRLOCK(DICT_LOCK, &d->rwlock);
+	/* the entry may have been resurrected by a concurrent lookup, it may
+	 * only be released if its refcount is still null under the lock
+	 */
+	if (HA_ATOMIC_LOAD(&de->refcount) != 0) {
+		HA_RWLOCK_WRUNLOCK(DICT_LOCK, &d->rwlock);
+		return;
+	}
 	ebpt_delete(&de->value);
 	HA_RWLOCK_WRUNLOCK(DICT_LOCK, &d->rwlock);
 
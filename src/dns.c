@@ -10,12 +10,16 @@
  *
  */
 
+#define _GNU_SOURCE  /* required for recvmmsg() and struct mmsghdr */
+
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <sys/socket.h>
+
 #include <sys/types.h>
 
 #include <haproxy/action.h>
@@ -155,7 +159,8 @@ ssize_t dns_recv_nameserver(struct dns_nameserver *ns, void *data, size_t size)
         ssize_t ret = -1;
 
 	if (ns->dgram) {
-		struct dgram_conn *dgram = &ns->dgram->conn;
+		struct dns_dgram_server *ds = ns->dgram;
+		struct dgram_conn *dgram = &ds->conn;
 		int fd;
 
 		HA_SPIN_LOCK(DNS_LOCK, &dgram->lock);
@@ -165,18 +170,68 @@ ssize_t dns_recv_nameserver(struct dns_nameserver *ns, void *data, size_t size)
 			return -1;
 		}
 
-		if ((ret = recv(fd, data, size, 0)) < 0) {
-			if (errno == EAGAIN || errno == EWOULDBLOCK) {
-				fd_cant_recv(fd);
+		if (ds->rx_next >= ds->rx_count) {
+			struct mmsghdr msgs[DNS_RX_BATCH];
+			struct iovec   iovs[DNS_RX_BATCH];
+			int i;
+
+			/* The stash is allocated on first use and sized for the
+			 * caller's buffer. If the allocation failed, or if a
+			 * caller shows up with another size, datagrams are
+			 * simply read one at a time.
+			 */
+			if (!ds->rx_buf) {
+				ds->rx_buf = malloc(DNS_RX_BATCH * size);
+				ds->rx_slot = size;
+			}
+
+			ds->rx_count = ds->rx_next = 0;
+			if (!ds->rx_buf || size != ds->rx_slot) {
+				if ((ret = recv(fd, data, size, 0)) < 0)
+					goto rx_err;
 				HA_SPIN_UNLOCK(DNS_LOCK, &dgram->lock);
-				return 0;
+				return ret;
 			}
-			fd_delete(fd);
-			dgram->t.sock.fd = -1;
+
+			/* refill the stash with a whole batch of datagrams */
+			memset(msgs, 0, sizeof(msgs));
+			for (i = 0; i < DNS_RX_BATCH; i++) {
+				iovs[i].iov_base = ds->rx_buf + i * ds->rx_slot;
+				iovs[i].iov_len  = ds->rx_slot;
+				msgs[i].msg_hdr.msg_iov    = &iovs[i];
+				msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+
+			ret = recvmmsg(fd, msgs, DNS_RX_BATCH, 0, NULL);
+			if (ret < 0)
+				goto rx_err;
+
+			for (i = 0; i < ret; i++)
+				ds->rx_len[i] = msgs[i].msg_len;
+			ds->rx_count = ret;
+		}
+
+		ret = 0;
+		if (ds->rx_next < ds->rx_count) {
+			ret = ds->rx_len[ds->rx_next];
+			if (ret > size)
+				ret = size;
+			memcpy(data, ds->rx_buf + ds->rx_next * ds->rx_slot, ret);
+			ds->rx_next++;
+		}
+		HA_SPIN_UNLOCK(DNS_LOCK, &dgram->lock);
+		return ret;
+
+  rx_err:
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			fd_cant_recv(fd);
 			HA_SPIN_UNLOCK(DNS_LOCK, &dgram->lock);
-			return -1;
+			return 0;
 		}
+		fd_delete(fd);
+		dgram->t.sock.fd = -1;
 		HA_SPIN_UNLOCK(DNS_LOCK, &dgram->lock);
+		return -1;
 	}
 	else if (ns->stream) {
 		struct dns_stream_server *dss = ns->stream;
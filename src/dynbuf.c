@@ -16,6 +16,7 @@
 
 #include <haproxy/api.h>
 #include <haproxy/dynbuf.h>
+#include <haproxy/errors.h>
 #include <haproxy/global.h>
 #include <haproxy/list.h>
 #include <haproxy/pool.h>
@@ -57,6 +58,30 @@ int init_buffer()
 	return 1;
 }
 
+/* Reserves the optional huge-page backed arena behind the buffer pool when
+ * "tune.buffers.huge-pages" is set. This must only be called once the final
+ * maxconn is known, hence after all the automatic sizing is done. Always
+ * returns 1 since running without the arena is only a performance matter.
+ */
+int buffer_arena_init()
+{
+	uint count;
+
+	if (!(global.tune.options & GTUNE_BUFS_HUGEPAGES))
+		return 1;
+
+	/* reserve enough for the configured limit if any, otherwise for two
+	 * buffers per connection plus the reserve, which covers the expected
+	 * working set.
+	 */
+	count = global.tune.buf_limit ? global.tune.buf_limit :
+		2 * global.maxconn + global.tune.reserved_bufs;
+	if (!pool_reserve_arena(pool_head_buffer, count))
+		ha_warning("Failed to reserve a huge-page arena for buffers, "
+			   "falling back to the default allocator.\n");
+	return 1;
+}
+
 /*
  * Dumps part or all of a buffer.
  */
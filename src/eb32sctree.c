@@ -261,6 +261,7 @@ struct eb32sc_node *eb32sc_lookup_ge(struct eb_root *root, u32 x, unsigned long
 		}
 		node = container_of(eb_untag(troot, EB_NODE),
 				    struct eb32sc_node, node.branches);
+		eb_prefetch_branches(&node->node.branches);
 
 		if (node->node.bit < 0) {
 			/* We're at the top of a dup tree. Either we got a
@@ -329,6 +330,7 @@ struct eb32sc_node *eb32sc_lookup_ge_or_first(struct eb_root *root, u32 x, unsig
 		}
 		eb32 = container_of(eb_untag(troot, EB_NODE),
 				    struct eb32sc_node, node.branches);
+		eb_prefetch_branches(&eb32->node.branches);
 
 		if (eb32->node.bit < 0) {
 			/* We're at the top of a dup tree. Either we got a
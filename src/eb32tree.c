@@ -71,6 +71,7 @@ struct eb32_node *eb32_lookup_le(struct eb_root *root, u32 x)
 		}
 		node = container_of(eb_untag(troot, EB_NODE),
 				    struct eb32_node, node.branches);
+		eb_prefetch_branches(&node->node.branches);
 
 		if (node->node.bit < 0) {
 			/* We're at the top of a dup tree. Either we got a
@@ -159,6 +160,7 @@ struct eb32_node *eb32_lookup_ge(struct eb_root *root, u32 x)
 		}
 		node = container_of(eb_untag(troot, EB_NODE),
 				    struct eb32_node, node.branches);
+		eb_prefetch_branches(&node->node.branches);
 
 		if (node->node.bit < 0) {
 			/* We're at the top of a dup tree. Either we got a
@@ -0,0 +1,327 @@
+/*
+ * Elastic Binary Trees - exported functions for operations on compact
+ * offset-based 32bit nodes.
+ * Version 6.0.6
+ * (C) 2002-2011 - Willy Tarreau <w@1wt.eu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Consult ebo32tree.h for more details about those functions */
+
+#include <import/ebo32tree.h>
+
+/*
+ * Find the node holding key <x> in the tree <root>, with all the links
+ * relative to arena <base>. If none can be found, return NULL. As the keys
+ * are unique in this variant, there is never a duplicate sub-tree to walk
+ * down.
+ */
+struct ebo32_node *ebo32_lookup(const void *base, const struct ebo32_root *root, u32 x)
+{
+	struct ebo32_node *node;
+	u32 troot;
+	u32 y;
+
+	troot = root->b[EB_LEFT];
+	if (unlikely(troot == 0))
+		return NULL;
+
+	while (1) {
+		if ((ebo32_gettag(troot) == EB_LEAF)) {
+			node = ebo32_node_at(base, ebo32_untag(troot, EB_LEAF));
+			if (node->key == x)
+				return node;
+			else
+				return NULL;
+		}
+		node = ebo32_node_at(base, ebo32_untag(troot, EB_NODE));
+
+		y = node->key ^ x;
+		if (!y) {
+			/* we found the node which holds the key */
+			return node;
+		}
+
+		if ((y >> node->bit) >= EB_NODE_BRANCHES)
+			return NULL; /* no more common bits */
+
+		troot = node->b[(x >> node->bit) & EB_NODE_BRANCH_MASK];
+	}
+}
+
+/*
+ * Find the first occurrence of the lowest key in the tree <root>, which is
+ * equal to or greater than <x>, with all the links relative to arena <base>.
+ * NULL is returned is no key matches.
+ */
+struct ebo32_node *ebo32_lookup_ge(const void *base, const struct ebo32_root *root, u32 x)
+{
+	struct ebo32_node *node;
+	u32 troot;
+
+	troot = root->b[EB_LEFT];
+	if (unlikely(troot == 0))
+		return NULL;
+
+	while (1) {
+		if ((ebo32_gettag(troot) == EB_LEAF)) {
+			/* We reached a leaf, which means that the whole upper
+			 * parts were common. We will return either the current
+			 * node or its next one if the former is too small.
+			 */
+			node = ebo32_node_at(base, ebo32_untag(troot, EB_LEAF));
+			if (node->key >= x)
+				return node;
+			/* return next */
+			troot = node->leaf_p;
+			break;
+		}
+		node = ebo32_node_at(base, ebo32_untag(troot, EB_NODE));
+
+		if (((x ^ node->key) >> node->bit) >= EB_NODE_BRANCHES) {
+			/* No more common bits at all. Either this node is too
+			 * large and we need to get its lowest value, or it is too
+			 * small, and we need to get the next value.
+			 */
+			if ((node->key >> node->bit) > (x >> node->bit))
+				return ebo32_walk_down(base, node->b[EB_LEFT], EB_LEFT);
+
+			/* Further values will be too low here, so return the next
+			 * unique node (if it exists).
+			 */
+			troot = node->node_p;
+			break;
+		}
+		troot = node->b[(x >> node->bit) & EB_NODE_BRANCH_MASK];
+	}
+
+	/* If we get here, it means we want to report next node after the
+	 * current one which is not below. <troot> is already initialised
+	 * to the parent's branches.
+	 */
+	while (ebo32_gettag(troot) != EB_LEFT)
+		/* Walking up from right branch, so we cannot be below root */
+		troot = ebo32_node_at(base, ebo32_untag(troot, EB_RGHT))->node_p;
+
+	/* Note that <troot> cannot be NULL at this stage */
+	troot = ebo32_node_at(base, ebo32_untag(troot, EB_LEFT))->b[EB_RGHT];
+	if (ebo32_clrtag(troot) == 0)
+		return NULL;
+
+	return ebo32_walk_down(base, troot, EB_LEFT);
+}
+
+/* Insert ebo32_node <new> into tree <root>, with all the links relative to
+ * arena <base>. Only new->key needs be set with the key. The ebo32_node is
+ * returned. Keys are unique: if <new>'s key was already present, the node
+ * carrying it is returned instead and <new> is not inserted.
+ */
+struct ebo32_node *ebo32_insert(void *base, struct ebo32_root *root, struct ebo32_node *new)
+{
+	struct ebo32_node *old;
+	unsigned int side;
+	u32 troot;
+	u32 *up_ptr;
+	u32 new_ofs = ebo32_ofs(base, new);
+	u32 newkey; /* caching the key saves approximately one cycle */
+	u32 new_left, new_rght;
+	u32 new_leaf;
+	int old_node_bit;
+
+	side = EB_LEFT;
+	troot = root->b[EB_LEFT];
+	if (unlikely(troot == 0)) {
+		/* Tree is empty, insert the leaf part below the left branch */
+		root->b[EB_LEFT] = ebo32_dotag(new_ofs, EB_LEAF);
+		new->leaf_p = ebo32_dotag(ebo32_ofs(base, root), EB_LEFT);
+		new->node_p = 0; /* node part unused */
+		return new;
+	}
+
+	/* The tree descent is fairly easy :
+	 *  - first, check if we have reached a leaf node
+	 *  - second, check if we have gone too far
+	 *  - third, reiterate
+	 * Everywhere, we use <new> for the node node we are inserting, <root>
+	 * for the node we attach it to, and <old> for the node we are
+	 * displacing below <new>. <troot> will always point to the future node
+	 * (tagged with its type). <side> carries the side the node <new> is
+	 * attached to below its parent, which is also where previous node
+	 * was attached. <newkey> carries the key being inserted.
+	 */
+	newkey = new->key;
+
+	while (1) {
+		if (ebo32_gettag(troot) == EB_LEAF) {
+			/* insert above a leaf */
+			old = ebo32_node_at(base, ebo32_untag(troot, EB_LEAF));
+			new->node_p = old->leaf_p;
+			up_ptr = &old->leaf_p;
+			break;
+		}
+
+		/* OK we're walking down this link */
+		old = ebo32_node_at(base, ebo32_untag(troot, EB_NODE));
+		old_node_bit = old->bit;
+
+		/* Stop going down when we don't have common bits anymore. */
+		if (((new->key ^ old->key) >> old_node_bit) >= EB_NODE_BRANCHES) {
+			/* The tree did not contain the key, so we insert <new> before the node
+			 * <old>, and set ->bit to designate the lowest bit position in <new>
+			 * which applies to ->b[].
+			 */
+			new->node_p = old->node_p;
+			up_ptr = &old->node_p;
+			break;
+		}
+
+		/* walk down */
+		root = (struct ebo32_root *)old;
+		side = (newkey >> old_node_bit) & EB_NODE_BRANCH_MASK;
+		troot = root->b[side];
+	}
+
+	if (new->key == old->key) {
+		/* the tree only contains unique keys, simply report the
+		 * existing node instead of inserting this one.
+		 */
+		return old;
+	}
+
+	new_left = ebo32_dotag(new_ofs, EB_LEFT);
+	new_rght = ebo32_dotag(new_ofs, EB_RGHT);
+	new_leaf = ebo32_dotag(new_ofs, EB_LEAF);
+
+	/* We need the common higher bits between new->key and old->key.
+	 * NOTE that bit(new) is always < bit(root) because highest
+	 * bit of new->key and old->key are identical here (otherwise they
+	 * would sit on different branches).
+	 */
+	new->bit = flsnz(new->key ^ old->key) - EB_NODE_BITS;
+
+	if (new->key >= old->key) {
+		new->b[EB_LEFT] = troot;
+		new->b[EB_RGHT] = new_leaf;
+		new->leaf_p = new_rght;
+		*up_ptr = new_left;
+	}
+	else {
+		new->b[EB_LEFT] = new_leaf;
+		new->b[EB_RGHT] = troot;
+		new->leaf_p = new_left;
+		*up_ptr = new_rght;
+	}
+
+	/* Ok, now we are inserting <new> between <root> and <old>. <old>'s
+	 * parent is already set to <new>, and the <root>'s branch is still in
+	 * <side>. Update the root's leaf till we have it.
+	 */
+	root->b[side] = ebo32_dotag(new_ofs, EB_NODE);
+	return new;
+}
+
+/* Removes node <node> from the tree it was in, with all the links relative
+ * to arena <base>. Marks the node as unlinked (leaf_p set to zero). It is
+ * safe to call it on an already unlinked node.
+ */
+void ebo32_delete(void *base, struct ebo32_node *node)
+{
+	__label__ delete_unlink;
+	unsigned int pside, gpside, sibtype;
+	struct ebo32_node *parent;
+	u32 parent_ofs, gparent_ofs;
+
+	if (!node->leaf_p)
+		return;
+
+	/* we need the parent, our side, and the grand parent */
+	pside = ebo32_gettag(node->leaf_p);
+	parent_ofs = ebo32_untag(node->leaf_p, pside);
+	parent = ebo32_node_at(base, parent_ofs);
+
+	/* We likely have to release the parent link, unless it's the root,
+	 * in which case we only set our branch to zero. Note that we can
+	 * only be attached to the root by its left branch.
+	 */
+	if (ebo32_clrtag(parent->b[EB_RGHT]) == 0) {
+		/* we're just below the root, it's trivial. */
+		parent->b[EB_LEFT] = 0;
+		goto delete_unlink;
+	}
+
+	/* To release our parent, we have to identify our sibling, and reparent
+	 * it directly to/from the grand parent. Note that the sibling can
+	 * either be a link or a leaf.
+	 */
+	gpside = ebo32_gettag(parent->node_p);
+	gparent_ofs = ebo32_untag(parent->node_p, gpside);
+
+	ebo32_node_at(base, gparent_ofs)->b[gpside] = parent->b[!pside];
+	sibtype = ebo32_gettag(parent->b[!pside]);
+
+	if (sibtype == EB_LEAF) {
+		ebo32_node_at(base, ebo32_untag(parent->b[!pside], EB_LEAF))->leaf_p =
+			ebo32_dotag(gparent_ofs, gpside);
+	} else {
+		ebo32_node_at(base, ebo32_untag(parent->b[!pside], EB_NODE))->node_p =
+			ebo32_dotag(gparent_ofs, gpside);
+	}
+	/* Mark the parent unused. Note that we do not check if the parent is
+	 * our own node, but that's not a problem because if it is, it will be
+	 * marked unused at the same time, which we'll use below to know we can
+	 * safely remove it.
+	 */
+	parent->node_p = 0;
+
+	/* The parent node has been detached, and is currently unused. It may
+	 * belong to another node, so we cannot remove it that way. Also, our
+	 * own node part might still be used. so we can use this spare node
+	 * to replace ours if needed.
+	 */
+
+	/* If our link part is unused, we can safely exit now */
+	if (!node->node_p)
+		goto delete_unlink;
+
+	/* From now on, <node> and <parent> are necessarily different, and the
+	 * <node>'s node part is in use. By definition, <parent> is at least
+	 * below <node>, so keeping its key for the bit string is OK.
+	 */
+	parent->node_p = node->node_p;
+	parent->b[EB_LEFT] = node->b[EB_LEFT];
+	parent->b[EB_RGHT] = node->b[EB_RGHT];
+	parent->bit = node->bit;
+
+	/* We must now update the new node's parent... */
+	gpside = ebo32_gettag(parent->node_p);
+	gparent_ofs = ebo32_untag(parent->node_p, gpside);
+	ebo32_node_at(base, gparent_ofs)->b[gpside] = ebo32_dotag(parent_ofs, EB_NODE);
+
+	/* ... and its branches */
+	for (pside = 0; pside <= 1; pside++) {
+		if (ebo32_gettag(parent->b[pside]) == EB_NODE) {
+			ebo32_node_at(base, ebo32_untag(parent->b[pside], EB_NODE))->node_p =
+				ebo32_dotag(parent_ofs, pside);
+		} else {
+			ebo32_node_at(base, ebo32_untag(parent->b[pside], EB_LEAF))->leaf_p =
+				ebo32_dotag(parent_ofs, pside);
+		}
+	}
+ delete_unlink:
+	/* Now the node has been completely unlinked */
+	node->leaf_p = 0;
+	return; /* tree is not empty yet */
+}
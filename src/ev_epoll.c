@@ -165,6 +165,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 	int updt_idx;
 	int wait_time;
 	int old_fd;
+	uint64_t spin_until;
 
 	/* first, scan the update list to find polling changes */
 	for (updt_idx = 0; updt_idx < fd_nbupdt; updt_idx++) {
@@ -224,11 +225,20 @@ static void _do_poll(struct poller *p, int exp, int wake)
 
 	/* Now let's wait for polled events. */
 	wait_time = wake ? 0 : compute_poll_timeout(exp);
+	spin_until = compute_poll_spin_until(wait_time);
 	clock_entering_poll();
 
 	do {
 		int timeout = (global.tune.options & GTUNE_BUSY_POLLING) ? 0 : wait_time;
 
+		if (unlikely(spin_until) && timeout) {
+			/* adaptive busy-wait phase before really sleeping */
+			if (now_mono_time() < spin_until)
+				timeout = 0;
+			else
+				spin_until = 0;
+		}
+
 		status = epoll_wait(epoll_fd[tid], epoll_events, global.tune.maxpollevents, timeout);
 		clock_update_local_date(timeout, status);
 
@@ -245,27 +255,52 @@ static void _do_poll(struct poller *p, int exp, int wake)
 	clock_update_global_date();
 	fd_leaving_poll(wait_time, status);
 
-	/* process polled events */
+	/* Process polled events in two passes over small batches: the first
+	 * pass translates the kernel's event words to our own flags and
+	 * prefetches the fdtab entries, the second one updates fdtab. This
+	 * keeps the scan of the kernel-filled array tight and hides part of
+	 * the fdtab cache miss latency behind the translation work, which
+	 * measurably reduces the time spent stalled on fdtab under very large
+	 * numbers of connections. Note that the kernel already merges multiple
+	 * events on a same FD into a single entry per epoll_wait() call, so
+	 * each entry costs exactly one fd_update_events() call.
+	 */
+
+	for (count = 0; count < status;) {
+		int batch_fd[16];
+		unsigned int batch_ev[16];
+		int batch, i;
+
+		batch = status - count;
+		if (batch > 16)
+			batch = 16;
 
-	for (count = 0; count < status; count++) {
-		unsigned int n, e;
+		for (i = 0; i < batch; i++, count++) {
+			unsigned int e;
 
-		e = epoll_events[count].events;
-		fd = epoll_events[count].data.fd;
+			e = epoll_events[count].events;
+			fd = epoll_events[count].data.fd;
 
-		if ((e & EPOLLRDHUP) && !(cur_poller.flags & HAP_POLL_F_RDHUP))
-			_HA_ATOMIC_OR(&cur_poller.flags, HAP_POLL_F_RDHUP);
+			if ((e & EPOLLRDHUP) && !(cur_poller.flags & HAP_POLL_F_RDHUP))
+				_HA_ATOMIC_OR(&cur_poller.flags, HAP_POLL_F_RDHUP);
 
+			batch_fd[i] = fd;
+			batch_ev[i] =
+			    ((e & EPOLLIN)    ? FD_EV_READY_R : 0) |
+			    ((e & EPOLLOUT)   ? FD_EV_READY_W : 0) |
+			    ((e & EPOLLRDHUP) ? FD_EV_SHUT_R  : 0) |
+			    ((e & EPOLLHUP)   ? FD_EV_SHUT_RW : 0) |
+			    ((e & EPOLLERR)   ? FD_EV_ERR_RW  : 0);
+
+			__builtin_prefetch(&fdtab[fd], 1);
+		}
+
+		for (i = 0; i < batch; i++) {
 #ifdef DEBUG_FD
-		_HA_ATOMIC_INC(&fdtab[fd].event_count);
+			_HA_ATOMIC_INC(&fdtab[batch_fd[i]].event_count);
 #endif
-		n = ((e & EPOLLIN)    ? FD_EV_READY_R : 0) |
-		    ((e & EPOLLOUT)   ? FD_EV_READY_W : 0) |
-		    ((e & EPOLLRDHUP) ? FD_EV_SHUT_R  : 0) |
-		    ((e & EPOLLHUP)   ? FD_EV_SHUT_RW : 0) |
-		    ((e & EPOLLERR)   ? FD_EV_ERR_RW  : 0);
-
-		fd_update_events(fd, n);
+			fd_update_events(batch_fd[i], batch_ev[i]);
+		}
 	}
 	/* the caller will take care of cached events */
 }
@@ -0,0 +1,776 @@
+/*
+ * FD polling functions for Linux io_uring
+ *
+ * Copyright 2023 HAProxy Technologies
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * This poller uses one io_uring instance per thread, on which FD readiness
+ * is watched using one-shot IORING_OP_POLL_ADD requests that are re-armed
+ * once their completion has been consumed, which provides the same
+ * level-triggered semantics as the other pollers. The point compared to
+ * epoll is that registering/modifying/removing interest on an FD only
+ * writes a submission entry into the shared ring, and all entries queued
+ * during a whole scheduler loop are flushed with a single io_uring_enter()
+ * call at polling time, removing the per-FD epoll_ctl() syscalls that
+ * dominate with short-lived connections.
+ */
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include <linux/io_uring.h>
+
+#include <haproxy/activity.h>
+#include <haproxy/api.h>
+#include <haproxy/clock.h>
+#include <haproxy/fd.h>
+#include <haproxy/global.h>
+#include <haproxy/signal.h>
+#include <haproxy/ticks.h>
+#include <haproxy/task.h>
+#include <haproxy/tools.h>
+
+/* io_uring syscall numbers are identical across all archs */
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup  425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter  426
+#endif
+
+#ifndef POLLRDHUP
+/* POLLRDHUP appeared in kernel 2.6.17 */
+#define POLLRDHUP 0x2000
+#endif
+
+/* user_data values above this limit are control requests, not FD polls */
+#define URING_UDATA_TIMEOUT  (~0ULL)
+
+/* Everything describing one thread's ring. Only ever accessed by its owner
+ * thread so no locking is involved.
+ */
+struct uring_ctx {
+	int ring_fd;
+	unsigned int sq_entries;       /* number of SQEs in the ring */
+	unsigned int cq_entries;       /* number of CQEs in the ring */
+	unsigned int sq_tail_local;    /* our private copy of the SQ tail */
+	unsigned int to_submit;        /* SQEs queued and not yet submitted */
+	unsigned int *sq_khead;        /* kernel's SQ head */
+	unsigned int *sq_ktail;        /* kernel's SQ tail */
+	unsigned int *sq_kmask;        /* SQ index mask */
+	unsigned int *sq_array;        /* SQ index array */
+	unsigned int *cq_khead;        /* kernel's CQ head */
+	unsigned int *cq_ktail;        /* kernel's CQ tail */
+	unsigned int *cq_kmask;        /* CQ index mask */
+	struct io_uring_sqe *sqes;     /* the SQE array */
+	struct io_uring_cqe *cqes;     /* the CQE array */
+	void *sq_ring;                 /* SQ ring mmap base */
+	size_t sq_ring_sz;             /* SQ ring mmap size */
+	void *cq_ring;                 /* CQ ring mmap base (==sq_ring if single mmap) */
+	size_t cq_ring_sz;             /* CQ ring mmap size */
+	size_t sqe_sz;                 /* SQE array mmap size */
+};
+
+static THREAD_LOCAL struct uring_ctx ring_ctx;
+static THREAD_LOCAL int ring_ok = 0; // this thread's ring is usable
+
+static int uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+                       unsigned int flags, void *arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+/* Creates and maps the ring for the current thread. Returns 0 on success,
+ * -1 on failure.
+ */
+static int uring_create(struct uring_ctx *r)
+{
+	struct io_uring_params p = { };
+	unsigned int entries;
+
+	/* make sure a full batch of events plus their re-arms fits in the
+	 * submission ring without an intermediate flush.
+	 */
+	entries = 8;
+	while (entries < 2 * (unsigned int)global.tune.maxpollevents && entries < 4096)
+		entries <<= 1;
+
+	r->ring_fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (r->ring_fd < 0)
+		return -1;
+
+	/* EXT_ARG is needed for timed waits (kernel >= 5.11), and implies
+	 * SINGLE_MMAP and NODROP which we rely on as well.
+	 */
+	if (!(p.features & IORING_FEAT_EXT_ARG))
+		goto fail;
+
+	r->sq_entries = p.sq_entries;
+	r->cq_entries = p.cq_entries;
+
+	r->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	r->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_ring_sz > r->sq_ring_sz)
+			r->sq_ring_sz = r->cq_ring_sz;
+		r->cq_ring_sz = r->sq_ring_sz;
+	}
+
+	r->sq_ring = mmap(NULL, r->sq_ring_sz, PROT_READ | PROT_WRITE,
+	                  MAP_SHARED | MAP_POPULATE, r->ring_fd, IORING_OFF_SQ_RING);
+	if (r->sq_ring == MAP_FAILED)
+		goto fail;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->cq_ring = r->sq_ring;
+	else {
+		r->cq_ring = mmap(NULL, r->cq_ring_sz, PROT_READ | PROT_WRITE,
+		                  MAP_SHARED | MAP_POPULATE, r->ring_fd, IORING_OFF_CQ_RING);
+		if (r->cq_ring == MAP_FAILED)
+			goto fail_cq;
+	}
+
+	r->sqe_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqe_sz, PROT_READ | PROT_WRITE,
+	               MAP_SHARED | MAP_POPULATE, r->ring_fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		goto fail_sqe;
+
+	r->sq_khead = (unsigned int *)((char *)r->sq_ring + p.sq_off.head);
+	r->sq_ktail = (unsigned int *)((char *)r->sq_ring + p.sq_off.tail);
+	r->sq_kmask = (unsigned int *)((char *)r->sq_ring + p.sq_off.ring_mask);
+	r->sq_array = (unsigned int *)((char *)r->sq_ring + p.sq_off.array);
+	r->cq_khead = (unsigned int *)((char *)r->cq_ring + p.cq_off.head);
+	r->cq_ktail = (unsigned int *)((char *)r->cq_ring + p.cq_off.tail);
+	r->cq_kmask = (unsigned int *)((char *)r->cq_ring + p.cq_off.ring_mask);
+	r->cqes     = (struct io_uring_cqe *)((char *)r->cq_ring + p.cq_off.cqes);
+
+	r->sq_tail_local = *r->sq_ktail;
+	r->to_submit = 0;
+	return 0;
+
+ fail_sqe:
+	if (r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_ring_sz);
+ fail_cq:
+	munmap(r->sq_ring, r->sq_ring_sz);
+ fail:
+	close(r->ring_fd);
+	r->ring_fd = -1;
+	return -1;
+}
+
+static void uring_destroy(struct uring_ctx *r)
+{
+	if (r->ring_fd < 0)
+		return;
+	munmap(r->sqes, r->sqe_sz);
+	if (r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_ring_sz);
+	munmap(r->sq_ring, r->sq_ring_sz);
+	close(r->ring_fd);
+	r->ring_fd = -1;
+}
+
+/* FDs whose poll cancellation or interest update could not be queued because
+ * the submission queue was full while the kernel refused submissions (EBUSY
+ * under CQ backlog). They are replayed at the next polling round, once
+ * completions have been consumed and made room.
+ */
+static THREAD_LOCAL int *pending_del;
+static THREAD_LOCAL int pending_del_cnt, pending_del_sz;
+static THREAD_LOCAL int *pending_upd;
+static THREAD_LOCAL int pending_upd_cnt, pending_upd_sz;
+
+/* Appends <fd> to the deferral array <arr> of <cnt> used entries over <sz>
+ * allocated ones, growing it as needed. Returns 0 on success, -1 on
+ * allocation failure.
+ */
+static int uring_defer_fd(int **arr, int *cnt, int *sz, int fd)
+{
+	if (*cnt >= *sz) {
+		int newsz = *sz ? *sz * 2 : 64;
+		int *ptr = realloc(*arr, newsz * sizeof(*ptr));
+
+		if (!ptr)
+			return -1;
+		*arr = ptr;
+		*sz = newsz;
+	}
+	(*arr)[(*cnt)++] = fd;
+	return 0;
+}
+
+/* Publishes all queued SQEs to the kernel without waiting. Called when the
+ * submission queue is full; the regular flush happens in _do_poll(). May
+ * legitimately fail with EBUSY when the kernel holds overflowed completions
+ * that we have not consumed yet, in which case to_submit is left untouched.
+ * Returns 0 on success, -1 on failure.
+ */
+static int uring_flush(struct uring_ctx *r)
+{
+	if (!r->to_submit)
+		return 0;
+
+	HA_ATOMIC_STORE(r->sq_ktail, r->sq_tail_local);
+	if (uring_enter(r->ring_fd, r->to_submit, 0, 0, NULL, 0) < 0)
+		return -1;
+
+	r->to_submit = 0;
+	return 0;
+}
+
+/* Returns the next free SQE, zeroed, flushing the queue first if it is full.
+ * Returns NULL if the queue is full and could not be flushed: the pending
+ * entries must not be overwritten, a lost registration would stall the FD
+ * forever and a lost cancellation would pin a closed file.
+ */
+static struct io_uring_sqe *uring_get_sqe(struct uring_ctx *r)
+{
+	unsigned int idx;
+
+	if (r->sq_tail_local - HA_ATOMIC_LOAD(r->sq_khead) >= r->sq_entries) {
+		uring_flush(r);
+		if (r->sq_tail_local - HA_ATOMIC_LOAD(r->sq_khead) >= r->sq_entries)
+			return NULL;
+	}
+
+	idx = r->sq_tail_local & *r->sq_kmask;
+	r->sq_array[idx] = idx;
+	r->sq_tail_local++;
+	r->to_submit++;
+
+	memset(&r->sqes[idx], 0, sizeof(r->sqes[idx]));
+	return &r->sqes[idx];
+}
+
+/* Queues the cancellation of the poll request armed on <fd>. Returns 0 on
+ * success, -1 if no room could be made in the ring.
+ */
+static int uring_del_poll(int fd)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(&ring_ctx);
+
+	if (!sqe)
+		return -1;
+
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = fd;
+	sqe->user_data = URING_UDATA_TIMEOUT; // ignored on completion
+	return 0;
+}
+
+/* Replays the poll cancellations that could not be queued earlier. Returns 0
+ * once none remains, -1 if the ring is still full.
+ */
+static int uring_replay_pending_del(void)
+{
+	while (pending_del_cnt) {
+		if (uring_del_poll(pending_del[pending_del_cnt - 1]) < 0)
+			return -1;
+		pending_del_cnt--;
+	}
+	return 0;
+}
+
+/* Queues a one-shot poll request for <fd> with poll events <events>. Returns
+ * 0 on success, -1 if no room could be made in the ring.
+ */
+static int uring_arm_poll(int fd, unsigned int events)
+{
+	struct io_uring_sqe *sqe;
+
+	/* pending cancellations must always be queued first: one of them may
+	 * target a previous incarnation of this very <fd>.
+	 */
+	if (uring_replay_pending_del() < 0)
+		return -1;
+
+	sqe = uring_get_sqe(&ring_ctx);
+	if (!sqe)
+		return -1;
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->user_data = fd;
+#if __BYTE_ORDER == __BIG_ENDIAN
+	events = (events << 16) | (events >> 16);
+#endif
+	sqe->poll32_events = events;
+	return 0;
+}
+
+/* Cancel the pending poll on close. Note that contrary to epoll, a closed FD
+ * is not automatically forgotten by the ring: the pending request pins the
+ * file, so we must cancel the poll we armed ourselves. Requests armed by
+ * other threads on a shared FD are removed by these threads via the regular
+ * update path when they release the FD.
+ */
+static void __fd_clo(int fd)
+{
+	if ((_HA_ATOMIC_LOAD(&polled_mask[fd].poll_recv) |
+	     _HA_ATOMIC_LOAD(&polled_mask[fd].poll_send)) & ti->ltid_bit) {
+		if (uring_del_poll(fd) < 0) {
+			/* the ring is full and the kernel backlogged. The
+			 * cancellation must not be forgotten or the pending
+			 * request would pin the closed file forever, so
+			 * remember it for the next polling round. Losing it
+			 * on an allocation failure is the least bad option
+			 * left at this point.
+			 */
+			uring_defer_fd(&pending_del, &pending_del_cnt, &pending_del_sz, fd);
+		}
+		_HA_ATOMIC_AND(&polled_mask[fd].poll_recv, ~ti->ltid_bit);
+		_HA_ATOMIC_AND(&polled_mask[fd].poll_send, ~ti->ltid_bit);
+	}
+}
+
+/* Reconciles the ring's knowledge of <fd> with its current state, arming,
+ * re-arming or cancelling the poll request as needed. The polled_mask bits
+ * indicate whether a request is currently armed and for which directions.
+ */
+static void _update_fd(int fd)
+{
+	int en;
+	ulong pr, ps;
+	unsigned int events;
+
+	en = fdtab[fd].state;
+	pr = _HA_ATOMIC_LOAD(&polled_mask[fd].poll_recv);
+	ps = _HA_ATOMIC_LOAD(&polled_mask[fd].poll_send);
+
+	/* if we're already polling or are going to poll for this FD and it's
+	 * neither active nor ready, force it to be active so that we don't
+	 * needlessly unsubscribe then re-subscribe it.
+	 */
+	if (!(en & (FD_EV_READY_R | FD_EV_SHUT_R | FD_EV_ERR_RW | FD_POLL_ERR)) &&
+	    ((en & FD_EV_ACTIVE_W) || ((ps | pr) & ti->ltid_bit)))
+		en |= FD_EV_ACTIVE_R;
+
+	if ((ps | pr) & ti->ltid_bit) {
+		if (!(fdtab[fd].thread_mask & ti->ltid_bit) || !(en & FD_EV_ACTIVE_RW)) {
+			/* fd removed from poll list */
+			if (uring_del_poll(fd) < 0)
+				goto defer;
+			if (pr & ti->ltid_bit)
+				_HA_ATOMIC_AND(&polled_mask[fd].poll_recv, ~ti->ltid_bit);
+			if (ps & ti->ltid_bit)
+				_HA_ATOMIC_AND(&polled_mask[fd].poll_send, ~ti->ltid_bit);
+		}
+		else {
+			if (((en & FD_EV_ACTIVE_R) != 0) == ((pr & ti->ltid_bit) != 0) &&
+			    ((en & FD_EV_ACTIVE_W) != 0) == ((ps & ti->ltid_bit) != 0))
+				return;
+
+			/* one-shot requests cannot be modified in place, so
+			 * cancel the pending one and arm a fresh one with the
+			 * new event set.
+			 */
+			if (uring_del_poll(fd) < 0)
+				goto defer;
+			if (en & FD_EV_ACTIVE_R)
+				_HA_ATOMIC_OR(&polled_mask[fd].poll_recv, ti->ltid_bit);
+			else if (pr & ti->ltid_bit)
+				_HA_ATOMIC_AND(&polled_mask[fd].poll_recv, ~ti->ltid_bit);
+			if (en & FD_EV_ACTIVE_W)
+				_HA_ATOMIC_OR(&polled_mask[fd].poll_send, ti->ltid_bit);
+			else if (ps & ti->ltid_bit)
+				_HA_ATOMIC_AND(&polled_mask[fd].poll_send, ~ti->ltid_bit);
+			goto arm;
+		}
+	}
+	else if ((fdtab[fd].thread_mask & ti->ltid_bit) && (en & FD_EV_ACTIVE_RW)) {
+		/* new fd in the poll list */
+		if (en & FD_EV_ACTIVE_R)
+			_HA_ATOMIC_OR(&polled_mask[fd].poll_recv, ti->ltid_bit);
+		if (en & FD_EV_ACTIVE_W)
+			_HA_ATOMIC_OR(&polled_mask[fd].poll_send, ti->ltid_bit);
+		goto arm;
+	}
+	return;
+
+ arm:
+	events = 0;
+	if (en & FD_EV_ACTIVE_R)
+		events |= POLLIN | POLLRDHUP;
+	if (en & FD_EV_ACTIVE_W)
+		events |= POLLOUT;
+
+	if (uring_arm_poll(fd, events) < 0) {
+		/* no request is armed anymore, drop the polled bits so that
+		 * the replay takes the fresh-arm path.
+		 */
+		_HA_ATOMIC_AND(&polled_mask[fd].poll_recv, ~ti->ltid_bit);
+		_HA_ATOMIC_AND(&polled_mask[fd].poll_send, ~ti->ltid_bit);
+		goto defer;
+	}
+	return;
+
+ defer:
+	/* the ring is full with a backlogged kernel, the update will be
+	 * replayed at the next polling round once completions have been
+	 * consumed. _update_fd() is idempotent so duplicate entries are
+	 * harmless. Under memory pressure, fall back to the regular update
+	 * list so that nothing is ever silently dropped.
+	 */
+	if (uring_defer_fd(&pending_upd, &pending_upd_cnt, &pending_upd_sz, fd) < 0)
+		updt_fd_polling(fd);
+}
+
+/*
+ * Linux io_uring poller
+ */
+static void _do_poll(struct poller *p, int exp, int wake)
+{
+	struct uring_ctx *r = &ring_ctx;
+	int status;
+	int fd;
+	int count;
+	int updt_idx;
+	int wait_time;
+	int old_fd;
+	uint64_t spin_until;
+	unsigned int head, tail;
+
+	/* first, replay the cancellations and interest updates that could not
+	 * be queued during the previous round because the submission queue
+	 * was full while the kernel was backlogged.
+	 */
+	uring_replay_pending_del();
+
+	if (pending_upd_cnt) {
+		int cnt = pending_upd_cnt;
+
+		for (updt_idx = 0; updt_idx < cnt; updt_idx++) {
+			fd = pending_upd[updt_idx];
+
+			if (!fd_grab_tgid(fd, tgid))
+				continue;
+
+			if (fdtab[fd].owner)
+				_update_fd(fd);
+
+			fd_drop_tgid(fd);
+		}
+
+		/* entries deferred again during the replay were appended past
+		 * <cnt>, only keep those.
+		 */
+		memmove(pending_upd, pending_upd + cnt,
+		        (pending_upd_cnt - cnt) * sizeof(*pending_upd));
+		pending_upd_cnt -= cnt;
+	}
+
+	/* then, scan the update list to find polling changes */
+	for (updt_idx = 0; updt_idx < fd_nbupdt; updt_idx++) {
+		fd = fd_updt[updt_idx];
+
+		if (!fd_grab_tgid(fd, tgid)) {
+			/* was reassigned */
+			activity[tid].poll_drop_fd++;
+			continue;
+		}
+
+		_HA_ATOMIC_AND(&fdtab[fd].update_mask, ~ti->ltid_bit);
+
+		if (fdtab[fd].owner)
+			_update_fd(fd);
+		else
+			activity[tid].poll_drop_fd++;
+
+		fd_drop_tgid(fd);
+	}
+	fd_nbupdt = 0;
+
+	/* Scan the shared update list */
+	for (old_fd = fd = update_list[tgid - 1].first; fd != -1; fd = fdtab[fd].update.next) {
+		if (fd == -2) {
+			fd = old_fd;
+			continue;
+		}
+		else if (fd <= -3)
+			fd = -fd -4;
+		if (fd == -1)
+			break;
+
+		if (!fd_grab_tgid(fd, tgid)) {
+			/* was reassigned */
+			activity[tid].poll_drop_fd++;
+			continue;
+		}
+
+		if (!(fdtab[fd].update_mask & ti->ltid_bit)) {
+			fd_drop_tgid(fd);
+			continue;
+		}
+
+		done_update_polling(fd);
+
+		if (fdtab[fd].owner)
+			_update_fd(fd);
+		else
+			activity[tid].poll_drop_fd++;
+
+		fd_drop_tgid(fd);
+	}
+
+	thread_idle_now();
+	thread_harmless_now();
+
+	/* Now let's wait for polled events. All SQEs queued during the whole
+	 * loop (interest updates and re-arms) are submitted by this single
+	 * io_uring_enter() call.
+	 */
+	wait_time = wake ? 0 : compute_poll_timeout(exp);
+	spin_until = compute_poll_spin_until(wait_time);
+	clock_entering_poll();
+
+	do {
+		int timeout = (global.tune.options & GTUNE_BUSY_POLLING) ? 0 : wait_time;
+
+		if (unlikely(spin_until) && timeout) {
+			/* adaptive busy-wait phase before really sleeping */
+			if (now_mono_time() < spin_until)
+				timeout = 0;
+			else
+				spin_until = 0;
+		}
+
+		HA_ATOMIC_STORE(r->sq_ktail, r->sq_tail_local);
+
+		if (HA_ATOMIC_LOAD(r->cq_khead) != HA_ATOMIC_LOAD(r->cq_ktail)) {
+			/* completions already pending, only submit */
+			if (uring_enter(r->ring_fd, r->to_submit, 0, 0, NULL, 0) >= 0)
+				r->to_submit = 0;
+		}
+		else if (timeout > 0) {
+			struct __kernel_timespec ts;
+			struct io_uring_getevents_arg arg = { };
+
+			ts.tv_sec  = timeout / 1000;
+			ts.tv_nsec = (timeout % 1000) * 1000000;
+			arg.ts = (unsigned long long)(uintptr_t)&ts;
+
+			if (uring_enter(r->ring_fd, r->to_submit, 1,
+			                IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+			                &arg, sizeof(arg)) >= 0)
+				r->to_submit = 0;
+		}
+		else {
+			if (uring_enter(r->ring_fd, r->to_submit, 0,
+			                IORING_ENTER_GETEVENTS, NULL, 0) >= 0)
+				r->to_submit = 0;
+		}
+
+		head = HA_ATOMIC_LOAD(r->cq_khead);
+		tail = HA_ATOMIC_LOAD(r->cq_ktail);
+		status = tail - head;
+		if (status > global.tune.maxpollevents)
+			status = global.tune.maxpollevents;
+
+		clock_update_local_date(timeout, status);
+
+		if (status) {
+			activity[tid].poll_io++;
+			break;
+		}
+		if (timeout || !wait_time)
+			break;
+		if (tick_isset(exp) && tick_is_expired(exp, now_ms))
+			break;
+	} while (1);
+
+	clock_update_global_date();
+	fd_leaving_poll(wait_time, status);
+
+	/* process polled events */
+
+	for (count = 0; count < status; count++) {
+		struct io_uring_cqe *cqe = &r->cqes[(head + count) & *r->cq_kmask];
+		unsigned int n, e;
+
+		if (cqe->user_data >= (unsigned long long)global.maxsock) {
+			/* control request (cancellation etc), nothing to do */
+			continue;
+		}
+
+		fd = cqe->user_data;
+
+		if (cqe->res < 0) {
+			/* cancelled or raced with a close, the FD state was
+			 * already updated at cancellation time.
+			 */
+			continue;
+		}
+
+		e = cqe->res;
+
+		if ((e & POLLRDHUP) && !(cur_poller.flags & HAP_POLL_F_RDHUP))
+			_HA_ATOMIC_OR(&cur_poller.flags, HAP_POLL_F_RDHUP);
+
+#ifdef DEBUG_FD
+		_HA_ATOMIC_INC(&fdtab[fd].event_count);
+#endif
+		n = ((e & POLLIN)    ? FD_EV_READY_R : 0) |
+		    ((e & POLLOUT)   ? FD_EV_READY_W : 0) |
+		    ((e & POLLRDHUP) ? FD_EV_SHUT_R  : 0) |
+		    ((e & POLLHUP)   ? FD_EV_SHUT_RW : 0) |
+		    ((e & POLLERR)   ? FD_EV_ERR_RW  : 0);
+
+		/* the one-shot request was consumed by this completion */
+		_HA_ATOMIC_AND(&polled_mask[fd].poll_recv, ~ti->ltid_bit);
+		_HA_ATOMIC_AND(&polled_mask[fd].poll_send, ~ti->ltid_bit);
+
+		fd_update_events(fd, n);
+
+		/* re-arm the FD if it's still ours and still active; the new
+		 * SQE will be flushed by the next polling round's enter call.
+		 */
+		if (fd_grab_tgid(fd, tgid)) {
+			if (fdtab[fd].owner)
+				_update_fd(fd);
+			fd_drop_tgid(fd);
+		}
+	}
+
+	HA_ATOMIC_STORE(r->cq_khead, head + count);
+	/* the caller will take care of cached events */
+}
+
+static int init_uring_per_thread()
+{
+	if (tid) {
+		if (uring_create(&ring_ctx) < 0)
+			return 0;
+	}
+	ring_ok = 1;
+
+	/* we may have to unregister some events initially registered on the
+	 * original fd when it was alone, and/or to register events on the new
+	 * fd for this thread. Let's just mark them as updated, the poller will
+	 * do the rest.
+	 */
+	fd_reregister_all(tgid, ti->ltid_bit);
+
+	return 1;
+}
+
+static void deinit_uring_per_thread()
+{
+	if (tid)
+		uring_destroy(&ring_ctx);
+	ring_ok = 0;
+
+	ha_free(&pending_del);
+	pending_del_cnt = pending_del_sz = 0;
+	ha_free(&pending_upd);
+	pending_upd_cnt = pending_upd_sz = 0;
+}
+
+/*
+ * Initialization of the io_uring poller.
+ * Returns 0 in case of failure, non-zero in case of success. If it fails, it
+ * disables the poller by setting its pref to 0.
+ */
+static int _do_init(struct poller *p)
+{
+	p->private = NULL;
+
+	if (uring_create(&ring_ctx) < 0)
+		goto fail;
+
+	ring_ok = 1;
+
+	hap_register_per_thread_init(init_uring_per_thread);
+	hap_register_per_thread_deinit(deinit_uring_per_thread);
+
+	return 1;
+
+ fail:
+	p->pref = 0;
+	return 0;
+}
+
+/*
+ * Termination of the io_uring poller.
+ * The ring is released and the poller is marked as unselectable.
+ */
+static void _do_term(struct poller *p)
+{
+	uring_destroy(&ring_ctx);
+	ring_ok = 0;
+
+	p->private = NULL;
+	p->pref = 0;
+}
+
+/*
+ * Check that the poller works.
+ * Returns 1 if OK, otherwise 0.
+ */
+static int _do_test(struct poller *p)
+{
+	struct uring_ctx tmp = { .ring_fd = -1 };
+
+	if (uring_create(&tmp) < 0)
+		return 0;
+	uring_destroy(&tmp);
+	return 1;
+}
+
+/*
+ * Recreate the ring after a fork(). Returns 1 if OK, otherwise 0. Rings are
+ * never shared between processes.
+ */
+static int _do_fork(struct poller *p)
+{
+	uring_destroy(&ring_ctx);
+	if (uring_create(&ring_ctx) < 0)
+		return 0;
+	return 1;
+}
+
+/*
+ * Registers the poller.
+ */
+static void _do_register(void)
+{
+	struct poller *p;
+
+	if (nbpollers >= MAX_POLLERS)
+		return;
+
+	p = &pollers[nbpollers++];
+
+	p->name = "uring";
+	p->pref = 290; // slightly below epoll until more widely proven
+	p->flags = HAP_POLL_F_ERRHUP; // note: RDHUP might be dynamically added
+	p->private = NULL;
+
+	p->clo  = __fd_clo;
+	p->test = _do_test;
+	p->init = _do_init;
+	p->term = _do_term;
+	p->poll = _do_poll;
+	p->fork = _do_fork;
+}
+
+INITCALL0(STG_REGISTER, _do_register);
+
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -612,6 +612,13 @@ static int _event_hdl_publish(event_hdl_sub_list *sub_list, struct event_hdl_sub
 	struct event_hdl_async_event_data *async_data = NULL; /* reuse async data for multiple async hdls */
 	int error = 0;
 
+	/* Fast path: don't even walk the list when nobody subscribed. This
+	 * keeps publishers of rarely-observed events (e.g.: server state
+	 * changes during mass flaps) almost free.
+	 */
+	if (MT_LIST_ISEMPTY(sub_list))
+		return 1;
+
 	mt_list_for_each_entry_safe(cur_sub, sub_list, mt_list, elt1, elt2) {
 		/* notify each function that has subscribed to sub_family.type */
 		if ((cur_sub->sub.family == e_type.family) &&
@@ -740,6 +747,16 @@ int event_hdl_publish(event_hdl_sub_list *sub_list,
 	}
 }
 
+/* tells whether a subscription list currently has subscribers
+ * (see the doc in the header file about the racy nature of this check)
+ */
+int event_hdl_sub_list_empty(event_hdl_sub_list *sub_list)
+{
+	if (!sub_list)
+		sub_list = &global_event_hdl_sub_list; /* fall back to global list */
+	return MT_LIST_ISEMPTY(sub_list);
+}
+
 /* when a subscription list is no longer used, call this
  * to do the cleanup and make sure all related subscriptions are
  * safely ended according to their types
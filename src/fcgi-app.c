@@ -14,6 +14,7 @@
 #include <haproxy/api.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/chunk.h>
+#include <haproxy/clock.h>
 #include <haproxy/errors.h>
 #include <haproxy/fcgi-app.h>
 #include <haproxy/filters.h>
@@ -339,12 +340,9 @@ static int fcgi_flt_http_headers(struct stream *s, struct filter *filter, struct
 		/* Add the header "Date:" if not found */
 		ctx.blk = NULL;
 		if (!http_find_header(htx, ist("date"), &ctx, 1)) {
-			struct tm tm;
+			const char *gmt_date = gmtdate2str_rfc7231_cached(date.tv_sec);
 
-			get_gmtime(date.tv_sec, &tm);
-			trash.data = strftime(trash.area, trash.size, "%a, %d %b %Y %T %Z", &tm);
-			if (trash.data)
-				http_add_header(htx, ist("date"), ist2(trash.area, trash.data));
+			http_add_header(htx, ist("date"), ist(gmt_date));
 		}
 
 		/* Add the header "Content-Length:" if possible */
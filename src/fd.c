@@ -87,9 +87,15 @@
 #include <errno.h>
 #endif
 
+#if defined(__linux__)
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#endif
+
 #include <haproxy/api.h>
 #include <haproxy/activity.h>
 #include <haproxy/cfgparse.h>
+#include <haproxy/clock.h>
 #include <haproxy/fd.h>
 #include <haproxy/global.h>
 #include <haproxy/log.h>
@@ -938,6 +944,38 @@ int compute_poll_timeout(int next)
 	return wait_time;
 }
 
+/* EWMA of the inter-arrival time of I/O wakeups and date of the last one,
+ * both in monotonic nanoseconds, used to decide whether busy-waiting a little
+ * before sleeping has a chance to pay off.
+ */
+static THREAD_LOCAL uint64_t poll_io_gap_ns;
+static THREAD_LOCAL uint64_t poll_last_io_ns;
+
+/* Computes the monotonic date until which the poller may keep polling with a
+ * zero timeout before really sleeping for <wait_time>, or 0 when it should
+ * not spin at all. Spinning is enabled by tune.poll.spin-time and is adaptive:
+ * it is only engaged when I/O wakeups have recently been arriving at
+ * intervals comparable to the spin budget, so that an idle thread does not
+ * burn CPU with no chance of catching an event, while a busy one skips the
+ * poller sleep/wakeup latency between two closely spaced events.
+ */
+uint64_t compute_poll_spin_until(int wait_time)
+{
+	uint64_t budget = (uint64_t)global.tune.poll_spin_us * 1000ULL;
+	uint64_t now;
+
+	if (likely(!budget) || !wait_time)
+		return 0;
+
+	if (!poll_last_io_ns || poll_io_gap_ns > 4 * budget)
+		return 0;
+
+	now = now_mono_time();
+	if (!now)
+		return 0;
+	return now + budget;
+}
+
 /* Handle the return of the poller, which consists in calculating the idle
  * time, saving a few clocks, marking the thread harmful again etc. All that
  * is some boring stuff that all pollers have to do anyway.
@@ -946,6 +984,17 @@ void fd_leaving_poll(int wait_time, int status)
 {
 	clock_leaving_poll(wait_time, status);
 
+	if (status > 0 && unlikely(global.tune.poll_spin_us)) {
+		uint64_t now = now_mono_time();
+
+		/* update the I/O inter-arrival time estimate */
+		if (now) {
+			if (poll_last_io_ns)
+				poll_io_gap_ns += ((int64_t)(now - poll_last_io_ns) - (int64_t)poll_io_gap_ns) / 8;
+			poll_last_io_ns = now;
+		}
+	}
+
 	thread_harmless_end();
 	thread_idle_end();
 
@@ -1017,6 +1066,60 @@ static void free_pollers_per_thread()
 	ha_free(&fd_updt);
 }
 
+/* Applies the configured NUMA placement policy to the <len> bytes at <addr>.
+ * With "numa-policy interleave", the pages of the large arrays shared by all
+ * threads (fdtab, polled_mask, fdinfo) are spread over all NUMA nodes instead
+ * of all landing on the node of the thread which first touched them (usually
+ * node 0, penalizing every other node). Best effort only: alignment is
+ * adjusted to full pages, and any failure (kernel without NUMA support,
+ * single-node machine, etc) is silently ignored since the default placement
+ * remains correct.
+ */
+static void numa_apply_policy(void *addr, size_t len)
+{
+#if defined(__linux__) && defined(__NR_mbind)
+#define HAP_MPOL_INTERLEAVE 3
+	unsigned long nodemask = 0;
+	size_t start, end;
+	long pagesz;
+	char path[64];
+	struct stat st;
+	int node;
+
+	if (global.numa_policy != NUMA_POLICY_INTERLEAVE)
+		return;
+
+	/* enumerate the usable nodes; mbind() rejects masks referencing
+	 * non-existing ones.
+	 */
+	for (node = 0; node < (int)(8 * sizeof(nodemask)); node++) {
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", node);
+		if (stat(path, &st) != 0)
+			break;
+		nodemask |= 1UL << node;
+	}
+
+	if (!nodemask || !(nodemask & (nodemask - 1)))
+		return; // zero or one node: nothing to spread
+
+	pagesz = sysconf(_SC_PAGESIZE);
+	if (pagesz <= 0)
+		return;
+
+	/* mbind() requires a page-aligned start; only the fully covered pages
+	 * are rebound, the heads and tails stay on their default node.
+	 */
+	start = ((size_t)addr + pagesz - 1) & -(size_t)pagesz;
+	end   = ((size_t)addr + len) & -(size_t)pagesz;
+	if (end <= start)
+		return;
+
+	syscall(__NR_mbind, start, end - start, HAP_MPOL_INTERLEAVE,
+	        &nodemask, 8 * sizeof(nodemask), 0);
+#undef HAP_MPOL_INTERLEAVE
+#endif
+}
+
 /*
  * Initialize the pollers till the best one is found.
  * If none works, returns 0, otherwise 1.
@@ -1033,16 +1136,19 @@ int init_pollers()
 
 	/* always provide an aligned fdtab */
 	fdtab = (struct fdtab*)((((size_t)fdtab_addr) + 63) & -(size_t)64);
+	numa_apply_policy(fdtab_addr, global.maxsock * (sizeof(*fdtab) + 64));
 
 	if ((polled_mask = calloc(global.maxsock, sizeof(*polled_mask))) == NULL) {
 		ha_alert("Not enough memory to allocate %d entries for polled_mask!\n", global.maxsock);
 		goto fail_polledmask;
 	}
+	numa_apply_policy(polled_mask, global.maxsock * sizeof(*polled_mask));
 
 	if ((fdinfo = calloc(global.maxsock, sizeof(*fdinfo))) == NULL) {
 		ha_alert("Not enough memory to allocate %d entries for fdinfo!\n", global.maxsock);
 		goto fail_info;
 	}
+	numa_apply_policy(fdinfo, global.maxsock * sizeof(*fdinfo));
 
 	for (p = 0; p < MAX_TGROUPS; p++)
 		update_list[p].first = update_list[p].last = -1;
@@ -1195,9 +1301,38 @@ static int cfg_parse_tune_fd_edge_triggered(char **args, int section_type, struc
 	return 0;
 }
 
+/* config parser for global "tune.poll.spin-time", accepts a time value from 0
+ * (disabled) to 1ms, microseconds by default.
+ */
+static int cfg_parse_tune_poll_spin_time(char **args, int section_type, struct proxy *curpx,
+                                      const struct proxy *defpx, const char *file, int line,
+                                      char **err)
+{
+	const char *res;
+	unsigned int spin;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	res = parse_time_err(args[1], &spin, TIME_UNIT_US);
+	if (res == PARSE_TIME_OVER || spin > 1000) {
+		memprintf(err, "timer <%s> to argument <%s> of '%s' overflows, maximum value is 1000 us",
+			  args[1], args[0], args[0]);
+		return -1;
+	}
+	else if (res) {
+		memprintf(err, "unexpected character '%c' in argument <%s> of '%s'", *res, args[0], args[0]);
+		return -1;
+	}
+
+	global.tune.poll_spin_us = spin;
+	return 0;
+}
+
 /* config keyword parsers */
 static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_GLOBAL, "tune.fd.edge-triggered", cfg_parse_tune_fd_edge_triggered, KWF_EXPERIMENTAL },
+	{ CFG_GLOBAL, "tune.poll.spin-time", cfg_parse_tune_poll_spin_time },
 	{ 0, NULL, NULL }
 }};
 
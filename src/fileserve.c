@@ -0,0 +1,539 @@
+/*
+ * Static file service applet.
+ *
+ * Copyright 2023 HAProxy Technologies
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <haproxy/action.h>
+#include <haproxy/api.h>
+#include <haproxy/applet.h>
+#include <haproxy/channel.h>
+#include <haproxy/chunk.h>
+#include <haproxy/http.h>
+#include <haproxy/http_ana-t.h>
+#include <haproxy/http_htx.h>
+#include <haproxy/htx.h>
+#include <haproxy/proxy-t.h>
+#include <haproxy/sc_strm.h>
+#include <haproxy/stconn.h>
+#include <haproxy/stream.h>
+#include <haproxy/tools.h>
+
+/* Applet state, in appctx->st0 */
+enum {
+	FSRV_ST_INIT = 0,  /* resolve the path and open the file */
+	FSRV_ST_HEAD,      /* send the response headers */
+	FSRV_ST_DATA,      /* stream the file contents */
+	FSRV_ST_DONE,      /* mark the end of the response */
+	FSRV_ST_END,       /* close */
+};
+
+/* Applet context, stored in appctx->svcctx */
+struct fsrv_ctx {
+	int fd;              /* fd of the file being served, or -1 */
+	int status;          /* HTTP status of the response */
+	unsigned long long size;    /* file size in bytes */
+	unsigned long long offset;  /* bytes of the file already sent */
+	unsigned long long mtime;   /* file modification time, for the ETag */
+	const char *ctype;   /* content-type derived from the extension */
+};
+
+/* Number of entries of each thread's open file cache. The working set on the
+ * target use case (a handful of huge assets) is tiny, so a small round-robin
+ * cache keyed on the resolved path is enough to elide open()+close() on the
+ * fast path.
+ */
+#define FSRV_CACHE_ENTRIES 8
+
+struct fsrv_cache_entry {
+	char *path;          /* resolved file path, NULL for an empty slot */
+	int fd;
+	ino_t ino;           /* inode/mtime/size used to detect replaced files */
+	unsigned long long mtime;
+	unsigned long long size;
+};
+
+static THREAD_LOCAL struct fsrv_cache_entry fsrv_cache[FSRV_CACHE_ENTRIES];
+static THREAD_LOCAL unsigned int fsrv_cache_next; /* next slot to evict */
+
+/* minimal extension to content-type mapping, defaulting to octet-stream */
+static const struct {
+	const char *ext;
+	const char *type;
+} fsrv_mime_types[] = {
+	{ "html",  "text/html"              },
+	{ "htm",   "text/html"              },
+	{ "css",   "text/css"               },
+	{ "js",    "application/javascript" },
+	{ "json",  "application/json"       },
+	{ "txt",   "text/plain"             },
+	{ "svg",   "image/svg+xml"          },
+	{ "png",   "image/png"              },
+	{ "jpg",   "image/jpeg"             },
+	{ "jpeg",  "image/jpeg"             },
+	{ "gif",   "image/gif"              },
+	{ "ico",   "image/x-icon"           },
+	{ "wasm",  "application/wasm"       },
+	{ "woff2", "font/woff2"             },
+	{ NULL,    NULL                     }
+};
+
+static const char *fsrv_get_ctype(const char *path)
+{
+	const char *ext = strrchr(path, '.');
+	int i;
+
+	if (ext && !strchr(ext, '/')) {
+		ext++;
+		for (i = 0; fsrv_mime_types[i].ext; i++) {
+			if (strcasecmp(ext, fsrv_mime_types[i].ext) == 0)
+				return fsrv_mime_types[i].type;
+		}
+	}
+	return "application/octet-stream";
+}
+
+/* Returns an fd opened on <path>, which must point to a regular file whose
+ * current attributes are in <st>, taking it from the thread-local cache when
+ * possible. The returned fd is always a dup() owned by the caller so that a
+ * later cache eviction cannot close it behind an applet still streaming from
+ * it (pread() never touches the fd's offset so sharing the open file is safe).
+ * Returns -1 on error.
+ */
+static int fsrv_get_fd(const char *path, const struct stat *st)
+{
+	struct fsrv_cache_entry *ent;
+	int fd;
+	int i;
+
+	for (i = 0; i < FSRV_CACHE_ENTRIES; i++) {
+		ent = &fsrv_cache[i];
+		if (!ent->path || strcmp(ent->path, path) != 0)
+			continue;
+		if (ent->ino == st->st_ino && ent->mtime == (unsigned long long)st->st_mtime &&
+		    ent->size == (unsigned long long)st->st_size)
+			return dup(ent->fd);
+		/* the file was replaced in place, drop the stale entry */
+		close(ent->fd);
+		ha_free(&ent->path);
+		break;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	/* install it into the next round-robin slot */
+	ent = &fsrv_cache[fsrv_cache_next];
+	fsrv_cache_next = (fsrv_cache_next + 1) % FSRV_CACHE_ENTRIES;
+	if (ent->path) {
+		close(ent->fd);
+		ha_free(&ent->path);
+	}
+	ent->path = strdup(path);
+	if (ent->path) {
+		ent->fd = fd;
+		ent->ino = st->st_ino;
+		ent->mtime = (unsigned long long)st->st_mtime;
+		ent->size = (unsigned long long)st->st_size;
+		return dup(fd);
+	}
+	/* allocation failed: serve without caching */
+	return fd;
+}
+
+/* builds the ETag of the file described by <ctx> into a trash chunk and
+ * returns it as an ist. The format is the classical "mtime-size" in hex.
+ */
+static struct ist fsrv_make_etag(struct fsrv_ctx *ctx, struct buffer *out)
+{
+	chunk_printf(out, "\"%llx-%llx\"", ctx->mtime, ctx->size);
+	return ist2(out->area, out->data);
+}
+
+/* Resolves the request path below the service's root directory, opens the
+ * file and decides the response status (200, 304 on If-None-Match, or an
+ * error). Returns 1 on success (including errors turned into an HTTP status)
+ * and -1 if the request itself cannot be exploited.
+ */
+static int fsrv_prepare_resp(struct appctx *appctx, struct stconn *sc)
+{
+	struct fsrv_ctx *ctx = appctx->svcctx;
+	struct stream *s = __sc_strm(sc);
+	const char *root = appctx->rule->arg.act.p[0];
+	struct channel *req = sc_oc(sc);
+	struct htx *req_htx;
+	struct htx_sl *sl;
+	struct http_uri_parser parser;
+	struct ist path;
+	struct buffer *fpath;
+	struct stat st;
+
+	ctx->status = 500;
+
+	req_htx = htxbuf(&req->buf);
+	sl = http_get_stline(req_htx);
+	if (!sl)
+		return -1;
+
+	if (s->txn->meth != HTTP_METH_GET && s->txn->meth != HTTP_METH_HEAD) {
+		ctx->status = 405;
+		return 1;
+	}
+
+	parser = http_uri_parser_init(htx_sl_req_uri(sl));
+	path = http_parse_path(&parser);
+	if (!isttest(path)) {
+		ctx->status = 400;
+		return 1;
+	}
+
+	/* strip the query-string if any */
+	path.len = memchr(istptr(path), '?', istlen(path)) ?
+		(char *)memchr(istptr(path), '?', istlen(path)) - istptr(path) : istlen(path);
+
+	/* refuse any dot-dot segment instead of trying to normalize it */
+	if (istlen(path) >= 2) {
+		const char *p = istptr(path);
+		const char *end = p + istlen(path) - 1;
+
+		for (; p < end; p++) {
+			if (p[0] == '.' && p[1] == '.' &&
+			    (p == istptr(path) || p[-1] == '/') &&
+			    (p + 2 > end || p[2] == '/')) {
+				ctx->status = 403;
+				return 1;
+			}
+		}
+	}
+
+	fpath = get_trash_chunk();
+	chunk_printf(fpath, "%s%.*s", root, (int)istlen(path), istptr(path));
+	if (fpath->data >= fpath->size - strlen("index.html")) {
+		ctx->status = 414;
+		return 1;
+	}
+	if (fpath->area[fpath->data - 1] == '/')
+		chunk_appendf(fpath, "index.html");
+
+	if (stat(fpath->area, &st) < 0) {
+		ctx->status = (errno == ENOENT || errno == ENOTDIR) ? 404 :
+			(errno == EACCES) ? 403 : 500;
+		return 1;
+	}
+	if (!S_ISREG(st.st_mode)) {
+		ctx->status = 403;
+		return 1;
+	}
+
+	ctx->size   = (unsigned long long)st.st_size;
+	ctx->mtime  = (unsigned long long)st.st_mtime;
+	ctx->ctype  = fsrv_get_ctype(fpath->area);
+	ctx->status = 200;
+
+	/* If-None-Match: only the exact strong form we emit, or "*" */
+	if (1) {
+		struct http_hdr_ctx hctx = { .blk = NULL };
+		struct ist etag = fsrv_make_etag(ctx, get_trash_chunk());
+
+		while (http_find_header(req_htx, ist("if-none-match"), &hctx, 0)) {
+			if (isteq(hctx.value, ist("*")) || isteq(hctx.value, etag)) {
+				ctx->status = 304;
+				return 1;
+			}
+		}
+	}
+
+	ctx->fd = fsrv_get_fd(fpath->area, &st);
+	if (ctx->fd < 0) {
+		ctx->status = (errno == EACCES) ? 403 : 500;
+		return 1;
+	}
+	return 1;
+}
+
+/* Sends the response headers for the status decided above. Returns 1 on
+ * success, 0 if it needs more room.
+ */
+static int fsrv_send_headers(struct appctx *appctx, struct stconn *sc, struct htx *htx)
+{
+	struct fsrv_ctx *ctx = appctx->svcctx;
+	struct channel *chn = sc_ic(sc);
+	unsigned int flags = HTX_SL_F_IS_RESP | HTX_SL_F_VER_11 | HTX_SL_F_XFER_LEN;
+	char status_str[4];
+	struct htx_sl *sl;
+	struct buffer *clen;
+
+	if (ctx->status == 304 || ctx->status != 200)
+		flags |= HTX_SL_F_BODYLESS;
+	if (ctx->status != 304)
+		flags |= HTX_SL_F_CLEN;
+
+	snprintf(status_str, sizeof(status_str), "%d", ctx->status);
+	sl = htx_add_stline(htx, HTX_BLK_RES_SL, flags, ist("HTTP/1.1"),
+			    ist(status_str), ist(http_get_reason(ctx->status)));
+	if (!sl)
+		goto full;
+	sl->info.res.status = ctx->status;
+
+	if (ctx->status == 200 || ctx->status == 304) {
+		struct ist etag = fsrv_make_etag(ctx, get_trash_chunk());
+
+		if (!htx_add_header(htx, ist("ETag"), etag))
+			goto full;
+	}
+
+	if (ctx->status == 200 &&
+	    !htx_add_header(htx, ist("Content-Type"), ist(ctx->ctype)))
+		goto full;
+
+	if (ctx->status != 304) {
+		clen = get_trash_chunk();
+		chunk_printf(clen, "%llu", (ctx->status == 200) ? ctx->size : 0ULL);
+		if (!htx_add_header(htx, ist("Content-Length"), ist2(clen->area, clen->data)))
+			goto full;
+	}
+
+	if (!htx_add_endof(htx, HTX_BLK_EOH))
+		goto full;
+
+	channel_add_input(chn, htx->data);
+	return 1;
+  full:
+	htx_reset(htx);
+	sc_need_room(sc);
+	return 0;
+}
+
+/* Streams the file contents. Returns 1 once the whole file was pushed, 0 if
+ * it must yield, and -1 on error.
+ */
+static int fsrv_send_data(struct appctx *appctx, struct stconn *sc, struct htx *htx)
+{
+	struct fsrv_ctx *ctx = appctx->svcctx;
+	struct channel *chn = sc_ic(sc);
+	struct buffer *tmp = get_trash_chunk();
+	size_t room, sent;
+	ssize_t ret;
+
+	while (ctx->offset < ctx->size) {
+		room = htx_free_data_space(htx);
+		if (!room) {
+			sc_need_room(sc);
+			return 0;
+		}
+		if (room > tmp->size)
+			room = tmp->size;
+		if (room > ctx->size - ctx->offset)
+			room = ctx->size - ctx->offset;
+
+		ret = pread(ctx->fd, tmp->area, room, ctx->offset);
+		if (ret <= 0) {
+			/* unreadable or truncated under us: we cannot
+			 * recover since the content-length was committed.
+			 */
+			return -1;
+		}
+
+		sent = htx_add_data(htx, ist2(tmp->area, ret));
+		if (!sent) {
+			sc_need_room(sc);
+			return 0;
+		}
+		ctx->offset += sent;
+		channel_add_input(chn, sent);
+	}
+	return 1;
+}
+
+static int fsrv_appctx_init(struct appctx *appctx)
+{
+	struct fsrv_ctx *ctx = applet_reserve_svcctx(appctx, sizeof(struct fsrv_ctx));
+
+	ctx->fd = -1;
+	appctx->st0 = FSRV_ST_INIT;
+	return 0;
+}
+
+static void fsrv_appctx_release(struct appctx *appctx)
+{
+	struct fsrv_ctx *ctx = appctx->svcctx;
+
+	if (ctx && ctx->fd >= 0) {
+		close(ctx->fd);
+		ctx->fd = -1;
+	}
+}
+
+/* The main I/O handler of the serve-file applet */
+static void fsrv_appctx_handle_io(struct appctx *appctx)
+{
+	struct stconn *sc = appctx_sc(appctx);
+	struct stream *s = __sc_strm(sc);
+	struct fsrv_ctx *ctx = appctx->svcctx;
+	struct channel *req = sc_oc(sc);
+	struct channel *res = sc_ic(sc);
+	struct htx *req_htx, *res_htx;
+	int ret;
+
+	res_htx = htx_from_buf(&res->buf);
+	if (unlikely(sc->state == SC_ST_DIS || sc->state == SC_ST_CLO))
+		goto out;
+
+	/* Check if the output buffer is available. */
+	if (!b_size(&res->buf)) {
+		sc_need_room(sc);
+		goto out;
+	}
+
+	switch (appctx->st0) {
+		case FSRV_ST_INIT:
+			ret = fsrv_prepare_resp(appctx, sc);
+			if (ret < 0)
+				goto error;
+			appctx->st0 = FSRV_ST_HEAD;
+			__fallthrough;
+
+		case FSRV_ST_HEAD:
+			if (!fsrv_send_headers(appctx, sc, res_htx))
+				goto out;
+			appctx->st0 = (ctx->status == 200 && s->txn->meth != HTTP_METH_HEAD) ?
+				FSRV_ST_DATA : FSRV_ST_DONE;
+			if (appctx->st0 == FSRV_ST_DONE)
+				goto done;
+			__fallthrough;
+
+		case FSRV_ST_DATA:
+			ret = fsrv_send_data(appctx, sc, res_htx);
+			if (ret <= 0) {
+				if (ret == -1)
+					goto error;
+				goto out;
+			}
+			appctx->st0 = FSRV_ST_DONE;
+			__fallthrough;
+
+		case FSRV_ST_DONE:
+		done:
+			/* no more data are expected. If the response buffer is
+			 * empty, be sure to add something (EOT block in this
+			 * case) to have something to send. It is important to
+			 * be sure the EOM flags will be handled by the
+			 * endpoint.
+			 */
+			if (htx_is_empty(res_htx)) {
+				if (!htx_add_endof(res_htx, HTX_BLK_EOT)) {
+					sc_need_room(sc);
+					goto out;
+				}
+				channel_add_input(res, 1);
+			}
+			res_htx->flags |= HTX_FL_EOM;
+			res->flags |= CF_EOI;
+			se_fl_set(appctx->sedesc, SE_FL_EOI);
+			appctx->st0 = FSRV_ST_END;
+			__fallthrough;
+
+		case FSRV_ST_END:
+			if (!(res->flags & CF_SHUTR)) {
+				res->flags |= CF_READ_EVENT;
+				sc_shutr(sc);
+			}
+	}
+
+  out:
+	htx_to_buf(res_htx, &res->buf);
+
+	/* eat the whole request */
+	if (co_data(req)) {
+		req_htx = htx_from_buf(&req->buf);
+		co_htx_skip(req, req_htx, co_data(req));
+	}
+	return;
+
+  error:
+	res->flags |= CF_READ_EVENT;
+	sc_shutr(sc);
+	sc_shutw(sc);
+	goto out;
+}
+
+struct applet fsrv_applet = {
+	.obj_type = OBJ_TYPE_APPLET,
+	.name = "<FILESERVE>", /* used for logging */
+	.init = fsrv_appctx_init,
+	.release = fsrv_appctx_release,
+	.fct = fsrv_appctx_handle_io,
+};
+
+/* release the root directory attached to the rule */
+static void release_serve_file(struct act_rule *rule)
+{
+	ha_free(&rule->arg.act.p[0]);
+}
+
+/* parses "use-service serve-file <root>" */
+static enum act_parse_ret service_parse_serve_file(const char **args, int *cur_arg, struct proxy *px,
+						   struct act_rule *rule, char **err)
+{
+	const char *root = args[*cur_arg];
+	struct stat st;
+	char *copy;
+	int len;
+
+	/* the serve-file service is only available on "http-request" rulesets */
+	if (rule->from != ACT_F_HTTP_REQ) {
+		memprintf(err, "serve-file service only available on 'http-request' rulesets");
+		return ACT_RET_PRS_ERR;
+	}
+
+	if (!root || !*root) {
+		memprintf(err, "serve-file service expects a <root> directory argument");
+		return ACT_RET_PRS_ERR;
+	}
+	if (*root != '/') {
+		memprintf(err, "serve-file service's <root> must be an absolute path");
+		return ACT_RET_PRS_ERR;
+	}
+	if (stat(root, &st) < 0 || !S_ISDIR(st.st_mode)) {
+		memprintf(err, "serve-file service's <root> '%s' is not a readable directory", root);
+		return ACT_RET_PRS_ERR;
+	}
+
+	copy = strdup(root);
+	if (!copy) {
+		memprintf(err, "out of memory");
+		return ACT_RET_PRS_ERR;
+	}
+	/* strip trailing slashes, the request path always starts with one */
+	for (len = strlen(copy); len > 0 && copy[len - 1] == '/'; len--)
+		copy[len - 1] = 0;
+
+	rule->arg.act.p[0] = copy;
+	rule->release_ptr = release_serve_file;
+	(*cur_arg)++;
+
+	/* Add applet pointer in the rule. */
+	rule->applet = fsrv_applet;
+
+	return ACT_RET_PRS_OK;
+}
+
+static struct action_kw_list service_actions = { ILH, {
+	{ "serve-file", service_parse_serve_file },
+	{ /* END */ }
+}};
+
+INITCALL1(STG_REGISTER, service_keywords_register, &service_actions);
@@ -96,17 +96,21 @@ static int bwlim_apply_limit(struct filter *filter, struct channel *chn, unsigne
 
 		/* In shared mode, get a pointer on the stick table entry. it
 		 * will be used to get the freq-counter. It is also used to get
-		 * The number of users.
+		 * The number of users. The entry's lock is not needed: the
+		 * freq-counter functions are thread-safe by themselves and the
+		 * number of users is only a hint to split the quota, so a racy
+		 * read is harmless. Any transient overshoot caused by
+		 * concurrent updates is caught by the overshoot check on the
+		 * next call.
 		 */
 		ptr = stktable_data_ptr(conf->table.t, st->ts, type);
 		if (!ptr)
 			goto end;
 
-		HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &st->ts->lock);
 		bytes_rate = &stktable_data_cast(ptr, std_t_frqp);
 		period = conf->table.t->data_arg[type].u;
 		limit = conf->limit;
-		users = st->ts->ref_cnt;
+		users = HA_ATOMIC_LOAD(&st->ts->ref_cnt);
 	}
 	else {
 		/* On per-stream mode, the freq-counter is private to the
@@ -130,8 +134,6 @@ static int bwlim_apply_limit(struct filter *filter, struct channel *chn, unsigne
 	 */
 	overshoot = freq_ctr_overshoot_period(bytes_rate, period, limit);
 	if (overshoot > 0) {
-		if (conf->flags & BWLIM_FL_SHARED)
-			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &st->ts->lock);
 		wait = div64_32((uint64_t)(conf->min_size + overshoot) * period * users,
 				limit);
 		st->exp = tick_add(now_ms, (wait ? wait : 1));
@@ -171,9 +173,6 @@ static int bwlim_apply_limit(struct filter *filter, struct channel *chn, unsigne
 		st->exp = tick_add(now_ms, (wait ? wait : 1));
 	}
 
-	if (conf->flags & BWLIM_FL_SHARED)
-		HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &st->ts->lock);
-
   end:
 	chn->analyse_exp = tick_first((tick_is_expired(chn->analyse_exp, now_ms) ? TICK_ETERNITY : chn->analyse_exp),
 				      st->exp);
@@ -0,0 +1,416 @@
+/*
+ * Request mirroring filter.
+ *
+ * This filter duplicates the requests received on a proxy to a shadow
+ * destination, using the internal HTTP client. The copy is asynchronous and
+ * fire-and-forget: the mirrored traffic never slows down nor alters the
+ * primary path. The amount of in-flight mirrored requests is bounded and new
+ * requests are simply dropped when the shadow destination cannot keep up.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <haproxy/api.h>
+#include <haproxy/channel-t.h>
+#include <haproxy/filters.h>
+#include <haproxy/global.h>
+#include <haproxy/http.h>
+#include <haproxy/http_ana-t.h>
+#include <haproxy/http_client.h>
+#include <haproxy/http_htx.h>
+#include <haproxy/htx.h>
+#include <haproxy/proxy-t.h>
+#include <haproxy/stream.h>
+#include <haproxy/tools.h>
+
+const char *mirror_flt_id = "mirror filter";
+
+struct flt_ops mirror_ops;
+
+#define MIRROR_DFLT_MAXREQ 64
+
+struct mirror_config {
+	struct proxy *proxy;
+	char         *uri;       /* scheme and authority of the shadow destination */
+	unsigned int  maxreq;    /* max in-flight mirrored requests */
+	unsigned int  in_flight; /* current in-flight mirrored requests */
+	unsigned int  dropped;   /* requests not mirrored because of the load */
+};
+
+struct mirror_state {
+	struct httpclient *hc;   /* client of the mirrored request being built */
+};
+
+DECLARE_STATIC_POOL(pool_head_mirror_state, "mirror_state", sizeof(struct mirror_state));
+
+/* Called by the httpclient applet when it is ready to send more payload. The
+ * data is pushed from the stream's http_payload callback instead, so there is
+ * nothing to do here: the callback only exists so that the request is kept
+ * open until the end of the mirrored message is seen.
+ */
+static void mirror_hc_req_payload(struct httpclient *hc)
+{
+}
+
+/* Called by the httpclient applet when the mirrored exchange ends, on
+ * success, error or timeout alike. The caller is cleared when the mirror was
+ * aborted and already accounted for.
+ */
+static void mirror_hc_res_end(struct httpclient *hc)
+{
+	struct mirror_config *conf = hc->caller;
+
+	if (conf)
+		HA_ATOMIC_DEC(&conf->in_flight);
+}
+
+/* Drop the mirrored request being built for stream state <st>. The httpclient
+ * runs on the same thread as the stream, so its ENDED flag tells whether the
+ * release callback already gave our in-flight slot back.
+ */
+static void mirror_abort(struct mirror_config *conf, struct mirror_state *st)
+{
+	struct httpclient *hc = st->hc;
+
+	st->hc = NULL;
+	if (!httpclient_ended(hc))
+		HA_ATOMIC_DEC(&conf->in_flight);
+	hc->caller = NULL;
+	httpclient_stop_and_destroy(hc);
+	HA_ATOMIC_INC(&conf->dropped);
+}
+
+/**************************************************************************
+ * Hooks that manage the filter lifecycle (init/check/deinit)
+ **************************************************************************/
+static int mirror_check(struct proxy *px, struct flt_conf *fconf)
+{
+	if (px->mode != PR_MODE_HTTP) {
+		ha_alert("Proxy '%s': unable to use the mirror filter in non-HTTP mode.\n",
+			 px->id);
+		return 1;
+	}
+	return 0;
+}
+
+static void mirror_deinit(struct proxy *px, struct flt_conf *fconf)
+{
+	struct mirror_config *conf = fconf->conf;
+
+	if (conf) {
+		ha_free(&conf->uri);
+		free(conf);
+	}
+	fconf->conf = NULL;
+}
+
+/**************************************************************************
+ * Hooks to handle start/stop of streams
+ *************************************************************************/
+static int mirror_attach(struct stream *s, struct filter *filter)
+{
+	struct mirror_state *st;
+
+	st = pool_zalloc(pool_head_mirror_state);
+	if (!st)
+		return -1;
+	filter->ctx = st;
+	return 1;
+}
+
+static void mirror_detach(struct stream *s, struct filter *filter)
+{
+	struct mirror_config *conf = FLT_CONF(filter);
+	struct mirror_state *st = filter->ctx;
+
+	if (!st)
+		return;
+
+	/* the request was aborted before its end, never replay a truncated
+	 * message
+	 */
+	if (st->hc)
+		mirror_abort(conf, st);
+
+	pool_free(pool_head_mirror_state, st);
+	filter->ctx = NULL;
+}
+
+/**************************************************************************
+ * Hooks to filter HTTP messages
+ *************************************************************************/
+static int mirror_http_headers(struct stream *s, struct filter *filter, struct http_msg *msg)
+{
+	struct mirror_config *conf = FLT_CONF(filter);
+	struct mirror_state *st = filter->ctx;
+	struct http_hdr hdrs[global.tune.max_http_hdr];
+	struct http_uri_parser parser;
+	struct httpclient *hc = NULL;
+	struct buffer *chk;
+	struct htx *htx;
+	struct htx_blk *blk;
+	struct htx_sl *sl;
+	struct ist path;
+	int hdr = 0;
+
+	if (msg->chn->flags & CF_ISRESP)
+		return 1;
+
+	/* only methods the httpclient can reproduce, and no tunnels */
+	if (s->txn->meth >= HTTP_METH_OTHER || s->txn->meth == HTTP_METH_CONNECT)
+		return 1;
+
+	/* bounded concurrency: drop new mirrors when the shadow destination
+	 * lags instead of buffering without limit
+	 */
+	if (HA_ATOMIC_ADD_FETCH(&conf->in_flight, 1) > conf->maxreq)
+		goto drop;
+
+	htx = htxbuf(&msg->chn->buf);
+	sl = http_get_stline(htx);
+	if (!sl)
+		goto drop;
+
+	parser = http_uri_parser_init(htx_sl_req_uri(sl));
+	path = http_parse_path(&parser);
+	if (!isttest(path))
+		path = ist("/");
+
+	chk = get_trash_chunk();
+	chunk_printf(chk, "%s%.*s", conf->uri, (int)path.len, path.ptr);
+
+	hc = httpclient_new(conf, s->txn->meth, ist2(b_head(chk), b_data(chk)));
+	if (!hc || !isttest(hc->req.url))
+		goto drop;
+
+	for (blk = htx_get_first_blk(htx); blk; blk = htx_get_next_blk(htx, blk)) {
+		enum htx_blk_type type = htx_get_blk_type(blk);
+		struct ist n, v;
+
+		if (type == HTX_BLK_EOH)
+			break;
+		if (type != HTX_BLK_HDR)
+			continue;
+
+		n = htx_get_blk_name(htx, blk);
+		v = htx_get_blk_value(htx, blk);
+
+		/* the httpclient frames the copied body itself */
+		if (isteqi(n, ist("content-length")) ||
+		    isteqi(n, ist("transfer-encoding")) ||
+		    isteqi(n, ist("connection")))
+			continue;
+
+		if (hdr >= global.tune.max_http_hdr - 1)
+			goto drop;
+		hdrs[hdr].n = n;
+		hdrs[hdr].v = v;
+		hdr++;
+	}
+	hdrs[hdr].n = IST_NULL;
+	hdrs[hdr].v = IST_NULL;
+
+	hc->ops.res_end = mirror_hc_res_end;
+	hc->flags |= HTTPCLIENT_FA_AUTOKILL;
+
+	/* when a body is announced, it will be pushed from the payload
+	 * callback, so the end of the mirrored message must not be reported
+	 * yet
+	 */
+	if (msg->flags & (HTTP_MSGF_CNT_LEN|HTTP_MSGF_TE_CHNK))
+		hc->ops.req_payload = mirror_hc_req_payload;
+
+	if (httpclient_req_gen(hc, hc->req.url, s->txn->meth,
+			       hdr ? hdrs : NULL, IST_NULL) != ERR_NONE)
+		goto drop;
+
+	if (!httpclient_start(hc))
+		goto drop;
+
+	/* bodyless requests are complete, others need the payload hooks to
+	 * follow the body
+	 */
+	if (hc->ops.req_payload) {
+		register_data_filter(s, msg->chn, filter);
+		st->hc = hc;
+	}
+	return 1;
+
+  drop:
+	if (hc) {
+		hc->caller = NULL;
+		httpclient_destroy(hc);
+	}
+	HA_ATOMIC_DEC(&conf->in_flight);
+	HA_ATOMIC_INC(&conf->dropped);
+	return 1;
+}
+
+static int mirror_http_payload(struct stream *s, struct filter *filter, struct http_msg *msg,
+			       unsigned int offset, unsigned int len)
+{
+	struct mirror_config *conf = FLT_CONF(filter);
+	struct mirror_state *st = filter->ctx;
+	struct htx *htx;
+	struct htx_ret htxret;
+	struct htx_blk *blk;
+	unsigned int ret = len;
+
+	if (!st->hc || (msg->chn->flags & CF_ISRESP))
+		return ret;
+
+	htx = htxbuf(&msg->chn->buf);
+	htxret = htx_find_offset(htx, offset);
+	blk = htxret.blk;
+	offset = htxret.ret;
+	for (; blk && len; blk = htx_get_next_blk(htx, blk)) {
+		enum htx_blk_type type = htx_get_blk_type(blk);
+		uint32_t sz = htx_get_blksz(blk);
+		struct ist v;
+
+		if (type == HTX_BLK_DATA) {
+			v = htx_get_blk_value(htx, blk);
+			v = istadv(v, offset);
+			if (v.len > len)
+				v.len = len;
+
+			/* the httpclient buffer is the bound: when the shadow
+			 * destination does not consume fast enough, drop the
+			 * mirror rather than slowing down the primary path
+			 */
+			if ((size_t)httpclient_req_xfer(st->hc, v, 0) < v.len) {
+				mirror_abort(conf, st);
+				break;
+			}
+		}
+		sz -= offset;
+		if (sz > len)
+			sz = len;
+		len -= sz;
+		offset = 0;
+	}
+	return ret;
+}
+
+static int mirror_http_end(struct stream *s, struct filter *filter, struct http_msg *msg)
+{
+	struct mirror_state *st = filter->ctx;
+
+	if (st->hc && !(msg->chn->flags & CF_ISRESP)) {
+		/* report the end of the mirrored message and let the client
+		 * finish on its own
+		 */
+		httpclient_req_xfer(st->hc, IST_NULL, 1);
+		st->hc = NULL;
+	}
+	return 1;
+}
+
+/********************************************************************
+ * Functions that manage the filter initialization
+ ********************************************************************/
+struct flt_ops mirror_ops = {
+	/* Manage mirror filter, called for each filter declaration */
+	.check             = mirror_check,
+	.deinit            = mirror_deinit,
+
+	/* Handle start/stop of streams */
+	.attach            = mirror_attach,
+	.detach            = mirror_detach,
+
+	/* Filter HTTP requests */
+	.http_headers      = mirror_http_headers,
+	.http_payload      = mirror_http_payload,
+	.http_end          = mirror_http_end,
+};
+
+/* Return -1 on error, else 0 */
+static int parse_mirror_flt(char **args, int *cur_arg, struct proxy *px,
+			    struct flt_conf *fconf, char **err, void *private)
+{
+	struct mirror_config *conf;
+	int pos = *cur_arg + 1;
+
+	conf = calloc(1, sizeof(*conf));
+	if (!conf) {
+		memprintf(err, "%s: out of memory", args[*cur_arg]);
+		return -1;
+	}
+	conf->proxy = px;
+	conf->maxreq = MIRROR_DFLT_MAXREQ;
+
+	while (*args[pos]) {
+		if (strcmp(args[pos], "uri") == 0) {
+			if (!*args[pos + 1]) {
+				memprintf(err, "'%s' : '%s' option without value",
+					  args[*cur_arg], args[pos]);
+				goto error;
+			}
+			conf->uri = strdup(args[pos + 1]);
+			if (!conf->uri) {
+				memprintf(err, "%s: out of memory", args[*cur_arg]);
+				goto error;
+			}
+			/* the request path is appended to it */
+			while (strlen(conf->uri) > 1 && conf->uri[strlen(conf->uri)-1] == '/')
+				conf->uri[strlen(conf->uri)-1] = 0;
+			pos++;
+		}
+		else if (strcmp(args[pos], "maxreq") == 0) {
+			int v;
+
+			if (!*args[pos + 1]) {
+				memprintf(err, "'%s' : '%s' option without value",
+					  args[*cur_arg], args[pos]);
+				goto error;
+			}
+			v = atoi(args[pos + 1]);
+			if (v <= 0) {
+				memprintf(err, "'%s' : '%s' expects a positive integer",
+					  args[*cur_arg], args[pos]);
+				goto error;
+			}
+			conf->maxreq = v;
+			pos++;
+		}
+		else
+			break;
+		pos++;
+	}
+
+	if (!conf->uri) {
+		memprintf(err, "'%s' : the 'uri' option is mandatory", args[*cur_arg]);
+		goto error;
+	}
+	if (strncmp(conf->uri, "http://", 7) != 0 && strncmp(conf->uri, "https://", 8) != 0) {
+		memprintf(err, "'%s' : invalid shadow uri '%s' (must start with http:// or https://)",
+			  args[*cur_arg], conf->uri);
+		goto error;
+	}
+
+	*cur_arg = pos;
+	fconf->id    = mirror_flt_id;
+	fconf->ops   = &mirror_ops;
+	fconf->conf  = conf;
+	fconf->flags |= FLT_CFG_FL_HTX;
+	return 0;
+
+ error:
+	if (conf->uri)
+		free(conf->uri);
+	free(conf);
+	return -1;
+}
+
+/* Declare the filter parser for "mirror" keyword */
+static struct flt_kw_list flt_kws = { "MIRROR", { }, {
+		{ "mirror", parse_mirror_flt, NULL },
+		{ NULL, NULL, NULL },
+	}
+};
+
+INITCALL1(STG_REGISTER, flt_register_keywords, &flt_kws);
@@ -1748,7 +1748,7 @@ spoe_handle_processing_appctx(struct appctx *appctx)
 	 */
 	close_asap = (global.nbthread > 1 &&
 		      (agent->b.be->queue.length ||
-		       (srv && (srv->queue.length || (srv->maxconn && srv->served >= srv_dynamic_maxconn(srv))))));
+		       (srv && (srv->queue_length || (srv->maxconn && srv->served >= srv_dynamic_maxconn(srv))))));
 
 	/* Don"t try to send new frame we are waiting for at lease a ack, in
 	 * sync mode or if applet must be closed ASAP
@@ -2167,12 +2167,23 @@ spoe_queue_context(struct spoe_context *ctx)
 		    ctx->strm, agent->counters.applets, agent->counters.idles,
 		    agent->rt[tid].processing);
 
-	/* Finally try to wakeup an IDLE applet. */
+	/* Finally try to wakeup an IDLE applet. The most loaded one is chosen
+	 * first, as long as it still has room in its pipeline, so that frames
+	 * are aggregated on as few connections as possible instead of being
+	 * spread one by one over all idle applets. This way each connection
+	 * flushes several NOTIFY frames at once and the agent processes them
+	 * in batches. The least loaded applet is only used once the most
+	 * loaded ones are full.
+	 */
 	if (!eb_is_empty(&agent->rt[tid].idle_applets)) {
 		struct eb32_node *node;
 
-		node = eb32_first(&agent->rt[tid].idle_applets);
+		node = eb32_last(&agent->rt[tid].idle_applets);
 		spoe_appctx = eb32_entry(node, struct spoe_appctx, node);
+		if (spoe_appctx && spoe_appctx->node.key >= agent->max_fpa) {
+			node = eb32_first(&agent->rt[tid].idle_applets);
+			spoe_appctx = eb32_entry(node, struct spoe_appctx, node);
+		}
 		if (node && spoe_appctx) {
 			eb32_delete(&spoe_appctx->node);
 			spoe_appctx->node.key++;
@@ -27,6 +27,7 @@
 #include <haproxy/chunk.h>
 #include <haproxy/connection.h>
 #include <haproxy/fd.h>
+#include <haproxy/freq_ctr.h>
 #include <haproxy/frontend.h>
 #include <haproxy/global.h>
 #include <haproxy/http_ana.h>
@@ -41,6 +42,11 @@
 #include <haproxy/tools.h>
 
 
+/* single-entry per-thread rate cache shared by the fe_req_rate and
+ * fe_sess_rate sample fetches.
+ */
+static THREAD_LOCAL struct freq_ctr_cache fe_rate_cache;
+
 /* Finish a stream accept() for a proxy (TCP or HTTP). It returns a negative
  * value in case of a critical failure which must cause the listener to be
  * disabled, a positive or null value in case of success.
@@ -225,7 +231,7 @@ smp_fetch_fe_req_rate(const struct arg *args, struct sample *smp, const char *kw
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
-	smp->data.u.sint = read_freq_ctr(&px->fe_req_per_sec);
+	smp->data.u.sint = read_freq_ctr_cached(&px->fe_req_per_sec, &fe_rate_cache);
 	return 1;
 }
 
@@ -245,7 +251,7 @@ smp_fetch_fe_sess_rate(const struct arg *args, struct sample *smp, const char *k
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
-	smp->data.u.sint = read_freq_ctr(&px->fe_sess_per_sec);
+	smp->data.u.sint = read_freq_ctr_cached(&px->fe_sess_per_sec, &fe_rate_cache);
 	return 1;
 }
 
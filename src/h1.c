@@ -550,8 +550,23 @@ int h1_headers_to_hdr_list(char *start, const char *stop,
 
 	case H1_MSG_RQURI:
 	http_msg_rquri:
+		/* speedup: skip packs of 4 or 8 bytes not between 0x21 and 0x7e
+		 * inclusive
+		 */
+#ifdef HA_UNALIGNED_LE64
+		while (ptr <= end - sizeof(long)) {
+			unsigned long x = *(unsigned long *)ptr - 0x2121212121212121ULL;
+			if (x & 0x8080808080808080ULL)
+				break;
+
+			x -= 0x5e5e5e5e5e5e5e5eULL;
+			if (!(x & 0x8080808080808080ULL))
+				break;
+
+			ptr += sizeof(long);
+		}
+#endif
 #ifdef HA_UNALIGNED_LE
-		/* speedup: skip bytes not between 0x21 and 0x7e inclusive */
 		while (ptr <= end - sizeof(int)) {
 			int x = *(int *)ptr - 0x21212121;
 			if (x & 0x80808080)
@@ -777,8 +792,31 @@ int h1_headers_to_hdr_list(char *start, const char *stop,
 
 	case H1_MSG_RPREASON:
 	http_msg_rpreason:
+		/* speedup: the reason phrase may be anything but CR/LF, so skip
+		 * packs of 4 or 8 bytes not containing bytes 0x0d and lower,
+		 * like for the header values below.
+		 */
+#ifdef HA_UNALIGNED_LE64
+		while (ptr <= end - sizeof(long)) {
+			if ((*(long *)ptr - 0x0e0e0e0e0e0e0e0eULL) & 0x8080808080808080ULL)
+				goto http_msg_rpreason2;
+			ptr += sizeof(long);
+		}
+#endif
+#ifdef HA_UNALIGNED_LE
+		while (ptr <= end - sizeof(int)) {
+			if ((*(int *)ptr - 0x0e0e0e0e) & 0x80808080)
+				goto http_msg_rpreason2;
+			ptr += sizeof(int);
+		}
+#endif
+		if (ptr >= end) {
+			state = H1_MSG_RPREASON;
+			goto http_msg_ood;
+		}
+	http_msg_rpreason2:
 		if (likely(!HTTP_IS_CRLF(*ptr)))
-			EAT_AND_JUMP_OR_RETURN(ptr, end, http_msg_rpreason, http_msg_ood, state, H1_MSG_RPREASON);
+			EAT_AND_JUMP_OR_RETURN(ptr, end, http_msg_rpreason2, http_msg_ood, state, H1_MSG_RPREASON);
 		sl.st.r.len = ptr - sl.st.r.ptr;
 	http_msg_rpline_eol:
 		/* We have seen the end of line. Note that we do not
@@ -823,6 +861,27 @@ int h1_headers_to_hdr_list(char *start, const char *stop,
 	case H1_MSG_HDR_NAME:
 	http_msg_hdr_name:
 		/* assumes sol points to the first char */
+
+		/* speedup: skip packs of 4 bytes of lower-case letters, which
+		 * need neither a case change nor a validity check. Other token
+		 * characters ('-', digits, upper-case) simply fall back to the
+		 * byte loop below. The test may only report false positives on
+		 * boundary bytes next to an internal borrow, which just breaks
+		 * the loop early and never skips an invalid byte.
+		 */
+#ifdef HA_UNALIGNED_LE
+		while (ptr <= end - sizeof(int)) {
+			unsigned int x = *(unsigned int *)ptr;
+
+			if (((x - 0x61616161) | (0x7a7a7a7a - x)) & 0x80808080)
+				break;
+			ptr += sizeof(int);
+		}
+		if (ptr >= end) {
+			state = H1_MSG_HDR_NAME;
+			goto http_msg_ood;
+		}
+#endif
 		if (likely(HTTP_IS_TOKEN(*ptr))) {
 			if (!skip_update) {
 				/* turn it to lower case if needed */
@@ -140,6 +140,7 @@
 #include <haproxy/uri_auth-t.h>
 #include <haproxy/vars.h>
 #include <haproxy/version.h>
+#include <haproxy/xxhash.h>
 
 
 /* array of init calls for older platforms */
@@ -163,6 +164,12 @@ const char *build_features = "";
 
 /* list of config files */
 static struct list cfg_cfgfiles = LIST_HEAD_INIT(cfg_cfgfiles);
+
+/* digest of the raw contents of the configuration files as they were loaded,
+ * used with "mworker-skip-unchanged-reloads" to elide no-op reloads. Zero
+ * when unknown.
+ */
+static uint64_t loaded_cfg_digest;
 int  pid;			/* current process id */
 
 static unsigned long stopping_tgroup_mask; /* Thread groups acknowledging stopping */
@@ -173,6 +180,7 @@ struct global global = {
 	.close_spread_time = TICK_ETERNITY,
 	.close_spread_end = TICK_ETERNITY,
 	.numa_cpu_mapping = 1,
+	.l3_cpu_mapping = 1,
 	.nbthread = 0,
 	.req_count = 0,
 	.logsrvs = LIST_HEAD_INIT(global.logsrvs),
@@ -194,6 +202,7 @@ struct global global = {
 		.pattern_cache = DEFAULT_PAT_LRU_SIZE,
 		.pool_low_ratio  = 20,
 		.pool_high_ratio = 25,
+		.sched_heavy_per_loop = 1,
 		.max_http_hdr = MAX_HTTP_HDR,
 #ifdef USE_OPENSSL
 		.sslcachesize = SSLCACHESIZE,
@@ -783,12 +792,112 @@ static void mworker_reexec_waitmode()
 	mworker_reexec();
 }
 
+/* Hashes the name and raw content of configuration file <path> into
+ * <digest>. Returns non-zero on success, 0 when the file cannot be read.
+ */
+static int cfg_file_digest_one(const char *path, uint64_t *digest)
+{
+	char buf[4096];
+	ssize_t ret;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	*digest = XXH64(path, strlen(path), *digest);
+	while ((ret = read(fd, buf, sizeof(buf))) > 0)
+		*digest = XXH64(buf, ret, *digest);
+	close(fd);
+	return ret == 0;
+}
+
+/* Computes a digest of the names and raw contents of all the configuration
+ * files, in load order, so that a later reload request can detect that it
+ * would load the exact same configuration. In wait mode the directories
+ * passed with -f were not expanded into their files, so they are walked here
+ * with the same rules as cfgfiles_expand_directories(), without modifying the
+ * list. Returns 0 when any file cannot be read, which disables the detection.
+ */
+static uint64_t cfg_files_digest(void)
+{
+	struct wordlist *wl;
+	uint64_t digest = 0;
+
+	list_for_each_entry(wl, &cfg_cfgfiles, list) {
+		struct stat file_stat;
+
+		if (stat(wl->s, &file_stat))
+			return 0;
+
+		if (S_ISDIR(file_stat.st_mode)) {
+			struct dirent **dir_entries;
+			int nb, it;
+			int ok = 1;
+
+			nb = scandir(wl->s, &dir_entries, NULL, alphasort);
+			if (nb < 0)
+				return 0;
+
+			for (it = 0; it < nb; it++) {
+				struct dirent *ent = dir_entries[it];
+				char *ext = strstr(ent->d_name, ".cfg");
+				char *filename = NULL;
+
+				if (ok && ent->d_name[0] != '.' && ext && ext[4] == '\0') {
+					if (!memprintf(&filename, "%s/%s", wl->s, ent->d_name) ||
+					    stat(filename, &file_stat) ||
+					    (S_ISREG(file_stat.st_mode) &&
+					     !cfg_file_digest_one(filename, &digest)))
+						ok = 0;
+				}
+				free(filename);
+				free(ent);
+			}
+			free(dir_entries);
+			if (!ok)
+				return 0;
+		}
+		else if (!cfg_file_digest_one(wl->s, &digest))
+			return 0;
+	}
+	return digest ? digest : 1; /* zero is reserved for "unknown" */
+}
+
+/* Returns non-zero when the configuration files on disk are known to be
+ * identical to those the current workers were started with, in which case a
+ * reload would only rebuild what is already running and may be skipped. This
+ * requires that the configuration currently in use had enabled
+ * "mworker-skip-unchanged-reloads" (advertised by the HAPROXY_CFG_DIGEST
+ * variable, only exported after a successful load), and that all the files
+ * can still be read and hashed.
+ */
+int mworker_config_unchanged(void)
+{
+	uint64_t digest;
+	char *env;
+
+	env = getenv("HAPROXY_CFG_DIGEST");
+	if (!env)
+		return 0;
+
+	digest = strtoull(env, NULL, 16);
+	if (!digest)
+		return 0;
+
+	return cfg_files_digest() == digest;
+}
+
 /* reload haproxy and emit a warning */
 void mworker_reload()
 {
 	struct mworker_proc *child;
 	struct per_thread_deinit_fct *ptdf;
 
+	if (mworker_config_unchanged()) {
+		ha_notice("Configuration files unchanged, skipping reload.\n");
+		return;
+	}
+
 	ha_notice("Reloading HAProxy\n");
 
 	/* close the poller FD and the thread waker pipe FD */
@@ -946,7 +1055,7 @@ static void sig_dump_state(struct sig_handler *sh)
 			             "SIGHUP: Server %s/%s is %s. Conn: %d act, %d pend, %lld tot.",
 			             p->id, s->id,
 			             (s->cur_state != SRV_ST_STOPPED) ? "UP" : "DOWN",
-			             s->cur_sess, s->queue.length, s->counters.cum_sess);
+			             s->cur_sess, s->queue_length, s->counters.cum_sess);
 			ha_warning("%s\n", trash.area);
 			send_log(p, LOG_NOTICE, "%s\n", trash.area);
 			s = s->next;
@@ -1574,6 +1683,9 @@ static void init_args(int argc, char **argv)
 #if defined(USE_EPOLL)
 	global.tune.options |= GTUNE_USE_EPOLL;
 #endif
+#if defined(USE_URING)
+	global.tune.options |= GTUNE_USE_URING;
+#endif
 #if defined(USE_KQUEUE)
 	global.tune.options |= GTUNE_USE_KQUEUE;
 #endif
@@ -2129,6 +2241,11 @@ static void init(int argc, char **argv)
 		setenv("HAPROXY_CFGFILES", env_cfgfiles, 1);
 		free(env_cfgfiles);
 
+		/* hash the files as they were just read so that a later reload
+		 * request can detect that nothing changed.
+		 */
+		if (mworker_skip_unchanged_reloads)
+			loaded_cfg_digest = cfg_files_digest();
 	}
 	if (global.mode & MODE_MWORKER) {
 		struct mworker_proc *tmproc;
@@ -2573,6 +2690,9 @@ static void init(int argc, char **argv)
 
 	proxy_adjust_all_maxconn();
 
+	/* now that the final maxconn is known, the buffer arena can be sized */
+	buffer_arena_init();
+
 	if (global.tune.maxpollevents <= 0)
 		global.tune.maxpollevents = MAX_POLL_EVENTS;
 
@@ -2640,6 +2760,9 @@ static void init(int argc, char **argv)
 	if (!(global.tune.options & GTUNE_USE_EPOLL))
 		disable_poller("epoll");
 
+	if (!(global.tune.options & GTUNE_USE_URING))
+		disable_poller("uring");
+
 	if (!(global.tune.options & GTUNE_USE_POLL))
 		disable_poller("poll");
 
@@ -3615,6 +3738,22 @@ int main(int argc, char **argv)
 #endif
 					/* if not in wait mode, reload in wait mode to free the memory */
 					setenv("HAPROXY_LOAD_SUCCESS", "1", 1);
+
+					/* advertise the digest of the running configuration so
+					 * that reloads of an unchanged one can be skipped. Make
+					 * sure not to leave a stale one when the option was
+					 * removed or the digest could not be computed.
+					 */
+					if (mworker_skip_unchanged_reloads && loaded_cfg_digest) {
+						char digest_str[32];
+
+						snprintf(digest_str, sizeof(digest_str), "%llx",
+						         (unsigned long long)loaded_cfg_digest);
+						setenv("HAPROXY_CFG_DIGEST", digest_str, 1);
+					}
+					else
+						unsetenv("HAPROXY_CFG_DIGEST");
+
 					ha_notice("Loading success.\n");
 					proc_self->failedreloads = 0; /* reset the number of failure */
 					mworker_reexec_waitmode();
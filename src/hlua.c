@@ -144,8 +144,20 @@ static struct list referenced_functions = LIST_HEAD_INIT(referenced_functions);
  */
 static int hlua_state_id;
 
-/* This is a NULL-terminated list of lua file which are referenced to load per thread */
-static char ***per_thread_load = NULL;
+/* Each "lua-load-per-thread" directive is recorded here with its arguments so
+ * that the script can be replayed in the states dedicated to the other
+ * threads. The bytecode produced when the first state compiles the script is
+ * kept along so that the other states load it directly instead of re-reading
+ * and re-compiling the file.
+ */
+struct hlua_per_thread_load {
+	char **args;          /* script path and arguments, ends with an empty string */
+	char *bytecode;       /* chunk compiled by the first state, or NULL */
+	size_t bytecode_len;  /* number of bytes in <bytecode> */
+};
+
+static struct hlua_per_thread_load *per_thread_load = NULL;
+static int per_thread_load_nb = 0;
 
 lua_State *hlua_init_state(int thread_id);
 
@@ -4217,6 +4229,59 @@ __LJMP static int hlua_run_sample_fetch(lua_State *L)
 	return 0; /* Never reached */
 }
 
+/* Fast-call variant of hlua_run_sample_fetch() above, registered for the
+ * sample-fetches which do not take any argument (the vast majority of the
+ * ones called from Lua: path, src, method, ...). Since there is nothing to
+ * marshal, the whole argument conversion and checking performed by
+ * hlua_lua2arg_check() is skipped and the fetch is called directly with the
+ * shared empty argument list. Extra arguments are rejected with the same
+ * error as the generic code.
+ */
+__LJMP static int hlua_run_sample_fetch_0arg(lua_State *L)
+{
+	struct hlua_smp *hsmp;
+	struct sample_fetch *f;
+	struct sample smp;
+
+	/* Get closure arguments. */
+	f = lua_touserdata(L, lua_upvalueindex(1));
+
+	/* Get traditional arguments. */
+	hsmp = MAY_LJMP(hlua_checkfetches(L, 1));
+
+	/* Check execution authorization. */
+	if (f->use & SMP_USE_HTTP_ANY &&
+	    !(hsmp->flags & HLUA_F_MAY_USE_HTTP)) {
+		lua_pushfstring(L, "the sample-fetch '%s' needs an HTTP parser which "
+		                   "is not available in Lua services", f->kw);
+		WILL_LJMP(lua_error(L));
+	}
+
+	/* This fetch doesn't take any argument. */
+	if (lua_gettop(L) > 1)
+		WILL_LJMP(luaL_argerror(L, 2, "Last argument expected"));
+
+	/* Initialise the sample. */
+	memset(&smp, 0, sizeof(smp));
+
+	/* Run the sample fetch process. */
+	smp_set_owner(&smp, hsmp->p, hsmp->s->sess, hsmp->s, hsmp->dir & SMP_OPT_DIR);
+	if (!f->process(empty_arg_list, &smp, f->kw, f->private)) {
+		if (hsmp->flags & HLUA_F_AS_STRING)
+			lua_pushstring(L, "");
+		else
+			lua_pushnil(L);
+		return 1;
+	}
+
+	/* Convert the returned sample in lua value. */
+	if (hsmp->flags & HLUA_F_AS_STRING)
+		hlua_smp2lua_str(L, &smp);
+	else
+		hlua_smp2lua(L, &smp);
+	return 1;
+}
+
 /*
  *
  *
@@ -5052,6 +5117,33 @@ __LJMP static int hlua_applet_http_getline_yield(lua_State *L, int status, lua_K
 	count = co_data(req);
 	blk = htx_get_first_blk(htx);
 
+	/* Fast path: nothing was accumulated yet and the line fully lies in
+	 * the first DATA block. Push it as a single Lua string instead of
+	 * going through the catenation buffer, which would copy the payload
+	 * a second time.
+	 */
+	if (!ctx && count && blk && htx_get_blk_type(blk) == HTX_BLK_DATA) {
+		uint32_t sz = htx_get_blksz(blk);
+		struct ist v = htx_get_blk_value(htx, blk);
+		char *nl;
+
+		if (v.len > count)
+			v.len = count;
+		nl = istchr(v, '\n');
+		if (nl != NULL) {
+			uint32_t vlen = nl - v.ptr + 1;
+
+			lua_pushlstring(L, v.ptr, vlen);
+			c_rew(req, vlen);
+			if (sz == vlen)
+				htx_remove_blk(htx, blk);
+			else
+				htx_cut_data_blk(htx, blk, vlen);
+			htx_to_buf(htx, &req->buf);
+			return 1;
+		}
+	}
+
 	while (count && !stop && blk) {
 		enum htx_blk_type type = htx_get_blk_type(blk);
 		uint32_t sz = htx_get_blksz(blk);
@@ -5079,6 +5171,7 @@ __LJMP static int hlua_applet_http_getline_yield(lua_State *L, int status, lua_K
 					vlen = nl - v.ptr + 1;
 				}
 				luaL_addlstring(&luactx->b, v.ptr, vlen);
+				ctx = 1;
 				break;
 
 			case HTX_BLK_TLR:
@@ -5109,7 +5202,7 @@ __LJMP static int hlua_applet_http_getline_yield(lua_State *L, int status, lua_K
 	htx_to_buf(htx, &req->buf);
 	if (!stop) {
 		applet_need_more_data(luactx->appctx);
-		MAY_LJMP(hlua_yieldk(L, 0, 0, hlua_applet_http_getline_yield, TICK_ETERNITY, 0));
+		MAY_LJMP(hlua_yieldk(L, 0, ctx, hlua_applet_http_getline_yield, TICK_ETERNITY, 0));
 	}
 
 	/* return the result. */
@@ -5147,6 +5240,35 @@ __LJMP static int hlua_applet_http_recv_yield(lua_State *L, int status, lua_KCon
 	len = MAY_LJMP(luaL_checkinteger(L, 2));
 	count = co_data(req);
 	blk = htx_get_head_blk(htx);
+
+	/* Fast path: nothing was accumulated yet and the whole requested
+	 * area lies in the first DATA block. Push it as a single Lua string
+	 * instead of going through the catenation buffer, which would copy
+	 * the payload a second time.
+	 */
+	if (!ctx && count && len && blk && htx_get_blk_type(blk) == HTX_BLK_DATA) {
+		uint32_t sz = htx_get_blksz(blk);
+		uint32_t vlen = sz;
+
+		if (len > 0 && vlen > len)
+			vlen = len;
+		if (vlen > count)
+			vlen = count;
+		if ((len > 0 && vlen == len) ||
+		    (vlen == sz && htx_nbblks(htx) == 1 && (req->flags & CF_EOI))) {
+			struct ist v = htx_get_blk_value(htx, blk);
+
+			lua_pushlstring(L, v.ptr, vlen);
+			c_rew(req, vlen);
+			if (sz == vlen)
+				htx_remove_blk(htx, blk);
+			else
+				htx_cut_data_blk(htx, blk, vlen);
+			htx_to_buf(htx, &req->buf);
+			return 1;
+		}
+	}
+
 	while (count && len && blk) {
 		enum htx_blk_type type = htx_get_blk_type(blk);
 		uint32_t sz = htx_get_blksz(blk);
@@ -5169,6 +5291,7 @@ __LJMP static int hlua_applet_http_recv_yield(lua_State *L, int status, lua_KCon
 			case HTX_BLK_DATA:
 				v = htx_get_blk_value(htx, blk);
 				luaL_addlstring(&luactx->b, v.ptr, vlen);
+				ctx = 1;
 				break;
 
 			case HTX_BLK_TLR:
@@ -5207,7 +5330,7 @@ __LJMP static int hlua_applet_http_recv_yield(lua_State *L, int status, lua_KCon
 			lua_replace(L, 2);
 		}
 		applet_need_more_data(luactx->appctx);
-		MAY_LJMP(hlua_yieldk(L, 0, 0, hlua_applet_http_recv_yield, TICK_ETERNITY, 0));
+		MAY_LJMP(hlua_yieldk(L, 0, ctx, hlua_applet_http_recv_yield, TICK_ETERNITY, 0));
 	}
 
 	/* return the result. */
@@ -11291,6 +11414,25 @@ static int hlua_parse_maxmem(char **args, int section_type, struct proxy *curpx,
 }
 
 
+/* Writer used by lua_dump() to append the bytecode of a freshly compiled
+ * chunk to the hlua_per_thread_load entry passed in <data>. Returns 0 on
+ * success, non-zero on allocation failure.
+ */
+static int hlua_dump_writer(lua_State *L, const void *p, size_t sz, void *data)
+{
+	struct hlua_per_thread_load *ptl = data;
+	char *area;
+
+	area = my_realloc2(ptl->bytecode, ptl->bytecode_len + sz);
+	if (!area)
+		return -1;
+
+	memcpy(area + ptl->bytecode_len, p, sz);
+	ptl->bytecode = area;
+	ptl->bytecode_len += sz;
+	return 0;
+}
+
 /* This function is called by the main configuration key "lua-load". It loads and
  * execute an lua file during the parsing of the HAProxy configuration file. It is
  * the main lua entry point.
@@ -11301,23 +11443,49 @@ static int hlua_parse_maxmem(char **args, int section_type, struct proxy *curpx,
  * In some error case, LUA set an error message in top of the stack. This function
  * returns this error message in the HAProxy logs and pop it from the stack.
  *
+ * When <ptl> is set (scripts loaded with "lua-load-per-thread"), the bytecode
+ * compiled by the first state is stored there and reused by the other states,
+ * which avoids re-reading and re-compiling the file once per thread.
+ *
  * This function can fail with an abort() due to an Lua critical error.
  * We are in the configuration parsing process of HAProxy, this abort() is
  * tolerated.
  */
-static int hlua_load_state(char **args, lua_State *L, char **err)
+static int hlua_load_state(char **args, lua_State *L, struct hlua_per_thread_load *ptl, char **err)
 {
 	int error;
 	int nargs;
 
-	/* Just load and compile the file. */
-	error = luaL_loadfile(L, args[0]);
+	if (ptl && ptl->bytecode) {
+		/* Load the chunk compiled by the first state. The chunk name
+		 * mimics the one set by luaL_loadfile() so that runtime error
+		 * messages still refer to the file.
+		 */
+		char *name = NULL;
+
+		memprintf(&name, "@%s", args[0]);
+		error = luaL_loadbuffer(L, ptl->bytecode, ptl->bytecode_len, name);
+		ha_free(&name);
+	}
+	else {
+		/* Just load and compile the file. */
+		error = luaL_loadfile(L, args[0]);
+	}
+
 	if (error) {
 		memprintf(err, "error in Lua file '%s': %s", args[0], lua_tostring(L, -1));
 		lua_pop(L, 1);
 		return -1;
 	}
 
+	/* Keep the bytecode for the next states. A dump failure is harmless:
+	 * the next states will simply compile the file again.
+	 */
+	if (ptl && !ptl->bytecode && lua_dump(L, hlua_dump_writer, ptl, 0) != 0) {
+		ha_free(&ptl->bytecode);
+		ptl->bytecode_len = 0;
+	}
+
 	/* Push args in the Lua stack, except the first one which is the filename */
 	for (nargs = 1; *(args[nargs]) != 0; nargs++) {
 		/* Check stack size. */
@@ -11372,14 +11540,14 @@ static int hlua_load(char **args, int section_type, struct proxy *curpx,
 	/* loading for global state */
 	hlua_state_id = 0;
 	ha_set_thread(NULL);
-	return hlua_load_state(&args[1], hlua_states[0], err);
+	return hlua_load_state(&args[1], hlua_states[0], NULL, err);
 }
 
 static int hlua_load_per_thread(char **args, int section_type, struct proxy *curpx,
                                 const struct proxy *defpx, const char *file, int line,
                                 char **err)
 {
-	int len;
+	struct hlua_per_thread_load *ptl;
 	int i;
 
 	if (*(args[1]) == 0) {
@@ -11387,50 +11555,41 @@ static int hlua_load_per_thread(char **args, int section_type, struct proxy *cur
 		return -1;
 	}
 
-	if (per_thread_load == NULL) {
-		/* allocate the first entry large enough to store the final NULL */
-		per_thread_load = calloc(1, sizeof(*per_thread_load));
-		if (per_thread_load == NULL) {
-			memprintf(err, "out of memory error");
-			return -1;
-		}
-	}
-
-	/* count used entries */
-	for (len = 0; per_thread_load[len] != NULL; len++)
-		;
-
-	per_thread_load = realloc(per_thread_load, (len + 2) * sizeof(*per_thread_load));
-	if (per_thread_load == NULL) {
+	ptl = my_realloc2(per_thread_load, (per_thread_load_nb + 1) * sizeof(*per_thread_load));
+	if (ptl == NULL) {
 		memprintf(err, "out of memory error");
 		return -1;
 	}
-	per_thread_load[len + 1] = NULL;
+	per_thread_load = ptl;
+	ptl = &per_thread_load[per_thread_load_nb];
+	memset(ptl, 0, sizeof(*ptl));
 
 	/* count args excepting the first, allocate array and copy args */
 	for (i = 0; *(args[i + 1]) != 0; i++);
-	per_thread_load[len] = calloc(i + 1, sizeof(*per_thread_load[len]));
-	if (per_thread_load[len] == NULL) {
+	ptl->args = calloc(i + 1, sizeof(*ptl->args));
+	if (ptl->args == NULL) {
 		memprintf(err, "out of memory error");
 		return -1;
 	}
 	for (i = 1; *(args[i]) != 0; i++) {
-		per_thread_load[len][i - 1] = strdup(args[i]);
-		if (per_thread_load[len][i - 1] == NULL) {
+		ptl->args[i - 1] = strdup(args[i]);
+		if (ptl->args[i - 1] == NULL) {
 			memprintf(err, "out of memory error");
 			return -1;
 		}
 	}
-	per_thread_load[len][i - 1] = strdup("");
-	if (per_thread_load[len][i - 1]  == NULL) {
+	ptl->args[i - 1] = strdup("");
+	if (ptl->args[i - 1]  == NULL) {
 		memprintf(err, "out of memory error");
 		return -1;
 	}
 
+	per_thread_load_nb++;
+
 	/* loading for thread 1 only */
 	hlua_state_id = 1;
 	ha_set_thread(NULL);
-	return hlua_load_state(per_thread_load[len], hlua_states[1], err);
+	return hlua_load_state(ptl->args, hlua_states[1], ptl, err);
 }
 
 /* Prepend the given <path> followed by a semicolon to the `package.<type>` variable
@@ -11869,8 +12028,9 @@ int hlua_post_init()
 		hlua_states[hlua_state_id] = hlua_init_state(hlua_state_id);
 
 		/* Load lua files */
-		for (i = 0; per_thread_load && per_thread_load[i]; i++) {
-			ret = hlua_load_state(per_thread_load[i], hlua_states[hlua_state_id], &err);
+		for (i = 0; i < per_thread_load_nb; i++) {
+			ret = hlua_load_state(per_thread_load[i].args, hlua_states[hlua_state_id],
+			                      &per_thread_load[i], &err);
 			if (ret != 0) {
 				ha_alert("Lua init: %s\n", err);
 				return 0;
@@ -12291,10 +12451,13 @@ lua_State *hlua_init_state(int thread_num)
 			if (*p == '.' || *p == '-' || *p == '+')
 				*p = '_';
 
-		/* Register the function. */
+		/* Register the function. Fetches without arguments get a
+		 * dedicated closure which skips all the argument marshalling.
+		 */
 		lua_pushstring(L, trash.area);
 		lua_pushlightuserdata(L, sf);
-		lua_pushcclosure(L, hlua_run_sample_fetch, 1);
+		lua_pushcclosure(L, sf->arg_mask ? hlua_run_sample_fetch
+		                                 : hlua_run_sample_fetch_0arg, 1);
 		lua_rawset(L, -3);
 	}
 
@@ -618,6 +618,7 @@ static void hlua_stktable_entry(lua_State *L, struct stktable *t, struct stksess
 int hlua_stktable_lookup(lua_State *L)
 {
 	struct stktable *t;
+	struct stktable_bucket *bkt;
 	struct sample smp;
 	struct stktable_key *skey;
 	struct stksess *ts;
@@ -649,9 +650,10 @@ int hlua_stktable_lookup(lua_State *L)
 	lua_settable(L, -3);
 
 	hlua_stktable_entry(L, t, ts);
-	HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->lock);
-	ts->ref_cnt--;
-	HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->lock);
+	bkt = stktable_bucket(t, ts);
+	HA_RWLOCK_RDLOCK(STK_TABLE_LOCK, &bkt->lock);
+	HA_ATOMIC_DEC(&ts->ref_cnt);
+	HA_RWLOCK_RDUNLOCK(STK_TABLE_LOCK, &bkt->lock);
 
 	return 1;
 }
@@ -689,9 +691,11 @@ static int hlua_error(lua_State *L, const char *fmt, ...)  {
 int hlua_stktable_dump(lua_State *L)
 {
 	struct stktable *t;
+	struct stktable_bucket *bkt;
 	struct ebmb_node *eb;
 	struct ebmb_node *n;
 	struct stksess *ts;
+	int bucket;
 	int type;
 	int op;
 	int dt;
@@ -761,83 +765,86 @@ int hlua_stktable_dump(lua_State *L)
 
 	lua_newtable(L);
 
-	HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->lock);
-	eb = ebmb_first(&t->keys);
-	for (n = eb; n; n = ebmb_next(n)) {
-		ts = ebmb_entry(n, struct stksess, key);
-		if (!ts) {
-			HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->lock);
-			return 1;
-		}
-		ts->ref_cnt++;
-		HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->lock);
+	for (bucket = 0; bucket < CONFIG_HAP_TBL_BUCKETS; bucket++) {
+		bkt = &t->buckets[bucket];
+		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &bkt->lock);
+		eb = ebmb_first(&bkt->keys);
+		for (n = eb; n; n = ebmb_next(n)) {
+			ts = ebmb_entry(n, struct stksess, key);
+			if (!ts) {
+				HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
+				return 1;
+			}
+			HA_ATOMIC_INC(&ts->ref_cnt);
+			HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
 
-		/* multi condition/value filter */
-		skip_entry = 0;
-		for (i = 0; i < filter_count; i++) {
-			if (t->data_ofs[filter[i].type] == 0)
-				continue;
+			/* multi condition/value filter */
+			skip_entry = 0;
+			for (i = 0; i < filter_count; i++) {
+				if (t->data_ofs[filter[i].type] == 0)
+					continue;
 
-			ptr = stktable_data_ptr(t, ts, filter[i].type);
+				ptr = stktable_data_ptr(t, ts, filter[i].type);
 
-			switch (stktable_data_types[filter[i].type].std_type) {
-			case STD_T_SINT:
-				val = stktable_data_cast(ptr, std_t_sint);
-				break;
-			case STD_T_UINT:
-				val = stktable_data_cast(ptr, std_t_uint);
-				break;
-			case STD_T_ULL:
-				val = stktable_data_cast(ptr, std_t_ull);
-				break;
-			case STD_T_FRQP:
-				val = read_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp),
-						           t->data_arg[filter[i].type].u);
-				break;
-			default:
-				continue;
-				break;
-			}
+				switch (stktable_data_types[filter[i].type].std_type) {
+				case STD_T_SINT:
+					val = stktable_data_cast(ptr, std_t_sint);
+					break;
+				case STD_T_UINT:
+					val = stktable_data_cast(ptr, std_t_uint);
+					break;
+				case STD_T_ULL:
+					val = stktable_data_cast(ptr, std_t_ull);
+					break;
+				case STD_T_FRQP:
+					val = read_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp),
+							           t->data_arg[filter[i].type].u);
+					break;
+				default:
+					continue;
+					break;
+				}
 
-			op = filter[i].op;
+				op = filter[i].op;
 
-			if ((val < filter[i].val && (op == STD_OP_EQ || op == STD_OP_GT || op == STD_OP_GE)) ||
-			    (val == filter[i].val && (op == STD_OP_NE || op == STD_OP_GT || op == STD_OP_LT)) ||
-			    (val > filter[i].val && (op == STD_OP_EQ || op == STD_OP_LT || op == STD_OP_LE))) {
-				skip_entry = 1;
-				break;
+				if ((val < filter[i].val && (op == STD_OP_EQ || op == STD_OP_GT || op == STD_OP_GE)) ||
+				    (val == filter[i].val && (op == STD_OP_NE || op == STD_OP_GT || op == STD_OP_LT)) ||
+				    (val > filter[i].val && (op == STD_OP_EQ || op == STD_OP_LT || op == STD_OP_LE))) {
+					skip_entry = 1;
+					break;
+				}
 			}
-		}
 
-		if (skip_entry) {
-			HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->lock);
-			ts->ref_cnt--;
-			continue;
-		}
+			if (skip_entry) {
+				HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &bkt->lock);
+				HA_ATOMIC_DEC(&ts->ref_cnt);
+				continue;
+			}
 
-		if (t->type == SMP_T_IPV4) {
-			char addr[INET_ADDRSTRLEN];
-			inet_ntop(AF_INET, (const void *)&ts->key.key, addr, sizeof(addr));
-			lua_pushstring(L, addr);
-		} else if (t->type == SMP_T_IPV6) {
-			char addr[INET6_ADDRSTRLEN];
-			inet_ntop(AF_INET6, (const void *)&ts->key.key, addr, sizeof(addr));
-			lua_pushstring(L, addr);
-		} else if (t->type == SMP_T_SINT) {
-			lua_pushinteger(L, *ts->key.key);
-		} else if (t->type == SMP_T_STR) {
-			lua_pushstring(L, (const char *)ts->key.key);
-		} else {
-			return hlua_error(L, "Unsupported stick table key type");
-		}
+			if (t->type == SMP_T_IPV4) {
+				char addr[INET_ADDRSTRLEN];
+				inet_ntop(AF_INET, (const void *)&ts->key.key, addr, sizeof(addr));
+				lua_pushstring(L, addr);
+			} else if (t->type == SMP_T_IPV6) {
+				char addr[INET6_ADDRSTRLEN];
+				inet_ntop(AF_INET6, (const void *)&ts->key.key, addr, sizeof(addr));
+				lua_pushstring(L, addr);
+			} else if (t->type == SMP_T_SINT) {
+				lua_pushinteger(L, *ts->key.key);
+			} else if (t->type == SMP_T_STR) {
+				lua_pushstring(L, (const char *)ts->key.key);
+			} else {
+				return hlua_error(L, "Unsupported stick table key type");
+			}
 
-		lua_newtable(L);
-		hlua_stktable_entry(L, t, ts);
-		lua_settable(L, -3);
-		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->lock);
-		ts->ref_cnt--;
+			lua_newtable(L);
+			hlua_stktable_entry(L, t, ts);
+			lua_settable(L, -3);
+			HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &bkt->lock);
+			HA_ATOMIC_DEC(&ts->ref_cnt);
+		}
+		HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
 	}
-	HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->lock);
 
 	return 1;
 }
@@ -0,0 +1,261 @@
+/*
+ * Per-host statistics.
+ *
+ * Copyright 2023 HAProxy Technologies
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+/* Frontends terminating many domains only expose aggregated per-proxy
+ * counters, which makes it impossible to tell which of the hosts behind a
+ * shared "bind" is responsible for a traffic or error spike. The store
+ * implemented here maintains one small counter block per host name, indexed
+ * in a bounded, LRU-evicted tree. It is split into HOST_STATS_SHARDS
+ * independent shards, each with its own lock, so that all threads may record
+ * their traffic with no more serialization than a brief spinlock on the
+ * shard matching the host's hash. Streams look their entry up once per
+ * request and then update the counters with simple atomic operations,
+ * holding a reference that protects the entry from eviction.
+ *
+ * The store is disabled by default and enabled by setting the global
+ * "tune.host-stats.max-entries" to a non-zero value. The result is dumped
+ * by the CLI's "show host-stats" and by the prometheus exporter.
+ */
+
+#include <ctype.h>
+
+#include <import/ebmbtree.h>
+#include <import/ebsttree.h>
+
+#include <haproxy/api.h>
+#include <haproxy/applet.h>
+#include <haproxy/cfgparse.h>
+#include <haproxy/cli.h>
+#include <haproxy/global.h>
+#include <haproxy/host_stats.h>
+#include <haproxy/list.h>
+#include <haproxy/sc_strm.h>
+#include <haproxy/stconn.h>
+#include <haproxy/thread.h>
+#include <haproxy/tools.h>
+#include <haproxy/xxhash.h>
+
+struct host_stats_shard host_stats_shards[HOST_STATS_SHARDS];
+
+/* the appctx context of "show host-stats", stored in appctx->svcctx */
+struct show_host_stats_ctx {
+	unsigned int shard;             /* shard being dumped */
+	struct host_stats_entry *entry; /* referenced entry to resume from, or NULL */
+};
+
+/* Returns a referenced entry for host <host> of length <len>, creating it if
+ * it does not exist yet, or NULL if the store is disabled or full of in-use
+ * entries. The name is truncated to HOST_STATS_KEYLEN bytes and normalized
+ * to lower case so that case variants of a same host share their entry. The
+ * caller must release the entry with host_stats_put() once done with it, and
+ * may update its counters atomically until then.
+ */
+struct host_stats_entry *host_stats_get(const char *host, size_t len)
+{
+	char key[HOST_STATS_KEYLEN + 1];
+	struct host_stats_shard *shard;
+	struct host_stats_entry *ent;
+	struct ebmb_node *node;
+	unsigned int max_per_shard;
+	size_t i;
+
+	if (!global.tune.host_stats_max || !len)
+		return NULL;
+
+	if (len > HOST_STATS_KEYLEN)
+		len = HOST_STATS_KEYLEN;
+
+	for (i = 0; i < len; i++)
+		key[i] = tolower((unsigned char)host[i]);
+	key[len] = 0;
+
+	shard = &host_stats_shards[XXH3(key, len, 0) & (HOST_STATS_SHARDS - 1)];
+
+	HA_SPIN_LOCK(HOST_STATS_LOCK, &shard->lock);
+	node = ebst_lookup(&shard->keys, key);
+	if (node) {
+		ent = ebmb_entry(node, struct host_stats_entry, node);
+		/* refresh the LRU position */
+		LIST_DELETE(&ent->lru);
+		LIST_INSERT(&shard->lru, &ent->lru);
+		HA_ATOMIC_INC(&ent->refcnt);
+		goto done;
+	}
+
+	/* miss: make room if the shard already holds its share of the
+	 * configured limit, by evicting the oldest entry nobody uses.
+	 */
+	max_per_shard = (global.tune.host_stats_max + HOST_STATS_SHARDS - 1) / HOST_STATS_SHARDS;
+	if (shard->count >= max_per_shard) {
+		struct host_stats_entry *old = NULL, *back;
+
+		list_for_each_entry_rev(back, &shard->lru, lru) {
+			if (!HA_ATOMIC_LOAD(&back->refcnt)) {
+				old = back;
+				break;
+			}
+		}
+
+		if (!old) {
+			/* everything is in use, don't grow past the limit */
+			ent = NULL;
+			goto done;
+		}
+
+		ebmb_delete(&old->node);
+		LIST_DELETE(&old->lru);
+		shard->count--;
+		shard->evicted++;
+		free(old);
+	}
+
+	ent = calloc(1, sizeof(*ent) + len + 1);
+	if (!ent)
+		goto done;
+
+	memcpy(ent->node.key, key, len + 1);
+	ent->shard = shard - host_stats_shards;
+	ent->refcnt = 1;
+	ebst_insert(&shard->keys, &ent->node);
+	LIST_INSERT(&shard->lru, &ent->lru);
+	shard->count++;
+ done:
+	HA_SPIN_UNLOCK(HOST_STATS_LOCK, &shard->lock);
+	return ent;
+}
+
+/* config parser for global "tune.host-stats.max-entries" */
+static int cfg_parse_host_stats_max_entries(char **args, int section_type, struct proxy *curpx,
+                                            const struct proxy *defpx, const char *file, int line,
+                                            char **err)
+{
+	int max;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	max = atoi(args[1]);
+	if (max < 0) {
+		memprintf(err, "'%s' expects a positive number of entries but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+
+	global.tune.host_stats_max = max;
+	return 0;
+}
+
+/* parses the "show host-stats" CLI command, it only preallocates the context */
+static int cli_parse_show_host_stats(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	struct show_host_stats_ctx *ctx = applet_reserve_svcctx(appctx, sizeof(*ctx));
+
+	ctx->shard = 0;
+	ctx->entry = NULL;
+	return 0;
+}
+
+/* dumps the whole store for the "show host-stats" CLI command. Upon a full
+ * output buffer, a reference is kept on the entry to resume from so that it
+ * cannot be evicted in between. Returns 1 when done, 0 if interrupted.
+ */
+static int cli_io_handler_show_host_stats(struct appctx *appctx)
+{
+	struct show_host_stats_ctx *ctx = appctx->svcctx;
+	struct host_stats_entry *ent;
+
+	if (!ctx->shard && !ctx->entry) {
+		chunk_printf(&trash, "# host req_tot 1xx 2xx 3xx 4xx 5xx other\n");
+		if (applet_putchk(appctx, &trash) == -1)
+			return 0;
+	}
+
+	while (ctx->shard < HOST_STATS_SHARDS) {
+		struct host_stats_shard *shard = &host_stats_shards[ctx->shard];
+		struct ebmb_node *node;
+
+		HA_SPIN_LOCK(HOST_STATS_LOCK, &shard->lock);
+		if (ctx->entry) {
+			ent = ctx->entry;
+			ctx->entry = NULL;
+			host_stats_put(ent);
+			node = &ent->node;
+		}
+		else
+			node = ebmb_first(&shard->keys);
+
+		while (node) {
+			ent = ebmb_entry(node, struct host_stats_entry, node);
+			chunk_printf(&trash, "%s %lld %lld %lld %lld %lld %lld %lld\n",
+				     (const char *)ent->node.key, ent->req_tot,
+				     ent->rsp[1], ent->rsp[2], ent->rsp[3],
+				     ent->rsp[4], ent->rsp[5], ent->rsp[0]);
+			if (applet_putchk(appctx, &trash) == -1) {
+				/* stay on this entry and protect it from
+				 * eviction while the lock is released.
+				 */
+				HA_ATOMIC_INC(&ent->refcnt);
+				ctx->entry = ent;
+				HA_SPIN_UNLOCK(HOST_STATS_LOCK, &shard->lock);
+				return 0;
+			}
+			node = ebmb_next(node);
+		}
+		HA_SPIN_UNLOCK(HOST_STATS_LOCK, &shard->lock);
+		ctx->shard++;
+	}
+	return 1;
+}
+
+/* releases the reference possibly held across two dump invocations */
+static void cli_release_show_host_stats(struct appctx *appctx)
+{
+	struct show_host_stats_ctx *ctx = appctx->svcctx;
+
+	if (ctx->entry)
+		host_stats_put(ctx->entry);
+}
+
+static void init_host_stats()
+{
+	int i;
+
+	for (i = 0; i < HOST_STATS_SHARDS; i++) {
+		host_stats_shards[i].keys = EB_ROOT_UNIQUE;
+		LIST_INIT(&host_stats_shards[i].lru);
+		HA_SPIN_INIT(&host_stats_shards[i].lock);
+	}
+}
+
+INITCALL0(STG_PREPARE, init_host_stats);
+
+/* config keyword parsers */
+static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.host-stats.max-entries", cfg_parse_host_stats_max_entries },
+	{ 0, NULL, NULL }
+}};
+
+INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
+
+/* register cli keywords */
+static struct cli_kw_list cli_kws = {{ },{
+	{ { "show", "host-stats", NULL }, "show host-stats                         : show per-host traffic statistics", cli_parse_show_host_stats, cli_io_handler_show_host_stats, cli_release_show_host_stats },
+	{{},}
+}};
+
+INITCALL1(STG_REGISTER, cli_register_kw, &cli_kws);
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -140,6 +140,20 @@ const signed short hpack_pos_len[32] = {
 
 /* Tries to encode header whose name is <n> and value <v> into the chunk <out>.
  * Returns non-zero on success, 0 on failure (buffer full).
+ *
+ * Note that the encoder is deliberately stateless and never adds its own
+ * entries to a dynamic table, even though indexing repeated custom headers
+ * would save bytes on the wire. Doing so requires keeping a mirror of the
+ * decoder's table that exactly matches the emitted instructions, and this
+ * does not resist the way the muxes use this function: a partially encoded
+ * HEADERS frame may be abandoned on lack of room and fully re-encoded later,
+ * so insertions performed during the aborted attempt would desynchronize the
+ * peer. It would also require honoring the peer's advertised table size and
+ * emitting dynamic table size updates, which the muxes currently ignore.
+ * Until the callers can commit table updates only once a frame is known to
+ * leave, only the static table is used, with the "literal with incremental
+ * indexing" representation kept because its 6-bit prefix encodes all static
+ * indexes in a single byte.
  */
 int hpack_encode_header(struct buffer *out, const struct ist n,
 			const struct ist v)
@@ -733,6 +733,15 @@ int huff_enc(const char *s, char *out)
  * with new bytes. Shift operations are cheap when done a single time like this.
  * On 64-bit platforms it is possible to further improve this by storing both
  * of them in a single word.
+ *
+ * A note on the code lengths <l> below: they are deliberately recomputed
+ * from comparisons on the code word instead of being stored next to the
+ * symbol in the lookup tables (which the dev/hpack generator can emit).
+ * The length feeds the loop-carried <shift>, so a combined symbol+length
+ * table puts a load on the critical path of every iteration, while the
+ * comparison trees predict almost perfectly on header text and resolve
+ * in parallel with the symbol load. The combined-table variant measured
+ * ~10% slower on realistic header values, so don't "optimize" this back.
  */
 int huff_dec(const uint8_t *huff, int hlen, char *out, int olen)
 {
@@ -802,6 +802,22 @@ char *http_find_hdr_value_end(char *s, const char *e)
 
 	quoted = qdpair = 0;
 
+#ifdef HA_UNALIGNED_LE64
+	/* speedup: skip everything not a comma nor a double quote */
+	for (; s <= e - sizeof(long); s += sizeof(long)) {
+		unsigned long c = *(unsigned long *)s; // comma
+		unsigned long q = c;                   // quote
+
+		c ^= 0x2c2c2c2c2c2c2c2cULL; // contains one zero on a comma
+		q ^= 0x2222222222222222ULL; // contains one zero on a quote
+
+		c = (c - 0x0101010101010101ULL) & ~c; // contains 0x80 below a comma
+		q = (q - 0x0101010101010101ULL) & ~q; // contains 0x80 below a quote
+
+		if ((c | q) & 0x8080808080808080ULL)
+			break; // found a comma or a quote
+	}
+#endif
 #ifdef HA_UNALIGNED_LE
 	/* speedup: skip everything not a comma nor a double quote */
 	for (; s <= e - sizeof(int); s += sizeof(int)) {
@@ -840,6 +856,45 @@ char *http_find_cookie_value_end(char *s, const char *e)
 	int quoted, qdpair;
 
 	quoted = qdpair = 0;
+
+#ifdef HA_UNALIGNED_LE64
+	/* speedup: skip everything not a comma, a semi-colon nor a double quote */
+	for (; s <= e - sizeof(long); s += sizeof(long)) {
+		unsigned long c = *(unsigned long *)s; // comma
+		unsigned long q = c;                   // quote
+		unsigned long m = c;                   // semi-colon
+
+		c ^= 0x2c2c2c2c2c2c2c2cULL; // contains one zero on a comma
+		q ^= 0x2222222222222222ULL; // contains one zero on a quote
+		m ^= 0x3b3b3b3b3b3b3b3bULL; // contains one zero on a semi-colon
+
+		c = (c - 0x0101010101010101ULL) & ~c; // contains 0x80 below a comma
+		q = (q - 0x0101010101010101ULL) & ~q; // contains 0x80 below a quote
+		m = (m - 0x0101010101010101ULL) & ~m; // contains 0x80 below a semi-colon
+
+		if ((c | q | m) & 0x8080808080808080ULL)
+			break; // found a comma, a semi-colon or a quote
+	}
+#endif
+#ifdef HA_UNALIGNED_LE
+	/* speedup: skip everything not a comma, a semi-colon nor a double quote */
+	for (; s <= e - sizeof(int); s += sizeof(int)) {
+		unsigned int c = *(int *)s; // comma
+		unsigned int q = c;         // quote
+		unsigned int m = c;         // semi-colon
+
+		c ^= 0x2c2c2c2c; // contains one zero on a comma
+		q ^= 0x22222222; // contains one zero on a quote
+		m ^= 0x3b3b3b3b; // contains one zero on a semi-colon
+
+		c = (c - 0x01010101) & ~c; // contains 0x80 below a comma
+		q = (q - 0x01010101) & ~q; // contains 0x80 below a quote
+		m = (m - 0x01010101) & ~m; // contains 0x80 below a semi-colon
+
+		if ((c | q | m) & 0x80808080)
+			break; // found a comma, a semi-colon or a quote
+	}
+#endif
 	for (; s < e; s++) {
 		if (qdpair)                    qdpair = 0;
 		else if (quoted) {
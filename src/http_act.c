@@ -28,6 +28,7 @@
 #include <haproxy/http_ana.h>
 #include <haproxy/http_htx.h>
 #include <haproxy/http_rules.h>
+#include <haproxy/init.h>
 #include <haproxy/log.h>
 #include <haproxy/pattern.h>
 #include <haproxy/pool.h>
@@ -49,6 +50,7 @@ static void release_http_action(struct act_rule *rule)
 	struct logformat_node *lf, *lfb;
 
 	istfree(&rule->arg.http.str);
+	istfree(&rule->arg.http.static_val);
 	if (rule->arg.http.re)
 		regex_free(rule->arg.http.re);
 	list_for_each_entry_safe(lf, lfb, &rule->arg.http.fmt, list) {
@@ -200,6 +202,194 @@ static enum act_parse_ret parse_set_req_line(const char **args, int *orig_arg, s
 	return ACT_RET_PRS_OK;
 }
 
+/* This function executes a chain of normalizers fused into a single
+ * http-request normalize-uri rule. The normalizers are stored in
+ * rule->arg.act.p[0], with their count in rule->arg.act.p[1], and are applied
+ * in sequence on the path, juggling between two scratch buffers. The request
+ * start line is only rewritten once at the end, which spares one HTX rewrite
+ * and one path parsing per extra normalizer compared to a series of
+ * single-normalizer rules. Errors are handled as in
+ * http_action_normalize_uri().
+ */
+static enum act_return http_action_normalize_uri_chain(struct act_rule *rule, struct proxy *px,
+                                                       struct session *sess, struct stream *s, int flags)
+{
+	enum act_return ret = ACT_RET_CONT;
+	struct htx *htx = htxbuf(&s->req.buf);
+	const struct ist uri = htx_sl_req_uri(http_get_stline(htx));
+	const enum act_normalize_uri *steps = rule->arg.act.p[0];
+	const size_t nb_steps = (uintptr_t)rule->arg.act.p[1];
+	struct buffer *buf[2] = { NULL, NULL };
+	enum uri_normalizer_err err = URI_NORMALIZER_ERR_NONE;
+	struct http_uri_parser parser = http_uri_parser_init(uri);
+	struct ist cur;
+	int bi = 0;
+	size_t i;
+
+	buf[0] = alloc_trash_chunk();
+	buf[1] = alloc_trash_chunk();
+	if (!buf[0] || !buf[1])
+		goto fail_alloc;
+
+	cur = http_parse_path(&parser);
+	if (!isttest(cur))
+		goto leave;
+
+	for (i = 0; i < nb_steps; i++) {
+		struct buffer *dst = buf[bi];
+		struct ist out;
+
+		switch (steps[i]) {
+		case ACT_NORMALIZE_URI_PATH_MERGE_SLASHES:
+		case ACT_NORMALIZE_URI_PATH_STRIP_DOT:
+		case ACT_NORMALIZE_URI_PATH_STRIP_DOTDOT:
+		case ACT_NORMALIZE_URI_PATH_STRIP_DOTDOT_FULL: {
+			/* These normalizers only see the path component, the
+			 * query string is glued back after their output.
+			 */
+			const struct ist suffix = istfind(cur, '?');
+
+			if (istlen(suffix) >= b_size(dst)) {
+				err = URI_NORMALIZER_ERR_ALLOC;
+				break;
+			}
+
+			out = ist2(b_orig(dst), b_size(dst) - istlen(suffix));
+			if (steps[i] == ACT_NORMALIZE_URI_PATH_MERGE_SLASHES)
+				err = uri_normalizer_path_merge_slashes(iststop(cur, '?'), &out);
+			else if (steps[i] == ACT_NORMALIZE_URI_PATH_STRIP_DOT)
+				err = uri_normalizer_path_dot(iststop(cur, '?'), &out);
+			else
+				err = uri_normalizer_path_dotdot(iststop(cur, '?'), steps[i] == ACT_NORMALIZE_URI_PATH_STRIP_DOTDOT_FULL, &out);
+
+			if (err != URI_NORMALIZER_ERR_NONE)
+				break;
+
+			memcpy(istend(out), istptr(suffix), istlen(suffix));
+			cur = ist2(istptr(out), istlen(out) + istlen(suffix));
+			bi ^= 1;
+			break;
+		}
+		case ACT_NORMALIZE_URI_QUERY_SORT_BY_NAME: {
+			const struct ist path = iststop(cur, '?');
+			const struct ist query = istfind(cur, '?');
+
+			/* nothing to sort without a query string */
+			if (!istlen(query))
+				break;
+
+			if (istlen(path) >= b_size(dst)) {
+				err = URI_NORMALIZER_ERR_ALLOC;
+				break;
+			}
+
+			memcpy(b_orig(dst), istptr(path), istlen(path));
+			out = ist2(b_orig(dst) + istlen(path), b_size(dst) - istlen(path));
+			err = uri_normalizer_query_sort(query, '&', &out);
+
+			if (err != URI_NORMALIZER_ERR_NONE)
+				break;
+
+			cur = ist2(b_orig(dst), istlen(path) + istlen(out));
+			bi ^= 1;
+			break;
+		}
+		case ACT_NORMALIZE_URI_PERCENT_TO_UPPERCASE:
+		case ACT_NORMALIZE_URI_PERCENT_TO_UPPERCASE_STRICT:
+			out = ist2(b_orig(dst), b_size(dst));
+			err = uri_normalizer_percent_upper(cur, steps[i] == ACT_NORMALIZE_URI_PERCENT_TO_UPPERCASE_STRICT, &out);
+
+			if (err != URI_NORMALIZER_ERR_NONE)
+				break;
+
+			cur = out;
+			bi ^= 1;
+			break;
+		case ACT_NORMALIZE_URI_PERCENT_DECODE_UNRESERVED:
+		case ACT_NORMALIZE_URI_PERCENT_DECODE_UNRESERVED_STRICT:
+			out = ist2(b_orig(dst), b_size(dst));
+			err = uri_normalizer_percent_decode_unreserved(cur, steps[i] == ACT_NORMALIZE_URI_PERCENT_DECODE_UNRESERVED_STRICT, &out);
+
+			if (err != URI_NORMALIZER_ERR_NONE)
+				break;
+
+			cur = out;
+			bi ^= 1;
+			break;
+		case ACT_NORMALIZE_URI_FRAGMENT_STRIP:
+			out = ist2(b_orig(dst), b_size(dst));
+			err = uri_normalizer_fragment_strip(cur, &out);
+
+			if (err != URI_NORMALIZER_ERR_NONE)
+				break;
+
+			cur = out;
+			bi ^= 1;
+			break;
+		case ACT_NORMALIZE_URI_FRAGMENT_ENCODE:
+			out = ist2(b_orig(dst), b_size(dst));
+			err = uri_normalizer_fragment_encode(cur, &out);
+
+			if (err != URI_NORMALIZER_ERR_NONE)
+				break;
+
+			cur = out;
+			bi ^= 1;
+			break;
+		case ACT_NORMALIZE_URI_CHAIN:
+			/* not a normalizer, cannot be a chain element */
+			my_unreachable();
+			break;
+		}
+
+		if (err != URI_NORMALIZER_ERR_NONE)
+			break;
+	}
+
+	if (err == URI_NORMALIZER_ERR_NONE && !http_replace_req_path(htx, cur, 1))
+		goto fail_rewrite;
+
+	switch (err) {
+	case URI_NORMALIZER_ERR_NONE:
+		break;
+	case URI_NORMALIZER_ERR_INTERNAL_ERROR:
+		ret = ACT_RET_ERR;
+		break;
+	case URI_NORMALIZER_ERR_INVALID_INPUT:
+		ret = ACT_RET_INV;
+		break;
+	case URI_NORMALIZER_ERR_ALLOC:
+		goto fail_alloc;
+	}
+
+  leave:
+	free_trash_chunk(buf[1]);
+	free_trash_chunk(buf[0]);
+	return ret;
+
+  fail_alloc:
+	if (!(s->flags & SF_ERR_MASK))
+		s->flags |= SF_ERR_RESOURCE;
+	ret = ACT_RET_ERR;
+	goto leave;
+
+  fail_rewrite:
+	_HA_ATOMIC_ADD(&sess->fe->fe_counters.failed_rewrites, 1);
+	if (s->flags & SF_BE_ASSIGNED)
+		_HA_ATOMIC_ADD(&s->be->be_counters.failed_rewrites, 1);
+	if (sess->listener && sess->listener->counters)
+		_HA_ATOMIC_ADD(&sess->listener->counters->failed_rewrites, 1);
+	if (objt_server(s->target))
+		_HA_ATOMIC_ADD(&__objt_server(s->target)->counters.failed_rewrites, 1);
+
+	if (!(s->txn->req.flags & HTTP_MSGF_SOFT_RW)) {
+		ret = ACT_RET_ERR;
+		if (!(s->flags & SF_ERR_MASK))
+			s->flags |= SF_ERR_PRXCOND;
+	}
+	goto leave;
+}
+
 /* This function executes the http-request normalize-uri action.
  * `rule->action` is expected to be a value from `enum act_normalize_uri`.
  *
@@ -367,6 +557,10 @@ static enum act_return http_action_normalize_uri(struct act_rule *rule, struct p
 
 			break;
 		}
+		case ACT_NORMALIZE_URI_CHAIN:
+			/* chains are handled by http_action_normalize_uri_chain() */
+			my_unreachable();
+			break;
 	}
 
 	switch (err) {
@@ -409,8 +603,17 @@ static enum act_return http_action_normalize_uri(struct act_rule *rule, struct p
 	goto leave;
 }
 
-/* Parses the http-request normalize-uri action. It expects a single <normalizer>
- * argument, corresponding too a value in `enum act_normalize_uri`.
+/* Releases the normalizer chain of a fused normalize-uri rule. */
+static void release_http_normalize_uri_chain(struct act_rule *rule)
+{
+	free(rule->arg.act.p[0]);
+}
+
+/* Parses the http-request normalize-uri action. It expects one or several
+ * <normalizer> arguments, each corresponding to a value in
+ * `enum act_normalize_uri`. A single normalizer is stored in the rule action
+ * itself, while several of them are fused into a chain executed by
+ * http_action_normalize_uri_chain() with a single start line rewrite.
  *
  * It returns ACT_RET_PRS_OK on success, ACT_RET_PRS_ERR on error.
  */
@@ -418,6 +621,8 @@ static enum act_parse_ret parse_http_normalize_uri(const char **args, int *orig_
                                                    struct act_rule *rule, char **err)
 {
 	int cur_arg = *orig_arg;
+	enum act_normalize_uri steps[16];
+	size_t nb_steps = 0;
 
 	rule->action_ptr = http_action_normalize_uri;
 	rule->release_ptr = NULL;
@@ -427,79 +632,93 @@ static enum act_parse_ret parse_http_normalize_uri(const char **args, int *orig_
 		return ACT_RET_PRS_ERR;
 	}
 
-	if (strcmp(args[cur_arg], "path-merge-slashes") == 0) {
-		cur_arg++;
-
-		rule->action = ACT_NORMALIZE_URI_PATH_MERGE_SLASHES;
-	}
-	else if (strcmp(args[cur_arg], "path-strip-dot") == 0) {
-		cur_arg++;
+	while (*args[cur_arg] && strcmp(args[cur_arg], "if") != 0 && strcmp(args[cur_arg], "unless") != 0) {
+		enum act_normalize_uri action;
 
-		rule->action = ACT_NORMALIZE_URI_PATH_STRIP_DOT;
-	}
-	else if (strcmp(args[cur_arg], "path-strip-dotdot") == 0) {
-		cur_arg++;
+		if (strcmp(args[cur_arg], "path-merge-slashes") == 0) {
+			cur_arg++;
 
-		if (strcmp(args[cur_arg], "full") == 0) {
+			action = ACT_NORMALIZE_URI_PATH_MERGE_SLASHES;
+		}
+		else if (strcmp(args[cur_arg], "path-strip-dot") == 0) {
 			cur_arg++;
-			rule->action = ACT_NORMALIZE_URI_PATH_STRIP_DOTDOT_FULL;
+
+			action = ACT_NORMALIZE_URI_PATH_STRIP_DOT;
 		}
-		else if (!*args[cur_arg]) {
-			rule->action = ACT_NORMALIZE_URI_PATH_STRIP_DOTDOT;
+		else if (strcmp(args[cur_arg], "path-strip-dotdot") == 0) {
+			cur_arg++;
+
+			if (strcmp(args[cur_arg], "full") == 0) {
+				cur_arg++;
+				action = ACT_NORMALIZE_URI_PATH_STRIP_DOTDOT_FULL;
+			}
+			else
+				action = ACT_NORMALIZE_URI_PATH_STRIP_DOTDOT;
 		}
-		else if (strcmp(args[cur_arg], "if") != 0 && strcmp(args[cur_arg], "unless") != 0) {
-			memprintf(err, "unknown argument '%s' for 'path-strip-dotdot' normalizer", args[cur_arg]);
-			return ACT_RET_PRS_ERR;
+		else if (strcmp(args[cur_arg], "query-sort-by-name") == 0) {
+			cur_arg++;
+
+			action = ACT_NORMALIZE_URI_QUERY_SORT_BY_NAME;
 		}
-	}
-	else if (strcmp(args[cur_arg], "query-sort-by-name") == 0) {
-		cur_arg++;
+		else if (strcmp(args[cur_arg], "percent-to-uppercase") == 0) {
+			cur_arg++;
 
-		rule->action = ACT_NORMALIZE_URI_QUERY_SORT_BY_NAME;
-	}
-	else if (strcmp(args[cur_arg], "percent-to-uppercase") == 0) {
-		cur_arg++;
+			if (strcmp(args[cur_arg], "strict") == 0) {
+				cur_arg++;
+				action = ACT_NORMALIZE_URI_PERCENT_TO_UPPERCASE_STRICT;
+			}
+			else
+				action = ACT_NORMALIZE_URI_PERCENT_TO_UPPERCASE;
+		}
+		else if (strcmp(args[cur_arg], "percent-decode-unreserved") == 0) {
+			cur_arg++;
 
-		if (strcmp(args[cur_arg], "strict") == 0) {
+			if (strcmp(args[cur_arg], "strict") == 0) {
+				cur_arg++;
+				action = ACT_NORMALIZE_URI_PERCENT_DECODE_UNRESERVED_STRICT;
+			}
+			else
+				action = ACT_NORMALIZE_URI_PERCENT_DECODE_UNRESERVED;
+		}
+		else if (strcmp(args[cur_arg], "fragment-strip") == 0) {
 			cur_arg++;
-			rule->action = ACT_NORMALIZE_URI_PERCENT_TO_UPPERCASE_STRICT;
+
+			action = ACT_NORMALIZE_URI_FRAGMENT_STRIP;
 		}
-		else if (!*args[cur_arg]) {
-			rule->action = ACT_NORMALIZE_URI_PERCENT_TO_UPPERCASE;
+		else if (strcmp(args[cur_arg], "fragment-encode") == 0) {
+			cur_arg++;
+
+			action = ACT_NORMALIZE_URI_FRAGMENT_ENCODE;
 		}
-		else if (strcmp(args[cur_arg], "if") != 0 && strcmp(args[cur_arg], "unless") != 0) {
-			memprintf(err, "unknown argument '%s' for 'percent-to-uppercase' normalizer", args[cur_arg]);
+		else {
+			memprintf(err, "unknown normalizer '%s'", args[cur_arg]);
 			return ACT_RET_PRS_ERR;
 		}
-	}
-	else if (strcmp(args[cur_arg], "percent-decode-unreserved") == 0) {
-		cur_arg++;
 
-		if (strcmp(args[cur_arg], "strict") == 0) {
-			cur_arg++;
-			rule->action = ACT_NORMALIZE_URI_PERCENT_DECODE_UNRESERVED_STRICT;
-		}
-		else if (!*args[cur_arg]) {
-			rule->action = ACT_NORMALIZE_URI_PERCENT_DECODE_UNRESERVED;
-		}
-		else if (strcmp(args[cur_arg], "if") != 0 && strcmp(args[cur_arg], "unless") != 0) {
-			memprintf(err, "unknown argument '%s' for 'percent-decode-unreserved' normalizer", args[cur_arg]);
+		if (nb_steps >= sizeof(steps) / sizeof(steps[0])) {
+			memprintf(err, "too many normalizers in a single rule (max %zu)", sizeof(steps) / sizeof(steps[0]));
 			return ACT_RET_PRS_ERR;
 		}
+		steps[nb_steps++] = action;
 	}
-	else if (strcmp(args[cur_arg], "fragment-strip") == 0) {
-		cur_arg++;
 
-		rule->action = ACT_NORMALIZE_URI_FRAGMENT_STRIP;
-	}
-	else if (strcmp(args[cur_arg], "fragment-encode") == 0) {
-		cur_arg++;
-
-		rule->action = ACT_NORMALIZE_URI_FRAGMENT_ENCODE;
-	}
+	if (nb_steps == 1)
+		rule->action = steps[0];
 	else {
-		memprintf(err, "unknown normalizer '%s'", args[cur_arg]);
-		return ACT_RET_PRS_ERR;
+		enum act_normalize_uri *chain;
+
+		chain = malloc(nb_steps * sizeof(*chain));
+		if (!chain) {
+			memprintf(err, "out of memory");
+			return ACT_RET_PRS_ERR;
+		}
+		memcpy(chain, steps, nb_steps * sizeof(*chain));
+
+		rule->action = ACT_NORMALIZE_URI_CHAIN;
+		rule->action_ptr = http_action_normalize_uri_chain;
+		rule->release_ptr = release_http_normalize_uri_chain;
+		rule->arg.act.p[0] = chain;
+		rule->arg.act.p[1] = (void *)(uintptr_t)nb_steps;
 	}
 
 	*orig_arg = cur_arg;
@@ -1351,16 +1570,28 @@ static enum act_return http_action_early_hint(struct act_rule *rule, struct prox
 	struct act_rule *next_rule;
 	struct channel *res = &s->res;
 	struct htx *htx = htx_from_buf(&res->buf);
-	struct buffer *value = alloc_trash_chunk();
+	struct buffer *value = NULL;
+	struct ist hint;
 	enum act_return ret = ACT_RET_CONT;
 
 	if (!(s->txn->req.flags & HTTP_MSGF_VER_11))
 		goto leave;
 
-	if (!value) {
-		if (!(s->flags & SF_ERR_MASK))
-			s->flags |= SF_ERR_RESOURCE;
-		goto error;
+	/* The value was precomputed at parsing time for purely static
+	 * formats, sparing a chunk allocation and a logline build per
+	 * request. Dynamic ones are still built now.
+	 */
+	if (isttest(rule->arg.http.static_val))
+		hint = rule->arg.http.static_val;
+	else {
+		value = alloc_trash_chunk();
+		if (!value) {
+			if (!(s->flags & SF_ERR_MASK))
+				s->flags |= SF_ERR_RESOURCE;
+			goto error;
+		}
+		value->data = build_logline(s, b_tail(value), b_room(value), &rule->arg.http.fmt);
+		hint = ist2(b_head(value), b_data(value));
 	}
 
 	/* if there is no pending 103 response, start a new response. Otherwise,
@@ -1380,8 +1611,7 @@ static enum act_return http_action_early_hint(struct act_rule *rule, struct prox
 	}
 
 	/* Add the HTTP Early Hint HTTP 103 response heade */
-	value->data = build_logline(s, b_tail(value), b_room(value), &rule->arg.http.fmt);
-	if (!htx_add_header(htx, rule->arg.http.str, ist2(b_head(value), b_data(value))))
+	if (!htx_add_header(htx, rule->arg.http.str, hint))
 		goto error;
 
 	/* if it is the last rule or the next one is not an early-hint or an
@@ -1529,6 +1759,37 @@ static enum act_parse_ret parse_http_set_header(const char **args, int *orig_arg
 		return ACT_RET_PRS_ERR;
 	}
 
+	if (rule->action_ptr == http_action_early_hint) {
+		struct logformat_node *lf;
+		size_t len = 0;
+
+		/* Early hints are mostly emitted with constant values (a few
+		 * "link" headers pointing to static assets). When the format
+		 * only contains raw text, precompute the value now so that the
+		 * rule does not rebuild the same string for every request.
+		 */
+		list_for_each_entry(lf, &rule->arg.http.fmt, list) {
+			if (lf->type != LOG_FMT_TEXT) {
+				len = 0;
+				break;
+			}
+			len += lf->arg_len;
+		}
+		if (len) {
+			char *value = malloc(len + 1);
+
+			if (value) {
+				len = 0;
+				list_for_each_entry(lf, &rule->arg.http.fmt, list) {
+					memcpy(value + len, lf->arg, lf->arg_len);
+					len += lf->arg_len;
+				}
+				value[len] = '\0';
+				rule->arg.http.static_val = ist2(value, len);
+			}
+		}
+	}
+
 	free(px->conf.lfs_file);
 	px->conf.lfs_file = strdup(px->conf.args.file);
 	px->conf.lfs_line = px->conf.args.line;
@@ -1750,6 +2011,331 @@ static enum act_parse_ret parse_http_del_header(const char **args, int *orig_arg
 	return ACT_RET_PRS_OK;
 }
 
+/* Maximum number of set-header/add-header values a single compiled header
+ * program may have to build per message. It bounds the on-stack array of
+ * value buffers in the executor; longer runs are split into several programs.
+ */
+#define HTTP_HDR_PROG_VALS 16
+
+/* A compiled header program, replacing a run of consecutive unconditional
+ * set-header/add-header/del-header rules so that all of them are applied in
+ * a single pass over the message instead of one full headers walk per rule.
+ * The original rules are moved here and keep carrying the names, formats and
+ * matching methods.
+ */
+struct http_hdr_prog {
+	struct list rules;    /* folded set/add/del-header rules, in order */
+	int nb_vals;          /* number of rules needing a value build */
+};
+
+/* returns non-zero if del-header rule <rule> matches header name <n>, using
+ * the same matching methods as the http_find_*_header() lookup functions.
+ */
+static int http_hdr_prog_del_match(const struct act_rule *rule, const struct ist n)
+{
+	const struct ist name = rule->arg.http.str;
+
+	switch (rule->action) {
+	case PAT_MATCH_STR:
+		return isteqi(n, name);
+	case PAT_MATCH_BEG:
+		return istlen(n) >= istlen(name) &&
+		       isteqi(ist2(istptr(n), istlen(name)), name);
+	case PAT_MATCH_END:
+		return istlen(n) >= istlen(name) &&
+		       isteqi(ist2(istend(n) - istlen(name), istlen(name)), name);
+	case PAT_MATCH_SUB:
+		return !!strnistr(istptr(n), istlen(n), istptr(name), istlen(name));
+	case PAT_MATCH_REG:
+		return regex_exec2(rule->arg.http.re, istptr(n), istlen(n));
+	}
+	return 0;
+}
+
+/* returns non-zero if folded rule <sub> wants header name <n> removed */
+static int http_hdr_prog_rule_match(const struct act_rule *sub, const struct ist n)
+{
+	if (sub->action_ptr == http_action_set_header)
+		return sub->action == 0 && isteqi(n, sub->arg.http.str);
+	return http_hdr_prog_del_match(sub, n);
+}
+
+/* returns non-zero if one of the sample expressions of log-format string
+ * <fmt> may use information covered by <mask> (a set of SMP_USE_* flags).
+ */
+static int http_fmt_uses(const struct list *fmt, uint mask)
+{
+	struct logformat_node *lf;
+
+	list_for_each_entry(lf, fmt, list) {
+		const struct sample_expr *expr = lf->expr;
+
+		if (lf->type == LOG_FMT_EXPR && expr && (expr->fetch->use & mask))
+			return 1;
+	}
+	return 0;
+}
+
+/* returns non-zero if log-format string <fmt> contains no sample expression
+ * at all, in which case evaluating it cannot have any side effect.
+ */
+static int http_fmt_is_static(const struct list *fmt)
+{
+	struct logformat_node *lf;
+
+	list_for_each_entry(lf, fmt, list) {
+		if (lf->type == LOG_FMT_EXPR)
+			return 0;
+	}
+	return 1;
+}
+
+/* Releases a compiled header program and the folded rules it carries */
+static void release_http_hdr_prog(struct act_rule *rule)
+{
+	struct http_hdr_prog *prog = rule->arg.act.p[0];
+	struct act_rule *sub, *back;
+
+	list_for_each_entry_safe(sub, back, &prog->rules, list)
+		free_act_rule(sub);
+	free(prog);
+}
+
+/* This function executes a compiled header program. All the values of the
+ * folded set-header/add-header rules are built first, in rule order, then
+ * all the headers deleted or replaced by the program are removed in a single
+ * pass over the message, and finally the new values are appended. On success
+ * it returns ACT_RET_CONT. If an error occurs while soft rewrites are
+ * enabled, the action is canceled, but the rule processing continues.
+ * Otherwise ACT_RET_ERR is returned.
+ */
+static enum act_return http_action_hdr_prog(struct act_rule *rule, struct proxy *px,
+					    struct session *sess, struct stream *s, int flags)
+{
+	struct http_hdr_prog *prog = rule->arg.act.p[0];
+	struct http_msg *msg = ((rule->from == ACT_F_HTTP_REQ) ? &s->txn->req : &s->txn->rsp);
+	struct htx *htx = htxbuf(&msg->chn->buf);
+	struct buffer *vals[HTTP_HDR_PROG_VALS];
+	enum act_return ret = ACT_RET_CONT;
+	struct act_rule *sub;
+	struct htx_blk *blk;
+	int nb_vals = 0;
+	int i;
+
+	/* build all the header values first, in rule order. The compiler
+	 * guarantees that none of them samples the headers mutated by this
+	 * program, so the reordering cannot be observed.
+	 */
+	list_for_each_entry(sub, &prog->rules, list) {
+		struct buffer *replace;
+
+		if (sub->action_ptr != http_action_set_header)
+			continue;
+		replace = alloc_trash_chunk();
+		if (!replace)
+			goto fail_alloc;
+		replace->data = build_logline(s, replace->area, replace->size, &sub->arg.http.fmt);
+		vals[nb_vals++] = replace;
+	}
+
+	/* now remove, in one single pass over the headers, all occurrences of
+	 * the headers deleted or replaced by the program
+	 */
+	blk = htx_get_first_blk(htx);
+	while (blk) {
+		enum htx_blk_type type = htx_get_blk_type(blk);
+		struct ist n;
+
+		if (type == HTX_BLK_EOH)
+			break;
+		if (type != HTX_BLK_HDR) {
+			blk = htx_get_next_blk(htx, blk);
+			continue;
+		}
+
+		n = htx_get_blk_name(htx, blk);
+		list_for_each_entry(sub, &prog->rules, list) {
+			if (http_hdr_prog_rule_match(sub, n))
+				break;
+		}
+		if (&sub->list != &prog->rules) {
+			blk = htx_remove_blk(htx, blk);
+			continue;
+		}
+		blk = htx_get_next_blk(htx, blk);
+	}
+
+	/* finally append the new values, in rule order */
+	i = 0;
+	list_for_each_entry(sub, &prog->rules, list) {
+		if (sub->action_ptr != http_action_set_header)
+			continue;
+		if (!http_add_header(htx, sub->arg.http.str, ist2(vals[i]->area, vals[i]->data)))
+			goto fail_rewrite;
+		i++;
+	}
+
+  leave:
+	for (i = 0; i < nb_vals; i++)
+		free_trash_chunk(vals[i]);
+	return ret;
+
+  fail_alloc:
+	if (!(s->flags & SF_ERR_MASK))
+		s->flags |= SF_ERR_RESOURCE;
+	ret = ACT_RET_ERR;
+	goto leave;
+
+  fail_rewrite:
+	_HA_ATOMIC_INC(&sess->fe->fe_counters.failed_rewrites);
+	if (s->flags & SF_BE_ASSIGNED)
+		_HA_ATOMIC_INC(&s->be->be_counters.failed_rewrites);
+	if (sess->listener && sess->listener->counters)
+		_HA_ATOMIC_INC(&sess->listener->counters->failed_rewrites);
+	if (objt_server(s->target))
+		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.failed_rewrites);
+
+	if (!(msg->flags & HTTP_MSGF_SOFT_RW)) {
+		ret = ACT_RET_ERR;
+		if (!(s->flags & SF_ERR_MASK))
+			s->flags |= SF_ERR_PRXCOND;
+	}
+	goto leave;
+}
+
+/* Terminates the run accumulated in <prog>. If it holds at least two rules,
+ * a program rule executing all of them is inserted in <rules> before rule
+ * <before> (at the end of the list when NULL). Otherwise the folded rules
+ * are put back at the same place and the program is dropped. Always returns
+ * NULL so that callers can reset their current run.
+ */
+static struct http_hdr_prog *http_hdr_prog_flush(struct list *rules,
+						 struct http_hdr_prog *prog,
+						 struct act_rule *before)
+{
+	struct act_rule *sub, *back, *first, *rule;
+	struct list *anchor;
+	int count = 0;
+
+	if (!prog)
+		return NULL;
+
+	anchor = (before ? &before->list : rules);
+
+	list_for_each_entry(sub, &prog->rules, list)
+		count++;
+
+	if (count >= 2) {
+		first = LIST_ELEM(prog->rules.n, struct act_rule *, list);
+		rule = new_act_rule(first->from, first->conf.file, first->conf.line);
+		if (rule) {
+			rule->action = ACT_CUSTOM;
+			rule->action_ptr = http_action_hdr_prog;
+			rule->release_ptr = release_http_hdr_prog;
+			rule->kw = first->kw;
+			rule->arg.act.p[0] = prog;
+			LIST_APPEND(anchor, &rule->list);
+			return NULL;
+		}
+	}
+
+	/* not worth a program (or allocation failure), restore the rules */
+	list_for_each_entry_safe(sub, back, &prog->rules, list) {
+		LIST_DELETE(&sub->list);
+		LIST_APPEND(anchor, &sub->list);
+	}
+	free(prog);
+	return NULL;
+}
+
+/* Scans ruleset <rules> and replaces every run of at least two consecutive
+ * unconditional set-header/add-header/del-header rules by a single compiled
+ * program executing all of them in one pass over the message. Sequential
+ * semantics are preserved: a rule whose value samples the mutated side of
+ * the message may only start a run, and a rule canceling the effect of an
+ * earlier one either drops it (when its value is purely static) or starts
+ * a new program.
+ */
+static void http_compile_hdr_progs(struct list *rules)
+{
+	struct http_hdr_prog *prog = NULL;
+	struct act_rule *rule, *back;
+
+	list_for_each_entry_safe(rule, back, rules, list) {
+		int is_set = (rule->action_ptr == http_action_set_header);
+		int is_del = (rule->action_ptr == http_action_del_header);
+		struct act_rule *sub, *sback;
+		uint dep_mask;
+
+		if (rule->cond || (!is_set && !is_del)) {
+			prog = http_hdr_prog_flush(rules, prog, rule);
+			continue;
+		}
+
+		/* a value sampling the headers (or body) of the mutated side
+		 * must see all the preceding mutations, so such a rule cannot
+		 * be appended to an existing run.
+		 */
+		dep_mask = ((rule->from == ACT_F_HTTP_REQ)
+			    ? (SMP_USE_HRQHV|SMP_USE_HRQHP|SMP_USE_HRQBO)
+			    : (SMP_USE_HRSHV|SMP_USE_HRSHP|SMP_USE_HRSBO));
+		if (is_set && prog && http_fmt_uses(&rule->arg.http.fmt, dep_mask))
+			prog = http_hdr_prog_flush(rules, prog, rule);
+
+		if (is_set && prog && prog->nb_vals >= HTTP_HDR_PROG_VALS)
+			prog = http_hdr_prog_flush(rules, prog, rule);
+
+		/* a set-header cancels earlier set/add of the same name and a
+		 * del-header cancels earlier set/add whose static name it
+		 * matches. Drop the doomed rules when their value cannot have
+		 * side effects, otherwise keep strict ordering by starting a
+		 * new program.
+		 */
+		if (prog && (is_del || (is_set && rule->action == 0))) {
+			list_for_each_entry_safe(sub, sback, &prog->rules, list) {
+				if (sub->action_ptr != http_action_set_header)
+					continue;
+				if (!(is_del ? http_hdr_prog_del_match(rule, sub->arg.http.str)
+					     : isteqi(sub->arg.http.str, rule->arg.http.str)))
+					continue;
+				if (!http_fmt_is_static(&sub->arg.http.fmt)) {
+					prog = http_hdr_prog_flush(rules, prog, rule);
+					break;
+				}
+				prog->nb_vals--;
+				free_act_rule(sub);
+			}
+		}
+
+		if (!prog) {
+			prog = calloc(1, sizeof(*prog));
+			if (!prog)
+				return;
+			LIST_INIT(&prog->rules);
+			prog->nb_vals = 0;
+		}
+
+		LIST_DELETE(&rule->list);
+		LIST_APPEND(&prog->rules, &rule->list);
+		if (is_set)
+			prog->nb_vals++;
+	}
+	http_hdr_prog_flush(rules, prog, NULL);
+}
+
+/* post-proxy-check callback compiling the header mutation programs of all
+ * the proxy's HTTP rulesets
+ */
+static int http_postcheck_hdr_progs(struct proxy *px)
+{
+	http_compile_hdr_progs(&px->http_req_rules);
+	http_compile_hdr_progs(&px->http_res_rules);
+	http_compile_hdr_progs(&px->http_after_res_rules);
+	return ERR_NONE;
+}
+
+REGISTER_POST_PROXY_CHECK(http_postcheck_hdr_progs);
+
 /* Release memory allocated by an http redirect action. */
 static void release_http_redir(struct act_rule *rule)
 {
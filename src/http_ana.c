@@ -12,6 +12,7 @@
 
 #include <haproxy/acl.h>
 #include <haproxy/action-t.h>
+#include <haproxy/activity.h>
 #include <haproxy/api.h>
 #include <haproxy/applet.h>
 #include <haproxy/backend.h>
@@ -23,6 +24,7 @@
 #include <haproxy/connection.h>
 #include <haproxy/errors.h>
 #include <haproxy/filters.h>
+#include <haproxy/host_stats.h>
 #include <haproxy/http.h>
 #include <haproxy/http_ana.h>
 #include <haproxy/http_htx.h>
@@ -160,9 +162,47 @@ int http_wait_for_request(struct stream *s, struct channel *req, int an_bit)
 	stream_inc_http_req_ctr(s);
 	proxy_inc_fe_req_ctr(sess->listener, sess->fe, http_ver); /* one more valid request for this FE */
 
+	/* when per-host stats are enabled, take (or create) the entry matching
+	 * the request's host so that the response can also be accounted on it
+	 * at the end of the stream.
+	 */
+	if (unlikely(global.tune.host_stats_max) && !s->host_stats) {
+		struct http_hdr_ctx ctx = { .blk = NULL };
+		struct ist host = IST_NULL;
+
+		if (http_find_header(htx, ist("host"), &ctx, 0))
+			host = ctx.value;
+		else if (sl->flags & HTX_SL_F_HAS_AUTHORITY) {
+			struct http_uri_parser parser = http_uri_parser_init(htx_sl_req_uri(sl));
+
+			host = http_parse_authority(&parser, 1);
+		}
+
+		if (istlen(host)) {
+			s->host_stats = host_stats_get(istptr(host), istlen(host));
+			if (s->host_stats)
+				_HA_ATOMIC_INC(&s->host_stats->req_tot);
+		}
+	}
+
 	/* kill the pending keep-alive timeout */
 	req->analyse_exp = TICK_ETERNITY;
 
+	if (unlikely(_HA_ATOMIC_LOAD(&th_ctx->flags) & TH_FL_OVERLOADED) &&
+	    global.tune.overload_action == OVERLOAD_ACT_FAST503) {
+		/* This thread is overloaded and the "fast-503" action was
+		 * chosen: answer a 503 right now without processing the
+		 * request, it's way cheaper than letting it consume a server
+		 * connection. Monitor requests are not excluded on purpose so
+		 * that external LBs quickly divert the traffic.
+		 */
+		_HA_ATOMIC_INC(&activity[tid].shed_reqs);
+		txn->status = 503;
+		if (!(s->flags & SF_ERR_MASK))
+			s->flags |= SF_ERR_RESOURCE;
+		goto return_prx_cond;
+	}
+
 	BUG_ON(htx_get_first_type(htx) != HTX_BLK_REQ_SL);
 
 	/* 0: we might have to print this header in debug mode */
@@ -448,7 +488,9 @@ int http_process_req_common(struct stream *s, struct channel *req, int an_bit, s
 
 		/* parse the whole stats request and extract the relevant information */
 		http_handle_stats(s, req);
-		verdict = http_req_get_intercept_rule(px, NULL, &px->uri_auth->http_req_rules, s);
+		verdict = HTTP_RULE_RES_CONT;
+		if (!LIST_ISEMPTY(&px->uri_auth->http_req_rules))
+			verdict = http_req_get_intercept_rule(px, NULL, &px->uri_auth->http_req_rules, s);
 		/* not all actions implemented: deny, allow, auth */
 
 		if (verdict == HTTP_RULE_RES_DENY) /* stats http-request deny */
@@ -1122,6 +1164,14 @@ static __inline int do_l7_retry(struct stream *s, struct stconn *sc)
 	if (s->conn_retries >= s->be->conn_retries)
 		return -1;
 
+	/* the retry budget may deny the retry even though some retries are
+	 * left, to avoid multiplying the load on an already degraded farm.
+	 */
+	if (!be_retry_within_budget(s->be)) {
+		_HA_ATOMIC_INC(&s->be->be_counters.denied_retries);
+		return -1;
+	}
+
 	if (objt_server(s->target)) {
 		if (s->flags & SF_CURR_SESS) {
 			s->flags &= ~SF_CURR_SESS;
@@ -1130,6 +1180,7 @@ static __inline int do_l7_retry(struct stream *s, struct stconn *sc)
 		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.retries);
 	}
 	_HA_ATOMIC_INC(&s->be->be_counters.retries);
+	update_freq_ctr(&s->be->retry_per_sec, 1);
 
 	req = &s->req;
 	res = &s->res;
@@ -1701,7 +1752,8 @@ int http_process_res_common(struct stream *s, struct channel *rep, int an_bit, s
 			def_rules = ((cur_proxy->defpx && (cur_proxy == s->be || cur_proxy->defpx != s->be->defpx)) ? &cur_proxy->defpx->http_res_rules : NULL);
 			rules = &cur_proxy->http_res_rules;
 
-			ret = http_res_get_intercept_rule(cur_proxy, def_rules, rules, s);
+			if ((def_rules && !LIST_ISEMPTY(def_rules)) || !LIST_ISEMPTY(rules))
+				ret = http_res_get_intercept_rule(cur_proxy, def_rules, rules, s);
 
 			switch (ret) {
 			case HTTP_RULE_RES_YIELD: /* some data miss, call the function later. */
@@ -2938,7 +2990,7 @@ int http_eval_after_res_rules(struct stream *s)
 
 	/* prune the request variables if not already done and swap to the response variables. */
 	if (s->vars_reqres.scope != SCOPE_RES) {
-		if (!LIST_ISEMPTY(&s->vars_reqres.head))
+		if (!eb_is_empty(&s->vars_reqres.name_root))
 			vars_prune(&s->vars_reqres, s->sess, s);
 		vars_init_head(&s->vars_reqres, SCOPE_RES);
 	}
@@ -2946,11 +2998,13 @@ int http_eval_after_res_rules(struct stream *s)
 	def_rules = (s->be->defpx ? &s->be->defpx->http_after_res_rules : NULL);
 	rules = &s->be->http_after_res_rules;
 
-	ret = http_res_get_intercept_rule(s->be, def_rules, rules, s);
+	if ((def_rules && !LIST_ISEMPTY(def_rules)) || !LIST_ISEMPTY(rules))
+		ret = http_res_get_intercept_rule(s->be, def_rules, rules, s);
 	if ((ret == HTTP_RULE_RES_CONT || ret == HTTP_RULE_RES_STOP) && sess->fe != s->be) {
 		def_rules = ((sess->fe->defpx && sess->fe->defpx != s->be->defpx) ? &sess->fe->defpx->http_after_res_rules : NULL);
 		rules = &sess->fe->http_after_res_rules;
-		ret = http_res_get_intercept_rule(sess->fe, def_rules, rules, s);
+		if ((def_rules && !LIST_ISEMPTY(def_rules)) || !LIST_ISEMPTY(rules))
+			ret = http_res_get_intercept_rule(sess->fe, def_rules, rules, s);
 	}
 
   end:
@@ -5037,9 +5091,9 @@ void http_destroy_txn(struct stream *s)
 	txn->srv_cookie = NULL;
 	txn->cli_cookie = NULL;
 
-	if (!LIST_ISEMPTY(&s->vars_txn.head))
+	if (!eb_is_empty(&s->vars_txn.name_root))
 		vars_prune(&s->vars_txn, s->sess, s);
-	if (!LIST_ISEMPTY(&s->vars_reqres.head))
+	if (!eb_is_empty(&s->vars_reqres.name_root))
 		vars_prune(&s->vars_reqres, s->sess, s);
 
 	b_free(&txn->l7_buffer);
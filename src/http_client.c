@@ -15,6 +15,7 @@
 #include <haproxy/api.h>
 #include <haproxy/applet.h>
 #include <haproxy/cli.h>
+#include <haproxy/clock.h>
 #include <haproxy/ssl_ckch.h>
 #include <haproxy/dynbuf.h>
 #include <haproxy/cfgparse.h>
@@ -252,9 +253,194 @@ static void hc_cli_release(struct appctx *appctx)
 	return;
 }
 
+/* --- This part of the file implements a load generator over the CLI ---
+ * The "httpclient-load" command drives a configurable number of parallel
+ * httpclient instances through the regular stream and mux layers, which
+ * allows to benchmark a local frontend without an external load generator.
+ * The functions are starting with "hc_cli_load".
+ */
+
+/* the CLI context for the httpclient-load command */
+struct hcli_load_ctx {
+	struct httpclient **clients; /* running clients, up to <conc> entries */
+	struct ist uri;         /* target URI of all requests */
+	struct ist body;        /* optional request body */
+	enum http_meth_t meth;  /* method of the requests */
+	int conc;               /* number of parallel clients */
+	unsigned int todo;      /* requests not started yet */
+	unsigned int inflight;  /* started and not finished yet */
+	unsigned int done;      /* finished requests, including failed ones */
+	unsigned int errs;      /* requests without a final status */
+	unsigned int codes[4];  /* final status counts per class (2xx..5xx) */
+	unsigned int start_ms;  /* now_ms when the command was started */
+};
+
+/* accounts a finished request and releases its slot. The httpclient destroys
+ * itself once this callback returns (AUTOKILL), so the pointer must be
+ * forgotten here.
+ */
+static void hc_cli_load_end_cb(struct httpclient *hc)
+{
+	struct appctx *appctx = hc->caller;
+	struct hcli_load_ctx *ctx;
+	int i;
+
+	if (!appctx)
+		return;
+
+	ctx = appctx->svcctx;
+	for (i = 0; i < ctx->conc; i++) {
+		if (ctx->clients[i] == hc) {
+			ctx->clients[i] = NULL;
+			break;
+		}
+	}
+
+	if (hc->res.status >= 200 && hc->res.status < 600)
+		ctx->codes[hc->res.status / 100 - 2]++;
+	else
+		ctx->errs++;
+
+	ctx->inflight--;
+	ctx->done++;
+	appctx_wakeup(appctx);
+}
+
+/*
+ * Parse the load generation command on the cli:
+ * httpclient-load <count> <concurrency> <method> <URI>
+ */
+static int hc_cli_load_parse(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	struct hcli_load_ctx *ctx = applet_reserve_svcctx(appctx, sizeof(*ctx));
+	enum http_meth_t meth;
+	int count, conc;
+
+	if (!cli_has_level(appctx, ACCESS_LVL_ADMIN))
+		return 1;
+
+	if (!*args[1] || !*args[2] || !*args[3] || !*args[4])
+		return cli_err(appctx, "Usage: httpclient-load <count> <concurrency> <method> <URI>\n");
+
+	count = atoi(args[1]);
+	if (count <= 0)
+		return cli_err(appctx, "Invalid request count.\n");
+
+	conc = atoi(args[2]);
+	if (conc <= 0 || conc > 1000)
+		return cli_err(appctx, "Concurrency must be between 1 and 1000.\n");
+	if (conc > count)
+		conc = count;
+
+	meth = find_http_meth(args[3], strlen(args[3]));
+	if (meth >= HTTP_METH_OTHER)
+		return cli_err(appctx, "Invalid method.\n");
+
+	ctx->clients = calloc(conc, sizeof(*ctx->clients));
+	ctx->uri = istdup(ist(args[4]));
+	if (payload)
+		ctx->body = istdup(ist(payload));
+
+	if (!ctx->clients || !isttest(ctx->uri) || (payload && !isttest(ctx->body))) {
+		/* the io_release handler is not called when the parser fails */
+		ha_free(&ctx->clients);
+		istfree(&ctx->uri);
+		istfree(&ctx->body);
+		return cli_err(appctx, "Out of memory.\n");
+	}
+
+	ctx->meth = meth;
+	ctx->conc = conc;
+	ctx->todo = count;
+	ctx->start_ms = now_ms;
+
+	return 0;
+}
+
+/* This function starts new requests as long as free slots remain, then
+ * reports the final counters once everything completed.
+ *
+ * Return 1 when the processing is finished
+ * return 0 if it needs to be called again
+ */
+static int hc_cli_load_io_handler(struct appctx *appctx)
+{
+	struct hcli_load_ctx *ctx = appctx->svcctx;
+	struct httpclient *hc;
+	unsigned int ms;
+	int i;
+
+	/* keep <conc> requests in flight until all of them were started */
+	for (i = 0; ctx->todo && i < ctx->conc; i++) {
+		if (ctx->clients[i])
+			continue;
+
+		hc = httpclient_new(appctx, ctx->meth, ctx->uri);
+		if (hc) {
+			hc->ops.res_end = hc_cli_load_end_cb;
+			if (httpclient_req_gen(hc, hc->req.url, hc->req.meth, NULL, ctx->body) != ERR_NONE ||
+			    !httpclient_start(hc)) {
+				httpclient_stop_and_destroy(hc);
+				hc = NULL;
+			}
+		}
+		if (!hc) {
+			/* could not be started, account it as failed */
+			ctx->errs++;
+			ctx->done++;
+			ctx->todo--;
+			continue;
+		}
+		/* let the httpclient free itself once finished */
+		hc->flags |= HTTPCLIENT_FA_AUTOKILL;
+		ctx->clients[i] = hc;
+		ctx->inflight++;
+		ctx->todo--;
+	}
+
+	if (ctx->todo || ctx->inflight) {
+		applet_have_no_more_data(appctx);
+		return 0;
+	}
+
+	ms = now_ms - ctx->start_ms;
+	if (!ms)
+		ms = 1;
+
+	chunk_printf(&trash,
+	             "requests: %u\n"
+	             "2xx: %u\n3xx: %u\n4xx: %u\n5xx: %u\nfailed: %u\n"
+	             "time_ms: %u\n"
+	             "rate_rps: %llu\n",
+	             ctx->done,
+	             ctx->codes[0], ctx->codes[1], ctx->codes[2], ctx->codes[3], ctx->errs,
+	             ms, (unsigned long long)ctx->done * 1000ULL / ms);
+	if (applet_putchk(appctx, &trash) == -1)
+		return 0;
+	return 1;
+}
+
+static void hc_cli_load_release(struct appctx *appctx)
+{
+	struct hcli_load_ctx *ctx = appctx->svcctx;
+	int i;
+
+	/* the CLI stream is going away, stop the remaining clients. This
+	 * drops their caller so the end callback won't touch the appctx.
+	 */
+	for (i = 0; ctx->clients && i < ctx->conc; i++) {
+		if (ctx->clients[i])
+			httpclient_stop_and_destroy(ctx->clients[i]);
+	}
+	ha_free(&ctx->clients);
+	istfree(&ctx->uri);
+	istfree(&ctx->body);
+}
+
 /* register cli keywords */
 static struct cli_kw_list cli_kws = {{ },{
 	{ { "httpclient", NULL }, "httpclient <method> <URI>               : launch an HTTP request", hc_cli_parse, hc_cli_io_handler, hc_cli_release,  NULL, ACCESS_EXPERT},
+	{ { "httpclient-load", NULL }, "httpclient-load <cnt> <conc> <meth> <URI> : benchmark a URI with parallel requests", hc_cli_load_parse, hc_cli_load_io_handler, hc_cli_load_release, NULL, ACCESS_EXPERT},
 	{ { NULL }, NULL, NULL, NULL }
 }};
 
@@ -596,6 +782,16 @@ void httpclient_destroy(struct httpclient *hc)
 	/* we should never destroy a client which was started but not stopped  */
 	BUG_ON(httpclient_started(hc) && !httpclient_ended(hc));
 
+	/* a client destroyed before ending must not hold its batch's
+	 * completion back */
+	if (hc->batch) {
+		LIST_DEL_INIT(&hc->batch_el);
+		if (!(hc->flags & HTTPCLIENT_FS_ENDED) &&
+		    !--hc->batch->remaining && hc->batch->done)
+			hc->batch->done(hc->batch);
+		hc->batch = NULL;
+	}
+
 	/* request */
 	istfree(&hc->req.url);
 	b_free(&hc->req.buf);
@@ -634,6 +830,7 @@ struct httpclient *httpclient_new(void *caller, enum http_meth_t meth, struct is
 	hc->caller = caller;
 	hc->req.url = istdup(url);
 	hc->req.meth = meth;
+	LIST_INIT(&hc->batch_el);
 	httpclient_set_proxy(hc, httpclient_proxy);
 
 	return hc;
@@ -661,6 +858,95 @@ struct httpclient *httpclient_new_from_proxy(struct proxy *px, void *caller, enu
 	return hc;
 }
 
+/* Allocate a batch whose <done> callback will be called with the batch as
+ * argument once all attached clients have ended. <caller> is an opaque
+ * pointer left to the caller's disposal.
+ *
+ * Return NULL on failure.
+ */
+struct httpclient_batch *httpclient_batch_new(void *caller, void (*done)(struct httpclient_batch *batch))
+{
+	struct httpclient_batch *batch;
+
+	batch = calloc(1, sizeof(*batch));
+	if (!batch)
+		return NULL;
+
+	LIST_INIT(&batch->clients);
+	batch->done = done;
+	batch->caller = caller;
+
+	return batch;
+}
+
+/* Attach <hc> to <batch>. The client must not be started yet and must not
+ * belong to another batch. Clients stay attached once ended so that the
+ * completion callback can walk batch->clients to collect the responses.
+ *
+ * Return 0 on success, -1 on failure.
+ */
+int httpclient_batch_add(struct httpclient_batch *batch, struct httpclient *hc)
+{
+	if (httpclient_started(hc) || hc->batch)
+		return -1;
+
+	hc->batch = batch;
+	LIST_APPEND(&batch->clients, &hc->batch_el);
+	batch->remaining++;
+
+	return 0;
+}
+
+/* Start every client of <batch> which was not started yet. A client whose
+ * start fails is detached from the batch and left to be released by the
+ * caller, so the completion callback can fire from here when nothing at all
+ * could be started.
+ *
+ * Return the number of clients successfully started.
+ */
+int httpclient_batch_start(struct httpclient_batch *batch)
+{
+	struct httpclient *hc, *back;
+	int started = 0;
+
+	list_for_each_entry_safe(hc, back, &batch->clients, batch_el) {
+		if (httpclient_started(hc))
+			continue;
+
+		if (!httpclient_start(hc)) {
+			LIST_DEL_INIT(&hc->batch_el);
+			hc->batch = NULL;
+			if (!--batch->remaining && batch->done)
+				batch->done(batch);
+			continue;
+		}
+		started++;
+	}
+
+	return started;
+}
+
+/* Release <batch>. The clients still attached are stopped and asked to
+ * destroy themselves; the completion callback is not called. This is
+ * normally used from the completion callback itself, or to abort the whole
+ * batch.
+ */
+void httpclient_batch_destroy(struct httpclient_batch *batch)
+{
+	struct httpclient *hc, *back;
+
+	if (!batch)
+		return;
+
+	batch->done = NULL;
+	list_for_each_entry_safe(hc, back, &batch->clients, batch_el) {
+		LIST_DEL_INIT(&hc->batch_el);
+		hc->batch = NULL;
+		httpclient_stop_and_destroy(hc);
+	}
+	free(batch);
+}
+
 /*
  * Configure an httpclient with a specific proxy <px>
  *
@@ -1108,6 +1394,10 @@ static void httpclient_applet_release(struct appctx *appctx)
 	if (hc->ops.res_end)
 		hc->ops.res_end(hc);
 
+	/* report the completion to the batch once the last client ends */
+	if (hc->batch && !--hc->batch->remaining && hc->batch->done)
+		hc->batch->done(hc->batch);
+
 	/* destroy the httpclient when set to autotokill */
 	if (hc->flags & HTTPCLIENT_FA_AUTOKILL) {
 		httpclient_destroy(hc);
@@ -20,6 +20,7 @@
 #include <haproxy/arg.h>
 #include <haproxy/capture-t.h>
 #include <haproxy/chunk.h>
+#include <haproxy/clock.h>
 #include <haproxy/http.h>
 #include <haproxy/pool.h>
 #include <haproxy/sample.h>
@@ -44,7 +45,6 @@ static int sample_conv_http_date(const struct arg *args, struct sample *smp, voi
 	const char day[7][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
 	const char mon[12][4] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
 	struct buffer *temp;
-	struct tm tm;
 	int sec_frac = 0;
 	time_t curr_date;
 
@@ -66,21 +66,18 @@ static int sample_conv_http_date(const struct arg *args, struct sample *smp, voi
 	/* With high numbers, the date returned can be negative, the 55 bits mask prevent this. */
 	curr_date = smp->data.u.sint & 0x007fffffffffffffLL;
 
-	get_gmtime(curr_date, &tm);
-
 	temp = get_trash_chunk();
 	if (args[1].type == ARGT_SINT && args[1].data.sint != TIME_UNIT_S) {
+	    const struct tm *tm = get_gmtime_cached(curr_date);
+
 	    temp->data = snprintf(temp->area, temp->size - temp->data,
 	                          "%s, %02d %s %04d %02d:%02d:%02d.%d GMT",
-			          day[tm.tm_wday], tm.tm_mday, mon[tm.tm_mon],
-			          1900+tm.tm_year,
-			          tm.tm_hour, tm.tm_min, tm.tm_sec, sec_frac);
+			          day[tm->tm_wday], tm->tm_mday, mon[tm->tm_mon],
+			          1900+tm->tm_year,
+			          tm->tm_hour, tm->tm_min, tm->tm_sec, sec_frac);
 	} else {
 	    temp->data = snprintf(temp->area, temp->size - temp->data,
-	                          "%s, %02d %s %04d %02d:%02d:%02d GMT",
-			          day[tm.tm_wday], tm.tm_mday, mon[tm.tm_mon],
-			          1900+tm.tm_year,
-			          tm.tm_hour, tm.tm_min, tm.tm_sec);
+	                          "%s", gmtdate2str_rfc7231_cached(curr_date));
         }
 
 	smp->data.u.str = *temp;
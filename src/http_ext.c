@@ -506,14 +506,33 @@ static inline void http_build_7239_header_nodename(struct buffer *out,
 	int quoted = !!forby->np_mode;
 
 	if (forby->nn_mode == HTTP_7239_FORBY_ORIG) {
+		struct ist src_txt = IST_NULL;
+
+		/* the "for" node is the client address itself: reuse the
+		 * stream's memoized text form instead of converting it again
+		 */
+		if (addr && addr == sc_src(s->scf))
+			src_txt = stream_src_txt(s);
+
 		if (addr && addr->ss_family == AF_INET) {
-			unsigned char *pn = (unsigned char *)&((struct sockaddr_in *)addr)->sin_addr;
+			if (istlen(src_txt))
+				chunk_istcat(out, src_txt);
+			else {
+				unsigned char *pn = (unsigned char *)&((struct sockaddr_in *)addr)->sin_addr;
 
-			chunk_appendf(out, "%d.%d.%d.%d", pn[0], pn[1], pn[2], pn[3]);
+				chunk_appendf(out, "%d.%d.%d.%d", pn[0], pn[1], pn[2], pn[3]);
+			}
 		}
 		else if (addr && addr->ss_family == AF_INET6) {
-			ip6_addr = &((struct sockaddr_in6 *)addr)->sin6_addr;
-			_7239_print_ip6(out, ip6_addr, quoted);
+			if (istlen(src_txt)) {
+				if (!quoted)
+					chunk_appendf(out, "\""); /* explicit quoting required for ipv6 */
+				chunk_appendf(out, "[%.*s]", (int)istlen(src_txt), istptr(src_txt));
+			}
+			else {
+				ip6_addr = &((struct sockaddr_in6 *)addr)->sin6_addr;
+				_7239_print_ip6(out, ip6_addr, quoted);
+			}
 		}
 		/* else: not supported */
 	}
@@ -799,43 +818,21 @@ int http_handle_xff_header(struct stream *s, struct channel *req)
 			 * and we found it, so don't do anything.
 			 */
 		}
-		else if (src && src->ss_family == AF_INET) {
+		else if (src && (src->ss_family == AF_INET || src->ss_family == AF_INET6)) {
 			/* Add an X-Forwarded-For header unless the source IP is
 			 * in the 'except' network range.
 			 */
 			if ((!f_xff || ipcmp2net(src, &f_xff->except_net)) &&
 			    (!b_xff || ipcmp2net(src, &b_xff->except_net))) {
-				unsigned char *pn = (unsigned char *)&((struct sockaddr_in *)src)->sin_addr;
+				struct ist src_txt = stream_src_txt(s);
 
 				/* Note: we rely on the backend to get the header name to be used for
 				 * x-forwarded-for, because the header is really meant for the backends.
 				 * However, if the backend did not specify any option, we have to rely
 				 * on the frontend's header name.
 				 */
-				chunk_printf(&trash, "%d.%d.%d.%d", pn[0], pn[1], pn[2], pn[3]);
-				if (unlikely(!http_add_header(htx, hdr, ist2(trash.area, trash.data))))
-					return 0;
-			}
-		}
-		else if (src && src->ss_family == AF_INET6) {
-			/* Add an X-Forwarded-For header unless the source IP is
-			 * in the 'except' network range.
-			 */
-			if ((!f_xff || ipcmp2net(src, &f_xff->except_net)) &&
-			    (!b_xff || ipcmp2net(src, &b_xff->except_net))) {
-				char pn[INET6_ADDRSTRLEN];
-
-				inet_ntop(AF_INET6,
-					  (const void *)&((struct sockaddr_in6 *)(src))->sin6_addr,
-					  pn, sizeof(pn));
-
-				/* Note: we rely on the backend to get the header name to be used for
-				 * x-forwarded-for, because the header is really meant for the backends.
-				 * However, if the backend did not specify any option, we have to rely
-				 * on the frontend's header name.
-				 */
-				chunk_printf(&trash, "%s", pn);
-				if (unlikely(!http_add_header(htx, hdr, ist2(trash.area, trash.data))))
+				if (istlen(src_txt) &&
+				    unlikely(!http_add_header(htx, hdr, src_txt)))
 					return 0;
 			}
 		}
@@ -129,6 +129,7 @@ size_t http_get_hdrs_size(struct htx *htx)
 static int __http_find_header(const struct htx *htx, const void *pattern, struct http_hdr_ctx *ctx, int flags)
 {
 	struct htx_blk *blk = ctx->blk;
+	struct htx_blk *tail = htx_get_tail_blk(htx);
 	struct ist n, v;
 	enum htx_blk_type type;
 
@@ -156,7 +157,7 @@ static int __http_find_header(const struct htx *htx, const void *pattern, struct
 	if (htx_is_empty(htx))
 		return 0;
 
-	for (blk = htx_get_first_blk(htx); blk; blk = htx_get_next_blk(htx, blk)) {
+	for (blk = htx_get_first_blk(htx); blk; blk = htx_get_next_blk_fast(blk, tail)) {
 	  rescan_hdr:
 		type = htx_get_blk_type(blk);
 		if (type == HTX_BLK_EOH)
@@ -178,6 +179,16 @@ static int __http_find_header(const struct htx *htx, const void *pattern, struct
 			if (!istlen(name))
 				goto match;
 
+			/* For an exact match, the header name length is encoded
+			 * in the block's info word, so blocks of a different
+			 * length are skipped without even computing the name
+			 * pointer nor comparing any byte. This is the common
+			 * case when scanning all headers for a lookup.
+			 */
+			if ((flags & HTTP_FIND_FL_MATCH_TYPE) == HTTP_FIND_FL_MATCH_STR &&
+			    (blk->info & 0xff) != istlen(name))
+				goto next_blk;
+
 			n = htx_get_blk_name(htx, blk);
 			switch (flags & HTTP_FIND_FL_MATCH_TYPE) {
 			case HTTP_FIND_FL_MATCH_STR:
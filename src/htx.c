@@ -92,7 +92,18 @@ struct htx_blk *htx_defrag(struct htx *htx, struct htx_blk *blk, uint32_t blkinf
 	htx->head_addr = htx->end_addr = 0;
 	htx->tail_addr = addr;
 	htx->flags &= ~HTX_FL_FRAGMENTED;
-	htx_memcpy((void *)htx->blocks, (void *)tmp->blocks, htx->size);
+
+	/* Only copy back the areas the loop above has filled: the unwrapped
+	 * payloads at the bottom of the area and the block table at the top.
+	 * The hole between them may be large (the message is defragmented
+	 * precisely because the free space is scattered) and its previous
+	 * contents are meaningless, so there is no point in copying the whole
+	 * <size> bytes.
+	 */
+	htx_memcpy((void *)htx->blocks, (void *)tmp->blocks, addr);
+	htx_memcpy((void *)htx->blocks + htx_pos_to_addr(htx, htx->tail),
+		   (void *)tmp->blocks + htx_pos_to_addr(tmp, htx->tail),
+		   new * sizeof(struct htx_blk));
 
 	return ((blkpos == -1) ? NULL : htx_get_blk(htx, blkpos));
 }
@@ -12,19 +12,43 @@
 
 #include <import/ebmbtree.h>
 #include <import/ebsttree.h>
+#include <import/lru.h>
 
 #include <haproxy/api.h>
+#include <haproxy/errors.h>
+#include <haproxy/init.h>
 #include <haproxy/tools.h>
 #include <haproxy/openssl-compat.h>
 #include <haproxy/base64.h>
 #include <haproxy/jwt.h>
 #include <haproxy/buf.h>
+#include <haproxy/xxhash.h>
 
 
 #ifdef USE_OPENSSL
 /* Tree into which the public certificates used to validate JWTs will be stored. */
 static struct eb_root jwt_cert_tree = EB_ROOT_UNIQUE;
 
+/* Per-thread cache of verification results. Signature checking clearly
+ * dominates the cost of jwt_verify and the same bearer token is typically
+ * presented by a client on every request, so remembering the status of
+ * recently seen (token, alg, key) triplets avoids redoing the asymmetric
+ * crypto for them. The result only depends on the triplet. The LRU is only
+ * indexed on a 64-bit hash of the triplet, which is not collision-resistant
+ * enough for an authentication decision on its own, so each entry also
+ * stores a SHA-256 digest of the full triplet which is compared on every
+ * hit before the cached verdict is trusted.
+ */
+#define JWT_LRU_CACHE_SIZE 1024
+static THREAD_LOCAL struct lru64_head *jwt_lru_tree = NULL;
+static unsigned long long jwt_lru_seed __read_mostly;
+
+/* a cached verification verdict and the digest authenticating its triplet */
+struct jwt_cache_entry {
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	enum jwt_vrfy_status status;
+};
+
 /*
  * The possible algorithm strings that can be found in a JWS's JOSE header are
  * defined in section 3.1 of RFC7518.
@@ -355,8 +379,8 @@ end:
  * signature.
  * Returns 1 in case of success.
  */
-enum jwt_vrfy_status jwt_verify(const struct buffer *token, const struct buffer *alg,
-				const struct buffer *key)
+static enum jwt_vrfy_status jwt_verify_token(const struct buffer *token, const struct buffer *alg,
+					     const struct buffer *key)
 {
 	struct jwt_item items[JWT_ELT_MAX] = { { 0 } };
 	unsigned int item_num = JWT_ELT_MAX;
@@ -441,6 +465,113 @@ end:
 	return retval;
 }
 
+/* Computes the SHA-256 digest authenticating a (token, alg, key) triplet in
+ * the verification cache. The lengths of the three fields are hashed first so
+ * that triplets with identical concatenations cannot produce the same digest.
+ * <digest> must be able to hold SHA256_DIGEST_LENGTH bytes. Returns 1 on
+ * success, 0 on failure.
+ */
+static int jwt_cache_digest(const struct buffer *token, const struct buffer *alg,
+			    const struct buffer *key, unsigned char *digest)
+{
+	uint64_t lens[3] = { token->data, alg->data, key->data };
+	EVP_MD_CTX *ctx;
+	int retval = 0;
+
+	ctx = EVP_MD_CTX_new();
+	if (!ctx)
+		return 0;
+
+	if (EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) &&
+	    EVP_DigestUpdate(ctx, lens, sizeof(lens)) &&
+	    EVP_DigestUpdate(ctx, token->area, token->data) &&
+	    EVP_DigestUpdate(ctx, alg->area, alg->data) &&
+	    EVP_DigestUpdate(ctx, key->area, key->data) &&
+	    EVP_DigestFinal_ex(ctx, digest, NULL))
+		retval = 1;
+
+	EVP_MD_CTX_free(ctx);
+	return retval;
+}
+
+/* Cache lookup wrapper around jwt_verify_token(). A cached status is returned
+ * when the same (token, alg, key) triplet was already checked by this thread,
+ * otherwise the signature is verified and the result stored. Since the LRU
+ * key is only a 64-bit hash, a cached verdict is only trusted after its full
+ * digest was compared to the current triplet's one. Out-of-memory statuses
+ * and entries whose allocation failed are committed with a NULL entry and a
+ * different revision so that they are seen as stale and recomputed on the
+ * next occurrence instead of sticking.
+ */
+enum jwt_vrfy_status jwt_verify(const struct buffer *token, const struct buffer *alg,
+				const struct buffer *key)
+{
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	enum jwt_vrfy_status retval;
+	struct lru64 *lru = NULL;
+
+	if (jwt_lru_tree && jwt_cache_digest(token, alg, key, digest)) {
+		unsigned long long h;
+
+		h = XXH3(token->area, token->data, jwt_lru_seed);
+		h = XXH3(alg->area, alg->data, h);
+		h = XXH3(key->area, key->data, h);
+
+		lru = lru64_get(h, jwt_lru_tree, &jwt_cert_tree, 0);
+		if (lru && lru->domain) {
+			struct jwt_cache_entry *entry = lru->data;
+
+			if (entry && memcmp(entry->digest, digest, sizeof(digest)) == 0)
+				return entry->status;
+
+			/* genuine 64-bit hash collision with another triplet:
+			 * drop the old verdict and replace it with ours below.
+			 */
+			free(lru->data);
+			lru->data = NULL;
+		}
+	}
+
+	retval = jwt_verify_token(token, alg, key);
+
+	if (lru) {
+		struct jwt_cache_entry *entry = NULL;
+
+		if (retval != JWT_VRFY_OUT_OF_MEMORY &&
+		    (entry = malloc(sizeof(*entry))) != NULL) {
+			memcpy(entry->digest, digest, sizeof(entry->digest));
+			entry->status = retval;
+		}
+		lru64_commit(lru, entry, &jwt_cert_tree, !entry, free);
+	}
+
+	return retval;
+}
+
+static int jwt_init_cache_seed(void)
+{
+	jwt_lru_seed = ha_random64();
+	return ERR_NONE;
+}
+REGISTER_POST_CHECK(jwt_init_cache_seed);
+
+static int jwt_alloc_lru_per_thread(void)
+{
+	jwt_lru_tree = lru64_new(JWT_LRU_CACHE_SIZE);
+	return jwt_lru_tree != NULL;
+}
+
+static void jwt_free_lru_per_thread(void)
+{
+	if (jwt_lru_tree) {
+		lru64_destroy(jwt_lru_tree);
+		jwt_lru_tree = NULL;
+	}
+}
+
+REGISTER_PER_THREAD_ALLOC(jwt_alloc_lru_per_thread);
+REGISTER_PER_THREAD_FREE(jwt_free_lru_per_thread);
+
 static void jwt_deinit(void)
 {
 	struct ebmb_node *node = NULL;
@@ -23,6 +23,22 @@
 #include <haproxy/queue.h>
 #include <haproxy/server-t.h>
 #include <haproxy/tools.h>
+#include <haproxy/xxhash.h>
+
+/* Compute the key of occurrence <occ> of server <s> on the hash ring. The
+ * points historically come from full_hash() over the server's puid and the
+ * occurrence number. When the proxy uses the xxh3 hash function, the same
+ * input is hashed with XXH3 instead so that the ring placement benefits from
+ * its better dispersion, consistently with what the keys are hashed with.
+ */
+static inline u32 chash_compute_node_key(struct server *s, unsigned int occ)
+{
+	u32 input = s->puid * SRV_EWGHT_RANGE + occ;
+
+	if ((s->proxy->lbprm.algo & BE_LB_HASH_FUNC) == BE_LB_HFCN_XXH3)
+		return XXH3(&input, sizeof(input), 0);
+	return full_hash(input);
+}
 
 /* Return next tree node after <node> which must still be in the tree, or be
  * NULL. Lookup wraps around the end to the beginning. If the next node is the
@@ -95,7 +111,7 @@ static inline void chash_queue_dequeue_srv(struct server *s)
 			    (s->next_eweight - s->lb_nodes_tot) * sizeof(*s->lb_nodes));
 			for (j = s->lb_nodes_tot; j < s->next_eweight; j++) {
 				s->lb_nodes[j].server = s;
-				s->lb_nodes[j].node.key = full_hash(s->puid * SRV_EWGHT_RANGE + j);
+				s->lb_nodes[j].node.key = chash_compute_node_key(s, j);
 			}
 			s->lb_nodes_tot = s->next_eweight;
 		}
@@ -284,17 +300,14 @@ static void chash_update_server_weight(struct server *srv)
 /*
  * This function implements the "Consistent Hashing with Bounded Loads" algorithm
  * of Mirrokni, Thorup, and Zadimoghaddam (arxiv:1608.01350), adapted for use with
- * unequal server weights.
+ * unequal server weights. The parameters <slots_per_weight> and <remainder>
+ * only depend on the proxy's number of outstanding requests and total weight,
+ * so the caller computes them once per lookup instead of once per candidate
+ * walked on the ring.
  */
-int chash_server_is_eligible(struct server *s)
+static inline int chash_server_is_eligible(struct server *s, unsigned slots_per_weight,
+                                           unsigned remainder)
 {
-	/* The total number of slots to allocate is the total number of outstanding requests
-	 * (including the one we're about to make) times the load-balance-factor, rounded up.
-	 */
-	unsigned tot_slots = ((s->proxy->served + 1) * s->proxy->lbprm.hash_balance_factor + 99) / 100;
-	unsigned slots_per_weight = tot_slots / s->proxy->lbprm.tot_weight;
-	unsigned remainder = tot_slots % s->proxy->lbprm.tot_weight;
-
 	/* Allocate a whole number of slots per weight unit... */
 	unsigned slots = s->cur_eweight * slots_per_weight;
 
@@ -325,10 +338,23 @@ struct server *chash_get_server_hash(struct proxy *p, unsigned int hash, const s
 	struct server *nsrv, *psrv;
 	struct eb_root *root;
 	unsigned int dn, dp;
+	unsigned int slots_per_weight = 0, remainder = 0;
 	int loop;
 
 	HA_RWLOCK_RDLOCK(LBPRM_LOCK, &p->lbprm.lock);
 
+	if (p->lbprm.hash_balance_factor) {
+		/* The total number of slots to allocate for the bounded-load
+		 * check is the total number of outstanding requests (including
+		 * the one we're about to make) times the balance factor,
+		 * rounded up. It is invariant during the ring walk below.
+		 */
+		unsigned int tot_slots = ((p->served + 1) * p->lbprm.hash_balance_factor + 99) / 100;
+
+		slots_per_weight = tot_slots / p->lbprm.tot_weight;
+		remainder = tot_slots % p->lbprm.tot_weight;
+	}
+
 	if (p->srv_act)
 		root = &p->lbprm.chash.act;
 	else if (p->lbprm.fbck) {
@@ -371,7 +397,9 @@ struct server *chash_get_server_hash(struct proxy *p, unsigned int hash, const s
 	}
 
 	loop = 0;
-	while (nsrv == avoid || (p->lbprm.hash_balance_factor && !chash_server_is_eligible(nsrv))) {
+	while (nsrv == avoid ||
+	       (p->lbprm.hash_balance_factor &&
+	        !chash_server_is_eligible(nsrv, slots_per_weight, remainder))) {
 		next = eb32_next(next);
 		if (!next) {
 			next = eb32_first(root);
@@ -443,7 +471,7 @@ struct server *chash_get_next_server(struct proxy *p, struct server *srvtoavoid)
 		 * case we simply remember it for later use if needed.
 		 */
 		s = eb32_entry(node, struct tree_occ, node)->server;
-		if (!s->maxconn || (!s->queue.length && s->served < srv_dynamic_maxconn(s))) {
+		if (!s->maxconn || (!s->queue_length && s->served < srv_dynamic_maxconn(s))) {
 			if (s != srvtoavoid) {
 				srv = s;
 				break;
@@ -507,7 +535,7 @@ int chash_init_server_tree(struct proxy *p)
 		}
 		for (node = 0; node < srv->lb_nodes_tot; node++) {
 			srv->lb_nodes[node].server = srv;
-			srv->lb_nodes[node].node.key = full_hash(srv->puid * SRV_EWGHT_RANGE + node);
+			srv->lb_nodes[node].node.key = chash_compute_node_key(srv, node);
 		}
 
 		if (srv_currently_usable(srv))
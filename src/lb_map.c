@@ -11,6 +11,7 @@
  */
 
 #include <import/eb32tree.h>
+#include <import/eb64tree.h>
 #include <haproxy/api.h>
 #include <haproxy/backend.h>
 #include <haproxy/lb_map.h>
@@ -68,14 +69,33 @@ static void map_set_server_status_up(struct server *srv)
 /* This function recomputes the server map for proxy px. It relies on
  * px->lbprm.tot_wact, tot_wbck, tot_used, tot_weight, so it must be
  * called after recount_servers(). It also expects px->lbprm.map.srv
- * to be allocated with the largest size needed. It updates tot_weight.
+ * and px->lbprm.map.pick to be allocated with the largest size needed.
+ *
+ * A server of effective weight <w> is assigned the slots located at virtual
+ * times k/w for k = 1..w, which spreads its slots evenly across the map. The
+ * servers are maintained in a queue ordered by next virtual pick time, with
+ * ties broken by declaration order, so that with equivalent weights the map
+ * follows the declaration order, and whatever the weights, the first slot
+ * always goes to the first usable server. This is an important assumption
+ * for the backup case, where we want the first server only. Filling one slot
+ * thus costs the log of the number of servers instead of a full rescan of
+ * the servers list, which used to stall all pickers on large farms since the
+ * whole map is rebuilt under the lbprm lock upon each state change.
+ *
+ * Virtual times are scaled by 2^32; effective weights being way below 2^16,
+ * the rounding error of the division stays orders of magnitude below the
+ * minimum distance between two distinct pick times, so each server still
+ * gets exactly <w> slots.
  *
  * The lbprm's lock must be held.
  */
 void recalc_server_map(struct proxy *px)
 {
-	int o, tot, flag;
-	struct server *cur, *best;
+	struct eb_root pq = EB_ROOT;
+	struct lb_map_pick *pk;
+	struct eb64_node *node;
+	struct server *cur;
+	int o, tot, flag, idx;
 
 	switch (px->lbprm.tot_used) {
 	case 0:	/* no server */
@@ -91,44 +111,32 @@ void recalc_server_map(struct proxy *px)
 	else
 		flag = SRV_F_BACKUP;
 
-	/* this algorithm gives priority to the first server, which means that
-	 * it will respect the declaration order for equivalent weights, and
-	 * that whatever the weights, the first server called will always be
-	 * the first declared. This is an important assumption for the backup
-	 * case, where we want the first server only.
-	 */
-	for (cur = px->srv; cur; cur = cur->next)
-		cur->wscore = 0;
+	pk = px->lbprm.map.pick;
+	idx = 0;
+	for (cur = px->srv; cur; cur = cur->next, idx++) {
+		if ((cur->flags & SRV_F_BACKUP) != flag ||
+		    !srv_willbe_usable(cur))
+			continue;
+		pk->srv = cur;
+		pk->picks = 0;
+		pk->node.key = ((1ULL << 32) / cur->next_eweight << 16) + (idx & 0xffff);
+		eb64_insert(&pq, &pk->node);
+		pk++;
+	}
 
 	for (o = 0; o < tot; o++) {
-		int max = 0;
-		best = NULL;
-		for (cur = px->srv; cur; cur = cur->next) {
-			if ((cur->flags & SRV_F_BACKUP) == flag &&
-			    srv_willbe_usable(cur)) {
-				int v;
-
-				/* If we are forced to return only one server, we don't want to
-				 * go further, because we would return the wrong one due to
-				 * divide overflow.
-				 */
-				if (tot == 1) {
-					best = cur;
-					/* note that best->wscore will be wrong but we don't care */
-					break;
-				}
-
-				_HA_ATOMIC_ADD(&cur->wscore, cur->next_eweight);
-				v = (cur->wscore + tot) / tot; /* result between 0 and 3 */
-				if (best == NULL || v > max) {
-					max = v;
-					best = cur;
-				}
-			}
+		node = eb64_first(&pq);
+		if (!node)
+			break; /* should not happen */
+		pk = eb64_entry(node, struct lb_map_pick, node);
+		px->lbprm.map.srv[o] = pk->srv;
+		eb64_delete(node);
+		pk->picks++;
+		if (pk->picks < pk->srv->next_eweight) {
+			pk->node.key = ((uint64_t)(pk->picks + 1) * (1ULL << 32) / pk->srv->next_eweight << 16) +
+			               (pk->node.key & 0xffff);
+			eb64_insert(&pq, &pk->node);
 		}
-		px->lbprm.map.srv[o] = best;
-		if (best)
-			_HA_ATOMIC_SUB(&best->wscore, tot);
 	}
 }
 
@@ -142,6 +150,7 @@ void init_server_map(struct proxy *p)
 	struct server *srv;
 	int pgcd;
 	int act, bck;
+	int nbsrv;
 
 	p->lbprm.set_server_status_up   = map_set_server_status_up;
 	p->lbprm.set_server_status_down = map_set_server_status_down;
@@ -179,6 +188,7 @@ void init_server_map(struct proxy *p)
 	p->lbprm.wmult = pgcd;
 
 	act = bck = 0;
+	nbsrv = 0;
 	for (srv = p->srv; srv; srv = srv->next) {
 		srv->next_eweight = (srv->uweight * p->lbprm.wdiv + p->lbprm.wmult - 1) / p->lbprm.wmult;
 
@@ -187,6 +197,7 @@ void init_server_map(struct proxy *p)
 		else
 			act += srv->next_eweight;
 		srv_lb_commit_status(srv);
+		nbsrv++;
 	}
 
 	/* this is the largest map we will ever need for this servers list */
@@ -197,6 +208,10 @@ void init_server_map(struct proxy *p)
 		act = 1;
 
 	p->lbprm.map.srv = calloc(act, sizeof(*p->lbprm.map.srv));
+	/* the pick queue needs one entry per server; the servers list cannot
+	 * grow at run time since dynamic servers require a dynamic algorithm.
+	 */
+	p->lbprm.map.pick = calloc(nbsrv, sizeof(*p->lbprm.map.pick));
 	/* recounts servers and their weights */
 	recount_servers(p);
 	update_backend_weight(p);
@@ -230,7 +245,7 @@ struct server *map_get_server_rr(struct proxy *px, struct server *srvtoavoid)
 	avoididx = 0; /* shut a gcc warning */
 	do {
 		srv = px->lbprm.map.srv[newidx++];
-		if (!srv->maxconn || (!srv->queue.length && srv->served < srv_dynamic_maxconn(srv))) {
+		if (!srv->maxconn || (!srv->queue_length && srv->served < srv_dynamic_maxconn(srv))) {
 			/* make sure it is not the server we are try to exclude... */
 			/* ...but remember that is was selected yet avoided */
 			avoided = srv;
@@ -0,0 +1,269 @@
+/*
+ * Power-of-two-choices load balancing algorithm.
+ *
+ * This algorithm picks two random servers from a flat map of usable servers
+ * and selects the less loaded of the two, based on the number of requests
+ * each of them is currently serving, normalized by their effective weights.
+ * It is well known (Mitzenmacher, "The Power of Two Choices in Randomized
+ * Load Balancing") to approximate least-connections very closely while not
+ * requiring any shared structure update on the picking path. This makes it
+ * an interesting alternative to "leastconn" on large backends at high
+ * request rates, where the cost of updating the leastconn tree under the
+ * lbprm lock for each connection starts to dominate: here the maps are only
+ * rebuilt upon server state or weight changes, and picks are performed
+ * without taking any lock, using a revision counter to detect a concurrent
+ * rebuild.
+ *
+ * Copyright 2000-2023 Willy Tarreau <w@1wt.eu>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <haproxy/api.h>
+#include <haproxy/backend.h>
+#include <haproxy/lb_p2c.h>
+#include <haproxy/queue.h>
+#include <haproxy/server-t.h>
+#include <haproxy/tools.h>
+
+/* Return a map suitable to hold <count> servers, growing <*head> if needed.
+ * Old maps are never freed at run time because a lockless reader may still
+ * be walking them; they are chained to the new one and only released by
+ * p2c_deinit_server_map(). Returns NULL if no map could be allocated and
+ * none existed, in which case the caller must consider the group empty.
+ *
+ * The lbprm's lock must be held.
+ */
+static struct lb_p2c_map *p2c_get_map(struct lb_p2c_map **head, unsigned int count)
+{
+	struct lb_p2c_map *map = *head;
+	struct lb_p2c_map *new;
+	unsigned int size;
+
+	if (map && map->size >= count)
+		return map;
+
+	size = map ? map->size : 8;
+	while (size < count)
+		size <<= 1;
+
+	new = calloc(1, sizeof(*new) + size * sizeof(struct server *));
+	if (!new)
+		return map;
+
+	new->size = size;
+	new->prev = map;
+	HA_ATOMIC_STORE(head, new);
+	return new;
+}
+
+/* Rebuild the active and backup server maps of proxy <p>. The revision
+ * counter is kept odd for the duration of the rebuild so that lockless
+ * pickers can detect it and retry.
+ *
+ * The lbprm's lock must be held.
+ */
+static void p2c_rebuild_maps(struct proxy *p)
+{
+	struct lb_p2c *l = &p->lbprm.p2c;
+	struct lb_p2c_map *act, *bck;
+	unsigned int nact, nbck;
+	struct server *srv;
+
+	nact = nbck = 0;
+	for (srv = p->srv; srv; srv = srv->next) {
+		if (!srv_willbe_usable(srv))
+			continue;
+		if (srv->flags & SRV_F_BACKUP)
+			nbck++;
+		else
+			nact++;
+	}
+
+	act = p2c_get_map(&l->act, nact);
+	bck = p2c_get_map(&l->bck, nbck);
+
+	_HA_ATOMIC_STORE(&l->revision, l->revision + 1);
+	__ha_barrier_store();
+
+	nact = nbck = 0;
+	for (srv = p->srv; srv; srv = srv->next) {
+		if (!srv_willbe_usable(srv))
+			continue;
+		if (srv->flags & SRV_F_BACKUP) {
+			if (bck && nbck < bck->size)
+				bck->srv[nbck++] = srv;
+		}
+		else {
+			if (act && nact < act->size)
+				act->srv[nact++] = srv;
+		}
+	}
+	l->nbsrv_act = act ? nact : 0;
+	l->nbsrv_bck = bck ? nbck : 0;
+
+	__ha_barrier_store();
+	_HA_ATOMIC_STORE(&l->revision, l->revision + 1);
+}
+
+/* This function is called when server <srv>'s status, weight or both change.
+ * Contrary to the tree-based algorithms there is no incremental operation to
+ * perform here: the proxy's counters are recomputed and the maps are rebuilt,
+ * which remains cheap enough for events as rare as state changes.
+ *
+ * The server's lock must be held. The lbprm's lock will be used.
+ */
+static void p2c_update_server_status(struct server *srv)
+{
+	struct proxy *p = srv->proxy;
+
+	if (!srv_lb_status_changed(srv))
+		return;
+
+	HA_RWLOCK_WRLOCK(LBPRM_LOCK, &p->lbprm.lock);
+	recount_servers(p);
+	update_backend_weight(p);
+	p2c_rebuild_maps(p);
+	HA_RWLOCK_WRUNLOCK(LBPRM_LOCK, &p->lbprm.lock);
+
+	srv_lb_commit_status(srv);
+}
+
+/* Pick two random servers from backend <p>'s map of usable servers and
+ * return the less loaded one, normalized by the effective weights, skipping
+ * server <srvtoavoid> when an alternative exists. Returns NULL when no
+ * server is usable or the selected one is saturated, so that the backend's
+ * queue is used instead.
+ *
+ * No lock is taken: the maps are read under the protection of the revision
+ * counter and the pick is retried if a rebuild happened in between.
+ */
+struct server *p2c_get_next_server(struct proxy *p, struct server *srvtoavoid)
+{
+	struct lb_p2c *l = &p->lbprm.p2c;
+	struct lb_p2c_map *map;
+	struct server *s1, *s2, *srv;
+	unsigned int rev, nbsrv;
+
+	while (1) {
+		rev = _HA_ATOMIC_LOAD(&l->revision);
+		__ha_barrier_load();
+		if (rev & 1) {
+			/* a rebuild is in progress */
+			__ha_cpu_relax();
+			continue;
+		}
+
+		nbsrv = _HA_ATOMIC_LOAD(&l->nbsrv_act);
+		if (nbsrv)
+			map = _HA_ATOMIC_LOAD(&l->act);
+		else if ((srv = p->lbprm.fbck))
+			return srv;
+		else {
+			nbsrv = _HA_ATOMIC_LOAD(&l->nbsrv_bck);
+			if (!nbsrv)
+				return NULL;
+			map = _HA_ATOMIC_LOAD(&l->bck);
+		}
+
+		s1 = _HA_ATOMIC_LOAD(&map->srv[statistical_prng_range(nbsrv)]);
+		s2 = _HA_ATOMIC_LOAD(&map->srv[statistical_prng_range(nbsrv)]);
+
+		__ha_barrier_load();
+		if (_HA_ATOMIC_LOAD(&l->revision) == rev)
+			break;
+		__ha_cpu_relax();
+	}
+
+	if (s1 == srvtoavoid && s2 != srvtoavoid)
+		srv = s2;
+	else if (s2 == srvtoavoid && s1 != srvtoavoid)
+		srv = s1;
+	else if ((p->options & PR_O_REUSE_LOCAL) && s1 != s2 &&
+	         (HA_ATOMIC_LOAD(&s1->curr_idle_thr[tid]) > 0) !=
+	         (HA_ATOMIC_LOAD(&s2->curr_idle_thr[tid]) > 0)) {
+		/* idle connection locality: prefer the candidate with an idle
+		 * connection on the current thread so that it can be reused
+		 * without stealing one from another thread.
+		 */
+		srv = (HA_ATOMIC_LOAD(&s1->curr_idle_thr[tid]) > 0) ? s1 : s2;
+	}
+	else if (s1->served * s2->cur_eweight <= s2->served * s1->cur_eweight)
+		srv = s1;
+	else
+		srv = s2;
+
+	/* if the selected server is full, try the other choice, and if both
+	 * are full, pretend we have none so that we reach the backend's
+	 * queue instead.
+	 */
+	if (srv->queue_length || (srv->maxconn && srv->served >= srv_dynamic_maxconn(srv))) {
+		s1 = (srv == s1) ? s2 : s1;
+		if (s1 != srv && s1 != srvtoavoid &&
+		    !s1->queue_length && (!s1->maxconn || s1->served < srv_dynamic_maxconn(s1)))
+			srv = s1;
+		else
+			srv = NULL;
+	}
+
+	return srv;
+}
+
+/* This function is responsible for preparing the maps of usable servers for
+ * the power-of-two-choices algorithm. It also sets p->lbprm.wdiv to the
+ * eweight to uweight ratio. Both active and backup groups are initialized.
+ */
+void p2c_init_server_map(struct proxy *p)
+{
+	struct server *srv;
+
+	p->lbprm.set_server_status_up   = p2c_update_server_status;
+	p->lbprm.set_server_status_down = p2c_update_server_status;
+	p->lbprm.update_server_eweight  = p2c_update_server_status;
+	p->lbprm.server_take_conn = NULL;
+	p->lbprm.server_drop_conn = NULL;
+
+	p->lbprm.wdiv = BE_WEIGHT_SCALE;
+	for (srv = p->srv; srv; srv = srv->next) {
+		srv->next_eweight = (srv->uweight * p->lbprm.wdiv + p->lbprm.wmult - 1) / p->lbprm.wmult;
+		srv_lb_commit_status(srv);
+	}
+
+	recount_servers(p);
+	update_backend_weight(p);
+
+	p->lbprm.p2c.act = NULL;
+	p->lbprm.p2c.bck = NULL;
+	p->lbprm.p2c.nbsrv_act = p->lbprm.p2c.nbsrv_bck = 0;
+	p->lbprm.p2c.revision = 0;
+	p2c_rebuild_maps(p);
+}
+
+/* Release the server maps of proxy <p>, including the old generations kept
+ * for lockless readers. Must only be called once the proxy is stopped.
+ */
+void p2c_deinit_server_map(struct proxy *p)
+{
+	struct lb_p2c_map *map, *prev;
+
+	for (map = p->lbprm.p2c.act; map; map = prev) {
+		prev = map->prev;
+		free(map);
+	}
+	for (map = p->lbprm.p2c.bck; map; map = prev) {
+		prev = map->prev;
+		free(map);
+	}
+	p->lbprm.p2c.act = p->lbprm.p2c.bck = NULL;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
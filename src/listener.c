@@ -29,10 +29,12 @@
 #include <haproxy/list.h>
 #include <haproxy/listener.h>
 #include <haproxy/log.h>
+#include <haproxy/pool.h>
 #include <haproxy/protocol.h>
 #include <haproxy/proxy.h>
 #include <haproxy/quic_tp.h>
 #include <haproxy/sample.h>
+#include <haproxy/session.h>
 #include <haproxy/stream.h>
 #include <haproxy/task.h>
 #include <haproxy/ticks.h>
@@ -848,6 +850,19 @@ void listener_accept(struct listener *l)
 	 */
 	max_accept = l->bind_conf->maxaccept ? l->bind_conf->maxaccept : 1;
 
+	if (unlikely(_HA_ATOMIC_LOAD(&th_ctx->flags) & TH_FL_OVERLOADED) &&
+	    global.tune.overload_action == OVERLOAD_ACT_DRAIN &&
+	    !(l->bind_conf->options & BC_O_UNLIMITED)) {
+		/* This thread is overloaded and the "drain" action was chosen:
+		 * leave incoming connections in the kernel's accept queue for
+		 * now and recheck in at most 100 ms, so that the backlog
+		 * absorbs the burst instead of the run queue.
+		 */
+		_HA_ATOMIC_INC(&activity[tid].shed_conns);
+		expire = tick_add(now_ms, 100);
+		goto limit_global;
+	}
+
 	if (!(l->bind_conf->options & BC_O_UNLIMITED) && global.sps_lim) {
 		int max = freq_ctr_remain(&global.sess_per_sec, global.sps_lim, 0);
 
@@ -901,6 +916,18 @@ void listener_accept(struct listener *l)
 			max_accept = max;
 	}
 
+	/* Pre-warm the local caches of the pools that every accepted
+	 * connection will hit, so that during bursts the objects are pulled
+	 * from the shared pools in bulk here rather than one cluster at a
+	 * time from within each connection's setup path.
+	 */
+	if (max_accept > 1) {
+		uint prewarm = MIN(max_accept, 16);
+
+		pool_prewarm(pool_head_connection, prewarm);
+		pool_prewarm(pool_head_session, prewarm);
+	}
+
 	/* Note: if we fail to allocate a connection because of configured
 	 * limits, we'll schedule a new attempt worst 1 second later in the
 	 * worst case. If we fail due to system limits or temporary resource
@@ -1096,6 +1123,20 @@ void listener_accept(struct listener *l)
 				q1 += l->thr_conn[base + t1];
 				q2 += l->thr_conn[base + t2];
 
+				if (unlikely(global.tune.options & GTUNE_LISTENER_MQ_LOAD)) {
+					/* "load" mode: also penalize threads
+					 * whose recent scheduler loops have
+					 * been long (SSL handshakes, Lua, etc)
+					 * so that new connections avoid
+					 * threads currently stuck in heavy
+					 * processing. Each millisecond of
+					 * average loop time counts as one
+					 * more queued connection.
+					 */
+					q1 += swrate_avg(activity[base + t1].avg_loop_us, TIME_STATS_SAMPLES) / 1000;
+					q2 += swrate_avg(activity[base + t2].avg_loop_us, TIME_STATS_SAMPLES) / 1000;
+				}
+
 				if (q1 - q2 < 0) {
 					t = t1;
 					t2 = t2 ? t2 - 1 : LONGBITS - 1;
@@ -1821,12 +1862,16 @@ static int cfg_parse_tune_listener_mq(char **args, int section_type, struct prox
 	if (too_many_args(1, args, err, NULL))
 		return -1;
 
-	if (strcmp(args[1], "on") == 0)
+	if (strcmp(args[1], "on") == 0) {
 		global.tune.options |= GTUNE_LISTENER_MQ;
+		global.tune.options &= ~GTUNE_LISTENER_MQ_LOAD;
+	}
+	else if (strcmp(args[1], "load") == 0)
+		global.tune.options |= GTUNE_LISTENER_MQ | GTUNE_LISTENER_MQ_LOAD;
 	else if (strcmp(args[1], "off") == 0)
-		global.tune.options &= ~GTUNE_LISTENER_MQ;
+		global.tune.options &= ~(GTUNE_LISTENER_MQ | GTUNE_LISTENER_MQ_LOAD);
 	else {
-		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		memprintf(err, "'%s' expects 'on', 'load' or 'off' but got '%s'.", args[0], args[1]);
 		return -1;
 	}
 	return 0;
@@ -10,6 +10,8 @@
  *
  */
 
+#define _GNU_SOURCE  /* required for sendmmsg() and struct mmsghdr */
+
 #include <ctype.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -34,6 +36,7 @@
 #include <haproxy/http_ana.h>
 #include <haproxy/listener.h>
 #include <haproxy/log.h>
+#include <haproxy/net_helper.h>
 #include <haproxy/proxy.h>
 #include <haproxy/sample.h>
 #include <haproxy/sc_strm.h>
@@ -41,6 +44,7 @@
 #include <haproxy/ssl_sock.h>
 #include <haproxy/stconn.h>
 #include <haproxy/stream.h>
+#include <haproxy/task.h>
 #include <haproxy/time.h>
 #include <haproxy/tools.h>
 
@@ -370,12 +374,34 @@ int parse_logformat_var(char *arg, int arg_len, char *var, int var_len, struct p
  *  LOG_TEXT: copy chars from start to end excluding end.
  *
 */
-int add_to_logformat_list(char *start, char *end, int type, struct list *list_format, char **err)
+int add_to_logformat_list(char *start, char *end, int type, int options, struct list *list_format, char **err)
 {
 	char *str;
 
 	if (type == LF_TEXT) { /* type text */
-		struct logformat_node *node = calloc(1, sizeof(*node));
+		struct logformat_node *node;
+
+		/* if the previous node is also a constant string (e.g. a literal
+		 * '%' followed by text), extend it instead of chaining a second
+		 * node, so that constant segments are emitted in one copy.
+		 */
+		if (!LIST_ISEMPTY(list_format)) {
+			node = LIST_PREV(list_format, struct logformat_node *, list);
+			if (node->type == LOG_FMT_TEXT) {
+				str = realloc(node->arg, node->arg_len + (end - start) + 1);
+				if (!str) {
+					memprintf(err, "out of memory error");
+					return 0;
+				}
+				memcpy(str + node->arg_len, start, end - start);
+				node->arg_len += end - start;
+				str[node->arg_len] = '\0';
+				node->arg = str;
+				return 1;
+			}
+		}
+
+		node = calloc(1, sizeof(*node));
 		if (!node) {
 			memprintf(err, "out of memory error");
 			return 0;
@@ -384,7 +410,9 @@ int add_to_logformat_list(char *start, char *end, int type, struct list *list_fo
 		strncpy(str, start, end - start);
 		str[end - start] = '\0';
 		node->arg = str;
+		node->arg_len = end - start;
 		node->type = LOG_FMT_TEXT; // type string
+		node->options = options;
 		LIST_APPEND(list_format, &node->list);
 	} else if (type == LF_SEPARATOR) {
 		struct logformat_node *node = calloc(1, sizeof(*node));
@@ -393,6 +421,7 @@ int add_to_logformat_list(char *start, char *end, int type, struct list *list_fo
 			return 0;
 		}
 		node->type = LOG_FMT_SEPARATOR;
+		node->options = options;
 		LIST_APPEND(list_format, &node->list);
 	}
 	return 1;
@@ -641,7 +670,7 @@ int parse_logformat_string(const char *fmt, struct proxy *curproxy, struct list
 				break;
 			case LF_TEXT:
 			case LF_SEPARATOR:
-				if (!add_to_logformat_list(sp, str, pformat, list_format, err))
+				if (!add_to_logformat_list(sp, str, pformat, options, list_format, err))
 					goto fail;
 				break;
 			}
@@ -944,7 +973,6 @@ int parse_logsrv(char **args, struct list *logsrvs, int do_del, const char *file
 
 		cur_arg += 2;
 	}
-	HA_SPIN_INIT(&logsrv->lock);
 	/* parse the facility */
 	logsrv->facility = get_log_facility(args[cur_arg]);
 	if (logsrv->facility < 0) {
@@ -1451,7 +1479,7 @@ struct ist *build_log_header(enum log_fmt format, int level, int facility,
 
 			if (unlikely(time != hdr_ctx.cur_legacy_time)) {
 				/* re-builds timestamp from the current local time */
-				get_localtime(time, &logtime);
+				logtime = *get_localtime_cached(time);
 
 				len = snprintf(hdr_ctx.timestamp_buffer, sizeof(hdr_ctx.timestamp_buffer),
 				               "%s %2d %02d:%02d:%02d ",
@@ -1501,7 +1529,7 @@ struct ist *build_log_header(enum log_fmt format, int level, int facility,
 				if (month < 12) {
 
 					/* get local time to retrieve year */
-					get_localtime(time, &logtime);
+					logtime = *get_localtime_cached(time);
 
 					/* year seems changed since log */
 					if (logtime.tm_mon < month)
@@ -1614,6 +1642,126 @@ struct ist *build_log_header(enum log_fmt format, int level, int facility,
 	return hdr_ctx.ist_vector;
 }
 
+#if defined(__linux__)
+/* Staging ring used to batch datagram log emission. Fully formatted lines are
+ * copied into per-thread slots by __do_send_log() and flushed by a per-thread
+ * tasklet using sendmmsg(), so that the request path pays a memcpy instead of
+ * one syscall per line per target. Producer and consumer both run on the
+ * owning thread so no locking is involved. The slots are allocated together
+ * with the other log buffers, each large enough for a line of
+ * tune.max-syslog-len bytes plus the trailing LF.
+ */
+#define LOG_STAGING_SLOTS 16
+
+struct log_staged_line {
+	int fd;                                /* output socket at staging time */
+	const struct sockaddr_storage *addr;   /* destination, points to the stable logsrv config object */
+	size_t len;                            /* bytes used in the slot */
+};
+
+struct log_staging {
+	struct tasklet *tl;                    /* per-thread flush tasklet */
+	char *slots;                           /* LOG_STAGING_SLOTS slots of max_syslog_len + 1 bytes */
+	struct log_staged_line line[LOG_STAGING_SLOTS];
+	unsigned int head, tail;               /* monotonic, slot index = value % LOG_STAGING_SLOTS */
+};
+
+static THREAD_LOCAL struct log_staging log_staging;
+
+/* Flushes all the lines staged on the current thread, batching consecutive
+ * lines for the same socket into a single sendmmsg() call. Lines which could
+ * not be sent are accounted for in <dropped_logs>, consistently with the
+ * behaviour of a failed sendmsg() on this lossy datagram path.
+ */
+static void flush_staged_logs(void)
+{
+	struct log_staging *ls = &log_staging;
+
+	while (ls->tail != ls->head) {
+		struct mmsghdr msgs[LOG_STAGING_SLOTS];
+		struct iovec iov[LOG_STAGING_SLOTS];
+		int fd = ls->line[ls->tail % LOG_STAGING_SLOTS].fd;
+		unsigned int n = 0;
+		int sent;
+
+		while (ls->tail + n != ls->head) {
+			struct log_staged_line *line = &ls->line[(ls->tail + n) % LOG_STAGING_SLOTS];
+
+			if (line->fd != fd)
+				break;
+			iov[n].iov_base = ls->slots + (size_t)((ls->tail + n) % LOG_STAGING_SLOTS) * (global.max_syslog_len + 1);
+			iov[n].iov_len  = line->len;
+			memset(&msgs[n], 0, sizeof(msgs[n]));
+			msgs[n].msg_hdr.msg_iov = &iov[n];
+			msgs[n].msg_hdr.msg_iovlen = 1;
+			msgs[n].msg_hdr.msg_name = (struct sockaddr *)line->addr;
+			msgs[n].msg_hdr.msg_namelen = get_addr_len(line->addr);
+			n++;
+		}
+
+		sent = sendmmsg(fd, msgs, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (sent < 0) {
+			static char once;
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				_HA_ATOMIC_ADD(&dropped_logs, n);
+			else if (!once) {
+				once = 1; /* note: no need for atomic ops here */
+				ha_alert("sendmmsg() failed in log emitter: %s (errno=%d)\n",
+				         strerror(errno), errno);
+			}
+		}
+		else if (sent < n)
+			_HA_ATOMIC_ADD(&dropped_logs, n - sent);
+
+		/* datagrams which could not be sent are dropped, never retried */
+		ls->tail += n;
+	}
+}
+
+static struct task *log_staging_process(struct task *t, void *ctx, unsigned int state)
+{
+	flush_staged_logs();
+	return NULL;
+}
+
+/* Tries to stage the line described by the <nb> elements of <iov> for
+ * emission to <addr> via <fd>. Returns 1 on success, 0 when staging is not
+ * available (e.g. during startup) in which case the caller must send the
+ * line itself.
+ */
+static int stage_log_line(int fd, const struct sockaddr_storage *addr, const struct iovec *iov, int nb)
+{
+	struct log_staging *ls = &log_staging;
+	struct log_staged_line *line;
+	size_t len = 0;
+	char *slot;
+	int i;
+
+	if (!ls->slots || !ls->tl)
+		return 0;
+
+	/* flush in place when full so that lines are never reordered */
+	if (ls->head - ls->tail == LOG_STAGING_SLOTS)
+		flush_staged_logs();
+
+	slot = ls->slots + (size_t)(ls->head % LOG_STAGING_SLOTS) * (global.max_syslog_len + 1);
+	for (i = 0; i < nb; i++) {
+		memcpy(slot + len, iov[i].iov_base, iov[i].iov_len);
+		len += iov[i].iov_len;
+	}
+
+	line = &ls->line[ls->head % LOG_STAGING_SLOTS];
+	line->fd = fd;
+	line->addr = addr;
+	line->len = len;
+	ls->head++;
+
+	tasklet_wakeup(ls->tl);
+	return 1;
+}
+#endif /* __linux__ */
+
 /*
  * This function sends a syslog message to <logsrv>.
  * The argument <metadata> MUST be an array of size
@@ -1720,11 +1868,20 @@ static inline void __do_send_log(struct logsrv *logsrv, int nblogger, int level,
 		iovec[i].iov_len = 1;
 		i++;
 
-		msghdr.msg_iovlen = i;
-		msghdr.msg_name = (struct sockaddr *)&logsrv->addr;
-		msghdr.msg_namelen = get_addr_len(&logsrv->addr);
+#if defined(__linux__)
+		if (stage_log_line(*plogfd, &logsrv->addr, iovec, i)) {
+			/* staged for batched emission by the flush tasklet */
+			sent = 1;
+		}
+		else
+#endif
+		{
+			msghdr.msg_iovlen = i;
+			msghdr.msg_name = (struct sockaddr *)&logsrv->addr;
+			msghdr.msg_namelen = get_addr_len(&logsrv->addr);
 
-		sent = sendmsg(*plogfd, &msghdr, MSG_DONTWAIT | MSG_NOSIGNAL);
+			sent = sendmsg(*plogfd, &msghdr, MSG_DONTWAIT | MSG_NOSIGNAL);
+		}
 	}
 
 	if (sent < 0) {
@@ -1763,21 +1920,27 @@ void process_send_log(struct list *logsrvs, int level, int facility,
 			continue;
 
 		if (logsrv->lb.smp_rgs) {
-			struct smp_log_range *curr_rg;
-
-			HA_SPIN_LOCK(LOGSRV_LOCK, &logsrv->lock);
-			curr_rg = &logsrv->lb.smp_rgs[logsrv->lb.curr_rg];
-			in_range = in_smp_log_range(curr_rg, logsrv->lb.curr_idx);
-			if (in_range) {
-				/* Let's consume this range. */
-				curr_rg->curr_idx = (curr_rg->curr_idx + 1) % curr_rg->sz;
-				if (!curr_rg->curr_idx) {
-					/* If consumed, let's select the next range. */
-					logsrv->lb.curr_rg = (logsrv->lb.curr_rg + 1) % logsrv->lb.smp_rgs_sz;
+			unsigned int curr, next;
+			int i;
+
+			/* atomically consume one index, wrapping modulo <smp_sz> */
+			do {
+				curr = HA_ATOMIC_LOAD(&logsrv->lb.curr_idx);
+				next = (curr + 1) % logsrv->lb.smp_sz;
+			} while (!HA_ATOMIC_CAS(&logsrv->lb.curr_idx, &curr, next) &&
+			         __ha_cpu_relax());
+
+			/* <smp_rgs> is sorted and the ranges do not overlap, so the
+			 * message is emitted iff the consumed index falls into one
+			 * of them, which makes the sampling state a single counter.
+			 */
+			in_range = 0;
+			for (i = 0; i < logsrv->lb.smp_rgs_sz; i++) {
+				if (in_smp_log_range(&logsrv->lb.smp_rgs[i], curr)) {
+					in_range = 1;
+					break;
 				}
 			}
-			logsrv->lb.curr_idx = (logsrv->lb.curr_idx + 1) % logsrv->lb.smp_sz;
-			HA_SPIN_UNLOCK(LOGSRV_LOCK, &logsrv->lock);
 		}
 		if (in_range)
 			__do_send_log(logsrv, ++nblogger,  MAX(level, logsrv->minlvl),
@@ -1936,6 +2099,17 @@ int init_log_buffers()
 	logline_rfc5424 = my_realloc2(logline_rfc5424, global.max_syslog_len + 1);
 	if (!logline || !logline_rfc5424)
 		return 0;
+#if defined(__linux__)
+	log_staging.slots = my_realloc2(log_staging.slots,
+	                                LOG_STAGING_SLOTS * (size_t)(global.max_syslog_len + 1));
+	if (!log_staging.tl) {
+		log_staging.tl = tasklet_new();
+		if (log_staging.tl)
+			log_staging.tl->process = log_staging_process;
+	}
+	if (!log_staging.slots || !log_staging.tl)
+		return 0;
+#endif
 	return 1;
 }
 
@@ -1946,6 +2120,14 @@ void deinit_log_buffers()
 	free(logline_rfc5424);
 	logline           = NULL;
 	logline_rfc5424   = NULL;
+#if defined(__linux__)
+	flush_staged_logs();
+	if (log_staging.tl)
+		tasklet_free(log_staging.tl);
+	free(log_staging.slots);
+	log_staging.tl    = NULL;
+	log_staging.slots = NULL;
+#endif
 }
 
 /* Builds a log line in <dst> based on <list_format>, and stops before reaching
@@ -1968,11 +2150,11 @@ int sess_build_logline(struct session *sess, struct stream *s, char *dst, size_t
 	char *spc;
 	char *qmark;
 	char *end;
-	struct tm tm;
 	int t_request;
 	int hdr;
 	int last_isspace = 1;
 	int nspaces = 0;
+	char *bin_vlen = NULL;
 	char *tmplog;
 	char *ret;
 	int iret;
@@ -2076,6 +2258,21 @@ int sess_build_logline(struct session *sess, struct stream *s, char *dst, size_t
 		struct sample *key;
 		const struct buffer empty = { };
 
+		if (tmp->options & LOG_OPT_BIN) {
+			/* binary output: each field is framed as a one-byte tag
+			 * (the LOG_FMT_* node type) followed by a 16-bit network
+			 * order length which is patched once the value has been
+			 * rendered. Separators carry no information in this mode.
+			 */
+			if (tmp->type == LOG_FMT_SEPARATOR)
+				continue;
+			if (tmplog + 3 >= dst + maxsize)
+				goto out;
+			*tmplog++ = tmp->type;
+			bin_vlen = tmplog;
+			tmplog += 2;
+		}
+
 		switch (tmp->type) {
 			case LOG_FMT_SEPARATOR:
 				if (!last_isspace) {
@@ -2085,10 +2282,12 @@ int sess_build_logline(struct session *sess, struct stream *s, char *dst, size_t
 				break;
 
 			case LOG_FMT_TEXT: // text
-				src = tmp->arg;
-				iret = strlcpy2(tmplog, src, dst + maxsize - tmplog);
-				if (iret == 0)
+				/* constant segment whose length was computed when
+				 * the format was parsed */
+				iret = tmp->arg_len;
+				if (iret >= dst + maxsize - tmplog)
 					goto out;
+				memcpy(tmplog, tmp->arg, iret);
 				tmplog += iret;
 				last_isspace = 0;
 				break;
@@ -2121,10 +2320,22 @@ int sess_build_logline(struct session *sess, struct stream *s, char *dst, size_t
 
 			case LOG_FMT_CLIENTIP:  // %ci
 				addr = (s ? sc_src(s->scf) : sess_src(sess));
+				if (s && addr && !(tmp->options & LOG_OPT_HEXA)) {
+					/* reuse the stream's memoized source address
+					 * text instead of converting it again
+					 */
+					struct ist src_txt = stream_src_txt(s);
+
+					if (istlen(src_txt)) {
+						ret = lf_text_len(tmplog, istptr(src_txt), istlen(src_txt), dst + maxsize - tmplog, tmp);
+						goto clientip_done;
+					}
+				}
 				if (addr)
 					ret = lf_ip(tmplog, (struct sockaddr *)addr, dst + maxsize - tmplog, tmp);
 				else
 					ret = lf_text_len(tmplog, NULL, 0, dst + maxsize - tmplog, tmp);
+  clientip_done:
 
 				if (ret == NULL)
 					goto out;
@@ -2230,8 +2441,7 @@ int sess_build_logline(struct session *sess, struct stream *s, char *dst, size_t
 				break;
 
 			case LOG_FMT_DATE: // %t = accept date
-				get_localtime(logs->accept_date.tv_sec, &tm);
-				ret = date2str_log(tmplog, &tm, &logs->accept_date, dst + maxsize - tmplog);
+				ret = date2str_log_cached(tmplog, &logs->accept_date, dst + maxsize - tmplog);
 				if (ret == NULL)
 					goto out;
 				tmplog = ret;
@@ -2241,8 +2451,7 @@ int sess_build_logline(struct session *sess, struct stream *s, char *dst, size_t
 			case LOG_FMT_tr: // %tr = start of request date
 				/* Note that the timers are valid if we get here */
 				tv_ms_add(&tv, &logs->accept_date, logs->t_idle >= 0 ? logs->t_idle + logs->t_handshake : 0);
-				get_localtime(tv.tv_sec, &tm);
-				ret = date2str_log(tmplog, &tm, &tv, dst + maxsize - tmplog);
+				ret = date2str_log_cached(tmplog, &tv, dst + maxsize - tmplog);
 				if (ret == NULL)
 					goto out;
 				tmplog = ret;
@@ -2250,8 +2459,7 @@ int sess_build_logline(struct session *sess, struct stream *s, char *dst, size_t
 				break;
 
 			case LOG_FMT_DATEGMT: // %T = accept date, GMT
-				get_gmtime(logs->accept_date.tv_sec, &tm);
-				ret = gmt2str_log(tmplog, &tm, dst + maxsize - tmplog);
+				ret = gmt2str_log_cached(tmplog, logs->accept_date.tv_sec, dst + maxsize - tmplog);
 				if (ret == NULL)
 					goto out;
 				tmplog = ret;
@@ -2260,8 +2468,7 @@ int sess_build_logline(struct session *sess, struct stream *s, char *dst, size_t
 
 			case LOG_FMT_trg: // %trg = start of request date, GMT
 				tv_ms_add(&tv, &logs->accept_date, logs->t_idle >= 0 ? logs->t_idle + logs->t_handshake : 0);
-				get_gmtime(tv.tv_sec, &tm);
-				ret = gmt2str_log(tmplog, &tm, dst + maxsize - tmplog);
+				ret = gmt2str_log_cached(tmplog, tv.tv_sec, dst + maxsize - tmplog);
 				if (ret == NULL)
 					goto out;
 				tmplog = ret;
@@ -2269,8 +2476,7 @@ int sess_build_logline(struct session *sess, struct stream *s, char *dst, size_t
 				break;
 
 			case LOG_FMT_DATELOCAL: // %Tl = accept date, local
-				get_localtime(logs->accept_date.tv_sec, &tm);
-				ret = localdate2str_log(tmplog, logs->accept_date.tv_sec, &tm, dst + maxsize - tmplog);
+				ret = localdate2str_log_cached(tmplog, logs->accept_date.tv_sec, dst + maxsize - tmplog);
 				if (ret == NULL)
 					goto out;
 				tmplog = ret;
@@ -2279,8 +2485,7 @@ int sess_build_logline(struct session *sess, struct stream *s, char *dst, size_t
 
 			case LOG_FMT_trl: // %trl = start of request date, local
 				tv_ms_add(&tv, &logs->accept_date, logs->t_idle >= 0 ? logs->t_idle + logs->t_handshake : 0);
-				get_localtime(tv.tv_sec, &tm);
-				ret = localdate2str_log(tmplog, tv.tv_sec, &tm, dst + maxsize - tmplog);
+				ret = localdate2str_log_cached(tmplog, tv.tv_sec, dst + maxsize - tmplog);
 				if (ret == NULL)
 					goto out;
 				tmplog = ret;
@@ -3058,9 +3263,20 @@ int sess_build_logline(struct session *sess, struct stream *s, char *dst, size_t
 				break;
 
 		}
+
+		if (bin_vlen) {
+			write_n16(bin_vlen, tmplog - (bin_vlen + 2));
+			bin_vlen = NULL;
+		}
 	}
 
 out:
+	/* a field truncated in the middle of a binary frame is dropped
+	 * entirely, its length could not be patched.
+	 */
+	if (bin_vlen)
+		tmplog = bin_vlen - 1;
+
 	/* *tmplog is a unused character */
 	*tmplog = '\0';
 	return tmplog - dst;
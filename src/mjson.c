@@ -305,7 +305,7 @@ static unsigned char mjson_unhex_nimble(const char *s) {
   return v;
 }
 
-static int mjson_unescape(const char *s, int len, char *to, int n) {
+int mjson_unescape(const char *s, int len, char *to, int n) {
   int i, j;
   for (i = 0, j = 0; i < len && j < n; i++, j++) {
     if (s[i] == '\\' && i + 5 < len && s[i + 1] == 'u') {
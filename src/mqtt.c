@@ -12,6 +12,24 @@
 
 #include <haproxy/chunk.h>
 #include <haproxy/mqtt.h>
+#include <haproxy/xxhash.h>
+
+/* Per-thread memo of the last fully validated message. Content-switching
+ * rules commonly apply several mqtt_is_valid/mqtt_field_value converters to
+ * the same req.payload contents, and each of them used to re-parse the whole
+ * packet. The parse result is remembered together with the message location
+ * and a hash of its content, so that subsequent calls on the very same
+ * message only pay for the hash. The ists stored in <mpkt> point into
+ * <area>, which is why an entry is only reused when both the location and
+ * the content match.
+ */
+static THREAD_LOCAL struct {
+	const char *area;           /* start of the last validated message, NULL = unset */
+	size_t len;                 /* its total length */
+	uint64_t hash;              /* XXH3 of its content */
+	int ret;                    /* verdict of mqtt_validate_message() */
+	struct mqtt_pkt mpkt;       /* the parsed packet itself */
+} mqtt_last_parsed;
 
 uint8_t mqtt_cpt_flags[MQTT_CPT_ENTRIES] = {
 	[MQTT_CPT_INVALID]     = 0x00,
@@ -1235,6 +1253,7 @@ int mqtt_validate_message(const struct ist msg, struct mqtt_pkt *mpkt)
 {
 	struct ist parser;
 	struct mqtt_pkt tmp_mpkt;
+	uint64_t hash;
 	int ret = MQTT_INVALID_MESSAGE;
 
 	if (!mpkt)
@@ -1264,6 +1283,18 @@ int mqtt_validate_message(const struct ist msg, struct mqtt_pkt *mpkt)
 	if (istlen(parser) < mpkt->fixed_hdr.remaining_length)
 		return MQTT_NEED_MORE_DATA;
 
+	/* The whole packet is present, check the per-thread memo before
+	 * running the expensive variable header and payload parsing : hashing
+	 * the message is much cheaper than re-parsing it.
+	 */
+	hash = XXH3(istptr(msg), istlen(msg), 0);
+	if (mqtt_last_parsed.area == istptr(msg) &&
+	    mqtt_last_parsed.len == istlen(msg) &&
+	    mqtt_last_parsed.hash == hash) {
+		*mpkt = mqtt_last_parsed.mpkt;
+		return mqtt_last_parsed.ret;
+	}
+
 	/* Now parsing the variable header and payload, which is based on the packet type */
 	switch (mpkt->fixed_hdr.type) {
 	case MQTT_CPT_CONNECT:
@@ -1276,6 +1307,12 @@ int mqtt_validate_message(const struct ist msg, struct mqtt_pkt *mpkt)
 		break;
 	}
 
+	mqtt_last_parsed.area = istptr(msg);
+	mqtt_last_parsed.len = istlen(msg);
+	mqtt_last_parsed.hash = hash;
+	mqtt_last_parsed.ret = ret;
+	mqtt_last_parsed.mpkt = *mpkt;
+
   end:
 	return ret;
 }
@@ -599,6 +599,27 @@ static int fcgi_avail_streams(struct connection *conn)
 	return ret1;
 }
 
+/* Advertises the connection for reuse by inserting it into the server's
+ * avail_conns tree if it can still host new streams. This is done as soon as
+ * the application confirms support for connection multiplexing, so that
+ * queued requests can be dispatched onto this connection without waiting for
+ * the first stream to detach.
+ */
+static void fcgi_conn_offer_avail(struct fcgi_conn *fconn)
+{
+	struct server *srv = objt_server(fconn->conn->target);
+
+	if (!srv || (fconn->conn->flags & CO_FL_PRIVATE) ||
+	    !(fconn->flags & FCGI_CF_MPXS_CONNS) ||
+	    fconn->conn->hash_node->node.node.leaf_p ||
+	    LIST_INLIST(&fconn->conn->session_list) ||
+	    fcgi_avail_streams(fconn->conn) <= 0)
+		return;
+
+	eb64_insert(&srv->per_thr[tid].avail_conns, &fconn->conn->hash_node->node);
+	TRACE_STATE("mpx connection advertised for reuse", FCGI_EV_FCONN_WAKE, fconn->conn);
+}
+
 /*****************************************************************/
 /* functions below are dedicated to the mux setup and management */
 /*****************************************************************/
@@ -665,6 +686,7 @@ static int fcgi_init(struct connection *conn, struct proxy *px, struct session *
 		goto fail;
 	fconn->wait_event.tasklet->process = fcgi_io_cb;
 	fconn->wait_event.tasklet->context = fconn;
+	conn_set_tasklet_class(conn, fconn->wait_event.tasklet);
 	fconn->wait_event.events = 0;
 
 	/* Initialise the context. */
@@ -1603,6 +1625,7 @@ static int fcgi_conn_handle_values_result(struct fcgi_conn *fconn)
 	fconn->drp = 0;
 	fconn->state = FCGI_CS_RECORD_H;
 	fcgi_wake_unassigned_streams(fconn);
+	fcgi_conn_offer_avail(fconn);
 	TRACE_STATE("switching to RECORD_H", FCGI_EV_RX_RECORD|FCGI_EV_RX_FHDR, fconn->conn);
 	TRACE_LEAVE(FCGI_EV_RX_RECORD|FCGI_EV_RX_GETVAL, fconn->conn);
 	return 1;
@@ -2638,6 +2661,7 @@ static int fcgi_process_mux(struct fcgi_conn *fconn)
 				fconn->state = FCGI_CS_RECORD_H;
 				TRACE_STATE("switching to RECORD_H", FCGI_EV_TX_RECORD|FCGI_EV_RX_RECORD|FCGI_EV_RX_FHDR, fconn->conn);
 				fcgi_wake_unassigned_streams(fconn);
+				fcgi_conn_offer_avail(fconn);
 				goto mux;
 			}
 			TRACE_PROTO("sending FCGI GET_VALUES record", FCGI_EV_TX_RECORD|FCGI_EV_TX_GETVAL, fconn->conn);
@@ -4183,6 +4207,7 @@ static int fcgi_takeover(struct connection *conn, int orig_tid)
 	}
 	fcgi->wait_event.tasklet->process = fcgi_io_cb;
 	fcgi->wait_event.tasklet->context = fcgi;
+	conn_set_tasklet_class(fcgi->conn, fcgi->wait_event.tasklet);
 	fcgi->conn->xprt->subscribe(fcgi->conn, fcgi->conn->xprt_ctx,
 		                    SUB_RETRY_RECV, &fcgi->wait_event);
 
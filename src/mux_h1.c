@@ -856,7 +856,10 @@ static void h1s_destroy(struct h1s *h1s)
 		if (!(h1c->flags & (H1C_F_EOS|H1C_F_ERR_PENDING|H1C_F_ERROR|H1C_F_ABRT_PENDING|H1C_F_ABRTED)) &&  /* No error/read0/abort */
 		    h1_is_alive(h1c) &&                                                      /* still alive */
 		    (h1s->flags & H1S_F_WANT_KAL) &&                                         /* K/A possible */
-		    h1s->req.state == H1_MSG_DONE && h1s->res.state == H1_MSG_DONE) {        /* req/res in DONE state */
+		    ((h1s->req.state == H1_MSG_DONE && h1s->res.state == H1_MSG_DONE) ||     /* req/res in DONE state */
+		     ((h1c->flags & H1C_F_IS_BACK) &&                                        /* or pristine backend conn, */
+		      h1s->req.state == H1_MSG_RQBEFORE &&                                   /* detached before anything */
+		      h1s->res.state == H1_MSG_RPBEFORE))) {                                 /* was sent (pre-warming) */
 			h1c->state = H1_CS_IDLE;
 			h1c->flags |= H1C_F_WAIT_NEXT_REQ;
 			TRACE_STATE("set idle mode on h1c, waiting for the next request", H1_EV_H1C_ERR, h1c->conn, h1s);
@@ -912,6 +915,7 @@ static int h1_init(struct connection *conn, struct proxy *proxy, struct session
 		goto fail;
 	h1c->wait_event.tasklet->process = h1_io_cb;
 	h1c->wait_event.tasklet->context = h1c;
+	conn_set_tasklet_class(conn, h1c->wait_event.tasklet);
 	h1c->wait_event.events   = 0;
 	h1c->idle_exp = TICK_ETERNITY;
 
@@ -2992,7 +2996,17 @@ static int h1_process(struct h1c * h1c)
 
 		count = (buf->size - sizeof(struct htx) - global.tune.maxrewrite);
 		h1_process_demux(h1c, buf, count);
-		h1_release_buf(h1c, &h1s->rxbuf);
+
+		/* When the headers are incomplete, keep the empty rxbuf for the
+		 * next attempt instead of going through a release/alloc cycle
+		 * for each chunk of a fragmented header block. It is bounded by
+		 * the same window as the ibuf, which holds the partial headers.
+		 * On a successful parsing, the rxbuf was transferred to the
+		 * stream, and on error it will be released with the H1 stream.
+		 */
+		if (h1c->state >= H1_CS_RUNNING ||
+		    (h1s->flags & (H1S_F_INTERNAL_ERROR|H1S_F_PARSING_ERROR|H1S_F_NOT_IMPL_ERROR)))
+			h1_release_buf(h1c, &h1s->rxbuf);
 		h1_set_idle_expiration(h1c);
 		if (h1c->state < H1_CS_RUNNING) {
 			if (h1s->flags & H1S_F_INTERNAL_ERROR) {
@@ -4110,6 +4124,7 @@ static int h1_takeover(struct connection *conn, int orig_tid)
 	}
 	h1c->wait_event.tasklet->process = h1_io_cb;
 	h1c->wait_event.tasklet->context = h1c;
+	conn_set_tasklet_class(h1c->conn, h1c->wait_event.tasklet);
 	h1c->conn->xprt->subscribe(h1c->conn, h1c->conn->xprt_ctx,
 		                   SUB_RETRY_RECV, &h1c->wait_event);
 
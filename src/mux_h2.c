@@ -55,6 +55,11 @@ struct h2c {
 	uint32_t rcvd_c; /* newly received data to ACK for the connection */
 	uint32_t rcvd_s; /* newly received data to ACK for the current stream (dsi) or zero */
 
+	int32_t diw; /* demux initial window size, as advertised to the peer */
+	uint32_t diw_ts; /* start of the current rx window measurement period (now_ms) */
+	uint32_t diw_bytes; /* payload bytes acknowledged since <diw_ts> */
+	uint32_t rtt; /* rough RTT estimate in milliseconds, 0 if not measured yet */
+
 	/* states for the demux direction */
 	struct hpack_dht *ddht; /* demux dynamic header table */
 	struct buffer dbuf;    /* demux buffer */
@@ -83,6 +88,7 @@ struct h2c {
 	unsigned int stream_cnt;  /* total number of streams seen */
 	struct proxy *proxy; /* the proxy this connection was created for */
 	struct task *task;  /* timeout management task */
+	struct ctimer ctmr; /* coarse timer carrying <task>'s expiration date */
 	struct h2_counters *px_counters; /* h2 counters attached to proxy */
 	struct eb_root streams_by_id; /* all active streams by their ID */
 	struct list send_list; /* list of blocked streams requesting to send */
@@ -114,6 +120,7 @@ struct h2s {
 	struct tasklet *shut_tl;  /* deferred shutdown tasklet, to retry to send an RST after we failed to,
 				   * in case there's no other subscription to do it */
 
+	uint8_t sched_weight; /* send scheduling weight (1..8), 8 minus the RFC 9218 urgency */
 	char upgrade_protocol[16]; /* rfc 8441: requested protocol on Extended CONNECT */
 };
 
@@ -401,11 +408,16 @@ DECLARE_STATIC_POOL(pool_head_h2s, "h2s", sizeof(struct h2s));
 /* maximum amount of data we're OK with re-aligning for buffer optimizations */
 #define MAX_DATA_REALIGN 1024
 
+/* default stream scheduling weight, 8 minus the RFC 9218 default urgency (3) */
+#define H2_SCHED_DEF_WEIGHT (8 - 3)
+
 /* a few settings from the global section */
 static int h2_settings_header_table_size      =  4096; /* initial value */
 static int h2_settings_initial_window_size    = 65536; /* initial value */
+static int h2_settings_max_window_size        = 0;     /* rx window auto-tuning limit per stream, 0 = disabled */
 static unsigned int h2_settings_max_concurrent_streams = 100;
 static int h2_settings_max_frame_size         = 0;     /* unset */
+static int h2_settings_sched_quantum          = 16384; /* DATA bytes granted per weight unit and send opportunity */
 
 /* a dummy closed endpoint */
 static const struct sedesc closed_ep = {
@@ -570,6 +582,7 @@ static inline int h2c_may_expire(const struct h2c *h2c)
 /* update h2c timeout if needed */
 static void h2c_update_timeout(struct h2c *h2c)
 {
+	int expire = TICK_ETERNITY;
 	int is_idle_conn = 0;
 
 	TRACE_ENTER(H2_EV_H2C_WAKE, h2c->conn);
@@ -581,11 +594,11 @@ static void h2c_update_timeout(struct h2c *h2c)
 		/* no more streams attached */
 		if (h2c->last_sid >= 0) {
 			/* GOAWAY sent, closing in progress */
-			h2c->task->expire = tick_add_ifset(now_ms, h2c->shut_timeout);
+			expire = tick_add_ifset(now_ms, h2c->shut_timeout);
 			is_idle_conn = 1;
 		} else if (br_data(h2c->mbuf)) {
 			/* pending output data: always the regular data timeout */
-			h2c->task->expire = tick_add_ifset(now_ms, h2c->timeout);
+			expire = tick_add_ifset(now_ms, h2c->timeout);
 		} else if (!(h2c->flags & H2_CF_IS_BACK) && h2c->max_id > 0 && !b_data(&h2c->dbuf)) {
 			/* idle after having seen one stream => keep-alive */
 			int to;
@@ -595,18 +608,27 @@ static void h2c_update_timeout(struct h2c *h2c)
 			else
 				to = h2c->proxy->timeout.httpreq;
 
-			h2c->task->expire = tick_add_ifset(h2c->idle_start, to);
+			expire = tick_add_ifset(h2c->idle_start, to);
 			is_idle_conn = 1;
+
+			if (global.tune.idle_shrink && !(h2c->flags & H2_CF_IDLE_SHRUNK)) {
+				/* wake up earlier to release the idle connection's memory */
+				int shrink = tick_add_ifset(h2c->idle_start, global.tune.idle_shrink);
+
+				if (!tick_isset(expire) ||
+				    tick_is_le(shrink, expire))
+					expire = shrink;
+			}
 		} else {
 			/* before first request, or started to deserialize a
 			 * new req => http-request, but only set, not refresh.
 			 */
 			int exp = (h2c->flags & H2_CF_IS_BACK) ? TICK_ETERNITY : h2c->proxy->timeout.httpreq;
-			h2c->task->expire = tick_add_ifset(h2c->idle_start, exp);
+			expire = tick_add_ifset(h2c->idle_start, exp);
 		}
 		/* if a timeout above was not set, fall back to the default one */
-		if (!tick_isset(h2c->task->expire))
-			h2c->task->expire = tick_add_ifset(now_ms, h2c->timeout);
+		if (!tick_isset(expire))
+			expire = tick_add_ifset(now_ms, h2c->timeout);
 
 		if ((h2c->proxy->flags & (PR_FL_DISABLED|PR_FL_STOPPED)) &&
 		    is_idle_conn && tick_isset(global.close_spread_end)) {
@@ -622,12 +644,12 @@ static void h2c_update_timeout(struct h2c *h2c)
 				/* We don't need to reset the expire if it would
 				 * already happen before the close window end.
 				 */
-				if (tick_isset(h2c->task->expire) &&
-				    tick_is_le(global.close_spread_end, h2c->task->expire)) {
+				if (tick_isset(expire) &&
+				    tick_is_le(global.close_spread_end, expire)) {
 					/* Set an expire value shorter than the current value
 					 * because the close spread window end comes earlier.
 					 */
-					h2c->task->expire = tick_add(now_ms, statistical_prng_range(remaining_window));
+					expire = tick_add(now_ms, statistical_prng_range(remaining_window));
 				}
 			}
 			else {
@@ -639,9 +661,13 @@ static void h2c_update_timeout(struct h2c *h2c)
 		}
 
 	} else {
-		h2c->task->expire = TICK_ETERNITY;
+		expire = TICK_ETERNITY;
 	}
-	task_queue(h2c->task);
+
+	if (tick_isset(expire))
+		ctimer_queue(&h2c->ctmr, expire);
+	else
+		ctimer_dequeue(&h2c->ctmr);
  leave:
 	TRACE_LEAVE(H2_EV_H2C_WAKE);
 }
@@ -783,6 +809,32 @@ static inline void h2_release_mbuf(struct h2c *h2c)
 		offer_buffers(NULL, count);
 }
 
+/* Releases an idle connection's expendable memory: empty demux and mux
+ * buffers, and the HPACK demux table when the peer's encoder never filled it
+ * (an empty table is identical to a freshly allocated one so it can safely be
+ * released and lazily reallocated on the next HEADERS frame). The
+ * H2_CF_IDLE_SHRUNK flag is set so that this is only attempted once per idle
+ * period; it is cleared when demux activity resumes.
+ */
+static void h2c_shrink_idle(struct h2c *h2c)
+{
+	TRACE_ENTER(H2_EV_H2C_WAKE, h2c->conn);
+
+	if (!b_data(&h2c->dbuf))
+		h2_release_buf(h2c, &h2c->dbuf);
+
+	if (!br_data(h2c->mbuf))
+		h2_release_mbuf(h2c);
+
+	if (h2c->ddht && !h2c->ddht->used) {
+		hpack_dht_free(h2c->ddht);
+		h2c->ddht = NULL;
+	}
+
+	h2c->flags |= H2_CF_IDLE_SHRUNK;
+	TRACE_LEAVE(H2_EV_H2C_WAKE, h2c->conn);
+}
+
 /* returns the number of allocatable outgoing streams for the connection taking
  * the last_sid and the reserved ones into account.
  */
@@ -968,14 +1020,15 @@ static int h2_init(struct connection *conn, struct proxy *prx, struct session *s
 		h2c->task = t;
 		t->process = h2_timeout_task;
 		t->context = h2c;
-		t->expire = tick_add(now_ms, h2c->timeout);
 	}
+	ctimer_init(&h2c->ctmr, t);
 
 	h2c->wait_event.tasklet = tasklet_new();
 	if (!h2c->wait_event.tasklet)
 		goto fail;
 	h2c->wait_event.tasklet->process = h2_io_cb;
 	h2c->wait_event.tasklet->context = h2c;
+	conn_set_tasklet_class(conn, h2c->wait_event.tasklet);
 	h2c->wait_event.events = 0;
 	if (!conn_is_back(conn)) {
 		/* Connection might already be in the stopping_list if subject
@@ -999,6 +1052,10 @@ static int h2_init(struct connection *conn, struct proxy *prx, struct session *s
 	h2c->errcode = H2_ERR_NO_ERROR;
 	h2c->rcvd_c = 0;
 	h2c->rcvd_s = 0;
+	h2c->diw = h2_settings_initial_window_size;
+	h2c->diw_ts = now_ms;
+	h2c->diw_bytes = 0;
+	h2c->rtt = 0;
 	h2c->nb_streams = 0;
 	h2c->nb_sc = 0;
 	h2c->nb_reserved = 0;
@@ -1024,7 +1081,7 @@ static int h2_init(struct connection *conn, struct proxy *prx, struct session *s
 	TRACE_USER("new H2 connection", H2_EV_H2C_NEW, conn);
 
 	if (t)
-		task_queue(t);
+		ctimer_queue(&h2c->ctmr, tick_add(now_ms, h2c->timeout));
 
 	if (h2c->flags & H2_CF_IS_BACK) {
 		/* FIXME: this is temporary, for outgoing connections we need
@@ -1109,6 +1166,11 @@ static void h2_release(struct h2c *h2c)
 	h2_release_buf(h2c, &h2c->dbuf);
 	h2_release_mbuf(h2c);
 
+	/* the coarse timer is embedded in the h2c so it must absolutely be
+	 * removed from the wheel before the h2c is freed.
+	 */
+	ctimer_dequeue(&h2c->ctmr);
+
 	if (h2c->task) {
 		h2c->task->context = NULL;
 		task_wakeup(h2c->task, TASK_WOKEN_OTHER);
@@ -1450,6 +1512,29 @@ static void h2s_destroy(struct h2s *h2s)
 	TRACE_LEAVE(H2_EV_H2S_END, conn);
 }
 
+/* Turns the value of an RFC 9218 "priority" header field into a scheduling
+ * weight. Only the "u=<0..7>" dictionary member is considered, any other
+ * member or a malformed value is ignored and leaves the default urgency (3)
+ * in place. Lower urgencies get larger weights so that more urgent streams
+ * receive a larger share of the connection's send opportunities.
+ */
+static uint8_t h2_priority_to_weight(struct ist value)
+{
+	const char *p = istptr(value);
+	const char *e = istend(value);
+	int urgency = 8 - H2_SCHED_DEF_WEIGHT;
+
+	while (p + 3 <= e) {
+		if (*p == 'u' && p[1] == '=' && p[2] >= '0' && p[2] <= '7' &&
+		    (p == istptr(value) || p[-1] == ' ' || p[-1] == '\t' || p[-1] == ',')) {
+			urgency = p[2] - '0';
+			break;
+		}
+		p++;
+	}
+	return 8 - urgency;
+}
+
 /* allocates a new stream <id> for connection <h2c> and adds it into h2c's
  * stream tree. In case of error, nothing is added and NULL is returned. The
  * causes of errors can be any failed memory allocation. The caller is
@@ -1484,6 +1569,7 @@ static struct h2s *h2s_new(struct h2c *h2c, int id)
 	h2s->status    = 0;
 	h2s->body_len  = 0;
 	h2s->rxbuf     = BUF_NULL;
+	h2s->sched_weight = H2_SCHED_DEF_WEIGHT;
 	memset(h2s->upgrade_protocol, 0, sizeof(h2s->upgrade_protocol));
 
 	h2s->by_id.key = h2s->id = id;
@@ -1720,6 +1806,12 @@ static int h2c_send_settings(struct h2c *h2c)
 			ret = 0;
 		}
 	}
+	else {
+		/* this is the reference date for the RTT estimate made from
+		 * the settings ACK.
+		 */
+		h2c->diw_ts = now_ms;
+	}
  out:
 	TRACE_LEAVE(H2_EV_TX_FRAME|H2_EV_TX_SETTINGS, h2c->conn);
 	return ret;
@@ -2183,6 +2275,12 @@ static int h2c_handle_settings(struct h2c *h2c)
 			error = H2_ERR_FRAME_SIZE_ERROR;
 			goto fail;
 		}
+		/* the first ACK necessarily responds to our initial SETTINGS
+		 * frame, use it as a rough RTT estimate for the rx window
+		 * auto-tuning.
+		 */
+		if (!h2c->rtt)
+			h2c->rtt = (now_ms - h2c->diw_ts) ? now_ms - h2c->diw_ts : 1;
 		goto done;
 	}
 
@@ -2355,6 +2453,94 @@ static int h2c_send_window_update(struct h2c *h2c, int sid, uint32_t increment)
 	return ret;
 }
 
+/* Try to advertise a new per-stream initial window size of <iws> bytes using
+ * a SETTINGS frame, the peer being in charge of applying the difference to
+ * all existing streams (RFC7540#6.9.2). Returns > 0 on success or zero on
+ * missing room or failure. It may return an error in h2c.
+ */
+static int h2c_send_updated_iws(struct h2c *h2c, int32_t iws)
+{
+	struct buffer *res;
+	char str[15];
+	int ret = 0;
+
+	TRACE_ENTER(H2_EV_TX_FRAME|H2_EV_TX_SETTINGS, h2c->conn);
+
+	/* length: 6, type: 4 (settings), flags: none, sid: 0,
+	 * identifier: 4 (initial_window_size)
+	 */
+	memcpy(str, "\x00\x00\x06\x04\x00\x00\x00\x00\x00\x00\x04", 11);
+	write_n32(str + 11, iws);
+
+	res = br_tail(h2c->mbuf);
+ retry:
+	if (!h2_get_buf(h2c, res)) {
+		h2c->flags |= H2_CF_MUX_MALLOC;
+		h2c->flags |= H2_CF_DEM_MROOM;
+		goto out;
+	}
+
+	ret = b_istput(res, ist2(str, 15));
+	if (unlikely(ret <= 0)) {
+		if (!ret) {
+			if ((res = br_tail_add(h2c->mbuf)) != NULL)
+				goto retry;
+			h2c->flags |= H2_CF_MUX_MFULL;
+			h2c->flags |= H2_CF_DEM_MROOM;
+		}
+		else {
+			h2c_error(h2c, H2_ERR_INTERNAL_ERROR);
+			ret = 0;
+		}
+	}
+ out:
+	TRACE_LEAVE(H2_EV_TX_FRAME|H2_EV_TX_SETTINGS, h2c->conn);
+	return ret;
+}
+
+/* Decide whether the per-stream window advertised on this connection deserves
+ * to be enlarged, and advertise the new size to the peer if so. The window is
+ * considered too small when the streams consumed a full window's worth of
+ * payload within a few round trips, in which case the sender is very likely
+ * to be window-limited: the window is then doubled, up to
+ * tune.h2.max-window-size. Since the trigger is the bytes *consumed* by the
+ * streams and not those received, a connection whose data pile up in front
+ * of a slow application never grows its window. This is only called with
+ * freshly acknowledged data so the measurement period cannot silently extend
+ * over an idle connection.
+ */
+static void h2c_tune_rcv_window(struct h2c *h2c)
+{
+	uint32_t period;
+	int32_t iws;
+
+	if (h2c->diw >= h2_settings_max_window_size)
+		return;
+
+	/* without an RTT estimate yet, assume a conservative 100ms */
+	period = h2c->rtt ? 4 * h2c->rtt : 100;
+
+	if (now_ms - h2c->diw_ts > period) {
+		/* measurement period over, restart it from now */
+		h2c->diw_ts = now_ms;
+		h2c->diw_bytes = 0;
+		return;
+	}
+
+	if (h2c->diw_bytes < (uint32_t)h2c->diw)
+		return;
+
+	iws = (h2c->diw > h2_settings_max_window_size / 2) ?
+		h2_settings_max_window_size : h2c->diw * 2;
+
+	if (h2c_send_updated_iws(h2c, iws) > 0) {
+		TRACE_STATE("growing advertised initial window size", H2_EV_TX_FRAME|H2_EV_TX_SETTINGS, h2c->conn);
+		h2c->diw = iws;
+		h2c->diw_ts = now_ms;
+		h2c->diw_bytes = 0;
+	}
+}
+
 /* try to send pending window update for the connection. It's safe to call it
  * with no pending updates. Returns > 0 on success or zero on missing room or
  * failure. It may return an error in h2c.
@@ -2368,6 +2554,8 @@ static int h2c_send_conn_wu(struct h2c *h2c)
 	if (h2c->rcvd_c <= 0)
 		goto out;
 
+	h2c->diw_bytes += h2c->rcvd_c;
+
 	if (!(h2c->flags & H2_CF_WINDOW_OPENED)) {
 		/* increase the advertised connection window to 2G on
 		 * first update.
@@ -2378,8 +2566,10 @@ static int h2c_send_conn_wu(struct h2c *h2c)
 
 	/* send WU for the connection */
 	ret = h2c_send_window_update(h2c, 0, h2c->rcvd_c);
-	if (ret > 0)
+	if (ret > 0) {
 		h2c->rcvd_c = 0;
+		h2c_tune_rcv_window(h2c);
+	}
 
  out:
 	TRACE_LEAVE(H2_EV_TX_FRAME|H2_EV_TX_WU, h2c->conn);
@@ -2754,6 +2944,14 @@ static struct h2s *h2c_frt_handle_headers(struct h2c *h2c, struct h2s *h2s)
 	h2s->flags |= flags;
 	h2s->body_len = body_len;
 
+	/* a request-level priority signal overrides the default scheduling weight */
+	if (b_data(&h2s->rxbuf)) {
+		struct http_hdr_ctx ctx = { .blk = NULL };
+
+		if (http_find_header(htxbuf(&h2s->rxbuf), ist("priority"), &ctx, 0))
+			h2s->sched_weight = h2_priority_to_weight(ctx.value);
+	}
+
  done:
 	if (h2c->dff & H2_F_HEADERS_END_STREAM)
 		h2s->flags |= H2_SF_ES_RCVD;
@@ -3163,6 +3361,9 @@ static void h2_process_demux(struct h2c *h2c)
 
 	TRACE_ENTER(H2_EV_H2C_WAKE, h2c->conn);
 
+	/* demux activity resumes, re-arm the idle shrinker */
+	h2c->flags &= ~H2_CF_IDLE_SHRUNK;
+
 	if (h2c->st0 >= H2_CS_ERROR)
 		goto out;
 
@@ -4077,7 +4278,7 @@ static int h2_wake(struct connection *conn)
 struct task *h2_timeout_task(struct task *t, void *context, unsigned int state)
 {
 	struct h2c *h2c = context;
-	int expired = tick_is_expired(t->expire, now_ms);
+	int expired;
 
 	TRACE_ENTER(H2_EV_H2C_WAKE, h2c ? h2c->conn : NULL);
 
@@ -4094,7 +4295,7 @@ struct task *h2_timeout_task(struct task *t, void *context, unsigned int state)
 			goto do_leave;
 		}
 
-
+		expired = tick_is_expired(h2c->ctmr.expire, now_ms);
 		if (!expired) {
 			HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
 			TRACE_DEVEL("leaving (not expired)", H2_EV_H2C_WAKE, h2c->conn);
@@ -4106,7 +4307,21 @@ struct task *h2_timeout_task(struct task *t, void *context, unsigned int state)
 			 * for the data layer, so we must not enforce the timeout here.
 			 */
 			HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
-			t->expire = TICK_ETERNITY;
+			ctimer_dequeue(&h2c->ctmr);
+			return t;
+		}
+
+		if (global.tune.idle_shrink && h2c->st0 < H2_CS_ERROR &&
+		    !(h2c->flags & (H2_CF_IDLE_SHRUNK | H2_CF_IS_BACK)) &&
+		    h2c->max_id > 0 && !br_data(h2c->mbuf)) {
+			/* the shrink delay struck before the keep-alive
+			 * timeout: release the idle connection's memory and go
+			 * back to sleep until the real timeout.
+			 */
+			h2c_shrink_idle(h2c);
+			HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
+			h2c_update_timeout(h2c);
+			TRACE_DEVEL("leaving after shrinking idle connection", H2_EV_H2C_WAKE, h2c->conn);
 			return t;
 		}
 
@@ -4308,7 +4523,7 @@ static void h2_detach(struct sedesc *sd)
 		/* refresh the timeout if none was active, so that the last
 		 * leaving stream may arm it.
 		 */
-		if (!tick_isset(h2c->task->expire))
+		if (!tick_isset(h2c->ctmr.expire))
 			h2c_update_timeout(h2c);
 		return;
 	}
@@ -4681,6 +4896,16 @@ static int h2c_dec_hdrs(struct h2c *h2c, struct buffer *rxbuf, uint32_t *flags,
 
 	TRACE_ENTER(H2_EV_RX_FRAME|H2_EV_RX_HDR, h2c->conn);
 
+	if (unlikely(!h2c->ddht)) {
+		/* the demux table was released while the connection was idle */
+		h2c->ddht = hpack_dht_alloc();
+		if (!h2c->ddht) {
+			TRACE_DEVEL("failed to reallocate the demux table", H2_EV_RX_FRAME|H2_EV_RX_HDR|H2_EV_H2C_ERR, h2c->conn);
+			h2c_error(h2c, H2_ERR_INTERNAL_ERROR);
+			goto fail;
+		}
+	}
+
 next_frame:
 	if (b_data(&h2c->dbuf) - hole < h2c->dfl)
 		goto leave; // incomplete input frame
@@ -5080,7 +5305,7 @@ static size_t h2s_snd_fhdrs(struct h2s *h2s, struct htx *htx)
 {
 	struct http_hdr list[global.tune.max_http_hdr];
 	struct h2c *h2c = h2s->h2c;
-	struct htx_blk *blk;
+	struct htx_blk *blk, *tail;
 	struct buffer outbuf;
 	struct buffer *mbuf;
 	struct htx_sl *sl;
@@ -5095,7 +5320,8 @@ static size_t h2s_snd_fhdrs(struct h2s *h2s, struct htx *htx)
 	 * that we dump starting at header 0 */
 	sl = NULL;
 	hdr = 0;
-	for (blk = htx_get_head_blk(htx); blk; blk = htx_get_next_blk(htx, blk)) {
+	for (blk = htx_get_head_blk(htx), tail = htx_get_tail_blk(htx); blk;
+	     blk = htx_get_next_blk_fast(blk, tail)) {
 		type = htx_get_blk_type(blk);
 
 		if (type == HTX_BLK_UNUSED)
@@ -5344,7 +5570,7 @@ static size_t h2s_snd_bhdrs(struct h2s *h2s, struct htx *htx)
 {
 	struct http_hdr list[global.tune.max_http_hdr];
 	struct h2c *h2c = h2s->h2c;
-	struct htx_blk *blk;
+	struct htx_blk *blk, *tail;
 	struct buffer outbuf;
 	struct buffer *mbuf;
 	struct htx_sl *sl;
@@ -5361,7 +5587,8 @@ static size_t h2s_snd_bhdrs(struct h2s *h2s, struct htx *htx)
 	 * that we dump starting at header 0 */
 	sl = NULL;
 	hdr = 0;
-	for (blk = htx_get_head_blk(htx); blk; blk = htx_get_next_blk(htx, blk)) {
+	for (blk = htx_get_head_blk(htx), tail = htx_get_tail_blk(htx); blk;
+	     blk = htx_get_next_blk_fast(blk, tail)) {
 		type = htx_get_blk_type(blk);
 
 		if (type == HTX_BLK_UNUSED)
@@ -5424,6 +5651,12 @@ static size_t h2s_snd_bhdrs(struct h2s *h2s, struct htx *htx)
 			if (isteq(list[hdr].n, ist("host")))
 				host = list[hdr].v;
 
+			/* a request-level priority signal overrides the default
+			 * scheduling weight
+			 */
+			if (isteqi(list[hdr].n, ist("priority")))
+				h2s->sched_weight = h2_priority_to_weight(list[hdr].v);
+
 			hdr++;
 		}
 		else if (type == HTX_BLK_REQ_SL) {
@@ -5753,9 +5986,10 @@ static size_t h2s_make_data(struct h2s *h2s, struct buffer *buf, size_t count)
 	int es_now = 0;
 	int bsize; /* htx block size */
 	int fsize; /* h2 frame size  */
+	int ftotal; /* total payload put into the current frame */
+	int max;   /* max payload for the current frame */
 	struct htx_blk *blk;
 	enum htx_blk_type type;
-	int trunc_out; /* non-zero if truncated on out buf */
 
 	TRACE_ENTER(H2_EV_TX_FRAME|H2_EV_TX_DATA, h2c->conn, h2s);
 
@@ -5798,7 +6032,6 @@ static size_t h2s_make_data(struct h2s *h2s, struct buffer *buf, size_t count)
 	type  = htx_get_blk_type(blk);
 	bsize = htx_get_blksz(blk);
 	fsize = bsize;
-	trunc_out = 0;
 	if (type != HTX_BLK_DATA)
 		goto end;
 
@@ -5924,8 +6157,18 @@ static size_t h2s_make_data(struct h2s *h2s, struct buffer *buf, size_t count)
 	 * unblocked on window opening. Note: we don't implement padding.
 	 */
 
-	if (!fsize)
+	if (!fsize) {
+		/* empty DATA block, emit an empty frame */
+		htx_remove_blk(htx, blk);
+		if ((htx->flags & HTX_FL_EOM) && htx_is_empty(htx)) {
+			/* EOM+empty: we may need to add END_STREAM (except for tunneled
+			 * message)
+			 */
+			if (!(h2s->flags & H2_SF_BODY_TUNNEL))
+				es_now = 1;
+		}
 		goto send_empty;
+	}
 
 	if (h2s_mws(h2s) <= 0) {
 		h2s->flags |= H2_SF_BLK_SFCTL;
@@ -5936,28 +6179,34 @@ static size_t h2s_make_data(struct h2s *h2s, struct buffer *buf, size_t count)
 		goto end;
 	}
 
-	if (fsize > count)
-		fsize = count;
+	/* <max> is the largest payload we're allowed to put into the frame
+	 * being built. It's bounded by the requested count, the stream's
+	 * window, the max frame size, the room left in the output buffer and
+	 * the connection's window. The connection's flow control is applied
+	 * last so that we can use a separate list of streams which are
+	 * immediately unblocked on window opening. Note: we don't implement
+	 * padding.
+	 */
+	max = count;
 
-	if (fsize > h2s_mws(h2s))
-		fsize = h2s_mws(h2s); // >0
+	if (max > h2s_mws(h2s))
+		max = h2s_mws(h2s); // >0
 
-	if (h2c->mfs && fsize > h2c->mfs)
-		fsize = h2c->mfs; // >0
+	if (h2c->mfs && max > h2c->mfs)
+		max = h2c->mfs; // >0
 
-	if (fsize + 9 > outbuf.size) {
+	if (max + 9 > outbuf.size) {
 		/* It doesn't fit at once. If it at least fits once split and
 		 * the amount of data to move is low, let's defragment the
 		 * buffer now.
 		 */
 		if (b_space_wraps(mbuf) &&
-		    (fsize + 9 <= b_room(mbuf)) &&
+		    (max + 9 <= b_room(mbuf)) &&
 		    b_data(mbuf) <= MAX_DATA_REALIGN)
 			goto realign_again;
-		fsize = outbuf.size - 9;
-		trunc_out = 1;
+		max = outbuf.size - 9;
 
-		if (fsize <= 0) {
+		if (max <= 0) {
 			/* no need to send an empty frame here */
 			if ((mbuf = br_tail_add(h2c->mbuf)) != NULL)
 				goto retry;
@@ -5974,35 +6223,64 @@ static size_t h2s_make_data(struct h2s *h2s, struct buffer *buf, size_t count)
 		goto end;
 	}
 
-	if (fsize > h2c->mws)
-		fsize = h2c->mws;
+	if (max > h2c->mws)
+		max = h2c->mws;
 
-	/* now let's copy this this into the output buffer */
-	memcpy(outbuf.area + 9, htx_get_blk_ptr(htx, blk), fsize);
-	h2s->sws -= fsize;
-	h2c->mws -= fsize;
-	count    -= fsize;
+	if (fsize > max)
+		fsize = max;
 
- send_empty:
-	/* update the frame's size */
-	h2_set_frame_size(outbuf.area, fsize);
+	/* now let's copy this into the output buffer. Several consecutive
+	 * DATA blocks may be pending in the HTX message, and each of them
+	 * would otherwise be sent as its own frame with its own 9-byte
+	 * header, so we aggregate as many of them as the limit above permits
+	 * into the frame being built. This significantly reduces the framing
+	 * overhead for applications emitting many small messages (e.g. gRPC).
+	 */
+	ftotal = 0;
+	for (;;) {
+		memcpy(outbuf.area + 9 + ftotal, htx_get_blk_ptr(htx, blk), fsize);
+		ftotal += fsize;
+		count  -= fsize;
 
-	/* consume incoming HTX block */
-	total += fsize;
-	if (fsize == bsize) {
-		htx_remove_blk(htx, blk);
-		if ((htx->flags & HTX_FL_EOM) && htx_is_empty(htx)) {
-			/* EOM+empty: we may need to add END_STREAM (except for tunneled
-			 * message)
-			 */
-			if (!(h2s->flags & H2_SF_BODY_TUNNEL))
-				es_now = 1;
+		/* consume incoming HTX block */
+		if (fsize == bsize) {
+			htx_remove_blk(htx, blk);
+			if ((htx->flags & HTX_FL_EOM) && htx_is_empty(htx)) {
+				/* EOM+empty: we may need to add END_STREAM (except
+				 * for tunneled message)
+				 */
+				if (!(h2s->flags & H2_SF_BODY_TUNNEL))
+					es_now = 1;
+				break;
+			}
 		}
+		else {
+			/* we've truncated this block */
+			htx_cut_data_blk(htx, blk, fsize);
+			break;
+		}
+
+		if (ftotal >= max)
+			break;
+
+		blk = htx_get_head_blk(htx);
+		if (!blk || htx_get_blk_type(blk) != HTX_BLK_DATA)
+			break;
+
+		bsize = htx_get_blksz(blk);
+		fsize = bsize;
+		if (fsize > max - ftotal)
+			fsize = max - ftotal;
 	}
-	else {
-		/* we've truncated this block */
-		htx_cut_data_blk(htx, blk, fsize);
-	}
+
+	h2s->sws -= ftotal;
+	h2c->mws -= ftotal;
+	fsize = ftotal;
+	total += ftotal;
+
+ send_empty:
+	/* update the frame's size */
+	h2_set_frame_size(outbuf.area, fsize);
 
 	if (es_now)
 		outbuf.area[4] |= H2_F_DATA_END_STREAM;
@@ -6020,15 +6298,12 @@ static size_t h2s_make_data(struct h2s *h2s, struct buffer *buf, size_t count)
 		h2s->flags |= H2_SF_ES_SENT;
 		TRACE_PROTO("ES flag set on outgoing frame", H2_EV_TX_FRAME|H2_EV_TX_DATA|H2_EV_TX_EOI, h2c->conn, h2s);
 	}
-	else if (fsize) {
-		if (fsize == bsize) {
-			TRACE_DEVEL("more data may be available, trying to send another frame", H2_EV_TX_FRAME|H2_EV_TX_DATA, h2c->conn, h2s);
-			goto new_frame;
-		}
-		else if (trunc_out) {
-			/* we've truncated this block */
-			goto new_frame;
-		}
+	else if (fsize && count) {
+		/* we were limited by the frame size, a window or the output
+		 * buffer, more data may be available or we may be blocked
+		 */
+		TRACE_DEVEL("more data may be available, trying to send another frame", H2_EV_TX_FRAME|H2_EV_TX_DATA, h2c->conn, h2s);
+		goto new_frame;
 	}
 
  end:
@@ -6118,7 +6393,7 @@ static size_t h2s_make_trailers(struct h2s *h2s, struct htx *htx)
 {
 	struct http_hdr list[global.tune.max_http_hdr];
 	struct h2c *h2c = h2s->h2c;
-	struct htx_blk *blk;
+	struct htx_blk *blk, *tail;
 	struct buffer outbuf;
 	struct buffer *mbuf;
 	enum htx_blk_type type;
@@ -6130,7 +6405,8 @@ static size_t h2s_make_trailers(struct h2s *h2s, struct htx *htx)
 
 	/* get trailers. */
 	hdr = 0;
-	for (blk = htx_get_head_blk(htx); blk; blk = htx_get_next_blk(htx, blk)) {
+	for (blk = htx_get_head_blk(htx), tail = htx_get_tail_blk(htx); blk;
+	     blk = htx_get_next_blk_fast(blk, tail)) {
 		type = htx_get_blk_type(blk);
 
 		if (type == HTX_BLK_UNUSED)
@@ -6444,6 +6720,7 @@ static size_t h2_rcv_buf(struct stconn *sc, struct buffer *buf, size_t count, in
 static size_t h2_snd_buf(struct stconn *sc, struct buffer *buf, size_t count, int flags)
 {
 	struct h2s *h2s = __sc_mux_strm(sc);
+	size_t budget = (size_t)-1;
 	size_t total = 0;
 	size_t ret;
 	struct htx *htx;
@@ -6476,6 +6753,16 @@ static size_t h2_snd_buf(struct stconn *sc, struct buffer *buf, size_t count, in
 		return 0;
 	}
 
+	/* When other streams are waiting to send on this connection, cap the
+	 * amount of DATA bytes this stream may emit during this opportunity
+	 * so that a single bulk transfer cannot monopolize the mux buffers.
+	 * The budget grows with the stream's scheduling weight, derived from
+	 * the RFC 9218 urgency. Once it is consumed we stop and go back to
+	 * the tail of the send list like any partial send.
+	 */
+	if (!LIST_ISEMPTY(&h2s->h2c->send_list) || !LIST_ISEMPTY(&h2s->h2c->fctl_list))
+		budget = (size_t)h2_settings_sched_quantum * h2s->sched_weight;
+
 	htx = htx_from_buf(buf);
 
 	if (!(h2s->flags & H2_SF_OUTGOING_DATA) && count)
@@ -6538,11 +6825,16 @@ static size_t h2_snd_buf(struct stconn *sc, struct buffer *buf, size_t count, in
 				    (h2s->flags & (H2_SF_BODY_TUNNEL|H2_SF_BODYLESS_RESP)) == H2_SF_BODYLESS_RESP)
 					ret = h2s_skip_data(h2s, buf, count);
 				else
-					ret = h2s_make_data(h2s, buf, count);
+					ret = h2s_make_data(h2s, buf, MIN(count, budget));
 				if (ret > 0) {
 					htx = htx_from_buf(buf);
 					total += ret;
 					count -= ret;
+					if (ret >= budget) {
+						TRACE_DEVEL("stream exhausted its send budget", H2_EV_H2S_SEND|H2_EV_H2S_BLK, h2s->h2c->conn, h2s);
+						goto done;
+					}
+					budget -= ret;
 					if (ret < bsize)
 						goto done;
 				}
@@ -6724,8 +7016,8 @@ static int h2_dump_h2c_info(struct buffer *msg, struct h2c *h2c, const char *pfx
 	chunk_appendf(msg, " .task=%p", h2c->task);
 	if (h2c->task) {
 		chunk_appendf(msg, " .exp=%s",
-			      h2c->task->expire ? tick_is_expired(h2c->task->expire, now_ms) ? "<PAST>" :
-			      human_time(TICKS_TO_MS(h2c->task->expire - now_ms), TICKS_TO_MS(1000)) : "<NEVER>");
+			      h2c->ctmr.expire ? tick_is_expired(h2c->ctmr.expire, now_ms) ? "<PAST>" :
+			      human_time(TICKS_TO_MS(h2c->ctmr.expire - now_ms), TICKS_TO_MS(1000)) : "<NEVER>");
 	}
 
 	return ret;
@@ -6779,14 +7071,34 @@ static int h2_show_sd(struct buffer *msg, struct sedesc *sd, const char *pfx)
 /* Migrate the the connection to the current thread.
  * Return 0 if successful, non-zero otherwise.
  * Expected to be called with the old thread lock held.
+ *
+ * Note that the whole mux state (HPACK tables, buffers, streams) simply
+ * follows the h2c pointer and costs nothing to migrate; only the scheduling
+ * glue needs to be rebuilt here. The old task and tasklet cannot be rebound
+ * to the new thread because they may already have been picked by the old
+ * thread's scheduler (e.g. the tasklet may be spinning on the idle_conns
+ * lock we're currently holding), so they're told to free themselves there
+ * and are replaced by fresh ones. These are allocated first so that a
+ * memory shortage fails the takeover without harming the connection, which
+ * then simply remains usable on its original thread.
  */
 static int h2_takeover(struct connection *conn, int orig_tid)
 {
 	struct h2c *h2c = conn->ctx;
 	struct task *task;
+	struct task *new_task;
+	struct tasklet *new_tasklet;
+
+	/* Pre-allocate tasks so that we don't have to roll back after the
+	 * takeover.
+	 */
+	new_task = task_new_here();
+	new_tasklet = tasklet_new();
+	if (!new_task || !new_tasklet)
+		goto fail;
 
 	if (fd_takeover(conn->handle.fd, conn) != 0)
-		return -1;
+		goto fail;
 
 	if (conn->xprt->takeover && conn->xprt->takeover(conn, conn->xprt_ctx, orig_tid) != 0) {
 		/* We failed to takeover the xprt, even if the connection may
@@ -6796,7 +7108,7 @@ static int h2_takeover(struct connection *conn, int orig_tid)
 		 */
 		conn->flags |= CO_FL_ERROR;
 		tasklet_wakeup_on(h2c->wait_event.tasklet, orig_tid);
-		return -1;
+		goto fail;
 	}
 
 	if (h2c->wait_event.events)
@@ -6810,30 +7122,40 @@ static int h2_takeover(struct connection *conn, int orig_tid)
 
 	task = h2c->task;
 	if (task) {
+		/* pull the coarse timer out of the original thread's wheel,
+		 * this is the only operation that may be performed on a remote
+		 * wheel. The new task is left unarmed like the old one was
+		 * after a takeover, the next stream activity will rearm it.
+		 */
+		ctimer_dequeue(&h2c->ctmr);
+
 		task->context = NULL;
 		h2c->task = NULL;
 		__ha_barrier_store();
 		task_kill(task);
 
-		h2c->task = task_new_here();
-		if (!h2c->task) {
-			h2_release(h2c);
-			return -1;
-		}
+		h2c->task = new_task;
+		new_task = NULL;
 		h2c->task->process = h2_timeout_task;
 		h2c->task->context = h2c;
+		ctimer_init(&h2c->ctmr, h2c->task);
 	}
-	h2c->wait_event.tasklet = tasklet_new();
-	if (!h2c->wait_event.tasklet) {
-		h2_release(h2c);
-		return -1;
-	}
+	h2c->wait_event.tasklet = new_tasklet;
 	h2c->wait_event.tasklet->process = h2_io_cb;
 	h2c->wait_event.tasklet->context = h2c;
+	conn_set_tasklet_class(h2c->conn, h2c->wait_event.tasklet);
 	h2c->conn->xprt->subscribe(h2c->conn, h2c->conn->xprt_ctx,
 		                   SUB_RETRY_RECV, &h2c->wait_event);
 
+	if (new_task)
+		__task_free(new_task);
 	return 0;
+ fail:
+	if (new_task)
+		__task_free(new_task);
+	if (new_tasklet)
+		tasklet_free(new_tasklet);
+	return -1;
 }
 
 /*******************************************************/
@@ -6872,6 +7194,22 @@ static int h2_parse_initial_window_size(char **args, int section_type, struct pr
 	return 0;
 }
 
+/* config parser for global "tune.h2.max-window-size" */
+static int h2_parse_max_window_size(char **args, int section_type, struct proxy *curpx,
+                                    const struct proxy *defpx, const char *file, int line,
+                                    char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	h2_settings_max_window_size = atoi(args[1]);
+	if (h2_settings_max_window_size < 0 || h2_settings_max_window_size > ((1<<30) - 1)) {
+		memprintf(err, "'%s' expects a numeric value between 0 and 1073741823.", args[0]);
+		return -1;
+	}
+	return 0;
+}
+
 /* config parser for global "tune.h2.max-concurrent-streams" */
 static int h2_parse_max_concurrent_streams(char **args, int section_type, struct proxy *curpx,
                                            const struct proxy *defpx, const char *file, int line,
@@ -6904,6 +7242,22 @@ static int h2_parse_max_frame_size(char **args, int section_type, struct proxy *
 	return 0;
 }
 
+/* config parser for global "tune.h2.sched-quantum" */
+static int h2_parse_sched_quantum(char **args, int section_type, struct proxy *curpx,
+                                  const struct proxy *defpx, const char *file, int line,
+                                  char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	h2_settings_sched_quantum = atoi(args[1]);
+	if (h2_settings_sched_quantum < 1024 || h2_settings_sched_quantum > 1048576) {
+		memprintf(err, "'%s' expects a numeric value between 1024 and 1048576.", args[0]);
+		return -1;
+	}
+	return 0;
+}
+
 
 /****************************************/
 /* MUX initialization and instantiation */
@@ -6944,6 +7298,8 @@ static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_GLOBAL, "tune.h2.initial-window-size",    h2_parse_initial_window_size    },
 	{ CFG_GLOBAL, "tune.h2.max-concurrent-streams", h2_parse_max_concurrent_streams },
 	{ CFG_GLOBAL, "tune.h2.max-frame-size",         h2_parse_max_frame_size         },
+	{ CFG_GLOBAL, "tune.h2.max-window-size",        h2_parse_max_window_size        },
+	{ CFG_GLOBAL, "tune.h2.sched-quantum",          h2_parse_sched_quantum          },
 	{ 0, NULL, NULL }
 }};
 
@@ -48,6 +48,7 @@
 
 static int exitcode = -1;
 static int max_reloads = -1; /* number max of reloads a worker can have until they are killed */
+int mworker_skip_unchanged_reloads = 0; /* skip reloads when the config files did not change */
 struct mworker_proc *proc_self = NULL; /* process structure of current process */
 
 /* ----- children processes handling ----- */
@@ -639,6 +640,9 @@ static int cli_parse_reload(char **args, char *payload, struct appctx *appctx, v
 	if (!cli_has_level(appctx, ACCESS_LVL_OPER))
 		return 1;
 
+	if (mworker_config_unchanged())
+		return cli_msg(appctx, LOG_INFO, "Configuration files unchanged, reload skipped.\n");
+
 	/* This ask for a synchronous reload, which means we will keep this FD
 	   instead of closing it. */
 
@@ -727,6 +731,20 @@ out:
 	return err_code;
 }
 
+static int mworker_parse_global_skip_unchanged_reloads(char **args, int section_type, struct proxy *curpx,
+           const struct proxy *defpx, const char *file, int linenum, char **err)
+{
+	int err_code = 0;
+
+	if (alertif_too_many_args(0, file, linenum, args, &err_code))
+		goto out;
+
+	mworker_skip_unchanged_reloads = 1;
+
+out:
+	return err_code;
+}
+
 void mworker_free_child(struct mworker_proc *child)
 {
 	int i;
@@ -745,6 +763,7 @@ void mworker_free_child(struct mworker_proc *child)
 
 static struct cfg_kw_list mworker_kws = {{ }, {
 	{ CFG_GLOBAL, "mworker-max-reloads", mworker_parse_global_max_reloads },
+	{ CFG_GLOBAL, "mworker-skip-unchanged-reloads", mworker_parse_global_skip_unchanged_reloads },
 	{ 0, NULL, NULL },
 }};
 
@@ -195,9 +195,36 @@ static struct ncb_blk ncb_blk_next(const struct ncbuf *buf,
 	return blk;
 }
 
+/* Rebuilds the descriptor of the non-reduced gap block starting at offset
+ * <off>. The caller is responsible for ensuring that a non-reduced gap
+ * effectively starts at this offset, typically via the buffer lookup hint.
+ */
+static struct ncb_blk ncb_blk_at_gap(const struct ncbuf *buf, ncb_sz_t off)
+{
+	struct ncb_blk blk;
+
+	blk.st = ncb_peek(buf, off);
+	blk.off = off;
+	blk.flag = NCB_BK_F_GAP;
+	blk.sz_ptr = ncb_peek(buf, off + NCB_GAP_SZ_OFF);
+	blk.sz = ncb_read_off(buf, blk.sz_ptr);
+	blk.sz_data = ncb_read_off(buf, ncb_peek(buf, off + NCB_GAP_SZ_DATA_OFF));
+
+	BUG_ON_HOT(blk.sz < NCB_GAP_MIN_SZ);
+	BUG_ON_HOT(off + blk.sz > ncb_size(buf));
+	blk.end = ncb_peek(buf, off + blk.sz);
+
+	return blk;
+}
+
 /* Returns the block containing offset <off>. Note that if <off> is at the
  * frontier between two blocks, this function will return the preceding one.
  * This is done to easily merge blocks on insertion/deletion.
+ *
+ * When the buffer hint references a gap located strictly before <off>, the
+ * loop resumes from it instead of scanning all the blocks from the start.
+ * This keeps lookups amortized O(1) when data are heavily fragmented by
+ * reordering, where the linear scan otherwise dominates.
  */
 static struct ncb_blk ncb_blk_find(const struct ncbuf *buf, ncb_sz_t off)
 {
@@ -208,8 +235,12 @@ static struct ncb_blk ncb_blk_find(const struct ncbuf *buf, ncb_sz_t off)
 
 	BUG_ON_HOT(off >= ncb_size(buf));
 
-	for (blk = ncb_blk_first(buf); off > blk.off + blk.sz;
-	     blk = ncb_blk_next(buf, &blk)) {
+	if (buf->hint && off > buf->hint)
+		blk = ncb_blk_at_gap(buf, buf->hint);
+	else
+		blk = ncb_blk_first(buf);
+
+	for (; off > blk.off + blk.sz; blk = ncb_blk_next(buf, &blk)) {
 	}
 
 	return blk;
@@ -387,6 +418,7 @@ void ncb_init(struct ncbuf *buf, ncb_sz_t head)
 
 	BUG_ON_HOT(head >= buf->size);
 	buf->head = head;
+	buf->hint = 0;
 
 	ncb_write_off(buf, ncb_reserved(buf), 0);
 	ncb_write_off(buf, ncb_head(buf), ncb_size(buf));
@@ -406,6 +438,7 @@ struct ncbuf ncb_make(char *area, ncb_sz_t size, ncb_sz_t head)
 	buf.area = area;
 	buf.size = size;
 	buf.head = head;
+	buf.hint = 0;
 
 	return buf;
 }
@@ -534,6 +567,20 @@ enum ncb_ret ncb_add(struct ncbuf *buf, ncb_sz_t off,
 	if (ret != NCB_RET_OK)
 		return ret;
 
+	/* Update the lookup hint : blocks located before the insertion point
+	 * cannot be modified by it, so when the insertion begins inside a gap,
+	 * its start is a safe resume point for the next lookups. Otherwise any
+	 * gap at or after <off> may be filled by this insertion, so a hint
+	 * pointing there must be dropped.
+	 */
+	if ((blk.flag & NCB_BK_F_GAP) && !(blk.flag & NCB_BK_F_FIN) &&
+	    off > blk.off) {
+		buf->hint = blk.off;
+	}
+	else if (buf->hint >= off) {
+		buf->hint = 0;
+	}
+
 	if (blk.flag & NCB_BK_F_GAP) {
 		/* Reduce gap size if insertion begins in a gap. Gap data size
 		 * is reset and will be recalculated during insertion.
@@ -609,6 +656,11 @@ enum ncb_ret ncb_advance(struct ncbuf *buf, ncb_sz_t adv)
 	if (!adv)
 		return NCB_RET_OK;
 
+	/* all the offsets are about to shift so the lookup hint cannot be
+	 * preserved.
+	 */
+	buf->hint = 0;
+
 	/* Special case if adv is full size. This is equivalent to a reset. */
 	if (adv == ncb_size(buf)) {
 		ncb_init(buf, buf->head);
@@ -18,6 +18,7 @@
 #include <import/lru.h>
 
 #include <haproxy/api.h>
+#include <haproxy/chunk.h>
 #include <haproxy/global.h>
 #include <haproxy/log.h>
 #include <haproxy/net_helper.h>
@@ -446,6 +447,24 @@ struct pattern *pat_match_str(struct sample *smp, struct pattern_expr *expr, int
 	if (!eb_is_empty(&expr->pattern_tree)) {
 		char prev = 0;
 
+		if (expr->mflags & PAT_MF_IGNORE_CASE) {
+			/* the keys are indexed lowercased, lookup a lowercased
+			 * copy of the sample (see pat_idx_tree_str()).
+			 */
+			struct buffer *tmp = get_trash_chunk();
+			size_t i;
+
+			if (smp->data.u.str.data >= tmp->size)
+				return NULL;
+
+			for (i = 0; i < smp->data.u.str.data; i++)
+				tmp->area[i] = tolower((unsigned char)smp->data.u.str.area[i]);
+			tmp->area[i] = '\0';
+
+			node = ebst_lookup(&expr->pattern_tree, tmp->area);
+			goto node_found;
+		}
+
 		if (smp->data.u.str.data < smp->data.u.str.size) {
 			/* we may have to force a trailing zero on the test pattern and
 			 * the buffer is large enough to accommodate it. If the flag
@@ -473,6 +492,8 @@ struct pattern *pat_match_str(struct sample *smp, struct pattern_expr *expr, int
 		if (prev)
 			smp->data.u.str.area[smp->data.u.str.data] = prev;
 
+ node_found:
+
 		while (node) {
 			elt = ebmb_entry(node, struct pattern_tree, node);
 			if (elt->ref->gen_id != expr->ref->curr_gen) {
@@ -647,6 +668,24 @@ struct pattern *pat_match_beg(struct sample *smp, struct pattern_expr *expr, int
 	if (!eb_is_empty(&expr->pattern_tree)) {
 		char prev = 0;
 
+		if (expr->mflags & PAT_MF_IGNORE_CASE) {
+			/* the keys are indexed lowercased, lookup a lowercased
+			 * copy of the sample (see pat_idx_tree_pfx()).
+			 */
+			struct buffer *tmp = get_trash_chunk();
+			size_t i;
+
+			if (smp->data.u.str.data >= tmp->size)
+				return NULL;
+
+			for (i = 0; i < smp->data.u.str.data; i++)
+				tmp->area[i] = tolower((unsigned char)smp->data.u.str.area[i]);
+			tmp->area[i] = '\0';
+
+			node = ebmb_lookup_longest(&expr->pattern_tree, tmp->area);
+			goto node_found;
+		}
+
 		if (smp->data.u.str.data < smp->data.u.str.size) {
 			/* we may have to force a trailing zero on the test pattern and
 			 * the buffer is large enough to accommodate it.
@@ -668,6 +707,8 @@ struct pattern *pat_match_beg(struct sample *smp, struct pattern_expr *expr, int
 		if (prev)
 			smp->data.u.str.area[smp->data.u.str.data] = prev;
 
+ node_found:
+
 		while (node) {
 			elt = ebmb_entry(node, struct pattern_tree, node);
 			if (elt->ref->gen_id != expr->ref->curr_gen) {
@@ -765,8 +806,288 @@ struct pattern *pat_match_end(struct sample *smp, struct pattern_expr *expr, int
 	return ret;
 }
 
-/* Checks that the pattern is included inside the tested string.
- * NB: Suboptimal, should be rewritten using a Boyer-Moore method.
+/* One state of the substring matching automaton. Outgoing transitions are
+ * kept in a per-node array sorted by character so that they can be looked up
+ * by binary search. <out> points to the first pattern (in list insertion
+ * order) which is fully matched when this state is reached, either directly
+ * or via the suffix (failure) chain, as propagated at build time.
+ */
+struct pat_ac_node {
+	struct pat_ac_edge *edges;  /* transitions, sorted by character */
+	unsigned int fail;          /* longest proper suffix state */
+	unsigned int nedges;        /* number of valid entries in <edges> */
+	struct pattern *out;        /* earliest matching pattern here, or NULL */
+	unsigned int out_pos;       /* list position of <out>, valid if <out> */
+};
+
+struct pat_ac_edge {
+	unsigned char c;            /* transition character (lowercased if icase) */
+	unsigned int next;          /* target state, never the root */
+};
+
+/* Compiled Aho-Corasick automaton covering all patterns of the current
+ * generation of an expression. It is built lazily by pat_match_sub() and
+ * remains valid as long as neither the revision nor the current generation of
+ * the reference change.
+ */
+struct pat_ac {
+	unsigned long long revision; /* expr->ref->revision at build time */
+	unsigned int gen_id;         /* expr->ref->curr_gen at build time */
+	unsigned int nb_nodes;       /* number of states in <nodes> */
+	struct pat_ac_node *nodes;   /* states, the root is at index zero */
+};
+
+/* An automaton is only built once this many patterns are indexed, below that
+ * the plain list scan is at least as fast.
+ */
+#define PAT_AC_MIN_PATTERNS 16
+
+/* Returns the state reached from <state> on character <c>, or zero if there
+ * is no such transition (the root never is a transition target).
+ */
+static inline unsigned int pat_ac_goto(const struct pat_ac_node *nodes, unsigned int state, unsigned char c)
+{
+	const struct pat_ac_edge *edges = nodes[state].edges;
+	unsigned int min = 0;
+	unsigned int max = nodes[state].nedges;
+
+	while (min < max) {
+		unsigned int mid = (min + max) / 2;
+
+		if (edges[mid].c < c)
+			min = mid + 1;
+		else if (edges[mid].c > c)
+			max = mid;
+		else
+			return edges[mid].next;
+	}
+	return 0;
+}
+
+/* Releases all the memory used by automaton <ac>. */
+static void pat_ac_destroy(struct pat_ac *ac)
+{
+	unsigned int i;
+
+	for (i = 0; i < ac->nb_nodes; i++)
+		free(ac->nodes[i].edges);
+	free(ac->nodes);
+	free(ac);
+}
+
+/* Drops the automaton attached to <expr> if any. It must be called by any
+ * operation adding or removing patterns, with the expression's write lock
+ * held, so that no other thread may still be walking the automaton.
+ */
+static void pat_ac_invalidate(struct pattern_expr *expr)
+{
+	struct pat_ac *ac = expr->ac;
+
+	if (!ac)
+		return;
+	HA_ATOMIC_STORE(&expr->ac, NULL);
+	pat_ac_destroy(ac);
+}
+
+/* Builds an Aho-Corasick automaton over all patterns of <expr> belonging to
+ * the current generation, so that one single pass over the input is enough to
+ * check all of them at once instead of scanning the input once per pattern.
+ * Patterns are lowercased at build time when the expression is
+ * case-insensitive, and the input is lowercased during the walk. Each
+ * terminal state records the matched pattern with the lowest list position so
+ * that the walk reports the same pattern a sequential scan of the list would
+ * have found first, which matters for maps. The caller must hold at least the
+ * read lock on <expr>. Returns the new automaton, or NULL if there are too
+ * few patterns to be worth it or on allocation failure, in which cases the
+ * caller simply falls back to the list scan.
+ */
+static struct pat_ac *pat_ac_build(struct pattern_expr *expr)
+{
+	int icase = expr->mflags & PAT_MF_IGNORE_CASE;
+	struct pattern_list *lst;
+	struct pattern *pattern;
+	struct pat_ac_node *nodes;
+	struct pat_ac *ac;
+	unsigned int *queue;
+	unsigned int nb_nodes, sz_nodes;
+	unsigned int count, pos;
+	unsigned int head, tail;
+	unsigned int cur, next;
+	unsigned int i, j;
+	unsigned char c;
+
+	count = 0;
+	list_for_each_entry(lst, &expr->patterns, list)
+		if (lst->pat.ref->gen_id == expr->ref->curr_gen)
+			count++;
+
+	if (count < PAT_AC_MIN_PATTERNS)
+		return NULL;
+
+	ac = calloc(1, sizeof(*ac));
+	if (!ac)
+		return NULL;
+
+	sz_nodes = 64;
+	nodes = calloc(sz_nodes, sizeof(*nodes));
+	if (!nodes) {
+		free(ac);
+		return NULL;
+	}
+	nb_nodes = 1; /* the root */
+
+	/* first pass: build the trie */
+	pos = 0;
+	list_for_each_entry(lst, &expr->patterns, list) {
+		pattern = &lst->pat;
+
+		if (pattern->ref->gen_id != expr->ref->curr_gen)
+			continue;
+
+		cur = 0;
+		for (i = 0; i < pattern->len; i++) {
+			struct pat_ac_edge *edges;
+
+			c = pattern->ptr.str[i];
+			if (icase)
+				c = tolower(c);
+
+			next = pat_ac_goto(nodes, cur, c);
+			if (next) {
+				cur = next;
+				continue;
+			}
+
+			if (nb_nodes == sz_nodes) {
+				struct pat_ac_node *new_nodes;
+
+				new_nodes = my_realloc2(nodes, sz_nodes * 2 * sizeof(*nodes));
+				if (!new_nodes)
+					goto fail;
+				nodes = new_nodes;
+				memset(nodes + sz_nodes, 0, sz_nodes * sizeof(*nodes));
+				sz_nodes *= 2;
+			}
+
+			edges = my_realloc2(nodes[cur].edges, (nodes[cur].nedges + 1) * sizeof(*edges));
+			if (!edges)
+				goto fail;
+			nodes[cur].edges = edges;
+
+			/* keep the edges sorted by character */
+			for (j = nodes[cur].nedges; j > 0 && edges[j - 1].c > c; j--)
+				edges[j] = edges[j - 1];
+			edges[j].c = c;
+			edges[j].next = nb_nodes;
+			nodes[cur].nedges++;
+
+			cur = nb_nodes++;
+		}
+
+		if (!nodes[cur].out || pos < nodes[cur].out_pos) {
+			nodes[cur].out = pattern;
+			nodes[cur].out_pos = pos;
+		}
+		pos++;
+	}
+
+	/* second pass: compute the failure links in BFS order and propagate the
+	 * earliest matching pattern along the suffix chains.
+	 */
+	queue = malloc(nb_nodes * sizeof(*queue));
+	if (!queue)
+		goto fail;
+
+	head = tail = 0;
+	for (j = 0; j < nodes[0].nedges; j++)
+		queue[tail++] = nodes[0].edges[j].next;
+
+	while (head < tail) {
+		cur = queue[head++];
+		for (j = 0; j < nodes[cur].nedges; j++) {
+			unsigned int f = nodes[cur].fail;
+
+			c = nodes[cur].edges[j].c;
+			next = nodes[cur].edges[j].next;
+
+			while (f && !pat_ac_goto(nodes, f, c))
+				f = nodes[f].fail;
+			nodes[next].fail = pat_ac_goto(nodes, f, c);
+
+			f = nodes[next].fail;
+			if (nodes[f].out &&
+			    (!nodes[next].out || nodes[f].out_pos < nodes[next].out_pos)) {
+				nodes[next].out = nodes[f].out;
+				nodes[next].out_pos = nodes[f].out_pos;
+			}
+			queue[tail++] = next;
+		}
+	}
+	free(queue);
+
+	ac->revision = expr->ref->revision;
+	ac->gen_id = expr->ref->curr_gen;
+	ac->nb_nodes = nb_nodes;
+	ac->nodes = nodes;
+	return ac;
+
+ fail:
+	for (i = 0; i < nb_nodes; i++)
+		free(nodes[i].edges);
+	free(nodes);
+	free(ac);
+	return NULL;
+}
+
+/* Walks input sample <smp> through automaton <ac> and returns the earliest
+ * pattern (in list order) found anywhere in the input, or NULL if none
+ * matches. The whole input is scanned so that a later occurrence of an
+ * earlier pattern wins over an earlier occurrence of a later one, exactly
+ * like the sequential list scan, except when the very first pattern of the
+ * list is met, which permits an early exit.
+ */
+static struct pattern *pat_ac_match(const struct pat_ac *ac, struct sample *smp, int icase)
+{
+	const struct pat_ac_node *nodes = ac->nodes;
+	struct pattern *ret = NULL;
+	unsigned int best = 0;
+	unsigned int state = 0;
+	unsigned int next;
+	size_t i;
+	unsigned char c;
+
+	if (nodes[0].out) {
+		/* an empty pattern matches everything */
+		ret = nodes[0].out;
+		best = nodes[0].out_pos;
+	}
+
+	for (i = 0; i < smp->data.u.str.data; i++) {
+		if (ret && !best)
+			break;
+
+		c = smp->data.u.str.area[i];
+		if (icase)
+			c = tolower(c);
+
+		next = pat_ac_goto(nodes, state, c);
+		while (!next && state) {
+			state = nodes[state].fail;
+			next = pat_ac_goto(nodes, state, c);
+		}
+		state = next;
+
+		if (nodes[state].out && (!ret || nodes[state].out_pos < best)) {
+			ret = nodes[state].out;
+			best = nodes[state].out_pos;
+		}
+	}
+	return ret;
+}
+
+/* Checks that the pattern is included inside the tested string. Large pattern
+ * lists are checked in one pass using a compiled automaton, smaller ones are
+ * scanned sequentially.
  */
 struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int fill)
 {
@@ -777,6 +1098,7 @@ struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
 	struct lru64 *lru = NULL;
+	struct pat_ac *ac;
 
 	if (pat_lru_tree) {
 		unsigned long long seed = pat_lru_seed ^ (long)expr;
@@ -789,6 +1111,31 @@ struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int
 		}
 	}
 
+	/* Large pattern lists are handled by a compiled automaton which is
+	 * built here on first use and dropped by writers on any update, so a
+	 * present one whose revision and generation still match is always in
+	 * sync with the list. We hold the expression's read lock here, thus
+	 * concurrent readers may only race to install a freshly built one,
+	 * which is resolved by the CAS below, the loser releasing its own
+	 * build after use.
+	 */
+	ac = HA_ATOMIC_LOAD(&expr->ac);
+	if (ac && ac->revision == expr->ref->revision && ac->gen_id == expr->ref->curr_gen) {
+		ret = pat_ac_match(ac, smp, expr->mflags & PAT_MF_IGNORE_CASE);
+		goto leave;
+	}
+	else if (!ac) {
+		ac = pat_ac_build(expr);
+		if (ac) {
+			struct pat_ac *expected = NULL;
+
+			ret = pat_ac_match(ac, smp, expr->mflags & PAT_MF_IGNORE_CASE);
+			if (!HA_ATOMIC_CAS(&expr->ac, &expected, ac))
+				pat_ac_destroy(ac);
+			goto leave;
+		}
+	}
+
 	list_for_each_entry(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
 
@@ -1176,6 +1523,7 @@ void pat_prune_gen(struct pattern_expr *expr)
 	free_pattern_tree(&expr->pattern_tree);
 	free_pattern_tree(&expr->pattern_tree_2);
 	LIST_INIT(&expr->patterns);
+	pat_ac_invalidate(expr);
 	expr->ref->revision = rdtsc();
 	expr->ref->entry_cnt = 0;
 }
@@ -1272,6 +1620,7 @@ int pat_idx_list_str(struct pattern_expr *expr, struct pattern *pat, char **err)
 	/* and from the reference */
 	patl->from_ref = pat->ref->list_head;
 	pat->ref->list_head = &patl->from_ref;
+	pat_ac_invalidate(expr);
 	expr->ref->revision = rdtsc();
 	expr->ref->entry_cnt++;
 
@@ -1411,10 +1760,6 @@ int pat_idx_tree_str(struct pattern_expr *expr, struct pattern *pat, char **err)
 		return 0;
 	}
 
-	/* If the flag PAT_F_IGNORE_CASE is set, we cannot use trees */
-	if (expr->mflags & PAT_MF_IGNORE_CASE)
-		return pat_idx_list_str(expr, pat, err);
-
 	/* Process the key len */
 	len = strlen(pat->ptr.str) + 1;
 
@@ -1429,8 +1774,17 @@ int pat_idx_tree_str(struct pattern_expr *expr, struct pattern *pat, char **err)
 	node->data = pat->data;
 	node->ref = pat->ref;
 
-	/* copy the string */
-	memcpy(node->node.key, pat->ptr.str, len);
+	/* copy the string. Case-insensitive keys are indexed lowercased and
+	 * looked up with a lowercased copy of the sample, see pat_match_str().
+	 */
+	if (expr->mflags & PAT_MF_IGNORE_CASE) {
+		int i;
+
+		for (i = 0; i < len; i++)
+			node->node.key[i] = tolower((unsigned char)pat->ptr.str[i]);
+	}
+	else
+		memcpy(node->node.key, pat->ptr.str, len);
 
 	/* index the new node */
 	ebst_insert(&expr->pattern_tree, &node->node);
@@ -1455,10 +1809,6 @@ int pat_idx_tree_pfx(struct pattern_expr *expr, struct pattern *pat, char **err)
 		return 0;
 	}
 
-	/* If the flag PAT_F_IGNORE_CASE is set, we cannot use trees */
-	if (expr->mflags & PAT_MF_IGNORE_CASE)
-		return pat_idx_list_str(expr, pat, err);
-
 	/* Process the key len */
 	len = strlen(pat->ptr.str);
 
@@ -1473,8 +1823,18 @@ int pat_idx_tree_pfx(struct pattern_expr *expr, struct pattern *pat, char **err)
 	node->data = pat->data;
 	node->ref = pat->ref;
 
-	/* copy the string and the trailing zero */
-	memcpy(node->node.key, pat->ptr.str, len + 1);
+	/* copy the string and the trailing zero. Case-insensitive keys are
+	 * indexed lowercased and looked up with a lowercased copy of the
+	 * sample, see pat_match_beg().
+	 */
+	if (expr->mflags & PAT_MF_IGNORE_CASE) {
+		int i;
+
+		for (i = 0; i <= len; i++)
+			node->node.key[i] = tolower((unsigned char)pat->ptr.str[i]);
+	}
+	else
+		memcpy(node->node.key, pat->ptr.str, len + 1);
 	node->node.node.pfx = len * 8;
 
 	/* index the new node */
@@ -1495,6 +1855,7 @@ void pat_delete_gen(struct pat_ref *ref, struct pat_ref_elt *elt)
 {
 	struct pattern_tree *tree;
 	struct pattern_list *pat;
+	struct pattern_expr *expr;
 	void **node;
 
 	/* delete all known tree nodes. They are all allocated inline */
@@ -1524,6 +1885,10 @@ void pat_delete_gen(struct pat_ref *ref, struct pat_ref_elt *elt)
 		free(pat);
 	}
 
+	/* drop the substring automatons, all expressions are locked here */
+	list_for_each_entry(expr, &ref->pat, list)
+		pat_ac_invalidate(expr);
+
 	/* update revision number to refresh the cache */
 	ref->revision = rdtsc();
 	ref->entry_cnt--;
@@ -1536,6 +1901,7 @@ void pattern_init_expr(struct pattern_expr *expr)
 	LIST_INIT(&expr->patterns);
 	expr->pattern_tree = EB_ROOT;
 	expr->pattern_tree_2 = EB_ROOT;
+	expr->ac = NULL;
 }
 
 void pattern_init_head(struct pattern_head *head)
@@ -1625,7 +1991,6 @@ void pat_ref_delete_by_ptr(struct pat_ref *ref, struct pat_ref_elt *elt)
 
 	LIST_DELETE(&elt->list);
 	free(elt->sample);
-	free(elt->pattern);
 	free(elt);
 }
 
@@ -1883,22 +2248,26 @@ struct pat_ref *pat_ref_newid(int unique_id, const char *display, unsigned int f
 struct pat_ref_elt *pat_ref_append(struct pat_ref *ref, const char *pattern, const char *sample, int line)
 {
 	struct pat_ref_elt *elt;
+	int len = strlen(pattern);
 
-	elt = calloc(1, sizeof(*elt));
+	/* The pattern string is immutable for the whole life of the element,
+	 * so it is stored at its end to save one allocation per entry.
+	 */
+	elt = calloc(1, sizeof(*elt) + len + 1);
 	if (!elt)
-		goto fail;
+		return NULL;
 
 	elt->gen_id = ref->curr_gen;
 	elt->line = line;
 
-	elt->pattern = strdup(pattern);
-	if (!elt->pattern)
-		goto fail;
+	memcpy(elt->pattern, pattern, len + 1);
 
 	if (sample) {
 		elt->sample = strdup(sample);
-		if (!elt->sample)
-			goto fail;
+		if (!elt->sample) {
+			free(elt);
+			return NULL;
+		}
 	}
 
 	LIST_INIT(&elt->back_refs);
@@ -1906,11 +2275,6 @@ struct pat_ref_elt *pat_ref_append(struct pat_ref *ref, const char *pattern, con
 	elt->tree_head = NULL;
 	LIST_APPEND(&ref->head, &elt->list);
 	return elt;
- fail:
-	if (elt)
-		free(elt->pattern);
-	free(elt);
-	return NULL;
 }
 
 /* This function creates sample found in <elt>, parses the pattern also
@@ -2075,7 +2439,6 @@ int pat_ref_purge_range(struct pat_ref *ref, uint from, uint to, int budget)
 		pat_delete_gen(ref, elt);
 
 		LIST_DELETE(&elt->list);
-		free(elt->pattern);
 		free(elt->sample);
 		free(elt);
 	}
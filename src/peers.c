@@ -226,6 +226,13 @@ struct peer_prep_params {
 #define PEER_MSG_STKT_ACK              0x84
 #define PEER_MSG_STKT_UPDATE_TIMED     0x85
 #define PEER_MSG_STKT_INCUPDATE_TIMED  0x86
+/* delta-keyed variants (protocol >= 2.2): the key is sent as a common prefix
+ * length with the previously sent key, followed by the remaining suffix.
+ */
+#define PEER_MSG_STKT_UPDATE_DELTA           0x87
+#define PEER_MSG_STKT_INCUPDATE_DELTA        0x88
+#define PEER_MSG_STKT_UPDATE_TIMED_DELTA     0x89
+#define PEER_MSG_STKT_INCUPDATE_TIMED_DELTA  0x8A
 /* All the stick-table message identifiers abova have the #7 bit set */
 #define PEER_MSG_STKT_BIT                 7
 #define PEER_MSG_STKT_BIT_MASK         (1 << PEER_MSG_STKT_BIT)
@@ -301,8 +308,10 @@ enum {
 
 #define PEER_SESSION_PROTO_NAME         "HAProxyS"
 #define PEER_MAJOR_VER        2
-#define PEER_MINOR_VER        1
+#define PEER_MINOR_VER        2
 #define PEER_DWNGRD_MINOR_VER 0
+/* minimum minor version supporting delta-keyed update messages */
+#define PEER_DELTA_MINOR_VER  2
 
 static size_t proto_len = sizeof(PEER_SESSION_PROTO_NAME) - 1;
 struct peers *cfg_peers = NULL;
@@ -580,9 +589,17 @@ static int peer_prepare_hellomsg(char *msg, size_t size, struct peer_prep_params
 
 	peer = p->hello.peer;
 	min_ver = (peer->flags & PEER_F_DWNGRD) ? PEER_DWNGRD_MINOR_VER : PEER_MINOR_VER;
-	/* Prepare headers */
-	ret = snprintf(msg, size, PEER_SESSION_PROTO_NAME " %d.%d\n%s\n%s %d %d\n",
-		       (int)PEER_MAJOR_VER, min_ver, peer->id, localpeer, (int)getpid(), (int)1);
+	/* Prepare headers. Striped sessions announce themselves under the
+	 * local peer name suffixed with "/<stripe>" so that the remote peer
+	 * can match them against its own striped peer instances.
+	 */
+	if (peer->stripe)
+		ret = snprintf(msg, size, PEER_SESSION_PROTO_NAME " %d.%d\n%s\n%s/%d %d %d\n",
+			       (int)PEER_MAJOR_VER, min_ver, peer->id, localpeer, peer->stripe,
+			       (int)getpid(), (int)1);
+	else
+		ret = snprintf(msg, size, PEER_SESSION_PROTO_NAME " %d.%d\n%s\n%s %d %d\n",
+			       (int)PEER_MAJOR_VER, min_ver, peer->id, localpeer, (int)getpid(), (int)1);
 	if (ret >= size)
 		return 0;
 
@@ -624,12 +641,20 @@ static int peer_prepare_status_errormsg(char *msg, size_t size, struct peer_prep
 }
 
 /* Set the stick-table UPDATE message type byte at <msg_type> address,
- * depending on <use_identifier> and <use_timed> boolean parameters.
- * Always successful.
+ * depending on <use_identifier>, <use_timed> and <use_delta> boolean
+ * parameters. Always successful.
  */
-static inline void peer_set_update_msg_type(char *msg_type, int use_identifier, int use_timed)
+static inline void peer_set_update_msg_type(char *msg_type, int use_identifier, int use_timed, int use_delta)
 {
-	if (use_timed) {
+	if (use_delta) {
+		if (use_timed)
+			*msg_type = use_identifier ? PEER_MSG_STKT_UPDATE_TIMED_DELTA :
+			                             PEER_MSG_STKT_INCUPDATE_TIMED_DELTA;
+		else
+			*msg_type = use_identifier ? PEER_MSG_STKT_UPDATE_DELTA :
+			                             PEER_MSG_STKT_INCUPDATE_DELTA;
+	}
+	else if (use_timed) {
 		if (use_identifier)
 			*msg_type = PEER_MSG_STKT_UPDATE_TIMED;
 		else
@@ -642,6 +667,34 @@ static inline void peer_set_update_msg_type(char *msg_type, int use_identifier,
 			*msg_type = PEER_MSG_STKT_INCUPDATE;
 	}
 }
+
+/* Return the length of the key of stick-table entry <ts> belonging to the
+ * table shared by <st>, as it is sent on the wire.
+ */
+static inline size_t peer_stksess_key_len(const struct shared_table *st, const struct stksess *ts)
+{
+	if (st->table->type == SMP_T_STR)
+		return strlen((const char *)ts->key.key);
+	return st->table->key_size;
+}
+
+/* Record the key of <ts> as the last one pushed to the peer for table <st>,
+ * so that the key of the next update message for this table may be
+ * delta-encoded against it. Must only be called once the message conveying
+ * this key was committed to the output buffer, otherwise a retry would be
+ * encoded against a key the remote peer never received.
+ */
+static inline void peer_save_pushed_key(struct shared_table *st, struct stksess *ts)
+{
+	size_t keylen;
+
+	if (st->table->type == SMP_T_SINT)
+		return;
+
+	keylen = peer_stksess_key_len(st, ts);
+	memcpy(st->last_pushed_key, ts->key.key, keylen);
+	st->last_pushed_key_len = keylen;
+}
 /*
  * This prepare the data update message on the stick session <ts>, <st> is the considered
  * stick table.
@@ -661,6 +714,7 @@ static int peer_prepare_updatemsg(char *msg, size_t size, struct peer_prep_param
 	unsigned int updateid;
 	int use_identifier;
 	int use_timed;
+	int use_delta, prefix;
 	struct peer *peer;
 
 	ts = p->updt.stksess;
@@ -679,6 +733,22 @@ static int peer_prepare_updatemsg(char *msg, size_t size, struct peer_prep_param
 		use_identifier = 1;
 	}
 
+	/* check whether the key may be delta-encoded against the last one
+	 * pushed for this table: only worth it past a 2-byte common prefix,
+	 * and meaningless for integer keys which are already minimal.
+	 */
+	prefix = 0;
+	if (peer->proto_minor >= PEER_DELTA_MINOR_VER &&
+	    st->table->type != SMP_T_SINT && st->last_pushed_key_len >= 0) {
+		int max = MIN((int)peer_stksess_key_len(st, ts), st->last_pushed_key_len);
+
+		while (prefix < max && ts->key.key[prefix] == (unsigned char)st->last_pushed_key[prefix])
+			prefix++;
+		if (prefix < 2)
+			prefix = 0;
+	}
+	use_delta = prefix > 0;
+
 	/* encode update identifier if needed */
 	if (use_identifier)  {
 		netinteger = htonl(updateid);
@@ -696,9 +766,17 @@ static int peer_prepare_updatemsg(char *msg, size_t size, struct peer_prep_param
 	if (st->table->type == SMP_T_STR) {
 		int stlen = strlen((char *)ts->key.key);
 
-		intencode(stlen, &cursor);
-		memcpy(cursor, ts->key.key, stlen);
-		cursor += stlen;
+		if (use_delta) {
+			intencode(prefix, &cursor);
+			intencode(stlen - prefix, &cursor);
+			memcpy(cursor, ts->key.key + prefix, stlen - prefix);
+			cursor += stlen - prefix;
+		}
+		else {
+			intencode(stlen, &cursor);
+			memcpy(cursor, ts->key.key, stlen);
+			cursor += stlen;
+		}
 	}
 	else if (st->table->type == SMP_T_SINT) {
 		netinteger = htonl(read_u32(ts->key.key));
@@ -706,8 +784,15 @@ static int peer_prepare_updatemsg(char *msg, size_t size, struct peer_prep_param
 		cursor += sizeof(netinteger);
 	}
 	else {
-		memcpy(cursor, ts->key.key, st->table->key_size);
-		cursor += st->table->key_size;
+		if (use_delta) {
+			intencode(prefix, &cursor);
+			memcpy(cursor, ts->key.key + prefix, st->table->key_size - prefix);
+			cursor += st->table->key_size - prefix;
+		}
+		else {
+			memcpy(cursor, ts->key.key, st->table->key_size);
+			cursor += st->table->key_size;
+		}
 	}
 
 	HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &ts->lock);
@@ -863,7 +948,7 @@ static int peer_prepare_updatemsg(char *msg, size_t size, struct peer_prep_param
 
 	/*  prepare message header */
 	msg[0] = PEER_MSG_CLASS_STICKTABLE;
-	peer_set_update_msg_type(&msg[1], use_identifier, use_timed);
+	peer_set_update_msg_type(&msg[1], use_identifier, use_timed, use_delta);
 	cursor = &msg[2];
 	intencode(datalen, &cursor);
 
@@ -1604,18 +1689,40 @@ static inline int peer_send_teachmsgs(struct appctx *appctx, struct peer *p,
 			continue;
 		}
 
-		ts->ref_cnt++;
+		/* with striped sessions, regular updates are spread over the
+		 * sessions by table bucket; resync lessons are not striped so
+		 * that a learner gets the whole table from its single teacher.
+		 */
+		if (p->peers->nb_stripes > 1 && !p->local &&
+		    peer_stksess_lookup == peer_teach_process_stksess_lookup &&
+		    (int)(ts->bucket % (unsigned int)p->peers->nb_stripes) != p->stripe) {
+			/* Skip this entry */
+			st->last_pushed = updateid;
+			new_pushed = 1;
+			continue;
+		}
+
+		/* atomic: killers check it under their bucket's lock while we
+		 * only hold the table's updates lock here.
+		 */
+		HA_ATOMIC_INC(&ts->ref_cnt);
 		HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &st->table->lock);
 
 		ret = peer_send_updatemsg(st, appctx, ts, updateid, new_pushed, use_timed);
 		if (ret <= 0) {
 			HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &st->table->lock);
-			ts->ref_cnt--;
+			HA_ATOMIC_DEC(&ts->ref_cnt);
 			break;
 		}
 
+		/* the message was committed to the output buffer, its key is
+		 * now the reference for delta-encoding the next one.
+		 */
+		if (p->proto_minor >= PEER_DELTA_MINOR_VER)
+			peer_save_pushed_key(st, ts);
+
 		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &st->table->lock);
-		ts->ref_cnt--;
+		HA_ATOMIC_DEC(&ts->ref_cnt);
 		st->last_pushed = updateid;
 
 		if (peer_stksess_lookup == peer_teach_process_stksess_lookup &&
@@ -1690,6 +1797,24 @@ static inline int peer_send_teach_stage2_msgs(struct appctx *appctx, struct peer
 }
 
 
+/* Installs the freq_ctr found in <data> into the one pointed to by <frqp>.
+ * The first bit of curr_tick is the freq_ctr's internal lock, it is taken
+ * for the time of the copy so that lock-free readers always observe a
+ * consistent state.
+ */
+static inline void peer_set_frqp(struct freq_ctr *frqp, const struct freq_ctr *data)
+{
+	uint curr_tick = HA_ATOMIC_LOAD(&frqp->curr_tick);
+
+	do {
+		curr_tick &= ~1;
+	} while (!HA_ATOMIC_CAS(&frqp->curr_tick, &curr_tick, curr_tick | 0x1));
+	frqp->curr_ctr = data->curr_ctr;
+	frqp->prev_ctr = data->prev_ctr;
+	/* release the lock and commit the new period at once */
+	HA_ATOMIC_STORE(&frqp->curr_tick, data->curr_tick & ~0x1);
+}
+
 /*
  * Function used to parse a stick-table update message after it has been received
  * by <p> peer with <msg_cur> as address of the pointer to the position in the
@@ -1700,9 +1825,12 @@ static inline int peer_send_teach_stage2_msgs(struct appctx *appctx, struct peer
  * <updt> must be set for  PEER_MSG_STKT_UPDATE or PEER_MSG_STKT_UPDATE_TIMED stick-table
  * messages, in this case the stick-table update message is received with a stick-table
  * update ID.
+ * <delta> must be set for the delta-keyed message variants, in this case the key is
+ * encoded as a common prefix length with the previously received key followed by the
+ * remaining suffix.
  * <totl> is the length of the stick-table update message computed upon receipt.
  */
-static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt, int exp,
+static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt, int exp, int delta,
                                 char **msg_cur, char *msg_end, int msg_len, int totl)
 {
 	struct shared_table *st = p->remote_table;
@@ -1755,7 +1883,15 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 		goto ignore_msg;
 
 	if (st->table->type == SMP_T_STR) {
-		unsigned int to_read, to_store;
+		unsigned int to_read, to_store, prefix = 0;
+
+		if (delta) {
+			prefix = intdecode(msg_cur, msg_end);
+			if (!*msg_cur || (int)prefix > st->last_get_key_len) {
+				TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
+				goto malformed_free_newts;
+			}
+		}
 
 		to_read = intdecode(msg_cur, msg_end);
 		if (!*msg_cur) {
@@ -1763,7 +1899,7 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 			goto malformed_free_newts;
 		}
 
-		to_store = MIN(to_read, st->table->key_size - 1);
+		to_store = MIN(to_read, st->table->key_size - 1 - prefix);
 		if (*msg_cur + to_store > msg_end) {
 			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
 			            NULL, p, *msg_cur);
@@ -1772,15 +1908,16 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 			goto malformed_free_newts;
 		}
 
-		keylen = to_store;
-		memcpy(newts->key.key, *msg_cur, keylen);
+		keylen = prefix + to_store;
+		memcpy(newts->key.key, st->last_get_key, prefix);
+		memcpy(newts->key.key + prefix, *msg_cur, to_store);
 		newts->key.key[keylen] = 0;
 		*msg_cur += to_read;
 	}
 	else if (st->table->type == SMP_T_SINT) {
 		unsigned int netinteger;
 
-		if (*msg_cur + sizeof(netinteger) > msg_end) {
+		if (delta || *msg_cur + sizeof(netinteger) > msg_end) {
 			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
 			            NULL, p, *msg_cur);
 			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
@@ -1795,7 +1932,19 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 		*msg_cur += keylen;
 	}
 	else {
-		if (*msg_cur + st->table->key_size > msg_end) {
+		unsigned int prefix = 0;
+
+		if (delta) {
+			prefix = intdecode(msg_cur, msg_end);
+			if (!*msg_cur || prefix > st->table->key_size ||
+			    (int)st->table->key_size != st->last_get_key_len) {
+				TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
+				goto malformed_free_newts;
+			}
+			memcpy(newts->key.key, st->last_get_key, prefix);
+		}
+
+		if (*msg_cur + st->table->key_size - prefix > msg_end) {
 			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
 			            NULL, p, *msg_cur);
 			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
@@ -1804,8 +1953,16 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 		}
 
 		keylen = st->table->key_size;
-		memcpy(newts->key.key, *msg_cur, keylen);
-		*msg_cur += keylen;
+		memcpy(newts->key.key + prefix, *msg_cur, keylen - prefix);
+		*msg_cur += keylen - prefix;
+	}
+
+	/* keep a copy of the key as a reference for rebuilding the next
+	 * delta-encoded one.
+	 */
+	if (p->proto_minor >= PEER_DELTA_MINOR_VER && st->table->type != SMP_T_SINT) {
+		memcpy(st->last_get_key, newts->key.key, keylen);
+		st->last_get_key_len = keylen;
 	}
 
 	newts->shard = stktable_get_key_shard(st->table, newts->key.key, keylen);
@@ -1880,12 +2037,6 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 				for (idx = 0; idx < st->remote_data_nbelem[data_type]; idx++) {
 					struct freq_ctr data;
 
-					/* First bit is reserved for the freq_ctr lock
-					 * Note: here we're still protected by the stksess lock
-					 * so we don't need to update the update the freq_ctr
-					 * using its internal lock.
-					 */
-
 					decoded_int = intdecode(msg_cur, msg_end);
 					if (!*msg_cur) {
 						TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
@@ -1907,7 +2058,7 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 
 					data_ptr = stktable_data_ptr_idx(st->table, ts, data_type, idx);
 					if (data_ptr && !ignore)
-						stktable_data_cast(data_ptr, std_t_frqp) = data;
+						peer_set_frqp(&stktable_data_cast(data_ptr, std_t_frqp), &data);
 				}
 				break;
 			}
@@ -1945,12 +2096,6 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 		case STD_T_FRQP: {
 			struct freq_ctr data;
 
-			/* First bit is reserved for the freq_ctr lock
-			Note: here we're still protected by the stksess lock
-			so we don't need to update the update the freq_ctr
-			using its internal lock.
-			*/
-
 			data.curr_tick = tick_add(now_ms, -decoded_int) & ~0x1;
 			data.curr_ctr = intdecode(msg_cur, msg_end);
 			if (!*msg_cur) {
@@ -1966,7 +2111,7 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 
 			data_ptr = stktable_data_ptr(st->table, ts, data_type);
 			if (data_ptr && !ignore)
-				stktable_data_cast(data_ptr, std_t_frqp) = data;
+				peer_set_frqp(&stktable_data_cast(data_ptr, std_t_frqp), &data);
 			break;
 		}
 		case STD_T_DICT: {
@@ -2552,12 +2697,19 @@ static inline int peer_treat_awaited_msg(struct appctx *appctx, struct peer *pee
 		else if (msg_head[1] == PEER_MSG_STKT_UPDATE ||
 		         msg_head[1] == PEER_MSG_STKT_INCUPDATE ||
 		         msg_head[1] == PEER_MSG_STKT_UPDATE_TIMED ||
-		         msg_head[1] == PEER_MSG_STKT_INCUPDATE_TIMED) {
-			int update, expire;
-
-			update = msg_head[1] == PEER_MSG_STKT_UPDATE || msg_head[1] == PEER_MSG_STKT_UPDATE_TIMED;
-			expire = msg_head[1] == PEER_MSG_STKT_UPDATE_TIMED || msg_head[1] == PEER_MSG_STKT_INCUPDATE_TIMED;
-			if (!peer_treat_updatemsg(appctx, peer, update, expire,
+		         msg_head[1] == PEER_MSG_STKT_INCUPDATE_TIMED ||
+		         msg_head[1] == PEER_MSG_STKT_UPDATE_DELTA ||
+		         msg_head[1] == PEER_MSG_STKT_INCUPDATE_DELTA ||
+		         msg_head[1] == PEER_MSG_STKT_UPDATE_TIMED_DELTA ||
+		         msg_head[1] == PEER_MSG_STKT_INCUPDATE_TIMED_DELTA) {
+			int update, expire, delta;
+
+			update = msg_head[1] == PEER_MSG_STKT_UPDATE || msg_head[1] == PEER_MSG_STKT_UPDATE_TIMED ||
+			         msg_head[1] == PEER_MSG_STKT_UPDATE_DELTA || msg_head[1] == PEER_MSG_STKT_UPDATE_TIMED_DELTA;
+			expire = msg_head[1] == PEER_MSG_STKT_UPDATE_TIMED || msg_head[1] == PEER_MSG_STKT_INCUPDATE_TIMED ||
+			         msg_head[1] == PEER_MSG_STKT_UPDATE_TIMED_DELTA || msg_head[1] == PEER_MSG_STKT_INCUPDATE_TIMED_DELTA;
+			delta = msg_head[1] >= PEER_MSG_STKT_UPDATE_DELTA;
+			if (!peer_treat_updatemsg(appctx, peer, update, expire, delta,
 			                          msg_cur, msg_end, msg_len, totl))
 				return 0;
 
@@ -2726,6 +2878,7 @@ static inline int peer_getline_version(struct appctx *appctx,
  */
 static inline int peer_getline_host(struct appctx *appctx)
 {
+	char *p;
 	int reql;
 
 	reql = peer_getline(appctx);
@@ -2735,7 +2888,12 @@ static inline int peer_getline_host(struct appctx *appctx)
 	if (reql < 0)
 		return -1;
 
-	/* test hostname match */
+	/* test hostname match, ignoring the "/<stripe>" suffix appended by
+	 * striped peer sessions targeting one of our striped instances.
+	 */
+	p = strchr(trash.area, '/');
+	if (p)
+		*p = 0;
 	if (strcmp(localpeer, trash.area) != 0) {
 		appctx->st0 = PEER_SESS_ST_EXIT;
 		appctx->st1 = PEER_SESS_SC_ERRHOST;
@@ -2813,6 +2971,7 @@ static inline void init_accepted_peer(struct peer *peer, struct peers *peers)
 	/* Init cursors */
 	for (st = peer->tables; st ; st = st->next) {
 		st->last_get = st->last_acked = 0;
+		st->last_pushed_key_len = st->last_get_key_len = -1;
 		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &st->table->lock);
 		/* if st->update appears to be in future it means
 		 * that the last acked value is very old and we
@@ -2865,9 +3024,12 @@ static inline void init_connected_peer(struct peer *peer, struct peers *peers)
 	struct shared_table *st;
 
 	peer->heartbeat = tick_add(now_ms, MS_TO_TICKS(PEER_HEARTBEAT_TIMEOUT));
+	/* the remote peer accepted the version we announced in our hello */
+	peer->proto_minor = (peer->flags & PEER_F_DWNGRD) ? PEER_DWNGRD_MINOR_VER : PEER_MINOR_VER;
 	/* Init cursors */
 	for (st = peer->tables; st ; st = st->next) {
 		st->last_get = st->last_acked = 0;
+		st->last_pushed_key_len = st->last_get_key_len = -1;
 		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &st->table->lock);
 		/* if st->update appears to be in future it means
 		 * that the last acked value is very old and we
@@ -2997,6 +3159,10 @@ switchstate:
 					else {
 						curpeer->flags &= ~PEER_F_DWNGRD;
 					}
+					/* the session runs at the minor version
+					 * announced by the connecting peer.
+					 */
+					curpeer->proto_minor = min_ver;
 				}
 				curpeer->appctx = appctx;
 				curpeer->flags |= PEER_F_ALIVE;
@@ -3717,6 +3883,53 @@ static struct ebpt_node *dcache_tx_insert(struct dcache *dc, struct dcache_tx_en
 	return o;
 }
 
+/*
+ * Instantiate the striped sessions of <peers> section: each remote peer is
+ * cloned <nb_stripes> - 1 times, the clones sharing the server of their base
+ * peer but running their own session under the "<name>/<stripe>" identity.
+ * Regular updates are then spread over the sessions by table bucket.
+ * Must be called once the section is fully parsed and before the dictionary
+ * caches and shared tables are allocated, so that the clones get theirs too.
+ * Return 1 if succeeded, 0 if not.
+ */
+int peers_alloc_stripes(struct peers *peers)
+{
+	struct peer *p, *clone;
+	int i;
+
+	if (peers->nb_stripes <= 1)
+		return 1;
+
+	for (p = peers->remote; p; p = p->next) {
+		if (p->local || p->stripe)
+			continue;
+
+		for (i = 1; i < peers->nb_stripes; i++) {
+			clone = calloc(1, sizeof(*clone));
+			if (!clone)
+				return 0;
+
+			if (memprintf(&clone->id, "%s/%d", p->id, i) == NULL) {
+				free(clone);
+				return 0;
+			}
+			clone->stripe = i;
+			clone->conf = p->conf;
+			clone->addr = p->addr;
+			clone->proto = p->proto;
+			clone->xprt = p->xprt;
+			clone->sock_init_arg = p->sock_init_arg;
+			clone->srv = p->srv;
+			clone->peers = peers;
+			HA_SPIN_INIT(&clone->lock);
+			clone->next = peers->remote;
+			peers->remote = clone;
+			peers->count++;
+		}
+	}
+	return 1;
+}
+
 /*
  * Allocate a dictionary cache for each peer of <peers> section.
  * Return 1 if succeeded, 0 if not.
@@ -3752,6 +3965,19 @@ int peers_register_table(struct peers *peers, struct stktable *table)
 			break;
 		}
 		st->table = table;
+		/* buffers used to delta-encode/decode keys against the
+		 * previous update message of the session.
+		 */
+		st->last_pushed_key = malloc(table->key_size);
+		st->last_get_key = malloc(table->key_size);
+		if (!st->last_pushed_key || !st->last_get_key) {
+			free(st->last_pushed_key);
+			free(st->last_get_key);
+			free(st);
+			retval = 1;
+			break;
+		}
+		st->last_pushed_key_len = st->last_get_key_len = -1;
 		st->next = curpeer->tables;
 		if (curpeer->tables)
 			id = curpeer->tables->local_id;
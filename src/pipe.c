@@ -15,6 +15,7 @@
 
 #include <haproxy/api.h>
 #include <haproxy/global.h>
+#include <haproxy/init.h>
 #include <haproxy/pipe-t.h>
 #include <haproxy/pool.h>
 #include <haproxy/thread.h>
@@ -128,6 +129,38 @@ void put_pipe(struct pipe *p)
 	HA_ATOMIC_DEC(&pipes_used);
 }
 
+/* pre-allocates tune.pipes.prewarm pipes into the local thread's cache so that
+ * the first spliced transfers don't have to pay the pipe() syscall cost in the
+ * I/O path, nor fall back to copies through a buffer when a burst empties the
+ * pool. Running short is not an error, the remaining ones will be created on
+ * the fly as usual. Always returns 1.
+ */
+static int init_pipe_per_thread()
+{
+	struct pipe *list = NULL;
+	struct pipe *p;
+	int i;
+
+	/* grab them all first, otherwise get_pipe() would simply pop back the
+	 * one just released.
+	 */
+	for (i = 0; i < global.tune.pipes_prewarm; i++) {
+		p = get_pipe();
+		if (!p)
+			break;
+		p->next = list;
+		list = p;
+	}
+
+	while (list) {
+		p = list;
+		list = p->next;
+		put_pipe(p);
+	}
+	return 1;
+}
+REGISTER_PER_THREAD_ALLOC(init_pipe_per_thread);
+
 /*
  * Local variables:
  *  c-indent-level: 8
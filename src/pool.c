@@ -23,9 +23,11 @@
 #include <haproxy/list.h>
 #include <haproxy/pool.h>
 #include <haproxy/pool-os.h>
+#include <haproxy/init.h>
 #include <haproxy/sc_strm.h>
 #include <haproxy/stats-t.h>
 #include <haproxy/stconn.h>
+#include <haproxy/task.h>
 #include <haproxy/thread.h>
 #include <haproxy/tools.h>
 
@@ -107,7 +109,22 @@ struct show_pools_ctx {
 static int mem_fail_rate __read_mostly = 0;
 static int using_default_allocator __read_mostly = 1;
 static int disable_trim __read_mostly = 0;
+static int mem_trim_slack __read_mostly = 0; /* percent of spare objects tolerated per pool; 0 = no background trimming */
+static int mem_pool_arenas __read_mostly = 0; /* bind each pool to a dedicated allocator arena when supported */
 static int(*my_mallctl)(const char *, void *, size_t *, void *, size_t) = NULL;
+static void *(*my_mallocx)(size_t, int) = NULL;
+static void (*my_dallocx)(void *, int) = NULL;
+static void (*my_mi_process_info)(size_t *, size_t *, size_t *, size_t *, size_t *, size_t *, size_t *, size_t *) = NULL;
+
+/* These mirror the public MALLOCX_ARENA() and MALLOCX_TCACHE_NONE macros from
+ * <jemalloc/jemalloc.h>, which are part of jemalloc's stable API, so that no
+ * build-time dependency on the header is needed (the allocator may just as
+ * well come from LD_PRELOAD). The thread cache is bypassed since pools
+ * implement their own, and this keeps all of an arena's memory attributable
+ * to its pool.
+ */
+#define POOL_MALLOCX_ARENA(a)    ((int)(((unsigned)(a) + 1) << 20))
+#define POOL_MALLOCX_TCACHE_NONE ((int)(((unsigned)-1 + 2) << 8))
 
 /* ask the allocator to trim memory pools.
  * This must run under thread isolation so that competing threads trying to
@@ -174,8 +191,14 @@ static void detect_allocator(void)
 {
 #if defined(__ELF__)
 	extern int mallctl(const char *, void *, size_t *, void *, size_t) __attribute__((weak));
+	extern void *mallocx(size_t, int) __attribute__((weak));
+	extern void dallocx(void *, int) __attribute__((weak));
+	extern void mi_process_info(size_t *, size_t *, size_t *, size_t *, size_t *, size_t *, size_t *, size_t *) __attribute__((weak));
 
 	my_mallctl = mallctl;
+	my_mallocx = mallocx;
+	my_dallocx = dallocx;
+	my_mi_process_info = mi_process_info;
 #endif
 
 	if (!my_mallctl) {
@@ -183,6 +206,22 @@ static void detect_allocator(void)
 		using_default_allocator = (my_mallctl == NULL);
 	}
 
+	if (my_mallctl) {
+		/* jemalloc: also resolve the extended allocation functions,
+		 * needed to bind pools to dedicated arenas.
+		 */
+		if (!my_mallocx)
+			my_mallocx = get_sym_curr_addr("mallocx");
+		if (!my_dallocx)
+			my_dallocx = get_sym_curr_addr("dallocx");
+	}
+	else if (!my_mi_process_info) {
+		/* maybe mimalloc, which only exposes statistics */
+		my_mi_process_info = get_sym_curr_addr("mi_process_info");
+		if (my_mi_process_info)
+			using_default_allocator = 0;
+	}
+
 	if (!my_mallctl) {
 #if defined(HA_HAVE_MALLOC_TRIM)
 #ifdef HA_HAVE_MALLINFO2
@@ -336,13 +375,27 @@ struct pool_head *create_pool(char *name, unsigned int size, unsigned int flags)
  * and directly returns it. The pool's allocated counter is checked and updated,
  * but no other checks are performed.
  */
+static struct pool_item *pool_get_shard_cluster(struct pool_item **root);
+
 void *pool_get_from_os(struct pool_head *pool)
 {
+	if (unlikely(pool->arena_size)) {
+		/* chunks recycled from the arena are already accounted for in
+		 * pool->allocated so they're returned as-is.
+		 */
+		void *ptr = pool_get_shard_cluster(&pool->arena_free);
+
+		if (ptr)
+			return ptr;
+	}
+
 	if (!pool->limit || pool->allocated < pool->limit) {
 		void *ptr;
 
 		if (pool_debugging & POOL_DBG_UAF)
 			ptr = pool_alloc_area_uaf(pool->alloc_sz);
+		else if (unlikely(pool->mem_flags))
+			ptr = my_mallocx(pool->alloc_sz, pool->mem_flags);
 		else
 			ptr = pool_alloc_area(pool->alloc_sz);
 		if (ptr) {
@@ -361,8 +414,38 @@ void *pool_get_from_os(struct pool_head *pool)
  */
 void pool_put_to_os(struct pool_head *pool, void *ptr)
 {
+	if (unlikely(pool->arena_size) &&
+	    (size_t)((char *)ptr - (char *)pool->arena_addr) < pool->arena_size) {
+		/* arena chunks are never given back to the system: they are
+		 * kept aside for future allocations and remain accounted for
+		 * in pool->allocated.
+		 */
+		struct pool_item *item = ptr;
+		struct pool_item *free_list;
+
+		item->down = NULL;
+		free_list = _HA_ATOMIC_LOAD(&pool->arena_free);
+		do {
+			while (unlikely(free_list == POOL_BUSY)) {
+				__ha_cpu_relax();
+				free_list = _HA_ATOMIC_LOAD(&pool->arena_free);
+			}
+			_HA_ATOMIC_STORE(&item->next, free_list);
+			__ha_barrier_atomic_store();
+		} while (!_HA_ATOMIC_CAS(&pool->arena_free, &free_list, item));
+		return;
+	}
+
 	if (pool_debugging & POOL_DBG_UAF)
 		pool_free_area_uaf(ptr, pool->alloc_sz);
+	else if (unlikely(pool->mem_flags)) {
+		/* note: with jemalloc, dallocx() is also valid for areas that
+		 * were allocated with plain malloc() before the pool was bound
+		 * to its arena.
+		 */
+		will_free(ptr, pool->alloc_sz);
+		my_dallocx(ptr, pool->mem_flags);
+	}
 	else
 		pool_free_area(ptr, pool->alloc_sz);
 	_HA_ATOMIC_DEC(&pool->allocated);
@@ -400,6 +483,67 @@ void pool_free_nocache(struct pool_head *pool, void *ptr)
 	pool_put_to_os(pool, ptr);
 }
 
+/* granularity of a pool arena reservation: one huge page */
+#define POOL_ARENA_HUGE_SZ (2UL << 20)
+
+/* Reserves a huge-page backed arena able to hold at least <count> objects for
+ * pool <pool> and donates the carved objects to the pool's shared cache. The
+ * mapping is rounded up to a multiple of 2MB and fully carved, so slightly
+ * more objects than requested may be provided. Huge pages are first requested
+ * explicitly, and if none are reserved on the system, a regular mapping is
+ * used and the kernel is advised to promote it to transparent huge pages.
+ * Objects coming from the arena are never returned to the system:
+ * pool_put_to_os() recycles them via a dedicated free list instead. This may
+ * only be called once per pool, before any allocation is performed, and is
+ * incompatible with use-after-free protection which relies on the system
+ * allocator. Returns the number of objects donated, or 0 on failure.
+ */
+int pool_reserve_arena(struct pool_head *pool, uint count)
+{
+	void *area;
+	size_t size;
+	uint n, donated;
+
+	if (pool_debugging & (POOL_DBG_NO_CACHE|POOL_DBG_NO_GLOBAL|POOL_DBG_UAF))
+		return 0;
+
+	if (pool->arena_size || !count)
+		return 0;
+
+	size = (size_t)count * pool->alloc_sz;
+	size = (size + POOL_ARENA_HUGE_SZ - 1) & -POOL_ARENA_HUGE_SZ;
+
+	area = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	area = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+	if (area == MAP_FAILED) {
+		area = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (area == MAP_FAILED)
+			return 0;
+#ifdef MADV_HUGEPAGE
+		madvise(area, size, MADV_HUGEPAGE);
+#endif
+	}
+
+	pool->arena_addr = area;
+	pool->arena_size = size;
+
+	donated = size / pool->alloc_sz;
+	HA_ATOMIC_ADD(&pool->allocated, donated);
+	HA_ATOMIC_ADD(&pool->used, donated);
+	for (n = 0; n < donated; n++) {
+		struct pool_item *item = (struct pool_item *)((char *)area + (size_t)n * pool->alloc_sz);
+
+		item->next = NULL;
+		item->down = NULL;
+		pool_put_to_shared_cache(pool, item, 1);
+	}
+	return donated;
+}
+
 
 /* Updates <pch>'s fill_pattern and fills the free area after <item> with it,
  * up to <size> bytes. The item part is left untouched.
@@ -587,35 +731,59 @@ void pool_put_to_cache(struct pool_head *pool, void *ptr, const void *caller)
  * the cache has enough objects for its use. Must not be used when pools are
  * disabled.
  */
-void pool_refill_local_from_shared(struct pool_head *pool, struct pool_cache_head *pch)
+/* Tries to detach the first item cluster from the shared free list shard
+ * rooted at <root>. Returns the detached cluster or NULL if the shard is
+ * empty. The shard is temporarily locked using POOL_BUSY while the first
+ * element is dereferenced so that nobody allocates then releases it, which
+ * would make the dereference fail.
+ */
+static struct pool_item *pool_get_shard_cluster(struct pool_item **root)
 {
-	struct pool_cache_item *item;
-	struct pool_item *ret, *down;
-	uint count;
+	struct pool_item *ret;
 
-	BUG_ON(pool_debugging & POOL_DBG_NO_CACHE);
-
-	/* we'll need to reference the first element to figure the next one. We
-	 * must temporarily lock it so that nobody allocates then releases it,
-	 * or the dereference could fail.
-	 */
-	ret = _HA_ATOMIC_LOAD(&pool->free_list);
+	ret = _HA_ATOMIC_LOAD(root);
 	do {
 		while (unlikely(ret == POOL_BUSY)) {
 			__ha_cpu_relax();
-			ret = _HA_ATOMIC_LOAD(&pool->free_list);
+			ret = _HA_ATOMIC_LOAD(root);
 		}
 		if (ret == NULL)
-			return;
-	} while (unlikely((ret = _HA_ATOMIC_XCHG(&pool->free_list, POOL_BUSY)) == POOL_BUSY));
+			return NULL;
+	} while (unlikely((ret = _HA_ATOMIC_XCHG(root, POOL_BUSY)) == POOL_BUSY));
 
 	if (unlikely(ret == NULL)) {
-		HA_ATOMIC_STORE(&pool->free_list, NULL);
-		return;
+		HA_ATOMIC_STORE(root, NULL);
+		return NULL;
 	}
 
 	/* this releases the lock */
-	HA_ATOMIC_STORE(&pool->free_list, ret->next);
+	HA_ATOMIC_STORE(root, ret->next);
+	return ret;
+}
+
+void pool_refill_local_from_shared(struct pool_head *pool, struct pool_cache_head *pch)
+{
+	struct pool_cache_item *item;
+	struct pool_item *ret, *down;
+	uint count;
+	uint grp;
+
+	BUG_ON(pool_debugging & POOL_DBG_NO_CACHE);
+
+	/* start with the local group's shard and only fall back to the other
+	 * groups' ones when it's empty, so that under normal load the atomic
+	 * traffic remains confined to the group while objects released by
+	 * another group can still be reused.
+	 */
+	ret = pool_get_shard_cluster(&pool->free_list[tgid - 1]);
+	for (grp = 0; !ret && grp < MAX_TGROUPS; grp++) {
+		if (grp == tgid - 1)
+			continue;
+		ret = pool_get_shard_cluster(&pool->free_list[grp]);
+	}
+
+	if (!ret)
+		return;
 
 	/* now store the retrieved object(s) into the local cache */
 	count = 0;
@@ -635,6 +803,31 @@ void pool_refill_local_from_shared(struct pool_head *pool, struct pool_cache_hea
 	pool_cache_bytes += count * pool->size;
 }
 
+/* Ensures that the local cache of <pool> holds at least <count> objects,
+ * refilling it from the shared cache in cluster-sized chunks. No malloc() is
+ * ever attempted: if the shared cache runs dry, the cache is simply left with
+ * fewer objects and the regular allocation path will deal with the rest. This
+ * is meant to be called before a known burst of allocations (e.g. an accept
+ * loop) so that objects are pulled in bulk outside of the per-object critical
+ * path instead of one cluster at a time from within it.
+ */
+void pool_prewarm(struct pool_head *pool, uint count)
+{
+	struct pool_cache_head *pch;
+	uint prev;
+
+	if (unlikely(pool_debugging & (POOL_DBG_NO_CACHE|POOL_DBG_NO_GLOBAL)))
+		return;
+
+	pch = &pool->cache[tid];
+	while (pch->count < count) {
+		prev = pch->count;
+		pool_refill_local_from_shared(pool, pch);
+		if (pch->count == prev)
+			break;
+	}
+}
+
 /* Adds pool item cluster <item> to the shared cache, which contains <count>
  * elements. The caller is advised to first check using pool_releasable() if
  * it's wise to add this series of objects there. Both the pool and the item's
@@ -642,18 +835,19 @@ void pool_refill_local_from_shared(struct pool_head *pool, struct pool_cache_hea
  */
 void pool_put_to_shared_cache(struct pool_head *pool, struct pool_item *item, uint count)
 {
+	struct pool_item **root = &pool->free_list[tgid - 1];
 	struct pool_item *free_list;
 
 	_HA_ATOMIC_SUB(&pool->used, count);
-	free_list = _HA_ATOMIC_LOAD(&pool->free_list);
+	free_list = _HA_ATOMIC_LOAD(root);
 	do {
 		while (unlikely(free_list == POOL_BUSY)) {
 			__ha_cpu_relax();
-			free_list = _HA_ATOMIC_LOAD(&pool->free_list);
+			free_list = _HA_ATOMIC_LOAD(root);
 		}
 		_HA_ATOMIC_STORE(&item->next, free_list);
 		__ha_barrier_atomic_store();
-	} while (!_HA_ATOMIC_CAS(&pool->free_list, &free_list, item));
+	} while (!_HA_ATOMIC_CAS(root, &free_list, item));
 	__ha_barrier_atomic_store();
 	swrate_add_opportunistic(&pool->needed_avg, POOL_AVG_SAMPLES, pool->used);
 }
@@ -664,31 +858,40 @@ void pool_put_to_shared_cache(struct pool_head *pool, struct pool_item *item, ui
 void pool_flush(struct pool_head *pool)
 {
 	struct pool_item *next, *temp, *down;
+	uint grp;
 
 	if (!pool || (pool_debugging & (POOL_DBG_NO_CACHE|POOL_DBG_NO_GLOBAL)))
 		return;
 
-	/* The loop below atomically detaches the head of the free list and
+	/* The loop below atomically detaches the head of each shard and
 	 * replaces it with a NULL. Then the list can be released.
 	 */
-	next = pool->free_list;
-	do {
-		while (unlikely(next == POOL_BUSY)) {
-			__ha_cpu_relax();
-			next = _HA_ATOMIC_LOAD(&pool->free_list);
-		}
+	for (grp = 0; grp < MAX_TGROUPS; grp++) {
+		struct pool_item **root = &pool->free_list[grp];
+
+		next = *root;
+		do {
+			while (unlikely(next == POOL_BUSY)) {
+				__ha_cpu_relax();
+				next = _HA_ATOMIC_LOAD(root);
+			}
+			if (next == NULL)
+				break;
+		} while (unlikely((next = _HA_ATOMIC_XCHG(root, POOL_BUSY)) == POOL_BUSY));
+
 		if (next == NULL)
-			return;
-	} while (unlikely((next = _HA_ATOMIC_XCHG(&pool->free_list, POOL_BUSY)) == POOL_BUSY));
-	_HA_ATOMIC_STORE(&pool->free_list, NULL);
-	__ha_barrier_atomic_store();
+			continue;
 
-	while (next) {
-		temp = next;
-		next = temp->next;
-		for (; temp; temp = down) {
-			down = temp->down;
-			pool_put_to_os(pool, temp);
+		_HA_ATOMIC_STORE(root, NULL);
+		__ha_barrier_atomic_store();
+
+		while (next) {
+			temp = next;
+			next = temp->next;
+			for (; temp; temp = down) {
+				down = temp->down;
+				pool_put_to_os(pool, temp);
+			}
 		}
 	}
 	/* here, we should have pool->allocated == pool->used */
@@ -709,14 +912,17 @@ void pool_gc(struct pool_head *pool_ctx)
 
 	list_for_each_entry(entry, &pools, list) {
 		struct pool_item *temp, *down;
-
-		while (entry->free_list &&
-		       (int)(entry->allocated - entry->used) > (int)entry->minavail) {
-			temp = entry->free_list;
-			entry->free_list = temp->next;
-			for (; temp; temp = down) {
-				down = temp->down;
-				pool_put_to_os(entry, temp);
+		uint grp;
+
+		for (grp = 0; grp < MAX_TGROUPS; grp++) {
+			while (entry->free_list[grp] &&
+			       (int)(entry->allocated - entry->used) > (int)entry->minavail) {
+				temp = entry->free_list[grp];
+				entry->free_list[grp] = temp->next;
+				for (; temp; temp = down) {
+					down = temp->down;
+					pool_put_to_os(entry, temp);
+				}
 			}
 		}
 	}
@@ -727,6 +933,126 @@ void pool_gc(struct pool_head *pool_ctx)
 		thread_release();
 }
 
+/* how often the background trimming task wakes up, and how many clusters it
+ * may release per pool per wakeup. Small batches on a short period keep the
+ * overhead invisible while still draining a spike's worth of memory within
+ * minutes.
+ */
+#define MEM_TRIM_PERIOD   1000
+#define MEM_TRIM_BATCH    16
+
+/* Background memory trimming task, only started when "tune.memory.trim-slack"
+ * is set. It periodically walks the pools and releases whole clusters from
+ * the shared caches back to the OS when a pool keeps more spare objects than
+ * the configured slack percentage above its current usage, then asks the
+ * allocator to effectively return the memory to the system. Unlike pool_gc()
+ * it doesn't require thread isolation for the release itself, only small
+ * lock-free detachments, so it can run permanently at low priority.
+ */
+static struct task *mem_trim_process(struct task *t, void *context, unsigned int state)
+{
+	struct pool_head *entry;
+	uint released = 0;
+
+	list_for_each_entry(entry, &pools, list) {
+		struct pool_item *ret, *down;
+		uint used = HA_ATOMIC_LOAD(&entry->used);
+		uint alloc = HA_ATOMIC_LOAD(&entry->allocated);
+		uint target;
+		uint batch;
+		uint grp;
+
+		/* tolerated allocation level: the slack above the current
+		 * usage, never below the configured minimum nor below the
+		 * recent needs estimate, to avoid fighting the regular
+		 * release heuristics.
+		 */
+		target = used + (ullong)used * mem_trim_slack / 100;
+		target = MAX(target, entry->minavail);
+		target = MAX(target, swrate_avg(entry->needed_avg + entry->needed_avg / 4, POOL_AVG_SAMPLES));
+
+		batch = MEM_TRIM_BATCH;
+		grp = 0;
+		while (alloc > target && batch) {
+			ret = pool_get_shard_cluster(&entry->free_list[grp]);
+			if (!ret) {
+				if (++grp >= MAX_TGROUPS)
+					break;
+				continue;
+			}
+
+			for (; ret; ret = down) {
+				down = ret->down;
+				pool_put_to_os(entry, ret);
+				alloc--;
+				released++;
+			}
+			batch--;
+		}
+	}
+
+	if (released)
+		trim_all_pools();
+
+	t->expire = tick_add(now_ms, MEM_TRIM_PERIOD);
+	return t;
+}
+
+/* starts the background trimming task if configured. Returns ERR_NONE on
+ * success (including when disabled), otherwise a fatal error.
+ */
+static int mem_trim_start_task(void)
+{
+	struct task *t;
+
+	if (!mem_trim_slack)
+		return ERR_NONE;
+
+	t = task_new_anywhere();
+	if (!t) {
+		ha_alert("Cannot allocate the memory trimming task.\n");
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	t->process = mem_trim_process;
+	t->nice = 1024;
+	task_schedule(t, tick_add(now_ms, MEM_TRIM_PERIOD));
+	return ERR_NONE;
+}
+REGISTER_POST_CHECK(mem_trim_start_task);
+
+/* Binds each pool to a dedicated allocator arena if configured and supported.
+ * This isolates the fragmentation each pool causes and makes the memory of a
+ * given pool attributable to its arena in the allocator's statistics. Only
+ * jemalloc supports this for now. Areas allocated before this point keep
+ * being released correctly since dallocx() accepts any allocated pointer.
+ * Returns ERR_NONE on success (including when disabled), otherwise a warning.
+ */
+static int mem_bind_pool_arenas(void)
+{
+	struct pool_head *entry;
+	unsigned int arena;
+	size_t len = sizeof(arena);
+
+	if (!mem_pool_arenas)
+		return ERR_NONE;
+
+	if (!my_mallctl || !my_mallocx || !my_dallocx) {
+		ha_warning("'tune.memory.pool-arenas' is set but the allocator in use does not support arenas; ignoring.\n");
+		return ERR_WARN;
+	}
+
+	list_for_each_entry(entry, &pools, list) {
+		if (my_mallctl("arenas.create", &arena, &len, NULL, 0) != 0) {
+			ha_warning("Failed to create a dedicated arena for pool '%s'; keeping default allocation for the remaining pools.\n", entry->name);
+			return ERR_WARN;
+		}
+		entry->mem_flags = POOL_MALLOCX_ARENA(arena) | POOL_MALLOCX_TCACHE_NONE;
+	}
+	return ERR_NONE;
+}
+REGISTER_POST_CHECK(mem_bind_pool_arenas);
+
 /*
  * Returns a pointer to type <type> taken from the pool <pool_type> or
  * dynamically allocated. In the first case, <pool_type> is updated to point to
@@ -818,6 +1144,8 @@ void *pool_destroy(struct pool_head *pool)
 		pool->users--;
 		if (!pool->users) {
 			LIST_DELETE(&pool->list);
+			if (pool->arena_size)
+				munmap(pool->arena_addr, pool->arena_size);
 			/* note that if used == 0, the cache is empty */
 			free(pool->base_addr);
 		}
@@ -941,7 +1269,7 @@ void dump_pools_to_trash(int by_what, int max, const char *pfx)
 	for (i = 0; i < nbpools && i < max; i++) {
 		chunk_appendf(&trash, "  - Pool %s (%lu bytes) : %lu allocated (%lu bytes), %lu used"
 			      " (~%lu by thread caches)"
-			      ", needed_avg %lu, %lu failures, %u users, @%p%s\n",
+			      ", needed_avg %lu, %lu failures, %u users, @%p%s",
 		              pool_info[i].entry->name, (ulong)pool_info[i].entry->size,
 			      pool_info[i].alloc_items, pool_info[i].alloc_bytes,
 			      pool_info[i].used_items, pool_info[i].cached_items,
@@ -949,6 +1277,10 @@ void dump_pools_to_trash(int by_what, int max, const char *pfx)
 		              pool_info[i].entry->users, pool_info[i].entry,
 		              (pool_info[i].entry->flags & MEM_F_SHARED) ? " [SHARED]" : "");
 
+		if (pool_info[i].entry->mem_flags)
+			chunk_appendf(&trash, " [ARENA=%u]", (pool_info[i].entry->mem_flags >> 20) - 1);
+		chunk_appendf(&trash, "\n");
+
 		cached_bytes += pool_info[i].cached_items * (ulong)pool_info[i].entry->size;
 		allocated    += pool_info[i].alloc_items  * (ulong)pool_info[i].entry->size;
 		used         += pool_info[i].used_items   * (ulong)pool_info[i].entry->size;
@@ -959,6 +1291,51 @@ void dump_pools_to_trash(int by_what, int max, const char *pfx)
 		      ".\n",
 	              nbpools, allocated, used, cached_bytes
 		      );
+
+	/* append a process-wide view of the allocator so that fragmentation
+	 * and memory retained from the system remain observable from here.
+	 */
+	if (my_mallctl) {
+		size_t je_allocated, je_active, je_metadata, je_resident, je_retained;
+		uint64_t epoch = 1;
+		size_t len = sizeof(size_t);
+
+		/* the statistics are only refreshed when the epoch is bumped */
+		my_mallctl("epoch", NULL, NULL, &epoch, sizeof(epoch));
+
+		if (my_mallctl("stats.allocated", &je_allocated, &len, NULL, 0) == 0 &&
+		    my_mallctl("stats.active",    &je_active,    &len, NULL, 0) == 0 &&
+		    my_mallctl("stats.metadata",  &je_metadata,  &len, NULL, 0) == 0 &&
+		    my_mallctl("stats.resident",  &je_resident,  &len, NULL, 0) == 0 &&
+		    my_mallctl("stats.retained",  &je_retained,  &len, NULL, 0) == 0) {
+			chunk_appendf(&trash, "Allocator: jemalloc: %llu bytes allocated, %llu active (%llu%% page fill),"
+				      " %llu metadata, %llu resident, %llu retained from the system.\n",
+				      (ullong)je_allocated, (ullong)je_active,
+				      je_active ? (ullong)je_allocated * 100ULL / je_active : 0ULL,
+				      (ullong)je_metadata, (ullong)je_resident, (ullong)je_retained);
+		}
+	}
+	else if (my_mi_process_info) {
+		size_t mi_rss = 0, mi_peak_rss = 0, mi_commit = 0, mi_peak_commit = 0;
+
+		my_mi_process_info(NULL, NULL, NULL, &mi_rss, &mi_peak_rss, &mi_commit, &mi_peak_commit, NULL);
+		chunk_appendf(&trash, "Allocator: mimalloc: %llu bytes resident (peak %llu), %llu committed (peak %llu).\n",
+			      (ullong)mi_rss, (ullong)mi_peak_rss, (ullong)mi_commit, (ullong)mi_peak_commit);
+	}
+#if defined(HA_HAVE_MALLOC_TRIM)
+	else if (using_default_allocator) {
+#ifdef HA_HAVE_MALLINFO2
+		struct mallinfo2 mi = mallinfo2();
+#else
+		struct mallinfo mi = mallinfo();
+#endif
+		chunk_appendf(&trash, "Allocator: libc: %llu bytes heap, %llu in use, %llu free (%llu%% fragmentation),"
+			      " %llu mmapped, %llu trimmable.\n",
+			      (ullong)mi.arena, (ullong)mi.uordblks, (ullong)mi.fordblks,
+			      mi.arena ? (ullong)mi.fordblks * 100ULL / mi.arena : 0ULL,
+			      (ullong)mi.hblkhd, (ullong)mi.keepcost);
+	}
+#endif
 }
 
 /* Dump statistics on pools usage. */
@@ -1185,6 +1562,11 @@ static void pools_register_build_options(void)
 		memprintf(&ptr, "Support for malloc_trim() is enabled.");
 		hap_register_build_opts(ptr, 1);
 	}
+#if defined(USE_JEMALLOC)
+	hap_register_build_opts("Built with jemalloc as the memory allocator.", 0);
+#elif defined(USE_MIMALLOC)
+	hap_register_build_opts("Built with mimalloc as the memory allocator.", 0);
+#endif
 }
 INITCALL0(STG_REGISTER, pools_register_build_options);
 
@@ -1232,6 +1614,46 @@ static int mem_parse_global_hot_size(char **args, int section_type, struct proxy
 	return 0;
 }
 
+/* config parser for global "tune.memory.trim-slack" */
+static int mem_parse_global_trim_slack(char **args, int section_type, struct proxy *curpx,
+                                       const struct proxy *defpx, const char *file, int line,
+                                       char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (!*args[1]) {
+		memprintf(err, "'%s' expects a percentage of spare objects.", args[0]);
+		return -1;
+	}
+
+	mem_trim_slack = atoi(args[1]);
+	if (mem_trim_slack < 0) {
+		memprintf(err, "'%s' expects a positive percentage.", args[0]);
+		return -1;
+	}
+	return 0;
+}
+
+/* config parser for global "tune.memory.pool-arenas", accepts "on" or "off" */
+static int mem_parse_global_pool_arenas(char **args, int section_type, struct proxy *curpx,
+                                       const struct proxy *defpx, const char *file, int line,
+                                       char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		mem_pool_arenas = 1;
+	else if (strcmp(args[1], "off") == 0)
+		mem_pool_arenas = 0;
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
+}
+
 /* config parser for global "no-memory-trimming" */
 static int mem_parse_global_no_mem_trim(char **args, int section_type, struct proxy *curpx,
                                        const struct proxy *defpx, const char *file, int line,
@@ -1247,6 +1669,8 @@ static int mem_parse_global_no_mem_trim(char **args, int section_type, struct pr
 static struct cfg_kw_list mem_cfg_kws = {ILH, {
 	{ CFG_GLOBAL, "tune.fail-alloc", mem_parse_global_fail_alloc },
 	{ CFG_GLOBAL, "tune.memory.hot-size", mem_parse_global_hot_size },
+	{ CFG_GLOBAL, "tune.memory.trim-slack", mem_parse_global_trim_slack },
+	{ CFG_GLOBAL, "tune.memory.pool-arenas", mem_parse_global_pool_arenas },
 	{ CFG_GLOBAL, "no-memory-trimming", mem_parse_global_no_mem_trim },
 	{ 0, NULL, NULL }
 }};
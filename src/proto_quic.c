@@ -24,6 +24,14 @@
 #include <netinet/udp.h>
 #include <netinet/in.h>
 
+/* UDP_GRO appeared in linux 5.0 but may be missing from older libcs */
+#if defined(__linux__) && !defined(UDP_GRO)
+#define UDP_GRO 104
+#endif
+#ifndef SOL_UDP
+#define SOL_UDP IPPROTO_UDP
+#endif
+
 #include <import/ebtree-t.h>
 
 #include <haproxy/api.h>
@@ -662,6 +670,15 @@ static int quic_bind_listener(struct listener *listener, char *errmsg, int errle
 		break;
 	}
 
+#ifdef UDP_GRO
+	/* Let the kernel coalesce bursts of datagrams from a same flow into a
+	 * single receive: this considerably reduces the number of syscalls
+	 * under load. The segments are split back before being dispatched in
+	 * quic_lstnr_sock_fd_iocb(). Silently ignored by older kernels.
+	 */
+	setsockopt(fd, SOL_UDP, UDP_GRO, &one, sizeof(one));
+#endif
+
 	if (!quic_alloc_rxbufs_listener(listener)) {
 		msg = "could not initialize tx/rx rings";
 		err |= ERR_WARN;
@@ -24,6 +24,15 @@
 #include <netinet/tcp.h>
 #include <netinet/in.h>
 
+#if defined(SO_ATTACH_REUSEPORT_CBPF)
+#include <linux/filter.h>
+#endif
+
+/* TCPI_OPT_SYN_DATA is missing from some libcs even when TCP_INFO is there */
+#if defined(TCP_INFO) && !defined(TCPI_OPT_SYN_DATA)
+#define TCPI_OPT_SYN_DATA 32
+#endif
+
 #include <haproxy/api.h>
 #include <haproxy/arg.h>
 #include <haproxy/connection.h>
@@ -492,6 +501,12 @@ int tcp_connect_server(struct connection *conn, int flags)
 	if (use_fastopen) {
 #if defined(TCP_FASTOPEN_CONNECT)
                 setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &one, sizeof(one));
+		/* remember the attempt so that its outcome may be checked and
+		 * accounted once the connection is established.
+		 */
+		conn->flags |= CO_FL_FASTOPEN;
+		_HA_ATOMIC_INC(&srv->counters.connect_tfo);
+		_HA_ATOMIC_INC(&be->be_counters.connect_tfo);
 #endif
 	}
 	if (global.tune.server_sndbuf)
@@ -564,6 +579,38 @@ int tcp_connect_server(struct connection *conn, int flags)
 	return SF_ERR_NONE;  /* connection is OK */
 }
 
+/* Reports the outcome of a TCP Fast Open attempt once connection <conn> is
+ * established, and clears CO_FL_FASTOPEN. When the kernel had no valid cookie
+ * for the destination (first contact, expired cookie, or SYN data stripped by
+ * a middlebox), it transparently downgrades to a regular handshake; this is
+ * accounted in the server's connect_tfo_fall counter so that the
+ * effectiveness of the "tfo" option may be monitored. No attempt is made to
+ * disable the option from here: per-destination fallback is already handled
+ * by the kernel's cookie cache.
+ */
+void tcp_fastopen_report(struct connection *conn)
+{
+	conn->flags &= ~CO_FL_FASTOPEN;
+#if defined(TCP_FASTOPEN_CONNECT) && defined(TCP_INFO)
+	{
+		struct server *srv = objt_server(conn->target);
+		struct tcp_info info;
+		socklen_t optlen = sizeof(info);
+
+		if (!srv || (conn->flags & CO_FL_FDLESS))
+			return;
+
+		if (getsockopt(conn->handle.fd, IPPROTO_TCP, TCP_INFO, &info, &optlen) == -1)
+			return;
+
+		if (!(info.tcpi_options & TCPI_OPT_SYN_DATA)) {
+			_HA_ATOMIC_INC(&srv->counters.connect_tfo_fall);
+			_HA_ATOMIC_INC(&srv->proxy->be_counters.connect_tfo_fall);
+		}
+	}
+#endif
+}
+
 /* This function tries to bind a TCPv4/v6 listener. It may return a warning or
  * an error message in <errmsg> if the message is at most <errlen> bytes long
  * (including '\0'). Note that <errmsg> may be NULL if <errlen> is also zero.
@@ -748,6 +795,34 @@ int tcp_bind_listener(struct listener *listener, char *errmsg, int errlen)
  */
 static void tcp_enable_listener(struct listener *l)
 {
+#if defined(SO_ATTACH_REUSEPORT_CBPF)
+	if (l->bind_conf->options & BC_O_STEER_CPU) {
+		/* Attach a classic BPF program steering each incoming
+		 * connection to the reuseport socket whose index matches the
+		 * CPU the SYN was received on, modulo the number of shards.
+		 * Sockets join the reuseport group in bind order, i.e. in
+		 * shard order, so with the threads of each shard pinned to
+		 * the CPUs receiving its flows (cpu-map + RSS), a connection
+		 * is accepted on the thread group of the CPU that will keep
+		 * processing its packets, instead of on a random shard. This
+		 * must be done here and not at bind time: the kernel refuses
+		 * to let a new socket join a TCP reuseport group once a
+		 * program is attached to it, while at enable time all shards
+		 * are already listening. The program applies to the whole
+		 * group, so re-attaching it for each shard is harmless.
+		 */
+		struct sock_filter steer[] = {
+			{ BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },
+			{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, l->bind_conf->settings.shards },
+			{ BPF_RET | BPF_A, 0, 0, 0 },
+		};
+		struct sock_fprog prog = { .len = sizeof(steer) / sizeof(steer[0]), .filter = steer };
+
+		if (setsockopt(l->rx.fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == -1)
+			ha_warning("Cannot attach cpu steering program to 'bind %s' at [%s:%d] : %s.\n",
+			           l->bind_conf->arg, l->bind_conf->file, l->bind_conf->line, strerror(errno));
+	}
+#endif
 	fd_want_recv_safe(l->rx.fd);
 }
 
@@ -25,6 +25,7 @@
 #include <haproxy/capture-t.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/cli.h>
+#include <haproxy/counters.h>
 #include <haproxy/errors.h>
 #include <haproxy/fd.h>
 #include <haproxy/filters.h>
@@ -32,6 +33,7 @@
 #include <haproxy/http_ana.h>
 #include <haproxy/http_htx.h>
 #include <haproxy/http_ext.h>
+#include <haproxy/lb_p2c.h>
 #include <haproxy/listener.h>
 #include <haproxy/log.h>
 #include <haproxy/obj_type-t.h>
@@ -60,12 +62,13 @@ struct eb_root proxy_by_name = EB_ROOT; /* tree of proxies sorted by name */
 struct eb_root defproxy_by_name = EB_ROOT; /* tree of default proxies sorted by name (dups possible) */
 unsigned int error_snapshot_id = 0;     /* global ID assigned to each error then incremented */
 
-/* CLI context used during "show servers {state|conn}" */
+/* CLI context used during "show servers {state|conn|timings}" */
 struct show_srv_ctx {
 	struct proxy *px;       /* current proxy to dump or NULL */
 	struct server *sv;      /* current server to dump or NULL */
 	uint only_pxid;         /* dump only this proxy ID when explicit */
-	int show_conn;          /* non-zero = "conn" otherwise "state" */
+	int show_conn;          /* 1 = "conn", 2 = "timings", otherwise "state" */
+	int bk_dumped;          /* non-zero once the backend's own line was dumped */
 	enum {
 		SHOW_SRV_HEAD = 0,
 		SHOW_SRV_LIST,
@@ -84,6 +87,7 @@ const struct cfg_opt cfg_opts[] =
 	{ "http-buffer-request", PR_O_WREQ_BODY,  PR_CAP_FE | PR_CAP_BE, 0, PR_MODE_HTTP },
 	{ "http-ignore-probes", PR_O_IGNORE_PRB, PR_CAP_FE, 0, PR_MODE_HTTP },
 	{ "idle-close-on-response", PR_O_IDLE_CLOSE_RESP, PR_CAP_FE, 0, PR_MODE_HTTP },
+	{ "idle-conn-locality", PR_O_REUSE_LOCAL, PR_CAP_BE, 0, 0 },
 	{ "prefer-last-server", PR_O_PREF_LAST,  PR_CAP_BE, 0, PR_MODE_HTTP },
 	{ "logasap",      PR_O_LOGASAP,    PR_CAP_FE, 0, 0 },
 	{ "nolinger",     PR_O_TCP_NOLING, PR_CAP_FE | PR_CAP_BE, 0, 0 },
@@ -112,6 +116,7 @@ const struct cfg_opt cfg_opts2[] =
 #endif
 	{ "accept-invalid-http-request",  PR_O2_REQBUG_OK, PR_CAP_FE, 0, PR_MODE_HTTP },
 	{ "accept-invalid-http-response", PR_O2_RSPBUG_OK, PR_CAP_BE, 0, PR_MODE_HTTP },
+	{ "binary-log",                   PR_O2_BINLOG,    PR_CAP_FE, 0, 0 },
 	{ "dontlog-normal",               PR_O2_NOLOGNORM, PR_CAP_FE, 0, 0 },
 	{ "log-separate-errors",          PR_O2_LOGERRORS, PR_CAP_FE, 0, 0 },
 	{ "log-health-checks",            PR_O2_LOGHCHKS,  PR_CAP_BE, 0, 0 },
@@ -187,8 +192,12 @@ void free_proxy(struct proxy *p)
 	free(p->conf.uniqueid_format_string);
 	istfree(&p->header_unique_id);
 	free(p->conf.uif_file);
-	if ((p->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_MAP)
+	if ((p->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_MAP) {
 		free(p->lbprm.map.srv);
+		free(p->lbprm.map.pick);
+	}
+	else if ((p->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_P2CMAP)
+		p2c_deinit_server_map(p);
 
 	if (p->conf.logformat_sd_string != default_rfc5424_sd_log_format)
 		free(p->conf.logformat_sd_string);
@@ -892,6 +901,36 @@ proxy_parse_retry_on(char **args, int section, struct proxy *curpx,
 	return 0;
 }
 
+/* This function parses a "retry-budget" statement */
+static int
+proxy_parse_retry_budget(char **args, int section, struct proxy *curpx,
+                         const struct proxy *defpx, const char *file, int line,
+                         char **err)
+{
+	char *res;
+	unsigned int budget;
+
+	if (!(*args[1])) {
+		memprintf(err, "'%s' expects a percentage of the session rate", args[0]);
+		return -1;
+	}
+	if (!(curpx->cap & PR_CAP_BE)) {
+		memprintf(err, "'%s' only available in backend or listen section", args[0]);
+		return -1;
+	}
+
+	budget = strtol(args[1], &res, 0);
+	if (*res == '%')
+		res++;
+	if (*res) {
+		memprintf(err, "'%s' : unexpected character '%c' in value '%s'", args[0], *res, args[1]);
+		return -1;
+	}
+
+	curpx->retry_budget = budget;
+	return 0;
+}
+
 #ifdef TCP_KEEPCNT
 /* This function parses "{cli|srv}tcpka-cnt" statements */
 static int proxy_parse_tcpka_cnt(char **args, int section, struct proxy *proxy,
@@ -1644,6 +1683,7 @@ static int proxy_defproxy_cpy(struct proxy *curproxy, const struct proxy *defpro
 	curproxy->no_options = defproxy->no_options;
 	curproxy->no_options2 = defproxy->no_options2;
 	curproxy->retry_type = defproxy->retry_type;
+	curproxy->retry_budget = defproxy->retry_budget;
 	curproxy->tcp_req.inspect_delay = defproxy->tcp_req.inspect_delay;
 	curproxy->tcp_rep.inspect_delay = defproxy->tcp_rep.inspect_delay;
 
@@ -2639,6 +2679,7 @@ static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_LISTEN, "max-keep-alive-queue", proxy_parse_max_ka_queue },
 	{ CFG_LISTEN, "declare", proxy_parse_declare },
 	{ CFG_LISTEN, "retry-on", proxy_parse_retry_on },
+	{ CFG_LISTEN, "retry-budget", proxy_parse_retry_budget },
 #ifdef TCP_KEEPCNT
 	{ CFG_LISTEN, "clitcpka-cnt", proxy_parse_tcpka_cnt },
 	{ CFG_LISTEN, "srvtcpka-cnt", proxy_parse_tcpka_cnt },
@@ -2699,17 +2740,20 @@ struct proxy *cli_find_backend(struct appctx *appctx, const char *arg)
 }
 
 
-/* parse a "show servers [state|conn]" CLI line, returns 0 if it wants to start
- * the dump or 1 if it stops immediately. If an argument is specified, it will
- * reserve a show_srv_ctx context and set the proxy pointer into ->px, its ID
- * into ->only_pxid, and ->show_conn to 0 for "state", or 1 for "conn".
+/* parse a "show servers [state|conn|timings]" CLI line, returns 0 if it wants
+ * to start the dump or 1 if it stops immediately. If an argument is specified,
+ * it will reserve a show_srv_ctx context and set the proxy pointer into ->px,
+ * its ID into ->only_pxid, and ->show_conn to 0 for "state", 1 for "conn" or
+ * 2 for "timings".
  */
 static int cli_parse_show_servers(char **args, char *payload, struct appctx *appctx, void *private)
 {
 	struct show_srv_ctx *ctx = applet_reserve_svcctx(appctx, sizeof(*ctx));
 	struct proxy *px;
 
-	ctx->show_conn = *args[2] == 'c'; // "conn" vs "state"
+	ctx->show_conn = (*args[2] == 'c') ? 1 :   // "conn"
+	                 (*args[2] == 't') ? 2 :   // "timings"
+	                 0;                        // "state"
 
 	/* check if a backend name has been provided */
 	if (*args[3]) {
@@ -2740,6 +2784,32 @@ static void dump_server_addr(const struct sockaddr_storage *addr, char *addr_str
 	}
 }
 
+/* Appends to the trash one line per time histogram (ttime/ctime/dtime) of
+ * counters <c>, prefixed with "<pxname>/<name>". Only the non-empty buckets
+ * are dumped, as "<upper-bound-ms>:<count>" pairs. The last bucket also
+ * collects all the times above its nominal bound.
+ */
+static void dump_server_timings(struct appctx *appctx, const struct proxy *px,
+                                const char *name, const struct be_counters *c)
+{
+	static const char *const tm_names[] = { "ttime", "ctime", "dtime" };
+	const unsigned int *hist;
+	unsigned int idx, cnt, m;
+
+	for (m = 0; m < 3; m++) {
+		hist = (m == 0) ? c->ttime_hist :
+		       (m == 1) ? c->ctime_hist :
+		                  c->dtime_hist;
+		chunk_appendf(&trash, "%s/%s %s", HA_ANON_CLI(px->id), HA_ANON_CLI(name), tm_names[m]);
+		for (idx = 0; idx < TIME_HIST_BUCKETS; idx++) {
+			cnt = HA_ATOMIC_LOAD(&hist[idx]);
+			if (cnt)
+				chunk_appendf(&trash, " %u:%u", tm_hist_bound(idx), cnt);
+		}
+		chunk_appendf(&trash, "\n");
+	}
+}
+
 /* dumps server state information for all the servers found in backend cli.p0.
  * These information are all the parameters which may change during HAProxy runtime.
  * By default, we only export to the last known server state file format. These
@@ -2761,6 +2831,15 @@ static int dump_servers_state(struct stconn *sc)
 	int bk_f_forced_id, srv_f_forced_id;
 	char *srvrecord;
 
+	if (ctx->show_conn == 2 && !ctx->bk_dumped) {
+		/* dump the backend's own aggregated histograms first */
+		chunk_reset(&trash);
+		dump_server_timings(appctx, px, "BACKEND", &px->be_counters);
+		if (applet_putchk(appctx, &trash) == -1)
+			return 0;
+		ctx->bk_dumped = 1;
+	}
+
 	if (!ctx->sv)
 		ctx->sv = px->srv;
 
@@ -2801,6 +2880,10 @@ static int dump_servers_state(struct stconn *sc)
 				     srv->hostname ? HA_ANON_CLI(srv->hostname) : "-", srv->svc_port,
 			             srvrecord ? srvrecord : "-", srv->use_ssl, srv->check.port,
 				     srv_check_addr, srv_agent_addr, srv->agent.port);
+		} else if (ctx->show_conn == 2) {
+			/* show servers timings */
+			chunk_reset(&trash);
+			dump_server_timings(appctx, px, srv->id, &srv->counters);
 		} else {
 			/* show servers conn */
 			int thr;
@@ -2823,6 +2906,7 @@ static int dump_servers_state(struct stconn *sc)
 			return 0;
 		}
 	}
+	ctx->bk_dumped = 0;
 	return 1;
 }
 
@@ -2839,6 +2923,9 @@ static int cli_io_handler_servers_state(struct appctx *appctx)
 	if (ctx->state == SHOW_SRV_HEAD) {
 		if (ctx->show_conn == 0)
 			chunk_printf(&trash, "%d\n# %s\n", SRV_STATE_FILE_VERSION, SRV_STATE_FILE_FIELD_NAMES);
+		else if (ctx->show_conn == 2)
+			chunk_printf(&trash,
+			             "# bkname/svname [ttime|ctime|dtime] <upper-bound-ms>:<count>...\n");
 		else
 			chunk_printf(&trash,
 			             "# bkname/svname bkid/svid addr port - purge_delay used_cur used_max need_est unsafe_nb safe_nb idle_lim idle_cur idle_per_thr[%d]\n",
@@ -3352,6 +3439,7 @@ static struct cli_kw_list cli_kws = {{ },{
 	{ { "set", "maxconn", "frontend",  NULL },          "set maxconn frontend <frontend> <value> : change a frontend's maxconn setting",                            cli_parse_set_maxconn_frontend, NULL },
 	{ { "show","servers", "conn",  NULL },              "show servers conn [<backend>]           : dump server connections status (all or for a single backend)",   cli_parse_show_servers, cli_io_handler_servers_state },
 	{ { "show","servers", "state",  NULL },             "show servers state [<backend>]          : dump volatile server information (all or for a single backend)", cli_parse_show_servers, cli_io_handler_servers_state },
+	{ { "show","servers", "timings",  NULL },           "show servers timings [<backend>]        : dump time histograms of backends and their servers",             cli_parse_show_servers, cli_io_handler_servers_state },
 	{ { "show", "backend", NULL },                      "show backend                            : list backends in the current running config", NULL,              cli_io_handler_show_backend },
 	{ { "shutdown", "frontend",  NULL },                "shutdown frontend <frontend>            : stop a specific frontend",                                       cli_parse_shutdown_frontend, NULL, NULL },
 	{ { "set", "dynamic-cookie-key", "backend", NULL }, "set dynamic-cookie-key backend <bk> <k> : change a backend secret key for dynamic cookies",                cli_parse_set_dyncookie_key_backend, NULL },
@@ -398,23 +398,17 @@ int qpack_decode_fs(const unsigned char *raw, uint64_t len, struct buffer *tmp,
 
 			qpack_debug_printf(stderr, " h=%d length=%llu", !!h, (unsigned long long)length);
 			if (h) {
-				char *trash;
+				char *trash = b_tail(tmp);
 				int nlen;
 
-				trash = chunk_newstr(tmp);
-				if (!trash) {
-					qpack_debug_printf(stderr, "##ERR@%d\n", __LINE__);
-					ret = -QPACK_DECOMPRESSION_FAILED;
-					goto out;
-				}
-				nlen = huff_dec(raw, length, trash, tmp->size - tmp->data);
+				nlen = huff_dec(raw, length, trash, b_room(tmp));
 				if (nlen == (uint32_t)-1) {
 					qpack_debug_printf(stderr, " can't decode huffman.\n");
 					ret = -QPACK_ERR_HUFFMAN;
 					goto out;
 				}
 
-				qpack_debug_printf(stderr, " [name huff %d->%d '%s']", (int)length, (int)nlen, trash);
+				qpack_debug_printf(stderr, " [name huff %d->%d]", (int)length, (int)nlen);
 				/* makes an ist from tmp storage */
 				b_add(tmp, nlen);
 				value = ist2(trash, nlen);
@@ -457,23 +451,17 @@ int qpack_decode_fs(const unsigned char *raw, uint64_t len, struct buffer *tmp,
 			}
 
 			if (hname) {
-				char *trash;
+				char *trash = b_tail(tmp);
 				int nlen;
 
-				trash = chunk_newstr(tmp);
-				if (!trash) {
-					qpack_debug_printf(stderr, "##ERR@%d\n", __LINE__);
-					ret = -QPACK_DECOMPRESSION_FAILED;
-					goto out;
-				}
-				nlen = huff_dec(raw, name_len, trash, tmp->size - tmp->data);
+				nlen = huff_dec(raw, name_len, trash, b_room(tmp));
 				if (nlen == (uint32_t)-1) {
 					qpack_debug_printf(stderr, " can't decode huffman.\n");
 					ret = -QPACK_ERR_HUFFMAN;
 					goto out;
 				}
 
-				qpack_debug_printf(stderr, " [name huff %d->%d '%s']", (int)name_len, (int)nlen, trash);
+				qpack_debug_printf(stderr, " [name huff %d->%d]", (int)name_len, (int)nlen);
 				/* makes an ist from tmp storage */
 				b_add(tmp, nlen);
 				name = ist2(trash, nlen);
@@ -502,23 +490,17 @@ int qpack_decode_fs(const unsigned char *raw, uint64_t len, struct buffer *tmp,
 			}
 
 			if (hvalue) {
-				char *trash;
+				char *trash = b_tail(tmp);
 				int nlen;
 
-				trash = chunk_newstr(tmp);
-				if (!trash) {
-					qpack_debug_printf(stderr, "##ERR@%d\n", __LINE__);
-					ret = -QPACK_DECOMPRESSION_FAILED;
-					goto out;
-				}
-				nlen = huff_dec(raw, value_len, trash, tmp->size - tmp->data);
+				nlen = huff_dec(raw, value_len, trash, b_room(tmp));
 				if (nlen == (uint32_t)-1) {
 					qpack_debug_printf(stderr, " can't decode huffman.\n");
 					ret = -QPACK_ERR_HUFFMAN;
 					goto out;
 				}
 
-				qpack_debug_printf(stderr, " [name huff %d->%d '%s']", (int)value_len, (int)nlen, trash);
+				qpack_debug_printf(stderr, " [name huff %d->%d]", (int)value_len, (int)nlen);
 				/* makes an ist from tmp storage */
 				b_add(tmp, nlen);
 				value = ist2(trash, nlen);
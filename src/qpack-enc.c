@@ -2,6 +2,7 @@
 
 #include <haproxy/buf.h>
 #include <haproxy/intops.h>
+#include <haproxy/qpack-tbl.h>
 
 /* Returns the byte size required to encode <i> as a <prefix_size>-prefix
  * integer.
@@ -150,28 +151,94 @@ int qpack_encode_field_section_line(struct buffer *out)
 
 #define QPACK_LFL_WLN_BIT  0x20 // Literal field line with literal name
 
-/* Encode a header in literal field line with literal name.
+/* Lookup <n>/<v> in the QPACK static table. The name comparison is
+ * case-insensitive as HTX may convey the original H1 field name case while
+ * the table only stores lowercase names. On name match, the index of the
+ * first matching entry is stored in <name_idx>. Returns the index of an
+ * entry matching both the name and the value, or -1 if none was found.
+ */
+static int qpack_stbl_lookup(const struct ist n, const struct ist v,
+                             int *name_idx)
+{
+	int i;
+
+	*name_idx = -1;
+	for (i = 0; i < QPACK_SHT_SIZE; ++i) {
+		if (qpack_sht[i].n.len != n.len || !isteqi(qpack_sht[i].n, n))
+			continue;
+
+		if (*name_idx < 0)
+			*name_idx = i;
+
+		if (isteq(qpack_sht[i].v, v))
+			return i;
+	}
+
+	return -1;
+}
+
+/* Encode a header, preferring the shortest representation allowed by the
+ * QPACK static table: indexed field line if both the name and the value are
+ * present in it, literal field line with name reference if only the name is,
+ * literal field line with literal name otherwise.
+ *
+ * Note that the encoder never references nor feeds a dynamic table, which is
+ * consistent with the null SETTINGS_QPACK_MAX_TABLE_CAPACITY we advertise for
+ * the other direction. Encoding into a dynamic table requires a local unidir
+ * encoder stream to convey the insertions, bookkeeping of the entries the
+ * peer acknowledged on its decoder stream, and a blocked-streams budget
+ * honoring the peer's SETTINGS_QPACK_BLOCKED_STREAMS, all of which live at
+ * the H3 layer, not here. In addition a HEADERS frame may be dropped and
+ * re-encoded by the caller when the output buffer lacks room, so insertions
+ * could not be performed before the frame is known to leave anyway.
+ *
  * Returns 0 on success else non-zero.
  */
 int qpack_encode_header(struct buffer *out, const struct ist n, const struct ist v)
 {
-	int i;
-	size_t sz = qpack_get_prefix_int_size(n.len, 3) + n.len +
-	            qpack_get_prefix_int_size(v.len, 7) + v.len;
+	int i, idx, name_idx;
+	size_t sz;
 
-	if (sz > b_room(out))
-		return 1;
+	idx = qpack_stbl_lookup(n, v, &name_idx);
+	if (idx >= 0) {
+		/* indexed field line with static table reference
+		 * | 1 | T=1 | . | . | . | . | . | . |
+		 */
+		if (qpack_get_prefix_int_size(idx, 6) > b_room(out))
+			return 1;
 
-	/* literal field line with literal name
-	 * | 0 | 0 | 1 | N | H | . | . | . |
-	 * N :(allow an intermediary to add the header in a dynamic table)
-	 * H: huffman encoded
-	 * name len
-	 */
-	qpack_encode_prefix_integer(out, n.len, 3, QPACK_LFL_WLN_BIT);
-	/* name */
-	for (i = 0; i < n.len; ++i)
-		b_putchr(out, n.ptr[i]);
+		qpack_encode_prefix_integer(out, idx, 6, 0xc0);
+		return 0;
+	}
+
+	if (name_idx >= 0) {
+		/* literal field line with static name reference
+		 * | 0 | 1 | N | T=1 | . | . | . | . |
+		 */
+		sz = qpack_get_prefix_int_size(name_idx, 4) +
+		     qpack_get_prefix_int_size(v.len, 7) + v.len;
+		if (sz > b_room(out))
+			return 1;
+
+		qpack_encode_prefix_integer(out, name_idx, 4, 0x50);
+	}
+	else {
+		sz = qpack_get_prefix_int_size(n.len, 3) + n.len +
+		     qpack_get_prefix_int_size(v.len, 7) + v.len;
+		if (sz > b_room(out))
+			return 1;
+
+		/* literal field line with literal name
+		 * | 0 | 0 | 1 | N | H | . | . | . |
+		 * N :(allow an intermediary to add the header in a dynamic table)
+		 * H: huffman encoded
+		 * name len
+		 */
+		qpack_encode_prefix_integer(out, n.len, 3, QPACK_LFL_WLN_BIT);
+		/* name */
+		for (i = 0; i < n.len; ++i)
+			b_putchr(out, n.ptr[i]);
+	}
 
 	/* | 0 | . | . | . | . | . | . | . |
 	 * value len
@@ -18,6 +18,14 @@
  *   - linked into the server's queue ;
  *   - linked into the proxy's queue.
  *
+ * The server's queue is sharded per thread group : there is one struct queue
+ * per thread group in srv->per_tgrp[], each with its own lock, and a pendconn
+ * is always added to the shard of the thread group of the thread which queued
+ * it. This way threads of different groups never compete for the same lock on
+ * the addition path. "The server's queue" below designates the shard the
+ * pendconn belongs to. The proxy's queue is not sharded. srv->queue_length
+ * always reflects the total number of entries in all of the server's shards.
+ *
  * A stream does not necessarily have such a pendconn. Thus the pendconn is
  * designated by the stream->pend_pos pointer. This results in some properties :
  *   - pendconn->strm->pend_pos is never NULL for any valid pendconn
@@ -197,8 +205,10 @@ void pendconn_unlink(struct pendconn *p)
 
 	if (done) {
 		oldidx -= p->queue_idx;
-		if (sv)
+		if (sv) {
 			p->strm->logs.srv_queue_pos += oldidx;
+			_HA_ATOMIC_DEC(&sv->queue_length);
+		}
 		else
 			p->strm->logs.prx_queue_pos += oldidx;
 
@@ -249,20 +259,20 @@ static struct pendconn *pendconn_first(struct eb_root *pendconns)
  *
  * The proxy's queue will be consulted only if px_ok is non-zero.
  *
- * This function must only be called if the server queue is locked _AND_ the
- * proxy queue is not. Today it is only called by process_srv_queue.
+ * This function must only be called if the server queue shard <q> is locked
+ * _AND_ the proxy queue is not. Today it is only called by process_srv_queue.
  * When a pending connection is dequeued, this function returns 1 if a pendconn
  * is dequeued, otherwise 0.
  */
-static int pendconn_process_next_strm(struct server *srv, struct proxy *px, int px_ok)
+static int pendconn_process_next_strm(struct server *srv, struct queue *q, struct proxy *px, int px_ok)
 {
 	struct pendconn *p = NULL;
 	struct pendconn *pp = NULL;
 	u32 pkey, ppkey;
 
 	p = NULL;
-	if (srv->queue.length)
-		p = pendconn_first(&srv->queue.head);
+	if (q->length)
+		p = pendconn_first(&q->head);
 
 	pp = NULL;
 	if (px_ok && px->queue.length) {
@@ -346,22 +356,27 @@ static int pendconn_process_next_strm(struct server *srv, struct proxy *px, int
 	task_wakeup(p->strm->task, TASK_WOKEN_RES);
 	__pendconn_unlink_srv(p);
 
-	_HA_ATOMIC_DEC(&srv->queue.length);
-	_HA_ATOMIC_INC(&srv->queue.idx);
+	_HA_ATOMIC_DEC(&q->length);
+	_HA_ATOMIC_DEC(&srv->queue_length);
+	_HA_ATOMIC_INC(&q->idx);
 	return 1;
 }
 
 /* Manages a server's connection queue. This function will try to dequeue as
- * many pending streams as possible, and wake them up.
+ * many pending streams as possible, and wake them up. The shard of the local
+ * thread group is served first so that freed slots preferably benefit local
+ * streams, then the other groups' shards are visited in turn.
  */
 void process_srv_queue(struct server *s)
 {
 	struct server *ref = s->track ? s->track : s;
 	struct proxy  *p = s->proxy;
+	struct queue *q;
 	int maxconn;
-	int stop = 0;
+	int stop;
 	int done = 0;
 	int px_ok;
+	int grp;
 
 	/* if a server is not usable or backup and must not be used
 	 * to dequeue backend requests.
@@ -371,30 +386,42 @@ void process_srv_queue(struct server *s)
 	         (!p->srv_act &&
 	          (s == p->lbprm.fbck || (p->options & PR_O_USE_ALL_BK))));
 
-	/* let's repeat that under the lock on each round. Threads competing
-	 * for the same server will give up, knowing that at least one of
-	 * them will check the conditions again before quitting. In order
-	 * to avoid the deadly situation where one thread spends its time
-	 * dequeueing for others, we limit the number of rounds it does.
-	 * However we still re-enter the loop for one pass if there's no
-	 * more served, otherwise we could end up with no other thread
-	 * trying to dequeue them.
-	 */
-	while (!stop && (done < global.tune.maxpollevents || !s->served) &&
-	       s->served < (maxconn = srv_dynamic_maxconn(s))) {
-		if (HA_SPIN_TRYLOCK(QUEUE_LOCK, &s->queue.lock) != 0)
-			break;
-
-		while (s->served < maxconn) {
-			stop = !pendconn_process_next_strm(s, p, px_ok);
-			if (stop)
-				break;
-			_HA_ATOMIC_INC(&s->served);
-			done++;
-			if (done >= global.tune.maxpollevents)
+	for (grp = 0; grp < global.nbtgroups; grp++) {
+		q = &s->per_tgrp[(grp + tgid - 1) % global.nbtgroups].queue;
+		stop = 0;
+
+		/* let's repeat that under the lock on each round. Threads
+		 * competing for the same shard will give up, knowing that at
+		 * least one of them will check the conditions again before
+		 * quitting. In order to avoid the deadly situation where one
+		 * thread spends its time dequeueing for others, we limit the
+		 * number of rounds it does. However we still re-enter the
+		 * loop for one pass if there's no more served, otherwise we
+		 * could end up with no other thread trying to dequeue them.
+		 */
+		while (!stop && (done < global.tune.maxpollevents || !s->served) &&
+		       s->served < (maxconn = srv_dynamic_maxconn(s))) {
+			if (HA_SPIN_TRYLOCK(QUEUE_LOCK, &q->lock) != 0) {
+				/* another thread is already dequeueing this
+				 * shard, let's visit the next one.
+				 */
 				break;
+			}
+
+			while (s->served < maxconn) {
+				stop = !pendconn_process_next_strm(s, q, p, px_ok);
+				if (stop)
+					break;
+				_HA_ATOMIC_INC(&s->served);
+				done++;
+				if (done >= global.tune.maxpollevents)
+					break;
+			}
+			HA_SPIN_UNLOCK(QUEUE_LOCK, &q->lock);
 		}
-		HA_SPIN_UNLOCK(QUEUE_LOCK, &s->queue.lock);
+
+		if (done >= global.tune.maxpollevents && s->served)
+			break;
 	}
 
 	if (done) {
@@ -452,7 +479,8 @@ struct pendconn *pendconn_add(struct stream *strm)
 		srv = NULL;
 
 	if (srv) {
-		q = &srv->queue;
+		/* queue to the shard of the local thread group */
+		q = &srv->per_tgrp[tgid - 1].queue;
 		max_ptr = &srv->counters.nbpend_max;
 	}
 	else {
@@ -463,6 +491,8 @@ struct pendconn *pendconn_add(struct stream *strm)
 	p->queue = q;
 	p->queue_idx  = _HA_ATOMIC_LOAD(&q->idx) - 1; // for logging only
 	new_max = _HA_ATOMIC_ADD_FETCH(&q->length, 1);
+	if (srv)
+		new_max = _HA_ATOMIC_ADD_FETCH(&srv->queue_length, 1);
 	old_max = _HA_ATOMIC_LOAD(max_ptr);
 	while (new_max > old_max) {
 		if (likely(_HA_ATOMIC_CAS(max_ptr, &old_max, new_max)))
@@ -479,39 +509,52 @@ struct pendconn *pendconn_add(struct stream *strm)
 }
 
 /* Redistribute pending connections when a server goes down. The number of
- * connections redistributed is returned. It will take the server queue lock
- * and does not use nor depend on other locks.
+ * connections redistributed is returned. It will take each of the server's
+ * queue shard locks in turn and does not use nor depend on other locks.
  */
 int pendconn_redistribute(struct server *s)
 {
 	struct pendconn *p;
 	struct eb32_node *node, *nodeb;
+	struct queue *q;
 	int xferred = 0;
+	int moved;
+	int grp;
 
 	/* The REDISP option was specified. We will ignore cookie and force to
 	 * balance or use the dispatcher. */
 	if ((s->proxy->options & (PR_O_REDISP|PR_O_PERSIST)) != PR_O_REDISP)
 		return 0;
 
-	HA_SPIN_LOCK(QUEUE_LOCK, &s->queue.lock);
-	for (node = eb32_first(&s->queue.head); node; node = nodeb) {
-		nodeb =	eb32_next(node);
+	for (grp = 0; grp < global.nbtgroups; grp++) {
+		q = &s->per_tgrp[grp].queue;
+		moved = 0;
 
-		p = eb32_entry(node, struct pendconn, node);
-		if (p->strm_flags & SF_FORCE_PRST)
-			continue;
+		HA_SPIN_LOCK(QUEUE_LOCK, &q->lock);
+		for (node = eb32_first(&q->head); node; node = nodeb) {
+			nodeb =	eb32_next(node);
 
-		/* it's left to the dispatcher to choose a server */
-		__pendconn_unlink_srv(p);
-		p->strm_flags &= ~(SF_DIRECT | SF_ASSIGNED);
+			p = eb32_entry(node, struct pendconn, node);
+			if (p->strm_flags & SF_FORCE_PRST)
+				continue;
 
-		task_wakeup(p->strm->task, TASK_WOKEN_RES);
-		xferred++;
+			/* it's left to the dispatcher to choose a server */
+			__pendconn_unlink_srv(p);
+			p->strm_flags &= ~(SF_DIRECT | SF_ASSIGNED);
+
+			task_wakeup(p->strm->task, TASK_WOKEN_RES);
+			moved++;
+		}
+		HA_SPIN_UNLOCK(QUEUE_LOCK, &q->lock);
+
+		if (moved) {
+			_HA_ATOMIC_SUB(&q->length, moved);
+			xferred += moved;
+		}
 	}
-	HA_SPIN_UNLOCK(QUEUE_LOCK, &s->queue.lock);
 
 	if (xferred) {
-		_HA_ATOMIC_SUB(&s->queue.length, xferred);
+		_HA_ATOMIC_SUB(&s->queue_length, xferred);
 		_HA_ATOMIC_SUB(&s->proxy->totpend, xferred);
 	}
 	return xferred;
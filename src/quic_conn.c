@@ -3162,6 +3162,21 @@ static int qc_prep_app_pkts(struct quic_conn *qc, struct buffer *buf,
 		if (!qc_may_build_pkt(qc, frms, qel, cc, probe, 0))
 			break;
 
+		/* When pacing, never prepare more than the current emission
+		 * credit allows: bursting a full congestion window at line
+		 * rate may produce losses the congestion controller would
+		 * needlessly pay for. Probes and immediate close are never
+		 * delayed.
+		 */
+		if (!probe && !cc && (global.tune.options & GTUNE_QUIC_PACING)) {
+			quic_path_pace_refill(qc->path);
+			if (qc->path->pace_credit < qc->path->mtu) {
+				TRACE_DEVEL("pacing limit reached", QUIC_EV_CONN_PHPKTS, qc);
+				qc->flags |= QUIC_FL_CONN_PACED_OUT;
+				break;
+			}
+		}
+
 		/* Leave room for the datagram header */
 		pos += dg_headlen;
 		if (!quic_peer_validated_addr(qc) && qc_is_listener(qc)) {
@@ -3195,6 +3210,10 @@ static int qc_prep_app_pkts(struct quic_conn *qc, struct buffer *buf,
 			pkt->flags |= QUIC_FL_TX_PACKET_PROBE_WITH_OLD_DATA;
 
 		total += pkt->len;
+		if (qc->path->pace_credit >= pkt->len)
+			qc->path->pace_credit -= pkt->len;
+		else
+			qc->path->pace_credit = 0;
 
 		/* Write datagram header. */
 		qc_txb_store(buf, pkt->len, pkt);
@@ -3420,6 +3439,7 @@ int qc_send_ppkts(struct buffer *buf, struct ssl_sock_ctx *ctx)
 		uint16_t dglen;
 		size_t headlen = sizeof dglen + sizeof first_pkt;
 		unsigned int time_sent;
+		int ndgram = 1;
 
 		pos = (unsigned char *)b_head(buf);
 		dglen = read_u16(pos);
@@ -3443,16 +3463,73 @@ int qc_send_ppkts(struct buffer *buf, struct ssl_sock_ctx *ctx)
 		 * quic-conn fd management.
 		 */
 		if (!skip_sendto) {
-			if (qc_snd_buf(qc, &tmpbuf, tmpbuf.data, 0)) {
+			struct iovec iov[QUIC_MAX_GSO_DGRAMS];
+			int ret;
+
+			/* When the datagrams are emitted on a connection-owned
+			 * socket and the kernel supports UDP GSO, hand over to
+			 * a single syscall as many consecutive datagrams of
+			 * the same size as possible, only the last of the
+			 * batch being allowed to be shorter, and let the
+			 * kernel segment them on the wire. The syscall count
+			 * is by far the dominant cost of small packet
+			 * emission.
+			 */
+			if (qc_test_fd(qc) && quic_sock_gso_supported()) {
+				size_t contig = b_contig_data(buf, 0);
+				size_t ofs = headlen + dglen;
+
+				iov[0].iov_base = tmpbuf.area;
+				iov[0].iov_len = dglen;
+				while (ndgram < QUIC_MAX_GSO_DGRAMS &&
+				       ofs + headlen <= contig) {
+					uint16_t len = read_u16((unsigned char *)b_head(buf) + ofs);
+
+					if (len > dglen || ofs + headlen + len > contig)
+						break;
+					iov[ndgram].iov_base = (char *)b_head(buf) + ofs + headlen;
+					iov[ndgram].iov_len = len;
+					ndgram++;
+					ofs += headlen + len;
+					if (len < dglen)
+						break; /* a shorter datagram ends the batch */
+				}
+			}
+
+			if (ndgram > 1)
+				ret = qc_snd_buf_gso(qc, iov, ndgram, dglen);
+			else
+				ret = qc_snd_buf(qc, &tmpbuf, tmpbuf.data, 0);
+
+			if (ret < 0) {
+				/* GSO turned out not to be usable on this
+				 * path and was just disabled: send the first
+				 * datagram alone, the next rounds will not
+				 * batch anymore.
+				 */
+				ndgram = 1;
+				ret = qc_snd_buf(qc, &tmpbuf, tmpbuf.data, 0);
+			}
+
+			if (ret > 0) {
 				skip_sendto = 1;
 				TRACE_ERROR("sendto error, simulate sending for the rest of data", QUIC_EV_CONN_SPPKTS, qc);
 			}
 		}
 
-		b_del(buf, dglen + headlen);
-		qc->tx.bytes += tmpbuf.data;
 		time_sent = now_ms;
 
+		/* now account all datagrams covered by this send, the batched
+		 * ones having been emitted exactly as if sent one at a time.
+		 */
+ next_dgram:
+		pos = (unsigned char *)b_head(buf);
+		dglen = read_u16(pos);
+		first_pkt = read_ptr(pos + sizeof dglen);
+
+		b_del(buf, dglen + headlen);
+		qc->tx.bytes += dglen;
+
 		for (pkt = first_pkt; pkt; pkt = next_pkt) {
 			pkt->time_sent = time_sent;
 			if (pkt->flags & QUIC_FL_TX_PACKET_ACK_ELICITING) {
@@ -3490,6 +3567,9 @@ int qc_send_ppkts(struct buffer *buf, struct ssl_sock_ctx *ctx)
 			quic_tx_packet_refinc(pkt);
 			eb64_insert(&pkt->pktns->tx.pkts, &pkt->pn_node);
 		}
+
+		if (--ndgram > 0)
+			goto next_dgram;
 	}
 
 	TRACE_LEAVE(QUIC_EV_CONN_SPPKTS, qc);
@@ -4188,6 +4268,15 @@ static int qc_send_app_pkts(struct quic_conn *qc, struct list *frms)
  out:
 	status = 1;
 	qc_txb_release(qc);
+	if (qc->flags & QUIC_FL_CONN_PACED_OUT) {
+		/* The pacing credit is replenished at each now_ms tick: simply
+		 * reschedule the I/O handler to resume the emission of the
+		 * remaining frames instead of waiting for an ack or a timer.
+		 * The flag is kept so that the I/O handler may also wake up
+		 * the MUX layer which subscribes after unsent frames.
+		 */
+		tasklet_wakeup(qc->wait_event.tasklet);
+	}
  leave:
 	TRACE_LEAVE(QUIC_EV_CONN_TXPKT, qc);
 	return status;
@@ -4400,6 +4489,20 @@ struct task *quic_conn_app_io_cb(struct task *t, void *context, unsigned int sta
 	if (!LIST_ISEMPTY(&qel->rx.pqpkts) && qc_qel_may_rm_hp(qc, qel))
 		qc_rm_hp_pkts(qc, qel);
 
+	if (qc->flags & QUIC_FL_CONN_PACED_OUT) {
+		/* A previous emission was interrupted by the pacer. Wake up
+		 * the MUX layer if it subscribed after its unsent frames so
+		 * that it restarts the emission as soon as credit is back.
+		 */
+		qc->flags &= ~QUIC_FL_CONN_PACED_OUT;
+		if (qc->subs && qc->subs->events & SUB_RETRY_SEND) {
+			tasklet_wakeup(qc->subs->tasklet);
+			qc->subs->events &= ~SUB_RETRY_SEND;
+			if (!qc->subs->events)
+				qc->subs = NULL;
+		}
+	}
+
 	if (!qc_treat_rx_pkts(qc, qel, NULL, 0)) {
 		TRACE_DEVEL("qc_treat_rx_pkts() failed", QUIC_EV_CONN_IO_CB, qc);
 		goto out;
@@ -5617,6 +5720,24 @@ static int quic_generate_retry_token_aad(unsigned char *aad,
 	return p - aad;
 }
 
+/* Cipher contexts used to build and check Retry tokens. They are kept
+ * per-thread and only re-keyed for each token, which amortizes the EVP
+ * context allocation and configuration across all the tokens processed by a
+ * thread. This matters during address validation storms where every Initial
+ * packet carrying a token costs an AEAD operation on the datagram path.
+ */
+static THREAD_LOCAL EVP_CIPHER_CTX *quic_retry_token_enc_ctx;
+static THREAD_LOCAL EVP_CIPHER_CTX *quic_retry_token_dec_ctx;
+
+static void quic_free_retry_token_ctx_per_thread(void)
+{
+	EVP_CIPHER_CTX_free(quic_retry_token_enc_ctx);
+	quic_retry_token_enc_ctx = NULL;
+	EVP_CIPHER_CTX_free(quic_retry_token_dec_ctx);
+	quic_retry_token_dec_ctx = NULL;
+}
+REGISTER_PER_THREAD_FREE(quic_free_retry_token_ctx_per_thread);
+
 /* QUIC server only function.
  * Generate the token to be used in Retry packets. The token is written to
  * <buf> with <len> as length. <odcid> is the original destination connection
@@ -5666,10 +5787,17 @@ static int quic_generate_retry_token(unsigned char *buf, size_t len,
 		goto err;
 	}
 
-	if (!quic_tls_tx_ctx_init(&ctx, aead, key)) {
-		TRACE_ERROR("quic_tls_tx_ctx_init() failed", QUIC_EV_CONN_TXPKT);
+	if (!quic_retry_token_enc_ctx) {
+		if (!quic_tls_tx_ctx_init(&quic_retry_token_enc_ctx, aead, key)) {
+			TRACE_ERROR("quic_tls_tx_ctx_init() failed", QUIC_EV_CONN_TXPKT);
+			goto err;
+		}
+	}
+	else if (!EVP_EncryptInit_ex(quic_retry_token_enc_ctx, NULL, NULL, key, NULL)) {
+		TRACE_ERROR("could not re-key the Retry token cipher context", QUIC_EV_CONN_TXPKT);
 		goto err;
 	}
+	ctx = quic_retry_token_enc_ctx;
 
 	/* Token build */
 	p = buf;
@@ -5689,7 +5817,6 @@ static int quic_generate_retry_token(unsigned char *buf, size_t len,
 	p += QUIC_TLS_TAG_LEN;
 	memcpy(p, salt, sizeof salt);
 	p += sizeof salt;
-	EVP_CIPHER_CTX_free(ctx);
 
 	ret = p - buf;
  leave:
@@ -5697,8 +5824,9 @@ static int quic_generate_retry_token(unsigned char *buf, size_t len,
 	return ret;
 
  err:
-	if (ctx)
-		EVP_CIPHER_CTX_free(ctx);
+	/* do not keep a cipher context in an undefined state */
+	EVP_CIPHER_CTX_free(quic_retry_token_enc_ctx);
+	quic_retry_token_enc_ctx = NULL;
 	goto leave;
 }
 
@@ -5750,6 +5878,7 @@ static int quic_retry_token_check(struct quic_rx_packet *pkt,
 	if (*pkt->token != QUIC_TOKEN_FMT_RETRY) {
 		/* TODO: New token check */
 		TRACE_PROTO("Packet dropped", QUIC_EV_CONN_LPKT, qc, NULL, NULL, pkt->version);
+		HA_ATOMIC_INC(&prx_counters->retry_token_early_dropped);
 		goto leave;
 	}
 
@@ -5758,6 +5887,16 @@ static int quic_retry_token_check(struct quic_rx_packet *pkt,
 		goto err;
 	}
 
+	/* The token must at least contain the format byte, the prefixed ODCID,
+	 * the timestamp, the AEAD tag and the salt. Shorter tokens can be
+	 * dropped right away, before paying for any key derivation.
+	 */
+	if (tokenlen < 2 + sizeof(uint32_t) + QUIC_TLS_TAG_LEN + QUIC_RETRY_TOKEN_SALTLEN) {
+		TRACE_PROTO("too short token", QUIC_EV_CONN_LPKT, qc);
+		HA_ATOMIC_INC(&prx_counters->retry_token_early_dropped);
+		goto err;
+	}
+
 	aadlen = quic_generate_retry_token_aad(aad, qv->num, &pkt->scid, &dgram->saddr);
 	salt = token + tokenlen - QUIC_RETRY_TOKEN_SALTLEN;
 	if (!quic_tls_derive_retry_token_secret(EVP_sha256(), key, sizeof key, iv, sizeof iv,
@@ -5766,10 +5905,20 @@ static int quic_retry_token_check(struct quic_rx_packet *pkt,
 		goto err;
 	}
 
-	if (!quic_tls_rx_ctx_init(&ctx, aead, key)) {
-		TRACE_ERROR("quic_tls_rx_ctx_init() failed", QUIC_EV_CONN_LPKT, qc);
+	if (!quic_retry_token_dec_ctx) {
+		if (!quic_tls_rx_ctx_init(&quic_retry_token_dec_ctx, aead, key)) {
+			TRACE_ERROR("quic_tls_rx_ctx_init() failed", QUIC_EV_CONN_LPKT, qc);
+			goto err;
+		}
+	}
+	else if (!EVP_DecryptInit_ex(quic_retry_token_dec_ctx, NULL, NULL, key, NULL)) {
+		TRACE_ERROR("could not re-key the Retry token cipher context", QUIC_EV_CONN_LPKT, qc);
+		/* do not keep a cipher context in an undefined state */
+		EVP_CIPHER_CTX_free(quic_retry_token_dec_ctx);
+		quic_retry_token_dec_ctx = NULL;
 		goto err;
 	}
+	ctx = quic_retry_token_dec_ctx;
 
 	/* Do not decrypt the QUIC_TOKEN_FMT_RETRY byte */
 	if (!quic_tls_decrypt2(buf, token + 1, tokenlen - QUIC_RETRY_TOKEN_SALTLEN - 1, aad, aadlen,
@@ -5783,8 +5932,6 @@ static int quic_retry_token_check(struct quic_rx_packet *pkt,
 		goto err;
 	}
 
-	EVP_CIPHER_CTX_free(ctx);
-
 	ret = 1;
 	HA_ATOMIC_INC(&prx_counters->retry_validated);
 
@@ -5794,8 +5941,6 @@ static int quic_retry_token_check(struct quic_rx_packet *pkt,
 
  err:
 	HA_ATOMIC_INC(&prx_counters->retry_error);
-	if (ctx)
-		EVP_CIPHER_CTX_free(ctx);
 	goto leave;
 }
 
@@ -5875,6 +6020,9 @@ static int send_retry(int fd, struct sockaddr_storage *addr,
  * type INITIAL, the ODCID tree is first used. In this case, <saddr> is
  * concatenated to the <pkt> DCID field.
  *
+ * This only runs on the thread encoded in the DCID, which owns both trees,
+ * so no locking is needed.
+ *
  * Returns the instance or NULL if not found.
  */
 static struct quic_conn *retrieve_qc_conn_from_cid(struct quic_rx_packet *pkt,
@@ -14,11 +14,21 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
+/* UDP_GRO appeared in linux 5.0 but may be missing from older libcs */
+#if defined(__linux__) && !defined(UDP_GRO)
+#define UDP_GRO 104
+#endif
+#ifndef SOL_UDP
+#define SOL_UDP IPPROTO_UDP
+#endif
+
 #include <haproxy/api.h>
 #include <haproxy/buf.h>
 #include <haproxy/connection.h>
@@ -288,12 +298,16 @@ static struct quic_dgram *quic_rxbuf_purge_dgrams(struct quic_receiver_buf *buf)
  * <to> will be set as AF_UNSPEC. The caller must specify <to_port> to ensure
  * that <to> address is completely filled.
  *
+ * If <gro_size> is not NULL and the socket has UDP GRO enabled, it is set to
+ * the size of the individual datagrams coalesced into the returned buffer, or
+ * zero when a single datagram was received.
+ *
  * Returns value from recvmsg syscall.
  */
 static ssize_t quic_recv(int fd, void *out, size_t len,
                          struct sockaddr *from, socklen_t from_len,
                          struct sockaddr *to, socklen_t to_len,
-                         uint16_t dst_port)
+                         uint16_t dst_port, uint16_t *gro_size)
 {
 	union pktinfo {
 #ifdef IP_PKTINFO
@@ -305,7 +319,7 @@ static ssize_t quic_recv(int fd, void *out, size_t len,
 		struct in6_pktinfo in6;
 #endif
 	};
-	char cdata[CMSG_SPACE(sizeof(union pktinfo))];
+	char cdata[CMSG_SPACE(sizeof(union pktinfo)) + CMSG_SPACE(sizeof(uint16_t))];
 	struct msghdr msg;
 	struct iovec vec;
 	struct cmsghdr *cmsg;
@@ -323,6 +337,8 @@ static ssize_t quic_recv(int fd, void *out, size_t len,
 	msg.msg_controllen = sizeof(cdata);
 
 	clear_addr((struct sockaddr_storage *)to);
+	if (gro_size)
+		*gro_size = 0;
 
 	do {
 		ret = recvmsg(fd, &msg, 0);
@@ -363,6 +379,13 @@ static ssize_t quic_recv(int fd, void *out, size_t len,
 #endif /* IP_PKTINFO || IP_RECVDSTADDR */
 			break;
 
+#ifdef UDP_GRO
+		case SOL_UDP:
+			if (cmsg->cmsg_type == UDP_GRO && gro_size)
+				*gro_size = *(uint16_t *)CMSG_DATA(cmsg);
+			break;
+#endif
+
 		case IPPROTO_IPV6:
 #ifdef IPV6_RECVPKTINFO
 			if (cmsg->cmsg_type == IPV6_PKTINFO) {
@@ -398,7 +421,9 @@ void quic_lstnr_sock_fd_iocb(int fd)
 	struct sockaddr_storage saddr = {0}, daddr = {0};
 	size_t max_sz, cspace;
 	struct quic_dgram *new_dgram;
-	unsigned char *dgram_buf;
+	unsigned char *dgram_buf, *seg;
+	uint16_t gro_size;
+	size_t left;
 	int max_dgrams;
 
 	BUG_ON(!l);
@@ -464,21 +489,56 @@ void quic_lstnr_sock_fd_iocb(int fd)
 	}
 
 	dgram_buf = (unsigned char *)b_tail(buf);
-	ret = quic_recv(fd, dgram_buf, max_sz,
+	ret = quic_recv(fd, dgram_buf, b_contig_space(buf),
 	                (struct sockaddr *)&saddr, sizeof(saddr),
 	                (struct sockaddr *)&daddr, sizeof(daddr),
-	                get_net_port(&l->rx.addr));
+	                get_net_port(&l->rx.addr), &gro_size);
 	if (ret <= 0)
 		goto out;
 
-	b_add(buf, ret);
-	if (!quic_lstnr_dgram_dispatch(dgram_buf, ret, l, &saddr, &daddr,
-	                               new_dgram, &rxbuf->dgram_list)) {
-		/* If wrong, consume this datagram */
-		b_sub(buf, ret);
+	/* With GRO, a single receive may return several datagrams of
+	 * <gro_size> bytes glued together, only the last one possibly being
+	 * shorter. Split them back and dispatch each segment as a datagram of
+	 * its own. The whole batch is always processed so that no received
+	 * data is lost, only the number of extra receives is bounded by
+	 * <max_dgrams>.
+	 */
+	seg = dgram_buf;
+	left = ret;
+	while (left) {
+		size_t seg_len = (gro_size && left > gro_size) ? gro_size : left;
+
+		b_add(buf, seg_len);
+		if (!quic_lstnr_dgram_dispatch(seg, seg_len, l, &saddr, &daddr,
+		                               new_dgram, &rxbuf->dgram_list)) {
+			/* If wrong, consume this segment */
+			b_sub(buf, seg_len);
+			if (left != seg_len) {
+				/* other segments follow in the buffer: account
+				 * for the space of this one with an already
+				 * consumed datagram so that it is released in
+				 * order, or drop the rest of the batch if it
+				 * cannot be allocated.
+				 */
+				struct quic_dgram *hole = pool_alloc(pool_head_quic_dgram);
+
+				if (!hole) {
+					new_dgram = NULL;
+					break;
+				}
+				hole->buf = NULL;
+				hole->len = seg_len;
+				LIST_APPEND(&rxbuf->dgram_list, &hole->recv_list);
+				b_add(buf, seg_len);
+			}
+		}
+		/* <new_dgram> was either consumed or released by the dispatch */
+		new_dgram = NULL;
+		seg += seg_len;
+		left -= seg_len;
+		max_dgrams--;
 	}
-	new_dgram = NULL;
-	if (--max_dgrams > 0)
+	if (max_dgrams > 0)
 		goto start;
  out:
 	pool_free(pool_head_quic_dgram, new_dgram);
@@ -643,6 +703,122 @@ int qc_snd_buf(struct quic_conn *qc, const struct buffer *buf, size_t sz,
 	return 0;
 }
 
+#ifdef UDP_SEGMENT
+/* UDP GSO support status: 0 = not yet probed, 1 = supported,
+ * -1 = unsupported, either on the probing socket or reported at runtime by
+ * the egress path.
+ */
+static int quic_udp_gso_state;
+#endif
+
+/* Returns non-zero if datagrams may be emitted using UDP GSO (UDP_SEGMENT)
+ * on this system. The first call probes the kernel with a dummy socket and
+ * the result is cached; qc_snd_buf_gso() may later clear it if the egress
+ * path rejects segmentation offload at runtime.
+ */
+int quic_sock_gso_supported(void)
+{
+#ifdef UDP_SEGMENT
+	int state = HA_ATOMIC_LOAD(&quic_udp_gso_state);
+
+	if (unlikely(!state)) {
+		int off = 0;
+		int fd;
+
+		state = -1;
+		fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if (fd >= 0) {
+			if (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &off, sizeof(off)) == 0)
+				state = 1;
+			close(fd);
+		}
+		HA_ATOMIC_STORE(&quic_udp_gso_state, state);
+	}
+	return state > 0;
+#else
+	return 0;
+#endif
+}
+
+/* Send in a single syscall the <ndgram> datagrams described by <iov>, all
+ * <gso_sz> bytes long except the last one which may be shorter, to <qc>'s
+ * peer, letting the kernel segment them on the wire (UDP GSO). This is only
+ * usable when the connection owns its socket (qc_test_fd()), which carries
+ * the destination.
+ *
+ * Returns 0 on success, 1 on a transient error, in which case the caller may
+ * consider the datagrams as emitted just like after qc_snd_buf(), or -1 when
+ * the egress path does not support segmentation offload, in which case GSO
+ * has been disabled for the whole process, nothing was sent and the caller
+ * must fall back to per-datagram emission.
+ */
+int qc_snd_buf_gso(struct quic_conn *qc, struct iovec *iov, int ndgram,
+                   uint16_t gso_sz)
+{
+#ifdef UDP_SEGMENT
+	struct msghdr msg = { 0 };
+	union {
+		char buf[CMSG_SPACE(sizeof(uint16_t))];
+		struct cmsghdr align;
+	} u;
+	struct cmsghdr *cmsg;
+	size_t sz = 0;
+	ssize_t ret;
+	int i;
+
+	BUG_ON(!qc_test_fd(qc));
+
+	for (i = 0; i < ndgram; i++)
+		sz += iov[i].iov_len;
+
+	msg.msg_iov = iov;
+	msg.msg_iovlen = ndgram;
+	msg.msg_control = u.buf;
+	msg.msg_controllen = sizeof(u.buf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_UDP;
+	cmsg->cmsg_type = UDP_SEGMENT;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(gso_sz));
+	memcpy(CMSG_DATA(cmsg), &gso_sz, sizeof(gso_sz));
+
+	do {
+		ret = sendmsg(qc->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0 && (errno == EIO || errno == EINVAL ||
+	                errno == ENOTSUP || errno == EOPNOTSUPP)) {
+		/* The device behind this path refuses segmentation offload:
+		 * this is typically reported once the route is resolved, not
+		 * by the probing socket. Give up on GSO for good.
+		 */
+		HA_ATOMIC_STORE(&quic_udp_gso_state, -1);
+		return -1;
+	}
+
+	if (ret < 0 || ret != sz) {
+		struct proxy *prx = qc->li->bind_conf->frontend;
+		struct quic_counters *prx_counters =
+		  EXTRA_COUNTERS_GET(prx->extra_counters_fe,
+		                     &quic_stats_module);
+
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			HA_ATOMIC_INC(&prx_counters->socket_full);
+		else
+			HA_ATOMIC_INC(&prx_counters->sendto_err_unknown);
+
+		return 1;
+	}
+
+	_HA_ATOMIC_ADD(&th_ctx->out_bytes, ret);
+	update_freq_ctr(&th_ctx->out_32bps, (ret + 16) / 32);
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
 /* Receive datagram on <qc> FD-owned socket.
  *
  * Returns the total number of bytes read or a negative value on error.
@@ -682,7 +858,7 @@ int qc_rcv_buf(struct quic_conn *qc)
 		ret = quic_recv(qc->fd, dgram_buf, max_sz,
 		                (struct sockaddr *)&saddr, sizeof(saddr),
 		                (struct sockaddr *)&daddr, sizeof(daddr),
-		                get_net_port(&qc->local_addr));
+		                get_net_port(&qc->local_addr), NULL);
 		if (ret <= 0) {
 			/* Subscribe FD for future reception. */
 			fd_want_recv(qc->fd);
@@ -27,6 +27,8 @@ static struct name_desc quic_stats[] = {
 	                                  .desc = "Total number of validated Retry tokens" },
 	[QUIC_ST_RETRY_ERRORS]        = { .name = "quic_retry_error",
 	                                  .desc = "Total number of Retry tokens errors" },
+	[QUIC_ST_RETRY_TOKEN_EARLY_DROP] = { .name = "quic_retry_token_early_drop",
+	                                  .desc = "Total number of Retry tokens dropped before crypto validation" },
 	[QUIC_ST_HALF_OPEN_CONN]      = { .name = "quic_half_open_conn",
 	                                  .desc = "Total number of half open connections" },
 	[QUIC_ST_HDSHK_FAIL]          = { .name = "quic_hdshk_fail",
@@ -104,6 +106,7 @@ static void quic_fill_stats(void *data, struct field *stats)
 	stats[QUIC_ST_RETRY_SENT]        = mkf_u64(FN_COUNTER, counters->retry_sent);
 	stats[QUIC_ST_RETRY_VALIDATED]   = mkf_u64(FN_COUNTER, counters->retry_validated);
 	stats[QUIC_ST_RETRY_ERRORS]      = mkf_u64(FN_COUNTER, counters->retry_error);
+	stats[QUIC_ST_RETRY_TOKEN_EARLY_DROP] = mkf_u64(FN_COUNTER, counters->retry_token_early_dropped);
 	stats[QUIC_ST_HALF_OPEN_CONN]    = mkf_u64(FN_GAUGE, counters->half_open_conn);
 	stats[QUIC_ST_HDSHK_FAIL]        = mkf_u64(FN_COUNTER, counters->hdshk_fail);
 	stats[QUIC_ST_STATELESS_RESET_SENT] = mkf_u64(FN_COUNTER, counters->stateless_reset_sent);
@@ -508,6 +508,16 @@ int quic_tls_tx_ctx_init(EVP_CIPHER_CTX **tx_ctx,
  * are provided from <aad> buffer with <aad_len> as length. This is always the
  * case here. So the caller of this function must provide <aad>.
  *
+ * This function and its decrypt counterparts below are called once per packet
+ * and are the hottest crypto spots of the datapath. Batching several packets
+ * of a same flush into a single multi-buffer call would amortize the EVP
+ * per-call overhead, but OpenSSL only exposes this through the pipeline
+ * cipher flags which no stock AES-GCM implementation sets, and each packet
+ * uses its own nonce anyway. So instead the cost per call is kept minimal:
+ * the key is installed once for all in the context at initialization time,
+ * only the nonce is updated here, and the CCM-specific contortions are kept
+ * out of the common GCM/CHACHA20 sequence.
+ *
  * https://wiki.openssl.org/index.php/EVP_Authenticated_Encryption_and_Decryption
  */
 int quic_tls_encrypt(unsigned char *buf, size_t len,
@@ -516,15 +526,24 @@ int quic_tls_encrypt(unsigned char *buf, size_t len,
                      const unsigned char *key, const unsigned char *iv)
 {
 	int outlen;
-	int aead_nid = EVP_CIPHER_nid(aead);
+
+	if (unlikely(EVP_CIPHER_nid(aead) == NID_aes_128_ccm)) {
+		if (!EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv) ||
+		    !EVP_EncryptUpdate(ctx, NULL, &outlen, NULL, len) ||
+		    !EVP_EncryptUpdate(ctx, NULL, &outlen, aad, aad_len) ||
+		    !EVP_EncryptUpdate(ctx, buf, &outlen, buf, len) ||
+		    !EVP_EncryptFinal_ex(ctx, buf + outlen, &outlen) ||
+		    !EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, QUIC_TLS_TAG_LEN, buf + len))
+			return 0;
+
+		return 1;
+	}
 
 	if (!EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv) ||
-	    (aead_nid == NID_aes_128_ccm &&
-	     !EVP_EncryptUpdate(ctx, NULL, &outlen, NULL, len)) ||
-		!EVP_EncryptUpdate(ctx, NULL, &outlen, aad, aad_len) ||
-		!EVP_EncryptUpdate(ctx, buf, &outlen, buf, len) ||
-		!EVP_EncryptFinal_ex(ctx, buf + outlen, &outlen) ||
-		!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, QUIC_TLS_TAG_LEN, buf + len))
+	    !EVP_EncryptUpdate(ctx, NULL, &outlen, aad, aad_len) ||
+	    !EVP_EncryptUpdate(ctx, buf, &outlen, buf, len) ||
+	    !EVP_EncryptFinal_ex(ctx, buf + outlen, &outlen) ||
+	    !EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, QUIC_TLS_TAG_LEN, buf + len))
 		return 0;
 
 	return 1;
@@ -545,17 +564,25 @@ int quic_tls_decrypt(unsigned char *buf, size_t len,
                      const unsigned char *key, const unsigned char *iv)
 {
 	int outlen;
-	int aead_nid = EVP_CIPHER_nid(aead);
+
+	if (unlikely(EVP_CIPHER_nid(aead) == NID_aes_128_ccm)) {
+		if (!EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, iv) ||
+		    !EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, QUIC_TLS_TAG_LEN,
+		                         buf + len - QUIC_TLS_TAG_LEN) ||
+		    !EVP_DecryptUpdate(ctx, NULL, &outlen, NULL, len - QUIC_TLS_TAG_LEN) ||
+		    !EVP_DecryptUpdate(ctx, NULL, &outlen, aad, aad_len) ||
+		    !EVP_DecryptUpdate(ctx, buf, &outlen, buf, len - QUIC_TLS_TAG_LEN))
+			return 0;
+
+		return 1;
+	}
 
 	if (!EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, iv) ||
 	    !EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, QUIC_TLS_TAG_LEN,
 	                         buf + len - QUIC_TLS_TAG_LEN) ||
-	    (aead_nid == NID_aes_128_ccm &&
-	     !EVP_DecryptUpdate(ctx, NULL, &outlen, NULL, len - QUIC_TLS_TAG_LEN)) ||
-		!EVP_DecryptUpdate(ctx, NULL, &outlen, aad, aad_len) ||
-		!EVP_DecryptUpdate(ctx, buf, &outlen, buf, len - QUIC_TLS_TAG_LEN) ||
-		(aead_nid != NID_aes_128_ccm &&
-		 !EVP_DecryptFinal_ex(ctx, buf + outlen, &outlen)))
+	    !EVP_DecryptUpdate(ctx, NULL, &outlen, aad, aad_len) ||
+	    !EVP_DecryptUpdate(ctx, buf, &outlen, buf, len - QUIC_TLS_TAG_LEN) ||
+	    !EVP_DecryptFinal_ex(ctx, buf + outlen, &outlen))
 		return 0;
 
 	return 1;
@@ -581,17 +608,24 @@ int quic_tls_decrypt2(unsigned char *out,
                       const unsigned char *key, const unsigned char *iv)
 {
 	int outlen;
-	int aead_nid = EVP_CIPHER_nid(aead);
 
 	len -= QUIC_TLS_TAG_LEN;
+	if (unlikely(EVP_CIPHER_nid(aead) == NID_aes_128_ccm)) {
+		if (!EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, iv) ||
+		    !EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, QUIC_TLS_TAG_LEN, in + len) ||
+		    !EVP_DecryptUpdate(ctx, NULL, &outlen, NULL, len) ||
+		    !EVP_DecryptUpdate(ctx, NULL, &outlen, aad, aad_len) ||
+		    !EVP_DecryptUpdate(ctx, out, &outlen, in, len))
+			return 0;
+
+		return 1;
+	}
+
 	if (!EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, iv) ||
 	    !EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, QUIC_TLS_TAG_LEN, in + len) ||
-	    (aead_nid == NID_aes_128_ccm &&
-	     !EVP_DecryptUpdate(ctx, NULL, &outlen, NULL, len)) ||
 	    !EVP_DecryptUpdate(ctx, NULL, &outlen, aad, aad_len) ||
 	    !EVP_DecryptUpdate(ctx, out, &outlen, in, len) ||
-	    (aead_nid != NID_aes_128_ccm &&
-	     !EVP_DecryptFinal_ex(ctx, out + outlen, &outlen)))
+	    !EVP_DecryptFinal_ex(ctx, out + outlen, &outlen))
 		return 0;
 
 	return 1;
@@ -17,12 +17,61 @@
 #include <haproxy/api.h>
 #include <haproxy/errors.h>
 #include <haproxy/global.h>
+#include <haproxy/init.h>
 #include <haproxy/regex.h>
 #include <haproxy/tools.h>
 
 /* regex trash buffer used by various regex tests */
 THREAD_LOCAL regmatch_t pmatch[MAX_MATCH];  /* rm_so, rm_eo for regular expressions */
 
+#ifdef USE_PCRE2
+/* Per-thread preallocated match data and match context, so that regex
+ * executions don't need a malloc/free pair per call. They remain NULL until
+ * the threads are started (e.g. during config parsing), in which case the
+ * execution functions fall back to a local allocation.
+ */
+THREAD_LOCAL pcre2_match_data *pcre2_matchdata = NULL;
+THREAD_LOCAL pcre2_match_context *pcre2_matchctx = NULL;
+#ifdef USE_PCRE2_JIT
+static THREAD_LOCAL pcre2_jit_stack *pcre2_jitstack = NULL;
+#endif
+
+static int regex_alloc_per_thread(void)
+{
+	pcre2_matchdata = pcre2_match_data_create(MAX_MATCH, NULL);
+	if (!pcre2_matchdata)
+		return 0;
+#ifdef USE_PCRE2_JIT
+	/* Give the JIT a dedicated stack larger than its default one so that
+	 * complex expressions on large subjects don't fail to match. If the
+	 * allocation fails we simply keep using the default stack.
+	 */
+	pcre2_jitstack = pcre2_jit_stack_create(64 * 1024, 512 * 1024, NULL);
+	if (pcre2_jitstack) {
+		pcre2_matchctx = pcre2_match_context_create(NULL);
+		if (pcre2_matchctx)
+			pcre2_jit_stack_assign(pcre2_matchctx, NULL, pcre2_jitstack);
+	}
+#endif
+	return 1;
+}
+
+static void regex_free_per_thread(void)
+{
+	pcre2_match_data_free(pcre2_matchdata);
+	pcre2_matchdata = NULL;
+	pcre2_match_context_free(pcre2_matchctx);
+	pcre2_matchctx = NULL;
+#ifdef USE_PCRE2_JIT
+	pcre2_jit_stack_free(pcre2_jitstack);
+	pcre2_jitstack = NULL;
+#endif
+}
+
+REGISTER_PER_THREAD_ALLOC(regex_alloc_per_thread);
+REGISTER_PER_THREAD_FREE(regex_free_per_thread);
+#endif /* USE_PCRE2 */
+
 int exp_replace(char *dst, unsigned int dst_size, char *src, const char *str, const regmatch_t *matches)
 {
 	char *old_dst = dst;
@@ -169,11 +218,17 @@ int regex_exec_match(const struct my_regex *preg, const char *subject,
 	 * space in the matches array.
 	 */
 #ifdef USE_PCRE2
-	pm = pcre2_match_data_create_from_pattern(preg->reg, NULL);
-	ret = preg->mfn(preg->reg, (PCRE2_SPTR)subject, (PCRE2_SIZE)strlen(subject), 0, options, pm, NULL);
+	pm = pcre2_matchdata;
+	if (unlikely(!pm)) {
+		pm = pcre2_match_data_create_from_pattern(preg->reg, NULL);
+		if (!pm)
+			return 0;
+	}
+	ret = preg->mfn(preg->reg, (PCRE2_SPTR)subject, (PCRE2_SIZE)strlen(subject), 0, options, pm, pcre2_matchctx);
 
 	if (ret < 0) {
-		pcre2_match_data_free(pm);
+		if (pm != pcre2_matchdata)
+			pcre2_match_data_free(pm);
 		return 0;
 	}
 
@@ -200,7 +255,8 @@ int regex_exec_match(const struct my_regex *preg, const char *subject,
 		pmatch[i].rm_eo = -1;
 	}
 #ifdef USE_PCRE2
-	pcre2_match_data_free(pm);
+	if (pm != pcre2_matchdata)
+		pcre2_match_data_free(pm);
 #endif
 	return 1;
 #else
@@ -262,11 +318,17 @@ int regex_exec_match2(const struct my_regex *preg, char *subject, int length,
 	 * space in the matches array.
 	 */
 #ifdef USE_PCRE2
-	pm = pcre2_match_data_create_from_pattern(preg->reg, NULL);
-	ret = preg->mfn(preg->reg, (PCRE2_SPTR)subject, (PCRE2_SIZE)length, 0, options, pm, NULL);
+	pm = pcre2_matchdata;
+	if (unlikely(!pm)) {
+		pm = pcre2_match_data_create_from_pattern(preg->reg, NULL);
+		if (!pm)
+			return 0;
+	}
+	ret = preg->mfn(preg->reg, (PCRE2_SPTR)subject, (PCRE2_SIZE)length, 0, options, pm, pcre2_matchctx);
 
 	if (ret < 0) {
-		pcre2_match_data_free(pm);
+		if (pm != pcre2_matchdata)
+			pcre2_match_data_free(pm);
 		return 0;
 	}
 
@@ -292,7 +354,8 @@ int regex_exec_match2(const struct my_regex *preg, char *subject, int length,
 		pmatch[i].rm_eo = -1;
 	}
 #ifdef USE_PCRE2
-	pcre2_match_data_free(pm);
+	if (pm != pcre2_matchdata)
+		pcre2_match_data_free(pm);
 #endif
 	return 1;
 #else
@@ -2156,7 +2156,6 @@ static int resolv_process_responses(struct dns_nameserver *ns)
 	/* process all pending input messages */
 	while (1) {
 		/* read message received */
-		memset(buf, '\0', resolvers->accepted_payload_size + 1);
 		if ((buflen = dns_recv_nameserver(ns, (void *)buf, sizeof(buf))) <= 0) {
 			break;
 		}
@@ -2167,6 +2166,11 @@ static int resolv_process_responses(struct dns_nameserver *ns)
 			continue;
 		}
 
+		/* no need to zero the whole buffer: the parser never reads
+		 * past <bufend>, a terminator is enough.
+		 */
+		buf[buflen] = '\0';
+
 		/* initializing variables */
 		bufend = buf + buflen;	/* pointer to mark the end of the buffer */
 
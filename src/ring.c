@@ -46,6 +46,7 @@ void ring_init(struct ring *ring, void *area, size_t size)
 	ring->buf = b_make(area, size, 0, 0);
 	/* write the initial RC byte */
 	b_putchr(&ring->buf, 0);
+	ring->pending = b_data(&ring->buf);
 }
 
 /* Creates and returns a ring buffer of size <size> bytes. Returns NULL on
@@ -114,6 +115,7 @@ struct ring *ring_cast_from_area(void *area)
 	HA_RWLOCK_INIT(&ring->lock);
 	LIST_INIT(&ring->waiters);
 	ring->readers_count = 0;
+	ring->pending = b_data(&ring->buf);
 
 	return ring;
 }
@@ -165,13 +167,37 @@ void ring_free(struct ring *ring)
 	free(ring);
 }
 
+/* Copies <len> bytes from <blk> into the storage area of buffer <buf> at
+ * offset <ofs> relative to the buffer's head, wrapping at the end of the
+ * area if needed. The buffer's metadata are left untouched, publishing the
+ * data is the caller's responsibility.
+ */
+static void ring_putblk_ofs(struct buffer *buf, size_t ofs, const char *blk, size_t len)
+{
+	while (len) {
+		char *ptr = b_peek(buf, ofs);
+		size_t part = b_wrap(buf) - ptr;
+
+		if (part > len)
+			part = len;
+		memcpy(ptr, blk, part);
+		blk += part;
+		ofs += part;
+		len -= part;
+	}
+}
+
 /* Tries to send <npfx> parts from <prefix> followed by <nmsg> parts from <msg>
  * to ring <ring>. The message is sent atomically. It may be truncated to
  * <maxlen> bytes if <maxlen> is non-null. There is no distinction between the
  * two lists, it's just a convenience to help the caller prepend some prefixes
- * when necessary. It takes the ring's write lock to make sure no other thread
- * will touch the buffer during the update. Returns the number of bytes sent,
- * or <=0 on failure.
+ * when necessary. As long as there is enough room, concurrent senders only
+ * take the ring's read lock: each of them reserves its area at the tail with
+ * a CAS on the reserved length, copies its payload in parallel with the other
+ * ones, then publishes it in reservation order by advancing the buffer's
+ * length once all messages reserved before its own are published. The write
+ * lock is only taken to recycle the oldest messages when room is missing.
+ * Returns the number of bytes sent, or <=0 on failure.
  */
 ssize_t ring_write(struct ring *ring, size_t maxlen, const struct ist pfx[], size_t npfx, const struct ist msg[], size_t nmsg)
 {
@@ -179,6 +205,9 @@ ssize_t ring_write(struct ring *ring, size_t maxlen, const struct ist pfx[], siz
 	struct appctx *appctx;
 	size_t totlen = 0;
 	size_t lenlen;
+	size_t needed;
+	size_t start;
+	size_t ofs;
 	uint64_t dellen;
 	int dellenlen;
 	ssize_t sent = 0;
@@ -187,10 +216,9 @@ ssize_t ring_write(struct ring *ring, size_t maxlen, const struct ist pfx[], siz
 	/* we have to find some room to add our message (the buffer is
 	 * never empty and at least contains the previous counter) and
 	 * to update both the buffer contents and heads at the same
-	 * time (it's doable using atomic ops but not worth the
-	 * trouble, let's just lock). For this we first need to know
-	 * the total message's length. We cannot measure it while
-	 * copying due to the varint encoding of the length.
+	 * time. For this we first need to know the total message's
+	 * length. We cannot measure it while copying due to the varint
+	 * encoding of the length.
 	 */
 	for (i = 0; i < npfx; i++)
 		totlen += pfx[i].len;
@@ -201,12 +229,94 @@ ssize_t ring_write(struct ring *ring, size_t maxlen, const struct ist pfx[], siz
 		totlen = maxlen;
 
 	lenlen = varint_bytes(totlen);
+	needed = lenlen + totlen + 1;
+
+	if (needed + 1 > b_size(buf))
+		return 0;
+
+	/* Fast path: neither the buffer's head nor the waiters list may
+	 * change under the read lock, so as long as there is enough room
+	 * past the already reserved area we only need to win our own part
+	 * of the tail with a CAS and everything else can proceed without
+	 * any exclusion between senders.
+	 */
+	HA_RWLOCK_RDLOCK(LOGSRV_LOCK, &ring->lock);
+
+	start = HA_ATOMIC_LOAD(&ring->pending);
+	while (1) {
+		if (needed > b_size(buf) - start) {
+			/* not enough room left, the oldest messages have to
+			 * be recycled under the write lock.
+			 */
+			HA_RWLOCK_RDUNLOCK(LOGSRV_LOCK, &ring->lock);
+			goto slow;
+		}
+		if (_HA_ATOMIC_CAS(&ring->pending, &start, start + needed))
+			break;
+		__ha_cpu_relax();
+	}
 
+	/* the area between <start> and <start+needed> is ours, encode the
+	 * length and copy the payload there. These offsets are relative to
+	 * the head which cannot move in parallel.
+	 */
+	{
+		char lenbuf[10];
+		char *p = lenbuf;
+
+		encode_varint(totlen, &p, lenbuf + sizeof(lenbuf));
+		ring_putblk_ofs(buf, start, lenbuf, p - lenbuf);
+	}
+	ofs = start + lenlen;
+
+	totlen = 0;
+	for (i = 0; i < npfx; i++) {
+		size_t len = pfx[i].len;
+
+		if (len + totlen > maxlen)
+			len = maxlen - totlen;
+		if (len)
+			ring_putblk_ofs(buf, ofs + totlen, pfx[i].ptr, len);
+		totlen += len;
+	}
+
+	for (i = 0; i < nmsg; i++) {
+		size_t len = msg[i].len;
+
+		if (len + totlen > maxlen)
+			len = maxlen - totlen;
+		if (len)
+			ring_putblk_ofs(buf, ofs + totlen, msg[i].ptr, len);
+		totlen += len;
+	}
+
+	*b_peek(buf, start + needed - 1) = 0; // new read counter
+
+	/* publish our message once all those reserved before it are
+	 * published themselves, so that readers always see a contiguous
+	 * sequence of complete messages.
+	 */
+	while (HA_ATOMIC_LOAD(&buf->data) != start)
+		__ha_cpu_relax();
+	HA_ATOMIC_STORE(&buf->data, start + needed);
+
+	sent = needed;
+
+	/* notify potential readers */
+	list_for_each_entry(appctx, &ring->waiters, wait_entry)
+		appctx_wakeup(appctx);
+
+	HA_RWLOCK_RDUNLOCK(LOGSRV_LOCK, &ring->lock);
+	return sent;
+
+ slow:
+	/* the write lock excludes readers and writers, thus the reserved and
+	 * published lengths are necessarily equal again and the buffer may
+	 * be modified at will.
+	 */
 	HA_RWLOCK_WRLOCK(LOGSRV_LOCK, &ring->lock);
-	if (lenlen + totlen + 1 + 1 > b_size(buf))
-		goto done_buf;
 
-	while (b_room(buf) < lenlen + totlen + 1) {
+	while (b_room(buf) < needed) {
 		/* we need to delete the oldest message (from the end),
 		 * and we have to stop if there's a reader stuck there.
 		 * Unless there's corruption in the buffer it's guaranteed
@@ -257,6 +367,10 @@ ssize_t ring_write(struct ring *ring, size_t maxlen, const struct ist pfx[], siz
 		appctx_wakeup(appctx);
 
  done_buf:
+	/* deletions above have consumed from the published length, resync the
+	 * reserved one before letting other writers in.
+	 */
+	ring->pending = b_data(buf);
 	HA_RWLOCK_WRUNLOCK(LOGSRV_LOCK, &ring->lock);
 	return sent;
 }
@@ -344,7 +458,7 @@ int cli_io_handler_show_ring(struct appctx *appctx)
 	size_t ofs = ctx->ofs;
 	size_t last_ofs;
 	uint64_t msg_len;
-	size_t len, cnt;
+	size_t len, cnt, data;
 	int ret;
 
 	if (unlikely(sc_ic(sc)->flags & CF_SHUTW))
@@ -356,6 +470,11 @@ int cli_io_handler_show_ring(struct appctx *appctx)
 
 	HA_RWLOCK_RDLOCK(LOGSRV_LOCK, &ring->lock);
 
+	/* writers only hold the read lock as well, snapshot the published
+	 * length once so that we don't look past the last complete message.
+	 */
+	data = HA_ATOMIC_LOAD(&buf->data);
+
 	/* explanation for the initialization below: it would be better to do
 	 * this in the parsing function but this would occasionally result in
 	 * dropped events because we'd take a reference on the oldest message
@@ -369,7 +488,7 @@ int cli_io_handler_show_ring(struct appctx *appctx)
 
 		/* going to the end means looking at tail-1 */
 		if (ctx->flags & RING_WF_SEEK_NEW)
-			ofs += b_data(buf) - 1;
+			ofs += data - 1;
 
 		HA_ATOMIC_INC(b_peek(buf, ofs));
 		ofs += ring->ofs;
@@ -387,13 +506,13 @@ int cli_io_handler_show_ring(struct appctx *appctx)
 	 * stop before the end (ret=0).
 	 */
 	ret = 1;
-	while (ofs + 1 < b_data(buf)) {
+	while (ofs + 1 < data) {
 		cnt = 1;
 		len = b_peek_varint(buf, ofs + cnt, &msg_len);
 		if (!len)
 			break;
 		cnt += len;
-		BUG_ON(msg_len + ofs + cnt + 1 > b_data(buf));
+		BUG_ON(msg_len + ofs + cnt + 1 > data);
 
 		if (unlikely(msg_len + 1 > b_size(&trash))) {
 			/* too large a message to ever fit, let's skip it */
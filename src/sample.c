@@ -1243,11 +1243,12 @@ struct sample *sample_process(struct proxy *px, struct session *sess,
 		 *  - c_none => nothing to do (let's optimize it)
 		 *  - other  => apply cast and prepare to fail
 		 */
-		if (!sample_casts[p->data.type][conv_expr->conv->in_type])
+		sample_cast_fct cast = sample_casts[p->data.type][conv_expr->conv->in_type];
+
+		if (!cast)
 			return NULL;
 
-		if (sample_casts[p->data.type][conv_expr->conv->in_type] != c_none &&
-		    !sample_casts[p->data.type][conv_expr->conv->in_type](p))
+		if (cast != c_none && !cast(p))
 			return NULL;
 
 		/* OK cast succeeded */
@@ -1805,8 +1806,6 @@ static int sample_conv_sha1(const struct arg *arg_p, struct sample *smp, void *p
 	blk_SHA_CTX ctx;
 	struct buffer *trash = get_trash_chunk();
 
-	memset(&ctx, 0, sizeof(ctx));
-
 	blk_SHA1_Init(&ctx);
 	blk_SHA1_Update(&ctx, smp->data.u.str.area, smp->data.u.str.data);
 	blk_SHA1_Final((unsigned char *) trash->area, &ctx);
@@ -3802,8 +3801,11 @@ static int sample_conv_json_query(const struct arg *args, struct sample *smp, vo
 			} else {
 				double double_val;
 
-				if (mjson_get_number(smp->data.u.str.area, smp->data.u.str.data, args[0].data.str.area, &double_val) == 0)
-					return 0;
+				/* <token> points to the number which was already
+				 * validated by mjson_find(), no need to resolve
+				 * the path a second time.
+				 */
+				double_val = strtod(token, NULL);
 
 				trash->data = snprintf(trash->area,trash->size,"%g",double_val);
 				smp->data.u.str = *trash;
@@ -3824,7 +3826,11 @@ static int sample_conv_json_query(const struct arg *args, struct sample *smp, vo
 		case MJSON_TOK_STRING: {
 			int len;
 
-			len = mjson_get_string(smp->data.u.str.area, smp->data.u.str.data, args[0].data.str.area, trash->area, trash->size);
+			/* <token> points to the quoted string found by
+			 * mjson_find(), unescape it directly instead of
+			 * walking the whole document again.
+			 */
+			len = mjson_unescape(token + 1, token_size - 2, trash->area, trash->size);
 
 			if (len == -1) {
 				/* invalid string */
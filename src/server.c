@@ -31,6 +31,7 @@
 #include <haproxy/log.h>
 #include <haproxy/mailers.h>
 #include <haproxy/namespace.h>
+#include <haproxy/pool.h>
 #include <haproxy/port_range.h>
 #include <haproxy/protocol.h>
 #include <haproxy/proxy.h>
@@ -39,6 +40,7 @@
 #include <haproxy/sample.h>
 #include <haproxy/sc_strm.h>
 #include <haproxy/server.h>
+#include <haproxy/session.h>
 #include <haproxy/stats.h>
 #include <haproxy/stconn.h>
 #include <haproxy/stream.h>
@@ -146,6 +148,10 @@ static inline void srv_event_hdl_publish(struct event_hdl_sub_type event, struct
 {
 	struct event_hdl_cb_data_server cb_data;
 
+	/* don't waste time building the event data if nobody listens */
+	if (event_hdl_sub_list_empty(&srv->e_subs) && event_hdl_sub_list_empty(NULL))
+		return;
+
 	/* safe data assignments */
 	cb_data.safe.puid = srv->puid;
 	cb_data.safe.rid = srv->rid;
@@ -741,6 +747,20 @@ static int srv_parse_pool_low_conn(char **args, int *cur_arg, struct proxy *curp
 	return 0;
 }
 
+static int srv_parse_pool_min_conn(char **args, int *cur_arg, struct proxy *curproxy, struct server *newsrv, char **err)
+{
+	char *arg;
+
+	arg = args[*cur_arg + 1];
+	if (!*arg) {
+		memprintf(err, "'%s' expects <value> as argument.\n", args[*cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	newsrv->min_idle_conns = atoi(arg);
+	return 0;
+}
+
 static int srv_parse_pool_max_conn(char **args, int *cur_arg, struct proxy *curproxy, struct server *newsrv, char **err)
 {
 	char *arg;
@@ -1184,6 +1204,33 @@ static int srv_parse_send_proxy_v2(char **args, int *cur_arg,
 	return srv_enable_pp_flags(newsrv, SRV_PP_V2);
 }
 
+/* Parse the "dual-stack-delay" server keyword */
+static int srv_parse_dual_stack_delay(char **args, int *cur_arg,
+                                      struct proxy *curproxy, struct server *newsrv, char **err)
+{
+	unsigned int val;
+	const char *time_err = parse_time_err(args[*cur_arg + 1], &val, TIME_UNIT_MS);
+
+	if (time_err == PARSE_TIME_OVER) {
+		memprintf(err, "overflow in argument <%s> to <%s> of server %s, maximum value is 2147483647 ms (~24.8 days).",
+		          args[*cur_arg+1], args[*cur_arg], newsrv->id);
+		return ERR_ALERT | ERR_FATAL;
+	}
+	else if (time_err == PARSE_TIME_UNDER) {
+		memprintf(err, "underflow in argument <%s> to <%s> of server %s, minimum non-null value is 1 ms.",
+		          args[*cur_arg+1], args[*cur_arg], newsrv->id);
+		return ERR_ALERT | ERR_FATAL;
+	}
+	else if (time_err) {
+		memprintf(err, "unexpected character '%c' in 'dual-stack-delay' argument of server %s.",
+		          *time_err, newsrv->id);
+		return ERR_ALERT | ERR_FATAL;
+	}
+	newsrv->dual_stack_delay = val;
+
+	return 0;
+}
+
 /* Parse the "slowstart" server keyword */
 static int srv_parse_slowstart(char **args, int *cur_arg,
                                struct proxy *curproxy, struct server *newsrv, char **err)
@@ -1550,13 +1597,13 @@ void srv_append_status(struct buffer *msg, struct server *s,
 				" %d sessions active, %d requeued, %d remaining in queue",
 				s->proxy->srv_act, s->proxy->srv_bck,
 				(s->proxy->srv_bck && !s->proxy->srv_act) ? " Running on backup." : "",
-				s->cur_sess, xferred, s->queue.length);
+				s->cur_sess, xferred, s->queue_length);
 		else
 			chunk_appendf(msg, ". %d active and %d backup servers online.%s"
 				" %d sessions requeued, %d total in queue",
 				s->proxy->srv_act, s->proxy->srv_bck,
 				(s->proxy->srv_bck && !s->proxy->srv_act) ? " Running on backup." : "",
-				xferred, s->queue.length);
+				xferred, s->queue_length);
 	}
 }
 
@@ -1823,6 +1870,7 @@ static struct srv_kw_list srv_kws = { "ALL", { }, {
 	{ "backup",              srv_parse_backup,              0,  1,  1 }, /* Flag as backup server */
 	{ "cookie",              srv_parse_cookie,              1,  1,  0 }, /* Assign a cookie to the server */
 	{ "disabled",            srv_parse_disabled,            0,  1,  1 }, /* Start the server in 'disabled' state */
+	{ "dual-stack-delay",    srv_parse_dual_stack_delay,    1,  1,  1 }, /* Set the head start given to the preferred family before racing the other one */
 	{ "enabled",             srv_parse_enabled,             0,  1,  1 }, /* Start the server in 'enabled' state */
 	{ "error-limit",         srv_parse_error_limit,         1,  1,  1 }, /* Configure the consecutive count of check failures to consider a server on error */
 	{ "ws",                  srv_parse_ws,                  1,  1,  1 }, /* websocket protocol */
@@ -1845,6 +1893,7 @@ static struct srv_kw_list srv_kws = { "ALL", { }, {
 	{ "on-marked-up",        srv_parse_on_marked_up,        1,  1,  1 }, /* Configure the action when a server is marked up */
 	{ "pool-low-conn",       srv_parse_pool_low_conn,       1,  1,  1 }, /* Set the min number of orphan idle connecbefore being allowed to pick from other threads */
 	{ "pool-max-conn",       srv_parse_pool_max_conn,       1,  1,  1 }, /* Set the max number of orphan idle connections, -1 means unlimited */
+	{ "pool-min-conn",       srv_parse_pool_min_conn,       1,  1,  1 }, /* Set the number of idle connections to maintain by pre-warming the pool */
 	{ "pool-purge-delay",    srv_parse_pool_purge_delay,    1,  1,  1 }, /* Set the time before we destroy orphan idle connections, defaults to 1s */
 	{ "proto",               srv_parse_proto,               1,  1,  1 }, /* Set the proto to use for all outgoing connections */
 	{ "proxy-v2-options",    srv_parse_proxy_v2_options,    1,  1,  1 }, /* options for send-proxy-v2 */
@@ -2290,6 +2339,7 @@ void srv_settings_cpy(struct server *srv, const struct server *src, int srv_tmpl
 	srv->minconn                  = src->minconn;
 	srv->maxconn                  = src->maxconn;
 	srv->slowstart                = src->slowstart;
+	srv->dual_stack_delay         = src->dual_stack_delay;
 	srv->observe                  = src->observe;
 	srv->onerror                  = src->onerror;
 	srv->onmarkeddown             = src->onmarkeddown;
@@ -2340,6 +2390,7 @@ void srv_settings_cpy(struct server *srv, const struct server *src, int srv_tmpl
 	srv->pool_purge_delay = src->pool_purge_delay;
 	srv->low_idle_conns = src->low_idle_conns;
 	srv->max_idle_conns = src->max_idle_conns;
+	srv->min_idle_conns = src->min_idle_conns;
 	srv->max_reuse = src->max_reuse;
 
 	if (srv_tmpl)
@@ -2364,10 +2415,10 @@ struct server *new_server(struct proxy *proxy)
 
 	srv->obj_type = OBJ_TYPE_SERVER;
 	srv->proxy = proxy;
-	queue_init(&srv->queue, proxy, srv);
 	LIST_APPEND(&servers_list, &srv->global_list);
 	LIST_INIT(&srv->srv_rec_item);
 	LIST_INIT(&srv->ip_rec_item);
+	LIST_INIT(&srv->prewarm_list);
 	event_hdl_sub_list_init(&srv->e_subs);
 
 	srv->next_state = SRV_ST_RUNNING; /* early server setup */
@@ -3616,6 +3667,41 @@ int snr_update_srv_status(struct server *s, int has_no_ip)
  *
  * Must be called with server lock held
  */
+/* Picks in <resolution>'s response the first record of the family opposite to
+ * server <s>'s current address and saves it as the server's alternate address,
+ * used by the dual-stack connect fallback. The alternate address is cleared
+ * when no such record exists (single-stack response) or when the feature is
+ * not enabled on the server.
+ *
+ * Must be called with the server lock held.
+ */
+static void snr_update_alt_addr(struct server *s, struct resolv_resolution *resolution)
+{
+	struct resolv_answer_item *record;
+	struct eb32_node *eb32;
+	short want;
+
+	if (!s->dual_stack_delay)
+		return;
+
+	memset(&s->addr_alt, 0, sizeof(s->addr_alt));
+
+	want = (s->addr.ss_family == AF_INET) ? AF_INET6 : AF_INET;
+	for (eb32 = eb32_first(&resolution->response.answer_tree); eb32; eb32 = eb32_next(eb32)) {
+		record = eb32_entry(eb32, typeof(*record), link);
+		if (want == AF_INET && record->type == DNS_RTYPE_A) {
+			((struct sockaddr_in *)&s->addr_alt)->sin_family = AF_INET;
+			((struct sockaddr_in *)&s->addr_alt)->sin_addr = record->data.in4.sin_addr;
+			break;
+		}
+		else if (want == AF_INET6 && record->type == DNS_RTYPE_AAAA) {
+			((struct sockaddr_in6 *)&s->addr_alt)->sin6_family = AF_INET6;
+			((struct sockaddr_in6 *)&s->addr_alt)->sin6_addr = record->data.in6.sin6_addr;
+			break;
+		}
+	}
+}
+
 int snr_resolution_cb(struct resolv_requester *requester, struct dns_counters *counters)
 {
 	struct server *s = NULL;
@@ -3673,6 +3759,7 @@ int snr_resolution_cb(struct resolv_requester *requester, struct dns_counters *c
 
 	switch (ret) {
 		case RSLV_UPD_NO:
+			snr_update_alt_addr(s, resolution);
 			goto update_status;
 
 		case RSLV_UPD_SRVIP_NOT_FOUND:
@@ -3703,6 +3790,7 @@ int snr_resolution_cb(struct resolv_requester *requester, struct dns_counters *c
 	else
 		chunk_printf(chk, "DNS cache");
 	srv_update_addr(s, firstip, firstip_sin_family, (char *) chk->area);
+	snr_update_alt_addr(s, resolution);
 
  update_status:
 	if (!snr_update_srv_status(s, has_no_ip) && has_no_ip)
@@ -4162,19 +4250,13 @@ struct server *cli_find_server(struct appctx *appctx, char *arg)
 }
 
 
-/* grabs the server lock */
-static int cli_parse_set_server(char **args, char *payload, struct appctx *appctx, void *private)
+/* Applies the "set server" operation described by <args> to server <sv>.
+ * Grabs the server lock.
+ */
+static int cli_parse_set_server_op(char **args, struct appctx *appctx, struct server *sv)
 {
-	struct server *sv;
 	const char *warning;
 
-	if (!cli_has_level(appctx, ACCESS_LVL_ADMIN))
-		return 1;
-
-	sv = cli_find_server(appctx, args[2]);
-	if (!sv)
-		return 1;
-
 	if (strcmp(args[3], "weight") == 0) {
 		HA_SPIN_LOCK(SERVER_LOCK, &sv->lock);
 		warning = server_parse_weight_change_request(sv, args[4]);
@@ -4387,6 +4469,70 @@ static int cli_parse_set_server(char **args, char *payload, struct appctx *appct
 	return 1;
 }
 
+/* grabs the server lock */
+static int cli_parse_set_server(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	struct proxy *px;
+	struct server *sv;
+	char *line, *name, *next, *msg = NULL;
+	int st0;
+
+	if (!cli_has_level(appctx, ACCESS_LVL_ADMIN))
+		return 1;
+
+	if (!strchr(args[2], ',')) {
+		sv = cli_find_server(appctx, args[2]);
+		if (!sv)
+			return 1;
+		return cli_parse_set_server_op(args, appctx, sv);
+	}
+
+	/* Comma-delimited list of servers of the same backend: apply the same
+	 * operation to all of them in a single command, to spare orchestration
+	 * tools one CLI round-trip per server during mass maintenance
+	 * operations. Only the state-family settings are eligible: they take
+	 * the exact same arguments for every server and emit no message on
+	 * success, so processing may stop at the first reported message.
+	 */
+	if (strcmp(args[3], "state") != 0 && strcmp(args[3], "weight") != 0 &&
+	    strcmp(args[3], "health") != 0 && strcmp(args[3], "agent") != 0)
+		return cli_err(appctx, "A server list is only supported for 'agent', 'health', 'state' and 'weight'.\n");
+
+	/* split "backend/server1,server2" and make <line> point to the list */
+	for (line = args[2]; *line; line++)
+		if (*line == '/') {
+			*line++ = '\0';
+			break;
+		}
+
+	if (!*line || !*args[2])
+		return cli_err(appctx, "Require 'backend/server'.\n");
+
+	st0 = appctx->st0;
+	for (name = line; name; name = next) {
+		next = strchr(name, ',');
+		if (next)
+			*next++ = '\0';
+
+		if (!get_backend_server(args[2], name, &px, &sv))
+			return cli_dynerr(appctx, memprintf(&msg, "No such %s '%s'.\n",
+							    (px ? "server" : "backend"),
+							    (px ? name : args[2])));
+
+		if (px->flags & (PR_FL_DISABLED|PR_FL_STOPPED))
+			return cli_err(appctx, "Proxy is disabled.\n");
+
+		cli_parse_set_server_op(args, appctx, sv);
+
+		/* stop at the first server reporting a message, it is
+		 * returned as-is and the remaining ones are left untouched.
+		 */
+		if (appctx->st0 != st0)
+			break;
+	}
+	return 1;
+}
+
 static int cli_parse_get_weight(char **args, char *payload, struct appctx *appctx, void *private)
 {
 	struct proxy *px;
@@ -4723,6 +4869,9 @@ int srv_init_per_thr(struct server *srv)
 		MT_LIST_INIT(&srv->per_thr[i].streams);
 	}
 
+	for (i = 0; i < global.nbtgroups; i++)
+		queue_init(&srv->per_tgrp[i].queue, srv->proxy, srv);
+
 	return 0;
 }
 
@@ -5055,8 +5204,7 @@ static int cli_parse_delete_server(char **args, char *payload, struct appctx *ap
 	 * TODO idle connections should not prevent server deletion. A proper
 	 * cleanup function should be implemented to be used here.
 	 */
-	if (srv->cur_sess || srv->curr_idle_conns ||
-	    !eb_is_empty(&srv->queue.head)) {
+	if (srv->cur_sess || srv->curr_idle_conns || srv->queue_length) {
 		cli_err(appctx, "Server still has connections attached to it, cannot remove it.");
 		goto out;
 	}
@@ -5134,7 +5282,7 @@ static struct cli_kw_list cli_kws = {{ },{
 	{ { "enable", "health",  NULL },         "enable health                           : enable health checks",                                        cli_parse_enable_health, NULL },
 	{ { "enable", "server",  NULL },         "enable server  (DEPRECATED)             : enable a disabled server (use 'set server' instead)",         cli_parse_enable_server, NULL },
 	{ { "set", "maxconn", "server",  NULL }, "set maxconn server <bk>/<srv>           : change a server's maxconn setting",                           cli_parse_set_maxconn_server, NULL },
-	{ { "set", "server", NULL },             "set server <bk>/<srv> [opts]            : change a server's state, weight, address or ssl",             cli_parse_set_server },
+	{ { "set", "server", NULL },             "set server <bk>/<srv>[,...] [opts]      : change a server's state, weight, address or ssl",             cli_parse_set_server },
 	{ { "get", "weight", NULL },             "get weight <bk>/<srv>                   : report a server's current weight",                            cli_parse_get_weight },
 	{ { "set", "weight", NULL },             "set weight <bk>/<srv>  (DEPRECATED)     : change a server's weight (use 'set server' instead)",         cli_parse_set_weight },
 	{ { "add", "server", NULL },             "add server <bk>/<srv>                   : create a new server",                                         cli_parse_add_server, NULL },
@@ -5799,12 +5947,22 @@ static void srv_update_status(struct server *s)
 struct task *srv_cleanup_toremove_conns(struct task *task, void *context, unsigned int state)
 {
 	struct connection *conn;
+	int budget = CONN_CLEANUP_BATCH;
 
-	while ((conn = MT_LIST_POP(&idle_conns[tid].toremove_conns,
+	while (budget-- > 0 &&
+	       (conn = MT_LIST_POP(&idle_conns[tid].toremove_conns,
 	                               struct connection *, toremove_list)) != NULL) {
 		conn->mux->destroy(conn->ctx);
 	}
 
+	/* Mass removals may queue way more connections than what we're
+	 * willing to tear down in one run. Re-wake ourselves so that the
+	 * remaining ones are dealt with after other tasks got a chance to
+	 * run, keeping the thread's latency flat during expiry storms.
+	 */
+	if (!MT_LIST_ISEMPTY(&idle_conns[tid].toremove_conns))
+		task_wakeup(task, TASK_WOKEN_OTHER);
+
 	return task;
 }
 
@@ -5944,7 +6102,8 @@ int srv_add_to_idle_list(struct server *srv, struct connection *conn, int is_saf
 	      (is_safe || eb_is_empty(&srv->per_thr[tid].idle_conns))) ||
 	     (ha_used_fds < global.tune.pool_low_count &&
 	      (srv->curr_used_conns + srv->curr_idle_conns <=
-	       MAX(srv->curr_used_conns, srv->est_need_conns) + srv->low_idle_conns))) &&
+	       MAX(srv->curr_used_conns, srv->est_need_conns) + srv->low_idle_conns +
+	       srv->min_idle_conns))) &&
 	    !conn->mux->used_streams(conn) && conn->mux->avail_streams(conn)) {
 		int retadd;
 
@@ -6031,7 +6190,8 @@ struct task *srv_cleanup_idle_conns(struct task *task, void *context, unsigned i
 		curr_idle = srv->curr_idle_conns;
 		if (curr_idle == 0)
 			goto remove;
-		exceed_conns = srv->curr_used_conns + curr_idle - MAX(srv->max_used_conns, srv->est_need_conns);
+		exceed_conns = srv->curr_used_conns + curr_idle -
+		               MAX(MAX(srv->max_used_conns, srv->est_need_conns), srv->min_idle_conns);
 		exceed_conns = to_kill = exceed_conns / 2 + (exceed_conns & 1);
 
 		srv->est_need_conns = (srv->est_need_conns + srv->max_used_conns) / 2;
@@ -6085,6 +6245,300 @@ remove:
 	return task;
 }
 
+/* Pre-warming of the idle connections pools ("pool-min-conn").
+ *
+ * Each thread maintains its share of the configured minimum by opening and
+ * handshaking real backend connections from a periodic task, then parking
+ * them into the idle trees via the regular mux detach path. Each in-flight
+ * attempt is carried by a small context below, bound to a stream-less
+ * session and a stream connector whose only role is to catch mux wake-ups
+ * until the connection settles.
+ */
+
+#define SRV_PREWARM_BUDGET 8    /* max connection attempts per thread per wakeup */
+#define SRV_PREWARM_INTER  1000 /* delay (in ms) between two pre-warming passes */
+
+struct srv_prewarm_conn {
+	struct list list;           /* member of the thread's prewarm_conn_list */
+	struct server *srv;         /* server whose pool is being pre-warmed */
+	struct session *sess;       /* the connection's stream-less session */
+	struct stconn *sc;          /* stream connector catching mux events */
+	int expire;                 /* connect timeout for this attempt */
+};
+
+DECLARE_STATIC_POOL(pool_head_srv_prewarm, "srv_prewarm_conn", sizeof(struct srv_prewarm_conn));
+
+/* servers with a non-null pool-min-conn which passed the eligibility checks */
+static struct list prewarm_srv_list = LIST_HEAD_INIT(prewarm_srv_list);
+
+static THREAD_LOCAL struct list prewarm_conn_list;
+static THREAD_LOCAL struct task *prewarm_task = NULL;
+
+/* wake callback of the pre-warming stream connectors. The settlement logic
+ * entirely lives in the pre-warming task, so just wake it up.
+ */
+int wake_srv_prewarm(struct stconn *sc)
+{
+	if (prewarm_task)
+		task_wakeup(prewarm_task, TASK_WOKEN_OTHER);
+	return 0;
+}
+
+/* Releases pre-warming attempt <pw>. The connection's fate is decided by the
+ * mux's detach handler: a pristine, properly established connection goes to
+ * the server's idle list while a failed or expired one is closed.
+ */
+static void srv_prewarm_release(struct srv_prewarm_conn *pw)
+{
+	LIST_DELETE(&pw->list);
+	sc_destroy(pw->sc);
+	session_free(pw->sess);
+	pool_free(pool_head_srv_prewarm, pw);
+}
+
+/* Tries to start a new pre-warming connection to server <srv>, following the
+ * same setup sequence as connect_server(). Returns 1 on success and 0 on
+ * failure, in which case nothing is left allocated.
+ */
+static int srv_prewarm_start_conn(struct server *srv)
+{
+	struct conn_hash_params hash_params;
+	struct srv_prewarm_conn *pw;
+	struct connection *conn = NULL;
+	struct protocol *proto;
+	int init_mux = 1;
+
+	pw = pool_zalloc(pool_head_srv_prewarm);
+	if (!pw)
+		goto fail;
+
+	pw->srv = srv;
+	pw->sess = session_new(srv->proxy, NULL, &srv->obj_type);
+	if (!pw->sess)
+		goto fail;
+
+	pw->sc = sc_new_from_prewarm(srv, SC_FL_ISBACK);
+	if (!pw->sc)
+		goto fail;
+
+	conn = conn_new(&srv->obj_type);
+	if (!conn)
+		goto fail;
+
+	if (sc_attach_mux(pw->sc, NULL, conn) < 0) {
+		conn_free(conn);
+		conn = NULL;
+		goto fail;
+	}
+	conn->ctx = pw->sc;
+	conn->owner = pw->sess;
+
+	if (!sockaddr_alloc(&conn->dst, NULL, 0))
+		goto fail;
+
+	*conn->dst = srv->addr;
+	set_host_port(conn->dst, srv->svc_port);
+
+	/* pre-warming is only enabled on servers whose connection hash does
+	 * not depend on the stream, so only the target counts here.
+	 */
+	memset(&hash_params, 0, sizeof(hash_params));
+	hash_params.target = &srv->obj_type;
+	conn->hash_node->node.key = conn_calculate_hash(&hash_params);
+
+	proto = protocol_lookup(conn->dst->ss_family, PROTO_TYPE_STREAM, 0);
+	if (!proto || !proto->connect)
+		goto fail;
+
+	if (conn_prepare(conn, proto, srv->xprt) < 0)
+		goto fail;
+
+	if (srv->flags & SRV_F_SOCKS4_PROXY) {
+		conn->send_proxy_ofs = 1;
+		conn->flags |= CO_FL_SOCKS4;
+	}
+
+	if (proto->connect(conn, 0) != SF_ERR_NONE)
+		goto fail;
+
+	if (conn->flags & CO_FL_HANDSHAKE) {
+		if (xprt_add_hs(conn) < 0)
+			goto fail;
+	}
+
+	if (conn_xprt_start(conn) < 0)
+		goto fail;
+
+	/* Like connect_server(), defer the mux installation to the end of the
+	 * handshake when it has to be discovered through ALPN/NPN. In this
+	 * case conn_create_mux() will install it using <ctx> once the xprt
+	 * is ready.
+	 */
+	if (srv->use_ssl == 1 && (srv->ssl_ctx.alpn_str || srv->ssl_ctx.npn_str) && !srv->mux_proto)
+		init_mux = 0;
+
+	if (init_mux && conn_install_mux_be(conn, pw->sc, pw->sess, NULL) < 0)
+		goto fail;
+
+	pw->expire = tick_add(now_ms, srv->proxy->timeout.connect ?
+	                              srv->proxy->timeout.connect : MS_TO_TICKS(5000));
+	LIST_APPEND(&prewarm_conn_list, &pw->list);
+	return 1;
+
+  fail:
+	if (pw) {
+		if (pw->sc)
+			sc_destroy(pw->sc); /* also closes <conn> once attached */
+		else if (conn)
+			conn_free(conn);
+		if (pw->sess)
+			session_free(pw->sess);
+		pool_free(pool_head_srv_prewarm, pw);
+	}
+	return 0;
+}
+
+/* Per-thread pre-warming task. First settles the in-flight attempts :
+ * releasing an attempt detaches its pristine stream from the mux, which
+ * parks established connections into the idle trees and closes failed ones.
+ * Then new attempts are started, within the per-wakeup budget, for each
+ * server whose idle+in-flight count is below this thread's share of the
+ * configured minimum.
+ */
+static struct task *srv_prewarm_process(struct task *t, void *context, unsigned int state)
+{
+	struct srv_prewarm_conn *pw, *pwb;
+	struct server *srv;
+	int budget = SRV_PREWARM_BUDGET;
+
+	list_for_each_entry_safe(pw, pwb, &prewarm_conn_list, list) {
+		struct connection *conn = sc_conn(pw->sc);
+
+		if (!conn || (conn->flags & CO_FL_ERROR) || sc_ep_test(pw->sc, SE_FL_ERROR))
+			srv_prewarm_release(pw);
+		else if (conn->mux && !(conn->flags & CO_FL_WAIT_XPRT) &&
+		         (conn->mux->ctl(conn, MUX_STATUS, NULL) & MUX_STATUS_READY))
+			srv_prewarm_release(pw);
+		else if (tick_is_expired(pw->expire, now_ms))
+			srv_prewarm_release(pw);
+	}
+
+	if (stopping)
+		goto leave;
+
+	list_for_each_entry(srv, &prewarm_srv_list, prewarm_list) {
+		int target, count;
+
+		if (budget <= 0)
+			break;
+
+		/* this thread's share of the configured minimum */
+		target = srv->min_idle_conns / global.nbthread +
+		         (tid < srv->min_idle_conns % global.nbthread);
+		if (!target)
+			continue;
+
+		if (!srv_currently_usable(srv) ||
+		    (srv->proxy->flags & (PR_FL_DISABLED|PR_FL_STOPPED)))
+			continue;
+
+		if (ha_used_fds >= global.tune.pool_low_count)
+			break;
+
+		count = HA_ATOMIC_LOAD(&srv->curr_idle_thr[tid]);
+		list_for_each_entry(pw, &prewarm_conn_list, list)
+			if (pw->srv == srv)
+				count++;
+
+		while (count < target && budget > 0) {
+			if (!srv_prewarm_start_conn(srv))
+				break;
+			count++;
+			budget--;
+		}
+	}
+
+  leave:
+	t->expire = tick_add(now_ms, SRV_PREWARM_INTER);
+	return t;
+}
+
+/* Builds the list of servers eligible for idle conns pre-warming. Servers
+ * whose connection hash depends on stream contents cannot be pre-warmed
+ * since the resulting connections could never be reused.
+ */
+static int srv_prewarm_build_list()
+{
+	struct server *srv;
+	int err_code = ERR_NONE;
+
+	list_for_each_entry(srv, &servers_list, global_list) {
+		const char *reason = NULL;
+
+		if (!srv->min_idle_conns)
+			continue;
+
+		if (srv->proxy->mode != PR_MODE_HTTP)
+			reason = "the proxy is not in HTTP mode";
+		else if ((srv->proxy->options & PR_O_REUSE_MASK) == PR_O_REUSE_NEVR)
+			reason = "connection reuse is disabled";
+		else if (!srv->max_idle_conns || srv->pool_purge_delay <= 0)
+			reason = "the idle connections pool is disabled";
+		else if (!is_addr(&srv->addr) || (srv->flags & SRV_F_MAPPORTS))
+			reason = "the address or port depends on the stream";
+		else if (srv->pp_opts)
+			reason = "the PROXY protocol header depends on the stream";
+		else if (srv->ssl_ctx.sni)
+			reason = "the SNI depends on the stream";
+#if defined(CONFIG_HAP_TRANSPARENT)
+		else if ((srv->conn_src.opts & CO_SRC_BIND) ||
+		         (srv->proxy->conn_src.opts & CO_SRC_BIND))
+			reason = "the source address depends on the stream";
+#endif
+		if (reason) {
+			ha_warning("%s '%s': ignoring 'pool-min-conn' for server '%s' : %s.\n",
+			           proxy_type_str(srv->proxy), srv->proxy->id, srv->id, reason);
+			err_code |= ERR_WARN;
+			continue;
+		}
+
+		LIST_APPEND(&prewarm_srv_list, &srv->prewarm_list);
+	}
+
+	return err_code;
+}
+
+REGISTER_POST_CHECK(srv_prewarm_build_list);
+
+static int srv_prewarm_init_per_thread()
+{
+	LIST_INIT(&prewarm_conn_list);
+
+	if (LIST_ISEMPTY(&prewarm_srv_list))
+		return 1;
+
+	prewarm_task = task_new_here();
+	if (!prewarm_task)
+		return 0;
+
+	prewarm_task->process = srv_prewarm_process;
+	task_wakeup(prewarm_task, TASK_WOKEN_INIT);
+	return 1;
+}
+
+static void srv_prewarm_deinit_per_thread()
+{
+	struct srv_prewarm_conn *pw, *pwb;
+
+	list_for_each_entry_safe(pw, pwb, &prewarm_conn_list, list)
+		srv_prewarm_release(pw);
+	task_destroy(prewarm_task);
+	prewarm_task = NULL;
+}
+
+REGISTER_PER_THREAD_INIT(srv_prewarm_init_per_thread);
+REGISTER_PER_THREAD_DEINIT(srv_prewarm_deinit_per_thread);
+
 /* Close remaining idle connections. This functions is designed to be run on
  * process shutdown. This guarantees a proper socket shutdown to avoid
  * TIME_WAIT state. For a quick operation, only ctrl is closed, xprt stack is
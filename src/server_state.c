@@ -11,6 +11,7 @@
  */
 
 #include <errno.h>
+#include <sys/stat.h>
 
 #include <import/eb64tree.h>
 #include <import/ebistree.h>
@@ -515,7 +516,6 @@ static void srv_state_px_update(const struct proxy *px, int vsn, struct eb_root
 
 		/* the node may be released now */
 		eb64_delete(node);
-		free(st_line->line);
 		free(st_line);
 	}
 }
@@ -551,38 +551,29 @@ static int srv_state_get_version(FILE *f) {
 
 /*
  * parses server state line stored in <buf> and supposedly in version <version>.
- * Set <params> accordingly on success. It returns 1 on success, 0 if the line
- * must be ignored and -1 on error.
+ * The line must be zero-terminated without a trailing '\n'. Set <params>
+ * accordingly on success. It returns 1 on success, 0 if the line must be
+ * ignored and -1 on error.
  * The caller must provide a supported version
  */
 static int srv_state_parse_line(char *buf, const int version, char **params)
 {
-	int buflen, arg, ret;
+	int arg, ret;
 	char *cur;
 
-	buflen = strlen(buf);
 	cur = buf;
 	ret = 1; /* be optimistic and pretend a success */
 
-	/* we need at least one character and a non-truncated line */
-	if (buflen == 0 || buf[buflen - 1] != '\n') {
-		ret = -1;
-		goto out;
-	}
-
 	/* skip blank characters at the beginning of the line */
 	while (*cur == ' ' || *cur == '\t')
 		++cur;
 
 	/* ignore empty or commented lines */
-	if (!*cur || *cur == '\n' || *cur == '#') {
+	if (!*cur || *cur == '#') {
 		ret = 0;
 		goto out;
 	}
 
-	/* Removes trailing '\n' to ease parsing */
-	buf[buflen - 1] = '\0';
-
 	/* we're now ready to move the line into <params> */
 	memset(params, 0, SRV_STATE_FILE_MAX_FIELDS * sizeof(*params));
 	arg = 0;
@@ -658,6 +649,8 @@ static int srv_state_parse_line(char *buf, const int version, char **params)
  * in <st_tree>. If an error occurred during the parsing, the line is
  * ignored. if <px> is defined, it is used to check the backend id/name against
  * the parsed params and to compute the key of the line.
+ * The line is referenced, not copied: the storage it points to must remain
+ * valid as long as the tree is in use.
  */
 static int srv_state_parse_and_store_line(char *line, int vsn, struct eb_root *st_tree,
 					  struct proxy *px)
@@ -665,13 +658,11 @@ static int srv_state_parse_and_store_line(char *line, int vsn, struct eb_root *s
 	struct server_state_line *st_line;
 	int ret = 0;
 
-	/* store line in tree and duplicate the line */
+	/* store line in tree */
 	st_line = calloc(1, sizeof(*st_line));
 	if (st_line == NULL)
 		goto skip_line;
-	st_line->line = strdup(line);
-	if (st_line->line == NULL)
-		goto skip_line;
+	st_line->line = line;
 
 	ret = srv_state_parse_line(st_line->line, vsn, st_line->params);
 	if (ret <= 0)
@@ -723,13 +714,37 @@ static int srv_state_parse_and_store_line(char *line, int vsn, struct eb_root *s
 
   skip_line:
 	/* free up memory in case of error during the processing of the line */
-	if (st_line) {
-		free(st_line->line);
-		free(st_line);
-	}
+	free(st_line);
 	return ret;
 }
 
+/* Reads the remaining content of the opened server-state file <f> into a
+ * single zero-terminated memory block, to be released by the caller. Returns
+ * NULL on error (allocation failure or read error).
+ */
+static char *srv_state_read_file(FILE *f)
+{
+	struct stat st;
+	char *content = NULL;
+	size_t len;
+
+	if (fstat(fileno(f), &st) == -1)
+		goto out;
+
+	content = malloc(st.st_size + 1);
+	if (!content)
+		goto out;
+
+	len = fread(content, 1, st.st_size, f);
+	if (ferror(f)) {
+		ha_free(&content);
+		goto out;
+	}
+	content[len] = '\0';
+  out:
+	return content;
+}
+
 /* Helper function to get the server-state file path.
  * If <filename> starts with a '/', it is considered as an absolute path. In
  * this case or if <global.server_state_base> is not set, <filename> only is
@@ -781,7 +796,8 @@ void apply_server_state(void)
 	struct server_state_line *st_line;
 	struct eb64_node *node, *next_node;
 	FILE *f;
-	char mybuf[SRV_STATE_LINE_MAXLEN];
+	char *global_content = NULL, *local_content = NULL;
+	char *cur, *next;
 	char file[MAXPATHLEN];
 	int local_vsn, global_vsn, len, linenum;
 
@@ -809,10 +825,25 @@ void apply_server_state(void)
 		goto close_globalfile;
 	}
 
-	for (linenum = 1; fgets(mybuf, SRV_STATE_LINE_MAXLEN, f); linenum++) {
-		int ret;
+	/* Slurp the rest of the file at once and split the lines in place: this
+	 * avoids one read(), one strdup() and one copy per line, which counts
+	 * with tens of thousands of servers.
+	 */
+	global_content = srv_state_read_file(f);
+	if (!global_content) {
+		ha_warning("config: Can't read global server state file '%s'.\n", file);
+		global_vsn = 0;
+		goto close_globalfile;
+	}
 
-		ret = srv_state_parse_and_store_line(mybuf, global_vsn, &global_state_tree, NULL);
+	for (linenum = 1, cur = global_content; *cur; cur = next, linenum++) {
+		int ret = -1; /* unterminated last line: corrupted file */
+
+		next = strchr(cur, '\n');
+		if (next) {
+			*next++ = '\0';
+			ret = srv_state_parse_and_store_line(cur, global_vsn, &global_state_tree, NULL);
+		}
 		if (ret == -1) {
 			ha_warning("config: corrupted global server state file '%s' at line %d.\n",
 				   file, linenum);
@@ -879,11 +910,22 @@ void apply_server_state(void)
 			goto close_localfile;
 		}
 
+		local_content = srv_state_read_file(f);
+		if (!local_content) {
+			ha_warning("Proxy '%s': Can't read server state file '%s'.\n",
+				   curproxy->id, file);
+			goto close_localfile;
+		}
+
 		/* First, parse lines of the local server-state file and store them in a eb-tree */
-		for (linenum = 1; fgets(mybuf, SRV_STATE_LINE_MAXLEN, f); linenum++) {
-			int ret;
+		for (linenum = 1, cur = local_content; *cur; cur = next, linenum++) {
+			int ret = -1; /* unterminated last line: corrupted file */
 
-			ret = srv_state_parse_and_store_line(mybuf, local_vsn, &local_state_tree, curproxy);
+			next = strchr(cur, '\n');
+			if (next) {
+				*next++ = '\0';
+				ret = srv_state_parse_and_store_line(cur, local_vsn, &local_state_tree, curproxy);
+			}
 			if (ret == -1) {
 				ha_warning("Proxy '%s': corrupted server state file '%s' at line %d.\n",
 					   curproxy->id, file, linenum);
@@ -910,12 +952,12 @@ void apply_server_state(void)
 					 st_line->params[3], curproxy->id);
 			}
 
-			free(st_line->line);
 			free(st_line);
 			node = next_node;
 		}
 
 	close_localfile:
+		ha_free(&local_content);
 		fclose(f);
 	}
 
@@ -924,8 +966,8 @@ void apply_server_state(void)
                 st_line = eb64_entry(node, typeof(*st_line), node);
                 next_node = eb64_next(node);
                 eb64_delete(node);
-		free(st_line->line);
 		free(st_line);
                 node = next_node;
         }
+	ha_free(&global_content);
 }
@@ -10,6 +10,7 @@
  *
  */
 
+#include <haproxy/activity.h>
 #include <haproxy/api.h>
 #include <haproxy/connection.h>
 #include <haproxy/global.h>
@@ -168,6 +169,19 @@ int session_accept_fd(struct connection *cli_conn)
 
 	conn_ctrl_init(cli_conn);
 
+	if (unlikely(_HA_ATOMIC_LOAD(&th_ctx->flags) & TH_FL_OVERLOADED) &&
+	    global.tune.overload_action == OVERLOAD_ACT_REJECT &&
+	    !(l->bind_conf->options & BC_O_UNLIMITED)) {
+		/* This thread is overloaded and the "reject" action was
+		 * chosen: close with a single RST so that the client quickly
+		 * knows it has to retry elsewhere.
+		 */
+		_HA_ATOMIC_INC(&activity[tid].shed_conns);
+		setsockopt(cfd, SOL_SOCKET, SO_LINGER, (struct linger *) &nolinger, sizeof(struct linger));
+		ret = 0; /* successful termination */
+		goto out_free_conn;
+	}
+
 	/* wait for a PROXY protocol header */
 	if (l->bind_conf->options & BC_O_ACC_PROXY)
 		cli_conn->flags |= CO_FL_ACCEPT_PROXY;
@@ -11,6 +11,7 @@
  * 2 of the License, or (at your option) any later version.
  */
 
+#include <unistd.h>
 #include <sys/mman.h>
 #include <arpa/inet.h>
 #include <import/ebmbtree.h>
@@ -19,6 +20,37 @@
 
 int use_shared_mem = 0;
 
+/* Put the runs of blocks previously detached by shctx_reclaim() back into
+ * service: each block of each run gets a fresh header and is appended to the
+ * avail list. The pages they cover were possibly returned to the OS and will
+ * simply fault back in on first touch. Must be called under the shctx lock.
+ */
+static void shctx_repopulate(struct shared_context *shctx)
+{
+	struct shared_block *first, *back;
+	size_t cell = sizeof(struct shared_block) + shctx->block_size;
+
+	list_for_each_entry_safe(first, back, &shctx->reclaim, list) {
+		unsigned int count = first->len;
+		unsigned int i;
+
+		LIST_DELETE(&first->list);
+		for (i = 0; i < count; i++) {
+			struct shared_block *block;
+
+			block = (struct shared_block *)((unsigned char *)first + i * cell);
+			block->len = 0;
+			block->block_count = 1;
+			block->refcount = 0;
+			block->last_reserved = NULL;
+			block->last_append = NULL;
+			LIST_APPEND(&shctx->avail, &block->list);
+			shctx->nbav++;
+		}
+		shctx->nbrcl -= count;
+	}
+}
+
 /*
  * Reserve a new row if <first> is null, put it in the hotlist, set the refcount to 1
  * or append new blocks to the row with <first> as first block if non null.
@@ -36,6 +68,13 @@ struct shared_block *shctx_row_reserve_hot(struct shared_context *shctx,
 
 	BUG_ON(data_len < 0);
 
+	/* bring reclaimed blocks back first if what remains cannot satisfy
+	 * the demand
+	 */
+	if (unlikely(!LIST_ISEMPTY(&shctx->reclaim)) &&
+	    data_len > shctx->nbav * shctx->block_size)
+		shctx_repopulate(shctx);
+
 	/* not enough usable blocks */
 	if (data_len > shctx->nbav * shctx->block_size)
 		goto out;
@@ -291,6 +330,108 @@ int shctx_row_data_get(struct shared_context *shctx, struct shared_block *first,
 	return len;
 }
 
+/*
+ * Release up to <rows> rows from the head of the avail list, ie the least
+ * recently used objects first. The release callback is invoked for each block
+ * so that the application forgets the object, then the blocks are detached
+ * from the avail list and flagged with a nul <block_count> so that
+ * shctx_reclaim() can spot them. Must be called under the shctx lock. Returns
+ * the number of blocks released, 0 once the avail list is empty.
+ */
+int shctx_release_avail(struct shared_context *shctx, int rows)
+{
+	struct shared_block *block, *sblock, *next;
+	int released = 0;
+
+	while (rows > 0 && !LIST_ISEMPTY(&shctx->avail)) {
+		int count = 0;
+		int first_count, first_len;
+
+		next = block = LIST_NEXT(&shctx->avail, struct shared_block *, list);
+		first_count = next->block_count;
+		first_len = next->len;
+
+		list_for_each_entry_safe_from(block, sblock, &shctx->avail, list) {
+			if (first_len && shctx->free_block)
+				shctx->free_block(next, block);
+
+			block->len = 0;
+			block->block_count = 0;
+			LIST_DELETE(&block->list);
+			shctx->nbav--;
+			shctx->nbrcl++;
+			released++;
+
+			count++;
+			if (count >= first_count)
+				break;
+		}
+		rows--;
+	}
+	return released;
+}
+
+/*
+ * Walk the whole area looking for runs of contiguous blocks previously
+ * detached by shctx_release_avail(), give the pages they cover back to the OS
+ * with MADV_DONTNEED and record each run in the reclaim list. The first block
+ * of a run keeps its header as the run descriptor (<len> holds the number of
+ * blocks), the other headers may be zeroed and are rebuilt when the run is
+ * put back into service by shctx_repopulate(). Runs recorded by a previous
+ * pass are merged with newly detached neighbours. Must be called under the
+ * shctx lock. Returns the number of bytes effectively released.
+ */
+size_t shctx_reclaim(struct shared_context *shctx)
+{
+	size_t cell = sizeof(struct shared_block) + shctx->block_size;
+	size_t pagemask = sysconf(_SC_PAGESIZE) - 1;
+	size_t released = 0;
+	unsigned char *base = (unsigned char *)shctx + sizeof(struct shared_context) + shctx->extra;
+	unsigned int i = 0;
+
+	while (i < shctx->maxblocks) {
+		struct shared_block *first = (struct shared_block *)(base + i * cell);
+		unsigned int count = 0;
+		unsigned char *start, *end;
+
+		if (first->block_count) {
+			/* live block (free, avail or hot) */
+			i++;
+			continue;
+		}
+
+		while (i + count < shctx->maxblocks) {
+			struct shared_block *block;
+
+			block = (struct shared_block *)(base + (i + count) * cell);
+			if (block->block_count)
+				break;
+			if (block->len) {
+				/* descriptor of a previously recorded run,
+				 * merge it into the current one
+				 */
+				LIST_DELETE(&block->list);
+				block->len = 0;
+			}
+			count++;
+		}
+
+		first->len = count;
+		LIST_APPEND(&shctx->reclaim, &first->list);
+
+		/* only whole pages may be released, and the run descriptor
+		 * above must be preserved
+		 */
+		start = (unsigned char *)(((size_t)first->data + pagemask) & ~pagemask);
+		end   = (unsigned char *)((size_t)(base + (i + count) * cell) & ~pagemask);
+		if (end > start && madvise(start, end - start, MADV_DONTNEED) == 0)
+			released += end - start;
+
+		i += count;
+	}
+	return released;
+}
+
 /* Allocate shared memory context.
  * <maxblocks> is maximum blocks.
  * If <maxblocks> is set to less or equal to 0, ssl cache is disabled.
@@ -328,9 +469,13 @@ int shctx_init(struct shared_context **orig_shctx, int maxblocks, int blocksize,
 
 	HA_SPIN_INIT(&shctx->lock);
 	shctx->nbav = 0;
+	shctx->nbrcl = 0;
+	shctx->maxblocks = maxblocks;
+	shctx->extra = extra;
 
 	LIST_INIT(&shctx->avail);
 	LIST_INIT(&shctx->hot);
+	LIST_INIT(&shctx->reclaim);
 
 	shctx->block_size = blocksize;
 	shctx->max_obj_size = maxobjsz == (unsigned int)-1 ? 0 : maxobjsz;
@@ -315,7 +315,7 @@ static void sink_forward_io_handler(struct appctx *appctx)
 	struct ring *ring = sink->ctx.ring;
 	struct buffer *buf = &ring->buf;
 	uint64_t msg_len;
-	size_t len, cnt, ofs, last_ofs;
+	size_t len, cnt, ofs, last_ofs, data;
 	int ret = 0;
 
 	/* if stopping was requested, close immediately */
@@ -360,6 +360,11 @@ static void sink_forward_io_handler(struct appctx *appctx)
 
 	HA_RWLOCK_RDLOCK(LOGSRV_LOCK, &ring->lock);
 
+	/* writers only hold the read lock as well, snapshot the published
+	 * length once so that we don't look past the last complete message.
+	 */
+	data = HA_ATOMIC_LOAD(&buf->data);
+
 	/* explanation for the initialization below: it would be better to do
 	 * this in the parsing function but this would occasionally result in
 	 * dropped events because we'd take a reference on the oldest message
@@ -388,13 +393,13 @@ static void sink_forward_io_handler(struct appctx *appctx)
 		HA_ATOMIC_DEC(b_peek(buf, ofs));
 
 		ret = 1;
-		while (ofs + 1 < b_data(buf)) {
+		while (ofs + 1 < data) {
 			cnt = 1;
 			len = b_peek_varint(buf, ofs + cnt, &msg_len);
 			if (!len)
 				break;
 			cnt += len;
-			BUG_ON(msg_len + ofs + cnt + 1 > b_data(buf));
+			BUG_ON(msg_len + ofs + cnt + 1 > data);
 
 			if (unlikely(msg_len + 1 > b_size(&trash))) {
 				/* too large a message to ever fit, let's skip it */
@@ -462,7 +467,7 @@ static void sink_forward_oc_io_handler(struct appctx *appctx)
 	struct ring *ring = sink->ctx.ring;
 	struct buffer *buf = &ring->buf;
 	uint64_t msg_len;
-	size_t len, cnt, ofs;
+	size_t len, cnt, ofs, data;
 	int ret = 0;
 	char *p;
 
@@ -509,6 +514,11 @@ static void sink_forward_oc_io_handler(struct appctx *appctx)
 
 	HA_RWLOCK_RDLOCK(LOGSRV_LOCK, &ring->lock);
 
+	/* writers only hold the read lock as well, snapshot the published
+	 * length once so that we don't look past the last complete message.
+	 */
+	data = HA_ATOMIC_LOAD(&buf->data);
+
 	/* explanation for the initialization below: it would be better to do
 	 * this in the parsing function but this would occasionally result in
 	 * dropped events because we'd take a reference on the oldest message
@@ -537,13 +547,13 @@ static void sink_forward_oc_io_handler(struct appctx *appctx)
 		HA_ATOMIC_DEC(b_peek(buf, ofs));
 
 		ret = 1;
-		while (ofs + 1 < b_data(buf)) {
+		while (ofs + 1 < data) {
 			cnt = 1;
 			len = b_peek_varint(buf, ofs + cnt, &msg_len);
 			if (!len)
 				break;
 			cnt += len;
-			BUG_ON(msg_len + ofs + cnt + 1 > b_data(buf));
+			BUG_ON(msg_len + ofs + cnt + 1 > data);
 
 			chunk_reset(&trash);
 			p = ulltoa(msg_len, trash.area, b_size(&trash));
@@ -28,6 +28,10 @@
 #include <import/slz.h>
 #include <import/slz-tables.h>
 
+#if defined(__x86_64__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 /* First, RFC1951-specific declarations and extracts from the RFC.
  *
  * RFC1951 - deflate stream format
@@ -397,7 +401,52 @@ static inline long memmatch(const unsigned char *a, const unsigned char *b, long
 {
 	long len = 0;
 
-#ifdef UNALIGNED_LE_OK
+#if defined(__AVX2__)
+	/* Compare 32 bytes at a time, the position of the first mismatching
+	 * byte is derived from the comparison mask. The scalar tail loop also
+	 * covers the case where fewer than 32 bytes remain.
+	 */
+	while (len + 32 <= max) {
+		__m256i va   = _mm256_loadu_si256((const __m256i *)&a[len]);
+		__m256i vb   = _mm256_loadu_si256((const __m256i *)&b[len]);
+		uint32_t eq  = _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+
+		if (eq != 0xffffffff)
+			return len + __builtin_ctz(~eq);
+		len += 32;
+	}
+
+	while (len < max) {
+		if (a[len] != b[len])
+			break;
+		len++;
+	}
+	return len;
+
+#elif defined(__x86_64__) || defined(__SSE2__)
+	/* SSE2 is part of the x86_64 baseline so no runtime detection is
+	 * needed. Compare 16 bytes at a time, the position of the first
+	 * mismatching byte is derived from the comparison mask. The scalar
+	 * tail loop also covers the case where fewer than 16 bytes remain.
+	 */
+	while (len + 16 <= max) {
+		__m128i va   = _mm_loadu_si128((const __m128i *)&a[len]);
+		__m128i vb   = _mm_loadu_si128((const __m128i *)&b[len]);
+		uint32_t eq  = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+
+		if (eq != 0xffff)
+			return len + __builtin_ctz(~eq);
+		len += 16;
+	}
+
+	while (len < max) {
+		if (a[len] != b[len])
+			break;
+		len++;
+	}
+	return len;
+
+#elif defined(UNALIGNED_LE_OK)
 	unsigned long xor;
 
 	while (1) {
@@ -2936,6 +2936,11 @@ static int cli_io_handler_commit_cafile_crlfile(struct appctx *appctx)
 				ebmb_delete(&old_cafile_entry->node);
 				ssl_store_delete_cafile_entry(old_cafile_entry);
 
+				/* invalidate the client cert verification cache: the
+				 * results obtained with the old CA/CRL are now stale.
+				 */
+				HA_ATOMIC_INC(&ssl_verify_cache_gen);
+
 				ctx->old_entry = ctx->new_entry = NULL;
 				ctx->state = CACRL_ST_SUCCESS;
 				__fallthrough;
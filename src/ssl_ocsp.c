@@ -127,6 +127,7 @@ int ssl_sock_ocsp_stapling_cbk(SSL *ssl, void *arg)
 	EVP_PKEY *ssl_pkey;
 	int key_type;
 	int index;
+	unsigned int idx;
 
 	ctx = SSL_get_SSL_CTX(ssl);
 	if (!ctx)
@@ -157,18 +158,30 @@ int ssl_sock_ocsp_stapling_cbk(SSL *ssl, void *arg)
 
 	}
 
-	if (!ocsp ||
-	    !ocsp->response.area ||
-	    !ocsp->response.data ||
-	    (ocsp->expire < now.tv_sec))
+	if (!ocsp)
 		return SSL_TLSEXT_ERR_NOACK;
 
-	ssl_buf = OPENSSL_malloc(ocsp->response.data);
+	/* The response slots are double-buffered: updates fill the standby
+	 * slot and flip <response_idx> last, with a release barrier, so
+	 * loading the index then reading the designated slot is safe without
+	 * taking the tree lock. The slot that was just made inactive is left
+	 * untouched until the next update, which cannot happen before
+	 * SSL_OCSP_UPDATE_DELAY_MIN, leaving in-flight copies ample time to
+	 * complete.
+	 */
+	idx = HA_ATOMIC_LOAD(&ocsp->response_idx);
+
+	if (!ocsp->response[idx].area ||
+	    !ocsp->response[idx].data ||
+	    (ocsp->expire[idx] < now.tv_sec))
+		return SSL_TLSEXT_ERR_NOACK;
+
+	ssl_buf = OPENSSL_malloc(ocsp->response[idx].data);
 	if (!ssl_buf)
 		return SSL_TLSEXT_ERR_NOACK;
 
-	memcpy(ssl_buf, ocsp->response.area, ocsp->response.data);
-	SSL_set_tlsext_status_ocsp_resp(ssl, (unsigned char*)ssl_buf, ocsp->response.data);
+	memcpy(ssl_buf, ocsp->response[idx].area, ocsp->response[idx].data);
+	SSL_set_tlsext_status_ocsp_resp(ssl, (unsigned char*)ssl_buf, ocsp->response[idx].data);
 
 	return SSL_TLSEXT_ERR_OK;
 }
@@ -218,6 +231,7 @@ int ssl_sock_load_ocsp_response(struct buffer *ocsp_response,
 	ASN1_GENERALIZEDTIME *revtime, *thisupd, *nextupd = NULL;
 	int reason;
 	int ret = 1;
+	unsigned int idx;
 #ifdef HAVE_ASN1_TIME_TO_TM
 	struct tm nextupd_tm = {0};
 #endif
@@ -307,9 +321,14 @@ int ssl_sock_load_ocsp_response(struct buffer *ocsp_response,
 		HA_SPIN_UNLOCK(OCSP_LOCK, &ocsp_tree_lock);
 	}
 
-	/* According to comments on "chunk_dup", the
-	   previous chunk buffer will be freed */
-	if (!chunk_dup(&ocsp->response, ocsp_response)) {
+	/* Fill the standby slot and only flip <response_idx> once it is fully
+	 * built, so that the stapling callback always sees a complete
+	 * response without any lock. The buffer being replaced is the one
+	 * which was made inactive by the previous update. According to
+	 * comments on "chunk_dup", its previous chunk buffer will be freed.
+	 */
+	idx = (HA_ATOMIC_LOAD(&ocsp->response_idx) + 1) % 2;
+	if (!chunk_dup(&ocsp->response[idx], ocsp_response)) {
 		memprintf(err, "OCSP response: Memory allocation error");
 		goto out;
 	}
@@ -319,15 +338,17 @@ int ssl_sock_load_ocsp_response(struct buffer *ocsp_response,
 		memprintf(err, "OCSP single response: Invalid \"Next Update\" time");
 		goto out;
 	}
-	ocsp->expire = my_timegm(&nextupd_tm) - OCSP_MAX_RESPONSE_TIME_SKEW;
+	ocsp->expire[idx] = my_timegm(&nextupd_tm) - OCSP_MAX_RESPONSE_TIME_SKEW;
 #else
-	ocsp->expire = asn1_generalizedtime_to_epoch(nextupd) - OCSP_MAX_RESPONSE_TIME_SKEW;
-	if (ocsp->expire < 0) {
+	ocsp->expire[idx] = asn1_generalizedtime_to_epoch(nextupd) - OCSP_MAX_RESPONSE_TIME_SKEW;
+	if (ocsp->expire[idx] < 0) {
 		memprintf(err, "OCSP single response: Invalid \"Next Update\" time");
 		goto out;
 	}
 #endif
 
+	HA_ATOMIC_STORE(&ocsp->response_idx, idx);
+
 	ret = 0;
 out:
 	ERR_clear_error();
@@ -373,7 +394,8 @@ void ssl_sock_free_ocsp(struct certificate_ocsp *ocsp)
 		ocsp->issuer = NULL;
 		sk_X509_pop_free(ocsp->chain, X509_free);
 		ocsp->chain = NULL;
-		chunk_destroy(&ocsp->response);
+		chunk_destroy(&ocsp->response[0]);
+		chunk_destroy(&ocsp->response[1]);
 		if (ocsp->uri) {
 			ha_free(&ocsp->uri->area);
 			ha_free(&ocsp->uri);
@@ -515,7 +537,7 @@ int ssl_get_ocspresponse_detail(unsigned char *ocsp_certid, struct buffer *out)
 		return -1;
 	}
 
-	ret = ssl_ocsp_response_print(&ocsp->response, out);
+	ret = ssl_ocsp_response_print(&ocsp->response[HA_ATOMIC_LOAD(&ocsp->response_idx)], out);
 
 	HA_SPIN_UNLOCK(OCSP_LOCK, &ocsp_tree_lock);
 
@@ -534,7 +556,7 @@ static int cli_io_handler_show_ocspresponse_detail(struct appctx *appctx)
 	if (trash == NULL)
 		return 1;
 
-	if (ssl_ocsp_response_print(&ocsp->response, trash)) {
+	if (ssl_ocsp_response_print(&ocsp->response[HA_ATOMIC_LOAD(&ocsp->response_idx)], trash)) {
 		free_trash_chunk(trash);
 		return 1;
 	}
@@ -850,16 +872,17 @@ void ssl_destroy_ocsp_update_task(void)
 
 static inline void ssl_ocsp_set_next_update(struct certificate_ocsp *ocsp)
 {
-	int update_margin = (ocsp->expire >= SSL_OCSP_UPDATE_MARGIN) ? SSL_OCSP_UPDATE_MARGIN : 0;
+	long expire = ocsp->expire[HA_ATOMIC_LOAD(&ocsp->response_idx)];
+	int update_margin = (expire >= SSL_OCSP_UPDATE_MARGIN) ? SSL_OCSP_UPDATE_MARGIN : 0;
 
 	ocsp->next_update.key = MIN(now.tv_sec + SSL_OCSP_UPDATE_DELAY_MAX,
-	                            ocsp->expire - update_margin);
+	                            expire - update_margin);
 
 	/* An already existing valid OCSP response that expires within less than
 	 * SSL_OCSP_UPDATE_DELAY_MIN or has no 'Next Update' field should not be
 	 * updated more than once every 5 minutes in order to avoid continuous
 	 * update of the same response. */
-	if (b_data(&ocsp->response))
+	if (b_data(&ocsp->response[HA_ATOMIC_LOAD(&ocsp->response_idx)]))
 		ocsp->next_update.key = MAX(ocsp->next_update.key,
 		                            now.tv_sec + SSL_OCSP_UPDATE_DELAY_MIN);
 }
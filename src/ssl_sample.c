@@ -646,6 +646,25 @@ out:
 	return ret;
 }
 
+/* Returns the field cache of <ssl>'s client certificate, allocating it on
+ * first use, or NULL on allocation failure (in which case callers simply
+ * keep the regular extraction path).
+ */
+static struct ssl_c_cache *ssl_get_c_cache(SSL *ssl)
+{
+	struct ssl_c_cache *ccache;
+
+	ccache = SSL_get_ex_data(ssl, ssl_c_cache_index);
+	if (!ccache) {
+		ccache = pool_zalloc(pool_head_ssl_c_cache);
+		if (ccache && !SSL_set_ex_data(ssl, ssl_c_cache_index, ccache)) {
+			pool_free(pool_head_ssl_c_cache, ccache);
+			ccache = NULL;
+		}
+	}
+	return ccache;
+}
+
 /* binary, returns serial of certificate in a binary chunk.
  * The 5th keyword char is used to know if SSL_get_certificate or SSL_get_peer_certificate
  * should be use.
@@ -659,6 +678,7 @@ smp_fetch_ssl_x_serial(const struct arg *args, struct sample *smp, const char *k
 	int ret = 0;
 	struct buffer *smp_trash;
 	struct connection *conn;
+	struct ssl_c_cache *ccache;
 	SSL *ssl;
 
 	if (conn_server)
@@ -674,6 +694,15 @@ smp_fetch_ssl_x_serial(const struct arg *args, struct sample *smp, const char *k
 		return 0;
 	}
 
+	ccache = (cert_peer && !conn_server) ? ssl_get_c_cache(ssl) : NULL;
+	if (ccache && (ccache->flags & SSL_CCACHE_SERIAL) && ccache->serial_len) {
+		smp->flags = SMP_F_VOL_SESS | SMP_F_CONST;
+		smp->data.u.str.area = (char *)ccache->serial;
+		smp->data.u.str.data = ccache->serial_len;
+		smp->data.type = SMP_T_BIN;
+		return 1;
+	}
+
 	if (cert_peer)
 		crt = ssl_sock_get_peer_certificate(ssl);
 	else
@@ -686,6 +715,14 @@ smp_fetch_ssl_x_serial(const struct arg *args, struct sample *smp, const char *k
 	if (ssl_sock_get_serial(crt, smp_trash) <= 0)
 		goto out;
 
+	if (ccache && !(ccache->flags & SSL_CCACHE_SERIAL)) {
+		ccache->flags |= SSL_CCACHE_SERIAL;
+		if (smp_trash->data <= sizeof(ccache->serial)) {
+			memcpy(ccache->serial, smp_trash->area, smp_trash->data);
+			ccache->serial_len = smp_trash->data;
+		}
+	}
+
 	smp->flags = SMP_F_VOL_SESS;
 	smp->data.u.str = *smp_trash;
 	smp->data.type = SMP_T_BIN;
@@ -712,6 +749,7 @@ smp_fetch_ssl_x_sha1(const struct arg *args, struct sample *smp, const char *kw,
 	unsigned int len = 0;
 	struct buffer *smp_trash;
 	struct connection *conn;
+	struct ssl_c_cache *ccache;
 	SSL *ssl;
 
 	if (conn_server)
@@ -728,6 +766,15 @@ smp_fetch_ssl_x_sha1(const struct arg *args, struct sample *smp, const char *kw,
 		return 0;
 	}
 
+	ccache = (cert_peer && !conn_server) ? ssl_get_c_cache(ssl) : NULL;
+	if (ccache && (ccache->flags & SSL_CCACHE_SHA1)) {
+		smp->flags = SMP_F_VOL_SESS | SMP_F_CONST;
+		smp->data.u.str.area = (char *)ccache->sha1;
+		smp->data.u.str.data = sizeof(ccache->sha1);
+		smp->data.type = SMP_T_BIN;
+		return 1;
+	}
+
 	if (cert_peer)
 		crt = ssl_sock_get_peer_certificate(ssl);
 	else
@@ -739,6 +786,12 @@ smp_fetch_ssl_x_sha1(const struct arg *args, struct sample *smp, const char *kw,
 	digest = EVP_sha1();
 	X509_digest(crt, digest, (unsigned char *) smp_trash->area, &len);
 	smp_trash->data = len;
+
+	if (ccache && len == sizeof(ccache->sha1)) {
+		memcpy(ccache->sha1, smp_trash->area, len);
+		ccache->flags |= SSL_CCACHE_SHA1;
+	}
+
 	smp->flags = SMP_F_VOL_SESS;
 	smp->data.u.str = *smp_trash;
 	smp->data.type = SMP_T_BIN;
@@ -763,6 +816,7 @@ smp_fetch_ssl_x_notafter(const struct arg *args, struct sample *smp, const char
 	int ret = 0;
 	struct buffer *smp_trash;
 	struct connection *conn;
+	struct ssl_c_cache *ccache;
 	SSL *ssl;
 
 	if (conn_server)
@@ -779,6 +833,15 @@ smp_fetch_ssl_x_notafter(const struct arg *args, struct sample *smp, const char
 		return 0;
 	}
 
+	ccache = (cert_peer && !conn_server) ? ssl_get_c_cache(ssl) : NULL;
+	if (ccache && (ccache->flags & SSL_CCACHE_NOTAFTER) && ccache->notafter_len) {
+		smp->flags = SMP_F_VOL_SESS | SMP_F_CONST;
+		smp->data.u.str.area = ccache->notafter;
+		smp->data.u.str.data = ccache->notafter_len;
+		smp->data.type = SMP_T_STR;
+		return 1;
+	}
+
 	if (cert_peer)
 		crt = ssl_sock_get_peer_certificate(ssl);
 	else
@@ -790,6 +853,14 @@ smp_fetch_ssl_x_notafter(const struct arg *args, struct sample *smp, const char
 	if (ssl_sock_get_time(X509_getm_notAfter(crt), smp_trash) <= 0)
 		goto out;
 
+	if (ccache && !(ccache->flags & SSL_CCACHE_NOTAFTER)) {
+		ccache->flags |= SSL_CCACHE_NOTAFTER;
+		if (smp_trash->data <= sizeof(ccache->notafter)) {
+			memcpy(ccache->notafter, smp_trash->area, smp_trash->data);
+			ccache->notafter_len = smp_trash->data;
+		}
+	}
+
 	smp->flags = SMP_F_VOL_SESS;
 	smp->data.u.str = *smp_trash;
 	smp->data.type = SMP_T_STR;
@@ -813,8 +884,10 @@ smp_fetch_ssl_x_i_dn(const struct arg *args, struct sample *smp, const char *kw,
 	X509 *crt = NULL;
 	X509_NAME *name;
 	int ret = 0;
+	int dn_oneline;
 	struct buffer *smp_trash;
 	struct connection *conn;
+	struct ssl_c_cache *ccache;
 	SSL *ssl;
 
 	if (conn_server)
@@ -831,6 +904,20 @@ smp_fetch_ssl_x_i_dn(const struct arg *args, struct sample *smp, const char *kw,
 		return 0;
 	}
 
+	/* only the default oneline format is cached, entry or format
+	 * variants keep the regular path.
+	 */
+	dn_oneline = !(args[0].type == ARGT_STR && args[0].data.str.data > 0) &&
+	             !(args[2].type == ARGT_STR && args[2].data.str.data > 0);
+	ccache = (cert_peer && !conn_server && dn_oneline) ? ssl_get_c_cache(ssl) : NULL;
+	if (ccache && (ccache->flags & SSL_CCACHE_I_DN) && ccache->i_dn_len) {
+		smp->flags = SMP_F_VOL_SESS | SMP_F_CONST;
+		smp->data.u.str.area = ccache->i_dn;
+		smp->data.u.str.data = ccache->i_dn_len;
+		smp->data.type = SMP_T_STR;
+		return 1;
+	}
+
 	if (cert_peer)
 		crt = ssl_sock_get_peer_certificate(ssl);
 	else
@@ -859,6 +946,14 @@ smp_fetch_ssl_x_i_dn(const struct arg *args, struct sample *smp, const char *kw,
 	else if (ssl_sock_get_dn_oneline(name, smp_trash) <= 0)
 		goto out;
 
+	if (ccache && !(ccache->flags & SSL_CCACHE_I_DN)) {
+		ccache->flags |= SSL_CCACHE_I_DN;
+		if (smp_trash->data <= sizeof(ccache->i_dn)) {
+			memcpy(ccache->i_dn, smp_trash->area, smp_trash->data);
+			ccache->i_dn_len = smp_trash->data;
+		}
+	}
+
 	smp->flags = SMP_F_VOL_SESS;
 	smp->data.type = SMP_T_STR;
 	smp->data.u.str = *smp_trash;
@@ -883,6 +978,7 @@ smp_fetch_ssl_x_notbefore(const struct arg *args, struct sample *smp, const char
 	int ret = 0;
 	struct buffer *smp_trash;
 	struct connection *conn;
+	struct ssl_c_cache *ccache;
 	SSL *ssl;
 
 	if (conn_server)
@@ -899,6 +995,15 @@ smp_fetch_ssl_x_notbefore(const struct arg *args, struct sample *smp, const char
 		return 0;
 	}
 
+	ccache = (cert_peer && !conn_server) ? ssl_get_c_cache(ssl) : NULL;
+	if (ccache && (ccache->flags & SSL_CCACHE_NOTBEFORE) && ccache->notbefore_len) {
+		smp->flags = SMP_F_VOL_SESS | SMP_F_CONST;
+		smp->data.u.str.area = ccache->notbefore;
+		smp->data.u.str.data = ccache->notbefore_len;
+		smp->data.type = SMP_T_STR;
+		return 1;
+	}
+
 	if (cert_peer)
 		crt = ssl_sock_get_peer_certificate(ssl);
 	else
@@ -910,6 +1015,14 @@ smp_fetch_ssl_x_notbefore(const struct arg *args, struct sample *smp, const char
 	if (ssl_sock_get_time(X509_getm_notBefore(crt), smp_trash) <= 0)
 		goto out;
 
+	if (ccache && !(ccache->flags & SSL_CCACHE_NOTBEFORE)) {
+		ccache->flags |= SSL_CCACHE_NOTBEFORE;
+		if (smp_trash->data <= sizeof(ccache->notbefore)) {
+			memcpy(ccache->notbefore, smp_trash->area, smp_trash->data);
+			ccache->notbefore_len = smp_trash->data;
+		}
+	}
+
 	smp->flags = SMP_F_VOL_SESS;
 	smp->data.u.str = *smp_trash;
 	smp->data.type = SMP_T_STR;
@@ -933,8 +1046,10 @@ smp_fetch_ssl_x_s_dn(const struct arg *args, struct sample *smp, const char *kw,
 	X509 *crt = NULL;
 	X509_NAME *name;
 	int ret = 0;
+	int dn_oneline;
 	struct buffer *smp_trash;
 	struct connection *conn;
+	struct ssl_c_cache *ccache;
 	SSL *ssl;
 
 	if (conn_server)
@@ -951,6 +1066,20 @@ smp_fetch_ssl_x_s_dn(const struct arg *args, struct sample *smp, const char *kw,
 		return 0;
 	}
 
+	/* only the default oneline format is cached, entry or format
+	 * variants keep the regular path.
+	 */
+	dn_oneline = !(args[0].type == ARGT_STR && args[0].data.str.data > 0) &&
+	             !(args[2].type == ARGT_STR && args[2].data.str.data > 0);
+	ccache = (cert_peer && !conn_server && dn_oneline) ? ssl_get_c_cache(ssl) : NULL;
+	if (ccache && (ccache->flags & SSL_CCACHE_S_DN) && ccache->s_dn_len) {
+		smp->flags = SMP_F_VOL_SESS | SMP_F_CONST;
+		smp->data.u.str.area = ccache->s_dn;
+		smp->data.u.str.data = ccache->s_dn_len;
+		smp->data.type = SMP_T_STR;
+		return 1;
+	}
+
 	if (cert_peer)
 		crt = ssl_sock_get_peer_certificate(ssl);
 	else
@@ -979,6 +1108,14 @@ smp_fetch_ssl_x_s_dn(const struct arg *args, struct sample *smp, const char *kw,
 	else if (ssl_sock_get_dn_oneline(name, smp_trash) <= 0)
 		goto out;
 
+	if (ccache && !(ccache->flags & SSL_CCACHE_S_DN)) {
+		ccache->flags |= SSL_CCACHE_S_DN;
+		if (smp_trash->data <= sizeof(ccache->s_dn)) {
+			memcpy(ccache->s_dn, smp_trash->area, smp_trash->data);
+			ccache->s_dn_len = smp_trash->data;
+		}
+	}
+
 	smp->flags = SMP_F_VOL_SESS;
 	smp->data.type = SMP_T_STR;
 	smp->data.u.str = *smp_trash;
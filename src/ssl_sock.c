@@ -128,9 +128,11 @@ struct global_ssl global_ssl = {
 	.hard_max_record = 0,
 	.default_dh_param = SSL_DEFAULT_DH_PARAM,
 	.ctx_cache = DEFAULT_SSL_CTX_CACHE,
+	.verify_cache = 0,
 	.capture_buffer_size = 0,
 	.extra_files = SSL_GF_ALL,
 	.extra_files_noext = 0,
+	.sess_cache_shards = 8,
 #ifdef HAVE_SSL_KEYLOG
 	.keylog = 0
 #endif
@@ -467,6 +469,12 @@ struct pool_head *pool_head_ssl_keylog_str __read_mostly = NULL;
 
 int ssl_client_crt_ref_index = -1;
 
+/* Used to store the lazily extracted client certificate fields (see
+ * struct ssl_c_cache in the ssl_c_* sample fetches).
+ */
+int ssl_c_cache_index = -1;
+DECLARE_POOL(pool_head_ssl_c_cache, "ssl_c_cache", sizeof(struct ssl_c_cache));
+
 /* Used to store the client's SNI in case of ClientHello callback error */
 int ssl_client_sni_index = -1;
 
@@ -529,6 +537,18 @@ __decl_rwlock(ssl_ctx_lru_rwlock);
 
 #endif // SSL_CTRL_SET_TLSEXT_HOSTNAME
 
+/* Per-thread LRU cache of successful client certificate chain verifications,
+ * enabled with "tune.ssl.ssl-verify-cache-size". Entries are keyed by the
+ * digests of all the certificates of the presented chain and scoped to the
+ * SSL_CTX they were verified against, so that a CA file, CRL file or verify
+ * depth change never matches stale results. The generation counter is bumped
+ * each time a CA/CRL file is committed over the CLI to invalidate everything
+ * at once.
+ */
+static THREAD_LOCAL struct lru64_head *ssl_verify_lru_tree;
+static THREAD_LOCAL unsigned long long ssl_verify_lru_seed;
+unsigned long long ssl_verify_cache_gen = 1;
+
 /* The order here matters for picking a default context,
  * keep the most common keytype at the bottom of the list
  */
@@ -538,8 +558,23 @@ const char *SSL_SOCK_KEYTYPE_NAMES[] = {
 	"rsa"
 };
 
-static struct shared_context *ssl_shctx = NULL; /* ssl shared session cache */
-static struct eb_root *sh_ssl_sess_tree; /* ssl shared session tree */
+/* The shared session cache is sharded by session id so that threads storing
+ * or looking up sessions in different shards do not contend on a single lock.
+ * Each shard is a fully independent shared context with its own lock, LRU and
+ * lookup tree. ssl_shctx[0] remains the "cache enabled" indicator.
+ */
+static struct shared_context *ssl_shctx[SH_SSL_SESS_MAX_SHARDS]; /* ssl shared session cache shards */
+static struct eb_root *sh_ssl_sess_tree[SH_SSL_SESS_MAX_SHARDS]; /* ssl shared session trees */
+static unsigned int sh_ssl_sess_shard_mask; /* number of shards - 1, always a power of two - 1 */
+
+/* Returns the session cache shard index for the zero-padded session id
+ * <s_id>. Session ids are random, so the first byte evenly spreads the
+ * sessions over the shards.
+ */
+static inline unsigned int sh_ssl_sess_shard(const unsigned char *s_id)
+{
+	return s_id[0] & sh_ssl_sess_shard_mask;
+}
 
 /* Dedicated callback functions for heartbeat and clienthello.
  */
@@ -909,8 +944,11 @@ static int ssl_tlsext_ticket_key_cb(SSL *s, unsigned char key_name[16], unsigned
 		ABORT_NOW();
 	}
 
-	HA_RWLOCK_RDLOCK(TLSKEYS_REF_LOCK, &ref->lock);
-
+	/* No lock here: ticket keys are only rotated under full thread
+	 * isolation (see ssl_sock_update_tlskey_ref()), so this resumption
+	 * hot path may read them without any synchronization even with many
+	 * threads.
+	 */
 	keys = ref->tlskeys;
 	head = ref->tls_ticket_enc_index;
 
@@ -966,7 +1004,6 @@ static int ssl_tlsext_ticket_key_cb(SSL *s, unsigned char key_name[16], unsigned
 	}
 
   end:
-	HA_RWLOCK_RDUNLOCK(TLSKEYS_REF_LOCK, &ref->lock);
 	return ret;
 }
 
@@ -1008,11 +1045,17 @@ int ssl_sock_update_tlskey_ref(struct tls_keys_ref *ref,
 	else
 		return -1;
 
-	HA_RWLOCK_WRLOCK(TLSKEYS_REF_LOCK, &ref->lock);
+	/* Rotation is a rare, operator driven event, while ticket decryption
+	 * happens for almost every resumed handshake. Instead of making all
+	 * readers pay a lock, perform the update under full thread isolation:
+	 * no handshake can run concurrently, so the readers access the keys
+	 * and the encryption index without any synchronization.
+	 */
+	thread_isolate();
 	memcpy((char *) (ref->tlskeys + ((ref->tls_ticket_enc_index + 2) % TLS_TICKETS_NO)),
 	       tlskey->area, tlskey->data);
 	ref->tls_ticket_enc_index = (ref->tls_ticket_enc_index + 1) % TLS_TICKETS_NO;
-	HA_RWLOCK_WRUNLOCK(TLSKEYS_REF_LOCK, &ref->lock);
+	thread_release();
 
 	return 0;
 }
@@ -1384,6 +1427,80 @@ void ssl_sock_infocbk(const SSL *ssl, int where, int ret)
 	}
 }
 
+/* Whole-chain verification callback, installed with
+ * SSL_CTX_set_cert_verify_callback() when "tune.ssl.ssl-verify-cache-size" is
+ * set. The presented client chain is first looked up in the per-thread LRU
+ * cache, and a hit means the exact same chain was already successfully
+ * verified against the same SSL_CTX (hence the same CA file, CRL file and
+ * verify depth), so the expensive X509_verify_cert() chain and CRL walk is
+ * skipped. Only successful verifications are cached : failures stay on the
+ * regular path so that the error and its possible "ca-ignore-err" handling
+ * keep going through ssl_sock_bind_verifycbk() on every occurrence.
+ * Returns 0 to break the handshake, 1 otherwise, like X509_verify_cert().
+ */
+static int ssl_sock_verify_cache_cbk(X509_STORE_CTX *x_store, void *arg)
+{
+	SSL *ssl;
+	struct connection *conn;
+	struct ssl_sock_ctx *ctx = NULL;
+	STACK_OF(X509) *chain;
+	struct lru64 *lru = NULL;
+	unsigned long long key, gen;
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int mdlen;
+	SSL_CTX *ssl_ctx;
+	X509 *crt;
+	int i, ok;
+
+	ssl = X509_STORE_CTX_get_ex_data(x_store, SSL_get_ex_data_X509_STORE_CTX_idx());
+	crt = X509_STORE_CTX_get0_cert(x_store);
+	if (!ssl_verify_lru_tree || !ssl || !crt)
+		return X509_verify_cert(x_store);
+
+	/* hash the digests of the leaf and of every other cert of the
+	 * presented chain, so that an identical leaf sent with a different
+	 * set of intermediates cannot match a previous verification.
+	 */
+	ssl_ctx = SSL_get_SSL_CTX(ssl);
+	key = ssl_verify_lru_seed ^ (long)ssl_ctx;
+	if (X509_digest(crt, EVP_sha256(), md, &mdlen))
+		key = XXH3(md, mdlen, key);
+	chain = X509_STORE_CTX_get0_untrusted(x_store);
+	for (i = 0; i < sk_X509_num(chain); i++) {
+		if (sk_X509_value(chain, i) == crt)
+			continue;
+		if (X509_digest(sk_X509_value(chain, i), EVP_sha256(), md, &mdlen))
+			key = XXH3(md, mdlen, key);
+	}
+
+	gen = HA_ATOMIC_LOAD(&ssl_verify_cache_gen);
+	lru = lru64_get(key, ssl_verify_lru_tree, ssl_ctx, gen);
+	if (lru && lru->domain && lru->data) {
+		/* cached success: report the verification as done, as
+		 * ssl_sock_bind_verifycbk() will not be called.
+		 */
+		conn = SSL_get_ex_data(ssl, ssl_app_data_index);
+		if (conn)
+			ctx = __conn_get_ssl_sock_ctx(conn);
+#ifdef USE_QUIC
+		else {
+			struct quic_conn *qc = SSL_get_ex_data(ssl, ssl_qc_app_data_index);
+
+			if (qc)
+				ctx = qc->xprt_ctx;
+		}
+#endif
+		if (ctx)
+			ctx->xprt_st |= SSL_SOCK_ST_FL_VERIFY_DONE;
+		X509_STORE_CTX_set_error(x_store, X509_V_OK);
+		return 1;
+	}
+
+	ok = X509_verify_cert(x_store);
+	lru64_commit(lru, (ok > 0) ? (void *)1UL : NULL, ssl_ctx, gen, 0);
+	return ok;
+}
+
 /* Callback is called for each certificate of the chain during a verify
    ok is set to 1 if preverify detect no error on current certificate.
    Returns 0 to break the handshake, 1 otherwise. */
@@ -2284,6 +2401,8 @@ struct methodVersions methodVersions[] = {
 	{SSL_OP_NO_TLSv1_3, MC_SSL_O_NO_TLSV13, ctx_set_TLSv13_func, ssl_set_TLSv13_func, "TLSv1.3"}, /* CONF_TLSV13 */
 };
 
+static int ssl_sock_prep_inst_deferred(struct bind_conf *bind_conf, struct ckch_inst *inst);
+
 static void ssl_sock_switchctx_set(SSL *ssl, SSL_CTX *ctx)
 {
 	SSL_set_verify(ssl, SSL_CTX_get_verify_mode(ctx), ssl_sock_bind_verifycbk);
@@ -2325,6 +2444,7 @@ int ssl_sock_switchctx_cbk(SSL *ssl, int *al, void *arg)
 	size_t servername_len;
 	struct ebmb_node *node, *n, *node_ecdsa = NULL, *node_rsa = NULL, *node_anonymous = NULL;
 	int allow_early = 0;
+	int need_wr = 0;
 	int i;
 
 	if (conn)
@@ -2491,15 +2611,32 @@ int ssl_sock_switchctx_cbk(SSL *ssl, int *al, void *arg)
 	}
 	trash.area[i] = 0;
 
-	HA_RWLOCK_RDLOCK(SNI_LOCK, &s->sni_lock);
+sni_lookup:
+	if (need_wr)
+		HA_RWLOCK_WRLOCK(SNI_LOCK, &s->sni_lock);
+	else
+		HA_RWLOCK_RDLOCK(SNI_LOCK, &s->sni_lock);
+
+	node_ecdsa = node_rsa = node_anonymous = NULL;
 
 	/* Look for an ECDSA, RSA and DSA certificate, first in the single
 	 * name and if not found in the wildcard  */
 	for (i = 0; i < 2; i++) {
 		if (i == 0) 	/* lookup in full qualified names */
 			node = ebst_lookup(&s->sni_ctx, trash.area);
-		else if (i == 1 && wildp)  /* lookup in wildcards names */
+		else if (i == 1 && wildp) { /* lookup in wildcards names */
+			/* No need to pay a second tree walk plus the neg
+			 * filter checks when the fully qualified name already
+			 * provided the certificate type the client prefers:
+			 * wildcard entries only fill the slots left empty by
+			 * the first lookup, so they cannot change the final
+			 * choice in this case.
+			 */
+			if (has_ecdsa_sig ? node_ecdsa != NULL :
+			    (has_rsa_sig && node_rsa != NULL))
+				break;
 			node = ebst_lookup(&s->sni_w_ctx, wildp);
+		}
 		else
 			break;
 
@@ -2556,19 +2693,44 @@ int ssl_sock_switchctx_cbk(SSL *ssl, int *al, void *arg)
 
 	if (node) {
 		/* switch ctx */
-		struct ssl_bind_conf *conf = container_of(node, struct sni_ctx, name)->conf;
-		ssl_sock_switchctx_set(ssl, container_of(node, struct sni_ctx, name)->ctx);
+		struct sni_ctx *sni = container_of(node, struct sni_ctx, name);
+		struct ssl_bind_conf *conf = sni->conf;
+
+		if (unlikely(sni->ckch_inst && !sni->ckch_inst->is_prepared)) {
+			/* The preparation of this ctx was deferred by
+			 * tune.ssl.lazy-ctx-prepare. It must be performed under
+			 * the write lock, and the node may have been released
+			 * while upgrading the lock, so the lookup has to be
+			 * redone from scratch.
+			 */
+			if (!need_wr) {
+				HA_RWLOCK_RDUNLOCK(SNI_LOCK, &s->sni_lock);
+				need_wr = 1;
+				goto sni_lookup;
+			}
+			if (ssl_sock_prep_inst_deferred(s, sni->ckch_inst)) {
+				HA_RWLOCK_WRUNLOCK(SNI_LOCK, &s->sni_lock);
+				goto abort;
+			}
+		}
+		ssl_sock_switchctx_set(ssl, sni->ctx);
 		if (conf) {
 			methodVersions[conf->ssl_methods.min].ssl_set_version(ssl, SET_MIN);
 			methodVersions[conf->ssl_methods.max].ssl_set_version(ssl, SET_MAX);
 			if (conf->early_data)
 				allow_early = 1;
 		}
-		HA_RWLOCK_RDUNLOCK(SNI_LOCK, &s->sni_lock);
+		if (need_wr)
+			HA_RWLOCK_WRUNLOCK(SNI_LOCK, &s->sni_lock);
+		else
+			HA_RWLOCK_RDUNLOCK(SNI_LOCK, &s->sni_lock);
 		goto allow_early;
 	}
 
-	HA_RWLOCK_RDUNLOCK(SNI_LOCK, &s->sni_lock);
+	if (need_wr)
+		HA_RWLOCK_WRUNLOCK(SNI_LOCK, &s->sni_lock);
+	else
+		HA_RWLOCK_RDUNLOCK(SNI_LOCK, &s->sni_lock);
 #if (!defined SSL_NO_GENERATE_CERTIFICATES)
 	if (s->options & BC_O_GENERATE_CERTS && ssl_sock_generate_certificate(trash.area, s, ssl)) {
 		/* switch ctx done in ssl_sock_generate_certificate */
@@ -2634,6 +2796,7 @@ int ssl_sock_switchctx_cbk(SSL *ssl, int *al, void *priv)
 	const char *wildp = NULL;
 	struct ebmb_node *node, *n;
 	struct bind_conf *s = priv;
+	int need_wr = 0;
 #ifdef USE_QUIC
 	const uint8_t *extension_data;
 	size_t extension_len;
@@ -2688,7 +2851,11 @@ int ssl_sock_switchctx_cbk(SSL *ssl, int *al, void *priv)
 	}
 	trash.area[i] = 0;
 
-	HA_RWLOCK_RDLOCK(SNI_LOCK, &s->sni_lock);
+sni_lookup:
+	if (need_wr)
+		HA_RWLOCK_WRLOCK(SNI_LOCK, &s->sni_lock);
+	else
+		HA_RWLOCK_RDLOCK(SNI_LOCK, &s->sni_lock);
 	node = NULL;
 	/* lookup in full qualified names */
 	for (n = ebst_lookup(&s->sni_ctx, trash.area); n; n = ebmb_next_dup(n)) {
@@ -2712,22 +2879,46 @@ int ssl_sock_switchctx_cbk(SSL *ssl, int *al, void *priv)
 #if (!defined SSL_NO_GENERATE_CERTIFICATES)
 		if (s->options & BC_O_GENERATE_CERTS && ssl_sock_generate_certificate(servername, s, ssl)) {
 			/* switch ctx done in ssl_sock_generate_certificate */
-			HA_RWLOCK_RDUNLOCK(SNI_LOCK, &s->sni_lock);
-			return SSL_TLSEXT_ERR_OK;
+			goto unlock_ok;
 		}
 #endif
 		if (s->strict_sni) {
-			HA_RWLOCK_RDUNLOCK(SNI_LOCK, &s->sni_lock);
+			if (need_wr)
+				HA_RWLOCK_WRUNLOCK(SNI_LOCK, &s->sni_lock);
+			else
+				HA_RWLOCK_RDUNLOCK(SNI_LOCK, &s->sni_lock);
 			return SSL_TLSEXT_ERR_ALERT_FATAL;
 		}
 		ssl_sock_switchctx_set(ssl, s->default_ctx);
-		HA_RWLOCK_RDUNLOCK(SNI_LOCK, &s->sni_lock);
-		return SSL_TLSEXT_ERR_OK;
+		goto unlock_ok;
+	}
+
+	if (unlikely(container_of(node, struct sni_ctx, name)->ckch_inst &&
+	             !container_of(node, struct sni_ctx, name)->ckch_inst->is_prepared)) {
+		/* The preparation of this ctx was deferred by
+		 * tune.ssl.lazy-ctx-prepare. It must be performed under the
+		 * write lock, and the node may have been released while
+		 * upgrading the lock, so the lookup has to be redone from
+		 * scratch.
+		 */
+		if (!need_wr) {
+			HA_RWLOCK_RDUNLOCK(SNI_LOCK, &s->sni_lock);
+			need_wr = 1;
+			goto sni_lookup;
+		}
+		if (ssl_sock_prep_inst_deferred(s, container_of(node, struct sni_ctx, name)->ckch_inst)) {
+			HA_RWLOCK_WRUNLOCK(SNI_LOCK, &s->sni_lock);
+			return SSL_TLSEXT_ERR_ALERT_FATAL;
+		}
 	}
 
 	/* switch ctx */
 	ssl_sock_switchctx_set(ssl, container_of(node, struct sni_ctx, name)->ctx);
-	HA_RWLOCK_RDUNLOCK(SNI_LOCK, &s->sni_lock);
+ unlock_ok:
+	if (need_wr)
+		HA_RWLOCK_WRUNLOCK(SNI_LOCK, &s->sni_lock);
+	else
+		HA_RWLOCK_RDUNLOCK(SNI_LOCK, &s->sni_lock);
 	return SSL_TLSEXT_ERR_OK;
 }
 #endif /* (!) OPENSSL_IS_BORINGSSL */
@@ -4192,10 +4383,12 @@ static inline struct shared_block *sh_ssl_sess_first_block(struct sh_ssl_sess_hd
  */
 static int sh_ssl_sess_store(unsigned char *s_id, unsigned char *data, int data_len)
 {
+	unsigned int shard = sh_ssl_sess_shard(s_id);
+	struct shared_context *shctx = ssl_shctx[shard];
 	struct shared_block *first;
 	struct sh_ssl_sess_hdr *sh_ssl_sess, *oldsh_ssl_sess;
 
-	first = shctx_row_reserve_hot(ssl_shctx, NULL, data_len + sizeof(struct sh_ssl_sess_hdr));
+	first = shctx_row_reserve_hot(shctx, NULL, data_len + sizeof(struct sh_ssl_sess_hdr));
 	if (!first) {
 		/* Could not retrieve enough free blocks to store that session */
 		return 0;
@@ -4208,26 +4401,26 @@ static int sh_ssl_sess_store(unsigned char *s_id, unsigned char *data, int data_
 
 	/* it returns the already existing node
            or current node if none, never returns null */
-	oldsh_ssl_sess = sh_ssl_sess_tree_insert(sh_ssl_sess);
+	oldsh_ssl_sess = sh_ssl_sess_tree_insert(sh_ssl_sess_tree[shard], sh_ssl_sess);
 	if (oldsh_ssl_sess != sh_ssl_sess) {
 		 /* NOTE: Row couldn't be in use because we lock read & write function */
 		/* release the reserved row */
 		first->len = 0; /* the len must be liberated in order not to call the release callback on it */
-		shctx_row_dec_hot(ssl_shctx, first);
+		shctx_row_dec_hot(shctx, first);
 		/* replace the previous session already in the tree */
 		sh_ssl_sess = oldsh_ssl_sess;
 		/* ignore the previous session data, only use the header */
 		first = sh_ssl_sess_first_block(sh_ssl_sess);
-		shctx_row_inc_hot(ssl_shctx, first);
+		shctx_row_inc_hot(shctx, first);
 		first->len = sizeof(struct sh_ssl_sess_hdr);
 	}
 
-	if (shctx_row_data_append(ssl_shctx, first, NULL, data, data_len) < 0) {
-		shctx_row_dec_hot(ssl_shctx, first);
+	if (shctx_row_data_append(shctx, first, NULL, data, data_len) < 0) {
+		shctx_row_dec_hot(shctx, first);
 		return 0;
 	}
 
-	shctx_row_dec_hot(ssl_shctx, first);
+	shctx_row_dec_hot(shctx, first);
 
 	return 1;
 }
@@ -4330,10 +4523,10 @@ int sh_ssl_sess_new_cb(SSL *ssl, SSL_SESSION *sess)
 	i2d_SSL_SESSION(sess, &p);
 
 
-	shctx_lock(ssl_shctx);
+	shctx_lock(ssl_shctx[sh_ssl_sess_shard(encid)]);
 	/* store to cache */
 	sh_ssl_sess_store(encid, encsess, data_len);
-	shctx_unlock(ssl_shctx);
+	shctx_unlock(ssl_shctx[sh_ssl_sess_shard(encid)]);
 err:
 	/* reset original length values */
 	SSL_SESSION_set1_id(sess, encid, sid_length);
@@ -4350,6 +4543,7 @@ SSL_SESSION *sh_ssl_sess_get_cb(SSL *ssl, __OPENSSL_110_CONST__ unsigned char *k
 	unsigned char tmpkey[SSL_MAX_SSL_SESSION_ID_LENGTH];
 	SSL_SESSION *sess;
 	struct shared_block *first;
+	unsigned int shard;
 
 	_HA_ATOMIC_INC(&global.shctx_lookups);
 
@@ -4363,14 +4557,16 @@ SSL_SESSION *sh_ssl_sess_get_cb(SSL *ssl, __OPENSSL_110_CONST__ unsigned char *k
 		key = tmpkey;
 	}
 
+	shard = sh_ssl_sess_shard(key);
+
 	/* lock cache */
-	shctx_lock(ssl_shctx);
+	shctx_lock(ssl_shctx[shard]);
 
 	/* lookup for session */
-	sh_ssl_sess = sh_ssl_sess_tree_lookup(key);
+	sh_ssl_sess = sh_ssl_sess_tree_lookup(sh_ssl_sess_tree[shard], key);
 	if (!sh_ssl_sess) {
 		/* no session found: unlock cache and exit */
-		shctx_unlock(ssl_shctx);
+		shctx_unlock(ssl_shctx[shard]);
 		_HA_ATOMIC_INC(&global.shctx_misses);
 		return NULL;
 	}
@@ -4378,9 +4574,9 @@ SSL_SESSION *sh_ssl_sess_get_cb(SSL *ssl, __OPENSSL_110_CONST__ unsigned char *k
 	/* sh_ssl_sess (shared_block->data) is at the end of shared_block */
 	first = sh_ssl_sess_first_block(sh_ssl_sess);
 
-	shctx_row_data_get(ssl_shctx, first, data, sizeof(struct sh_ssl_sess_hdr), first->len-sizeof(struct sh_ssl_sess_hdr));
+	shctx_row_data_get(ssl_shctx[shard], first, data, sizeof(struct sh_ssl_sess_hdr), first->len-sizeof(struct sh_ssl_sess_hdr));
 
-	shctx_unlock(ssl_shctx);
+	shctx_unlock(ssl_shctx[shard]);
 
 	/* decode ASN1 session */
 	p = data;
@@ -4402,6 +4598,7 @@ void sh_ssl_sess_remove_cb(SSL_CTX *ctx, SSL_SESSION *sess)
 	unsigned char tmpkey[SSL_MAX_SSL_SESSION_ID_LENGTH];
 	unsigned int sid_length;
 	const unsigned char *sid_data;
+	unsigned int shard;
 	(void)ctx;
 
 	sid_data = SSL_SESSION_get_id(sess, &sid_length);
@@ -4412,17 +4609,19 @@ void sh_ssl_sess_remove_cb(SSL_CTX *ctx, SSL_SESSION *sess)
 		sid_data = tmpkey;
 	}
 
-	shctx_lock(ssl_shctx);
+	shard = sh_ssl_sess_shard(sid_data);
+
+	shctx_lock(ssl_shctx[shard]);
 
 	/* lookup for session */
-	sh_ssl_sess = sh_ssl_sess_tree_lookup(sid_data);
+	sh_ssl_sess = sh_ssl_sess_tree_lookup(sh_ssl_sess_tree[shard], sid_data);
 	if (sh_ssl_sess) {
 		/* free session */
 		sh_ssl_sess_tree_delete(sh_ssl_sess);
 	}
 
 	/* unlock cache */
-	shctx_unlock(ssl_shctx);
+	shctx_unlock(ssl_shctx[shard]);
 }
 
 /* Set session cache mode to server and disable openssl internal cache.
@@ -4432,7 +4631,7 @@ void ssl_set_shctx(SSL_CTX *ctx)
 {
 	SSL_CTX_set_session_id_context(ctx, (const unsigned char *)SHCTX_APPNAME, strlen(SHCTX_APPNAME));
 
-	if (!ssl_shctx) {
+	if (!ssl_shctx[0]) {
 		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
 		return;
 	}
@@ -4587,6 +4786,8 @@ static int ssl_sock_prepare_ctx(struct bind_conf *bind_conf, struct ssl_bind_con
 			break;
 	}
 	SSL_CTX_set_verify(ctx, verify, ssl_sock_bind_verifycbk);
+	if ((verify & SSL_VERIFY_PEER) && global_ssl.verify_cache)
+		SSL_CTX_set_cert_verify_callback(ctx, ssl_sock_verify_cache_cbk, NULL);
 	if (verify & SSL_VERIFY_PEER) {
 		char *ca_file = (ssl_conf && ssl_conf->ca_file) ? ssl_conf->ca_file : bind_conf->ssl_conf.ca_file;
 		char *ca_verify_file = (ssl_conf && ssl_conf->ca_verify_file) ? ssl_conf->ca_verify_file : bind_conf->ssl_conf.ca_verify_file;
@@ -4762,12 +4963,45 @@ int ssl_sock_prep_ctx_and_inst(struct bind_conf *bind_conf, struct ssl_bind_conf
 	int errcode = 0;
 
 	errcode |= ssl_sock_prepare_ctx(bind_conf, ssl_conf, ctx, err);
-	if (!errcode && ckch_inst)
+	if (!errcode && ckch_inst) {
 		ckch_inst_add_cafile_link(ckch_inst, bind_conf, ssl_conf, NULL);
+		ckch_inst->is_prepared = 1;
+	}
 
 	return errcode;
 }
 
+/* Completes the preparation of <inst>'s ctx, which was deferred at startup
+ * because of "tune.ssl.lazy-ctx-prepare". Must be called with the SNI lock of
+ * <bind_conf> held for writing. Returns 0 on success, non-zero if the ctx
+ * could not be prepared, in which case the instance is flagged so that the
+ * error is only reported once and never retried.
+ */
+static int ssl_sock_prep_inst_deferred(struct bind_conf *bind_conf, struct ckch_inst *inst)
+{
+	char *errmsg = NULL;
+	int errcode;
+
+	if (inst->is_prepared)
+		return 0;
+	if (inst->prep_failed)
+		return 1;
+
+	errcode = ssl_sock_prep_ctx_and_inst(bind_conf, inst->ssl_conf, inst->ctx, inst, &errmsg);
+	if (errcode & ERR_CODE) {
+		inst->prep_failed = 1;
+		ha_alert("Deferred preparation of the SSL context for certificate '%s' failed: %s",
+		         inst->ckch_store ? inst->ckch_store->path : "-",
+		         errmsg ? errmsg : "(no details)\n");
+		free(errmsg);
+		return 1;
+	}
+	if (errcode & ERR_WARN)
+		ha_warning("%s", errmsg);
+	free(errmsg);
+	return 0;
+}
+
 static int ssl_sock_srv_hostcheck(const char *pattern, const char *hostname)
 {
 	const char *pattern_wildcard, *pattern_left_label_end, *hostname_left_label_end;
@@ -5203,26 +5437,31 @@ int ssl_sock_prepare_all_ctx(struct bind_conf *bind_conf)
 		errcode |= ssl_sock_prep_ctx_and_inst(bind_conf, bind_conf->default_ssl_conf, bind_conf->default_ctx, bind_conf->default_inst, &errmsg);
 	}
 
-	node = ebmb_first(&bind_conf->sni_ctx);
-	while (node) {
-		sni = ebmb_entry(node, struct sni_ctx, name);
-		if (!sni->order && sni->ctx != bind_conf->default_ctx) {
-			/* only initialize the CTX on its first occurrence and
-			   if it is not the default_ctx */
-			errcode |= ssl_sock_prep_ctx_and_inst(bind_conf, sni->conf, sni->ctx, sni->ckch_inst, &errmsg);
+	/* with tune.ssl.lazy-ctx-prepare, the other contexts are prepared by
+	 * the pre-warming task or on first use from the SNI selection callback
+	 */
+	if (!global_ssl.lazy_ctx_prepare) {
+		node = ebmb_first(&bind_conf->sni_ctx);
+		while (node) {
+			sni = ebmb_entry(node, struct sni_ctx, name);
+			if (!sni->order && sni->ctx != bind_conf->default_ctx) {
+				/* only initialize the CTX on its first occurrence and
+				   if it is not the default_ctx */
+				errcode |= ssl_sock_prep_ctx_and_inst(bind_conf, sni->conf, sni->ctx, sni->ckch_inst, &errmsg);
+			}
+			node = ebmb_next(node);
 		}
-		node = ebmb_next(node);
-	}
 
-	node = ebmb_first(&bind_conf->sni_w_ctx);
-	while (node) {
-		sni = ebmb_entry(node, struct sni_ctx, name);
-		if (!sni->order && sni->ctx != bind_conf->default_ctx) {
-			/* only initialize the CTX on its first occurrence and
-			   if it is not the default_ctx */
-			errcode |= ssl_sock_prep_ctx_and_inst(bind_conf, sni->conf, sni->ctx, sni->ckch_inst, &errmsg);
+		node = ebmb_first(&bind_conf->sni_w_ctx);
+		while (node) {
+			sni = ebmb_entry(node, struct sni_ctx, name);
+			if (!sni->order && sni->ctx != bind_conf->default_ctx) {
+				/* only initialize the CTX on its first occurrence and
+				   if it is not the default_ctx */
+				errcode |= ssl_sock_prep_ctx_and_inst(bind_conf, sni->conf, sni->ctx, sni->ckch_inst, &errmsg);
+			}
+			node = ebmb_next(node);
 		}
-		node = ebmb_next(node);
 	}
 
 	if (errcode & ERR_WARN) {
@@ -5236,6 +5475,90 @@ int ssl_sock_prepare_all_ctx(struct bind_conf *bind_conf)
 	return err;
 }
 
+/* Number of deferred contexts prepared per pre-warming task wakeup, and per
+ * write lock acquisition, so that pending handshakes on the bind line being
+ * warmed are never delayed for too long.
+ */
+#define SSL_PREWARM_BUDGET 64
+#define SSL_PREWARM_CHUNK  16
+
+/* Background pre-warming task used with "tune.ssl.lazy-ctx-prepare": walks
+ * all the SSL bind lines and prepares the contexts whose preparation was
+ * deferred at startup, a small batch at a time. The trees are rescanned from
+ * the beginning after each lock release, which remains cheap since already
+ * prepared instances only cost a flag check, and keeps the walk safe against
+ * concurrent updates from the CLI. The task destroys itself once a complete
+ * pass finds nothing left to prepare.
+ */
+static struct task *ssl_sock_prewarm_ctx(struct task *t, void *context, unsigned int state)
+{
+	struct proxy *px;
+	struct bind_conf *bind_conf;
+	struct eb_root *trees[2];
+	struct ebmb_node *node;
+	struct sni_ctx *sni;
+	int budget = SSL_PREWARM_BUDGET;
+	int done, i;
+
+	for (px = proxies_list; px; px = px->next) {
+		list_for_each_entry(bind_conf, &px->conf.bind, by_fe) {
+			if (!(bind_conf->options & BC_O_USE_SSL))
+				continue;
+			trees[0] = &bind_conf->sni_ctx;
+			trees[1] = &bind_conf->sni_w_ctx;
+		rescan:
+			done = 0;
+			HA_RWLOCK_WRLOCK(SNI_LOCK, &bind_conf->sni_lock);
+			for (i = 0; i < 2; i++) {
+				for (node = ebmb_first(trees[i]); node; node = ebmb_next(node)) {
+					sni = ebmb_entry(node, struct sni_ctx, name);
+					if (!sni->ckch_inst || sni->ckch_inst->is_prepared ||
+					    sni->ckch_inst->prep_failed)
+						continue;
+					ssl_sock_prep_inst_deferred(bind_conf, sni->ckch_inst);
+					budget--;
+					if (!budget || ++done >= SSL_PREWARM_CHUNK)
+						goto unlock;
+				}
+			}
+		unlock:
+			HA_RWLOCK_WRUNLOCK(SNI_LOCK, &bind_conf->sni_lock);
+			if (!budget) {
+				task_wakeup(t, TASK_WOKEN_OTHER);
+				return t;
+			}
+			if (done >= SSL_PREWARM_CHUNK)
+				goto rescan;
+		}
+	}
+
+	/* full pass completed with budget left: nothing remains to prepare */
+	task_destroy(t);
+	return NULL;
+}
+
+/* Creates and schedules the context pre-warming task when deferred
+ * preparation was enabled. Returns ERR_NONE on success.
+ */
+static int ssl_sock_start_prewarm(void)
+{
+	struct task *t;
+
+	if (!global_ssl.lazy_ctx_prepare || global.mode & MODE_CHECK)
+		return ERR_NONE;
+
+	t = task_new_anywhere();
+	if (!t) {
+		ha_alert("Failed to allocate the SSL context pre-warming task.\n");
+		return ERR_ALERT | ERR_FATAL;
+	}
+	t->process = ssl_sock_prewarm_ctx;
+	task_wakeup(t, TASK_WOKEN_INIT);
+	return ERR_NONE;
+}
+
+REGISTER_POST_CHECK(ssl_sock_start_prewarm);
+
 /* Prepares all the contexts for a bind_conf and allocates the shared SSL
  * context if needed. Returns < 0 on error, 0 on success. The warnings and
  * alerts are directly emitted since the rest of the stack does it below.
@@ -5264,22 +5587,34 @@ int ssl_sock_prepare_bind_conf(struct bind_conf *bind_conf)
 			return -1;
 		}
 	}
-	if (!ssl_shctx && global.tune.sslcachesize) {
-		alloc_ctx = shctx_init(&ssl_shctx, global.tune.sslcachesize,
-		                       sizeof(struct sh_ssl_sess_hdr) + SHSESS_BLOCK_MIN_SIZE, -1,
-		                       sizeof(*sh_ssl_sess_tree), (global.nbthread > 1));
-		if (alloc_ctx <= 0) {
-			if (alloc_ctx == SHCTX_E_INIT_LOCK)
-				ha_alert("Unable to initialize the lock for the shared SSL session cache. You can retry using the global statement 'tune.ssl.force-private-cache' but it could increase CPU usage due to renegotiations if nbproc > 1.\n");
-			else
-				ha_alert("Unable to allocate SSL session cache.\n");
-			return -1;
+	if (!ssl_shctx[0] && global.tune.sslcachesize) {
+		int nbshards = global_ssl.sess_cache_shards;
+		int shard;
+
+		/* do not shard a small cache into segments too small to hold
+		 * a useful number of sessions each.
+		 */
+		while (nbshards > 1 && global.tune.sslcachesize / nbshards < 256)
+			nbshards /= 2;
+
+		for (shard = 0; shard < nbshards; shard++) {
+			alloc_ctx = shctx_init(&ssl_shctx[shard], global.tune.sslcachesize / nbshards,
+			                       sizeof(struct sh_ssl_sess_hdr) + SHSESS_BLOCK_MIN_SIZE, -1,
+			                       sizeof(**sh_ssl_sess_tree), (global.nbthread > 1));
+			if (alloc_ctx <= 0) {
+				if (alloc_ctx == SHCTX_E_INIT_LOCK)
+					ha_alert("Unable to initialize the lock for the shared SSL session cache. You can retry using the global statement 'tune.ssl.force-private-cache' but it could increase CPU usage due to renegotiations if nbproc > 1.\n");
+				else
+					ha_alert("Unable to allocate SSL session cache.\n");
+				return -1;
+			}
+			/* free block callback */
+			ssl_shctx[shard]->free_block = sh_ssl_sess_free_blocks;
+			/* init the root tree within the extra space */
+			sh_ssl_sess_tree[shard] = (void *)ssl_shctx[shard] + sizeof(struct shared_context);
+			*sh_ssl_sess_tree[shard] = EB_ROOT_UNIQUE;
 		}
-		/* free block callback */
-		ssl_shctx->free_block = sh_ssl_sess_free_blocks;
-		/* init the root tree within the extra space */
-		sh_ssl_sess_tree = (void *)ssl_shctx + sizeof(struct shared_context);
-		*sh_ssl_sess_tree = EB_ROOT_UNIQUE;
+		sh_ssl_sess_shard_mask = nbshards - 1;
 	}
 	err = 0;
 	/* initialize all certificate contexts */
@@ -7108,7 +7443,6 @@ static int cli_io_handler_tlskeys_files(struct appctx *appctx)
 			if (ctx->dump_entries) {
 				int head;
 
-				HA_RWLOCK_RDLOCK(TLSKEYS_REF_LOCK, &ref->lock);
 				head = ref->tls_ticket_enc_index;
 				while (ctx->next_index < TLS_TICKETS_NO) {
 					struct buffer *t2 = get_trash_chunk();
@@ -7138,12 +7472,10 @@ static int cli_io_handler_tlskeys_files(struct appctx *appctx)
 						/* let's try again later from this stream. We add ourselves into
 						 * this stream's users so that it can remove us upon termination.
 						 */
-						HA_RWLOCK_RDUNLOCK(TLSKEYS_REF_LOCK, &ref->lock);
 						return 0;
 					}
 					ctx->next_index++;
 				}
-				HA_RWLOCK_RDUNLOCK(TLSKEYS_REF_LOCK, &ref->lock);
 				ctx->next_index = 0;
 			}
 			if (applet_putchk(appctx, &trash) == -1) {
@@ -7308,7 +7640,24 @@ static struct cli_kw_list cli_kws = {{ },{
 
 INITCALL1(STG_REGISTER, cli_register_kw, &cli_kws);
 
-/* transport-layer operations for SSL sockets */
+/* transport-layer operations for SSL sockets.
+ *
+ * Note on kernel TLS: rcv_pipe/snd_pipe are left unset on purpose, and
+ * SSL_OP_ENABLE_KTLS must not naively be added to the context options.
+ * OpenSSL only engages kTLS when the SSL object sits on a socket BIO it
+ * fully controls, while here it is plugged on <ha_meth>, a custom BIO
+ * routing the records through the underlying xprt so that readiness,
+ * errors and subscriptions keep being handled by the regular conn/fd
+ * machinery: with this BIO the option is silently ignored. Bypassing
+ * OpenSSL with direct TLS_TX/TLS_RX setsockopts is no better since the
+ * library does not expose the derived traffic keys of an established
+ * session. Supporting kTLS thus means teaching this xprt to run on a
+ * socket BIO when it is stacked directly on a connected socket, without
+ * losing the fd state updates performed by raw_sock, and to keep the
+ * buffered path for renegotiations and control records. Until then the
+ * splice callbacks stay NULL, which makes the stream layer fall back to
+ * buffered copies for SSL traffic.
+ */
 struct xprt_ops ssl_sock = {
 	.snd_buf  = ssl_sock_from_buf,
 	.rcv_buf  = ssl_sock_to_buf,
@@ -7416,6 +7765,11 @@ static void ssl_sock_clt_crt_free_func(void *parent, void *ptr, CRYPTO_EX_DATA *
 	X509_free((X509*)ptr);
 }
 
+static void ssl_sock_c_cache_free_func(void *parent, void *ptr, CRYPTO_EX_DATA *ad, int idx, long argl, void *argp)
+{
+	pool_free(pool_head_ssl_c_cache, ptr);
+}
+
 static void ssl_sock_clt_sni_free_func(void *parent, void *ptr, CRYPTO_EX_DATA *ad, int idx, long argl, void *argp)
 {
 	pool_free(ssl_sock_client_sni_pool, ptr);
@@ -7471,6 +7825,7 @@ static void __ssl_sock_init(void)
 	ssl_keylog_index = SSL_get_ex_new_index(0, NULL, NULL, NULL, ssl_sock_keylog_free_func);
 #endif
 	ssl_client_crt_ref_index = SSL_get_ex_new_index(0, NULL, NULL, NULL, ssl_sock_clt_crt_free_func);
+	ssl_c_cache_index = SSL_get_ex_new_index(0, NULL, NULL, NULL, ssl_sock_c_cache_free_func);
 	ssl_client_sni_index = SSL_get_ex_new_index(0, NULL, NULL, NULL, ssl_sock_clt_sni_free_func);
 #if defined(USE_ENGINE) && !defined(OPENSSL_NO_ENGINE)
 	ENGINE_load_builtin_engines();
@@ -7633,6 +7988,23 @@ void ssl_free_dh(void) {
 }
 #endif
 
+static int ssl_verify_cache_per_thread_alloc()
+{
+	if (!global_ssl.verify_cache)
+		return 1;
+	ssl_verify_lru_seed = ha_random64();
+	ssl_verify_lru_tree = lru64_new(global_ssl.verify_cache);
+	return !!ssl_verify_lru_tree;
+}
+
+static void ssl_verify_cache_per_thread_free()
+{
+	lru64_destroy(ssl_verify_lru_tree);
+}
+
+REGISTER_PER_THREAD_ALLOC(ssl_verify_cache_per_thread_alloc);
+REGISTER_PER_THREAD_FREE(ssl_verify_cache_per_thread_free);
+
 static void __ssl_sock_deinit(void)
 {
 #if (defined SSL_CTRL_SET_TLSEXT_HOSTNAME && !defined SSL_NO_GENERATE_CERTIFICATES)
@@ -34,6 +34,7 @@
 #include <haproxy/cli.h>
 #include <haproxy/clock.h>
 #include <haproxy/compression.h>
+#include <haproxy/counters.h>
 #include <haproxy/debug.h>
 #include <haproxy/errors.h>
 #include <haproxy/fd.h>
@@ -271,6 +272,9 @@ const struct name_desc stat_fields[ST_F_TOTAL_FIELDS] = {
 	[ST_F_H1REQ]                         = { .name = "h1req",                       .desc = "Total number of HTTP/1 sessions processed by this object since the worker process started" },
 	[ST_F_H2REQ]                         = { .name = "h2req",                       .desc = "Total number of hTTP/2 sessions processed by this object since the worker process started" },
 	[ST_F_H3REQ]                         = { .name = "h3req",                       .desc = "Total number of HTTP/3 sessions processed by this object since the worker process started" },
+	[ST_F_CONNECT_TFO]                   = { .name = "connect_tfo",                 .desc = "Total number of outgoing connection attempts with data in the SYN (TCP Fast Open) on this backend/server since the worker process started" },
+	[ST_F_CONNECT_TFO_FALL]              = { .name = "connect_tfo_fall",            .desc = "Total number of TCP Fast Open attempts downgraded to a regular handshake on this backend/server since the worker process started" },
+	[ST_F_RETR_DENIED]                   = { .name = "retr_denied",                 .desc = "Total number of connection retries denied by the retry budget since the worker process started" },
 };
 
 /* one line of info */
@@ -358,23 +362,42 @@ static const char *stats_scope_ptr(struct appctx *appctx, struct stconn *sc)
  */
 
 
+/* Returns non-zero if field <field> of domain <domain> must be emitted, which
+ * is the case when no field projection was set on "show stat" or when the
+ * field is part of it. Fields registered by stats modules cannot be named in
+ * a projection, thus a projection drops them.
+ */
+static int stats_proj_field(const struct show_stat_ctx *ctx, enum stats_domain domain, int field)
+{
+	if (!(ctx->flags & STAT_PROJ_FIELDS))
+		return 1;
+	if (domain == STATS_DOMAIN_PROXY && field >= ST_F_TOTAL_FIELDS)
+		return 0;
+	if (field >= (int)(sizeof(ctx->col_mask) * 8))
+		return 0;
+	return !!(ctx->col_mask[field / 64] & (1ULL << (field % 64)));
+}
+
 /* Dumps the stats CSV header to the local trash buffer. The caller is
  * responsible for clearing it if needed.
  * NOTE: Some tools happen to rely on the field position instead of its name,
  *       so please only append new fields at the end, never in the middle.
  */
-static void stats_dump_csv_header(enum stats_domain domain)
+static void stats_dump_csv_header(enum stats_domain domain, struct show_stat_ctx *ctx)
 {
 	int field;
 
 	chunk_appendf(&trash_chunk, "# ");
 	if (stat_f[domain]) {
 		for (field = 0; field < stat_count[domain]; ++field) {
+			if (!stats_proj_field(ctx, domain, field))
+				continue;
 			chunk_appendf(&trash_chunk, "%s,", stat_f[domain][field].name);
 
 			/* print special delimiter on proxy stats to mark end of
 			   static fields */
-			if (domain == STATS_DOMAIN_PROXY && field + 1 == ST_F_TOTAL_FIELDS)
+			if (domain == STATS_DOMAIN_PROXY && field + 1 == ST_F_TOTAL_FIELDS &&
+			    !(ctx->flags & STAT_PROJ_FIELDS))
 				chunk_appendf(&trash_chunk, "-,");
 		}
 	}
@@ -598,6 +621,8 @@ static int stats_dump_fields_csv(struct buffer *out,
 	int field;
 
 	for (field = 0; field < stats_count; ++field) {
+		if (!stats_proj_field(ctx, domain, field))
+			continue;
 		if (!stats_emit_raw_data_field(out, &stats[field]))
 			return 0;
 		if (!chunk_strcat(out, ","))
@@ -605,7 +630,8 @@ static int stats_dump_fields_csv(struct buffer *out,
 
 		/* print special delimiter on proxy stats to mark end of
 		   static fields */
-		if (domain == STATS_DOMAIN_PROXY && field + 1 == ST_F_TOTAL_FIELDS) {
+		if (domain == STATS_DOMAIN_PROXY && field + 1 == ST_F_TOTAL_FIELDS &&
+		    !(ctx->flags & STAT_PROJ_FIELDS)) {
 			if (!chunk_strcat(out, "-,"))
 				return 0;
 		}
@@ -629,6 +655,9 @@ static int stats_dump_fields_typed(struct buffer *out,
 		if (!stats[field].type)
 			continue;
 
+		if (!stats_proj_field(ctx, domain, field))
+			continue;
+
 		switch (domain) {
 		case STATS_DOMAIN_PROXY:
 			chunk_appendf(out, "%c.%u.%u.%d.%s.%u:",
@@ -789,6 +818,9 @@ static int stats_dump_fields_json(struct buffer *out,
 		if (!stats[field].type)
 			continue;
 
+		if (!stats_proj_field(ctx, domain, field))
+			continue;
+
 		if (started && !chunk_strcat(out, ","))
 			goto err;
 		started = 1;
@@ -1733,10 +1765,10 @@ int stats_fill_fe_stats(struct proxy *px, struct field *stats, int len,
 				metric = mkf_u64(FN_COUNTER, px->fe_counters.cum_sess);
 				break;
 			case ST_F_BIN:
-				metric = mkf_u64(FN_COUNTER, px->fe_counters.bytes_in);
+				metric = mkf_u64(FN_COUNTER, cnt_bytes_in(px->fe_counters.shards));
 				break;
 			case ST_F_BOUT:
-				metric = mkf_u64(FN_COUNTER, px->fe_counters.bytes_out);
+				metric = mkf_u64(FN_COUNTER, cnt_bytes_out(px->fe_counters.shards));
 				break;
 			case ST_F_DREQ:
 				metric = mkf_u64(FN_COUNTER, px->fe_counters.denied_req);
@@ -2002,10 +2034,10 @@ int stats_fill_li_stats(struct proxy *px, struct listener *l, int flags,
 				metric = mkf_u64(FN_COUNTER, l->counters->cum_conn);
 				break;
 			case ST_F_BIN:
-				metric = mkf_u64(FN_COUNTER, l->counters->bytes_in);
+				metric = mkf_u64(FN_COUNTER, cnt_bytes_in(l->counters->shards));
 				break;
 			case ST_F_BOUT:
-				metric = mkf_u64(FN_COUNTER, l->counters->bytes_out);
+				metric = mkf_u64(FN_COUNTER, cnt_bytes_out(l->counters->shards));
 				break;
 			case ST_F_DREQ:
 				metric = mkf_u64(FN_COUNTER, l->counters->denied_req);
@@ -2258,7 +2290,7 @@ int stats_fill_sv_stats(struct proxy *px, struct server *sv, int flags,
 				metric = mkf_str(FO_CONFIG|FS_SERVICE, proxy_mode_str(px->mode));
 				break;
 			case ST_F_QCUR:
-				metric = mkf_u32(0, sv->queue.length);
+				metric = mkf_u32(0, sv->queue_length);
 				break;
 			case ST_F_QMAX:
 				metric = mkf_u32(FN_MAX, sv->counters.nbpend_max);
@@ -2284,10 +2316,10 @@ int stats_fill_sv_stats(struct proxy *px, struct server *sv, int flags,
 				metric = mkf_u64(FN_COUNTER, sv->counters.cum_sess);
 				break;
 			case ST_F_BIN:
-				metric = mkf_u64(FN_COUNTER, sv->counters.bytes_in);
+				metric = mkf_u64(FN_COUNTER, cnt_bytes_in(sv->counters.shards));
 				break;
 			case ST_F_BOUT:
-				metric = mkf_u64(FN_COUNTER, sv->counters.bytes_out);
+				metric = mkf_u64(FN_COUNTER, cnt_bytes_out(sv->counters.shards));
 				break;
 			case ST_F_DRESP:
 				metric = mkf_u64(FN_COUNTER, sv->counters.denied_resp);
@@ -2316,6 +2348,12 @@ int stats_fill_sv_stats(struct proxy *px, struct server *sv, int flags,
 			case ST_F_REUSE:
 				metric = mkf_u64(FN_COUNTER, sv->counters.reuse);
 				break;
+			case ST_F_CONNECT_TFO:
+				metric = mkf_u64(FN_COUNTER, sv->counters.connect_tfo);
+				break;
+			case ST_F_CONNECT_TFO_FALL:
+				metric = mkf_u64(FN_COUNTER, sv->counters.connect_tfo_fall);
+				break;
 			case ST_F_IDLE_CONN_CUR:
 				metric = mkf_u32(0, sv->curr_idle_nb);
 				break;
@@ -2735,10 +2773,10 @@ int stats_fill_be_stats(struct proxy *px, int flags, struct field *stats, int le
 				metric = mkf_u64(FN_COUNTER, px->be_counters.cum_conn);
 				break;
 			case ST_F_BIN:
-				metric = mkf_u64(FN_COUNTER, px->be_counters.bytes_in);
+				metric = mkf_u64(FN_COUNTER, cnt_bytes_in(px->be_counters.shards));
 				break;
 			case ST_F_BOUT:
-				metric = mkf_u64(FN_COUNTER, px->be_counters.bytes_out);
+				metric = mkf_u64(FN_COUNTER, cnt_bytes_out(px->be_counters.shards));
 				break;
 			case ST_F_DREQ:
 				metric = mkf_u64(FN_COUNTER, px->be_counters.denied_req);
@@ -2770,6 +2808,15 @@ int stats_fill_be_stats(struct proxy *px, int flags, struct field *stats, int le
 			case ST_F_REUSE:
 				metric = mkf_u64(FN_COUNTER, px->be_counters.reuse);
 				break;
+			case ST_F_CONNECT_TFO:
+				metric = mkf_u64(FN_COUNTER, px->be_counters.connect_tfo);
+				break;
+			case ST_F_CONNECT_TFO_FALL:
+				metric = mkf_u64(FN_COUNTER, px->be_counters.connect_tfo_fall);
+				break;
+			case ST_F_RETR_DENIED:
+				metric = mkf_u64(FN_COUNTER, px->be_counters.denied_retries);
+				break;
 			case ST_F_STATUS:
 				fld = chunk_newstr(out);
 				chunk_appendf(out, "%s", (px->lbprm.tot_weight > 0 || !px->srv) ? "UP" : "DOWN");
@@ -3891,7 +3938,7 @@ static int stats_dump_stat_to_buffer(struct stconn *sc, struct htx *htx,
 		else if (ctx->flags & STAT_FMT_JSON)
 			stats_dump_json_header();
 		else if (!(ctx->flags & STAT_FMT_TYPED))
-			stats_dump_csv_header(ctx->domain);
+			stats_dump_csv_header(ctx->domain, ctx);
 
 		if (!stats_putchk(rep, htx))
 			goto full;
@@ -5116,6 +5163,17 @@ static int cli_parse_show_info(char **args, char *payload, struct appctx *appctx
 }
 
 
+/* Returns non-zero if <tok> is one of the option keywords of "show stat",
+ * to disambiguate them from the positional <iid> <type> <sid> triplet when
+ * several options are passed.
+ */
+static int show_stat_option(const char *tok)
+{
+	return strcmp(tok, "typed") == 0 || strcmp(tok, "json") == 0 ||
+	       strcmp(tok, "desc") == 0 || strcmp(tok, "no-maint") == 0 ||
+	       strcmp(tok, "up") == 0 || strcmp(tok, "fields") == 0;
+}
+
 static int cli_parse_show_stat(char **args, char *payload, struct appctx *appctx, void *private)
 {
 	struct show_stat_ctx *ctx = applet_reserve_svcctx(appctx, sizeof(*ctx));
@@ -5144,7 +5202,8 @@ static int cli_parse_show_stat(char **args, char *payload, struct appctx *appctx
 	}
 
 	if (ctx->domain == STATS_DOMAIN_PROXY
-	    && *args[arg] && *args[arg+1] && *args[arg+2]) {
+	    && *args[arg] && *args[arg+1] && *args[arg+2]
+	    && !show_stat_option(args[arg])) {
 		struct proxy *px;
 
 		px = proxy_find_by_name(args[arg], 0, 0);
@@ -5173,6 +5232,39 @@ static int cli_parse_show_stat(char **args, char *payload, struct appctx *appctx
 			ctx->flags |= STAT_HIDE_MAINT;
 		else if (strcmp(args[arg], "up") == 0)
 			ctx->flags |= STAT_HIDE_DOWN;
+		else if (strcmp(args[arg], "fields") == 0 && *args[arg+1]) {
+			/* restrict the dump to a comma-delimited list of field
+			 * names, so that periodic scrapers which only care
+			 * about a few columns don't pay for the whole line.
+			 * Only the statically known fields may be named here.
+			 */
+			char *name, *comma;
+			int cap, f;
+
+			cap = stat_count[ctx->domain];
+			if (ctx->domain == STATS_DOMAIN_PROXY)
+				cap = ST_F_TOTAL_FIELDS;
+			if (cap > (int)(sizeof(ctx->col_mask) * 8))
+				cap = sizeof(ctx->col_mask) * 8;
+
+			for (name = args[arg+1]; name && *name; name = comma) {
+				comma = strchr(name, ',');
+				if (comma)
+					*(comma++) = 0;
+				for (f = 0; f < cap; f++)
+					if (strcmp(name, stat_f[ctx->domain][f].name) == 0)
+						break;
+				if (f == cap) {
+					char *err = NULL;
+
+					memprintf(&err, "Unknown stats field '%s'.\n", name);
+					return cli_dynerr(appctx, err);
+				}
+				ctx->col_mask[f / 64] |= 1ULL << (f % 64);
+			}
+			ctx->flags |= STAT_PROJ_FIELDS;
+			arg++;
+		}
 		arg++;
 	}
 
@@ -5438,7 +5530,7 @@ REGISTER_PER_THREAD_FREE(free_trash_counters);
 static struct cli_kw_list cli_kws = {{ },{
 	{ { "clear", "counters",  NULL },      "clear counters [all]                    : clear max statistics counters (or all counters)", cli_parse_clear_counters, NULL, NULL },
 	{ { "show", "info",  NULL },           "show info [desc|json|typed|float]*      : report information about the running process",    cli_parse_show_info, cli_io_handler_dump_info, NULL },
-	{ { "show", "stat",  NULL },           "show stat [desc|json|no-maint|typed|up]*: report counters for each proxy and server",       cli_parse_show_stat, cli_io_handler_dump_stat, NULL },
+	{ { "show", "stat",  NULL },           "show stat [desc|json|no-maint|typed|up|fields <f1,..>]*: report counters for each proxy and server",       cli_parse_show_stat, cli_io_handler_dump_stat, NULL },
 	{ { "show", "schema",  "json", NULL }, "show schema json                        : report schema used for stats",                    NULL, cli_io_handler_dump_json_schema, NULL },
 	{{},}
 }};
@@ -18,6 +18,7 @@
 #include <haproxy/pipe.h>
 #include <haproxy/pool.h>
 #include <haproxy/sc_strm.h>
+#include <haproxy/server.h>
 #include <haproxy/stconn.h>
 
 DECLARE_POOL(pool_head_connstream, "stconn", sizeof(struct stconn));
@@ -86,6 +87,16 @@ struct sc_app_ops sc_app_check_ops = {
 	.name    = "CHCK",
 };
 
+/* stream connector for server idle conns pre-warming */
+struct sc_app_ops sc_app_prewarm_ops = {
+	.chk_rcv = NULL,
+	.chk_snd = NULL,
+	.shutr   = NULL,
+	.shutw   = NULL,
+	.wake    = wake_srv_prewarm,
+	.name    = "PWRM",
+};
+
 /* Initializes an endpoint */
 void sedesc_init(struct sedesc *sedesc)
 {
@@ -214,6 +225,25 @@ struct stconn *sc_new_from_check(struct check *check, unsigned int flags)
 	return sc;
 }
 
+/* Creates a new stream connector used to pre-warm an idle connection to a
+ * server. There is no endpoint here, thus it will be created by sc_new(). So
+ * the SE_FL_DETACHED flag is set. It returns NULL on error. On success, the
+ * new stream connector is returned.
+ */
+struct stconn *sc_new_from_prewarm(struct server *srv, unsigned int flags)
+{
+	struct stconn *sc;
+
+	sc = sc_new(NULL);
+	if (unlikely(!sc))
+		return NULL;
+	sc->flags |= flags;
+	sc_ep_set(sc, SE_FL_DETACHED);
+	sc->app = &srv->obj_type;
+	sc->app_ops = &sc_app_prewarm_ops;
+	return sc;
+}
+
 /* Releases a stconn previously allocated by sc_new(), as well as its
  * endpoint, if it exists. This function is called internally or on error path.
  */
@@ -1230,7 +1260,21 @@ static void sc_notify(struct stconn *sc)
 	       !(oc->flags & (CF_AUTO_CLOSE|CF_SHUTW_NOW|CF_SHUTW))) &&
 	      (sco->state != SC_ST_EST ||
 	       (channel_is_empty(oc) && !oc->to_forward)))))) {
-		task_wakeup(task, TASK_WOKEN_IO);
+		/* When wakeup coalescing is enabled and some budget remains for
+		 * this scheduler pass, make the stream run in the same polling
+		 * loop iteration instead of transiting via the run queue again:
+		 * the event was already subject to the priority ordering when
+		 * it was dispatched to us, so requeueing only adds latency and
+		 * tree operations. The budget, refilled by the scheduler, bounds
+		 * the work processed this way so that the run queue and the
+		 * poller are still revisited under load.
+		 */
+		if (th_ctx->sched_inline_credit > 0) {
+			th_ctx->sched_inline_credit--;
+			task_instant_wakeup(task, TASK_WOKEN_IO);
+		}
+		else
+			task_wakeup(task, TASK_WOKEN_IO);
 	}
 	else {
 		/* Update expiration date for the task and requeue it */
@@ -11,8 +11,10 @@
  *
  */
 
-#include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <import/ebmbtree.h>
 #include <import/ebsttree.h>
@@ -49,6 +51,12 @@
 
 /* structure used to return a table key built from a sample */
 static THREAD_LOCAL struct stktable_key static_table_key;
+
+/* single-entry per-thread rate cache shared by the sc_* rate sample fetches,
+ * so that multiple rules checking the same counter in a single evaluation
+ * only pay the rate interpolation once.
+ */
+static THREAD_LOCAL struct freq_ctr_cache sc_rate_cache;
 static int (*smp_fetch_src)(const struct arg *, struct sample *, const char *, void *);
 struct pool_head *pool_head_stk_ctr __read_mostly = NULL;
 struct stktable *stktables_list;
@@ -56,6 +64,8 @@ struct eb_root stktable_by_name = EB_ROOT;
 
 #define round_ptr_size(i) (((i) + (sizeof(void *) - 1)) &~ (sizeof(void *) - 1))
 
+static void stktable_release(struct stktable *t, struct stksess *ts);
+
 /* This function inserts stktable <t> into the tree of known stick-table.
  * The stick-table ID is used as the storing key so it must already have
  * been initialized.
@@ -98,27 +108,41 @@ void __stksess_free(struct stktable *t, struct stksess *ts)
  */
 void stksess_free(struct stktable *t, struct stksess *ts)
 {
+	struct stktable_bucket *bkt = stktable_bucket(t, ts);
 	void *data;
+
 	data = stktable_data_ptr(t, ts, STKTABLE_DT_SERVER_KEY);
 	if (data) {
 		dict_entry_unref(&server_key_dict, stktable_data_cast(data, std_t_dict));
 		stktable_data_cast(data, std_t_dict) = NULL;
 	}
-	HA_RWLOCK_RDLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_RWLOCK_RDLOCK(STK_TABLE_LOCK, &bkt->lock);
 	__stksess_free(t, ts);
-	HA_RWLOCK_RDUNLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_RWLOCK_RDUNLOCK(STK_TABLE_LOCK, &bkt->lock);
 }
 
 /*
- * Kill an stksess (only if its ref_cnt is zero).
+ * Kill an stksess (only if its ref_cnt is zero). The caller must hold the
+ * write lock on the entry's bucket. Peers may still find the entry through
+ * the updates tree and grab a reference on it under the updates lock, so
+ * when the entry is there, it is first removed from this tree under its
+ * lock, after re-checking the refcount.
  */
 int __stksess_kill(struct stktable *t, struct stksess *ts)
 {
-	if (ts->ref_cnt)
+	if (HA_ATOMIC_LOAD(&ts->ref_cnt))
 		return 0;
 
+	if (ts->upd.node.leaf_p) {
+		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->lock);
+		if (HA_ATOMIC_LOAD(&ts->ref_cnt)) {
+			HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->lock);
+			return 0;
+		}
+		eb32_delete(&ts->upd);
+		HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->lock);
+	}
 	eb32_delete(&ts->exp);
-	eb32_delete(&ts->upd);
 	ebmb_delete(&ts->key);
 	__stksess_free(t, ts);
 	return 1;
@@ -131,28 +155,33 @@ int __stksess_kill(struct stktable *t, struct stksess *ts)
  */
 int stksess_kill(struct stktable *t, struct stksess *ts, int decrefcnt)
 {
+	struct stktable_bucket *bkt = stktable_bucket(t, ts);
 	int ret;
 
-	HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &bkt->lock);
 	if (decrefcnt)
-		ts->ref_cnt--;
+		HA_ATOMIC_DEC(&ts->ref_cnt);
 	ret = __stksess_kill(t, ts);
-	HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
 
 	return ret;
 }
 
 /*
  * Initialize or update the key in the sticky session <ts> present in table <t>
- * from the value present in <key>.
+ * from the value present in <key>. The entry's bucket is (re)computed from the
+ * stored key.
  */
 void stksess_setkey(struct stktable *t, struct stksess *ts, struct stktable_key *key)
 {
-	if (t->type != SMP_T_STR)
+	if (t->type != SMP_T_STR) {
 		memcpy(ts->key.key, key->key, t->key_size);
+		ts->bucket = stktable_calc_bucket_num(t, ts->key.key, t->key_size);
+	}
 	else {
 		memcpy(ts->key.key, key->key, MIN(t->key_size - 1, key->key_len));
 		ts->key.key[MIN(t->key_size - 1, key->key_len)] = 0;
+		ts->bucket = stktable_calc_bucket_num(t, ts->key.key, t->key_size - 1);
 	}
 }
 
@@ -171,6 +200,30 @@ int stktable_get_key_shard(struct stktable *t, const void *key, size_t len)
 	return XXH64(key, len, t->hash_seed) % t->peers.p->nb_shards + 1;
 }
 
+/* return the bucket number (0 to CONFIG_HAP_TBL_BUCKETS-1) to use for a key
+ * <key> of len <len> in table <t>. For string keys the hash stops at the
+ * first NUL character, like the tree comparisons do, so that all the ways to
+ * designate a given key always hash to the same bucket.
+ */
+uint stktable_calc_bucket_num(const struct stktable *t, const void *key, size_t len)
+{
+	if (t->type == SMP_T_STR)
+		len = strnlen(key, len);
+
+	return XXH64(key, len, t->hash_seed) & (CONFIG_HAP_TBL_BUCKETS - 1);
+}
+
+/* return the bucket number to use for lookup key <key> in table <t> */
+static uint stktable_key_bucket(const struct stktable *t, const struct stktable_key *key)
+{
+	size_t len = t->key_size;
+
+	if (t->type == SMP_T_STR)
+		len = MIN(t->key_size - 1, key->key_len);
+
+	return stktable_calc_bucket_num(t, key->key, len);
+}
+
 /*
  * Set the shard for <key> key of <ts> sticky session attached to <t> stick table.
  * Use zero for stick-table without peers synchronisation.
@@ -197,6 +250,7 @@ static struct stksess *__stksess_init(struct stktable *t, struct stksess * ts)
 	memset((void *)ts - t->data_size, 0, t->data_size);
 	ts->ref_cnt = 0;
 	ts->shard = 0;
+	ts->bucket = 0;
 	ts->key.node.leaf_p = NULL;
 	ts->exp.node.leaf_p = NULL;
 	ts->upd.node.leaf_p = NULL;
@@ -209,95 +263,98 @@ static struct stksess *__stksess_init(struct stktable *t, struct stksess * ts)
  * Trash oldest <to_batch> sticky sessions from table <t>
  * Returns number of trashed sticky sessions. It may actually trash less
  * than expected if finding these requires too long a search time (e.g.
- * most of them have ts->ref_cnt>0).
+ * most of them have ts->ref_cnt>0). The buckets are visited in turn,
+ * starting at a random one so that successive purges don't always
+ * sacrifice entries hashed into the first ones. Each bucket's lock is
+ * taken for the time needed to scan it.
  */
-int __stktable_trash_oldest(struct stktable *t, int to_batch)
+int stktable_trash_oldest(struct stktable *t, int to_batch)
 {
+	struct stktable_bucket *bkt;
 	struct stksess *ts;
 	struct eb32_node *eb;
 	int max_search = to_batch * 2; // no more than 50% misses
 	int batched = 0;
-	int looped = 0;
+	uint bucket;
+	uint i;
 
-	eb = eb32_lookup_ge(&t->exps, now_ms - TIMER_LOOK_BACK);
+	bucket = statistical_prng_range(CONFIG_HAP_TBL_BUCKETS);
 
-	while (batched < to_batch) {
+	for (i = 0; i < CONFIG_HAP_TBL_BUCKETS && batched < to_batch && max_search >= 0; i++, bucket++) {
+		int looped = 0;
 
-		if (unlikely(!eb)) {
-			/* we might have reached the end of the tree, typically because
-			 * <now_ms> is in the first half and we're first scanning the last
-			 * half. Let's loop back to the beginning of the tree now if we
-			 * have not yet visited it.
-			 */
-			if (looped)
-				break;
-			looped = 1;
-			eb = eb32_first(&t->exps);
-			if (likely(!eb))
-				break;
-		}
+		bkt = &t->buckets[bucket % CONFIG_HAP_TBL_BUCKETS];
+		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &bkt->lock);
+		eb = eb32_lookup_ge(&bkt->exps, now_ms - TIMER_LOOK_BACK);
 
-		if (--max_search < 0)
-			break;
+		while (batched < to_batch) {
 
-		/* timer looks expired, detach it from the queue */
-		ts = eb32_entry(eb, struct stksess, exp);
-		eb = eb32_next(eb);
+			if (unlikely(!eb)) {
+				/* we might have reached the end of the tree, typically because
+				 * <now_ms> is in the first half and we're first scanning the last
+				 * half. Let's loop back to the beginning of the tree now if we
+				 * have not yet visited it.
+				 */
+				if (looped)
+					break;
+				looped = 1;
+				eb = eb32_first(&bkt->exps);
+				if (likely(!eb))
+					break;
+			}
 
-		/* don't delete an entry which is currently referenced */
-		if (ts->ref_cnt)
-			continue;
+			if (--max_search < 0)
+				break;
 
-		eb32_delete(&ts->exp);
+			/* timer looks expired, detach it from the queue */
+			ts = eb32_entry(eb, struct stksess, exp);
+			eb = eb32_next(eb);
 
-		if (ts->expire != ts->exp.key) {
-			if (!tick_isset(ts->expire))
+			/* don't delete an entry which is currently referenced */
+			if (HA_ATOMIC_LOAD(&ts->ref_cnt))
 				continue;
 
-			ts->exp.key = ts->expire;
-			eb32_insert(&t->exps, &ts->exp);
-
-			/* the update might have jumped beyond the next element,
-			 * possibly causing a wrapping. We need to check whether
-			 * the next element should be used instead. If the next
-			 * element doesn't exist it means we're on the right
-			 * side and have to check the first one then. If it
-			 * exists and is closer, we must use it, otherwise we
-			 * use the current one.
-			 */
-			if (!eb)
-				eb = eb32_first(&t->exps);
+			eb32_delete(&ts->exp);
 
-			if (!eb || tick_is_lt(ts->exp.key, eb->key))
-				eb = &ts->exp;
+			if (ts->expire != ts->exp.key) {
+				if (!tick_isset(ts->expire))
+					continue;
 
-			continue;
-		}
+				ts->exp.key = ts->expire;
+				eb32_insert(&bkt->exps, &ts->exp);
 
-		/* session expired, trash it */
-		ebmb_delete(&ts->key);
-		eb32_delete(&ts->upd);
-		__stksess_free(t, ts);
-		batched++;
-	}
+				/* the update might have jumped beyond the next element,
+				 * possibly causing a wrapping. We need to check whether
+				 * the next element should be used instead. If the next
+				 * element doesn't exist it means we're on the right
+				 * side and have to check the first one then. If it
+				 * exists and is closer, we must use it, otherwise we
+				 * use the current one.
+				 */
+				if (!eb)
+					eb = eb32_first(&bkt->exps);
 
-	return batched;
-}
+				if (!eb || tick_is_lt(ts->exp.key, eb->key))
+					eb = &ts->exp;
 
-/*
- * Trash oldest <to_batch> sticky sessions from table <t>
- * Returns number of trashed sticky sessions.
- * This function locks the table
- */
-int stktable_trash_oldest(struct stktable *t, int to_batch)
-{
-	int ret;
+				continue;
+			}
 
-	HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->lock);
-	ret = __stktable_trash_oldest(t, to_batch);
-	HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->lock);
+			/* session expired, trash it */
+			if (!__stksess_kill(t, ts)) {
+				/* a peer just grabbed a reference on it through
+				 * the updates tree, leave it for a next pass.
+				 */
+				ts->exp.key = ts->expire;
+				eb32_insert(&bkt->exps, &ts->exp);
+				continue;
+			}
+			batched++;
+		}
+		HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
+	}
 
-	return ret;
+	return batched;
 }
 /*
  * Allocate and initialise a new sticky session.
@@ -336,17 +393,18 @@ struct stksess *stksess_new(struct stktable *t, struct stktable_key *key)
 }
 
 /*
- * Looks in table <t> for a sticky session matching key <key>.
- * Returns pointer on requested sticky session or NULL if none was found.
+ * Looks in bucket <bucket> of table <t> for a sticky session matching key
+ * <key>. Returns pointer on requested sticky session or NULL if none was
+ * found. The bucket's lock must be held by the caller.
  */
-struct stksess *__stktable_lookup_key(struct stktable *t, struct stktable_key *key)
+struct stksess *__stktable_lookup_key(struct stktable *t, struct stktable_key *key, uint bucket)
 {
 	struct ebmb_node *eb;
 
 	if (t->type == SMP_T_STR)
-		eb = ebst_lookup_len(&t->keys, key->key, key->key_len+1 < t->key_size ? key->key_len : t->key_size-1);
+		eb = ebst_lookup_len(&t->buckets[bucket].keys, key->key, key->key_len+1 < t->key_size ? key->key_len : t->key_size-1);
 	else
-		eb = ebmb_lookup(&t->keys, key->key, t->key_size);
+		eb = ebmb_lookup(&t->buckets[bucket].keys, key->key, t->key_size);
 
 	if (unlikely(!eb)) {
 		/* no session found */
@@ -360,33 +418,36 @@ struct stksess *__stktable_lookup_key(struct stktable *t, struct stktable_key *k
  * Looks in table <t> for a sticky session matching key <key>.
  * Returns pointer on requested sticky session or NULL if none was found.
  * The refcount of the found entry is increased and this function
- * is protected using the table lock
+ * is protected using the bucket lock
  */
 struct stksess *stktable_lookup_key(struct stktable *t, struct stktable_key *key)
 {
+	uint bucket = stktable_key_bucket(t, key);
 	struct stksess *ts;
 
-	HA_RWLOCK_RDLOCK(STK_TABLE_LOCK, &t->lock);
-	ts = __stktable_lookup_key(t, key);
+	HA_RWLOCK_RDLOCK(STK_TABLE_LOCK, &t->buckets[bucket].lock);
+	ts = __stktable_lookup_key(t, key, bucket);
 	if (ts)
 		HA_ATOMIC_INC(&ts->ref_cnt);
-	HA_RWLOCK_RDUNLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_RWLOCK_RDUNLOCK(STK_TABLE_LOCK, &t->buckets[bucket].lock);
 
 	return ts;
 }
 
 /*
- * Looks in table <t> for a sticky session with same key as <ts>.
- * Returns pointer on requested sticky session or NULL if none was found.
+ * Looks in table <t> for a sticky session with same key as <ts>, which must
+ * have its ->bucket properly set. Returns pointer on requested sticky session
+ * or NULL if none was found. The bucket's lock must be held by the caller.
  */
 struct stksess *__stktable_lookup(struct stktable *t, struct stksess *ts)
 {
+	struct stktable_bucket *bkt = stktable_bucket(t, ts);
 	struct ebmb_node *eb;
 
 	if (t->type == SMP_T_STR)
-		eb = ebst_lookup(&(t->keys), (char *)ts->key.key);
+		eb = ebst_lookup(&bkt->keys, (char *)ts->key.key);
 	else
-		eb = ebmb_lookup(&(t->keys), ts->key.key, t->key_size);
+		eb = ebmb_lookup(&bkt->keys, ts->key.key, t->key_size);
 
 	if (unlikely(!eb))
 		return NULL;
@@ -398,17 +459,18 @@ struct stksess *__stktable_lookup(struct stktable *t, struct stksess *ts)
  * Looks in table <t> for a sticky session with same key as <ts>.
  * Returns pointer on requested sticky session or NULL if none was found.
  * The refcount of the found entry is increased and this function
- * is protected using the table lock
+ * is protected using the bucket lock
  */
 struct stksess *stktable_lookup(struct stktable *t, struct stksess *ts)
 {
+	struct stktable_bucket *bkt = stktable_bucket(t, ts);
 	struct stksess *lts;
 
-	HA_RWLOCK_RDLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_RWLOCK_RDLOCK(STK_TABLE_LOCK, &bkt->lock);
 	lts = __stktable_lookup(t, ts);
 	if (lts)
 		HA_ATOMIC_INC(&lts->ref_cnt);
-	HA_RWLOCK_RDUNLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_RWLOCK_RDUNLOCK(STK_TABLE_LOCK, &bkt->lock);
 
 	return lts;
 }
@@ -470,18 +532,11 @@ void stktable_touch_with_exp(struct stktable *t, struct stksess *ts, int local,
 		}
 	}
 
-	if (decrefcnt) {
-		if (locked)
-			ts->ref_cnt--;
-		else {
-			HA_RWLOCK_RDLOCK(STK_TABLE_LOCK, &t->lock);
-			HA_ATOMIC_DEC(&ts->ref_cnt);
-			HA_RWLOCK_RDUNLOCK(STK_TABLE_LOCK, &t->lock);
-		}
-	}
-
 	if (locked)
 		HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->lock);
+
+	if (decrefcnt)
+		stktable_release(t, ts);
 }
 
 /* Update the expiration timer for <ts> but do not touch its expiration node.
@@ -508,41 +563,47 @@ void stktable_touch_local(struct stktable *t, struct stksess *ts, int decrefcnt)
 	stktable_touch_with_exp(t, ts, 1, expire, decrefcnt);
 }
 /* Just decrease the ref_cnt of the current session. Does nothing if <ts> is NULL.
- * Note that we still need to take the read lock because a number of other places
- * (including in Lua and peers) update the ref_cnt non-atomically under the write
- * lock.
+ * Note that we still need to take the read lock so that a killer checking the
+ * ref_cnt under the bucket's write lock cannot miss our reference.
  */
 static void stktable_release(struct stktable *t, struct stksess *ts)
 {
+	struct stktable_bucket *bkt;
+
 	if (!ts)
 		return;
-	HA_RWLOCK_RDLOCK(STK_TABLE_LOCK, &t->lock);
+	bkt = stktable_bucket(t, ts);
+	HA_RWLOCK_RDLOCK(STK_TABLE_LOCK, &bkt->lock);
 	HA_ATOMIC_DEC(&ts->ref_cnt);
-	HA_RWLOCK_RDUNLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_RWLOCK_RDUNLOCK(STK_TABLE_LOCK, &bkt->lock);
 }
 
-/* Insert new sticky session <ts> in the table. It is assumed that it does not
- * yet exist (the caller must check this). The table's timeout is updated if it
- * is set. <ts> is returned if properly inserted, otherwise the one already
- * present if any.
+/* Insert new sticky session <ts> in its assigned bucket of the table. It is
+ * assumed that it does not yet exist (the caller must check this), and that
+ * its ->bucket was set by stksess_setkey(). The bucket's lock must be held.
+ * <ts> is returned if properly inserted, otherwise the one already present
+ * if any.
  */
 struct stksess *__stktable_store(struct stktable *t, struct stksess *ts)
 {
+	struct stktable_bucket *bkt = stktable_bucket(t, ts);
 	struct ebmb_node *eb;
 
-	eb = ebmb_insert(&t->keys, &ts->key, t->key_size);
+	eb = ebmb_insert(&bkt->keys, &ts->key, t->key_size);
 	if (likely(eb == &ts->key)) {
 		ts->exp.key = ts->expire;
-		eb32_insert(&t->exps, &ts->exp);
+		eb32_insert(&bkt->exps, &ts->exp);
 	}
 	return ebmb_entry(eb, struct stksess, key); // most commonly this is <ts>
 }
 
-/* requeues the table's expiration task to take the recently added <ts> into
- * account. This is performed atomically and doesn't require any lock.
+/* requeues the expiration task of <ts>'s bucket to take the recently added
+ * <ts> into account. This is performed atomically and doesn't require any
+ * lock.
  */
 void stktable_requeue_exp(struct stktable *t, const struct stksess *ts)
 {
+	struct stktable_bucket *bkt = &t->buckets[ts->bucket];
 	int old_exp, new_exp;
 	int expire = ts->expire;
 
@@ -550,33 +611,34 @@ void stktable_requeue_exp(struct stktable *t, const struct stksess *ts)
 		return;
 
 	/* set the task's expire to the newest expiration date. */
-	old_exp = HA_ATOMIC_LOAD(&t->exp_task->expire);
+	old_exp = HA_ATOMIC_LOAD(&bkt->exp_task->expire);
 	new_exp = tick_first(expire, old_exp);
 
 	/* let's not go further if we're already up to date */
 	if (new_exp == old_exp)
 		return;
 
-	HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &bkt->lock);
 
 	while (new_exp != old_exp &&
-	       !HA_ATOMIC_CAS(&t->exp_task->expire, &old_exp, new_exp)) {
+	       !HA_ATOMIC_CAS(&bkt->exp_task->expire, &old_exp, new_exp)) {
 		__ha_cpu_relax();
 		new_exp = tick_first(expire, old_exp);
 	}
 
-	task_queue(t->exp_task);
+	task_queue(bkt->exp_task);
 
-	HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
 }
 
 /* Returns a valid or initialized stksess for the specified stktable_key in the
  * specified table, or NULL if the key was NULL, or if no entry was found nor
  * could be created. The entry's expiration is updated. This function locks the
- * table, and the refcount of the entry is increased.
+ * entry's bucket, and the refcount of the entry is increased.
  */
 struct stksess *stktable_get_entry(struct stktable *table, struct stktable_key *key)
 {
+	struct stktable_bucket *bkt;
 	struct stksess *ts, *ts2;
 
 	if (!key)
@@ -602,7 +664,8 @@ struct stksess *stktable_get_entry(struct stktable *table, struct stktable_key *
 	 * one we find.
 	 */
 
-	HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &table->lock);
+	bkt = stktable_bucket(table, ts);
+	HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &bkt->lock);
 
 	ts2 = __stktable_store(table, ts);
 	if (unlikely(ts2 != ts)) {
@@ -614,25 +677,32 @@ struct stksess *stktable_get_entry(struct stktable *table, struct stktable_key *
 	}
 
 	HA_ATOMIC_INC(&ts->ref_cnt);
-	HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &table->lock);
+	HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
 
 	stktable_requeue_exp(table, ts);
 	return ts;
 }
 
 /* Lookup for an entry with the same key and store the submitted
- * stksess if not found. This function locks the table either shared or
- * exclusively, and the refcount of the entry is increased.
+ * stksess if not found. This function locks the entry's bucket either shared
+ * or exclusively, and the refcount of the entry is increased. <nts>'s bucket
+ * is (re)computed from its key since callers such as the peers applet fill
+ * the key in place without going through stksess_setkey().
  */
 struct stksess *stktable_set_entry(struct stktable *table, struct stksess *nts)
 {
+	struct stktable_bucket *bkt;
 	struct stksess *ts;
 
-	HA_RWLOCK_RDLOCK(STK_TABLE_LOCK, &table->lock);
+	nts->bucket = stktable_calc_bucket_num(table, nts->key.key,
+	                                       (table->type == SMP_T_STR) ? table->key_size - 1 : table->key_size);
+	bkt = stktable_bucket(table, nts);
+
+	HA_RWLOCK_RDLOCK(STK_TABLE_LOCK, &bkt->lock);
 	ts = __stktable_lookup(table, nts);
 	if (ts) {
 		HA_ATOMIC_INC(&ts->ref_cnt);
-		HA_RWLOCK_RDUNLOCK(STK_TABLE_LOCK, &table->lock);
+		HA_RWLOCK_RDUNLOCK(STK_TABLE_LOCK, &bkt->lock);
 		return ts;
 	}
 	ts = nts;
@@ -640,37 +710,39 @@ struct stksess *stktable_set_entry(struct stktable *table, struct stksess *nts)
 	/* let's increment it before switching to exclusive */
 	HA_ATOMIC_INC(&ts->ref_cnt);
 
-	if (HA_RWLOCK_TRYRDTOSK(STK_TABLE_LOCK, &table->lock) != 0) {
+	if (HA_RWLOCK_TRYRDTOSK(STK_TABLE_LOCK, &bkt->lock) != 0) {
 		/* upgrade to seek lock failed, let's drop and take */
-		HA_RWLOCK_RDUNLOCK(STK_TABLE_LOCK, &table->lock);
-		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &table->lock);
+		HA_RWLOCK_RDUNLOCK(STK_TABLE_LOCK, &bkt->lock);
+		HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &bkt->lock);
 	}
 	else
-		HA_RWLOCK_SKTOWR(STK_TABLE_LOCK, &table->lock);
+		HA_RWLOCK_SKTOWR(STK_TABLE_LOCK, &bkt->lock);
 
 	/* now we're write-locked */
 
 	__stktable_store(table, ts);
-	HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &table->lock);
+	HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
 
 	stktable_requeue_exp(table, ts);
 	return ts;
 }
 
 /*
- * Task processing function to trash expired sticky sessions. A pointer to the
- * task itself is returned since it never dies.
+ * Task processing function to trash expired sticky sessions from one bucket
+ * of a table. The task's context points to the bucket. A pointer to the task
+ * itself is returned since it never dies.
  */
 struct task *process_table_expire(struct task *task, void *context, unsigned int state)
 {
-	struct stktable *t = context;
+	struct stktable_bucket *bkt = context;
+	struct stktable *t = bkt->table;
 	struct stksess *ts;
 	struct eb32_node *eb;
 	int looped = 0;
 	int exp_next;
 
-	HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &t->lock);
-	eb = eb32_lookup_ge(&t->exps, now_ms - TIMER_LOOK_BACK);
+	HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &bkt->lock);
+	eb = eb32_lookup_ge(&bkt->exps, now_ms - TIMER_LOOK_BACK);
 
 	while (1) {
 		if (unlikely(!eb)) {
@@ -682,7 +754,7 @@ struct task *process_table_expire(struct task *task, void *context, unsigned int
 			if (looped)
 				break;
 			looped = 1;
-			eb = eb32_first(&t->exps);
+			eb = eb32_first(&bkt->exps);
 			if (likely(!eb))
 				break;
 		}
@@ -698,7 +770,7 @@ struct task *process_table_expire(struct task *task, void *context, unsigned int
 		eb = eb32_next(eb);
 
 		/* don't delete an entry which is currently referenced */
-		if (ts->ref_cnt)
+		if (HA_ATOMIC_LOAD(&ts->ref_cnt))
 			continue;
 
 		eb32_delete(&ts->exp);
@@ -708,7 +780,7 @@ struct task *process_table_expire(struct task *task, void *context, unsigned int
 				continue;
 
 			ts->exp.key = ts->expire;
-			eb32_insert(&t->exps, &ts->exp);
+			eb32_insert(&bkt->exps, &ts->exp);
 
 			/* the update might have jumped beyond the next element,
 			 * possibly causing a wrapping. We need to check whether
@@ -719,7 +791,7 @@ struct task *process_table_expire(struct task *task, void *context, unsigned int
 			 * use the current one.
 			 */
 			if (!eb)
-				eb = eb32_first(&t->exps);
+				eb = eb32_first(&bkt->exps);
 
 			if (!eb || tick_is_lt(ts->exp.key, eb->key))
 				eb = &ts->exp;
@@ -727,9 +799,13 @@ struct task *process_table_expire(struct task *task, void *context, unsigned int
 		}
 
 		/* session expired, trash it */
-		ebmb_delete(&ts->key);
-		eb32_delete(&ts->upd);
-		__stksess_free(t, ts);
+		if (!__stksess_kill(t, ts)) {
+			/* a peer just grabbed a reference on it through the
+			 * updates tree, revisit it on a next pass.
+			 */
+			ts->exp.key = ts->expire;
+			eb32_insert(&bkt->exps, &ts->exp);
+		}
 	}
 
 	/* We have found no task to expire in any tree */
@@ -737,7 +813,7 @@ struct task *process_table_expire(struct task *task, void *context, unsigned int
 
 out_unlock:
 	task->expire = exp_next;
-	HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
 	return task;
 }
 
@@ -745,23 +821,30 @@ out_unlock:
 int stktable_init(struct stktable *t)
 {
 	int peers_retval = 0;
+	int i;
 
 	t->hash_seed = XXH64(t->id, t->idlen, 0);
 
 	if (t->size) {
-		t->keys = EB_ROOT_UNIQUE;
-		memset(&t->exps, 0, sizeof(t->exps));
+		for (i = 0; i < CONFIG_HAP_TBL_BUCKETS; i++) {
+			t->buckets[i].keys = EB_ROOT_UNIQUE;
+			memset(&t->buckets[i].exps, 0, sizeof(t->buckets[i].exps));
+			t->buckets[i].table = t;
+			HA_RWLOCK_INIT(&t->buckets[i].lock);
+		}
 		t->updates = EB_ROOT_UNIQUE;
 		HA_RWLOCK_INIT(&t->lock);
 
 		t->pool = create_pool("sticktables", sizeof(struct stksess) + round_ptr_size(t->data_size) + t->key_size, MEM_F_SHARED);
 
 		if ( t->expire ) {
-			t->exp_task = task_new_anywhere();
-			if (!t->exp_task)
-				return 0;
-			t->exp_task->process = process_table_expire;
-			t->exp_task->context = (void *)t;
+			for (i = 0; i < CONFIG_HAP_TBL_BUCKETS; i++) {
+				t->buckets[i].exp_task = task_new_anywhere();
+				if (!t->buckets[i].exp_task)
+					return 0;
+				t->buckets[i].exp_task->process = process_table_expire;
+				t->buckets[i].exp_task->context = &t->buckets[i];
+			}
 		}
 		if (t->peers.p && t->peers.p->peers_fe && !(t->peers.p->peers_fe->flags & (PR_FL_DISABLED|PR_FL_STOPPED))) {
 			peers_retval = peers_register_table(t->peers.p, t);
@@ -1211,6 +1294,25 @@ struct stktable_key *smp_to_stkey(struct sample *smp, struct stktable *t)
 struct stktable_key *stktable_fetch_key(struct stktable *t, struct proxy *px, struct session *sess, struct stream *strm,
                                         unsigned int opt, struct sample_expr *expr, struct sample *smp)
 {
+	static THREAD_LOCAL struct sample memo_smp;
+
+	/* Configs tracking multiple scopes commonly evaluate the same
+	 * expression several times per stream (eg: "track-sc0/sc1/sc2 src"
+	 * over different tables). When the previous call for this stream
+	 * already fetched this expression in the same direction and its
+	 * result was memoized, replay it instead of re-running the whole
+	 * fetch and conversion chain; only the conversion to this table's
+	 * key type remains to be done.
+	 */
+	if (strm && strm->stkey_memo.expr == expr && strm->stkey_memo.opt == opt) {
+		if (!smp)
+			smp = &memo_smp;
+		memset(smp, 0, sizeof(*smp));
+		smp->data  = strm->stkey_memo.data;
+		smp->flags = strm->stkey_memo.flags;
+		return smp_to_stkey(smp, t);
+	}
+
 	if (smp)
 		memset(smp, 0, sizeof(*smp));
 
@@ -1221,6 +1323,27 @@ struct stktable_key *stktable_fetch_key(struct stktable *t, struct proxy *px, st
 	if ((smp->flags & SMP_F_MAY_CHANGE) && !(opt & SMP_OPT_FINAL))
 		return NULL; /* we can only use stable samples */
 
+	/* Memoize the result for this stream before smp_to_stkey() converts
+	 * it in place to this table's key type, so that a later rule using
+	 * the same expression on a table of a different type still converts
+	 * from the original sample. Only self-contained types are kept:
+	 * strings and blocks may point to buffer contents which will not
+	 * survive this rule's execution. Samples depending on request
+	 * contents (VOL_TEST/VOL_1ST/VOL_HDR) are not memoized either since
+	 * a rule executed in between could change what a new fetch would
+	 * return.
+	 */
+	if (strm &&
+	    !(smp->flags & (SMP_F_VOL_TEST|SMP_F_VOL_1ST|SMP_F_VOL_HDR)) &&
+	    (smp->data.type == SMP_T_BOOL || smp->data.type == SMP_T_SINT ||
+	     smp->data.type == SMP_T_ADDR || smp->data.type == SMP_T_IPV4 ||
+	     smp->data.type == SMP_T_IPV6)) {
+		strm->stkey_memo.expr  = expr;
+		strm->stkey_memo.opt   = opt;
+		strm->stkey_memo.flags = smp->flags;
+		strm->stkey_memo.data  = smp->data;
+	}
+
 	return smp_to_stkey(smp, t);
 }
 
@@ -2231,6 +2354,36 @@ static int sample_conv_table_kbytes_out(const struct arg *arg_p, struct sample *
 	return !!ptr;
 }
 
+/* Casts sample <smp> to the type of the table specified in arg(0), and returns
+ * the shard number this key belongs to according to the sharding configured in
+ * the table's peers section, from 1 to the number of shards, or 0 when the
+ * table is not sharded. The key does not need to exist in the table. This lets
+ * rules check whether the local node owns a given key in a sharded peers
+ * setup, or route a request to the instance owning it.
+ */
+static int sample_conv_table_key_shard(const struct arg *arg_p, struct sample *smp, void *private)
+{
+	struct stktable *t;
+	struct stktable_key *key;
+	size_t len;
+
+	t = arg_p[0].data.t;
+
+	key = smp_to_stkey(smp, t);
+	if (!key)
+		return 0;
+
+	/* same key length convention as stksess_setkey_shard() so that the
+	 * result always matches the shard assigned to the stored entry.
+	 */
+	len = (t->type == SMP_T_STR) ? key->key_len : t->key_size;
+
+	smp->flags = SMP_F_VOL_TEST;
+	smp->data.type = SMP_T_SINT;
+	smp->data.u.sint = stktable_get_key_shard(t, key->key, len);
+	return 1;
+}
+
 /* Casts sample <smp> to the type of the table specified in arg(0), and looks
  * it up into this table. Returns the server ID associated with the key if the
  * key is present in the table, otherwise zero, so that comparisons can be
@@ -3232,11 +3385,8 @@ smp_fetch_sc_get_gpt(const struct arg *args, struct sample *smp, const char *kw,
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = stktable_data_cast(ptr, std_t_uint);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* this is a mere load of an aligned word, no need to lock */
+		smp->data.u.sint = HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_uint));
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -3276,11 +3426,8 @@ smp_fetch_sc_get_gpt0(const struct arg *args, struct sample *smp, const char *kw
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = stktable_data_cast(ptr, std_t_uint);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* this is a mere load of an aligned word, no need to lock */
+		smp->data.u.sint = HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_uint));
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -3321,11 +3468,8 @@ smp_fetch_sc_get_gpc(const struct arg *args, struct sample *smp, const char *kw,
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = stktable_data_cast(ptr, std_t_uint);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* this is a mere load of an aligned word, no need to lock */
+		smp->data.u.sint = HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_uint));
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -3367,11 +3511,8 @@ smp_fetch_sc_get_gpc0(const struct arg *args, struct sample *smp, const char *kw
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = stktable_data_cast(ptr, std_t_uint);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* this is a mere load of an aligned word, no need to lock */
+		smp->data.u.sint = HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_uint));
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -3413,11 +3554,8 @@ smp_fetch_sc_get_gpc1(const struct arg *args, struct sample *smp, const char *kw
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = stktable_data_cast(ptr, std_t_uint);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* this is a mere load of an aligned word, no need to lock */
+		smp->data.u.sint = HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_uint));
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -3457,12 +3595,9 @@ smp_fetch_sc_gpc_rate(const struct arg *args, struct sample *smp, const char *kw
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp),
-		                   stkctr->table->data_arg[STKTABLE_DT_GPC_RATE].u);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* read_freq_ctr_period() is lock-free, no need to lock */
+		smp->data.u.sint = read_freq_ctr_period_cached(&stktable_data_cast(ptr, std_t_frqp),
+		                   stkctr->table->data_arg[STKTABLE_DT_GPC_RATE].u, &sc_rate_cache);
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -3509,11 +3644,8 @@ smp_fetch_sc_gpc0_rate(const struct arg *args, struct sample *smp, const char *k
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp), period);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* read_freq_ctr_period() is lock-free, no need to lock */
+		smp->data.u.sint = read_freq_ctr_period_cached(&stktable_data_cast(ptr, std_t_frqp), period, &sc_rate_cache);
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -3560,11 +3692,8 @@ smp_fetch_sc_gpc1_rate(const struct arg *args, struct sample *smp, const char *k
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp), period);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* read_freq_ctr_period() is lock-free, no need to lock */
+		smp->data.u.sint = read_freq_ctr_period_cached(&stktable_data_cast(ptr, std_t_frqp), period, &sc_rate_cache);
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -3940,11 +4069,8 @@ smp_fetch_sc_conn_cnt(const struct arg *args, struct sample *smp, const char *kw
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = stktable_data_cast(ptr, std_t_uint);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* this is a mere load of an aligned word, no need to lock */
+		smp->data.u.sint = HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_uint));
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -3981,12 +4107,9 @@ smp_fetch_sc_conn_rate(const struct arg *args, struct sample *smp, const char *k
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp),
-					       stkctr->table->data_arg[STKTABLE_DT_CONN_RATE].u);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* read_freq_ctr_period() is lock-free, no need to lock */
+		smp->data.u.sint = read_freq_ctr_period_cached(&stktable_data_cast(ptr, std_t_frqp),
+					       stkctr->table->data_arg[STKTABLE_DT_CONN_RATE].u, &sc_rate_cache);
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -4073,11 +4196,8 @@ smp_fetch_sc_conn_cur(const struct arg *args, struct sample *smp, const char *kw
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = stktable_data_cast(ptr, std_t_uint);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* this is a mere load of an aligned word, no need to lock */
+		smp->data.u.sint = HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_uint));
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -4112,11 +4232,8 @@ smp_fetch_sc_sess_cnt(const struct arg *args, struct sample *smp, const char *kw
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = stktable_data_cast(ptr, std_t_uint);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* this is a mere load of an aligned word, no need to lock */
+		smp->data.u.sint = HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_uint));
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -4150,12 +4267,9 @@ smp_fetch_sc_sess_rate(const struct arg *args, struct sample *smp, const char *k
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp),
-					       stkctr->table->data_arg[STKTABLE_DT_SESS_RATE].u);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* read_freq_ctr_period() is lock-free, no need to lock */
+		smp->data.u.sint = read_freq_ctr_period_cached(&stktable_data_cast(ptr, std_t_frqp),
+					       stkctr->table->data_arg[STKTABLE_DT_SESS_RATE].u, &sc_rate_cache);
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -4190,11 +4304,8 @@ smp_fetch_sc_http_req_cnt(const struct arg *args, struct sample *smp, const char
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = stktable_data_cast(ptr, std_t_uint);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* this is a mere load of an aligned word, no need to lock */
+		smp->data.u.sint = HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_uint));
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -4229,12 +4340,9 @@ smp_fetch_sc_http_req_rate(const struct arg *args, struct sample *smp, const cha
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp),
-					       stkctr->table->data_arg[STKTABLE_DT_HTTP_REQ_RATE].u);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* read_freq_ctr_period() is lock-free, no need to lock */
+		smp->data.u.sint = read_freq_ctr_period_cached(&stktable_data_cast(ptr, std_t_frqp),
+					       stkctr->table->data_arg[STKTABLE_DT_HTTP_REQ_RATE].u, &sc_rate_cache);
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -4269,11 +4377,8 @@ smp_fetch_sc_http_err_cnt(const struct arg *args, struct sample *smp, const char
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = stktable_data_cast(ptr, std_t_uint);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* this is a mere load of an aligned word, no need to lock */
+		smp->data.u.sint = HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_uint));
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -4308,12 +4413,9 @@ smp_fetch_sc_http_err_rate(const struct arg *args, struct sample *smp, const cha
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp),
-					       stkctr->table->data_arg[STKTABLE_DT_HTTP_ERR_RATE].u);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* read_freq_ctr_period() is lock-free, no need to lock */
+		smp->data.u.sint = read_freq_ctr_period_cached(&stktable_data_cast(ptr, std_t_frqp),
+					       stkctr->table->data_arg[STKTABLE_DT_HTTP_ERR_RATE].u, &sc_rate_cache);
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -4348,11 +4450,8 @@ smp_fetch_sc_http_fail_cnt(const struct arg *args, struct sample *smp, const cha
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = stktable_data_cast(ptr, std_t_uint);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* this is a mere load of an aligned word, no need to lock */
+		smp->data.u.sint = HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_uint));
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -4387,12 +4486,9 @@ smp_fetch_sc_http_fail_rate(const struct arg *args, struct sample *smp, const ch
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp),
-					       stkctr->table->data_arg[STKTABLE_DT_HTTP_FAIL_RATE].u);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* read_freq_ctr_period() is lock-free, no need to lock */
+		smp->data.u.sint = read_freq_ctr_period_cached(&stktable_data_cast(ptr, std_t_frqp),
+					       stkctr->table->data_arg[STKTABLE_DT_HTTP_FAIL_RATE].u, &sc_rate_cache);
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -4427,11 +4523,8 @@ smp_fetch_sc_kbytes_in(const struct arg *args, struct sample *smp, const char *k
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = stktable_data_cast(ptr, std_t_ull) >> 10;
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* this is a mere load of an aligned word, no need to lock */
+		smp->data.u.sint = HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_ull)) >> 10;
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -4466,12 +4559,9 @@ smp_fetch_sc_bytes_in_rate(const struct arg *args, struct sample *smp, const cha
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp),
-					       stkctr->table->data_arg[STKTABLE_DT_BYTES_IN_RATE].u);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* read_freq_ctr_period() is lock-free, no need to lock */
+		smp->data.u.sint = read_freq_ctr_period_cached(&stktable_data_cast(ptr, std_t_frqp),
+					       stkctr->table->data_arg[STKTABLE_DT_BYTES_IN_RATE].u, &sc_rate_cache);
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -4506,11 +4596,8 @@ smp_fetch_sc_kbytes_out(const struct arg *args, struct sample *smp, const char *
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = stktable_data_cast(ptr, std_t_ull) >> 10;
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* this is a mere load of an aligned word, no need to lock */
+		smp->data.u.sint = HA_ATOMIC_LOAD(&stktable_data_cast(ptr, std_t_ull)) >> 10;
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -4545,12 +4632,9 @@ smp_fetch_sc_bytes_out_rate(const struct arg *args, struct sample *smp, const ch
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp),
-					       stkctr->table->data_arg[STKTABLE_DT_BYTES_OUT_RATE].u);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		/* read_freq_ctr_period() is lock-free, no need to lock */
+		smp->data.u.sint = read_freq_ctr_period_cached(&stktable_data_cast(ptr, std_t_frqp),
+					       stkctr->table->data_arg[STKTABLE_DT_BYTES_OUT_RATE].u, &sc_rate_cache);
 
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
@@ -4596,6 +4680,8 @@ enum {
 	STK_CLI_ACT_CLR,
 	STK_CLI_ACT_SET,
 	STK_CLI_ACT_SHOW,
+	STK_CLI_ACT_DUMP,
+	STK_CLI_ACT_LOAD,
 };
 
 /* Dump the status of a table to a stream connector's
@@ -4752,6 +4838,7 @@ struct show_table_ctx {
 	void *target;                               /* table we want to dump, or NULL for all */
 	struct stktable *t;                         /* table being currently dumped (first if NULL) */
 	struct stksess *entry;                      /* last entry we were trying to dump (or first if NULL) */
+	unsigned int bucket;                        /* bucket being currently dumped in the current table */
 	long long value[STKTABLE_FILTER_LEN];       /* value to compare against */
 	signed char data_type[STKTABLE_FILTER_LEN]; /* type of data to compare, or -1 if none */
 	signed char data_op[STKTABLE_FILTER_LEN];   /* operator (STD_OP_*) when data_type set */
@@ -4908,22 +4995,30 @@ static int table_process_entry_per_key(struct appctx *appctx, char **args)
 			case STD_T_ULL:
 				stktable_data_cast(ptr, std_t_ull) = value;
 				break;
-			case STD_T_FRQP:
+			case STD_T_FRQP: {
+				uint curr_tick;
+
 				/* We set both the current and previous values. That way
 				 * the reported frequency is stable during all the period
 				 * then slowly fades out. This allows external tools to
 				 * push measures without having to update them too often.
 				 */
 				frqp = &stktable_data_cast(ptr, std_t_frqp);
-				/* First bit is reserved for the freq_ctr lock
-				   Note: here we're still protected by the stksess lock
-				   so we don't need to update the update the freq_ctr
-				   using its internal lock */
-				frqp->curr_tick = now_ms & ~0x1;
+				/* First bit is reserved for the freq_ctr lock. The
+				 * counters may be read by lock-free sample fetches,
+				 * so let's take it while rewriting the whole structure.
+				 */
+				curr_tick = HA_ATOMIC_LOAD(&frqp->curr_tick);
+				do {
+					curr_tick &= ~1;
+				} while (!HA_ATOMIC_CAS(&frqp->curr_tick, &curr_tick, curr_tick | 0x1));
 				frqp->prev_ctr = 0;
 				frqp->curr_ctr = value;
+				/* release the lock and commit the new period */
+				HA_ATOMIC_STORE(&frqp->curr_tick, now_ms & ~0x1);
 				break;
 			}
+			}
 		}
 		HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
 		stktable_touch_local(t, ts, 1);
@@ -4984,6 +5079,7 @@ static int cli_parse_table_req(char **args, char *payload, struct appctx *appctx
 		ctx->data_type[i] = -1;
 	ctx->target = NULL;
 	ctx->entry = NULL;
+	ctx->bucket = 0;
 	ctx->action = (long)private; // keyword argument, one of STK_CLI_ACT_*
 
 	if (*args[2]) {
@@ -5029,6 +5125,7 @@ static int cli_io_handler_table(struct appctx *appctx)
 	struct show_table_ctx *ctx = appctx->svcctx;
 	struct stconn *sc = appctx_sc(appctx);
 	struct stream *s = __sc_strm(sc);
+	struct stktable_bucket *bkt;
 	struct ebmb_node *eb;
 	int skip_entry;
 	int show = ctx->action == STK_CLI_ACT_SHOW;
@@ -5036,10 +5133,12 @@ static int cli_io_handler_table(struct appctx *appctx)
 	/*
 	 * We have 3 possible states in ctx->state :
 	 *   - STATE_NEXT : the proxy pointer points to the next table to
-	 *     dump, the entry pointer is NULL ;
+	 *     dump, the bucket number points to the next bucket to visit
+	 *     in it, the entry pointer is NULL ;
 	 *   - STATE_DUMP : the proxy pointer points to the current table
-	 *     and the entry pointer points to the next entry to be dumped,
-	 *     and the refcount on the next entry is held ;
+	 *     and the entry pointer points to the next entry to be dumped
+	 *     in the current bucket, and the refcount on the next entry is
+	 *     held ;
 	 *   - STATE_DONE : nothing left to dump, the buffer may contain some
 	 *     data though.
 	 */
@@ -5065,25 +5164,33 @@ static int cli_io_handler_table(struct appctx *appctx)
 			}
 
 			if (ctx->t->size) {
-				if (show && !table_dump_head_to_buffer(&trash, appctx, ctx->t, ctx->target))
+				if (!ctx->bucket && show &&
+				    !table_dump_head_to_buffer(&trash, appctx, ctx->t, ctx->target))
 					return 0;
 
 				if (ctx->target &&
 				    (strm_li(s)->bind_conf->level & ACCESS_LVL_MASK) >= ACCESS_LVL_OPER) {
 					/* dump entries only if table explicitly requested */
-					HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &ctx->t->lock);
-					eb = ebmb_first(&ctx->t->keys);
-					if (eb) {
-						ctx->entry = ebmb_entry(eb, struct stksess, key);
-						ctx->entry->ref_cnt++;
-						ctx->state = STATE_DUMP;
-						HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &ctx->t->lock);
-						break;
+					while (ctx->bucket < CONFIG_HAP_TBL_BUCKETS) {
+						bkt = &ctx->t->buckets[ctx->bucket];
+						HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &bkt->lock);
+						eb = ebmb_first(&bkt->keys);
+						if (eb) {
+							ctx->entry = ebmb_entry(eb, struct stksess, key);
+							HA_ATOMIC_INC(&ctx->entry->ref_cnt);
+							ctx->state = STATE_DUMP;
+							HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
+							break;
+						}
+						HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
+						ctx->bucket++;
 					}
-					HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &ctx->t->lock);
+					if (ctx->state == STATE_DUMP)
+						break;
 				}
 			}
 			ctx->t = ctx->t->next;
+			ctx->bucket = 0;
 			break;
 
 		case STATE_DUMP:
@@ -5148,8 +5255,9 @@ static int cli_io_handler_table(struct appctx *appctx)
 
 			HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &ctx->entry->lock);
 
-			HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &ctx->t->lock);
-			ctx->entry->ref_cnt--;
+			bkt = &ctx->t->buckets[ctx->bucket];
+			HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &bkt->lock);
+			HA_ATOMIC_DEC(&ctx->entry->ref_cnt);
 
 			eb = ebmb_next(&ctx->entry->key);
 			if (eb) {
@@ -5157,22 +5265,23 @@ static int cli_io_handler_table(struct appctx *appctx)
 				ctx->entry = ebmb_entry(eb, struct stksess, key);
 				if (show)
 					__stksess_kill_if_expired(ctx->t, old);
-				else if (!skip_entry && !ctx->entry->ref_cnt)
+				else if (!skip_entry && !HA_ATOMIC_LOAD(&ctx->entry->ref_cnt))
 					__stksess_kill(ctx->t, old);
-				ctx->entry->ref_cnt++;
-				HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &ctx->t->lock);
+				HA_ATOMIC_INC(&ctx->entry->ref_cnt);
+				HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
 				break;
 			}
 
 
 			if (show)
 				__stksess_kill_if_expired(ctx->t, ctx->entry);
-			else if (!skip_entry && !ctx->entry->ref_cnt)
+			else if (!skip_entry && !HA_ATOMIC_LOAD(&ctx->entry->ref_cnt))
 				__stksess_kill(ctx->t, ctx->entry);
 
-			HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &ctx->t->lock);
+			HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
 
-			ctx->t = ctx->t->next;
+			/* this bucket is done, visit the next one in this table */
+			ctx->bucket++;
 			ctx->state = STATE_NEXT;
 			break;
 
@@ -5192,6 +5301,613 @@ static void cli_release_show_table(struct appctx *appctx)
 	}
 }
 
+/* The "dump table" and "load table" commands below transfer a whole table's
+ * content as a binary snapshot file on the local filesystem. "show table"
+ * formats every entry as text and pushes it through the CLI socket buffer,
+ * which is way too slow to snapshot multi-million entry tables. Here entries
+ * are serialized as compact binary records and written (or read back) by
+ * batches of STKTABLE_SNAP_BATCH entries per applet wakeup, so that the
+ * bucket locks are only held to move the iteration cursor and the thread
+ * regularly yields to the scheduler. The format is tied to the host's
+ * endianness and to the table's exact declaration (key type and size, stored
+ * data types, array sizes and periods), all of which are verified at load
+ * time. Dict-based data types (e.g. server_key) cannot be serialized and are
+ * simply skipped.
+ */
+
+#define STKTABLE_SNAP_MAGIC    0x53544231U  /* "STB1" */
+#define STKTABLE_SNAP_VERSION  1
+#define STKTABLE_SNAP_BATCH    4096
+
+/* fixed part of a snapshot file header. It is followed by one {nbelem, arg}
+ * pair of u32 for each data type present in the <dtypes> bitmap, in ascending
+ * type order, then by one record per entry: a u32 key length, the key bytes,
+ * a u32 remaining TTL in milliseconds (~0 meaning eternity), then the raw
+ * values of all serialized data types. Freq counters are stored as {age,
+ * curr_ctr, prev_ctr} so that the load side can rebase them on its own clock.
+ */
+struct stktable_snap_hdr {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int key_type;                 /* SMP_T_* of the table's key */
+	unsigned int key_size;
+	unsigned long long dtypes;             /* bitmap of serialized data types */
+};
+
+/* appctx context used by the "dump table" and "load table" commands */
+struct table_snap_ctx {
+	struct stktable *t;                    /* table being dumped or loaded */
+	struct stksess *entry;                 /* dump cursor, refcount held, or NULL */
+	struct buffer *buf;                    /* file I/O buffer */
+	const char *err;                       /* error message to report, or NULL */
+	unsigned long long recs;               /* entries processed so far */
+	unsigned long long dtypes;             /* bitmap of serialized data types */
+	int fd;                                /* snapshot file descriptor */
+	unsigned int bucket;                   /* bucket being visited (dump) */
+	unsigned int vlen;                     /* serialized size of one entry's data */
+	unsigned int ofs;                      /* parsing offset into <buf> (load) */
+	enum {
+		SNAP_STATE_HDR = 0,            /* emit the file header */
+		SNAP_STATE_WORK,               /* iterating over entries/records */
+		SNAP_STATE_FIN,                /* flush, close and report */
+		SNAP_STATE_DONE,               /* everything done */
+	} state;
+	char action;                           /* STK_CLI_ACT_DUMP or STK_CLI_ACT_LOAD */
+};
+
+/* Returns the serialized size of one entry's data values for the data types
+ * present in <dtypes>, according to table <t>'s declaration.
+ */
+static unsigned int stktable_snap_data_len(const struct stktable *t, unsigned long long dtypes)
+{
+	unsigned int len = 0;
+	int dt;
+
+	for (dt = 0; dt < STKTABLE_DATA_TYPES; dt++) {
+		unsigned int n, elem;
+
+		if (!(dtypes & (1ULL << dt)))
+			continue;
+
+		switch (stktable_data_types[dt].std_type) {
+		case STD_T_SINT:
+		case STD_T_ULL:  elem = 8;  break;
+		case STD_T_UINT: elem = 4;  break;
+		case STD_T_FRQP: elem = 12; break;
+		default:         elem = 0;  break;
+		}
+		n = stktable_data_types[dt].is_array ? t->data_nbelem[dt] : 1;
+		len += n * elem;
+	}
+	return len;
+}
+
+/* Writes the pending bytes of <ctx>'s buffer to its snapshot file and resets
+ * the buffer. Returns 0 on success, -1 on write error.
+ */
+static int table_snap_flush(struct table_snap_ctx *ctx)
+{
+	size_t ofs = 0;
+	ssize_t ret;
+
+	while (ofs < ctx->buf->data) {
+		ret = write(ctx->fd, b_orig(ctx->buf) + ofs, ctx->buf->data - ofs);
+		if (ret <= 0) {
+			if (ret < 0 && errno == EINTR)
+				continue;
+			return -1;
+		}
+		ofs += ret;
+	}
+	ctx->buf->data = 0;
+	return 0;
+}
+
+/* Serializes entry <ts> into <ctx>'s buffer. Must be called with the entry's
+ * read lock held. Returns 1 on success (expired entries are silently skipped)
+ * or 0 if the buffer needs to be flushed first.
+ */
+static int table_snap_dump_entry(struct table_snap_ctx *ctx, struct stksess *ts)
+{
+	struct stktable *t = ctx->t;
+	struct buffer *out = ctx->buf;
+	unsigned int key_len = t->key_size;
+	int dt;
+
+	if (tick_isset(ts->expire) && tick_is_expired(ts->expire, now_ms))
+		return 1;
+
+	if (t->type == SMP_T_STR) {
+		const char *z = memchr(ts->key.key, 0, t->key_size);
+
+		if (z)
+			key_len = z - (const char *)ts->key.key;
+	}
+
+	if (b_room(out) < 8 + key_len + ctx->vlen)
+		return 0;
+
+	write_u32(b_tail(out), key_len);
+	b_add(out, 4);
+	memcpy(b_tail(out), ts->key.key, key_len);
+	b_add(out, key_len);
+	write_u32(b_tail(out), tick_isset(ts->expire) ?
+	          (unsigned int)tick_remain(now_ms, ts->expire) : ~0U);
+	b_add(out, 4);
+
+	for (dt = 0; dt < STKTABLE_DATA_TYPES; dt++) {
+		unsigned int idx, n;
+
+		if (!(ctx->dtypes & (1ULL << dt)))
+			continue;
+
+		n = stktable_data_types[dt].is_array ? t->data_nbelem[dt] : 1;
+		for (idx = 0; idx < n; idx++) {
+			void *ptr = stktable_data_types[dt].is_array ?
+				stktable_data_ptr_idx(t, ts, dt, idx) :
+				stktable_data_ptr(t, ts, dt);
+
+			switch (stktable_data_types[dt].std_type) {
+			case STD_T_SINT:
+				write_u64(b_tail(out), (long long)stktable_data_cast(ptr, std_t_sint));
+				b_add(out, 8);
+				break;
+			case STD_T_UINT:
+				write_u32(b_tail(out), stktable_data_cast(ptr, std_t_uint));
+				b_add(out, 4);
+				break;
+			case STD_T_ULL:
+				write_u64(b_tail(out), stktable_data_cast(ptr, std_t_ull));
+				b_add(out, 8);
+				break;
+			case STD_T_FRQP: {
+				struct freq_ctr *frqp = &stktable_data_cast(ptr, std_t_frqp);
+				uint curr_tick = HA_ATOMIC_LOAD(&frqp->curr_tick) & ~1;
+
+				write_u32(b_tail(out), curr_tick ? now_ms - curr_tick : 0);
+				write_u32(b_tail(out) + 4, HA_ATOMIC_LOAD(&frqp->curr_ctr));
+				write_u32(b_tail(out) + 8, HA_ATOMIC_LOAD(&frqp->prev_ctr));
+				b_add(out, 12);
+				break;
+			}
+			}
+		}
+	}
+	ctx->recs++;
+	return 1;
+}
+
+/* Loads one serialized entry starting at <p> into <ctx>'s table. The caller
+ * guarantees that the whole record is available. Returns NULL on success or
+ * an error message.
+ */
+static const char *table_snap_load_rec(struct table_snap_ctx *ctx, const char *p)
+{
+	struct stktable *t = ctx->t;
+	struct stksess *ts;
+	unsigned int key_len, remain;
+	int expire;
+	int dt;
+
+	key_len = read_u32(p);
+	p += 4;
+	static_table_key.key = (void *)p;
+	static_table_key.key_len = key_len;
+	p += key_len;
+	remain = read_u32(p);
+	p += 4;
+
+	ts = stktable_get_entry(t, &static_table_key);
+	if (!ts)
+		return "Failed to allocate a table entry";
+
+	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
+	for (dt = 0; dt < STKTABLE_DATA_TYPES; dt++) {
+		unsigned int idx, n;
+
+		if (!(ctx->dtypes & (1ULL << dt)))
+			continue;
+
+		n = stktable_data_types[dt].is_array ? t->data_nbelem[dt] : 1;
+		for (idx = 0; idx < n; idx++) {
+			void *ptr = stktable_data_types[dt].is_array ?
+				stktable_data_ptr_idx(t, ts, dt, idx) :
+				stktable_data_ptr(t, ts, dt);
+
+			switch (stktable_data_types[dt].std_type) {
+			case STD_T_SINT:
+				stktable_data_cast(ptr, std_t_sint) = (long long)read_u64(p);
+				p += 8;
+				break;
+			case STD_T_UINT:
+				stktable_data_cast(ptr, std_t_uint) = read_u32(p);
+				p += 4;
+				break;
+			case STD_T_ULL:
+				stktable_data_cast(ptr, std_t_ull) = read_u64(p);
+				p += 8;
+				break;
+			case STD_T_FRQP: {
+				struct freq_ctr *frqp = &stktable_data_cast(ptr, std_t_frqp);
+				uint curr_tick;
+
+				/* the entry may already be seen by lock-free
+				 * readers, so take the freq_ctr lock while
+				 * rewriting it, like "set table" does. The
+				 * stored age rebases the counter on the local
+				 * clock.
+				 */
+				curr_tick = HA_ATOMIC_LOAD(&frqp->curr_tick);
+				do {
+					curr_tick &= ~1;
+				} while (!HA_ATOMIC_CAS(&frqp->curr_tick, &curr_tick, curr_tick | 0x1));
+				frqp->curr_ctr = read_u32(p + 4);
+				frqp->prev_ctr = read_u32(p + 8);
+				HA_ATOMIC_STORE(&frqp->curr_tick, (now_ms - read_u32(p)) & ~0x1);
+				p += 12;
+				break;
+			}
+			}
+		}
+	}
+	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+
+	expire = (remain == ~0U) ? TICK_ETERNITY : tick_add(now_ms, remain);
+	stktable_touch_with_exp(t, ts, 1, expire, 1);
+	ctx->recs++;
+	return NULL;
+}
+
+/* I/O handler of the "dump table" command. Returns 1 when done, 0 if it must
+ * be called again after a yield.
+ */
+static int cli_io_handler_table_dump_file(struct appctx *appctx)
+{
+	struct table_snap_ctx *ctx = appctx->svcctx;
+	struct stconn *sc = appctx_sc(appctx);
+	struct stktable *t = ctx->t;
+	struct stktable_bucket *bkt;
+	struct ebmb_node *eb;
+	unsigned int budget = STKTABLE_SNAP_BATCH;
+	int done;
+
+	if (unlikely(sc_ic(sc)->flags & CF_SHUTW)) {
+		/* in case of abort, remove any refcount we might have set on an entry */
+		if (ctx->entry) {
+			stksess_kill_if_expired(t, ctx->entry, 1);
+			ctx->entry = NULL;
+		}
+		return 1;
+	}
+
+	while (ctx->state != SNAP_STATE_DONE) {
+		switch (ctx->state) {
+		case SNAP_STATE_HDR: {
+			struct stktable_snap_hdr hdr = {
+				.magic    = STKTABLE_SNAP_MAGIC,
+				.version  = STKTABLE_SNAP_VERSION,
+				.key_type = t->type,
+				.key_size = t->key_size,
+				.dtypes   = ctx->dtypes,
+			};
+			int dt;
+
+			chunk_memcat(ctx->buf, (const char *)&hdr, sizeof(hdr));
+			for (dt = 0; dt < STKTABLE_DATA_TYPES; dt++) {
+				if (!(ctx->dtypes & (1ULL << dt)))
+					continue;
+				write_u32(b_tail(ctx->buf),
+				          stktable_data_types[dt].is_array ? t->data_nbelem[dt] : 1);
+				write_u32(b_tail(ctx->buf) + 4, t->data_arg[dt].u);
+				b_add(ctx->buf, 8);
+			}
+			ctx->state = SNAP_STATE_WORK;
+			break;
+		}
+
+		case SNAP_STATE_WORK:
+			if (!ctx->entry) {
+				/* find the first entry of the next non-empty bucket */
+				while (ctx->bucket < CONFIG_HAP_TBL_BUCKETS) {
+					bkt = &t->buckets[ctx->bucket];
+					HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &bkt->lock);
+					eb = ebmb_first(&bkt->keys);
+					if (eb) {
+						ctx->entry = ebmb_entry(eb, struct stksess, key);
+						HA_ATOMIC_INC(&ctx->entry->ref_cnt);
+						HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
+						break;
+					}
+					HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
+					ctx->bucket++;
+				}
+				if (!ctx->entry) {
+					ctx->state = SNAP_STATE_FIN;
+					break;
+				}
+			}
+
+			HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &ctx->entry->lock);
+			done = table_snap_dump_entry(ctx, ctx->entry);
+			HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &ctx->entry->lock);
+
+			if (!done) {
+				if (table_snap_flush(ctx) < 0) {
+					ctx->err = "Write error on the snapshot file";
+					ctx->state = SNAP_STATE_FIN;
+					break;
+				}
+				if (b_room(ctx->buf) < 8 + t->key_size + ctx->vlen) {
+					ctx->err = "Entry larger than the snapshot buffer";
+					ctx->state = SNAP_STATE_FIN;
+					break;
+				}
+				/* retry the same entry with an empty buffer */
+				break;
+			}
+
+			/* move the cursor to the next entry */
+			bkt = &t->buckets[ctx->bucket];
+			HA_RWLOCK_WRLOCK(STK_TABLE_LOCK, &bkt->lock);
+			HA_ATOMIC_DEC(&ctx->entry->ref_cnt);
+			eb = ebmb_next(&ctx->entry->key);
+			if (eb) {
+				struct stksess *old = ctx->entry;
+
+				ctx->entry = ebmb_entry(eb, struct stksess, key);
+				__stksess_kill_if_expired(t, old);
+				HA_ATOMIC_INC(&ctx->entry->ref_cnt);
+				HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
+			}
+			else {
+				__stksess_kill_if_expired(t, ctx->entry);
+				HA_RWLOCK_WRUNLOCK(STK_TABLE_LOCK, &bkt->lock);
+				ctx->entry = NULL;
+				ctx->bucket++;
+			}
+
+			if (!--budget) {
+				/* let other tasks run before the next batch */
+				appctx_wakeup(appctx);
+				return 0;
+			}
+			break;
+
+		case SNAP_STATE_FIN:
+			if (ctx->entry) {
+				/* error path: drop the cursor's reference */
+				stksess_kill_if_expired(t, ctx->entry, 1);
+				ctx->entry = NULL;
+			}
+			if (ctx->fd >= 0) {
+				if (!ctx->err && table_snap_flush(ctx) < 0)
+					ctx->err = "Write error on the snapshot file";
+				close(ctx->fd);
+				ctx->fd = -1;
+			}
+			chunk_reset(&trash);
+			if (ctx->err)
+				chunk_printf(&trash, "%s after %llu entries.\n", ctx->err, ctx->recs);
+			else
+				chunk_printf(&trash, "%llu entries dumped from table %s.\n", ctx->recs, t->id);
+			if (applet_putchk(appctx, &trash) == -1)
+				return 0;
+			ctx->state = SNAP_STATE_DONE;
+			break;
+
+		default:
+			break;
+		}
+	}
+	return 1;
+}
+
+/* I/O handler of the "load table" command. Returns 1 when done, 0 if it must
+ * be called again after a yield.
+ */
+static int cli_io_handler_table_load_file(struct appctx *appctx)
+{
+	struct table_snap_ctx *ctx = appctx->svcctx;
+	struct stconn *sc = appctx_sc(appctx);
+	struct stktable *t = ctx->t;
+	struct buffer *in = ctx->buf;
+	unsigned int budget = STKTABLE_SNAP_BATCH;
+
+	if (unlikely(sc_ic(sc)->flags & CF_SHUTW))
+		return 1;
+
+	while (ctx->state == SNAP_STATE_WORK) {
+		size_t avail = in->data - ctx->ofs;
+		unsigned int key_len, rec_len;
+		const char *msg;
+		ssize_t ret;
+
+		if (avail >= 4) {
+			key_len = read_u32(b_orig(in) + ctx->ofs);
+			if ((t->type == SMP_T_STR && key_len >= t->key_size) ||
+			    (t->type != SMP_T_STR && key_len != t->key_size)) {
+				ctx->err = "Corrupted snapshot file (invalid key length)";
+				ctx->state = SNAP_STATE_FIN;
+				break;
+			}
+			rec_len = 8 + key_len + ctx->vlen;
+			if (avail >= rec_len) {
+				msg = table_snap_load_rec(ctx, b_orig(in) + ctx->ofs);
+				if (msg) {
+					ctx->err = msg;
+					ctx->state = SNAP_STATE_FIN;
+					break;
+				}
+				ctx->ofs += rec_len;
+				if (!--budget) {
+					/* let other tasks run before the next batch */
+					appctx_wakeup(appctx);
+					return 0;
+				}
+				continue;
+			}
+		}
+
+		/* incomplete record, refill the buffer from the file */
+		if (ctx->ofs) {
+			memmove(b_orig(in), b_orig(in) + ctx->ofs, avail);
+			in->data = avail;
+			ctx->ofs = 0;
+		}
+		if (in->data == in->size) {
+			ctx->err = "Corrupted snapshot file (oversized record)";
+			ctx->state = SNAP_STATE_FIN;
+			break;
+		}
+		ret = read(ctx->fd, b_orig(in) + in->data, in->size - in->data);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			ctx->err = "Read error on the snapshot file";
+			ctx->state = SNAP_STATE_FIN;
+			break;
+		}
+		if (!ret) {
+			if (in->data)
+				ctx->err = "Corrupted snapshot file (truncated record)";
+			ctx->state = SNAP_STATE_FIN;
+			break;
+		}
+		in->data += ret;
+	}
+
+	if (ctx->state == SNAP_STATE_FIN) {
+		if (ctx->fd >= 0) {
+			close(ctx->fd);
+			ctx->fd = -1;
+		}
+		chunk_reset(&trash);
+		if (ctx->err)
+			chunk_printf(&trash, "%s after %llu entries.\n", ctx->err, ctx->recs);
+		else
+			chunk_printf(&trash, "%llu entries loaded into table %s.\n", ctx->recs, t->id);
+		if (applet_putchk(appctx, &trash) == -1)
+			return 0;
+		ctx->state = SNAP_STATE_DONE;
+	}
+	return 1;
+}
+
+/* Parses the "dump table" and "load table" requests, opens the snapshot file
+ * and, on load, validates its header against the table's declaration.
+ * Returns 0 if the I/O handler must run, 1 if processing has ended.
+ */
+static int cli_parse_table_snap(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	struct table_snap_ctx *ctx = applet_reserve_svcctx(appctx, sizeof(*ctx));
+	struct stktable *t;
+	char *err = NULL;
+	int dt;
+
+	if (!cli_has_level(appctx, ACCESS_LVL_ADMIN))
+		return 1;
+
+	if (!*args[2] || !*args[3])
+		return cli_err(appctx, "Required arguments: <table> <file>\n");
+
+	t = stktable_find_by_name(args[2]);
+	if (!t)
+		return cli_err(appctx, "No such table\n");
+
+	ctx->t = t;
+	ctx->entry = NULL;
+	ctx->buf = NULL;
+	ctx->err = NULL;
+	ctx->recs = 0;
+	ctx->fd = -1;
+	ctx->bucket = 0;
+	ctx->ofs = 0;
+	ctx->action = (long)private;
+
+	ctx->dtypes = 0;
+	for (dt = 0; dt < STKTABLE_DATA_TYPES; dt++) {
+		if (!t->data_ofs[dt])
+			continue;
+		if (stktable_data_types[dt].std_type == STD_T_DICT)
+			continue; /* cannot be serialized */
+		ctx->dtypes |= 1ULL << dt;
+	}
+	ctx->vlen = stktable_snap_data_len(t, ctx->dtypes);
+
+	ctx->buf = alloc_trash_chunk();
+	if (!ctx->buf)
+		return cli_err(appctx, "Failed to allocate a buffer\n");
+
+	if (ctx->action == STK_CLI_ACT_DUMP) {
+		ctx->fd = open(args[3], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+		if (ctx->fd < 0)
+			goto fail_open;
+		ctx->state = SNAP_STATE_HDR;
+	}
+	else {
+		struct stktable_snap_hdr hdr;
+
+		ctx->fd = open(args[3], O_RDONLY | O_CLOEXEC);
+		if (ctx->fd < 0)
+			goto fail_open;
+
+		if (read(ctx->fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+		    hdr.magic != STKTABLE_SNAP_MAGIC ||
+		    hdr.version != STKTABLE_SNAP_VERSION)
+			goto fail_fmt;
+
+		if (hdr.key_type != t->type || hdr.key_size != t->key_size ||
+		    hdr.dtypes != ctx->dtypes)
+			goto fail_decl;
+
+		for (dt = 0; dt < STKTABLE_DATA_TYPES; dt++) {
+			char meta[8];
+
+			if (!(ctx->dtypes & (1ULL << dt)))
+				continue;
+			if (read(ctx->fd, meta, sizeof(meta)) != sizeof(meta))
+				goto fail_fmt;
+			if (read_u32(meta) != (stktable_data_types[dt].is_array ? t->data_nbelem[dt] : 1) ||
+			    read_u32(meta + 4) != t->data_arg[dt].u)
+				goto fail_decl;
+		}
+		ctx->state = SNAP_STATE_WORK;
+	}
+	return 0;
+
+ fail_open:
+	memprintf(&err, "Cannot open '%s': %s\n", args[3], strerror(errno));
+	free_trash_chunk(ctx->buf);
+	ctx->buf = NULL;
+	return cli_dynerr(appctx, err);
+
+ fail_fmt:
+	close(ctx->fd);
+	ctx->fd = -1;
+	free_trash_chunk(ctx->buf);
+	ctx->buf = NULL;
+	return cli_err(appctx, "Not a valid table snapshot file\n");
+
+ fail_decl:
+	close(ctx->fd);
+	ctx->fd = -1;
+	free_trash_chunk(ctx->buf);
+	ctx->buf = NULL;
+	return cli_err(appctx, "Snapshot file does not match the table's declaration (key type/size, stored data types and periods must be identical)\n");
+}
+
+static void cli_release_table_snap(struct appctx *appctx)
+{
+	struct table_snap_ctx *ctx = appctx->svcctx;
+
+	if (ctx->entry)
+		stksess_kill_if_expired(ctx->t, ctx->entry, 1);
+	if (ctx->fd >= 0)
+		close(ctx->fd);
+	if (ctx->buf)
+		free_trash_chunk(ctx->buf);
+}
+
 static int stk_parse_stick_counters(char **args, int section_type, struct proxy *curpx,
                                 const struct proxy *defpx, const char *file, int line,
                                 char **err)
@@ -5246,6 +5962,8 @@ INITCALL0(STG_INIT, stkt_late_init);
 /* register cli keywords */
 static struct cli_kw_list cli_kws = {{ },{
 	{ { "clear", "table", NULL }, "clear table <table> [<filter>]*         : remove an entry from a table (filter: data/key)",                           cli_parse_table_req, cli_io_handler_table, cli_release_show_table, (void *)STK_CLI_ACT_CLR },
+	{ { "dump",  "table", NULL }, "dump table <table> <file>               : save a table's content as a binary snapshot file",                          cli_parse_table_snap, cli_io_handler_table_dump_file, cli_release_table_snap, (void *)STK_CLI_ACT_DUMP },
+	{ { "load",  "table", NULL }, "load table <table> <file>               : restore a table's content from a binary snapshot file",                     cli_parse_table_snap, cli_io_handler_table_load_file, cli_release_table_snap, (void *)STK_CLI_ACT_LOAD },
 	{ { "set",   "table", NULL }, "set table <table> key <k> [data.* <v>]* : update or create a table entry's data",                                     cli_parse_table_req, cli_io_handler_table, NULL, (void *)STK_CLI_ACT_SET },
 	{ { "show",  "table", NULL }, "show table <table> [<filter>]*          : report table usage stats or dump this table's contents (filter: data/key)", cli_parse_table_req, cli_io_handler_table, cli_release_show_table, (void *)STK_CLI_ACT_SHOW },
 	{{},}
@@ -5513,6 +6231,7 @@ static struct sample_conv_kw_list sample_conv_kws = {ILH, {
 	{ "table_idle",           sample_conv_table_idle,           ARG2(1,TAB,SINT),  NULL, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_kbytes_in",      sample_conv_table_kbytes_in,      ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_kbytes_out",     sample_conv_table_kbytes_out,     ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
+	{ "table_key_shard",      sample_conv_table_key_shard,      ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_server_id",      sample_conv_table_server_id,      ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_sess_cnt",       sample_conv_table_sess_cnt,       ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_sess_rate",      sample_conv_table_sess_rate,      ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
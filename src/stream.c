@@ -28,6 +28,7 @@
 #include <haproxy/check.h>
 #include <haproxy/cli.h>
 #include <haproxy/connection.h>
+#include <haproxy/counters.h>
 #include <haproxy/dict.h>
 #include <haproxy/dynbuf.h>
 #include <haproxy/fd.h>
@@ -36,6 +37,7 @@
 #include <haproxy/frontend.h>
 #include <haproxy/global.h>
 #include <haproxy/hlua.h>
+#include <haproxy/host_stats.h>
 #include <haproxy/http_ana.h>
 #include <haproxy/http_rules.h>
 #include <haproxy/htx.h>
@@ -43,6 +45,7 @@
 #include <haproxy/log.h>
 #include <haproxy/pipe.h>
 #include <haproxy/pool.h>
+#include <haproxy/proto_tcp.h>
 #include <haproxy/proxy.h>
 #include <haproxy/queue.h>
 #include <haproxy/sc_strm.h>
@@ -349,6 +352,16 @@ struct stream *stream_new(struct session *sess, struct stconn *sc, struct buffer
 	if (unlikely((s = pool_alloc(pool_head_stream)) == NULL))
 		goto out_fail_alloc;
 
+	/* the allocations performed further below only happen after a fair
+	 * amount of initialization work, so start fetching the objects they
+	 * will most likely return now to overlap their first-touch misses
+	 * with it instead of serializing them.
+	 */
+	if (pool_head_stk_ctr)
+		pool_prefetch(pool_head_stk_ctr);
+	pool_prefetch(pool_head_task);
+	pool_prefetch(pool_head_connstream);
+
 	/* minimum stream initialization required for an embryonic stream is
 	 * fairly low. We need very little to execute L4 ACLs, then we need a
 	 * task to make the client-side connection live on its own.
@@ -389,7 +402,7 @@ struct stream *stream_new(struct session *sess, struct stconn *sc, struct buffer
 	s->last_rule_line = 0;
 
 	s->stkctr = NULL;
-	if (pool_head_stk_ctr) {
+	if (pool_head_stk_ctr && !(sess->fe->flags & PR_FL_LIGHT_STREAM)) {
 		s->stkctr = pool_alloc(pool_head_stk_ctr);
 		if (!s->stkctr)
 			goto out_fail_alloc;
@@ -420,6 +433,9 @@ struct stream *stream_new(struct session *sess, struct stconn *sc, struct buffer
 	s->pcli_next_pid = 0;
 	s->pcli_flags = 0;
 	s->unique_id = IST_NULL;
+	s->host_stats = NULL;
+	s->stkey_memo.expr = NULL;
+	s->src_txt.len = 0;
 
 	if ((t = task_new_here()) == NULL)
 		goto out_fail_alloc;
@@ -653,6 +669,11 @@ void stream_free(struct stream *s)
 	pool_free(pool_head_uniqueid, s->unique_id.ptr);
 	s->unique_id = IST_NULL;
 
+	if (s->host_stats) {
+		host_stats_put(s->host_stats);
+		s->host_stats = NULL;
+	}
+
 	flt_stream_stop(s);
 	flt_stream_release(s, 0);
 
@@ -703,9 +724,9 @@ void stream_free(struct stream *s)
 	}
 
 	/* Cleanup all variable contexts. */
-	if (!LIST_ISEMPTY(&s->vars_txn.head))
+	if (!eb_is_empty(&s->vars_txn.name_root))
 		vars_prune(&s->vars_txn, s->sess, s);
-	if (!LIST_ISEMPTY(&s->vars_reqres.head))
+	if (!eb_is_empty(&s->vars_reqres.name_root))
 		vars_prune(&s->vars_reqres, s->sess, s);
 
 	stream_store_counters(s);
@@ -797,36 +818,43 @@ void stream_process_counters(struct stream *s)
 	bytes = s->req.total - s->logs.bytes_in;
 	s->logs.bytes_in = s->req.total;
 	if (bytes) {
-		_HA_ATOMIC_ADD(&sess->fe->fe_counters.bytes_in, bytes);
-		_HA_ATOMIC_ADD(&s->be->be_counters.bytes_in,    bytes);
+		cnt_add_bytes_in(&sess->fe->fe_counters, bytes);
+		cnt_add_bytes_in(&s->be->be_counters,    bytes);
 
 		if (objt_server(s->target))
-			_HA_ATOMIC_ADD(&__objt_server(s->target)->counters.bytes_in, bytes);
+			cnt_add_bytes_in(&__objt_server(s->target)->counters, bytes);
 
 		if (sess->listener && sess->listener->counters)
-			_HA_ATOMIC_ADD(&sess->listener->counters->bytes_in, bytes);
+			cnt_add_bytes_in(sess->listener->counters, bytes);
 
-		for (i = 0; i < global.tune.nb_stk_ctr; i++) {
-			if (!stkctr_inc_bytes_in_ctr(&s->stkctr[i], bytes))
-				stkctr_inc_bytes_in_ctr(&sess->stkctr[i], bytes);
+		/* stkctr may be NULL on light streams (PR_FL_LIGHT_STREAM), in
+		 * which case nothing can be tracked at all.
+		 */
+		if (s->stkctr) {
+			for (i = 0; i < global.tune.nb_stk_ctr; i++) {
+				if (!stkctr_inc_bytes_in_ctr(&s->stkctr[i], bytes))
+					stkctr_inc_bytes_in_ctr(&sess->stkctr[i], bytes);
+			}
 		}
 	}
 
 	bytes = s->res.total - s->logs.bytes_out;
 	s->logs.bytes_out = s->res.total;
 	if (bytes) {
-		_HA_ATOMIC_ADD(&sess->fe->fe_counters.bytes_out, bytes);
-		_HA_ATOMIC_ADD(&s->be->be_counters.bytes_out,    bytes);
+		cnt_add_bytes_out(&sess->fe->fe_counters, bytes);
+		cnt_add_bytes_out(&s->be->be_counters,    bytes);
 
 		if (objt_server(s->target))
-			_HA_ATOMIC_ADD(&__objt_server(s->target)->counters.bytes_out, bytes);
+			cnt_add_bytes_out(&__objt_server(s->target)->counters, bytes);
 
 		if (sess->listener && sess->listener->counters)
-			_HA_ATOMIC_ADD(&sess->listener->counters->bytes_out, bytes);
+			cnt_add_bytes_out(sess->listener->counters, bytes);
 
-		for (i = 0; i < global.tune.nb_stk_ctr; i++) {
-			if (!stkctr_inc_bytes_out_ctr(&s->stkctr[i], bytes))
-				stkctr_inc_bytes_out_ctr(&sess->stkctr[i], bytes);
+		if (s->stkctr) {
+			for (i = 0; i < global.tune.nb_stk_ctr; i++) {
+				if (!stkctr_inc_bytes_out_ctr(&s->stkctr[i], bytes))
+					stkctr_inc_bytes_out_ctr(&sess->stkctr[i], bytes);
+			}
 		}
 	}
 }
@@ -920,6 +948,10 @@ static void back_establish(struct stream *s)
 	if (objt_server(s->target))
 		health_adjust(__objt_server(s->target), HANA_STATUS_L4_OK);
 
+	/* let the TCP layer check whether the SYN really carried the data */
+	if (conn && (conn->flags & CO_FL_FASTOPEN))
+		tcp_fastopen_report(conn);
+
 	if (!IS_HTX_STRM(s)) { /* let's allow immediate data connection in this case */
 		/* if the user wants to log as soon as possible, without counting
 		 * bytes from the server, then this is the right moment. */
@@ -2011,25 +2043,73 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 			ana_list = ana_back = req->analysers;
 			while (ana_list && max_loops--) {
 				/* Warning! ensure that analysers are always placed in ascending order! */
-				ANALYZE    (s, req, flt_start_analyze,          ana_list, ana_back, AN_REQ_FLT_START_FE);
-				FLT_ANALYZE(s, req, tcp_inspect_request,        ana_list, ana_back, AN_REQ_INSPECT_FE);
-				FLT_ANALYZE(s, req, http_wait_for_request,      ana_list, ana_back, AN_REQ_WAIT_HTTP);
-				FLT_ANALYZE(s, req, http_wait_for_request_body, ana_list, ana_back, AN_REQ_HTTP_BODY);
-				FLT_ANALYZE(s, req, http_process_req_common,    ana_list, ana_back, AN_REQ_HTTP_PROCESS_FE, sess->fe);
-				FLT_ANALYZE(s, req, process_switching_rules,    ana_list, ana_back, AN_REQ_SWITCHING_RULES);
-				ANALYZE    (s, req, flt_start_analyze,          ana_list, ana_back, AN_REQ_FLT_START_BE);
-				FLT_ANALYZE(s, req, tcp_inspect_request,        ana_list, ana_back, AN_REQ_INSPECT_BE);
-				FLT_ANALYZE(s, req, http_process_req_common,    ana_list, ana_back, AN_REQ_HTTP_PROCESS_BE, s->be);
-				FLT_ANALYZE(s, req, http_process_tarpit,        ana_list, ana_back, AN_REQ_HTTP_TARPIT);
-				FLT_ANALYZE(s, req, process_server_rules,       ana_list, ana_back, AN_REQ_SRV_RULES);
-				FLT_ANALYZE(s, req, http_process_request,       ana_list, ana_back, AN_REQ_HTTP_INNER);
-				FLT_ANALYZE(s, req, tcp_persist_rdp_cookie,     ana_list, ana_back, AN_REQ_PRST_RDP_COOKIE);
-				FLT_ANALYZE(s, req, process_sticking_rules,     ana_list, ana_back, AN_REQ_STICKING_RULES);
-				ANALYZE    (s, req, flt_analyze_http_headers,   ana_list, ana_back, AN_REQ_FLT_HTTP_HDRS);
-				ANALYZE    (s, req, http_request_forward_body,  ana_list, ana_back, AN_REQ_HTTP_XFER_BODY);
-				ANALYZE    (s, req, pcli_wait_for_request,      ana_list, ana_back, AN_REQ_WAIT_CLI);
-				ANALYZE    (s, req, flt_xfer_data,              ana_list, ana_back, AN_REQ_FLT_XFER_DATA);
-				ANALYZE    (s, req, flt_end_analyze,            ana_list, ana_back, AN_REQ_FLT_END);
+				/* The switch jumps straight to the lowest enabled
+				 * analyser, skipping the tests of all the disabled
+				 * ones below it. The macros still test their own
+				 * bit so the chain remains correct wherever it is
+				 * entered. A "break" in a macro leaves the switch
+				 * and falls onto the final break below, thus stops
+				 * the evaluation exactly like it used to.
+				 */
+				switch (ana_list & ~(ana_list - 1)) {
+				default: /* only the bits listed below may be set */
+				case AN_REQ_FLT_START_FE:
+					ANALYZE    (s, req, flt_start_analyze,          ana_list, ana_back, AN_REQ_FLT_START_FE);
+					__fallthrough;
+				case AN_REQ_INSPECT_FE:
+					FLT_ANALYZE(s, req, tcp_inspect_request,        ana_list, ana_back, AN_REQ_INSPECT_FE);
+					__fallthrough;
+				case AN_REQ_WAIT_HTTP:
+					FLT_ANALYZE(s, req, http_wait_for_request,      ana_list, ana_back, AN_REQ_WAIT_HTTP);
+					__fallthrough;
+				case AN_REQ_HTTP_BODY:
+					FLT_ANALYZE(s, req, http_wait_for_request_body, ana_list, ana_back, AN_REQ_HTTP_BODY);
+					__fallthrough;
+				case AN_REQ_HTTP_PROCESS_FE:
+					FLT_ANALYZE(s, req, http_process_req_common,    ana_list, ana_back, AN_REQ_HTTP_PROCESS_FE, sess->fe);
+					__fallthrough;
+				case AN_REQ_SWITCHING_RULES:
+					FLT_ANALYZE(s, req, process_switching_rules,    ana_list, ana_back, AN_REQ_SWITCHING_RULES);
+					__fallthrough;
+				case AN_REQ_FLT_START_BE:
+					ANALYZE    (s, req, flt_start_analyze,          ana_list, ana_back, AN_REQ_FLT_START_BE);
+					__fallthrough;
+				case AN_REQ_INSPECT_BE:
+					FLT_ANALYZE(s, req, tcp_inspect_request,        ana_list, ana_back, AN_REQ_INSPECT_BE);
+					__fallthrough;
+				case AN_REQ_HTTP_PROCESS_BE:
+					FLT_ANALYZE(s, req, http_process_req_common,    ana_list, ana_back, AN_REQ_HTTP_PROCESS_BE, s->be);
+					__fallthrough;
+				case AN_REQ_HTTP_TARPIT:
+					FLT_ANALYZE(s, req, http_process_tarpit,        ana_list, ana_back, AN_REQ_HTTP_TARPIT);
+					__fallthrough;
+				case AN_REQ_SRV_RULES:
+					FLT_ANALYZE(s, req, process_server_rules,       ana_list, ana_back, AN_REQ_SRV_RULES);
+					__fallthrough;
+				case AN_REQ_HTTP_INNER:
+					FLT_ANALYZE(s, req, http_process_request,       ana_list, ana_back, AN_REQ_HTTP_INNER);
+					__fallthrough;
+				case AN_REQ_PRST_RDP_COOKIE:
+					FLT_ANALYZE(s, req, tcp_persist_rdp_cookie,     ana_list, ana_back, AN_REQ_PRST_RDP_COOKIE);
+					__fallthrough;
+				case AN_REQ_STICKING_RULES:
+					FLT_ANALYZE(s, req, process_sticking_rules,     ana_list, ana_back, AN_REQ_STICKING_RULES);
+					__fallthrough;
+				case AN_REQ_FLT_HTTP_HDRS:
+					ANALYZE    (s, req, flt_analyze_http_headers,   ana_list, ana_back, AN_REQ_FLT_HTTP_HDRS);
+					__fallthrough;
+				case AN_REQ_HTTP_XFER_BODY:
+					ANALYZE    (s, req, http_request_forward_body,  ana_list, ana_back, AN_REQ_HTTP_XFER_BODY);
+					__fallthrough;
+				case AN_REQ_WAIT_CLI:
+					ANALYZE    (s, req, pcli_wait_for_request,      ana_list, ana_back, AN_REQ_WAIT_CLI);
+					__fallthrough;
+				case AN_REQ_FLT_XFER_DATA:
+					ANALYZE    (s, req, flt_xfer_data,              ana_list, ana_back, AN_REQ_FLT_XFER_DATA);
+					__fallthrough;
+				case AN_REQ_FLT_END:
+					ANALYZE    (s, req, flt_end_analyze,            ana_list, ana_back, AN_REQ_FLT_END);
+				}
 				break;
 			}
 		}
@@ -2088,17 +2168,45 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 			ana_list = ana_back = res->analysers;
 			while (ana_list && max_loops--) {
 				/* Warning! ensure that analysers are always placed in ascending order! */
-				ANALYZE    (s, res, flt_start_analyze,          ana_list, ana_back, AN_RES_FLT_START_FE);
-				ANALYZE    (s, res, flt_start_analyze,          ana_list, ana_back, AN_RES_FLT_START_BE);
-				FLT_ANALYZE(s, res, tcp_inspect_response,       ana_list, ana_back, AN_RES_INSPECT);
-				FLT_ANALYZE(s, res, http_wait_for_response,     ana_list, ana_back, AN_RES_WAIT_HTTP);
-				FLT_ANALYZE(s, res, process_store_rules,        ana_list, ana_back, AN_RES_STORE_RULES);
-				FLT_ANALYZE(s, res, http_process_res_common,    ana_list, ana_back, AN_RES_HTTP_PROCESS_BE, s->be);
-				ANALYZE    (s, res, flt_analyze_http_headers,   ana_list, ana_back, AN_RES_FLT_HTTP_HDRS);
-				ANALYZE    (s, res, http_response_forward_body, ana_list, ana_back, AN_RES_HTTP_XFER_BODY);
-				ANALYZE    (s, res, pcli_wait_for_response,     ana_list, ana_back, AN_RES_WAIT_CLI);
-				ANALYZE    (s, res, flt_xfer_data,              ana_list, ana_back, AN_RES_FLT_XFER_DATA);
-				ANALYZE    (s, res, flt_end_analyze,            ana_list, ana_back, AN_RES_FLT_END);
+				/* Same dispatch logic as for the request channel
+				 * above: jump straight to the lowest enabled
+				 * analyser.
+				 */
+				switch (ana_list & ~(ana_list - 1)) {
+				default: /* only the bits listed below may be set */
+				case AN_RES_FLT_START_FE:
+					ANALYZE    (s, res, flt_start_analyze,          ana_list, ana_back, AN_RES_FLT_START_FE);
+					__fallthrough;
+				case AN_RES_FLT_START_BE:
+					ANALYZE    (s, res, flt_start_analyze,          ana_list, ana_back, AN_RES_FLT_START_BE);
+					__fallthrough;
+				case AN_RES_INSPECT:
+					FLT_ANALYZE(s, res, tcp_inspect_response,       ana_list, ana_back, AN_RES_INSPECT);
+					__fallthrough;
+				case AN_RES_WAIT_HTTP:
+					FLT_ANALYZE(s, res, http_wait_for_response,     ana_list, ana_back, AN_RES_WAIT_HTTP);
+					__fallthrough;
+				case AN_RES_STORE_RULES:
+					FLT_ANALYZE(s, res, process_store_rules,        ana_list, ana_back, AN_RES_STORE_RULES);
+					__fallthrough;
+				case AN_RES_HTTP_PROCESS_BE:
+					FLT_ANALYZE(s, res, http_process_res_common,    ana_list, ana_back, AN_RES_HTTP_PROCESS_BE, s->be);
+					__fallthrough;
+				case AN_RES_FLT_HTTP_HDRS:
+					ANALYZE    (s, res, flt_analyze_http_headers,   ana_list, ana_back, AN_RES_FLT_HTTP_HDRS);
+					__fallthrough;
+				case AN_RES_HTTP_XFER_BODY:
+					ANALYZE    (s, res, http_response_forward_body, ana_list, ana_back, AN_RES_HTTP_XFER_BODY);
+					__fallthrough;
+				case AN_RES_WAIT_CLI:
+					ANALYZE    (s, res, pcli_wait_for_response,     ana_list, ana_back, AN_RES_WAIT_CLI);
+					__fallthrough;
+				case AN_RES_FLT_XFER_DATA:
+					ANALYZE    (s, res, flt_xfer_data,              ana_list, ana_back, AN_RES_FLT_XFER_DATA);
+					__fallthrough;
+				case AN_RES_FLT_END:
+					ANALYZE    (s, res, flt_end_analyze,            ana_list, ana_back, AN_RES_FLT_END);
+				}
 				break;
 			}
 		}
@@ -2323,7 +2431,7 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 	if (sc_state_in(scb->state, SC_SB_REQ|SC_SB_QUE|SC_SB_TAR|SC_SB_ASS)) {
 		/* prune the request variables and swap to the response variables. */
 		if (s->vars_reqres.scope != SCOPE_RES) {
-			if (!LIST_ISEMPTY(&s->vars_reqres.head))
+			if (!eb_is_empty(&s->vars_reqres.name_root))
 				vars_prune(&s->vars_reqres, s->sess, s);
 			vars_init_head(&s->vars_reqres, SCOPE_RES);
 		}
@@ -2620,6 +2728,9 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 				_HA_ATOMIC_INC(&s->be->be_counters.p.http.rsp[n]);
 				_HA_ATOMIC_INC(&s->be->be_counters.p.http.cum_req);
 			}
+
+			if (s->host_stats)
+				_HA_ATOMIC_INC(&s->host_stats->rsp[n]);
 		}
 
 		/* let's do a final log if we need it */
@@ -2685,6 +2796,9 @@ void stream_update_time_stats(struct stream *s)
 		HA_ATOMIC_UPDATE_MAX(&srv->counters.ctime_max, t_connect);
 		HA_ATOMIC_UPDATE_MAX(&srv->counters.dtime_max, t_data);
 		HA_ATOMIC_UPDATE_MAX(&srv->counters.ttime_max, t_close);
+		tm_hist_add(srv->counters.ctime_hist, t_connect);
+		tm_hist_add(srv->counters.dtime_hist, t_data);
+		tm_hist_add(srv->counters.ttime_hist, t_close);
 	}
 	samples_window = (((s->be->mode == PR_MODE_HTTP) ?
 		s->be->be_counters.p.http.cum_req : s->be->be_counters.cum_lbconn) > TIME_STATS_SAMPLES) ? TIME_STATS_SAMPLES : 0;
@@ -2696,6 +2810,9 @@ void stream_update_time_stats(struct stream *s)
 	HA_ATOMIC_UPDATE_MAX(&s->be->be_counters.ctime_max, t_connect);
 	HA_ATOMIC_UPDATE_MAX(&s->be->be_counters.dtime_max, t_data);
 	HA_ATOMIC_UPDATE_MAX(&s->be->be_counters.ttime_max, t_close);
+	tm_hist_add(s->be->be_counters.ctime_hist, t_connect);
+	tm_hist_add(s->be->be_counters.dtime_hist, t_data);
+	tm_hist_add(s->be->be_counters.ttime_hist, t_close);
 }
 
 /*
@@ -2956,6 +3073,50 @@ struct ist stream_generate_unique_id(struct stream *strm, struct list *format)
 	}
 }
 
+/* Returns the canonical text form of the stream's source address as an ist,
+ * converting and memoizing it in the stream on first use so that the XFF and
+ * Forwarded headers and the logs do not each redo the conversion. The memo is
+ * keyed on the raw address, thus a "set-src" rule executed between two uses
+ * transparently refreshes it. IST_NULL is returned when the stream has no
+ * source address or an unsupported family.
+ */
+struct ist stream_src_txt(struct stream *s)
+{
+	const struct sockaddr_storage *src = sc_src(s->scf);
+
+	if (!src)
+		return IST_NULL;
+
+	if (src->ss_family == AF_INET) {
+		const struct in_addr *a = &((const struct sockaddr_in *)src)->sin_addr;
+
+		if (!s->src_txt.len || s->src_txt.family != AF_INET ||
+		    s->src_txt.addr.v4.s_addr != a->s_addr) {
+			const unsigned char *pn = (const unsigned char *)a;
+
+			s->src_txt.len = snprintf(s->src_txt.str, sizeof(s->src_txt.str),
+						  "%d.%d.%d.%d", pn[0], pn[1], pn[2], pn[3]);
+			s->src_txt.family = AF_INET;
+			s->src_txt.addr.v4 = *a;
+		}
+	}
+	else if (src->ss_family == AF_INET6) {
+		const struct in6_addr *a = &((const struct sockaddr_in6 *)src)->sin6_addr;
+
+		if (!s->src_txt.len || s->src_txt.family != AF_INET6 ||
+		    memcmp(&s->src_txt.addr.v6, a, sizeof(*a)) != 0) {
+			inet_ntop(AF_INET6, a, s->src_txt.str, sizeof(s->src_txt.str));
+			s->src_txt.len = strlen(s->src_txt.str);
+			s->src_txt.family = AF_INET6;
+			s->src_txt.addr.v6 = *a;
+		}
+	}
+	else
+		return IST_NULL;
+
+	return ist2(s->src_txt.str, s->src_txt.len);
+}
+
 /************************************************************************/
 /*           All supported ACL keywords must be declared here.          */
 /************************************************************************/
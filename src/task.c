@@ -19,6 +19,7 @@
 #include <haproxy/cfgparse.h>
 #include <haproxy/clock.h>
 #include <haproxy/fd.h>
+#include <haproxy/init.h>
 #include <haproxy/list.h>
 #include <haproxy/pool.h>
 #include <haproxy/task.h>
@@ -216,7 +217,32 @@ void __task_wakeup(struct task *t)
 	int thr __maybe_unused = t->tid >= 0 ? t->tid : tid;
 
 #ifdef USE_THREAD
-	if (thr != tid) {
+	if (thr != tid && likely(!t->nice)) {
+		/* Lock-free cross-thread wakeup: bound tasks without a nice
+		 * value do not need an ordered insertion in the remote tree,
+		 * so they go through the target thread's MPSC shared tasklet
+		 * list with a single atomic exchange instead of the locked
+		 * tree, exactly like task_kill() does. Niced tasks keep the
+		 * tree so their boosted position is preserved.
+		 */
+		if (_HA_ATOMIC_LOAD(&ha_thread_ctx[thr].flags) & TH_FL_TASK_PROFILING)
+			t->wake_date = now_mono_time();
+
+		/* Beware: tasks that have never run don't have their ->list empty yet! */
+		MT_LIST_APPEND(&ha_thread_ctx[thr].shared_tasklet_list,
+		               list_to_mt_list(&((struct tasklet *)t)->list));
+		_HA_ATOMIC_INC(&ha_thread_ctx[thr].rq_total);
+		_HA_ATOMIC_INC(&ha_thread_ctx[thr].tasks_in_list);
+		wake_thread(thr);
+		return;
+	}
+
+	/* work stealing only considers the shared run queues since the local
+	 * ones are lock-free, so when it is enabled, non-affine tasks have to
+	 * be queued there even for the local thread so that an idle sibling
+	 * may pick them up.
+	 */
+	if (thr != tid || (t->tid < 0 && global.tune.sched_steal_batch)) {
 		root = &ha_thread_ctx[thr].rqueue_shared;
 
 		_HA_ATOMIC_INC(&ha_thread_ctx[thr].rq_total);
@@ -245,18 +271,41 @@ void __task_wakeup(struct task *t)
 	eb32_insert(root, &t->rq);
 
 #ifdef USE_THREAD
-	if (thr != tid) {
+	if (root == &ha_thread_ctx[thr].rqueue_shared) {
 		HA_SPIN_UNLOCK(TASK_RQ_LOCK, &ha_thread_ctx[thr].rqsh_lock);
 
 		/* If all threads that are supposed to handle this task are sleeping,
 		 * wake one.
 		 */
-		wake_thread(thr);
+		if (thr != tid)
+			wake_thread(thr);
 	}
 #endif
 	return;
 }
 
+/* Returns the wait queue key to use for a task whose expiration date is
+ * <expire>. When tune.sched.timer-granularity is set, timers at least eight
+ * granularity units away are rounded up to the next multiple of the
+ * granularity, so that the huge amounts of coarse timeouts found on busy
+ * processes (client/server/http timeouts all use second-level resolutions)
+ * collapse into duplicates of a small set of keys. Duplicate keys are chained
+ * under a common node in the tree, which keeps their insertion cost almost
+ * constant and considerably shrinks the tree. Rounding is only ever done
+ * upwards so a task may never be woken up before its expiration date, and
+ * timers close to their expiration are left untouched so that precise ones
+ * (rare but latency-sensitive) keep their accuracy: the relative error is
+ * always bounded by 1/8.
+ */
+static inline int task_wq_key(int expire)
+{
+	uint gran = global.tune.sched_timer_gran;
+
+	if (gran > 1 && (int)(expire - now_ms) > (int)(8 * gran))
+		expire += (gran - ((uint)expire % gran)) % gran;
+	return expire;
+}
+
 /*
  * __task_queue()
  *
@@ -288,7 +337,7 @@ void __task_queue(struct task *task, struct eb_root *wq)
 		__task_unlink_wq(task);
 
 	/* the task is not in the queue now */
-	task->wq.key = task->expire;
+	task->wq.key = task_wq_key(task->expire);
 #ifdef DEBUG_CHECK_INVALID_EXPIRATION_DATES
 	if (tick_is_lt(task->wq.key, now_ms))
 		/* we're queuing too far away or in the past (most likely) */
@@ -298,6 +347,124 @@ void __task_queue(struct task *task, struct eb_root *wq)
 	eb32_insert(wq, &task->wq);
 }
 
+/* The coarse timer wheel. Each thread has its own wheel made of a small
+ * number of buckets, each covering a fixed slice of time, into which coarse
+ * timers (struct ctimer) are hashed by their expiration date. Arming and
+ * disarming are thus constant-time list operations, contrary to the timer
+ * ebtree whose population and churn grow with the number of connections.
+ * Timers whose date is beyond one full turn of the wheel simply alias into
+ * their bucket and are skipped when the bucket is visited too early, which
+ * costs at most one extra visit per turn. The wheel is only ever serviced by
+ * its owner thread; remote threads may only remove an entry (mt_list).
+ */
+#define CTIMER_GRAN_BITS 8                  /* bucket width: 256 ms */
+#define CTIMER_BUCKETS  64                  /* must be a power of two; one turn covers ~16s */
+
+static THREAD_LOCAL struct {
+	struct mt_list buckets[CTIMER_BUCKETS];
+	uint last;  /* bucket date (now_ms >> CTIMER_GRAN_BITS) of the last service */
+	int ready;  /* non-zero once the buckets above were initialized */
+} ctimer_wheel;
+
+/* Arms coarse timer <ct> to expire at <expire> by (re-)queuing it into the
+ * current thread's wheel. See the doc in task.h.
+ */
+void ctimer_queue(struct ctimer *ct, int expire)
+{
+	uint bucket;
+
+	BUG_ON(!tick_isset(expire));
+	BUG_ON(!ctimer_wheel.ready);
+
+	if (MT_LIST_INLIST(&ct->list)) {
+		if (ct->expire == expire)
+			return;
+		MT_LIST_DELETE(&ct->list);
+	}
+
+	/* round the date up to the next bucket boundary: a bucket is visited
+	 * when the boundary preceding it is crossed, so this guarantees the
+	 * timer may only fire once its date is passed.
+	 */
+	bucket = ((uint)expire + (1 << CTIMER_GRAN_BITS) - 1) >> CTIMER_GRAN_BITS;
+
+	/* dates in the past or within the current bucket go to the next
+	 * bucket to be visited so that they fire on the next turn of the
+	 * polling loop crossing a bucket boundary.
+	 */
+	if ((int)(bucket - ctimer_wheel.last) <= 0)
+		bucket = ctimer_wheel.last + 1;
+
+	ct->expire = expire;
+	MT_LIST_APPEND(&ctimer_wheel.buckets[bucket & (CTIMER_BUCKETS - 1)], &ct->list);
+}
+
+/* Walks the buckets the current thread's wheel has crossed since the last
+ * call and wakes up the tasks of all expired coarse timers found there.
+ * Entries aliased from a later turn are left in place. Expired entries are
+ * unlinked before their task is woken, like regular timers, so it is up to
+ * the task to re-arm its timer if needed.
+ */
+static void wake_expired_ctimers(void)
+{
+	uint now_bucket = (uint)now_ms >> CTIMER_GRAN_BITS;
+	struct mt_list *elt1;
+	struct mt_list elt2;
+	struct ctimer *ct;
+
+	if (!ctimer_wheel.ready || ctimer_wheel.last == now_bucket)
+		return;
+
+	/* after a long stall, one full turn is enough to visit everything */
+	if (now_bucket - ctimer_wheel.last > CTIMER_BUCKETS)
+		ctimer_wheel.last = now_bucket - CTIMER_BUCKETS;
+
+	while (ctimer_wheel.last != now_bucket) {
+		ctimer_wheel.last++;
+		mt_list_for_each_entry_safe(ct, &ctimer_wheel.buckets[ctimer_wheel.last & (CTIMER_BUCKETS - 1)], list, elt1, elt2) {
+			if (tick_is_expired(ct->expire, now_ms)) {
+				MT_LIST_DELETE_SAFE(elt1);
+				task_wakeup(ct->task, TASK_WOKEN_TIMER);
+			}
+		}
+	}
+}
+
+/* Returns the date of the next bucket boundary at which a non-empty bucket
+ * of the current thread's wheel will be serviced, or TICK_ETERNITY if the
+ * wheel is empty. Aliased entries may cause at most one early wakeup per
+ * turn of the wheel, which is harmless.
+ */
+static int next_ctimer_expiry(void)
+{
+	uint bucket;
+	int date;
+
+	if (!ctimer_wheel.ready)
+		return TICK_ETERNITY;
+
+	for (bucket = ctimer_wheel.last + 1; bucket != ctimer_wheel.last + CTIMER_BUCKETS + 1; bucket++) {
+		if (!MT_LIST_ISEMPTY(&ctimer_wheel.buckets[bucket & (CTIMER_BUCKETS - 1)])) {
+			date = bucket << CTIMER_GRAN_BITS;
+			return tick_isset(date) ? date : 1;
+		}
+	}
+	return TICK_ETERNITY;
+}
+
+/* initializes the current thread's coarse timer wheel */
+static int init_ctimers_per_thread()
+{
+	int i;
+
+	for (i = 0; i < CTIMER_BUCKETS; i++)
+		MT_LIST_INIT(&ctimer_wheel.buckets[i]);
+	ctimer_wheel.last = (uint)now_ms >> CTIMER_GRAN_BITS;
+	ctimer_wheel.ready = 1;
+	return 1;
+}
+REGISTER_PER_THREAD_INIT(init_ctimers_per_thread);
+
 /*
  * Extract all expired timers from the timer queue, and wakes up all
  * associated tasks.
@@ -310,6 +477,8 @@ void wake_expired_tasks()
 	struct eb32_node *eb;
 	__decl_thread(int key);
 
+	wake_expired_ctimers();
+
 	while (1) {
 		if (max_processed-- <= 0)
 			goto leave;
@@ -349,7 +518,7 @@ void wake_expired_tasks()
 			__task_unlink_wq(task);
 			task_wakeup(task, TASK_WOKEN_TIMER);
 		}
-		else if (task->expire != eb->key) {
+		else if (task_wq_key(task->expire) != eb->key) {
 			/* task is not expired but its key doesn't match so let's
 			 * update it and skip to next apparently expired task.
 			 */
@@ -434,7 +603,7 @@ void wake_expired_tasks()
 			HA_RWLOCK_WRTOSK(TASK_WQ_LOCK, &wq_lock);
 			task_drop_running(task, TASK_WOKEN_TIMER);
 		}
-		else if (task->expire != eb->key) {
+		else if (task_wq_key(task->expire) != eb->key) {
 			/* task is not expired but its key doesn't match so let's
 			 * update it and skip to next apparently expired task.
 			 */
@@ -497,6 +666,7 @@ int next_timer_expiry()
 			ret = tick_first(ret, key);
 	}
 #endif
+	ret = tick_first(ret, next_ctimer_expiry());
 	return ret;
 }
 
@@ -673,6 +843,73 @@ unsigned int run_tasks_from_lists(unsigned int budgets[])
 	return done;
 }
 
+#ifdef USE_THREAD
+/* Tries to steal up to global.tune.sched_steal_batch non-affine tasks (i.e.
+ * those whose tid is negative) from the shared run queues of the other threads
+ * of the current thread's group, and appends them to the local TL_NORMAL
+ * tasklet list, exactly like process_runnable_tasks() does when picking from
+ * its own queues. Only called when the local thread has nothing to do, so the
+ * cost of walking a sibling's tree is always amortized against otherwise idle
+ * cycles. Siblings' locks are only tried, never waited for, so a busy victim
+ * is simply skipped. Returns the number of tasks stolen.
+ */
+static unsigned int task_steal_from_siblings(void)
+{
+	struct thread_ctx * const tt = th_ctx;
+	unsigned int budget = global.tune.sched_steal_batch;
+	unsigned int stolen = 0;
+	unsigned int picked;
+	struct eb32_node *node, *next;
+	struct task *t;
+	uint thr;
+
+	for (thr = ti->tg->base; thr < ti->tg->base + ti->tg->count && stolen < budget; thr++) {
+		struct thread_ctx *vt = &ha_thread_ctx[thr];
+
+		if (thr == tid)
+			continue;
+
+		if (eb_is_empty(&vt->rqueue_shared))
+			continue;
+
+		if (HA_SPIN_TRYLOCK(TASK_RQ_LOCK, &vt->rqsh_lock))
+			continue;
+
+		picked = 0;
+		node = eb32_first(&vt->rqueue_shared);
+		while (node && stolen + picked < budget) {
+			next = eb32_next(node);
+			t = eb32_entry(node, struct task, rq);
+			if (t->tid < 0) {
+				/* non-affine task, we may take it */
+				eb32_delete(&t->rq);
+				/* siblings belong to our group so this is our counter */
+				if (t->nice)
+					_HA_ATOMIC_DEC(&tg_ctx->niced_tasks);
+				LIST_APPEND(&tt->tasklets[TL_NORMAL], &((struct tasklet *)t)->list);
+				picked++;
+			}
+			node = next;
+		}
+
+		HA_SPIN_UNLOCK(TASK_RQ_LOCK, &vt->rqsh_lock);
+
+		if (picked) {
+			_HA_ATOMIC_SUB(&vt->rq_total, picked);
+			stolen += picked;
+		}
+	}
+
+	if (stolen) {
+		tt->tl_class_mask |= 1 << TL_NORMAL;
+		_HA_ATOMIC_ADD(&tt->rq_total, stolen);
+		_HA_ATOMIC_ADD(&tt->tasks_in_list, stolen);
+		activity[tid].tasksw += stolen;
+	}
+	return stolen;
+}
+#endif
+
 /* The run queue is chronologically sorted in a tree. An insertion counter is
  * used to assign a position to each task. This counter may be combined with
  * other variables (eg: nice value) to set the final position in the tree. The
@@ -696,7 +933,7 @@ void process_runnable_tasks()
 		[TL_URGENT] = 64, // ~50% of CPU bandwidth for I/O
 		[TL_NORMAL] = 48, // ~37% of CPU bandwidth for tasks
 		[TL_BULK]   = 16, // ~13% of CPU bandwidth for self-wakers
-		[TL_HEAVY]  = 1,  // never more than 1 heavy task at once
+		[TL_HEAVY]  = 1,  // never more than sched_heavy_per_loop at once
 	};
 	unsigned int max[TL_CLASSES]; // max to be run per class
 	unsigned int max_total;       // sum of max above
@@ -709,10 +946,26 @@ void process_runnable_tasks()
 
 	_HA_ATOMIC_AND(&th_ctx->flags, ~TH_FL_STUCK); // this thread is still running
 
+	/* refill the wakeup coalescing budget: I/O handlers may spend it to
+	 * make stream tasks run during this pass instead of transiting via
+	 * the run queue again (see tune.sched.inline-depth).
+	 */
+	tt->sched_inline_credit = global.tune.sched_inline_depth;
+
 	if (!thread_has_tasks()) {
+#ifdef USE_THREAD
+		/* work stealing enabled: before going idle, try to pick some
+		 * non-affine work left over on an overloaded sibling.
+		 */
+		if (global.tune.sched_steal_batch && task_steal_from_siblings())
+			goto has_work;
+#endif
 		activity[tid].empty_rq++;
 		return;
 	}
+#ifdef USE_THREAD
+ has_work:
+#endif
 
 	max_processed = global.tune.runqueue_depth;
 
@@ -743,13 +996,16 @@ void process_runnable_tasks()
 	if ((tt->tl_class_mask & (1 << TL_BULK)))
 		max[TL_BULK] = default_weights[TL_BULK];
 
-	/* heavy tasks are processed only once and never refilled in a
-	 * call round. That budget is not lost either as we don't reset
-	 * it unless consumed.
+	/* heavy tasks are processed only once per call round and never
+	 * refilled. That budget is not lost either as we don't reset it
+	 * unless consumed. It defaults to a single task per loop and may
+	 * be enlarged with "tune.sched.heavy-per-loop" by those preferring
+	 * to clear handshake storms faster at the expense of the latency
+	 * of the other tasks.
 	 */
 	if (!heavy_queued) {
 		if ((tt->tl_class_mask & (1 << TL_HEAVY)))
-			max[TL_HEAVY] = default_weights[TL_HEAVY];
+			max[TL_HEAVY] = global.tune.sched_heavy_per_loop;
 		else
 			max[TL_HEAVY] = 0;
 		heavy_queued = 1;
@@ -770,11 +1026,11 @@ void process_runnable_tasks()
 	for (queue = 0; queue < TL_CLASSES; queue++)
 		max[queue]  = ((unsigned)max_processed * max[queue] + max_total - 1) / max_total;
 
-	/* The heavy queue must never process more than one task at once
-	 * anyway.
+	/* The heavy queue must never process more than the configured
+	 * heavy tasks budget at once anyway.
 	 */
-	if (max[TL_HEAVY] > 1)
-		max[TL_HEAVY] = 1;
+	if (max[TL_HEAVY] > global.tune.sched_heavy_per_loop)
+		max[TL_HEAVY] = global.tune.sched_heavy_per_loop;
 
 	lrq = grq = NULL;
 
@@ -927,6 +1183,25 @@ static void init_task()
 	}
 }
 
+/* config parser for global "tune.sched.bulk-ssl-io", accepts "on" or "off" */
+static int cfg_parse_tune_sched_bulk_ssl_io(char **args, int section_type, struct proxy *curpx,
+                                      const struct proxy *defpx, const char *file, int line,
+                                      char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		global.tune.options |= GTUNE_SCHED_BULK_SSL;
+	else if (strcmp(args[1], "off") == 0)
+		global.tune.options &= ~GTUNE_SCHED_BULK_SSL;
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
+}
+
 /* config parser for global "tune.sched.low-latency", accepts "on" or "off" */
 static int cfg_parse_tune_sched_low_latency(char **args, int section_type, struct proxy *curpx,
                                       const struct proxy *defpx, const char *file, int line,
@@ -946,9 +1221,108 @@ static int cfg_parse_tune_sched_low_latency(char **args, int section_type, struc
 	return 0;
 }
 
+/* config parser for global "tune.sched.steal-batch", accepts a number of
+ * tasks from 0 (disabled) to 1024.
+ */
+static int cfg_parse_tune_sched_steal_batch(char **args, int section_type, struct proxy *curpx,
+                                      const struct proxy *defpx, const char *file, int line,
+                                      char **err)
+{
+	int batch;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	batch = atoi(args[1]);
+	if (batch < 0 || batch > 1024) {
+		memprintf(err, "'%s' expects a value between 0 and 1024 but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+
+	global.tune.sched_steal_batch = batch;
+	return 0;
+}
+
+/* config parser for global "tune.sched.heavy-per-loop", accepts a number of
+ * tasks from 1 to 64.
+ */
+static int cfg_parse_tune_sched_heavy_per_loop(char **args, int section_type, struct proxy *curpx,
+                                      const struct proxy *defpx, const char *file, int line,
+                                      char **err)
+{
+	int budget;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	budget = atoi(args[1]);
+	if (budget < 1 || budget > 64) {
+		memprintf(err, "'%s' expects a value between 1 and 64 but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+
+	global.tune.sched_heavy_per_loop = budget;
+	return 0;
+}
+
+/* config parser for global "tune.sched.inline-depth", accepts a number of
+ * wakeups from 0 (disabled) to 1024.
+ */
+static int cfg_parse_tune_sched_inline_depth(char **args, int section_type, struct proxy *curpx,
+                                      const struct proxy *defpx, const char *file, int line,
+                                      char **err)
+{
+	int depth;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	depth = atoi(args[1]);
+	if (depth < 0 || depth > 1024) {
+		memprintf(err, "'%s' expects a value between 0 and 1024 but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+
+	global.tune.sched_inline_depth = depth;
+	return 0;
+}
+
+/* config parser for global "tune.sched.timer-granularity", accepts a time
+ * value from 0 (disabled) to 60s.
+ */
+static int cfg_parse_tune_sched_timer_gran(char **args, int section_type, struct proxy *curpx,
+                                      const struct proxy *defpx, const char *file, int line,
+                                      char **err)
+{
+	const char *res;
+	unsigned int gran;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	res = parse_time_err(args[1], &gran, TIME_UNIT_MS);
+	if (res == PARSE_TIME_OVER || gran > 60000) {
+		memprintf(err, "timer <%s> to argument <%s> of '%s' overflows, maximum value is 60000 ms",
+			  args[1], args[0], args[0]);
+		return -1;
+	}
+	else if (res) {
+		memprintf(err, "unexpected character '%c' in argument <%s> of '%s'", *res, args[0], args[0]);
+		return -1;
+	}
+
+	global.tune.sched_timer_gran = gran;
+	return 0;
+}
+
 /* config keyword parsers */
 static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.sched.bulk-ssl-io", cfg_parse_tune_sched_bulk_ssl_io },
+	{ CFG_GLOBAL, "tune.sched.heavy-per-loop", cfg_parse_tune_sched_heavy_per_loop },
+	{ CFG_GLOBAL, "tune.sched.inline-depth", cfg_parse_tune_sched_inline_depth },
 	{ CFG_GLOBAL, "tune.sched.low-latency", cfg_parse_tune_sched_low_latency },
+	{ CFG_GLOBAL, "tune.sched.steal-batch", cfg_parse_tune_sched_steal_batch },
+	{ CFG_GLOBAL, "tune.sched.timer-granularity", cfg_parse_tune_sched_timer_gran },
 	{ 0, NULL, NULL }
 }};
 
@@ -68,6 +68,7 @@ volatile unsigned int rdv_requests       = 0;  // total number of threads reques
 volatile unsigned int isolated_thread    = ~0; // ID of the isolated thread, or ~0 when none
 THREAD_LOCAL unsigned int  tgid          = 1; // thread ID starts at 1
 THREAD_LOCAL unsigned int  tid           = 0;
+unsigned int lock_contention[LOCK_LABELS] = { }; // contended acquisitions per label
 int thread_cpus_enabled_at_boot          = 1;
 static pthread_t ha_pthread[MAX_THREADS] = { };
 
@@ -395,14 +396,8 @@ int thread_cpu_mask_forced()
 #endif
 }
 
-/* Below come the lock-debugging functions */
-
-#if defined(DEBUG_THREAD) || defined(DEBUG_FULL)
-
-struct lock_stat lock_stats[LOCK_LABELS];
-
-/* this is only used below */
-static const char *lock_label(enum lock_label label)
+/* returns the human-readable name of lock label <label> */
+const char *lock_label(enum lock_label label)
 {
 	switch (label) {
 	case TASK_RQ_LOCK:         return "TASK_RQ";
@@ -430,7 +425,6 @@ static const char *lock_label(enum lock_label label)
 	case PID_LIST_LOCK:        return "PID_LIST";
 	case EMAIL_ALERTS_LOCK:    return "EMAIL_ALERTS";
 	case PIPES_LOCK:           return "PIPES";
-	case TLSKEYS_REF_LOCK:     return "TLSKEYS_REF";
 	case AUTH_LOCK:            return "AUTH";
 	case LOGSRV_LOCK:          return "LOGSRV";
 	case DICT_LOCK:            return "DICT";
@@ -443,6 +437,8 @@ static const char *lock_label(enum lock_label label)
 	case IDLE_CONNS_LOCK:      return "IDLE_CONNS";
 	case QUIC_LOCK:            return "QUIC";
 	case OCSP_LOCK:            return "OCSP";
+	case CACHE_LOCK:           return "CACHE";
+	case HOST_STATS_LOCK:      return "HOST_STATS";
 	case OTHER_LOCK:           return "OTHER";
 	case DEBUG1_LOCK:          return "DEBUG1";
 	case DEBUG2_LOCK:          return "DEBUG2";
@@ -455,6 +451,12 @@ static const char *lock_label(enum lock_label label)
 	abort();
 }
 
+/* Below come the lock-debugging functions */
+
+#if defined(DEBUG_THREAD) || defined(DEBUG_FULL)
+
+struct lock_stat lock_stats[LOCK_LABELS];
+
 void show_lock_stats()
 {
 	int lbl;
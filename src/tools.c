@@ -2094,6 +2094,38 @@ int url_decode(char *string, int in_form)
 
 	in = string;
 	out = string;
+
+#ifdef HA_UNALIGNED_LE64
+	/* speedup: until the first '%', '+' or '?', the string is decoded onto
+	 * itself so there is nothing to rewrite. First walk to a word boundary
+	 * so that the loads below are aligned and cannot cross a page past the
+	 * trailing zero, then skip words of plain bytes at once. The loop
+	 * stops on the word containing the first interesting character (or the
+	 * zero), which the byte-by-byte loop below will handle.
+	 */
+	while (((uintptr_t)in & (sizeof(long) - 1)) &&
+	       *in && *in != '%' && *in != '+' && *in != '?')
+		in++;
+
+	if (!((uintptr_t)in & (sizeof(long) - 1))) {
+		while (1) {
+			unsigned long z = *(unsigned long *)in;     // zero
+			unsigned long p = z ^ 0x2525252525252525ULL; // '%'
+			unsigned long f = z ^ 0x2b2b2b2b2b2b2b2bULL; // '+'
+			unsigned long q = z ^ 0x3f3f3f3f3f3f3f3fULL; // '?'
+
+			z = (z - 0x0101010101010101ULL) & ~z; // contains 0x80 below a zero
+			p = (p - 0x0101010101010101ULL) & ~p; // contains 0x80 below a '%'
+			f = (f - 0x0101010101010101ULL) & ~f; // contains 0x80 below a '+'
+			q = (q - 0x0101010101010101ULL) & ~q; // contains 0x80 below a '?'
+
+			if ((z | p | f | q) & 0x8080808080808080ULL)
+				break;
+			in += sizeof(long);
+		}
+	}
+	out = in;
+#endif
 	while (*in) {
 		switch (*in) {
 		case '+' :
@@ -234,6 +234,15 @@ void __trace(enum trace_level level, uint64_t mask, struct trace_source *src,
 		return;
 	}
 
+	/* without a sink there is nobody to read the message: skip all the
+	 * formatting work, including the decode callbacks which are by far
+	 * the most expensive part, but keep the start/stop/lock-on state
+	 * machine running so that attaching a sink later resumes a
+	 * consistent trace.
+	 */
+	if (unlikely(!src->sink))
+		goto end;
+
 	/* log the logging location truncated to 10 chars from the right so that
 	 * the line number and the end of the file name are there.
 	 */
@@ -283,8 +292,7 @@ void __trace(enum trace_level level, uint64_t mask, struct trace_source *src,
 		line[words++] = msg;
 	}
 
-	if (src->sink)
-		sink_write(src->sink, line, words, 0, 0, NULL);
+	sink_write(src->sink, line, words, 0, 0, NULL);
 
  end:
 	/* check if we need to stop the trace now */
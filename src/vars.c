@@ -1,5 +1,7 @@
 #include <ctype.h>
 
+#include <import/eb64tree.h>
+
 #include <haproxy/api.h>
 #include <haproxy/arg.h>
 #include <haproxy/buf.h>
@@ -178,7 +180,7 @@ unsigned int var_clear(struct var *var, int force)
 	var->data.type = SMP_T_ANY;
 
 	if (!(var->flags & VF_PERMANENT) || force) {
-		LIST_DELETE(&var->l);
+		eb64_delete(&var->node);
 		pool_free(var_pool, var);
 		size += sizeof(struct var);
 	}
@@ -190,11 +192,15 @@ unsigned int var_clear(struct var *var, int force)
  */
 void vars_prune(struct vars *vars, struct session *sess, struct stream *strm)
 {
-	struct var *var, *tmp;
+	struct eb64_node *node;
+	struct var *var;
 	unsigned int size = 0;
 
 	vars_wrlock(vars);
-	list_for_each_entry_safe(var, tmp, &vars->head, l) {
+	node = eb64_first(&vars->name_root);
+	while (node) {
+		var = eb64_entry(node, struct var, node);
+		node = eb64_next(node);
 		size += var_clear(var, 1);
 	}
 	vars_wrunlock(vars);
@@ -206,11 +212,15 @@ void vars_prune(struct vars *vars, struct session *sess, struct stream *strm)
  */
 void vars_prune_per_sess(struct vars *vars)
 {
-	struct var *var, *tmp;
+	struct eb64_node *node;
+	struct var *var;
 	unsigned int size = 0;
 
 	vars_wrlock(vars);
-	list_for_each_entry_safe(var, tmp, &vars->head, l) {
+	node = eb64_first(&vars->name_root);
+	while (node) {
+		var = eb64_entry(node, struct var, node);
+		node = eb64_next(node);
 		size += var_clear(var, 1);
 	}
 	vars_wrunlock(vars);
@@ -224,7 +234,7 @@ void vars_prune_per_sess(struct vars *vars)
 /* This function initializes a variables list head */
 void vars_init_head(struct vars *vars, enum vars_scope scope)
 {
-	LIST_INIT(&vars->head);
+	vars->name_root = EB_ROOT;
 	vars->scope = scope;
 	vars->size = 0;
 	HA_RWLOCK_INIT(&vars->rwlock);
@@ -294,18 +304,17 @@ static int vars_hash_name(const char *name, int len, enum vars_scope *scope,
 	return 1;
 }
 
-/* This function returns the variable from the given list that matches
- * <name_hash> or returns NULL if not found. It's only a linked list since it
- * is not expected to have many variables per scope (a few tens at best).
- * The caller is responsible for ensuring that <vars> is properly locked.
+/* This function returns the variable from the given scope that matches
+ * <name_hash> or returns NULL if not found. The caller is responsible for
+ * ensuring that <vars> is properly locked.
  */
 static struct var *var_get(struct vars *vars, uint64_t name_hash)
 {
-	struct var *var;
+	struct eb64_node *node;
 
-	list_for_each_entry(var, &vars->head, l)
-		if (var->name_hash == name_hash)
-			return var;
+	node = eb64_lookup(&vars->name_root, name_hash);
+	if (node)
+		return eb64_entry(node, struct var, node);
 	return NULL;
 }
 
@@ -399,8 +408,8 @@ static int var_set(uint64_t name_hash, enum vars_scope scope, struct sample *smp
 		var = pool_alloc(var_pool);
 		if (!var)
 			goto unlock;
-		LIST_APPEND(&vars->head, &var->l);
-		var->name_hash = name_hash;
+		var->node.key = name_hash;
+		eb64_insert(&vars->name_root, &var->node);
 		var->flags = flags & VF_PERMANENT;
 		var->data.type = SMP_T_ANY;
 	}